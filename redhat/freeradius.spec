@@ -963,6 +963,7 @@ fi
 /usr/bin/radcrypt
 /usr/bin/radict
 /usr/bin/radlast
+/usr/bin/radperf
 /usr/bin/radsniff
 /usr/bin/radsqlrelay
 /usr/bin/radtest
@@ -973,6 +974,7 @@ fi
 %doc %{_mandir}/man1/dhcpclient.1.gz
 %doc %{_mandir}/man1/radclient.1.gz
 %doc %{_mandir}/man1/radlast.1.gz
+%doc %{_mandir}/man1/radperf.1.gz
 %doc %{_mandir}/man1/radtest.1.gz
 %doc %{_mandir}/man1/radwho.1.gz
 %doc %{_mandir}/man1/radzap.1.gz
@@ -1,5 +1,6 @@
 SUBMAKEFILES := \
     radclient.mk \
+    radperf.mk \
     radict.mk \
     radiusd.mk \
     radlast.mk \
@@ -31,14 +31,19 @@ RCSID("$Id$")
 
 #include <freeradius-devel/server/base.h>
 #include <freeradius-devel/server/dependency.h>
+#include <freeradius-devel/server/file_reload.h>
 #include <freeradius-devel/server/map_proc.h>
 #include <freeradius-devel/server/module.h>
 #include <freeradius-devel/server/radmin.h>
+#include <freeradius-devel/server/reload.h>
 #include <freeradius-devel/server/state.h>
 #include <freeradius-devel/server/virtual_servers.h>
 #include <freeradius-devel/util/debug.h>
+#include <freeradius-devel/util/log_async.h>
 #include <freeradius-devel/util/size.h>
 
+#include <freeradius-devel/io/master.h>
+
 #include <freeradius-devel/tls/base.h>
 #include <freeradius-devel/tls/log.h>
 
@@ -138,6 +143,8 @@ static int thread_instantiate(TALLOC_CTX *ctx, fr_event_list_t *el, UNUSED void
 #ifdef WITH_TLS
 	if (fr_openssl_thread_init(main_config->openssl_async_pool_init,
 				   main_config->openssl_async_pool_max) < 0) return -1;
+
+	if (fr_tls_offload_thread_init(ctx, el) < 0) return -1;
 #endif
 	return 0;
 }
@@ -201,6 +208,491 @@ static void fr_exit_after(fr_event_list_t *el, fr_time_t now, void *uctx)
 }
 #endif
 
+/*
+ *	Graceful reload.
+ *
+ *	On HUP we start a new copy of the server, and pass it our
+ *	listening sockets.  The new process reads the configuration,
+ *	re-uses any sockets which are still configured, and tells us
+ *	when it's ready.  We then stop reading packets, finish the
+ *	requests we already have, and exit.  The sockets are never
+ *	closed, so packets which arrive during the hand-over are queued
+ *	for the new process.
+ *
+ *	Our state entries aren't handed over, as they can hold things
+ *	like TLS sessions.  Instead, when the new process gets a
+ *	request with a State it doesn't know, it passes the packet back
+ *	to us over a socket pair.  We inject it into the listener for
+ *	the socket it arrived on, which processes it as if it had read
+ *	it, and sends the reply.  We keep running until our last state
+ *	entry has expired.  Retransmissions of such requests are passed
+ *	back too, so our duplicate detection handles them.
+ *
+ *	Retransmissions of requests without a State, which we were
+ *	processing at the hand-over, are processed again by the new
+ *	process.
+ */
+#define RELOAD_ENV_FDS		"FR_RELOAD_FDS"
+#define RELOAD_ENV_READY	"FR_RELOAD_READY"
+#define RELOAD_ENV_FORWARD	"FR_RELOAD_FORWARD"
+
+typedef struct {
+	main_config_t const	*config;	//!< of this process.
+	fr_schedule_t		*sc;		//!< to drain once the new process is ready.
+
+	char const		*exe;		//!< path of the program to run.
+	char			**argv;		//!< we were started with.
+
+	pid_t			pid;		//!< of the new process.  0 if there isn't one.
+	int			ready_fd;	//!< the new process writes its PID here when ready.
+	int			forward_fd;	//!< the new process passes packets for our sessions here.
+	fr_event_timer_t const	*ev;		//!< start timeout, or drain check.
+
+	bool			handed_over;	//!< the new process is handling packets.
+	fr_time_t		drain_start;	//!< when we stopped reading packets.
+	unsigned int		idle;		//!< number of drain checks which saw no active requests.
+} radiusd_reload_t;
+
+static radiusd_reload_t reload = { .ready_fd = -1, .forward_fd = -1 };
+
+/** The previous instance of the server, if we were started by a reload
+ */
+static int reload_parent_fd = -1;
+
+/** Write our PID to the PID file
+ *
+ */
+static int pid_file_write(main_config_t const *config)
+{
+	FILE *fp;
+
+	fp = fopen(config->pid_file, "w");
+	if (!fp) {
+		ERROR("Failed creating PID file %s: %s", config->pid_file, fr_syserror(errno));
+		return -1;
+	}
+
+	/*
+	 *  @fixme What about following symlinks,
+	 *  and having it over-write a normal file?
+	 */
+	fprintf(fp, "%d\n", (int) radius_pid);
+	fclose(fp);
+
+	return 0;
+}
+
+/** Find the program we were started as, so that a reload runs the current binary
+ *
+ */
+static char const *reload_exe_find(TALLOC_CTX *ctx, char const *argv0)
+{
+	char const	*path, *p, *q;
+	char		*exe;
+
+	if (strchr(argv0, FR_DIR_SEP)) return argv0;
+
+	path = getenv("PATH");
+	if (!path) return argv0;
+
+	for (p = path; *p; p = q) {
+		q = strchr(p, ':');
+		if (!q) q = p + strlen(p);
+
+		exe = talloc_asprintf(ctx, "%.*s/%s", (int) (q - p), p, argv0);
+		if (exe && (access(exe, X_OK) == 0)) return exe;
+		talloc_free(exe);
+
+		if (*q) q++;
+	}
+
+	return argv0;
+}
+
+/** Pick up the sockets passed to us by the previous instance of the server
+ *
+ */
+static void reload_inherit(main_config_t *config)
+{
+	char const	*fds, *ready, *forward;
+	char		*end;
+	long		fd;
+
+	fds = getenv(RELOAD_ENV_FDS);
+	ready = getenv(RELOAD_ENV_READY);
+	forward = getenv(RELOAD_ENV_FORWARD);
+	if (!ready) return;
+
+	fd = strtol(ready, &end, 10);
+	if ((*end != '\0') || (fd <= STDERR_FILENO)) {
+		WARN("Ignoring invalid %s", RELOAD_ENV_READY);
+		goto done;
+	}
+	reload_parent_fd = fd;
+	(void) fcntl(reload_parent_fd, F_SETFD, FD_CLOEXEC);
+
+	config->reload_inherited = true;
+
+	if (forward) {
+		fd = strtol(forward, &end, 10);
+		if ((*end != '\0') || (fd <= STDERR_FILENO)) {
+			WARN("Ignoring invalid %s", RELOAD_ENV_FORWARD);
+		} else {
+			(void) fcntl(fd, F_SETFD, FD_CLOEXEC);
+			fr_reload_forward_fd_set(fd);
+		}
+	}
+
+	for (end = UNCONST(char *, fds); end && *end; ) {
+		fd = strtol(end, &end, 10);
+		while (*end == ' ') end++;
+
+		if (fr_socket_inherit(fd) < 0) {
+			PWARN("Ignoring inherited socket");
+			if (fd > STDERR_FILENO) close(fd);
+		}
+	}
+
+done:
+	unsetenv(RELOAD_ENV_FDS);
+	unsetenv(RELOAD_ENV_READY);
+	unsetenv(RELOAD_ENV_FORWARD);
+}
+
+/** Tell the previous instance of the server that we're handling packets
+ *
+ */
+static int reload_ready(void)
+{
+	pid_t	pid = getpid();
+
+	if (reload_parent_fd < 0) return 0;
+
+	if (write(reload_parent_fd, &pid, sizeof(pid)) != sizeof(pid)) {
+		ERROR("Failed informing the previous server process that we're ready: %s",
+		      fr_syserror(errno));
+		close(reload_parent_fd);
+		reload_parent_fd = -1;
+		return -1;
+	}
+
+	close(reload_parent_fd);
+	reload_parent_fd = -1;
+
+	return 0;
+}
+
+static void reload_stop(radiusd_reload_t *r, fr_event_list_t *el)
+{
+	if (r->ready_fd >= 0) {
+		(void) fr_event_fd_delete(el, r->ready_fd, FR_EVENT_FILTER_IO);
+		close(r->ready_fd);
+		r->ready_fd = -1;
+	}
+	fr_event_timer_delete(&r->ev);
+	r->pid = 0;
+}
+
+static void reload_failed(radiusd_reload_t *r, fr_event_list_t *el)
+{
+	reload_stop(r, el);
+
+	if (r->forward_fd >= 0) {
+		close(r->forward_fd);
+		r->forward_fd = -1;
+	}
+
+	ERROR("Reload failed - continuing with the current configuration");
+
+	/*
+	 *	The new process truncated the PID file.
+	 */
+	if (r->config->write_pid) (void) pid_file_write(r->config);
+}
+
+/** Wait for the requests and sessions we already have to finish, and then exit
+ *
+ */
+static void reload_drain_check(fr_event_list_t *el, fr_time_t now, void *uctx)
+{
+	radiusd_reload_t	*r = uctx;
+	uint64_t		active;
+
+	/*
+	 *	Requests may be in transit between the network and
+	 *	the workers, so we need to see nothing active twice.
+	 *	The new process passes us requests for our sessions
+	 *	until they have all expired.
+	 */
+	active = fr_schedule_num_active(r->sc);
+	if ((active == 0) && fr_time_gteq(now, fr_state_entries_expiry())) {
+		if (++r->idle >= 2) {
+			INFO("All requests and sessions finished, exiting");
+			main_loop_signal_raise(RADIUS_SIGNAL_SELF_EXIT);
+			return;
+		}
+	} else {
+		r->idle = 0;
+	}
+
+	if (fr_time_gteq(now, fr_time_add(r->drain_start, r->config->reload_drain_timeout))) {
+		WARN("Exiting with %" PRIu64 " requests still active after %pVs", active,
+		     fr_box_time_delta(r->config->reload_drain_timeout));
+		main_loop_signal_raise(RADIUS_SIGNAL_SELF_EXIT);
+		return;
+	}
+
+	if (fr_event_timer_in(NULL, el, &r->ev, fr_time_delta_from_msec(100), reload_drain_check, r) < 0) {
+		PERROR("Failed inserting drain event");
+		main_loop_signal_raise(RADIUS_SIGNAL_SELF_EXIT);
+	}
+}
+
+/** Process packets which the new process passed back to us
+ *
+ * They're injected into the listener which reads the socket they were
+ * received on, and are processed as if we'd read them ourselves.
+ */
+static void reload_forward_read(UNUSED fr_event_list_t *el, int fd, UNUSED int flags, UNUSED void *uctx)
+{
+	static uint8_t	buffer[UINT16_MAX];
+	fr_socket_t	socket;
+	fr_listen_t	*child;
+	ssize_t		slen;
+	int		i;
+
+	for (i = 0; i < 16; i++) {
+		slen = fr_reload_forward_recv(fd, &socket, buffer, sizeof(buffer));
+		if (slen == 0) return;
+		if (slen < 0) {
+			PERROR("Discarding packet from the new server process");
+			continue;
+		}
+
+		child = listen_find_fd(socket.fd);
+		if (!child) {
+			ERROR("Discarding packet from the new server process - we don't have socket %d", socket.fd);
+			continue;
+		}
+
+		if (fr_master_io_inject(child, &socket, buffer, slen) < 0) {
+			PERROR("Discarding packet from the new server process");
+		}
+	}
+}
+
+static void reload_forward_error(fr_event_list_t *el, int fd, UNUSED int flags, int fd_errno, void *uctx)
+{
+	radiusd_reload_t *r = uctx;
+
+	ERROR("Lost connection to the new server process: %s", fr_syserror(fd_errno));
+
+	(void) fr_event_fd_delete(el, fd, FR_EVENT_FILTER_IO);
+	close(fd);
+	r->forward_fd = -1;
+}
+
+static void reload_ready_read(fr_event_list_t *el, int fd, UNUSED int flags, void *uctx)
+{
+	radiusd_reload_t	*r = uctx;
+	pid_t			pid;
+	ssize_t			slen;
+
+	slen = read(fd, &pid, sizeof(pid));
+	if ((slen < 0) && ((errno == EINTR) || (errno == EAGAIN))) return;
+
+	if (slen != sizeof(pid)) {
+		ERROR("New server process exited before it was ready");
+		reload_failed(r, el);
+		return;
+	}
+
+	reload_stop(r, el);
+
+	INFO("New server process %d is ready, no longer reading packets", (int) pid);
+
+#ifdef HAVE_SYSTEMD
+	/*
+	 *	The new process is now the main one.
+	 */
+	if (getenv("NOTIFY_SOCKET")) sd_notifyf(0, "MAINPID=%lu", (unsigned long) pid);
+#endif
+	unsetenv("NOTIFY_SOCKET");
+
+	r->handed_over = true;
+	r->drain_start = fr_time();
+
+	if (fr_schedule_drain(r->sc) < 0) PWARN("Failed stopping network threads");
+
+	if (fr_event_fd_insert(NULL, el, r->forward_fd, reload_forward_read, NULL, reload_forward_error, r) < 0) {
+		PWARN("Failed watching for packets from the new server process");
+	}
+
+	reload_drain_check(el, r->drain_start, r);
+}
+
+static void reload_ready_error(fr_event_list_t *el, UNUSED int fd, UNUSED int flags, int fd_errno, void *uctx)
+{
+	radiusd_reload_t *r = uctx;
+
+	ERROR("New server process exited before it was ready: %s", fr_syserror(fd_errno));
+	reload_failed(r, el);
+}
+
+static void reload_start_timeout(fr_event_list_t *el, UNUSED fr_time_t now, void *uctx)
+{
+	radiusd_reload_t *r = uctx;
+
+	ERROR("New server process was not ready after %pVs", fr_box_time_delta(r->config->reload_start_timeout));
+
+	/*
+	 *	If the new process has daemonized, it's no longer
+	 *	our child.  It exits when it finds that we've closed
+	 *	the pipe.
+	 */
+	(void) kill(r->pid, SIGTERM);
+	reload_failed(r, el);
+}
+
+static void reload_reap(UNUSED fr_event_list_t *el, pid_t pid, int status, UNUSED void *uctx)
+{
+	if (WIFEXITED(status) && (WEXITSTATUS(status) == 0)) return;
+
+	DEBUG("New server process %d exited with status %d", (int) pid, status);
+}
+
+/** Start a new copy of the server, and hand our sockets over to it
+ *
+ */
+static void reload_hup(fr_event_list_t *el, void *uctx)
+{
+	radiusd_reload_t	*r = uctx;
+	int			ready[2], forward[2];
+	int			*fds, num, i;
+	char			**envp, **env_in;
+	char			*fd_env, *ready_env, *forward_env;
+	size_t			num_env;
+	pid_t			pid;
+
+	if (r->pid || r->handed_over) {
+		INFO("Ignoring HUP - reload is already in progress");
+		return;
+	}
+
+	/*
+	 *	Everything which allocates memory has to be done
+	 *	before we fork.
+	 */
+	num = listen_fds(NULL, &fds);
+	if (num < 0) {
+		PERROR("Failed finding listening sockets");
+		return;
+	}
+
+	MEM(fd_env = talloc_strdup(fds, RELOAD_ENV_FDS "="));
+	for (i = 0; i < num; i++) {
+		MEM(fd_env = talloc_asprintf_append_buffer(fd_env, "%s%d", (i > 0) ? " " : "", fds[i]));
+	}
+
+	if (pipe(ready) < 0) {
+		ERROR("Failed creating reload pipe: %s", fr_syserror(errno));
+		talloc_free(fds);
+		return;
+	}
+	(void) fcntl(ready[0], F_SETFD, FD_CLOEXEC);
+	(void) fcntl(ready[1], F_SETFD, FD_CLOEXEC);
+	(void) fr_nonblock(ready[0]);
+
+	/*
+	 *	The new process passes requests for our sessions back
+	 *	to us over this.
+	 */
+	if (socketpair(AF_UNIX, SOCK_DGRAM, 0, forward) < 0) {
+		ERROR("Failed creating reload socket pair: %s", fr_syserror(errno));
+		close(ready[0]);
+		close(ready[1]);
+		talloc_free(fds);
+		return;
+	}
+	(void) fcntl(forward[0], F_SETFD, FD_CLOEXEC);
+	(void) fcntl(forward[1], F_SETFD, FD_CLOEXEC);
+	(void) fr_nonblock(forward[0]);
+
+	MEM(ready_env = talloc_asprintf(fds, RELOAD_ENV_READY "=%d", ready[1]));
+	MEM(forward_env = talloc_asprintf(fds, RELOAD_ENV_FORWARD "=%d", forward[1]));
+
+	for (num_env = 0; environ[num_env]; num_env++);
+	MEM(envp = talloc_zero_array(fds, char *, num_env + 4));
+	for (env_in = environ, i = 0; *env_in; env_in++) {
+		if ((strncmp(*env_in, RELOAD_ENV_FDS "=", sizeof(RELOAD_ENV_FDS)) == 0) ||
+		    (strncmp(*env_in, RELOAD_ENV_READY "=", sizeof(RELOAD_ENV_READY)) == 0) ||
+		    (strncmp(*env_in, RELOAD_ENV_FORWARD "=", sizeof(RELOAD_ENV_FORWARD)) == 0)) continue;
+		envp[i++] = *env_in;
+	}
+	envp[i++] = fd_env;
+	envp[i++] = ready_env;
+	envp[i] = forward_env;
+
+	INFO("Starting new server process with %d inherited sockets", num);
+
+	pid = fork();
+	if (pid < 0) {
+		ERROR("Failed starting new server process: %s", fr_syserror(errno));
+		close(ready[0]);
+		close(ready[1]);
+		close(forward[0]);
+		close(forward[1]);
+		talloc_free(fds);
+		return;
+	}
+
+	/*
+	 *	Child.  Only async-signal-safe functions from here on.
+	 */
+	if (pid == 0) {
+		for (i = 0; i < num; i++) (void) fcntl(fds[i], F_SETFD, 0);
+		(void) fcntl(ready[1], F_SETFD, 0);
+		(void) fcntl(forward[1], F_SETFD, 0);
+		close(ready[0]);
+		close(forward[0]);
+
+		/*
+		 *	We send SIGTERM to our process group on exit,
+		 *	which must not include the new process.
+		 */
+		(void) setpgid(0, 0);
+
+		execve(r->exe, r->argv, envp);
+		_exit(EXIT_FAILURE);
+	}
+
+	close(ready[1]);
+	close(forward[1]);
+	talloc_free(fds);
+
+	r->pid = pid;
+	r->ready_fd = ready[0];
+	r->forward_fd = forward[0];
+	r->idle = 0;
+
+	if (fr_event_pid_reap(el, pid, reload_reap, r) < 0) {
+		PWARN("Failed watching new server process %d", (int) pid);
+	}
+
+	if (fr_event_fd_insert(NULL, el, r->ready_fd, reload_ready_read, NULL, reload_ready_error, r) < 0) {
+		PERROR("Failed watching reload pipe");
+	error:
+		(void) kill(pid, SIGTERM);
+		reload_failed(r, el);
+		return;
+	}
+
+	if (fr_event_timer_in(NULL, el, &r->ev, r->config->reload_start_timeout, reload_start_timeout, r) < 0) {
+		PERROR("Failed inserting reload timeout");
+		goto error;
+	}
+}
+
 #ifdef HAVE_CAPABILITY_H
 #define DUMP_CAPABILITIES(_phase) \
 { \
@@ -321,6 +813,14 @@ int main(int argc, char *argv[])
 	config->daemonize = true;
 	config->spawn_workers = true;
 
+	/*
+	 *	Save the arguments before getopt() re-orders them, so
+	 *	that a reload starts the new process the same way.
+	 */
+	MEM(reload.argv = talloc_zero_array(config, char *, argc + 1));
+	for (c = 0; c < argc; c++) MEM(reload.argv[c] = talloc_typed_strdup(reload.argv, argv[c]));
+	reload.exe = reload_exe_find(config, argv[0]);
+
 #ifdef OSFC2
 	set_auth_parameters(argc, argv);
 #endif
@@ -587,6 +1087,12 @@ int main(int argc, char *argv[])
 	 */
 	if (main_config_init(config) < 0) EXIT_WITH_FAILURE;
 
+	/*
+	 *  Pick up the sockets from the previous instance of the
+	 *  server if we're being started by a reload.
+	 */
+	reload_inherit(config);
+
 	/*
 	 *  Check we're the only process using this config.
 	 */
@@ -811,6 +1317,27 @@ int main(int argc, char *argv[])
 	 */
 	if (log_global_init(&default_log, config->daemonize) < 0) EXIT_WITH_FAILURE;
 
+	/*
+	 *	Start the log thread.  This has to be done
+	 *	post-fork, as threads aren't inherited.
+	 */
+	if (config->log_async && (fr_log_async_start(config->log_async_buffer_size) < 0)) {
+		PERROR("Failed starting log thread");
+		EXIT_WITH_FAILURE;
+	}
+
+#ifdef WITH_TLS
+	/*
+	 *	Start the threads which run TLS handshakes.
+	 *	These must be running before the workers.
+	 */
+	if (fr_tls_offload_start(config->openssl_offload_threads, config->openssl_offload_max_queued,
+				 config->openssl_async_pool_init, config->openssl_async_pool_max) < 0) {
+		PERROR("Failed starting TLS offload threads");
+		EXIT_WITH_FAILURE;
+	}
+#endif
+
 	/*
 	 *	Start the network / worker threads.
 	 */
@@ -824,6 +1351,8 @@ int main(int argc, char *argv[])
 		schedule->stats_interval = config->stats_interval;
 
 		schedule->network.max_outstanding = config->max_requests;
+		schedule->network.shed_low_priority = config->shed_low_priority;
+		schedule->network.shed_normal_priority = config->shed_normal_priority;
 
 #define COPY(_x) schedule->worker._x = config->_x
 		COPY(max_requests);
@@ -831,6 +1360,7 @@ int main(int argc, char *argv[])
 		COPY(unflatten_after_decode);
 		COPY(unflatten_before_encode);
 		COPY(flatten_before_encode);
+		COPY(trace_records);
 
 		/*
 		 *	Single server mode: use the global event list.
@@ -852,6 +1382,22 @@ int main(int argc, char *argv[])
 		 *	Tell the virtual servers to open their sockets.
 		 */
 		if (virtual_servers_open(sc) < 0) EXIT_WITH_FAILURE;
+
+		/*
+		 *	Close inherited sockets which are no longer
+		 *	used by any listener.
+		 */
+		fr_socket_inherit_done();
+	}
+
+	/*
+	 *	Start watching the files modules asked to have
+	 *	reloaded when they change.  The workers have
+	 *	instantiated their modules by now.
+	 */
+	if (fr_file_reload_start() < 0) {
+		PERROR("Failed starting file reload thread");
+		EXIT_WITH_FAILURE;
 	}
 
 	/*
@@ -902,22 +1448,7 @@ int main(int argc, char *argv[])
 	/*
 	 *  Write the PID after we've forked, so that we write the correct one.
 	 */
-	if (config->write_pid) {
-		FILE *fp;
-
-		fp = fopen(config->pid_file, "w");
-		if (fp != NULL) {
-			/*
-			 *  @fixme What about following symlinks,
-			 *  and having it over-write a normal file?
-			 */
-			fprintf(fp, "%d\n", (int) radius_pid);
-			fclose(fp);
-		} else {
-			ERROR("Failed creating PID file %s: %s", config->pid_file, fr_syserror(errno));
-			EXIT_WITH_FAILURE;
-		}
-	}
+	if (config->write_pid && (pid_file_write(config) < 0)) EXIT_WITH_FAILURE;
 
 	trigger_exec(NULL, NULL, "server.start", false, NULL);
 
@@ -966,6 +1497,20 @@ int main(int argc, char *argv[])
 	 *  Process requests until HUP or exit.
 	 */
 	INFO("Ready to process requests");	/* we were actually ready a while ago, but oh well */
+
+	/*
+	 *  Tell the previous instance of the server that it can
+	 *  stop reading packets.  If it's gone away, then it
+	 *  gave up waiting for us, and has kept its sockets.
+	 */
+	if (reload_ready() < 0) EXIT_WITH_FAILURE;
+
+	if (config->reload_graceful) {
+		reload.config = config;
+		reload.sc = sc;
+		main_loop_hup_func_set(reload_hup, &reload);
+	}
+
 	while ((status = main_loop_start()) == 0x80) {
 #ifdef WITH_STATS
 		radius_stats_init(1);
@@ -1005,7 +1550,7 @@ int main(int argc, char *argv[])
 	 *   not killed with the rest of the process group, below.
 	 */
 	if (status == 2) trigger_exec(NULL, NULL, "server.signal.term", true, NULL);
-	trigger_exec(NULL, NULL, "server.stop", false, NULL);
+	if (!reload.handed_over) trigger_exec(NULL, NULL, "server.stop", false, NULL);
 
 	/*
 	 *  Stop the scheduler, this signals the network and worker threads
@@ -1017,8 +1562,10 @@ int main(int argc, char *argv[])
 	/*
 	 *  We're exiting, so we can delete the PID file.
 	 *  (If it doesn't exist, we can ignore the error returned by unlink)
+	 *
+	 *  If we've handed over to a new process, the PID file is its.
 	 */
-	if (config->daemonize) unlink(config->pid_file);
+	if (config->daemonize && !reload.handed_over) unlink(config->pid_file);
 
 	/*
 	 *  Free memory in an explicit and consistent order
@@ -1055,8 +1602,10 @@ int main(int argc, char *argv[])
 	 *	as the parent process MUST NOT call this
 	 *	function as it exits, otherwise the semaphore
 	 *	is removed and there's no exclusivity.
+	 *
+	 *	The same applies if a new process has taken over.
 	 */
-	main_config_exclusive_proc_done(main_config);
+	if (!reload.handed_over) main_config_exclusive_proc_done(main_config);
 
 cleanup:
 	/*
@@ -1065,6 +1614,12 @@ cleanup:
 	 */
 	(void) fr_schedule_destroy(&sc);
 
+	/*
+	 *	No more readers, so stop replacing module data
+	 *	before the modules are freed.
+	 */
+	fr_file_reload_stop();
+
 	/*
 	 *	Ensure all thread local memory is cleaned up
 	 *	before we start cleaning up global resources.
@@ -1073,8 +1628,24 @@ cleanup:
 	 *	depend on global resources are freed at the
 	 *	appropriate time.
 	 */
+#ifdef WITH_TLS
+	/*
+	 *	The workers have exited, so there are no more
+	 *	handshakes to run.  This must be done before
+	 *	triggering the thread local destructors, so the
+	 *	offload threads run their own.
+	 */
+	fr_tls_offload_stop();
+#endif
+
 	fr_atexit_thread_trigger_all();
 
+	/*
+	 *	Write out any buffered log messages, and
+	 *	log synchronously from now on.
+	 */
+	fr_log_async_stop();
+
 	/*
 	 *  Frees request specific logging resources which is OK
 	 *  because all the requests will have been stopped.
@@ -0,0 +1,1118 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file src/bin/radperf.c
+ * @brief RADIUS load generator.
+ *
+ * Sends packets from multiple threads, each with its own set of UDP
+ * sockets (and therefore source ports).  Packets are either sent
+ * open-loop at a target rate, or closed-loop as fast as replies arrive.
+ * Latencies are recorded in per-thread histograms, which are merged
+ * at exit and printed as percentiles for each type of request.
+ *
+ * When running open-loop, a packet which could not be sent on time
+ * because all IDs were in use has its latency measured from the time
+ * it should have been sent.  That way a server which falls behind
+ * shows up as higher latency, instead of as a lower send rate.
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/util/atexit.h>
+#include <freeradius-devel/util/conf.h>
+#include <freeradius-devel/util/histogram.h>
+#include <freeradius-devel/util/pair_legacy.h>
+#include <freeradius-devel/util/syserror.h>
+#include <freeradius-devel/util/time.h>
+#include <freeradius-devel/radius/radius.h>
+
+#include <ctype.h>
+#include <poll.h>
+#include <pthread.h>
+
+#ifdef HAVE_GETOPT_H
+#  include <getopt.h>
+#endif
+
+#undef DEBUG
+#define DEBUG(fmt, ...)		if (fr_debug_lvl > 0) fprintf(fr_log_fp, fmt "\n", ## __VA_ARGS__)
+#define ERROR(fmt, ...)		fr_perror("radperf: " fmt, ## __VA_ARGS__)
+
+/** How often each thread looks for packets which have timed out
+ *
+ */
+#define RP_CHECK_INTERVAL	fr_time_delta_from_msec(100)
+
+/** Maximum number of sockets each thread may open
+ *
+ */
+#define RP_MAX_SOCKETS		1024
+
+/** A packet read from the input file
+ *
+ */
+typedef struct {
+	unsigned int		code;			//!< Packet code to send.
+	fr_pair_list_t		vps;			//!< Attributes to encode.
+} rp_packet_t;
+
+/** Counters for one type of request
+ *
+ */
+typedef struct {
+	uint64_t		sent;			//!< Packets sent.
+	uint64_t		received;		//!< Valid replies received.
+	uint64_t		lost;			//!< Packets which timed out.
+	uint64_t		deferred;		//!< Packets sent late because no ID was free.
+	uint64_t		reply[FR_RADIUS_CODE_MAX];	//!< Replies, by reply code.
+	fr_histogram_t		latency;		//!< Of valid replies, in nanoseconds.
+} rp_stats_t;
+
+/** An outstanding packet
+ *
+ */
+typedef struct {
+	bool			in_use;			//!< Whether we're waiting for a reply.
+	uint8_t			code;			//!< Of the request.
+	fr_time_t		start;			//!< Latency is measured from here.
+	fr_time_t		sent;			//!< When the packet was actually sent.
+	uint8_t			header[RADIUS_HEADER_LENGTH];	//!< Of the request, used to verify the reply.
+} rp_slot_t;
+
+/** A UDP socket, with its own 256 IDs
+ *
+ */
+typedef struct {
+	int			fd;
+	uint16_t		port;			//!< Source port.
+
+	unsigned int		num_free;		//!< Number of IDs available.
+	unsigned int		free_head;		//!< Next ID to use.
+	uint8_t			free_ids[256];		//!< FIFO of free IDs, so that IDs are reused
+							///< as late as possible.
+
+	rp_slot_t		slot[256];		//!< Indexed by ID.
+} rp_socket_t;
+
+/** State for one sender thread
+ *
+ */
+typedef struct {
+	pthread_t		pthread_id;
+	unsigned int		num;			//!< Thread number.
+	TALLOC_CTX		*ctx;			//!< Only used by this thread.
+
+	rp_packet_t		*packets;		//!< Our copy of the input packets.
+	size_t			num_packets;
+	size_t			next_packet;		//!< Next packet to send, round-robin.
+
+	rp_socket_t		*sockets;
+	unsigned int		num_sockets;
+	unsigned int		next_socket;		//!< Next socket to try, round-robin.
+	struct pollfd		*pfd;
+
+	uint64_t		count;			//!< Number of packets to send, 0 for no limit.
+	fr_time_delta_t		interval;		//!< Between packets, 0 for closed-loop.
+	fr_time_delta_t		phase;			//!< Offset from the start time, so that threads
+							///< don't all send at the same time.
+
+	uint64_t		total_sent;		//!< Across all packet types.
+	uint64_t		outstanding;		//!< Packets waiting for a reply.
+	uint64_t		invalid;		//!< Replies which failed verification, or which
+							///< didn't match an outstanding packet.
+	uint64_t		send_errors;		//!< Packets which the kernel refused.
+
+	fr_time_t		start;			//!< When the thread started sending.
+	fr_time_t		end;			//!< When the thread stopped sending.
+
+	rp_stats_t		*stats;			//!< Indexed by request code.
+
+	atomic_bool		done;			//!< Written by the thread when it exits.
+} rp_thread_t;
+
+static fr_dict_t const *dict_freeradius;
+static fr_dict_t const *dict_radius;
+
+extern fr_dict_autoload_t radperf_dict[];
+fr_dict_autoload_t radperf_dict[] = {
+	{ .out = &dict_freeradius, .proto = "freeradius" },
+	{ .out = &dict_radius, .proto = "radius" },
+	{ NULL }
+};
+
+static fr_dict_attr_t const *attr_message_authenticator;
+static fr_dict_attr_t const *attr_packet_type;
+
+extern fr_dict_attr_autoload_t radperf_dict_attr[];
+fr_dict_attr_autoload_t radperf_dict_attr[] = {
+	{ .out = &attr_message_authenticator, .name = "Message-Authenticator", .type = FR_TYPE_OCTETS, .dict = &dict_radius },
+	{ .out = &attr_packet_type, .name = "Packet-Type", .type = FR_TYPE_UINT32, .dict = &dict_radius },
+	{ NULL }
+};
+
+static char const *radperf_version = RADIUSD_VERSION_BUILD("radperf");
+
+static fr_ipaddr_t server_ipaddr;
+static uint16_t server_port = 0;
+static fr_ipaddr_t client_ipaddr;
+static char *secret = NULL;
+static size_t secret_len;
+
+static unsigned int max_outstanding = 256;
+static fr_time_delta_t timeout = fr_time_delta_wrap((int64_t)5 * NSEC);	/* 5 seconds */
+static fr_time_delta_t duration = fr_time_delta_wrap(0);
+
+static rp_packet_t **packets;
+static size_t num_packets;
+
+static atomic_bool stop_sending;
+
+static NEVER_RETURNS void usage(void)
+{
+	fprintf(stderr, "Usage: radperf [options] server[:port] <command> [<secret>]\n");
+
+	fprintf(stderr, "  <command>              One of auth, acct, status, coa, disconnect or auto.\n");
+	fprintf(stderr, "  -4                     Use IPv4 address of server\n");
+	fprintf(stderr, "  -6                     Use IPv6 address of server.\n");
+	fprintf(stderr, "  -c <count>             Stop after sending 'count' packets.\n");
+	fprintf(stderr, "  -d <raddb>             Set user dictionary directory (defaults to " RADDBDIR ").\n");
+	fprintf(stderr, "  -D <dictdir>           Set main dictionary directory (defaults to " DICTDIR ").\n");
+	fprintf(stderr, "  -f <file>              Read packets from file, not stdin.  Packets are sent round-robin.\n");
+	fprintf(stderr, "  -h                     Print usage help information.\n");
+	fprintf(stderr, "  -l <time>              Stop sending after 'time' (default 10s, unless -c is given).\n");
+	fprintf(stderr, "  -n <num>               Send 'num' packets/s in total, regardless of replies.\n");
+	fprintf(stderr, "                         Without -n, each thread sends as fast as replies arrive.\n");
+	fprintf(stderr, "  -p <num>               Allow 'num' outstanding packets per socket, 1..256 (default 256).\n");
+	fprintf(stderr, "  -q                     Do not print progress every second.\n");
+	fprintf(stderr, "  -s <num>               Open 'num' sockets (source ports) per thread (default 1).\n");
+	fprintf(stderr, "  -S <file>              Read secret from file, not command line.\n");
+	fprintf(stderr, "  -t <timeout>           Count a packet as lost after 'timeout' (default 5s).\n");
+	fprintf(stderr, "  -T <num>               Send from 'num' threads (default 1).\n");
+	fprintf(stderr, "  -v                     Show program version information.\n");
+	fprintf(stderr, "  -x                     Debugging mode.\n");
+
+	fr_exit_now(EXIT_SUCCESS);
+}
+
+static void rp_signal(UNUSED int sig)
+{
+	atomic_store(&stop_sending, true);
+}
+
+/** Read all of the packets from a file
+ *
+ */
+static int rp_packets_read(TALLOC_CTX *ctx, char const *filename, unsigned int default_code)
+{
+	FILE		*fp;
+	bool		done = false;
+
+	if (strcmp(filename, "-") == 0) {
+		fp = stdin;
+		filename = "stdin";
+	} else {
+		fp = fopen(filename, "r");
+		if (!fp) {
+			ERROR("Error opening %s: %s", filename, fr_syserror(errno));
+			return -1;
+		}
+	}
+
+	while (!done) {
+		rp_packet_t	*packet;
+		fr_pair_t	*vp;
+
+		MEM(packet = talloc_zero(ctx, rp_packet_t));
+		fr_pair_list_init(&packet->vps);
+
+		if (fr_pair_list_afrom_file(packet, dict_radius, &packet->vps, fp, &done) < 0) {
+			ERROR("Error parsing \"%s\"", filename);
+		error:
+			talloc_free(packet);
+			if (fp != stdin) fclose(fp);
+			return -1;
+		}
+
+		if (fr_pair_list_empty(&packet->vps)) {
+			talloc_free(packet);
+			continue;
+		}
+
+		packet->code = default_code;
+		vp = fr_pair_find_by_da(&packet->vps, NULL, attr_packet_type);
+		if (vp) packet->code = vp->vp_uint32;
+
+		switch (packet->code) {
+		case FR_RADIUS_CODE_ACCESS_REQUEST:
+		case FR_RADIUS_CODE_STATUS_SERVER:
+			/*
+			 *	Servers may require Message-Authenticator,
+			 *	and it costs us very little to add it.
+			 */
+			if (!fr_pair_find_by_da(&packet->vps, NULL, attr_message_authenticator)) {
+				MEM(vp = fr_pair_afrom_da(packet, attr_message_authenticator));
+				fr_pair_value_memdup(vp, (uint8_t const *)"\0", 1, true);
+				fr_pair_append(&packet->vps, vp);
+			}
+			break;
+
+		case FR_RADIUS_CODE_ACCOUNTING_REQUEST:
+		case FR_RADIUS_CODE_COA_REQUEST:
+		case FR_RADIUS_CODE_DISCONNECT_REQUEST:
+			break;
+
+		default:
+			ERROR("Packet %zu in \"%s\" has no valid Packet-Type, and no type was given "
+			      "on the command line", num_packets + 1, filename);
+			goto error;
+		}
+
+		/*
+		 *	Check that the packet can be encoded, so that
+		 *	the sender threads don't have to deal with
+		 *	failures.
+		 */
+		{
+			uint8_t data[MAX_PACKET_LEN] = { 0 };
+
+			if (fr_radius_encode(data, sizeof(data), NULL, secret, secret_len,
+					     packet->code, 0, &packet->vps) < 0) {
+				fr_perror("radperf: Failed encoding packet %zu in \"%s\"", num_packets + 1, filename);
+				goto error;
+			}
+		}
+
+		MEM(packets = talloc_realloc(ctx, packets, rp_packet_t *, num_packets + 1));
+		packets[num_packets++] = talloc_steal(packets, packet);
+	}
+
+	if (fp != stdin) fclose(fp);
+
+	return 0;
+}
+
+/** Release an ID back to its socket
+ *
+ */
+static inline void rp_slot_free(rp_thread_t *t, rp_socket_t *sock, uint8_t id)
+{
+	sock->slot[id].in_use = false;
+	sock->free_ids[(sock->free_head + sock->num_free) & 0xff] = id;
+	sock->num_free++;
+	t->outstanding--;
+}
+
+/** Encode and send the next packet
+ *
+ * @param[in] t		thread sending the packet.
+ * @param[in] start	time the packet should have been sent.  If this is
+ *			before now, the packet is counted as deferred.
+ * @param[in] now	the current time.
+ * @return
+ *	- 1 if the packet was sent.
+ *	- 0 if there are no free IDs.
+ *	- -1 on error.  The packet is counted as sent, and as a send error.
+ */
+static int rp_send(rp_thread_t *t, fr_time_t start, fr_time_t now)
+{
+	unsigned int	i;
+	rp_socket_t	*sock = NULL;
+	rp_packet_t	*packet;
+	rp_slot_t	*slot;
+	rp_stats_t	*stats;
+	uint8_t		id;
+	ssize_t		slen;
+	uint8_t		data[MAX_PACKET_LEN];
+
+	for (i = 0; i < t->num_sockets; i++) {
+		rp_socket_t *s = &t->sockets[t->next_socket++];
+
+		if (t->next_socket == t->num_sockets) t->next_socket = 0;
+
+		if (s->num_free) {
+			sock = s;
+			break;
+		}
+	}
+	if (!sock) return 0;
+
+	id = sock->free_ids[sock->free_head++ & 0xff];
+	sock->free_head &= 0xff;
+	sock->num_free--;
+	t->outstanding++;
+
+	packet = &t->packets[t->next_packet++];
+	if (t->next_packet == t->num_packets) t->next_packet = 0;
+
+	stats = &t->stats[packet->code];
+	stats->sent++;
+	if (fr_time_lt(start, now)) stats->deferred++;
+	t->total_sent++;
+
+	/*
+	 *	Access-Request and Status-Server need a random
+	 *	Request Authenticator.  The encoder reads it from
+	 *	the buffer.  Other packets have it calculated by
+	 *	fr_radius_sign().
+	 */
+	if ((packet->code == FR_RADIUS_CODE_ACCESS_REQUEST) ||
+	    (packet->code == FR_RADIUS_CODE_STATUS_SERVER)) {
+		fr_rand_buffer(data + 4, RADIUS_AUTH_VECTOR_LENGTH);
+	}
+
+	slen = fr_radius_encode(data, sizeof(data), NULL, secret, secret_len, packet->code, id, &packet->vps);
+	if (slen < 0) {
+		ERROR("Failed encoding packet");
+		goto error;
+	}
+
+	if (fr_radius_sign(data, NULL, (uint8_t const *) secret, secret_len) < 0) {
+		ERROR("Failed signing packet");
+		goto error;
+	}
+
+	if (send(sock->fd, data, slen, 0) < 0) {
+		if (fr_debug_lvl > 0) ERROR("Failed sending packet: %s", fr_syserror(errno));
+		goto error;
+	}
+
+	slot = &sock->slot[id];
+	slot->in_use = true;
+	slot->code = packet->code;
+	slot->start = start;
+	slot->sent = now;
+	memcpy(slot->header, data, sizeof(slot->header));
+
+	return 1;
+
+error:
+	t->send_errors++;
+	rp_slot_free(t, sock, id);
+	return -1;
+}
+
+/** Read all pending replies from a socket
+ *
+ */
+static void rp_recv(rp_thread_t *t, rp_socket_t *sock)
+{
+	uint8_t		data[MAX_PACKET_LEN];
+	ssize_t		rcode;
+	size_t		packet_len;
+	rp_slot_t	*slot;
+	rp_stats_t	*stats;
+	fr_time_t	now;
+
+	while ((rcode = recv(sock->fd, data, sizeof(data), 0)) > 0) {
+		now = fr_time();
+
+		packet_len = rcode;
+		if (!fr_radius_ok(data, &packet_len, RADIUS_MAX_ATTRIBUTES, false, NULL)) {
+			t->invalid++;
+			continue;
+		}
+
+		slot = &sock->slot[data[1]];
+		if (!slot->in_use) {
+			t->invalid++;
+			continue;
+		}
+
+		if (fr_radius_verify(data, slot->header, (uint8_t const *) secret, secret_len, false) < 0) {
+			t->invalid++;
+			continue;
+		}
+
+		stats = &t->stats[slot->code];
+		stats->received++;
+		if (data[0] < FR_RADIUS_CODE_MAX) stats->reply[data[0]]++;
+		fr_histogram_record(&stats->latency, fr_time_delta_unwrap(fr_time_sub(now, slot->start)));
+
+		rp_slot_free(t, sock, data[1]);
+	}
+}
+
+/** Count packets which have waited too long for a reply as lost
+ *
+ */
+static void rp_check_timeouts(rp_thread_t *t, fr_time_t now)
+{
+	unsigned int	i, id;
+
+	for (i = 0; i < t->num_sockets; i++) {
+		rp_socket_t *sock = &t->sockets[i];
+
+		if (sock->num_free == max_outstanding) continue;
+
+		for (id = 0; id < 256; id++) {
+			rp_slot_t *slot = &sock->slot[id];
+
+			if (!slot->in_use) continue;
+
+			if (fr_time_lt(now, fr_time_add(slot->sent, timeout))) continue;
+
+			t->stats[slot->code].lost++;
+			rp_slot_free(t, sock, id);
+		}
+	}
+}
+
+/** Send packets, and wait for replies
+ *
+ */
+static void *rp_thread(void *arg)
+{
+	rp_thread_t	*t = arg;
+	fr_time_t	now, next_send, next_check, end = fr_time_wrap(0);
+	bool		sending = true;
+	bool		behind = false;
+	unsigned int	i;
+
+	t->start = now = fr_time();
+	next_send = fr_time_add(now, t->phase);
+	next_check = fr_time_add(now, RP_CHECK_INTERVAL);
+	if (fr_time_delta_ispos(duration)) end = fr_time_add(now, duration);
+
+	while (true) {
+		fr_time_t	wake;
+		int64_t		wait;
+		int		num;
+		bool		blocked = false;
+
+		now = fr_time();
+
+		if (sending &&
+		    (atomic_load(&stop_sending) ||
+		     (t->count && (t->total_sent >= t->count)) ||
+		     (fr_time_ispos(end) && fr_time_gteq(now, end)))) {
+			sending = false;
+			t->end = now;
+		}
+
+		if (sending) {
+			if (!fr_time_delta_ispos(t->interval)) {
+				/*
+				 *	Closed-loop.  Fill all free IDs, but
+				 *	don't starve the receive side.
+				 */
+				for (i = 0; i < 256; i++) {
+					if (t->count && (t->total_sent >= t->count)) break;
+					if (rp_send(t, now, now) == 0) break;
+				}
+			} else {
+				/*
+				 *	Open-loop.  Send everything which is
+				 *	due.  If we're out of IDs, we wait for
+				 *	replies, and the packets we send while
+				 *	catching up have their latency measured
+				 *	from when they were due.
+				 *
+				 *	Being late because poll() woke us up
+				 *	late is our fault, not the server's, so
+				 *	that isn't counted.
+				 */
+				while (fr_time_lteq(next_send, now)) {
+					if (t->count && (t->total_sent >= t->count)) break;
+					if (fr_time_ispos(end) && fr_time_gteq(next_send, end)) break;
+
+					if (rp_send(t, behind ? next_send : now, now) == 0) {
+						behind = blocked = true;
+						break;
+					}
+
+					next_send = fr_time_add(next_send, t->interval);
+				}
+				if (fr_time_gt(next_send, now)) behind = false;
+			}
+		}
+
+		if (fr_time_gteq(now, next_check)) {
+			rp_check_timeouts(t, now);
+			next_check = fr_time_add(now, RP_CHECK_INTERVAL);
+		}
+
+		if (!sending && !t->outstanding) break;
+
+		/*
+		 *	Sleep until the next packet is due, or until
+		 *	we next need to check for timeouts.
+		 */
+		wake = next_check;
+		if (sending && fr_time_delta_ispos(t->interval) && !blocked && fr_time_lt(next_send, wake)) wake = next_send;
+		if (sending && fr_time_ispos(end) && fr_time_lt(end, wake)) wake = end;
+
+		wait = fr_time_delta_unwrap(fr_time_sub(wake, now));
+		if (wait < 0) wait = 0;
+
+		num = poll(t->pfd, t->num_sockets, (int) ((wait + NSEC / 1000 - 1) / (NSEC / 1000)));
+		if (num < 0) {
+			if (errno == EINTR) continue;
+
+			ERROR("Failed polling sockets: %s", fr_syserror(errno));
+			break;
+		}
+
+		for (i = 0; (i < t->num_sockets) && (num > 0); i++) {
+			if (!t->pfd[i].revents) continue;
+
+			num--;
+			rp_recv(t, &t->sockets[i]);
+		}
+	}
+
+	if (sending) t->end = fr_time();
+
+	atomic_store(&t->done, true);
+
+	return NULL;
+}
+
+/** Create a thread's sockets, and its copy of the input packets
+ *
+ */
+static int rp_thread_init(rp_thread_t *t, unsigned int num_sockets)
+{
+	unsigned int	i, j;
+
+	t->ctx = talloc_new(NULL);
+
+	MEM(t->packets = talloc_zero_array(t->ctx, rp_packet_t, num_packets));
+	t->num_packets = num_packets;
+	t->next_packet = (t->num * 7) % num_packets;	/* so threads don't all send the same packet */
+
+	for (i = 0; i < num_packets; i++) {
+		t->packets[i].code = packets[i]->code;
+		fr_pair_list_init(&t->packets[i].vps);
+		if (fr_pair_list_copy(t->ctx, &t->packets[i].vps, &packets[i]->vps) < 0) {
+			ERROR("Failed copying packet");
+			return -1;
+		}
+	}
+
+	MEM(t->stats = talloc_zero_array(t->ctx, rp_stats_t, FR_RADIUS_CODE_MAX));
+
+	MEM(t->sockets = talloc_zero_array(t->ctx, rp_socket_t, num_sockets));
+	MEM(t->pfd = talloc_zero_array(t->ctx, struct pollfd, num_sockets));
+
+	for (i = 0; i < num_sockets; i++) {
+		rp_socket_t	*sock = &t->sockets[i];
+		fr_ipaddr_t	src_ipaddr = client_ipaddr;
+		int		size = 4 * 1024 * 1024;
+
+		sock->fd = fr_socket_client_udp(&src_ipaddr, &sock->port, &server_ipaddr, server_port, true);
+		if (sock->fd < 0) {
+			ERROR("Failed opening socket");
+			return -1;
+		}
+
+		/*
+		 *	Larger buffers mean that bursts of replies are
+		 *	less likely to be dropped by the kernel.  The
+		 *	kernel may limit this, which is fine.
+		 */
+		(void) setsockopt(sock->fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+		(void) setsockopt(sock->fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+
+		for (j = 0; j < max_outstanding; j++) sock->free_ids[j] = j;
+		sock->num_free = max_outstanding;
+
+		t->pfd[i].fd = sock->fd;
+		t->pfd[i].events = POLLIN;
+		t->num_sockets++;
+	}
+
+	return 0;
+}
+
+static void rp_thread_free(rp_thread_t *t)
+{
+	unsigned int i;
+
+	for (i = 0; i < t->num_sockets; i++) close(t->sockets[i].fd);
+
+	talloc_free(t->ctx);
+}
+
+/** Print a latency, in a unit suitable for its size
+ *
+ */
+static char const *rp_latency_str(char *buffer, size_t len, uint64_t nsec)
+{
+	if (nsec < 10 * 1000) {
+		snprintf(buffer, len, "%" PRIu64 "ns", nsec);
+	} else if (nsec < 10 * 1000 * 1000) {
+		snprintf(buffer, len, "%.1fus", (double) nsec / 1000);
+	} else {
+		snprintf(buffer, len, "%.2fms", (double) nsec / (1000 * 1000));
+	}
+
+	return buffer;
+}
+
+/** Merge the per-thread statistics, and print them
+ *
+ */
+static void rp_summary(rp_thread_t *threads, unsigned int num_threads)
+{
+	unsigned int		i, code, reply;
+	fr_time_t		start = fr_time_max(), end = fr_time_wrap(0);
+	double			elapsed;
+	uint64_t		invalid = 0, send_errors = 0;
+	rp_stats_t		*total;
+	static double const	percentiles[] = { 50, 90, 99, 99.9, 99.99 };
+
+	MEM(total = talloc_zero_array(NULL, rp_stats_t, FR_RADIUS_CODE_MAX));
+
+	for (i = 0; i < num_threads; i++) {
+		rp_thread_t *t = &threads[i];
+
+		if (!t->stats) continue;
+
+		if (fr_time_lt(t->start, start)) start = t->start;
+		if (fr_time_gt(t->end, end)) end = t->end;
+
+		invalid += t->invalid;
+		send_errors += t->send_errors;
+
+		for (code = 0; code < FR_RADIUS_CODE_MAX; code++) {
+			rp_stats_t *in = &t->stats[code];
+			rp_stats_t *out = &total[code];
+
+			out->sent += in->sent;
+			out->received += in->received;
+			out->lost += in->lost;
+			out->deferred += in->deferred;
+			for (reply = 0; reply < FR_RADIUS_CODE_MAX; reply++) out->reply[reply] += in->reply[reply];
+			fr_histogram_merge(&out->latency, &in->latency);
+		}
+	}
+
+	elapsed = (double) fr_time_delta_unwrap(fr_time_sub(end, start)) / NSEC;
+	if (elapsed <= 0) elapsed = 1;
+
+	printf("\nSent for %.2fs from %u thread(s)\n", elapsed, num_threads);
+
+	for (code = 0; code < FR_RADIUS_CODE_MAX; code++) {
+		rp_stats_t	*stats = &total[code];
+		char		buffer[32];
+
+		if (!stats->sent) continue;
+
+		printf("\n%s\n", fr_packet_codes[code]);
+		printf("\tSent                : %" PRIu64 " (%.0f/s)\n", stats->sent, stats->sent / elapsed);
+		printf("\tReceived            : %" PRIu64 " (%.0f/s)\n", stats->received, stats->received / elapsed);
+		printf("\tLost                : %" PRIu64 "\n", stats->lost);
+		if (stats->deferred) printf("\tDeferred            : %" PRIu64 "\n", stats->deferred);
+
+		for (reply = 0; reply < FR_RADIUS_CODE_MAX; reply++) {
+			if (!stats->reply[reply]) continue;
+
+			printf("\t%-20s: %" PRIu64 "\n", fr_packet_codes[reply], stats->reply[reply]);
+		}
+
+		if (!stats->latency.count) continue;
+
+		printf("\tLatency min         : %s\n", rp_latency_str(buffer, sizeof(buffer), stats->latency.min));
+		printf("\tLatency mean        : %s\n", rp_latency_str(buffer, sizeof(buffer), fr_histogram_mean(&stats->latency)));
+		for (i = 0; i < NUM_ELEMENTS(percentiles); i++) {
+			char name[16];
+
+			snprintf(name, sizeof(name), "p%g", percentiles[i]);
+			printf("\tLatency %-12s: %s\n", name,
+			       rp_latency_str(buffer, sizeof(buffer),
+					      fr_histogram_percentile(&stats->latency, percentiles[i])));
+		}
+		printf("\tLatency max         : %s\n", rp_latency_str(buffer, sizeof(buffer), stats->latency.max));
+	}
+
+	if (invalid) printf("\nInvalid replies : %" PRIu64 "\n", invalid);
+	if (send_errors) printf("\nSend errors     : %" PRIu64 "\n", send_errors);
+
+	talloc_free(total);
+}
+
+int main(int argc, char **argv)
+{
+	int		ret = EXIT_SUCCESS;
+	int		c, rcode;
+	char		const *raddb_dir = RADDBDIR;
+	char		const *dict_dir = DICTDIR;
+	char		const *filename = "-";
+	char		filesecret[256];
+	FILE		*fp;
+	int		force_af = AF_UNSPEC;
+	int		packet_code = FR_RADIUS_CODE_UNDEFINED;
+	bool		quiet = false;
+	uint64_t	count = 0;
+	uint64_t	rate = 0;
+	unsigned int	num_threads = 1, num_sockets = 1, i, running;
+	rp_thread_t	*threads;
+	uint64_t	last_sent = 0, last_received = 0;
+#ifndef NDEBUG
+	TALLOC_CTX	*autofree;
+#endif
+
+	fr_debug_lvl = 0;
+	fr_log_fp = stdout;
+
+	/*
+	 *	Must be called first, so the handler is called last
+	 */
+	fr_atexit_global_setup();
+
+#ifndef NDEBUG
+	autofree = talloc_autofree_context();
+
+	if (fr_fault_setup(autofree, getenv("PANIC_ACTION"), argv[0]) < 0) {
+		fr_perror("radperf");
+		fr_exit_now(EXIT_FAILURE);
+	}
+#endif
+
+	talloc_set_log_stderr();
+
+	default_log.dst = L_DST_STDOUT;
+	default_log.fd = STDOUT_FILENO;
+	default_log.print_level = false;
+
+	while ((c = getopt(argc, argv, "46c:d:D:f:hl:n:p:qs:S:t:T:vx")) != -1) switch (c) {
+		case '4':
+			force_af = AF_INET;
+			break;
+
+		case '6':
+			force_af = AF_INET6;
+			break;
+
+		case 'c':
+			if (!isdigit((int) *optarg)) usage();
+			count = strtoull(optarg, NULL, 10);
+			if (!count) usage();
+			break;
+
+		case 'D':
+			dict_dir = optarg;
+			break;
+
+		case 'd':
+			raddb_dir = optarg;
+			break;
+
+		case 'f':
+			filename = optarg;
+			break;
+
+		case 'l':
+			if (fr_time_delta_from_str(&duration, optarg, strlen(optarg), FR_TIME_RES_SEC) < 0) {
+				fr_perror("Failed parsing duration");
+				fr_exit_now(EXIT_FAILURE);
+			}
+			if (!fr_time_delta_ispos(duration)) usage();
+			break;
+
+		case 'n':
+			if (!isdigit((int) *optarg)) usage();
+			rate = strtoull(optarg, NULL, 10);
+			if ((rate == 0) || (rate > NSEC)) usage();
+			break;
+
+		case 'p':
+			max_outstanding = atoi(optarg);
+			if ((max_outstanding < 1) || (max_outstanding > 256)) usage();
+			break;
+
+		case 'q':
+			quiet = true;
+			break;
+
+		case 's':
+			num_sockets = atoi(optarg);
+			if ((num_sockets < 1) || (num_sockets > RP_MAX_SOCKETS)) usage();
+			break;
+
+		case 'S':
+		{
+			char *p;
+
+			fp = fopen(optarg, "r");
+			if (!fp) {
+				ERROR("Error opening %s: %s", optarg, fr_syserror(errno));
+				fr_exit_now(EXIT_FAILURE);
+			}
+			if (fgets(filesecret, sizeof(filesecret), fp) == NULL) {
+				ERROR("Error reading %s: %s", optarg, fr_syserror(errno));
+				fr_exit_now(EXIT_FAILURE);
+			}
+			fclose(fp);
+
+			/* truncate newline */
+			p = filesecret + strlen(filesecret) - 1;
+			while ((p >= filesecret) && (*p < ' ')) {
+				*p = '\0';
+				--p;
+			}
+
+			if (strlen(filesecret) < 2) {
+				ERROR("Secret in %s is too short", optarg);
+				fr_exit_now(EXIT_FAILURE);
+			}
+			secret = talloc_strdup(NULL, filesecret);
+		}
+			break;
+
+		case 't':
+			if (fr_time_delta_from_str(&timeout, optarg, strlen(optarg), FR_TIME_RES_SEC) < 0) {
+				fr_perror("Failed parsing timeout value");
+				fr_exit_now(EXIT_FAILURE);
+			}
+			break;
+
+		case 'T':
+			num_threads = atoi(optarg);
+			if ((num_threads < 1) || (num_threads > 1024)) usage();
+			break;
+
+		case 'v':
+			fr_debug_lvl = 1;
+			DEBUG("%s", radperf_version);
+			fr_exit_now(EXIT_SUCCESS);
+
+		case 'x':
+			fr_debug_lvl++;
+			break;
+
+		case 'h':
+		default:
+			usage();
+	}
+	argc -= (optind - 1);
+	argv += (optind - 1);
+
+	if ((argc < 3) || ((secret == NULL) && (argc < 4))) {
+		ERROR("Insufficient arguments");
+		usage();
+	}
+
+	/*
+	 *	Without a limit, we'd run until interrupted.
+	 */
+	if (!count && !fr_time_delta_ispos(duration)) duration = fr_time_delta_from_sec(10);
+
+	/*
+	 *	Mismatch between the binary and the libraries it depends on
+	 */
+	if (fr_check_lib_magic(RADIUSD_MAGIC_NUMBER) < 0) {
+		fr_perror("radperf");
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	if (!fr_dict_global_ctx_init(NULL, true, dict_dir)) {
+		fr_perror("radperf");
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	if (fr_radius_init() < 0) {
+		fr_perror("radperf");
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	if (fr_dict_autoload(radperf_dict) < 0) {
+		fr_perror("radperf");
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	if (fr_dict_attr_autoload(radperf_dict_attr) < 0) {
+		fr_perror("radperf");
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	if (fr_dict_read(fr_dict_unconst(dict_freeradius), raddb_dir, FR_DICTIONARY_FILE) == -1) {
+		fr_log_perror(&default_log, L_ERR, __FILE__, __LINE__, NULL,
+			      "Failed to initialize the dictionaries");
+		fr_exit_now(EXIT_FAILURE);
+	}
+	fr_strerror_clear();	/* Clear the error buffer */
+
+	/*
+	 *	Get the request type
+	 */
+	if (!isdigit((int) argv[2][0])) {
+		packet_code = fr_table_value_by_str(fr_request_types, argv[2], -2);
+		if (packet_code == -2) {
+			ERROR("Unrecognised request type \"%s\"", argv[2]);
+			usage();
+		}
+	} else {
+		packet_code = atoi(argv[2]);
+	}
+
+	if (fr_inet_pton_port(&server_ipaddr, &server_port, argv[1], -1, force_af, true, true) < 0) {
+		fr_perror("radperf");
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	if (!server_port) switch (packet_code) {
+	case FR_RADIUS_CODE_ACCOUNTING_REQUEST:
+		server_port = FR_ACCT_UDP_PORT;
+		break;
+
+	case FR_RADIUS_CODE_COA_REQUEST:
+		server_port = FR_COA_UDP_PORT;
+		break;
+
+	case FR_RADIUS_CODE_DISCONNECT_REQUEST:
+		server_port = FR_POD_UDP_PORT;
+		break;
+
+	default:
+		server_port = FR_AUTH_UDP_PORT;
+		break;
+	}
+
+	memset(&client_ipaddr, 0, sizeof(client_ipaddr));
+	client_ipaddr.af = server_ipaddr.af;
+
+	if (argv[3]) secret = talloc_strdup(NULL, argv[3]);
+	secret_len = talloc_array_length(secret) - 1;
+
+	if (rp_packets_read(NULL, filename, packet_code) < 0) fr_exit_now(EXIT_FAILURE);
+
+	if (!num_packets) {
+		ERROR("Nothing to send");
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	/*
+	 *	Split the work between the threads.  Each thread
+	 *	sends at its share of the rate, offset from the
+	 *	others so that the packets are evenly spaced.
+	 */
+	MEM(threads = talloc_zero_array(NULL, rp_thread_t, num_threads));
+	for (i = 0; i < num_threads; i++) {
+		rp_thread_t *t = &threads[i];
+
+		t->num = i;
+
+		if (count) {
+			t->count = count / num_threads;
+			if (i < (count % num_threads)) t->count++;
+			if (!t->count) continue;
+		}
+
+		if (rate) {
+			t->interval = fr_time_delta_wrap((NSEC * num_threads) / rate);
+			if (!fr_time_delta_ispos(t->interval)) t->interval = fr_time_delta_wrap(1);
+			t->phase = fr_time_delta_wrap((fr_time_delta_unwrap(t->interval) * i) / num_threads);
+		}
+
+		if (rp_thread_init(t, num_sockets) < 0) {
+			ret = EXIT_FAILURE;
+			goto finish;
+		}
+	}
+
+	fr_set_signal(SIGINT, rp_signal);
+	fr_set_signal(SIGTERM, rp_signal);
+
+	for (i = 0; i < num_threads; i++) {
+		rp_thread_t *t = &threads[i];
+
+		if (count && !t->count) {
+			atomic_store(&t->done, true);
+			continue;
+		}
+
+		rcode = pthread_create(&t->pthread_id, NULL, rp_thread, t);
+		if (rcode != 0) {
+			ERROR("Failed creating thread: %s", fr_syserror(rcode));
+			atomic_store(&stop_sending, true);
+			atomic_store(&t->done, true);
+			t->pthread_id = 0;
+			ret = EXIT_FAILURE;
+		}
+	}
+
+	/*
+	 *	Print progress once a second.  The counters are
+	 *	written by the sender threads without locks, so they
+	 *	may be slightly out of date.
+	 */
+	do {
+		uint64_t sent = 0, received = 0, lost = 0, outstanding = 0;
+
+		usleep(USEC);
+
+		running = 0;
+		for (i = 0; i < num_threads; i++) {
+			rp_thread_t	*t = &threads[i];
+			unsigned int	code;
+
+			if (!atomic_load(&t->done)) running++;
+			if (!t->stats) continue;
+
+			sent += t->total_sent;
+			outstanding += t->outstanding;
+			for (code = 0; code < FR_RADIUS_CODE_MAX; code++) {
+				received += t->stats[code].received;
+				lost += t->stats[code].lost;
+			}
+		}
+
+		if (!quiet) {
+			printf("sent %" PRIu64 "/s, received %" PRIu64 "/s, lost %" PRIu64
+			       ", outstanding %" PRIu64 "\n",
+			       sent - last_sent, received - last_received, lost, outstanding);
+			fflush(stdout);
+		}
+		last_sent = sent;
+		last_received = received;
+	} while (running);
+
+	for (i = 0; i < num_threads; i++) {
+		if (threads[i].pthread_id) pthread_join(threads[i].pthread_id, NULL);
+	}
+
+	rp_summary(threads, num_threads);
+
+finish:
+	for (i = 0; i < num_threads; i++) rp_thread_free(&threads[i]);
+	talloc_free(threads);
+	talloc_free(packets);
+	talloc_free(secret);
+
+	fr_radius_free();
+
+	if (fr_dict_autofree(radperf_dict) < 0) {
+		fr_perror("radperf");
+		ret = EXIT_FAILURE;
+	}
+
+#ifndef NDEBUG
+	talloc_free(autofree);
+#endif
+
+	/*
+	 *	Ensure our atexit handlers run before any other
+	 *	atexit handlers registered by third party libraries.
+	 */
+	fr_atexit_global_trigger_all();
+
+	return ret;
+}
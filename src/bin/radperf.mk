@@ -0,0 +1,5 @@
+TARGET		:= radperf$(E)
+SOURCES		:= radperf.c
+
+TGT_PREREQS	:= libfreeradius-radius$(L)
+TGT_LDLIBS	:= $(LIBS)
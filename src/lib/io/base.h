@@ -244,11 +244,15 @@ typedef ssize_t (*fr_io_data_write_t)(fr_listen_t *li, void *packet_ctx, fr_time
  * @param[in] buffer		the buffer where the raw packet to be injected
  * @param[in] buffer_len	the length of the buffer
  * @param[in] recv_time		when the packet was received
+ * @param[in] socket		where the packet came from, and which address it was
+ *				sent to.  NULL for connected sockets, which already
+ *				know the addresses.
  * @return
  *	- <0 on error
  *	- 0 on success
  */
-typedef int (*fr_io_data_inject_t)(fr_listen_t *li,uint8_t *buffer, size_t buffer_len, fr_time_t recv_time);
+typedef int (*fr_io_data_inject_t)(fr_listen_t *li,uint8_t *buffer, size_t buffer_len, fr_time_t recv_time,
+				   fr_socket_t const *socket);
 
 /** Tell the IO handler that a VNODE has changed
  *
@@ -960,6 +960,21 @@ int fr_channel_signal_open(fr_channel_t *ch)
 	return fr_control_message_send(ch->end[TO_RESPONDER].control, ch->end[TO_RESPONDER].rb, FR_CONTROL_ID_CHANNEL, &cc, sizeof(cc));
 }
 
+/** Get a copy of the statistics for both directions of a channel
+ *
+ * This may be called from a thread which doesn't own either end of
+ * the channel.  The counters may be slightly out of date.
+ *
+ * @param[out] to_responder	statistics for messages sent to the responder.
+ * @param[out] to_requestor	statistics for messages sent to the requestor.
+ * @param[in] ch		to get statistics for.
+ */
+void fr_channel_stats_get(fr_channel_stats_t *to_responder, fr_channel_stats_t *to_requestor, fr_channel_t const *ch)
+{
+	*to_responder = ch->end[TO_RESPONDER].stats;
+	*to_requestor = ch->end[TO_REQUESTOR].stats;
+}
+
 void fr_channel_stats_log(fr_channel_t const *ch, fr_log_t const *log, char const *file, int line)
 {
 	fr_log(log, L_INFO, file, line, "requestor\n");
@@ -47,6 +47,12 @@ typedef struct {
 	uint32_t			num_connections;		//!< number of dynamic connections
 	uint32_t			num_pending_packets;   		//!< number of pending packets
 	uint64_t			client_id;			//!< Unique client identifier.
+
+	uint8_t				*inject;			//!< packet injected into the master socket,
+									///< which the next read() returns.
+	size_t				inject_len;			//!< length of the injected packet.
+	fr_time_t			inject_time;			//!< when the injected packet was received.
+	fr_socket_t			inject_socket;			//!< where the injected packet came from.
 } fr_io_thread_t;
 
 /** A saved packet
@@ -382,6 +388,8 @@ static RADCLIENT *radclient_clone(TALLOC_CTX *ctx, RADCLIENT const *parent)
 	COPY_FIELD(proto);
 
 	COPY_FIELD(use_connected);
+	COPY_FIELD(limit);
+	COPY_FIELD(configured);
 
 #ifdef WITH_TLS
 	COPY_FIELD(tls_required);
@@ -867,6 +875,65 @@ static RADCLIENT *radclient_alloc(TALLOC_CTX *ctx, int ipproto, fr_io_address_t
 }
 
 
+/** Check whether a packet exceeds a rate limit
+ *
+ *  This is a token bucket, implemented as the "generic cell rate
+ *  algorithm".  We track when the next packet is due.  Each packet
+ *  pushes that time forward by 1/max_packets_per_second.  Packets
+ *  which arrive more than "burst" packets ahead of schedule are
+ *  dropped, and don't push the time forward.
+ *
+ *  The time is updated atomically, as copies of the same client may
+ *  be used by different threads.
+ *
+ * @param[in,out] rate_tat	when the next packet is due.
+ * @param[in] limit		to apply.
+ * @param[in] now		the current time.
+ * @return
+ *	- true if the packet should be dropped.
+ *	- false if the packet is OK.
+ */
+static bool rate_limited(atomic_int_fast64_t *rate_tat, fr_socket_limit_t const *limit, fr_time_t now)
+{
+	fr_time_delta_t		interval, tolerance;
+	fr_time_t		tat;
+	int_fast64_t		old;
+	uint32_t		burst;
+
+	if (!limit->max_packets_per_second) return false;
+
+	burst = limit->max_packet_burst ? limit->max_packet_burst : limit->max_packets_per_second;
+	interval = fr_time_delta_wrap(NSEC / limit->max_packets_per_second);
+	tolerance = fr_time_delta_wrap(fr_time_delta_unwrap(interval) * (burst - 1));
+
+	old = atomic_load_explicit(rate_tat, memory_order_relaxed);
+	do {
+		tat = fr_time_gt(fr_time_wrap(old), now) ? fr_time_wrap(old) : now;
+		if (fr_time_delta_gt(fr_time_sub(tat, now), tolerance)) return true;
+	} while (!atomic_compare_exchange_weak_explicit(rate_tat, &old, fr_time_unwrap(fr_time_add(tat, interval)),
+							memory_order_relaxed, memory_order_relaxed));
+
+	return false;
+}
+
+/** Check whether a client is sending packets faster than it's allowed to
+ *
+ *  Packets are counted against the configured client, so that a
+ *  client can't get around the limit by opening more connections.
+ *
+ * @param[in] client	which sent the packet.
+ * @param[in] now	the current time.
+ * @return
+ *	- true if the packet should be dropped.
+ *	- false if the packet is OK.
+ */
+static bool client_rate_limited(fr_io_client_t *client, fr_time_t now)
+{
+	RADCLIENT *radclient = client->radclient->configured ? client->radclient->configured : client->radclient;
+
+	return rate_limited(&radclient->rate_tat, &client->radclient->limit, now);
+}
+
 static fr_io_track_t *fr_io_track_add(fr_io_client_t *client,
 				      fr_io_address_t *address,
 				      uint8_t const *packet, size_t packet_len,
@@ -1297,10 +1364,28 @@ do_read:
 		 *	to have yet another layer of trampoline
 		 *	functions which do all of the TLS work.
 		 */
-		packet_len = inst->app_io->read(child, (void **) &local_address, &recv_time,
-					  buffer, buffer_len, leftover, priority, is_dup);
-		if (packet_len <= 0) {
-			return packet_len;
+		if (!connection && thread->inject) {
+			/*
+			 *	Return the injected packet, as if it had
+			 *	been read from the socket.
+			 */
+			if (thread->inject_len > buffer_len) {
+				thread->inject = NULL;
+				return 0;
+			}
+
+			memcpy(buffer, thread->inject, thread->inject_len);
+			packet_len = thread->inject_len;
+			recv_time = thread->inject_time;
+			address.socket = thread->inject_socket;
+			thread->inject = NULL;
+
+		} else {
+			packet_len = inst->app_io->read(child, (void **) &local_address, &recv_time,
+							buffer, buffer_len, leftover, priority, is_dup);
+			if (packet_len <= 0) {
+				return packet_len;
+			}
 		}
 
 		/*
@@ -1388,12 +1473,18 @@ do_read:
 
 		radclient = inst->app_io->client_find(thread->child, &address.socket.inet.src_ipaddr, inst->ipproto);
 		if (radclient) {
+			RADCLIENT *configured = radclient;
+
 			state = PR_CLIENT_STATIC;
 
 			/*
 			 *	Make our own copy that we can modify it.
+			 *	The copies all count packets against the
+			 *	configured client, so max_packets_per_second
+			 *	applies across threads and connections.
 			 */
 			MEM(radclient = radclient_clone(thread, radclient));
+			radclient->configured = configured;
 			radclient->active = true;
 
 		} else if (inst->dynamic_clients) {
@@ -1613,6 +1704,20 @@ have_client:
 			 *	Got to free this if we don't process the packet.
 			 */
 			new_track = track;
+
+			/*
+			 *	The client is sending packets faster
+			 *	than it's allowed to.  Drop new
+			 *	packets, but still answer retransmits
+			 *	from the cache, above.  Those are
+			 *	cheap.
+			 */
+			if (client_rate_limited(client, fr_time())) {
+				RATE_LIMIT_GLOBAL(WARN, "proto_%s - client %s exceeded max_packets_per_second - discarding packet",
+						  inst->app_io->common.name, client->radclient->shortname);
+				fr_network_listen_rate_limited(connection ? connection->nr : thread->nr, li);
+				goto done;
+			}
 		}
 
 		/*
@@ -1744,7 +1849,7 @@ have_client:
 	 *	tracked in the connected socket.
 	 */
 	(void) fr_network_listen_inject(connection->nr, connection->listen,
-					buffer, packet_len, recv_time);
+					buffer, packet_len, recv_time, NULL);
 
 done:
 	talloc_free(new_track);
@@ -1755,20 +1860,37 @@ done:
  *
  *  Always called in the context of the network.
  */
-static int mod_inject(fr_listen_t *li, uint8_t *buffer, size_t buffer_len, fr_time_t recv_time)
+static int mod_inject(fr_listen_t *li, uint8_t *buffer, size_t buffer_len, fr_time_t recv_time,
+		      fr_socket_t const *socket)
 {
 	fr_io_instance_t const *inst;
+	fr_io_thread_t	*thread;
 	int		priority;
 	bool		is_dup = false;
 	fr_io_connection_t *connection;
 	fr_io_pending_packet_t *pending;
 	fr_io_track_t *track;
 
-	get_inst(li, &inst, NULL, &connection, NULL);
+	get_inst(li, &inst, &thread, &connection, NULL);
 
+	/*
+	 *	The master socket needs to know who sent the packet.
+	 *	It then goes through the same client lookup and
+	 *	duplicate detection as packets read from the socket.
+	 *	The network calls read() immediately after this
+	 *	function, so we don't need to copy the packet.
+	 */
 	if (!connection) {
-		DEBUG2("Received injected packet for an unconnected socket.");
-		return -1;
+		if (!socket || (inst->ipproto != IPPROTO_UDP)) {
+			DEBUG2("Received injected packet for an unconnected socket.");
+			return -1;
+		}
+
+		thread->inject = buffer;
+		thread->inject_len = buffer_len;
+		thread->inject_time = recv_time;
+		thread->inject_socket = *socket;
+		return 0;
 	}
 
 	priority = inst->app->priority(inst, buffer, buffer_len);
@@ -3035,7 +3157,8 @@ int fr_master_io_listen(TALLOC_CTX *ctx, fr_io_instance_t *inst, fr_schedule_t *
 	li->name = child->name;
 
 	/*
-	 *	Record which socket we opened.
+	 *	Record which socket we opened, so that it can be
+	 *	handed over to a new process on reload.
 	 */
 	if (child->app_io_addr) {
 		fr_listen_t *other;
@@ -3050,10 +3173,10 @@ int fr_master_io_listen(TALLOC_CTX *ctx, fr_io_instance_t *inst, fr_schedule_t *
 			talloc_free(li);
 			return -1;
 		}
-
-		(void) listen_record(child);
 	}
 
+	(void) listen_record(child);
+
 	/*
 	 *	Add the socket to the scheduler, where it might end up
 	 *	in a different thread.
@@ -3067,6 +3190,40 @@ int fr_master_io_listen(TALLOC_CTX *ctx, fr_io_instance_t *inst, fr_schedule_t *
 }
 
 
+/** Inject a packet into a master socket, as if it had been read from the socket
+ *
+ *  The packet goes through the same client lookup and duplicate
+ *  detection as any other packet, and the reply is written to the
+ *  socket.
+ *
+ * @param[in] child		the listener which opened the socket, as recorded by listen_record().
+ * @param[in] socket		where the packet came from, and which address it was sent to.
+ * @param[in] packet		to inject.
+ * @param[in] packet_len	length of the packet.
+ * @return
+ *	- 0 on success.
+ *	- -1 on error.
+ */
+int fr_master_io_inject(fr_listen_t *child, fr_socket_t const *socket, uint8_t const *packet, size_t packet_len)
+{
+	fr_listen_t	*li = talloc_parent(child);
+	fr_io_thread_t	*thread;
+
+	if (!li || (li->app_io != &fr_master_app_io) ||
+	    (((fr_io_thread_t *) li->thread_instance)->child != child)) {
+		fr_strerror_printf("Socket %s is not read by a master listener", child->name);
+		return -1;
+	}
+
+	thread = li->thread_instance;
+	if (!thread->nr) {
+		fr_strerror_printf("Socket %s is not being read", child->name);
+		return -1;
+	}
+
+	return fr_network_listen_inject(thread->nr, li, packet, packet_len, fr_time(), socket);
+}
+
 fr_app_io_t fr_master_app_io = {
 	.common = {
 		.magic			= MODULE_MAGIC_INIT,
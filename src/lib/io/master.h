@@ -115,6 +115,8 @@ extern fr_app_io_t fr_master_app_io;
 fr_trie_t *fr_master_io_network(TALLOC_CTX *ctx, int af, fr_ipaddr_t *allow, fr_ipaddr_t *deny);
 int fr_master_io_listen(TALLOC_CTX *ctx, fr_io_instance_t *io, fr_schedule_t *sc,
 			size_t default_message_size, size_t num_messages) CC_HINT(nonnull);
+int fr_master_io_inject(fr_listen_t *child, fr_socket_t const *socket,
+			uint8_t const *packet, size_t packet_len) CC_HINT(nonnull);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,127 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Tests for per-client rate limiting
+ *
+ * @file src/lib/io/master_tests.c
+ * @copyright 2026 The FreeRADIUS server project
+ */
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+
+#include "master.c"
+
+/*
+ *	An arbitrary time, well away from zero.
+ */
+#define TEST_NOW	fr_time_wrap((int64_t)1000 * NSEC)
+
+/** Send packets at the same time, returning how many were allowed
+ *
+ */
+static int test_burst(atomic_int_fast64_t *tat, fr_socket_limit_t const *limit, fr_time_t now, int num)
+{
+	int i, allowed = 0;
+
+	for (i = 0; i < num; i++) if (!rate_limited(tat, limit, now)) allowed++;
+
+	return allowed;
+}
+
+static void test_no_limit(void)
+{
+	atomic_int_fast64_t	tat = 0;
+	fr_socket_limit_t	limit = { .max_packets_per_second = 0 };
+
+	TEST_CASE("Packets are never dropped without max_packets_per_second");
+	TEST_CHECK_RET(test_burst(&tat, &limit, TEST_NOW, 1000), 1000);
+	TEST_CHECK(atomic_load(&tat) == 0);
+}
+
+static void test_default_burst(void)
+{
+	atomic_int_fast64_t	tat = 0;
+	fr_socket_limit_t	limit = { .max_packets_per_second = 10 };
+
+	TEST_CASE("Without max_packet_burst, one second's worth of packets may arrive at once");
+	TEST_CHECK_RET(test_burst(&tat, &limit, TEST_NOW, 20), 10);
+
+	TEST_CASE("Dropped packets don't push the next packet back");
+	TEST_CHECK_RET(test_burst(&tat, &limit, fr_time_add(TEST_NOW, fr_time_delta_from_msec(100)), 5), 1);
+	TEST_CHECK_RET(test_burst(&tat, &limit, fr_time_add(TEST_NOW, fr_time_delta_from_msec(150)), 5), 0);
+	TEST_CHECK_RET(test_burst(&tat, &limit, fr_time_add(TEST_NOW, fr_time_delta_from_msec(300)), 5), 2);
+
+	TEST_CASE("The whole burst is available again after an idle second");
+	TEST_CHECK_RET(test_burst(&tat, &limit, fr_time_add(TEST_NOW, fr_time_delta_from_sec(10)), 20), 10);
+}
+
+static void test_explicit_burst(void)
+{
+	atomic_int_fast64_t	tat = 0;
+	fr_socket_limit_t	limit = { .max_packets_per_second = 100, .max_packet_burst = 1 };
+	int			i, allowed = 0;
+
+	TEST_CASE("A burst of 1 only allows one packet per interval");
+	TEST_CHECK_RET(test_burst(&tat, &limit, TEST_NOW, 5), 1);
+	TEST_CHECK_RET(test_burst(&tat, &limit, fr_time_add(TEST_NOW, fr_time_delta_from_msec(9)), 5), 0);
+	TEST_CHECK_RET(test_burst(&tat, &limit, fr_time_add(TEST_NOW, fr_time_delta_from_msec(10)), 5), 1);
+
+	TEST_CASE("Packets arriving at the configured rate are all allowed");
+	for (i = 0; i < 100; i++) {
+		if (!rate_limited(&tat, &limit, fr_time_add(TEST_NOW, fr_time_delta_from_msec(20 + (i * 10))))) allowed++;
+	}
+	TEST_CHECK_RET(allowed, 100);
+
+	TEST_CASE("Packets arriving at twice the configured rate are halved");
+	allowed = 0;
+	for (i = 0; i < 100; i++) {
+		if (!rate_limited(&tat, &limit, fr_time_add(TEST_NOW, fr_time_delta_from_msec(2000 + (i * 5))))) allowed++;
+	}
+	TEST_CHECK_RET(allowed, 50);
+}
+
+static void test_shared(void)
+{
+	RADCLIENT		configured = { .limit = { .max_packets_per_second = 10 } };
+	RADCLIENT		copy_a = { .limit = configured.limit, .configured = &configured };
+	RADCLIENT		copy_b = { .limit = configured.limit, .configured = &configured };
+	RADCLIENT		dynamic = { .limit = configured.limit };
+	fr_io_client_t		client_a = { .radclient = &copy_a };
+	fr_io_client_t		client_b = { .radclient = &copy_b };
+	fr_io_client_t		client_dynamic = { .radclient = &dynamic };
+	int			i, allowed = 0;
+
+	TEST_CASE("Copies of a configured client share its rate limit");
+	for (i = 0; i < 10; i++) {
+		if (!client_rate_limited(&client_a, TEST_NOW)) allowed++;
+		if (!client_rate_limited(&client_b, TEST_NOW)) allowed++;
+	}
+	TEST_CHECK_RET(allowed, 10);
+
+	TEST_CASE("Clients which aren't copies have their own rate limit");
+	allowed = 0;
+	for (i = 0; i < 20; i++) if (!client_rate_limited(&client_dynamic, TEST_NOW)) allowed++;
+	TEST_CHECK_RET(allowed, 10);
+}
+
+TEST_LIST = {
+	{ "no_limit",		test_no_limit },
+	{ "default_burst",	test_default_burst },
+	{ "explicit_burst",	test_explicit_burst },
+	{ "shared",		test_shared },
+
+	{ NULL }
+};
@@ -44,6 +44,8 @@ RCSID("$Id$")
 #include <freeradius-devel/io/ring_buffer.h>
 #include <freeradius-devel/io/worker.h>
 
+#include <freeradius-devel/server/metrics.h>
+
 #define MAX_WORKERS 64
 
 static _Thread_local fr_ring_buffer_t *fr_network_rb;
@@ -53,6 +55,7 @@ typedef struct {
 	uint8_t			*packet;
 	size_t			packet_len;
 	fr_time_t		recv_time;
+	fr_socket_t		*socket;		//!< allocated in the context of the packet.
 } fr_network_inject_t;
 
 /** Associate a worker thread with a network thread
@@ -94,8 +97,45 @@ typedef struct {
 	fr_channel_data_t	*pending;		//!< the currently pending partial packet
 	fr_heap_t		*waiting;		//!< packets waiting to be written
 	fr_io_stats_t		stats;
+	uint64_t		rate_limited;		//!< packets dropped because a client sent too many.
 } fr_network_socket_t;
 
+/** Counters for one socket, as last published by the network thread
+ *
+ */
+typedef struct {
+	int			number;			//!< unique ID of the socket.
+	char const		*name;			//!< of the socket.
+	fr_io_stats_t		stats;
+} fr_network_socket_metrics_t;
+
+/** Counters for one network thread, as last published by that thread
+ *
+ * Metrics are printed by whichever thread serves the request for them,
+ * which is almost never the network thread which owns the counters.
+ * The owning thread copies everything here periodically, and readers
+ * only ever look at this copy, with the mutex held.
+ */
+typedef struct {
+	pthread_mutex_t		mutex;			//!< Held when publishing or reading.
+
+	fr_io_stats_t		stats;
+	uint64_t		rate_limited;
+	uint64_t		shed_low;
+	uint64_t		shed_normal;
+
+	fr_network_socket_metrics_t *sockets;		//!< talloced array, one entry per socket.
+
+	bool			channel[MAX_WORKERS];	//!< whether there's a channel to this worker.
+	fr_channel_stats_t	to_worker[MAX_WORKERS];
+	fr_channel_stats_t	to_network[MAX_WORKERS];
+} fr_network_metrics_t;
+
+/** How often a network thread publishes its metrics
+ *
+ */
+#define NETWORK_METRICS_INTERVAL (fr_time_delta_from_sec(1))
+
 /*
  *	We have an array of workers, so we can index the workers in
  *	O(1) time.  remove the heap of "workers ordered by CPU time"
@@ -116,6 +156,7 @@ struct fr_network_s {
 
 	bool			started;		//!< Set to true when the first worker is added.
 	bool			suspended;		//!< whether or not we're suspended.
+	bool			draining;		//!< no longer reading packets, see fr_network_drain().
 
 	fr_log_t const		*log;			//!< log destination
 	fr_log_lvl_t		lvl;			//!< debug log level
@@ -131,6 +172,9 @@ struct fr_network_s {
 	fr_heap_t		*replies;		//!< replies from the worker, ordered by priority / origin time
 
 	fr_io_stats_t		stats;
+	uint64_t		rate_limited;		//!< packets dropped because a client sent too many.
+	uint64_t		shed_low;		//!< low priority packets dropped because the workers are busy.
+	uint64_t		shed_normal;		//!< normal priority packets dropped because the workers are busy.
 
 	fr_rb_tree_t		*sockets;		//!< list of sockets we're managing, ordered by the listener
 	fr_rb_tree_t		*sockets_by_num;       	//!< ordered by number;
@@ -146,6 +190,9 @@ struct fr_network_s {
 
 	fr_network_config_t	config;			//!< configuration
 	fr_network_worker_t	*workers[MAX_WORKERS]; 	//!< each worker
+
+	fr_network_metrics_t	*metrics;		//!< Last published copy of our counters.
+	fr_event_timer_t const	*metrics_ev;		//!< When we next publish our counters.
 };
 
 static void fr_network_post_event(fr_event_list_t *el, fr_time_t now, void *uctx);
@@ -324,6 +371,25 @@ void fr_network_listen_read(fr_network_t *nr, fr_listen_t *li)
 }
 
 
+/** Count a packet which a listener dropped because the client is sending too many packets
+ *
+ *  MUST only be called from the network thread.
+ *
+ * @param nr the network
+ * @param li the listener which read the packet.
+ */
+void fr_network_listen_rate_limited(fr_network_t *nr, fr_listen_t *li)
+{
+	fr_network_socket_t *s;
+
+	fr_assert(is_network_thread(nr));
+
+	nr->rate_limited++;
+
+	s = fr_rb_find(nr->sockets, &(fr_network_socket_t){ .listen = li });
+	if (s) s->rate_limited++;
+}
+
 /** Inject a packet for a listener to write
  *
  * @param nr		the network
@@ -377,11 +443,13 @@ void fr_network_listen_write(fr_network_t *nr, fr_listen_t *li, uint8_t const *p
  * @param packet	the packet to be injected
  * @param packet_len	the length of the packet
  * @param recv_time	when the packet was received.
+ * @param socket	where the packet came from.  NULL for connected sockets.
  * @return
  *	- <0 on error
  *	- 0 on success
  */
-int fr_network_listen_inject(fr_network_t *nr, fr_listen_t *li, uint8_t const *packet, size_t packet_len, fr_time_t recv_time)
+int fr_network_listen_inject(fr_network_t *nr, fr_listen_t *li, uint8_t const *packet, size_t packet_len,
+			     fr_time_t recv_time, fr_socket_t const *socket)
 {
 	fr_ring_buffer_t *rb;
 	fr_network_inject_t my_inject;
@@ -401,6 +469,7 @@ int fr_network_listen_inject(fr_network_t *nr, fr_listen_t *li, uint8_t const *p
 	my_inject.packet = talloc_memdup(NULL, packet, packet_len);
 	my_inject.packet_len = packet_len;
 	my_inject.recv_time = recv_time;
+	my_inject.socket = socket ? talloc_memdup(my_inject.packet, socket, sizeof(*socket)) : NULL;
 
 	return fr_control_message_send(nr->control, rb, FR_CONTROL_ID_INJECT, &my_inject, sizeof(my_inject));
 }
@@ -433,7 +502,7 @@ static void fr_network_unsuspend(fr_network_t *nr)
 	fr_rb_iter_inorder_t	iter;
 	fr_network_socket_t		*socket;
 
-	if (!nr->suspended) return;
+	if (!nr->suspended || nr->draining) return;
 
 	for (socket = fr_rb_iter_init_inorder(&iter, nr->sockets);
 	     socket;
@@ -443,6 +512,50 @@ static void fr_network_unsuspend(fr_network_t *nr)
 	nr->suspended = false;
 }
 
+/** Stop reading packets from all sockets
+ *
+ */
+static void fr_network_drain_self(fr_network_t *nr)
+{
+	if (nr->draining) return;
+
+	DEBUG("%s - No longer reading packets", nr->name);
+
+	fr_network_suspend(nr);
+	nr->draining = true;
+}
+
+static void fr_network_drain_callback(void *ctx, UNUSED void const *data, UNUSED size_t data_size, UNUSED fr_time_t now)
+{
+	fr_network_t *nr = talloc_get_type_abort(ctx, fr_network_t);
+
+	fr_network_drain_self(nr);
+}
+
+/** Stop a network from reading new packets
+ *
+ *  Replies to requests which are already being processed are still
+ *  written.  Once a network is draining, it never reads packets
+ *  again.  This is used when handing the sockets over to another
+ *  instance of the server.
+ *
+ * @param nr		the network
+ */
+int fr_network_drain(fr_network_t *nr)
+{
+	fr_ring_buffer_t *rb;
+
+	if (is_network_thread(nr)) {
+		fr_network_drain_self(nr);
+		return 0;
+	}
+
+	rb = fr_network_rb_init();
+	if (!rb) return -1;
+
+	return fr_control_message_send(nr->control, rb, FR_CONTROL_ID_DRAIN, &nr, sizeof(nr));
+}
+
 #define IALPHA (8)
 #define RTT(_old, _new) fr_time_delta_wrap((fr_time_delta_unwrap(_new) + (fr_time_delta_unwrap(_old) * (IALPHA - 1))) / IALPHA)
 
@@ -563,6 +676,31 @@ static void fr_network_channel_callback(void *ctx, void const *data, size_t data
 
 #define OUTSTANDING(_x) ((_x)->stats.in - (_x)->stats.out)
 
+/** Whether a packet should be dropped, to leave room for higher priority packets
+ *
+ * @param[in] config		of the network.
+ * @param[in] priority		of the packet.
+ * @param[in] outstanding	packets for the least busy worker.
+ * @return
+ *	- true if the packet should be dropped.
+ *	- false if the packet should be sent to the worker.
+ */
+static inline CC_HINT(always_inline) bool network_shed(fr_network_config_t const *config,
+						       uint32_t priority, uint64_t outstanding)
+{
+	if ((priority <= PRIORITY_LOW) &&
+	    config->shed_low_priority && (outstanding >= config->shed_low_priority)) return true;
+
+	/*
+	 *	Low priority packets are also dropped whenever normal
+	 *	priority ones are.
+	 */
+	if ((priority <= PRIORITY_NORMAL) &&
+	    config->shed_normal_priority && (outstanding >= config->shed_normal_priority)) return true;
+
+	return false;
+}
+
 /** Send a message on the "best" channel.
  *
  * @param nr the network
@@ -658,6 +796,27 @@ retry:
 
 	(void) talloc_get_type_abort(worker, fr_network_worker_t);
 
+	/*
+	 *	Admission control.  When the least busy worker we
+	 *	could find is getting full, drop the less important
+	 *	packets first.  That leaves room in the queues for
+	 *	the high priority packets, so that their latency
+	 *	stays flat.
+	 *
+	 *	Dropped packets will be retransmitted by the client.
+	 *	By then, the workers may have caught up.
+	 */
+	if (network_shed(&nr->config, cd->priority, OUTSTANDING(worker))) {
+		if (cd->priority <= PRIORITY_LOW) {
+			RATE_LIMIT_GLOBAL(WARN, "shed_low_priority reached - dropping low priority packet");
+			nr->shed_low++;
+		} else {
+			RATE_LIMIT_GLOBAL(WARN, "shed_normal_priority reached - dropping normal priority packet");
+			nr->shed_normal++;
+		}
+		return -1;
+	}
+
 	/*
 	 *	Too many outstanding packets for this worker.  Drop
 	 *	the request.
@@ -1472,7 +1631,8 @@ static void fr_network_inject_callback(void *ctx, void const *data, size_t data_
 	 *	Inject the packet, and then read it back from the
 	 *	network.
 	 */
-	if (s->listen->app_io->inject(s->listen, my_inject.packet, my_inject.packet_len, my_inject.recv_time) == 0) {
+	if (s->listen->app_io->inject(s->listen, my_inject.packet, my_inject.packet_len, my_inject.recv_time,
+				     my_inject.socket) == 0) {
 		fr_network_read(nr->el, s->listen->fd, 0, s);
 	}
 
@@ -1734,6 +1894,63 @@ int fr_network_exit(fr_network_t *nr)
 	return 0;
 }
 
+static int _network_metrics_free(fr_network_metrics_t *m)
+{
+	pthread_mutex_destroy(&m->mutex);
+
+	return 0;
+}
+
+/** Publish a copy of our counters, for fr_network_metrics()
+ *
+ * This runs in the network thread, so it's safe to walk the sockets.
+ */
+static void network_metrics_publish(fr_event_list_t *el, fr_time_t now, void *uctx)
+{
+	fr_network_t		*nr = talloc_get_type_abort(uctx, fr_network_t);
+	fr_network_metrics_t	*m = nr->metrics;
+	fr_rb_iter_inorder_t	iter;
+	fr_network_socket_t	*s;
+	int			i;
+
+	pthread_mutex_lock(&m->mutex);
+
+	m->stats = nr->stats;
+	m->rate_limited = nr->rate_limited;
+	m->shed_low = nr->shed_low;
+	m->shed_normal = nr->shed_normal;
+
+	TALLOC_FREE(m->sockets);
+	MEM(m->sockets = talloc_array(m, fr_network_socket_metrics_t, fr_rb_num_elements(nr->sockets_by_num)));
+
+	for (s = fr_rb_iter_init_inorder(&iter, nr->sockets_by_num), i = 0;
+	     s;
+	     s = fr_rb_iter_next_inorder(&iter), i++) {
+		char const *name = s->listen->app_io->get_name ? s->listen->app_io->get_name(s->listen) :
+								 s->listen->app_io->common.name;
+
+		m->sockets[i] = (fr_network_socket_metrics_t) {
+			.number = s->number,
+			.stats = s->stats
+		};
+		MEM(m->sockets[i].name = talloc_strdup(m->sockets, name));
+	}
+
+	for (i = 0; i < nr->max_workers; i++) {
+		m->channel[i] = (nr->workers[i] != NULL);
+		if (!m->channel[i]) continue;
+
+		fr_channel_stats_get(&m->to_worker[i], &m->to_network[i], nr->workers[i]->channel);
+	}
+
+	pthread_mutex_unlock(&m->mutex);
+
+	if (fr_event_timer_at(nr, el, &nr->metrics_ev, fr_time_add(now, NETWORK_METRICS_INTERVAL),
+			      network_metrics_publish, nr) < 0) {
+		PERROR("Failed inserting metrics timer");
+	}
+}
+
 /** Free any resources associated with a network thread
  *
  */
@@ -1836,6 +2053,11 @@ fr_network_t *fr_network_create(TALLOC_CTX *ctx, fr_event_list_t *el, char const
 		goto fail2;
 	}
 
+	if (fr_control_callback_add(nr->control, FR_CONTROL_ID_DRAIN, nr, fr_network_drain_callback) < 0) {
+		fr_strerror_const_push("Failed adding drain callback");
+		goto fail2;
+	}
+
 	/*
 	 *	Create the various heaps.
 	 */
@@ -1879,6 +2101,11 @@ fr_network_t *fr_network_create(TALLOC_CTX *ctx, fr_event_list_t *el, char const
 		goto fail2;
 	}
 
+	MEM(nr->metrics = talloc_zero(nr, fr_network_metrics_t));
+	pthread_mutex_init(&nr->metrics->mutex, NULL);
+	talloc_set_destructor(nr->metrics, _network_metrics_free);
+	network_metrics_publish(nr->el, fr_time(), nr);
+
 	return nr;
 }
 
@@ -1912,6 +2139,128 @@ void fr_network_stats_log(fr_network_t const *nr, fr_log_t const *log)
 	}
 }
 
+static char const *network_metrics_types[] = { "in", "out", "dup", "dropped" };
+
+/** Print OpenMetrics for a set of network threads
+ *
+ * @param[in] fp	to print to.
+ * @param[in] nrs	network threads, labelled by their index in the array.
+ * @param[in] num	number of network threads.
+ */
+void fr_network_metrics(FILE *fp, fr_network_t const **nrs, int num)
+{
+	int			i, j, k;
+	fr_network_metrics_t	*m;
+
+	/*
+	 *	We only read the copies published by each network
+	 *	thread.  Nothing else is safe to look at from here.
+	 */
+	for (i = 0; i < num; i++) pthread_mutex_lock(&nrs[i]->metrics->mutex);
+
+	fr_metrics_family(fp, "freeradius_network_packets", FR_METRICS_TYPE_COUNTER,
+			  "Packets handled by a network thread.");
+	for (i = 0; i < num; i++) {
+		uint64_t stats[NUM_ELEMENTS(network_metrics_types)];
+
+		m = nrs[i]->metrics;
+		stats[0] = m->stats.in;
+		stats[1] = m->stats.out;
+		stats[2] = m->stats.dup;
+		stats[3] = m->stats.dropped;
+
+		for (j = 0; j < (int) NUM_ELEMENTS(stats); j++) {
+			fprintf(fp, "freeradius_network_packets_total{network=\"%d\",type=\"%s\"} %" PRIu64 "\n",
+				i, network_metrics_types[j], stats[j]);
+		}
+	}
+
+	fr_metrics_family(fp, "freeradius_listener_packets", FR_METRICS_TYPE_COUNTER,
+			  "Packets handled by a socket.");
+	for (i = 0; i < num; i++) {
+		m = nrs[i]->metrics;
+
+		for (k = 0; k < (int) talloc_array_length(m->sockets); k++) {
+			fr_network_socket_metrics_t const	*socket = &m->sockets[k];
+			uint64_t				stats[NUM_ELEMENTS(network_metrics_types)] = {
+									socket->stats.in, socket->stats.out,
+									socket->stats.dup, socket->stats.dropped
+								};
+
+			for (j = 0; j < (int) NUM_ELEMENTS(stats); j++) {
+				fprintf(fp, "freeradius_listener_packets_total{network=\"%d\",socket=\"%d\",",
+					i, socket->number);
+				fr_metrics_label(fp, "name", socket->name);
+				fprintf(fp, ",type=\"%s\"} %" PRIu64 "\n", network_metrics_types[j], stats[j]);
+			}
+		}
+	}
+
+	fr_metrics_family(fp, "freeradius_network_rate_limited", FR_METRICS_TYPE_COUNTER,
+			  "Packets dropped because a client exceeded its packet rate.");
+	for (i = 0; i < num; i++) {
+		fprintf(fp, "freeradius_network_rate_limited_total{network=\"%d\"} %" PRIu64 "\n",
+			i, nrs[i]->metrics->rate_limited);
+	}
+
+	fr_metrics_family(fp, "freeradius_network_shed", FR_METRICS_TYPE_COUNTER,
+			  "Packets dropped by admission control because the workers were busy.");
+	for (i = 0; i < num; i++) {
+		fprintf(fp, "freeradius_network_shed_total{network=\"%d\",priority=\"low\"} %" PRIu64 "\n",
+			i, nrs[i]->metrics->shed_low);
+		fprintf(fp, "freeradius_network_shed_total{network=\"%d\",priority=\"normal\"} %" PRIu64 "\n",
+			i, nrs[i]->metrics->shed_normal);
+	}
+
+	/*
+	 *	Channels between this network thread and its workers.
+	 */
+	fr_metrics_family(fp, "freeradius_channel_messages", FR_METRICS_TYPE_COUNTER,
+			  "Messages sent over a channel between a network thread and a worker.");
+	for (i = 0; i < num; i++) {
+		m = nrs[i]->metrics;
+
+		for (j = 0; j < MAX_WORKERS; j++) {
+			if (!m->channel[j]) continue;
+
+			fprintf(fp, "freeradius_channel_messages_total{network=\"%d\",channel=\"%d\",direction=\"to_worker\"} %" PRIu64 "\n",
+				i, j, m->to_worker[j].packets);
+			fprintf(fp, "freeradius_channel_messages_total{network=\"%d\",channel=\"%d\",direction=\"to_network\"} %" PRIu64 "\n",
+				i, j, m->to_network[j].packets);
+		}
+	}
+
+	fr_metrics_family(fp, "freeradius_channel_signals", FR_METRICS_TYPE_COUNTER,
+			  "Signals sent over a channel between a network thread and a worker.");
+	for (i = 0; i < num; i++) {
+		m = nrs[i]->metrics;
+
+		for (j = 0; j < MAX_WORKERS; j++) {
+			if (!m->channel[j]) continue;
+
+			fprintf(fp, "freeradius_channel_signals_total{network=\"%d\",channel=\"%d\",direction=\"to_worker\"} %" PRIu64 "\n",
+				i, j, m->to_worker[j].signals);
+			fprintf(fp, "freeradius_channel_signals_total{network=\"%d\",channel=\"%d\",direction=\"to_network\"} %" PRIu64 "\n",
+				i, j, m->to_network[j].signals);
+		}
+	}
+
+	fr_metrics_family(fp, "freeradius_channel_outstanding", FR_METRICS_TYPE_GAUGE,
+			  "Requests sent to a worker which have not yet been answered.");
+	for (i = 0; i < num; i++) {
+		m = nrs[i]->metrics;
+
+		for (j = 0; j < MAX_WORKERS; j++) {
+			if (!m->channel[j]) continue;
+
+			fprintf(fp, "freeradius_channel_outstanding{network=\"%d\",channel=\"%d\"} %" PRIu64 "\n",
+				i, j, m->to_worker[j].outstanding);
+		}
+	}
+
+	for (i = 0; i < num; i++) pthread_mutex_unlock(&nrs[i]->metrics->mutex);
+}
+
 static int cmd_stats_self(FILE *fp, UNUSED FILE *fp_err, void *ctx, UNUSED fr_cmd_info_t const *info)
 {
 	fr_network_t const *nr = ctx;
@@ -1920,6 +2269,9 @@ static int cmd_stats_self(FILE *fp, UNUSED FILE *fp_err, void *ctx, UNUSED fr_cm
 	fprintf(fp, "count.out\t%" PRIu64 "\n", nr->stats.out);
 	fprintf(fp, "count.dup\t%" PRIu64 "\n", nr->stats.dup);
 	fprintf(fp, "count.dropped\t%" PRIu64 "\n", nr->stats.dropped);
+	fprintf(fp, "count.rate_limited\t%" PRIu64 "\n", nr->rate_limited);
+	fprintf(fp, "count.shed_low\t%" PRIu64 "\n", nr->shed_low);
+	fprintf(fp, "count.shed_normal\t%" PRIu64 "\n", nr->shed_normal);
 	fprintf(fp, "count.sockets\t%u\n", fr_rb_num_elements(nr->sockets));
 
 	return 0;
@@ -1960,6 +2312,7 @@ static int cmd_stats_socket(FILE *fp, FILE *fp_err, void *ctx, fr_cmd_info_t con
 	fprintf(fp, "count.out\t%" PRIu64 "\n", s->stats.out);
 	fprintf(fp, "count.dup\t%" PRIu64 "\n", s->stats.dup);
 	fprintf(fp, "count.dropped\t%" PRIu64 "\n", s->stats.dropped);
+	fprintf(fp, "count.rate_limited\t%" PRIu64 "\n", s->rate_limited);
 
 	return 0;
 }
@@ -44,6 +44,8 @@ extern "C" {
 
 typedef struct {
 	uint32_t	max_outstanding;
+	uint32_t	shed_low_priority;	//!< Drop low priority packets when a worker has this many outstanding.
+	uint32_t	shed_normal_priority;	//!< Drop normal priority packets when a worker has this many outstanding.
 } fr_network_config_t;
 
 int		fr_network_listen_add(fr_network_t *nr, fr_listen_t *li) CC_HINT(nonnull);
@@ -54,12 +56,17 @@ int		fr_network_directory_add(fr_network_t *nr, fr_listen_t *li) CC_HINT(nonnull
 
 int		fr_network_worker_add(fr_network_t *nr, fr_worker_t *worker) CC_HINT(nonnull);
 
+int		fr_network_drain(fr_network_t *nr) CC_HINT(nonnull);
+
 void		fr_network_listen_read(fr_network_t *nr, fr_listen_t *li) CC_HINT(nonnull);
 
+void		fr_network_listen_rate_limited(fr_network_t *nr, fr_listen_t *li) CC_HINT(nonnull);
+
 void		fr_network_listen_write(fr_network_t *nr, fr_listen_t *li, uint8_t const *packet, size_t packet_len,
 					void *packet_ctx, fr_time_t request_time) CC_HINT(nonnull);
 
-int		fr_network_listen_inject(fr_network_t *nr, fr_listen_t *li, uint8_t const *packet, size_t packet_len, fr_time_t recv_time);
+int		fr_network_listen_inject(fr_network_t *nr, fr_listen_t *li, uint8_t const *packet, size_t packet_len,
+					 fr_time_t recv_time, fr_socket_t const *socket);
 
 int		fr_network_listen_send_packet(fr_network_t *nr, fr_listen_t *parent, fr_listen_t *li,
 					      const uint8_t *buffer, size_t buflen, fr_time_t recv_time, void *packet_ctx) CC_HINT(nonnull(1,2,3,4));
@@ -80,6 +87,8 @@ int		fr_network_stats(fr_network_t const *nr, int num, uint64_t *stats) CC_HINT(
 
 void		fr_network_stats_log(fr_network_t const *nr, fr_log_t const *log) CC_HINT(nonnull);
 
+void		fr_network_metrics(FILE *fp, fr_network_t const **nrs, int num) CC_HINT(nonnull);
+
 extern fr_cmd_table_t cmd_network_table[];
 
 #ifdef __cplusplus
@@ -0,0 +1,80 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Tests for priority based load shedding
+ *
+ * @file src/lib/io/network_tests.c
+ * @copyright 2026 The FreeRADIUS server project
+ */
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+
+#include "network.c"
+
+static void test_disabled(void)
+{
+	fr_network_config_t config = { .max_outstanding = 100 };
+
+	TEST_CASE("Nothing is shed when the thresholds aren't set");
+	TEST_CHECK(!network_shed(&config, PRIORITY_LOW, 0));
+	TEST_CHECK(!network_shed(&config, PRIORITY_LOW, 1000));
+	TEST_CHECK(!network_shed(&config, PRIORITY_NORMAL, 1000));
+	TEST_CHECK(!network_shed(&config, PRIORITY_HIGH, 1000));
+}
+
+static void test_priority(void)
+{
+	fr_network_config_t config = { .shed_low_priority = 10, .shed_normal_priority = 20 };
+
+	TEST_CASE("Nothing is shed while the worker has room");
+	TEST_CHECK(!network_shed(&config, PRIORITY_LOW, 9));
+	TEST_CHECK(!network_shed(&config, PRIORITY_NORMAL, 9));
+	TEST_CHECK(!network_shed(&config, PRIORITY_HIGH, 9));
+
+	TEST_CASE("Low priority packets are shed first");
+	TEST_CHECK(network_shed(&config, PRIORITY_LOW, 10));
+	TEST_CHECK(network_shed(&config, PRIORITY_LOW - 1, 10));
+	TEST_CHECK(!network_shed(&config, PRIORITY_NORMAL, 10));
+	TEST_CHECK(!network_shed(&config, PRIORITY_HIGH, 10));
+
+	TEST_CASE("Then normal priority packets");
+	TEST_CHECK(network_shed(&config, PRIORITY_LOW, 20));
+	TEST_CHECK(network_shed(&config, PRIORITY_NORMAL, 20));
+	TEST_CHECK(network_shed(&config, PRIORITY_LOW + 1, 20));
+	TEST_CHECK(!network_shed(&config, PRIORITY_HIGH, 20));
+
+	TEST_CASE("High priority packets are never shed");
+	TEST_CHECK(!network_shed(&config, PRIORITY_HIGH, UINT64_MAX));
+	TEST_CHECK(!network_shed(&config, PRIORITY_NOW, UINT64_MAX));
+}
+
+static void test_normal_only(void)
+{
+	fr_network_config_t config = { .shed_normal_priority = 20 };
+
+	TEST_CASE("Low priority packets are shed with normal ones if only shed_normal_priority is set");
+	TEST_CHECK(!network_shed(&config, PRIORITY_LOW, 19));
+	TEST_CHECK(network_shed(&config, PRIORITY_LOW, 20));
+	TEST_CHECK(network_shed(&config, PRIORITY_NORMAL, 20));
+}
+
+TEST_LIST = {
+	{ "disabled",		test_disabled },
+	{ "priority",		test_priority },
+	{ "normal_only",	test_normal_only },
+
+	{ NULL }
+};
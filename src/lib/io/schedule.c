@@ -32,6 +32,7 @@ RCSID("$Id$")
 #include <freeradius-devel/util/dlist.h>
 #include <freeradius-devel/util/rb.h>
 #include <freeradius-devel/util/syserror.h>
+#include <freeradius-devel/server/metrics.h>
 #include <freeradius-devel/server/trigger.h>
 
 #include <pthread.h>
@@ -146,6 +147,8 @@ struct fr_schedule_s {
 
 	fr_network_t	*single_network;	//!< for single-threaded mode
 	fr_worker_t	*single_worker;		//!< for single-threaded mode
+
+	fr_metrics_t	metrics;		//!< for exporting network and worker statistics
 };
 
 static _Thread_local int worker_id;		//!< Internal ID of the current worker thread.
@@ -394,6 +397,98 @@ int fr_schedule_pthread_create(pthread_t *thread, void *(*func)(void *), void *a
 	return 0;
 }
 
+/** Print OpenMetrics for all network and worker threads
+ *
+ */
+static void schedule_metrics_print(FILE *fp, void *uctx)
+{
+	fr_schedule_t		*sc = talloc_get_type_abort(uctx, fr_schedule_t);
+	fr_network_t const	**nrs;
+	fr_worker_t const	**workers;
+	fr_schedule_network_t	*sn;
+	fr_schedule_worker_t	*sw;
+	int			num_networks = 0, num_workers = 0;
+
+	if (sc->el) {
+		fr_network_t const	*nr = sc->single_network;
+		fr_worker_t const	*worker = sc->single_worker;
+
+		fr_network_metrics(fp, &nr, 1);
+		fr_worker_metrics(fp, &worker, 1);
+		return;
+	}
+
+	MEM(nrs = talloc_array(NULL, fr_network_t const *, fr_dlist_num_elements(&sc->networks)));
+	for (sn = fr_dlist_head(&sc->networks);
+	     sn != NULL;
+	     sn = fr_dlist_next(&sc->networks, sn)) {
+		nrs[num_networks++] = sn->nr;
+	}
+	fr_network_metrics(fp, nrs, num_networks);
+	talloc_free(nrs);
+
+	MEM(workers = talloc_array(NULL, fr_worker_t const *, fr_dlist_num_elements(&sc->workers)));
+	for (sw = fr_dlist_head(&sc->workers);
+	     sw != NULL;
+	     sw = fr_dlist_next(&sc->workers, sw)) {
+		workers[num_workers++] = sw->worker;
+	}
+	fr_worker_metrics(fp, workers, num_workers);
+	talloc_free(workers);
+}
+
+static int cmd_show_cpu(FILE *fp, UNUSED FILE *fp_err, void *ctx, fr_cmd_info_t const *info)
+{
+	fr_schedule_t		*sc = talloc_get_type_abort(ctx, fr_schedule_t);
+	fr_worker_t		**workers;
+	fr_schedule_worker_t	*sw;
+	fr_worker_cpu_by_t	by;
+	int			num_workers = 0;
+	int			max = 10;
+
+	if (strcmp(info->argv[0], "client") == 0) {
+		by = FR_WORKER_CPU_BY_CLIENT;
+	} else if (strcmp(info->argv[0], "server") == 0) {
+		by = FR_WORKER_CPU_BY_SERVER;
+	} else if (strcmp(info->argv[0], "packet-type") == 0) {
+		by = FR_WORKER_CPU_BY_PACKET_TYPE;
+	} else {
+		by = FR_WORKER_CPU_BY_ALL;
+	}
+
+	if (info->argc > 1) max = info->box[1]->vb_uint32;
+
+	if (sc->el) {
+		fr_worker_cpu_usage_print(fp, &sc->single_worker, 1, by, max);
+		return 0;
+	}
+
+	MEM(workers = talloc_array(NULL, fr_worker_t *, fr_dlist_num_elements(&sc->workers)));
+	for (sw = fr_dlist_head(&sc->workers);
+	     sw != NULL;
+	     sw = fr_dlist_next(&sc->workers, sw)) {
+		workers[num_workers++] = sw->worker;
+	}
+	fr_worker_cpu_usage_print(fp, workers, num_workers, by, max);
+	talloc_free(workers);
+
+	return 0;
+}
+
+static fr_cmd_table_t cmd_schedule_table[] = {
+	{
+		.parent = "show",
+		.name = "cpu",
+		.syntax = "(client|server|packet-type|all) [INTEGER]",
+		.func = cmd_show_cpu,
+		.help = "Show the CPU time used by requests, summed over all workers, and the rate over the last minute.  "
+			"Only the top INTEGER entries are shown, default 10, or 0 for all.",
+		.read_only = true
+	},
+
+	CMD_TABLE_END
+};
+
 /** Create a scheduler and spawn the child threads.
  *
  * @param[in] ctx				talloc context.
@@ -483,6 +578,11 @@ fr_schedule_t *fr_schedule_create(TALLOC_CTX *ctx, fr_event_list_t *el,
 			goto st_fail;
 		}
 
+		if (fr_command_register_hook(NULL, NULL, sc, cmd_schedule_table) < 0) {
+			PERROR("Failed adding scheduler commands");
+			goto st_fail;
+		}
+
 		(void) fr_network_worker_add(sc->single_network, sc->single_worker);
 		DEBUG("Scheduler created in single-threaded mode");
 
@@ -499,6 +599,9 @@ fr_schedule_t *fr_schedule_create(TALLOC_CTX *ctx, fr_event_list_t *el,
 			goto st_fail;
 		}
 
+		sc->metrics = (fr_metrics_t) { .name = "schedule", .func = schedule_metrics_print, .uctx = sc };
+		fr_metrics_register(&sc->metrics);
+
 		return sc;
 	}
 
@@ -685,9 +788,17 @@ fr_schedule_t *fr_schedule_create(TALLOC_CTX *ctx, fr_event_list_t *el,
 		}
 	}
 
+	if (fr_command_register_hook(NULL, NULL, sc, cmd_schedule_table) < 0) {
+		PERROR("Failed adding scheduler commands");
+		goto st_fail;
+	}
+
 	if (sc) INFO("Scheduler created successfully with %u networks and %u workers",
 		     sc->config->max_networks, (unsigned int)fr_dlist_num_elements(&sc->workers));
 
+	sc->metrics = (fr_metrics_t) { .name = "schedule", .func = schedule_metrics_print, .uctx = sc };
+	fr_metrics_register(&sc->metrics);
+
 	return sc;
 }
 
@@ -714,6 +825,11 @@ int fr_schedule_destroy(fr_schedule_t **sc_to_free)
 
 	sc->running = false;
 
+	/*
+	 *	Stop printing metrics before the threads go away.
+	 */
+	fr_metrics_unregister(&sc->metrics);
+
 	/*
 	 *	Single threaded mode: kill the only network / worker we have.
 	 */
@@ -877,3 +993,58 @@ fr_network_t *fr_schedule_directory_add(fr_schedule_t *sc, fr_listen_t *li)
 
 	return nr;
 }
+
+/** Stop all networks from reading new packets
+ *
+ *  Requests which are already being processed run to completion,
+ *  and their replies are sent.
+ *
+ * @param[in] sc the scheduler
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int fr_schedule_drain(fr_schedule_t *sc)
+{
+	fr_schedule_network_t *sn;
+
+	(void) talloc_get_type_abort(sc, fr_schedule_t);
+
+	if (sc->el) return fr_network_drain(sc->single_network);
+
+	for (sn = fr_dlist_head(&sc->networks);
+	     sn != NULL;
+	     sn = fr_dlist_next(&sc->networks, sn)) {
+		if (fr_network_drain(sn->nr) < 0) return -1;
+	}
+
+	return 0;
+}
+
+/** Return the number of requests being processed by all workers
+ *
+ * @param[in] sc the scheduler
+ * @return the number of active requests.
+ */
+uint64_t fr_schedule_num_active(fr_schedule_t const *sc)
+{
+	fr_schedule_worker_t	*sw;
+	uint64_t		stats[6];
+	uint64_t		num_active = 0;
+
+	if (sc->el) {
+		if (fr_worker_stats(sc->single_worker, NUM_ELEMENTS(stats), stats) < 0) return 0;
+		return stats[5];
+	}
+
+	for (sw = fr_dlist_head(&sc->workers);
+	     sw != NULL;
+	     sw = fr_dlist_next(&sc->workers, sw)) {
+		if (!sw->worker) continue;
+
+		if (fr_worker_stats(sw->worker, NUM_ELEMENTS(stats), stats) < 0) continue;
+		num_active += stats[5];
+	}
+
+	return num_active;
+}
@@ -82,6 +82,9 @@ int			fr_schedule_destroy(fr_schedule_t **sc);
 
 fr_network_t		*fr_schedule_listen_add(fr_schedule_t *sc, fr_listen_t *li) CC_HINT(nonnull);
 fr_network_t		*fr_schedule_directory_add(fr_schedule_t *sc, fr_listen_t *li) CC_HINT(nonnull);
+
+int			fr_schedule_drain(fr_schedule_t *sc) CC_HINT(nonnull);
+uint64_t		fr_schedule_num_active(fr_schedule_t const *sc) CC_HINT(nonnull);
 #ifdef __cplusplus
 }
 #endif
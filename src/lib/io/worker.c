@@ -56,6 +56,8 @@ RCSID("$Id$")
 #include <freeradius-devel/io/message.h>
 #include <freeradius-devel/io/time_tracking.h>
 #include <freeradius-devel/io/worker.h>
+#include <freeradius-devel/server/client.h>
+#include <freeradius-devel/server/metrics.h>
 #include <freeradius-devel/unlang/base.h>
 #include <freeradius-devel/unlang/call.h>
 #include <freeradius-devel/unlang/interpret.h>
@@ -77,6 +79,28 @@ static alignas(CACHE_LINE_SIZE) atomic_uint64_t request_number = 0;
 /**
  *  A worker which takes packets from a master, and processes them.
  */
+/** Counters for one worker, as last published by that worker
+ *
+ * Metrics are printed from another thread, which can't safely look at
+ * the worker itself.  The worker copies its counters here periodically,
+ * and readers only ever look at this copy, with the mutex held.
+ */
+typedef struct {
+	pthread_mutex_t		mutex;		//!< Held when publishing or reading.
+
+	fr_io_stats_t		stats;
+	uint64_t		num_naks;
+	uint64_t		num_active;
+	uint64_t		num_runnable;
+	fr_time_delta_t		running_total;
+	fr_time_delta_t		waiting_total;
+} fr_worker_metrics_t;
+
+/** How often a worker publishes its metrics
+ *
+ */
+#define WORKER_METRICS_INTERVAL (fr_time_delta_from_sec(1))
+
 struct fr_worker_s {
 	char const		*name;		//!< name of this worker
 	fr_worker_config_t	config;		//!< external configuration
@@ -117,9 +141,50 @@ struct fr_worker_s {
 
 	fr_event_timer_t const	*ev_cleanup;	//!< timer for max_request_time
 
+	unlang_trace_t		*trace;		//!< ring of recent request execution, for debugging
+
+	fr_rb_tree_t		*cpu_usage;	//!< CPU time used by client, virtual server, and packet type.
+	pthread_mutex_t		cpu_usage_mutex; //!< Held when inserting into, or walking cpu_usage.
+
 	fr_channel_t		**channel;	//!< list of channels
+
+	fr_worker_metrics_t	*metrics;	//!< Last published copy of our counters.
+	fr_event_timer_t const	*metrics_ev;	//!< When we next publish our counters.
 };
 
+/** CPU time used by requests from one client, for one virtual server and packet type
+ *
+ */
+typedef struct {
+	fr_rb_node_t		node;		//!< Entry in the worker's cpu_usage tree.
+
+	fr_ipaddr_t		client_ip;	//!< Of the client which sent the requests.
+	CONF_SECTION const	*server_cs;	//!< Which ran the requests.
+	uint32_t		code;		//!< Packet code of the requests.
+
+	char const		*client;	//!< Short name of the client.
+	char const		*server;	//!< Name of the virtual server.
+	char const		*packet_type;	//!< Name of the packet type.
+
+	fr_time_delta_t		cpu;		//!< Total CPU time used.
+	uint64_t		requests;	//!< Number of requests.
+
+	fr_time_t		window_start;	//!< When the current window started.
+	fr_time_delta_t		window_cpu[2];	//!< CPU time used in the current, and the previous window.
+	uint64_t		window_requests[2]; //!< Requests in the current, and the previous window.
+} worker_cpu_usage_t;
+
+/** Limit how many entries each worker tracks.
+ *
+ * Requests which would need a new entry past this limit aren't counted.
+ */
+#define WORKER_CPU_USAGE_MAX	(4096)
+
+/** Recent CPU usage is averaged over this long
+ *
+ */
+#define WORKER_CPU_USAGE_WINDOW	(fr_time_delta_from_sec(60))
+
 static void worker_request_bootstrap(fr_worker_t *worker, fr_channel_data_t *cd, fr_time_t now);
 static void worker_send_reply(fr_worker_t *worker, request_t *request, size_t size, fr_time_t now);
 static void worker_max_request_time(UNUSED fr_event_list_t *el, UNUSED fr_time_t when, void *uctx);
@@ -486,6 +551,98 @@ static void worker_request_time_tracking_end(fr_worker_t *worker, request_t *req
 	if (fr_minmax_heap_entry_inserted(request->time_order_id)) (void) fr_minmax_heap_extract(worker->time_order, request);
 }
 
+static int8_t worker_cpu_usage_cmp(void const *one, void const *two)
+{
+	int ret;
+	worker_cpu_usage_t const *a = one, *b = two;
+
+	ret = fr_ipaddr_cmp(&a->client_ip, &b->client_ip);
+	if (ret) return ret;
+
+	ret = CMP(a->server_cs, b->server_cs);
+	if (ret) return ret;
+
+	return CMP(a->code, b->code);
+}
+
+/** Start a new window if the current one has ended
+ *
+ */
+static void worker_cpu_usage_window(worker_cpu_usage_t *usage, fr_time_t now)
+{
+	fr_time_delta_t	elapsed = fr_time_sub(now, usage->window_start);
+
+	if (fr_time_delta_lt(elapsed, WORKER_CPU_USAGE_WINDOW)) return;
+
+	/*
+	 *	Nothing happened for a whole window, so the previous
+	 *	one is empty, too.
+	 */
+	if (fr_time_delta_lt(elapsed, fr_time_delta_add(WORKER_CPU_USAGE_WINDOW, WORKER_CPU_USAGE_WINDOW))) {
+		usage->window_cpu[1] = usage->window_cpu[0];
+		usage->window_requests[1] = usage->window_requests[0];
+		usage->window_start = fr_time_add(usage->window_start, WORKER_CPU_USAGE_WINDOW);
+	} else {
+		usage->window_cpu[1] = fr_time_delta_wrap(0);
+		usage->window_requests[1] = 0;
+		usage->window_start = now;
+	}
+
+	usage->window_cpu[0] = fr_time_delta_wrap(0);
+	usage->window_requests[0] = 0;
+}
+
+/** Charge the CPU time used by a finished request to its client, virtual server and packet type
+ *
+ * Entries are only ever added or updated by the worker, with the mutex
+ * held, so that readers in other threads see consistent values.  The
+ * mutex is only ever contended while someone is running "show cpu".
+ */
+static void worker_cpu_usage_account(fr_worker_t *worker, request_t *request, fr_time_t now)
+{
+	worker_cpu_usage_t	my_usage, *usage;
+	fr_time_delta_t		cpu = request->async->tracking.running_total;
+
+	memset(&my_usage, 0, sizeof(my_usage));
+	if (request->client) my_usage.client_ip = request->client->ipaddr;
+	my_usage.server_cs = request->async->listen->server_cs;
+	my_usage.code = request->packet->code;
+
+	usage = fr_rb_find(worker->cpu_usage, &my_usage);
+	if (!usage) {
+		fr_dict_attr_t const	*da;
+		char const		*name = NULL;
+
+		if (fr_rb_num_elements(worker->cpu_usage) >= WORKER_CPU_USAGE_MAX) return;
+
+		MEM(usage = talloc(worker->cpu_usage, worker_cpu_usage_t));
+		*usage = my_usage;
+		usage->window_start = now;
+
+		usage->client = talloc_strdup(usage, (request->client && request->client->shortname) ?
+					      request->client->shortname : "-");
+		usage->server = talloc_strdup(usage, usage->server_cs ? cf_section_name2(usage->server_cs) : "-");
+
+		da = fr_dict_attr_by_name(NULL, fr_dict_root(request->dict), "Packet-Type");
+		if (da) name = fr_dict_enum_name_by_value(da, fr_box_uint32(usage->code));
+		usage->packet_type = name ? talloc_strdup(usage, name) : talloc_asprintf(usage, "%u", usage->code);
+
+		pthread_mutex_lock(&worker->cpu_usage_mutex);
+		(void) fr_rb_insert(worker->cpu_usage, usage);
+	} else {
+		pthread_mutex_lock(&worker->cpu_usage_mutex);
+	}
+
+	usage->cpu = fr_time_delta_add(usage->cpu, cpu);
+	usage->requests++;
+
+	worker_cpu_usage_window(usage, now);
+	usage->window_cpu[0] = fr_time_delta_add(usage->window_cpu[0], cpu);
+	usage->window_requests[0]++;
+
+	pthread_mutex_unlock(&worker->cpu_usage_mutex);
+}
+
 /** Send a response packet to the network side
  *
  * @param[in] worker		This worker.
@@ -823,6 +980,8 @@ nak:
 		(void) fr_rb_insert(worker->dedup, request);
 	}
 
+	if (worker->trace) unlang_trace_request_start(worker->trace, request);
+
 	worker_request_time_tracking_start(worker, request, now);
 }
 
@@ -946,11 +1105,13 @@ static void _worker_request_internal_init(request_t *request, void *uctx)
 /** External request is now complete
  *
  */
-static void _worker_request_done_external(request_t *request, UNUSED rlm_rcode_t rcode, void *uctx)
+static void _worker_request_done_external(request_t *request, rlm_rcode_t rcode, void *uctx)
 {
 	fr_worker_t	*worker = talloc_get_type_abort(uctx, fr_worker_t);
 	fr_time_t 	now = fr_time();
 
+	if (worker->trace) unlang_trace_request_done(worker->trace, request, rcode);
+
 	/*
 	 *	All external requests MUST have a listener.
 	 */
@@ -988,6 +1149,7 @@ static void _worker_request_done_external(request_t *request, UNUSED rlm_rcode_t
 	 *	The request is done.  Track that.
 	 */
 	worker_request_time_tracking_end(worker, request, now);
+	worker_cpu_usage_account(worker, request, now);
 
 	/*
 	 *	These conditions are true when the server is
@@ -1198,6 +1360,43 @@ static inline CC_HINT(always_inline) void worker_run_request(fr_worker_t *worker
 	}
 }
 
+static int _worker_free(fr_worker_t *worker)
+{
+	pthread_mutex_destroy(&worker->cpu_usage_mutex);
+
+	return 0;
+}
+
+static int _worker_metrics_free(fr_worker_metrics_t *m)
+{
+	pthread_mutex_destroy(&m->mutex);
+
+	return 0;
+}
+
+/** Publish a copy of our counters, for fr_worker_metrics()
+ *
+ */
+static void worker_metrics_publish(fr_event_list_t *el, fr_time_t now, void *uctx)
+{
+	fr_worker_t		*worker = talloc_get_type_abort(uctx, fr_worker_t);
+	fr_worker_metrics_t	*m = worker->metrics;
+
+	pthread_mutex_lock(&m->mutex);
+	m->stats = worker->stats;
+	m->num_naks = worker->num_naks;
+	m->num_active = worker->num_active;
+	m->num_runnable = fr_heap_num_elements(worker->runnable);
+	m->running_total = worker->tracking.running_total;
+	m->waiting_total = worker->tracking.waiting_total;
+	pthread_mutex_unlock(&m->mutex);
+
+	if (fr_event_timer_at(worker, el, &worker->metrics_ev, fr_time_add(now, WORKER_METRICS_INTERVAL),
+			      worker_metrics_publish, worker) < 0) {
+		PERROR("Failed inserting metrics timer");
+	}
+}
+
 /** Create a worker
  *
  * @param[in] ctx the talloc context
@@ -1301,6 +1500,14 @@ nomem:
 		goto fail;
 	}
 
+	worker->cpu_usage = fr_rb_inline_talloc_alloc(worker, worker_cpu_usage_t, node, worker_cpu_usage_cmp, NULL);
+	if (!worker->cpu_usage) {
+		fr_strerror_const("Failed creating CPU usage tree");
+		goto fail;
+	}
+	pthread_mutex_init(&worker->cpu_usage_mutex, NULL);
+	talloc_set_destructor(worker, _worker_free);
+
 	worker->intp = unlang_interpret_init(worker, el,
 					     &(unlang_request_func_t){
 							.init_internal = _worker_request_internal_init,
@@ -1324,6 +1531,20 @@ nomem:
 	}
 	unlang_interpret_set_thread_default(worker->intp);
 
+	if (worker->config.trace_records) {
+		worker->trace = unlang_trace_alloc(worker, worker->config.trace_records);
+		if (!worker->trace) {
+			fr_strerror_const_push("Failed creating trace ring");
+			goto fail;
+		}
+		unlang_interpret_set_trace(worker->intp, worker->trace);
+	}
+
+	MEM(worker->metrics = talloc_zero(worker, fr_worker_metrics_t));
+	pthread_mutex_init(&worker->metrics->mutex, NULL);
+	talloc_set_destructor(worker->metrics, _worker_metrics_free);
+	worker_metrics_publish(el, fr_time(), worker);
+
 	return worker;
 }
 
@@ -1518,6 +1739,229 @@ int fr_worker_stats(fr_worker_t const *worker, int num, uint64_t *stats)
 	return 6;
 }
 
+/** Print OpenMetrics for a set of workers
+ *
+ * @param[in] fp	to print to.
+ * @param[in] workers	labelled by their index in the array.
+ * @param[in] num	number of workers.
+ */
+void fr_worker_metrics(FILE *fp, fr_worker_t const **workers, int num)
+{
+	static char const	*types[] = { "in", "out", "dup", "dropped" };
+	int			i, j;
+
+	/*
+	 *	We only read the copies published by each worker.
+	 */
+	for (i = 0; i < num; i++) pthread_mutex_lock(&workers[i]->metrics->mutex);
+
+	fr_metrics_family(fp, "freeradius_worker_packets", FR_METRICS_TYPE_COUNTER,
+			  "Packets handled by a worker.");
+	for (i = 0; i < num; i++) {
+		fr_worker_metrics_t const	*m = workers[i]->metrics;
+		uint64_t			stats[NUM_ELEMENTS(types)] = {
+							m->stats.in, m->stats.out, m->stats.dup, m->stats.dropped
+						};
+
+		for (j = 0; j < (int) NUM_ELEMENTS(stats); j++) {
+			fprintf(fp, "freeradius_worker_packets_total{worker=\"%d\",type=\"%s\"} %" PRIu64 "\n",
+				i, types[j], stats[j]);
+		}
+	}
+
+	fr_metrics_family(fp, "freeradius_worker_naks", FR_METRICS_TYPE_COUNTER,
+			  "Requests a worker refused to process.");
+	for (i = 0; i < num; i++) {
+		fprintf(fp, "freeradius_worker_naks_total{worker=\"%d\"} %" PRIu64 "\n", i, workers[i]->metrics->num_naks);
+	}
+
+	fr_metrics_family(fp, "freeradius_worker_requests", FR_METRICS_TYPE_GAUGE,
+			  "Requests being processed by a worker.");
+	for (i = 0; i < num; i++) {
+		fprintf(fp, "freeradius_worker_requests{worker=\"%d\",state=\"active\"} %" PRIu64 "\n",
+			i, workers[i]->metrics->num_active);
+		fprintf(fp, "freeradius_worker_requests{worker=\"%d\",state=\"runnable\"} %" PRIu64 "\n",
+			i, workers[i]->metrics->num_runnable);
+	}
+
+	fr_metrics_family(fp, "freeradius_worker_cpu_seconds", FR_METRICS_TYPE_COUNTER,
+			  "Time a worker has spent running requests.");
+	for (i = 0; i < num; i++) {
+		fprintf(fp, "freeradius_worker_cpu_seconds_total{worker=\"%d\"} %.9f\n",
+			i, fr_time_delta_unwrap(workers[i]->metrics->running_total) / (double)NSEC);
+	}
+
+	fr_metrics_family(fp, "freeradius_worker_wait_seconds", FR_METRICS_TYPE_COUNTER,
+			  "Time requests in a worker have spent waiting for external events.");
+	for (i = 0; i < num; i++) {
+		fprintf(fp, "freeradius_worker_wait_seconds_total{worker=\"%d\"} %.9f\n",
+			i, fr_time_delta_unwrap(workers[i]->metrics->waiting_total) / (double)NSEC);
+	}
+
+	for (i = 0; i < num; i++) pthread_mutex_unlock(&workers[i]->metrics->mutex);
+}
+
+typedef struct {
+	fr_rb_node_t		node;
+	char const		*key;
+	fr_time_delta_t		cpu;
+	uint64_t		requests;
+	double			cpu_rate;	//!< Recent CPU seconds used per second.
+	double			request_rate;	//!< Recent requests per second.
+} worker_cpu_total_t;
+
+static int8_t worker_cpu_total_key_cmp(void const *one, void const *two)
+{
+	worker_cpu_total_t const *a = one, *b = two;
+	int ret;
+
+	ret = strcmp(a->key, b->key);
+	return CMP(ret, 0);
+}
+
+/*
+ *	Largest first.
+ */
+static int8_t worker_cpu_total_cpu_cmp(void const *one, void const *two)
+{
+	worker_cpu_total_t const *a = one, *b = two;
+
+	return CMP(fr_time_delta_unwrap(b->cpu), fr_time_delta_unwrap(a->cpu));
+}
+
+/** Print the clients, virtual servers or packet types which have used the most CPU
+ *
+ * Each worker's usage is aggregated by the requested key, and the
+ * totals are printed in descending order of CPU time used.
+ *
+ * As well as the totals since the server started, we print recent
+ * rates, so that a client which has just started sending a lot of
+ * traffic is visible.  The rates are estimated from the current window,
+ * plus the part of the previous window which overlaps the last
+ * WORKER_CPU_USAGE_WINDOW.
+ *
+ * @param[in] fp	to print to.
+ * @param[in] workers	to aggregate CPU usage over.
+ * @param[in] num	number of workers.
+ * @param[in] by	what to aggregate by.
+ * @param[in] max	number of lines to print.  0 for no limit.
+ */
+void fr_worker_cpu_usage_print(FILE *fp, fr_worker_t **workers, int num, fr_worker_cpu_by_t by, int max)
+{
+	TALLOC_CTX		*tmp_ctx = talloc_new(NULL);
+	fr_rb_tree_t		*totals;
+	worker_cpu_usage_t	*snapshot;
+	worker_cpu_total_t	**sorted;
+	fr_time_delta_t		cpu = fr_time_delta_wrap(0);
+	fr_time_t		now = fr_time();
+	double			window = fr_time_delta_unwrap(WORKER_CPU_USAGE_WINDOW) / (double)NSEC;
+	int			i, total_num;
+
+	MEM(totals = fr_rb_inline_talloc_alloc(tmp_ctx, worker_cpu_total_t, node, worker_cpu_total_key_cmp, NULL));
+	MEM(snapshot = talloc_array(tmp_ctx, worker_cpu_usage_t, WORKER_CPU_USAGE_MAX));
+
+	for (i = 0; i < num; i++) {
+		size_t	snapshot_num = 0, j;
+
+		/*
+		 *	Only copy the counters with the mutex held, so
+		 *	the worker isn't kept waiting while we format
+		 *	the keys.  The names are never changed or freed
+		 *	while the worker is running.
+		 */
+		pthread_mutex_lock(&workers[i]->cpu_usage_mutex);
+		fr_rb_inorder_foreach(workers[i]->cpu_usage, worker_cpu_usage_t, usage) {
+			if (snapshot_num >= WORKER_CPU_USAGE_MAX) break;
+			snapshot[snapshot_num++] = *usage;
+		}
+		endforeach
+		pthread_mutex_unlock(&workers[i]->cpu_usage_mutex);
+
+		for (j = 0; j < snapshot_num; j++) {
+			worker_cpu_usage_t	*usage = &snapshot[j];
+			worker_cpu_total_t	my_total, *total;
+			char			buffer[FR_IPADDR_STRLEN] = "-";
+			double			previous;
+
+			if (usage->client_ip.af != AF_UNSPEC) fr_inet_ntop(buffer, sizeof(buffer), &usage->client_ip);
+
+			switch (by) {
+			case FR_WORKER_CPU_BY_CLIENT:
+				my_total.key = talloc_asprintf(tmp_ctx, "%s (%s)", buffer, usage->client);
+				break;
+
+			case FR_WORKER_CPU_BY_SERVER:
+				my_total.key = talloc_strdup(tmp_ctx, usage->server);
+				break;
+
+			case FR_WORKER_CPU_BY_PACKET_TYPE:
+				my_total.key = talloc_asprintf(tmp_ctx, "%s %s", usage->server, usage->packet_type);
+				break;
+
+			case FR_WORKER_CPU_BY_ALL:
+				my_total.key = talloc_asprintf(tmp_ctx, "%s (%s) %s %s", buffer, usage->client,
+							       usage->server, usage->packet_type);
+				break;
+			}
+
+			total = fr_rb_find(totals, &my_total);
+			if (!total) {
+				MEM(total = talloc_zero(tmp_ctx, worker_cpu_total_t));
+				total->key = my_total.key;
+				(void) fr_rb_insert(totals, total);
+			}
+
+			total->cpu = fr_time_delta_add(total->cpu, usage->cpu);
+			total->requests += usage->requests;
+			cpu = fr_time_delta_add(cpu, usage->cpu);
+
+			/*
+			 *	How much of the previous window is
+			 *	still within the last window's worth of
+			 *	time.
+			 */
+			worker_cpu_usage_window(usage, now);
+			previous = 1.0 - ((fr_time_delta_unwrap(fr_time_sub(now, usage->window_start)) / (double)NSEC) / window);
+			if (previous < 0) previous = 0;
+
+			total->cpu_rate += ((fr_time_delta_unwrap(usage->window_cpu[0]) +
+					     (fr_time_delta_unwrap(usage->window_cpu[1]) * previous)) / (double)NSEC) / window;
+			total->request_rate += (usage->window_requests[0] + (usage->window_requests[1] * previous)) / window;
+		}
+	}
+
+	fprintf(fp, "%-14s %7s %12s %14s %10s %10s  %s\n",
+		"cpu", "percent", "requests", "average", "cpu/s", "requests/s", "name");
+
+	total_num = fr_rb_num_elements(totals);
+	if (!total_num) goto done;
+
+	MEM(sorted = talloc_array(tmp_ctx, worker_cpu_total_t *, total_num));
+	i = 0;
+	fr_rb_inorder_foreach(totals, worker_cpu_total_t, total) {
+		sorted[i++] = total;
+	}
+	endforeach
+	fr_quick_sort((void const **) sorted, 0, total_num - 1, worker_cpu_total_cpu_cmp);
+
+	if ((max <= 0) || (max > total_num)) max = total_num;
+
+	for (i = 0; i < max; i++) {
+		fprintf(fp, "%-14.6f %6.2f%% %12" PRIu64 " %14.9f %10.6f %10.2f  %s\n",
+			fr_time_delta_unwrap(sorted[i]->cpu) / (double)NSEC,
+			fr_time_delta_ispos(cpu) ?
+			(fr_time_delta_unwrap(sorted[i]->cpu) * 100.0) / fr_time_delta_unwrap(cpu) : 0.0,
+			sorted[i]->requests,
+			sorted[i]->requests ?
+			(fr_time_delta_unwrap(sorted[i]->cpu) / (double)NSEC) / sorted[i]->requests : 0.0,
+			sorted[i]->cpu_rate, sorted[i]->request_rate,
+			sorted[i]->key);
+	}
+
+done:
+	talloc_free(tmp_ctx);
+}
+
 static int cmd_stats_worker(FILE *fp, UNUSED FILE *fp_err, void *ctx, fr_cmd_info_t const *info)
 {
 	fr_worker_t const *worker = ctx;
@@ -1554,6 +1998,60 @@ static int cmd_stats_worker(FILE *fp, UNUSED FILE *fp_err, void *ctx, fr_cmd_inf
 	return 0;
 }
 
+static int cmd_trace_check(FILE *fp_err, fr_worker_t const *worker)
+{
+	if (worker->trace) return 0;
+
+	fprintf(fp_err, "Tracing is disabled.  Set 'thread pool { trace_records = ... }' to enable it.\n");
+	return -1;
+}
+
+static int cmd_show_trace(FILE *fp, FILE *fp_err, void *ctx, fr_cmd_info_t const *info)
+{
+	fr_worker_t const	*worker = ctx;
+	fr_time_delta_t		window = fr_time_delta_wrap(0);
+
+	if (cmd_trace_check(fp_err, worker) < 0) return -1;
+
+	if (info->argc > 0) window = fr_time_delta_from_sec(info->box[0]->vb_uint32);
+
+	if (unlang_trace_dump(fp, worker->trace, window, 0, NULL) == 0) fprintf(fp, "No trace records.\n");
+
+	return 0;
+}
+
+static int cmd_show_trace_request(FILE *fp, FILE *fp_err, void *ctx, fr_cmd_info_t const *info)
+{
+	fr_worker_t const	*worker = ctx;
+	fr_time_delta_t		window = fr_time_delta_wrap(0);
+
+	if (cmd_trace_check(fp_err, worker) < 0) return -1;
+
+	if (info->argc > 1) window = fr_time_delta_from_sec(info->box[1]->vb_uint32);
+
+	if (unlang_trace_dump(fp, worker->trace, window, info->box[0]->vb_uint64, NULL) == 0) {
+		fprintf(fp, "No trace records for request %s.\n", info->argv[0]);
+	}
+
+	return 0;
+}
+
+static int cmd_show_trace_client(FILE *fp, FILE *fp_err, void *ctx, fr_cmd_info_t const *info)
+{
+	fr_worker_t const	*worker = ctx;
+	fr_time_delta_t		window = fr_time_delta_wrap(0);
+
+	if (cmd_trace_check(fp_err, worker) < 0) return -1;
+
+	if (info->argc > 1) window = fr_time_delta_from_sec(info->box[1]->vb_uint32);
+
+	if (unlang_trace_dump(fp, worker->trace, window, 0, &info->box[0]->vb_ip) == 0) {
+		fprintf(fp, "No trace records for client %s.\n", info->argv[0]);
+	}
+
+	return 0;
+}
+
 fr_cmd_table_t cmd_worker_table[] = {
 	{
 		.parent = "stats",
@@ -1572,5 +2070,42 @@ fr_cmd_table_t cmd_worker_table[] = {
 		.read_only = true
 	},
 
+	{
+		.parent = "show",
+		.name = "worker",
+		.help = "Show information about worker threads.",
+		.read_only = true
+	},
+
+	{
+		.parent = "show worker",
+		.add_name = true,
+		.name = "trace",
+		.syntax = "[INTEGER]",
+		.func = cmd_show_trace,
+		.help = "Show the trace of requests run by this worker.  Limited to the last INTEGER seconds if given.",
+		.read_only = true
+	},
+
+	{
+		.parent = "show worker",
+		.add_name = true,
+		.name = "trace-request",
+		.syntax = "UINT64 [INTEGER]",
+		.func = cmd_show_trace_request,
+		.help = "Show the trace of a request run by this worker, by request number.",
+		.read_only = true
+	},
+
+	{
+		.parent = "show worker",
+		.add_name = true,
+		.name = "trace-client",
+		.syntax = "COMBO-IP [INTEGER]",
+		.func = cmd_show_trace_client,
+		.help = "Show the trace of requests from a client run by this worker.",
+		.read_only = true
+	},
+
 	CMD_TABLE_END
 };
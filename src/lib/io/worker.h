@@ -55,6 +55,16 @@ extern "C" {
 #endif
 extern fr_cmd_table_t cmd_worker_table[];
 
+/** How to aggregate CPU usage
+ *
+ */
+typedef enum {
+	FR_WORKER_CPU_BY_CLIENT = 0,			//!< Client IP address.
+	FR_WORKER_CPU_BY_SERVER,			//!< Virtual server.
+	FR_WORKER_CPU_BY_PACKET_TYPE,			//!< Virtual server and packet type.
+	FR_WORKER_CPU_BY_ALL				//!< Client, virtual server and packet type.
+} fr_worker_cpu_by_t;
+
 typedef struct {
 	int		max_requests;		//!< max requests this worker will handle
 
@@ -70,6 +80,8 @@ typedef struct {
 	bool		unflatten_before_encode;	//!< the worker will call "unflatten" before all encoding
 
 	size_t		talloc_pool_size;	//!< for each request
+
+	uint32_t	trace_records;		//!< number of records in the trace ring, 0 to disable tracing
 } fr_worker_config_t;
 
 fr_worker_t	*fr_worker_create(TALLOC_CTX *ctx, fr_event_list_t *el, char const *name,
@@ -89,6 +101,11 @@ fr_channel_t	*fr_worker_channel_create(fr_worker_t *worker, TALLOC_CTX *ctx, fr_
 
 int		fr_worker_stats(fr_worker_t const *worker, int num, uint64_t *stats) CC_HINT(nonnull);
 
+void		fr_worker_metrics(FILE *fp, fr_worker_t const **workers, int num) CC_HINT(nonnull);
+
+void		fr_worker_cpu_usage_print(FILE *fp, fr_worker_t **workers, int num,
+					  fr_worker_cpu_by_t by, int max) CC_HINT(nonnull);
+
 #include <freeradius-devel/server/module.h>
 
 int		fr_worker_subrequest_add(request_t *request) CC_HINT(nonnull);
@@ -14,6 +14,7 @@
 #include <freeradius-devel/server/global_lib.h>
 #include <freeradius-devel/server/map.h>
 #include <freeradius-devel/server/trunk.h>
+#include <freeradius-devel/unlang/coalesce.h>
 #include <freeradius-devel/util/dlist.h>
 
 #define LDAP_DEPRECATED 0	/* Quiet warnings about LDAP_DEPRECATED not being defined */
@@ -379,6 +380,8 @@ typedef struct {
 	fr_event_list_t		*el;		//!< Thread event list for callbacks / timeouts
 	fr_connection_t		*conn;		//!< LDAP connection used for bind auths
 	fr_rb_tree_t		*binds;		//!< Tree of outstanding bind auths
+	unlang_coalesce_t	*coalesce;	//!< Outstanding xlat queries, which identical
+						///< queries can wait on.
 } fr_ldap_thread_t;
 
 /** Thread LDAP trunk structure
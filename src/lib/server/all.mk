@@ -1,5 +1,9 @@
 SUBMAKEFILES := \
+	file_reload_tests.mk \
 	libfreeradius-server.mk \
+	module_tests.mk \
 	pair_server_tests.mk \
+	state_tests.mk \
 	tmpl_dcursor_tests.mk \
-	trunk_tests.mk
+	trunk_tests.mk \
+	users_file_image_tests.mk
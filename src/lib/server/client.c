@@ -430,6 +430,10 @@ static CONF_PARSER limit_config[] = {
 	{ FR_CONF_OFFSET("lifetime", FR_TYPE_TIME_DELTA, RADCLIENT, limit.lifetime), .dflt = "0" },
 
 	{ FR_CONF_OFFSET("idle_timeout", FR_TYPE_TIME_DELTA, RADCLIENT, limit.idle_timeout), .dflt = "30s" },
+
+	{ FR_CONF_OFFSET("max_packets_per_second", FR_TYPE_UINT32, RADCLIENT, limit.max_packets_per_second), .dflt = "0" },
+
+	{ FR_CONF_OFFSET("max_packet_burst", FR_TYPE_UINT32, RADCLIENT, limit.max_packet_burst), .dflt = "0" },
 	CONF_PARSER_TERMINATOR
 };
 
@@ -114,6 +114,10 @@ struct rad_client {
 
 	int			proto;			//!< Protocol number.
 	fr_socket_limit_t	limit;			//!< Connections per client (TCP clients only).
+
+	RADCLIENT		*configured;		//!< The configured client this is a copy of, if any.
+							///< Its rate_tat is shared by all of the copies.
+	atomic_int_fast64_t	rate_tat;		//!< When the next packet is due, for max_packets_per_second.
 };
 
 RADCLIENT_LIST	*client_list_init(CONF_SECTION *cs);
@@ -30,6 +30,19 @@ RCSID("$Id$")
 #include <freeradius-devel/server/util.h>
 #include <freeradius-devel/util/debug.h>
 
+#include <spawn.h>
+
+/*
+ *	posix_spawn() doesn't copy the page tables of the server
+ *	the way fork() does, which is expensive for a large, threaded
+ *	process that's only going to call exec.  We can only use it if
+ *	it can also close all of the server's file descriptors in the
+ *	child.
+ */
+#ifdef HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP
+#  define EXEC_USE_SPAWN 1
+#endif
+
 #define MAX_ENVP 1024
 
 static _Thread_local char *env_arr[MAX_ENVP];				/* Avoid allocing 8k on the stack */
@@ -203,6 +216,7 @@ static CC_HINT(nonnull(1,3,4,5)) int exec_pair_to_env(char **env_p, size_t env_l
 	return i;
 }
 
+#ifndef EXEC_USE_SPAWN
 /*
  *	Child process.
  *
@@ -306,6 +320,89 @@ static NEVER_RETURNS void exec_child(request_t *request, char **argv, char **env
 	 */
 	exit(2);
 }
+#else
+/** Add an action which points one of the child's stdio FDs at a pipe, or at /dev/null
+ *
+ */
+static int exec_spawn_stdio(posix_spawn_file_actions_t *actions, int fd, int child_fd, int flags)
+{
+	if (fd >= 0) return posix_spawn_file_actions_adddup2(actions, fd, child_fd);
+
+	return posix_spawn_file_actions_addopen(actions, child_fd, "/dev/null", flags, 0);
+}
+
+/** Start a child process with posix_spawn()
+ *
+ * The child gets the same stdio and file descriptors as it would
+ * from #exec_child, but without the server being duplicated first.
+ *
+ * @param[out] pid_p		The PID of the child.
+ * @param[in] request		the request.  May be NULL.
+ * @param[in] argv		of the program to run.
+ * @param[in] envp		environment of the child.
+ * @param[in] exec_wait		if true, connect the child to any pipes
+ *				the caller created.
+ * @param[in] stdin_pipe	to read stdin from.
+ * @param[in] stdout_pipe	to write stdout to.
+ * @param[in] stderr_pipe	to write stderr to.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+static int exec_spawn(pid_t *pid_p, request_t *request, char **argv, char **envp, bool exec_wait,
+		      int stdin_pipe[static 2], int stdout_pipe[static 2], int stderr_pipe[static 2])
+{
+	posix_spawn_file_actions_t	actions;
+	int				ret;
+
+	ret = posix_spawn_file_actions_init(&actions);
+	if (ret != 0) {
+		fr_strerror_printf("Failed initialising spawn actions: %s", fr_syserror(ret));
+		return -1;
+	}
+
+	if (exec_wait) {
+		ret = exec_spawn_stdio(&actions, stdin_pipe[0], STDIN_FILENO, O_RDONLY);
+		if (ret == 0) ret = exec_spawn_stdio(&actions, stdout_pipe[1], STDOUT_FILENO, O_WRONLY);
+		if (ret == 0) ret = exec_spawn_stdio(&actions, stderr_pipe[1], STDERR_FILENO, O_WRONLY);
+	} else {
+		ret = exec_spawn_stdio(&actions, -1, STDIN_FILENO, O_RDONLY);
+		if (ret == 0) ret = exec_spawn_stdio(&actions, -1, STDOUT_FILENO, O_WRONLY);
+
+		/*
+		 *	If we are debugging, then we want the error
+		 *	messages to go to the STDERR of the server.
+		 */
+		if ((ret == 0) && (!request || !RDEBUG_ENABLED)) {
+			ret = exec_spawn_stdio(&actions, -1, STDERR_FILENO, O_WRONLY);
+		}
+	}
+
+	/*
+	 *	Close everything else, including our ends of the pipes.
+	 */
+	if (ret == 0) ret = posix_spawn_file_actions_addclosefrom_np(&actions, STDERR_FILENO + 1);
+	if (ret != 0) {
+		fr_strerror_printf("Failed setting up spawn actions: %s", fr_syserror(ret));
+		posix_spawn_file_actions_destroy(&actions);
+		return -1;
+	}
+
+	/*
+	 *	Unlike fork(), a failure to exec the program is
+	 *	reported here, rather than by the exit code of the
+	 *	child.
+	 */
+	ret = posix_spawn(pid_p, argv[0], &actions, NULL, argv, envp);
+	posix_spawn_file_actions_destroy(&actions);
+	if (ret != 0) {
+		fr_strerror_printf("Failed to execute \"%s\": %s", argv[0], fr_syserror(ret));
+		return -1;
+	}
+
+	return 0;
+}
+#endif
 
 /** Execute a program without waiting for the program to finish.
  *
@@ -380,6 +477,16 @@ int fr_exec_fork_nowait(request_t *request, FR_DLIST_HEAD(fr_value_box_list) *ar
 		while (*env_p) RDEBUG3("export %s", *env_p++);
 	}
 
+#ifdef EXEC_USE_SPAWN
+	{
+		int unused[2] = { -1, -1 };
+
+		if (exec_spawn(&pid, request, argv, env, false, unused, unused, unused) < 0) {
+			RPEDEBUG("Couldn't start %s", argv[0]);
+			return -1;
+		}
+	}
+#else
 	pid = fork();
 	/*
 	 *	The child never returns from calling exec_child();
@@ -392,9 +499,9 @@ int fr_exec_fork_nowait(request_t *request, FR_DLIST_HEAD(fr_value_box_list) *ar
 
 	if (pid < 0) {
 		RPEDEBUG("Couldn't fork %s", argv[0]);
-	error:
 		return -1;
 	}
+#endif
 
 	/*
 	 *	Ensure that we can clean up any child processes.  We
@@ -409,7 +516,7 @@ int fr_exec_fork_nowait(request_t *request, FR_DLIST_HEAD(fr_value_box_list) *ar
 		 */
 		kill(pid, SIGKILL);
 		waitpid(pid, &status, WNOHANG);
-		goto error;
+		return -1;
 	}
 
 	return 0;
@@ -542,17 +649,22 @@ int fr_exec_fork_wait(pid_t *pid_p,
 		if (fr_nonblock(stderr_pipe[0]) < 0) PERROR("Error setting stderr to nonblock");
 	}
 	
+#ifdef EXEC_USE_SPAWN
+	if (exec_spawn(&pid, request, argv, env, true, stdin_pipe, stdout_pipe, stderr_pipe) < 0) pid = -1;
+#else
 	pid = fork();
 
 	/*
 	 *	The child never returns from calling exec_child();
 	 */
 	if (pid == 0) exec_child(request, argv, env, true, stdin_pipe, stdout_pipe, stderr_pipe);
+	if (pid < 0) fr_strerror_printf("Couldn't fork %s: %s", argv[0], fr_syserror(errno));
+#endif
 	if (pid < 0) {
-		PERROR("Couldn't fork %s", argv[0]);
 		*pid_p = -1;	/* Ensure the PID is set even if the caller didn't check the return code */
-		talloc_free(argv);
-		goto error4;
+		close(stderr_pipe[0]);
+		close(stderr_pipe[1]);
+		goto error4;	/* frees argv */
 	}
 	talloc_free(argv);
 
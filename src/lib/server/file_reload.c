@@ -0,0 +1,745 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file src/lib/server/file_reload.c
+ * @brief Rebuild module data when the files it was read from change.
+ *
+ * Modules which read their data from files (users files, CSV files and
+ * the like) keep that data behind an #fr_file_reload_t.  A single
+ * reload thread watches the files with its own event list.  When a
+ * file changes, the thread waits for writes to settle, then calls the
+ * module's build callback to create a new copy of the data, and
+ * publishes it with an atomic pointer swap.
+ *
+ * Workers never block.  Each thread which reads the data has a counter
+ * which is odd while it's between #fr_file_reload_acquire and
+ * #fr_file_reload_release.  After publishing, the reload thread waits
+ * until every thread which was reading has left its read section,
+ * and only then frees the old data.
+ *
+ * The directory containing each file is watched as well, so that
+ * files which are replaced with rename(), or deleted and re-created,
+ * are noticed.  While a file is missing, the reload thread checks for
+ * it again every #FILE_RELOAD_SETTLE.
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/server/file_reload.h>
+#include <freeradius-devel/server/log.h>
+#include <freeradius-devel/util/atexit.h>
+#include <freeradius-devel/util/debug.h>
+#include <freeradius-devel/util/dlist.h>
+#include <freeradius-devel/util/event.h>
+#include <freeradius-devel/util/syserror.h>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+#else
+#  include <freeradius-devel/util/stdatomic.h>
+#endif
+
+/** How long to wait after the last change before rebuilding
+ *
+ * Files are often written in several chunks.  Rebuilding
+ * from a partially written file would just fail.
+ */
+#define FILE_RELOAD_SETTLE	fr_time_delta_from_sec(1)
+
+/** How long to sleep between checks on a thread which is reading
+ *
+ */
+#define FILE_RELOAD_POLL_NSEC	(100 * 1000)
+
+/** How long to wait for threads to stop reading the old data
+ *
+ * Read sections never yield, so anything this long means a thread is
+ * stuck.  The old data is leaked rather than freed underneath it.
+ */
+#ifndef FILE_RELOAD_SYNC_TIMEOUT
+#  define FILE_RELOAD_SYNC_TIMEOUT	fr_time_delta_from_sec(5)
+#endif
+
+/** A thread which reads data protected by an #fr_file_reload_t
+ *
+ */
+typedef struct {
+	fr_dlist_t		entry;			//!< Entry in the list of readers.
+	_Atomic(uint64_t)	ctr;			//!< Odd while the thread is reading.
+} file_reload_reader_t;
+
+/** A file being watched
+ *
+ */
+typedef struct {
+	fr_dlist_t		entry;			//!< Entry in the reload's list of files.
+	fr_file_reload_t	*reload;		//!< Which this file belongs to.
+
+	char const		*filename;		//!< Of the file.
+	char const		*dirname;		//!< Directory containing the file.
+
+	int			fd;			//!< Open on the file, for watching.
+	int			dir_fd;			//!< Open on the directory, for watching.
+
+	struct stat		st;			//!< Of the file when it was last loaded.
+	bool			exists;			//!< Whether the file existed when it was last loaded.
+	bool			written;		//!< We were told the file was written to.
+} file_reload_file_t;
+
+struct fr_file_reload_s {
+	fr_dlist_t		entry;			//!< Entry in the list of reloads.
+	char const		*name;			//!< For log messages, usually the module name.
+
+	_Atomic(void *)		data;			//!< The current data.
+	_Atomic(uint64_t)	generation;		//!< Incremented each time the data is replaced.
+
+	fr_file_reload_build_t	build;			//!< Creates new data.
+	void			*uctx;			//!< Passed to build.
+
+	fr_dlist_head_t		files;			//!< Files the data is read from.
+	fr_event_timer_t const	*ev;			//!< Fires once writes have settled.
+};
+
+static _Thread_local file_reload_reader_t	*file_reload_reader;
+static _Thread_local unsigned int		file_reload_depth;
+
+static pthread_mutex_t		file_reload_reader_mutex = PTHREAD_MUTEX_INITIALIZER;	//!< Protects the list of readers.
+static fr_dlist_head_t		file_reload_readers;
+
+static pthread_mutex_t		file_reload_mutex = PTHREAD_MUTEX_INITIALIZER;		//!< Protects the list of reloads.
+static fr_dlist_head_t		file_reload_list;
+
+static pthread_t		file_reload_thread;
+static bool			file_reload_running;
+static int			file_reload_pipe[2] = { -1, -1 };	//!< Wakes the reload thread when it should exit.
+
+static int _file_reload_reader_free(void *uctx)
+{
+	file_reload_reader_t *reader = uctx;
+
+	pthread_mutex_lock(&file_reload_reader_mutex);
+	fr_dlist_remove(&file_reload_readers, reader);
+	pthread_mutex_unlock(&file_reload_reader_mutex);
+
+	free(reader);
+	file_reload_reader = NULL;
+
+	return 0;
+}
+
+/** Get the reader for the current thread, allocating one if needed
+ *
+ */
+static file_reload_reader_t *file_reload_reader_alloc(void)
+{
+	file_reload_reader_t *reader;
+
+	if (fr_atexit_is_exiting()) return NULL;
+
+	reader = calloc(1, sizeof(*reader));
+	if (!reader) return NULL;
+
+	pthread_mutex_lock(&file_reload_reader_mutex);
+	if (!fr_dlist_initialised(&file_reload_readers)) fr_dlist_init(&file_reload_readers, file_reload_reader_t, entry);
+	fr_dlist_insert_tail(&file_reload_readers, reader);
+	pthread_mutex_unlock(&file_reload_reader_mutex);
+
+	fr_atexit_thread_local(file_reload_reader, _file_reload_reader_free, reader);
+
+	return reader;
+}
+
+/** A thread which was reading when the data was replaced
+ *
+ */
+typedef struct {
+	file_reload_reader_t	*reader;		//!< May have exited since.
+	uint64_t		ctr;			//!< Value when the data was replaced.
+} file_reload_wait_t;
+
+/** Check whether a thread has stopped reading data we've replaced
+ *
+ * @note Must be called with file_reload_reader_mutex held.
+ */
+static bool file_reload_wait_done(file_reload_wait_t const *wait)
+{
+	file_reload_reader_t *reader;
+
+	for (reader = fr_dlist_head(&file_reload_readers);
+	     reader;
+	     reader = fr_dlist_next(&file_reload_readers, reader)) {
+		if (reader == wait->reader) return (atomic_load(&reader->ctr) != wait->ctr);
+	}
+
+	return true;	/* Thread exited */
+}
+
+/** Wait until no thread can still be reading data we've just replaced
+ *
+ * Any thread which was in a read section when the data was swapped
+ * has an odd counter.  We wait until that counter changes.  Threads
+ * which weren't reading will see the new data.
+ *
+ * The reader list is only locked while it's checked, so that threads
+ * can start and exit while we wait.
+ *
+ * @param[in] reload	the data was replaced for.
+ * @return
+ *	- 0 if the old data can be freed.
+ *	- -1 if threads were still reading it after #FILE_RELOAD_SYNC_TIMEOUT.
+ */
+static int file_reload_synchronize(fr_file_reload_t const *reload)
+{
+	file_reload_reader_t	*reader;
+	file_reload_wait_t	*waits;
+	size_t			i, num = 0, pending;
+	fr_time_t		start = fr_time();
+	bool			warned = false;
+
+	pthread_mutex_lock(&file_reload_reader_mutex);
+	if (!fr_dlist_initialised(&file_reload_readers)) {
+		pthread_mutex_unlock(&file_reload_reader_mutex);
+		return 0;
+	}
+
+	MEM(waits = talloc_array(NULL, file_reload_wait_t, fr_dlist_num_elements(&file_reload_readers)));
+	for (reader = fr_dlist_head(&file_reload_readers);
+	     reader;
+	     reader = fr_dlist_next(&file_reload_readers, reader)) {
+		uint64_t ctr = atomic_load(&reader->ctr);
+
+		if ((ctr & 0x01) == 0) continue;
+
+		waits[num++] = (file_reload_wait_t){ .reader = reader, .ctr = ctr };
+	}
+	pthread_mutex_unlock(&file_reload_reader_mutex);
+
+	pending = num;
+	while (pending > 0) {
+		fr_time_delta_t waited;
+
+		nanosleep(&(struct timespec){ .tv_nsec = FILE_RELOAD_POLL_NSEC }, NULL);
+
+		pthread_mutex_lock(&file_reload_reader_mutex);
+		for (i = 0; i < num; i++) {
+			if (!waits[i].reader || !file_reload_wait_done(&waits[i])) continue;
+
+			waits[i].reader = NULL;
+			pending--;
+		}
+		pthread_mutex_unlock(&file_reload_reader_mutex);
+
+		if (pending == 0) break;
+
+		waited = fr_time_sub(fr_time(), start);
+		if (fr_time_delta_gteq(waited, FILE_RELOAD_SYNC_TIMEOUT)) {
+			ERROR("%s - %zu thread(s) still reading the previous data after %pVs, "
+			      "it will not be freed", reload->name, pending, fr_box_time_delta(waited));
+			talloc_free(waits);
+			return -1;
+		}
+
+		if (!warned && fr_time_delta_gteq(waited, fr_time_delta_div(FILE_RELOAD_SYNC_TIMEOUT,
+									    fr_time_delta_wrap(2)))) {
+			WARN("%s - Waiting for %zu thread(s) to stop reading the previous data",
+			     reload->name, pending);
+			warned = true;
+		}
+	}
+
+	talloc_free(waits);
+	return 0;
+}
+
+/** Get the current data
+ *
+ * Must be paired with a call to #fr_file_reload_release.  The data is
+ * valid until then, and must not be modified.  Calls may be nested,
+ * but nothing which yields may be done between the two calls.
+ *
+ * @param[in] reload	to get the data from.
+ * @return the current data.
+ */
+void *fr_file_reload_acquire(fr_file_reload_t const *reload)
+{
+	file_reload_reader_t *reader = file_reload_reader;
+
+	if (unlikely(!reader)) reader = file_reload_reader_alloc();
+
+	if ((file_reload_depth++ == 0) && likely(reader != NULL)) atomic_fetch_add(&reader->ctr, 1);
+
+	return atomic_load(&reload->data);
+}
+
+/** Finish reading data returned by #fr_file_reload_acquire
+ *
+ */
+void fr_file_reload_release(void)
+{
+	fr_assert(file_reload_depth > 0);
+
+	if ((--file_reload_depth == 0) && likely(file_reload_reader != NULL)) {
+		atomic_fetch_add_explicit(&file_reload_reader->ctr, 1, memory_order_release);
+	}
+}
+
+/** Return how many times the data has been replaced
+ *
+ */
+uint64_t fr_file_reload_generation(fr_file_reload_t const *reload)
+{
+	return atomic_load_explicit(&reload->generation, memory_order_relaxed);
+}
+
+static int _file_reload_free(fr_file_reload_t *reload)
+{
+	/*
+	 *	The reload thread may be using us.  This only
+	 *	happens when modules are freed on exit, so
+	 *	stopping reloads altogether is fine.
+	 */
+	if (file_reload_running) fr_file_reload_stop();
+
+	pthread_mutex_lock(&file_reload_mutex);
+	fr_dlist_remove(&file_reload_list, reload);
+	pthread_mutex_unlock(&file_reload_mutex);
+
+	talloc_free(atomic_load(&reload->data));
+
+	return 0;
+}
+
+/** Allocate a structure to hold data which may be reloaded
+ *
+ * @param[in] ctx	to allocate the structure in, usually the module instance.
+ * @param[in] name	for log messages.
+ * @param[in] data	the initial data.  The reload structure takes
+ *			ownership of it, and frees it when it's replaced.
+ * @param[in] build	called to create new data when files change.
+ * @param[in] uctx	passed to build.
+ * @return
+ *	- The new reload structure.
+ *	- NULL on error.
+ */
+fr_file_reload_t *fr_file_reload_alloc(TALLOC_CTX *ctx, char const *name, void *data,
+				       fr_file_reload_build_t build, void *uctx)
+{
+	fr_file_reload_t *reload;
+
+	MEM(reload = talloc_zero(ctx, fr_file_reload_t));
+	reload->name = talloc_strdup(reload, name);
+	reload->build = build;
+	reload->uctx = uctx;
+	atomic_init(&reload->data, data);
+	atomic_init(&reload->generation, 0);
+	fr_dlist_talloc_init(&reload->files, file_reload_file_t, entry);
+
+	pthread_mutex_lock(&file_reload_mutex);
+	if (!fr_dlist_initialised(&file_reload_list)) fr_dlist_init(&file_reload_list, fr_file_reload_t, entry);
+	fr_dlist_insert_tail(&file_reload_list, reload);
+	pthread_mutex_unlock(&file_reload_mutex);
+
+	talloc_set_destructor(reload, _file_reload_free);
+
+	return reload;
+}
+
+/** Rebuild the data when a file changes
+ *
+ * Should be called just after the data was read from the file, so
+ * that changes made between then and the reload thread starting
+ * are noticed.  Must be called before #fr_file_reload_start.
+ *
+ * @param[in] reload	to rebuild.
+ * @param[in] filename	to watch.
+ * @return
+ *	- 0 on success.
+ *	- -1 on error.
+ */
+int fr_file_reload_watch(fr_file_reload_t *reload, char const *filename)
+{
+	file_reload_file_t	*file;
+	char const		*p;
+
+	if (file_reload_running) {
+		fr_strerror_const("Files can't be watched after the reload thread has started");
+		return -1;
+	}
+
+	MEM(file = talloc_zero(reload, file_reload_file_t));
+	file->reload = reload;
+	file->fd = file->dir_fd = -1;
+	file->filename = talloc_strdup(file, filename);
+
+	p = strrchr(filename, '/');
+	if (!p) {
+		file->dirname = talloc_strdup(file, ".");
+	} else if (p == filename) {
+		file->dirname = talloc_strdup(file, "/");
+	} else {
+		file->dirname = talloc_strndup(file, filename, p - filename);
+	}
+
+	file->exists = (stat(filename, &file->st) == 0);
+	fr_dlist_insert_tail(&reload->files, file);
+
+	return 0;
+}
+
+static void file_reload_schedule(fr_event_list_t *el, fr_file_reload_t *reload);
+
+static void _file_reload_file_changed(fr_event_list_t *el, UNUSED int fd, UNUSED int fflags, void *uctx)
+{
+	file_reload_file_t *file = talloc_get_type_abort(uctx, file_reload_file_t);
+
+	file->written = true;
+	file_reload_schedule(el, file->reload);
+}
+
+static void _file_reload_dir_changed(fr_event_list_t *el, UNUSED int fd, UNUSED int fflags, void *uctx)
+{
+	file_reload_file_t *file = talloc_get_type_abort(uctx, file_reload_file_t);
+
+	file_reload_schedule(el, file->reload);
+}
+
+static void file_reload_file_close(fr_event_list_t *el, file_reload_file_t *file)
+{
+	if (file->fd < 0) return;
+
+	(void) fr_event_fd_delete(el, file->fd, FR_EVENT_FILTER_VNODE);
+	close(file->fd);
+	file->fd = -1;
+}
+
+/** Start watching a file, and the directory it's in
+ *
+ * Failing to watch the file isn't fatal.  It may be in the middle of
+ * being replaced, and we'll try again when the directory changes.
+ */
+static void file_reload_file_open(fr_event_list_t *el, file_reload_file_t *file)
+{
+	fr_event_vnode_func_t funcs = {
+		.delete = _file_reload_file_changed,
+		.write = _file_reload_file_changed,
+		.extend = _file_reload_file_changed,
+		.attrib = _file_reload_file_changed,
+		.rename = _file_reload_file_changed
+	};
+
+	if (file->dir_fd < 0) {
+		file->dir_fd = open(file->dirname, O_RDONLY);
+		if (file->dir_fd < 0) {
+			ERROR("%s - Failed opening directory %s: %s", file->reload->name, file->dirname,
+			      fr_syserror(errno));
+		} else if (fr_event_filter_insert(file, NULL, el, file->dir_fd, FR_EVENT_FILTER_VNODE,
+						  &(fr_event_vnode_func_t){
+							.delete = _file_reload_dir_changed,
+							.extend = _file_reload_dir_changed
+						  }, NULL, file) < 0) {
+			PERROR("%s - Failed watching directory %s", file->reload->name, file->dirname);
+			close(file->dir_fd);
+			file->dir_fd = -1;
+		}
+	}
+
+	if (file->fd >= 0) return;
+
+	file->fd = open(file->filename, O_RDONLY);
+	if (file->fd < 0) {
+		DEBUG("%s - Failed opening %s: %s", file->reload->name, file->filename, fr_syserror(errno));
+		return;
+	}
+
+	if (fr_event_filter_insert(file, NULL, el, file->fd, FR_EVENT_FILTER_VNODE, &funcs, NULL, file) < 0) {
+		PERROR("%s - Failed watching %s", file->reload->name, file->filename);
+		close(file->fd);
+		file->fd = -1;
+	}
+}
+
+/** Compare the current state of a file with its state when it was last loaded
+ *
+ */
+static bool file_reload_file_differs(file_reload_file_t const *file, struct stat const *st)
+{
+	return !file->exists ||
+	       (st->st_ino != file->st.st_ino) || (st->st_dev != file->st.st_dev) ||
+	       (st->st_size != file->st.st_size) || (st->st_mtime != file->st.st_mtime) ||
+	       (st->st_ctime != file->st.st_ctime);
+}
+
+/** See if a file has changed since it was last loaded
+ *
+ * If the file has been replaced, start watching the new one.
+ *
+ * @return
+ *	- 1 if the file has changed.
+ *	- 0 if the file is unchanged.
+ *	- -1 if the file doesn't exist.
+ */
+static int file_reload_file_check(fr_event_list_t *el, file_reload_file_t *file)
+{
+	struct stat	st, fd_st;
+	bool		changed;
+
+	if (stat(file->filename, &st) < 0) {
+		DEBUG("%s - Can't reload yet, %s: %s", file->reload->name, file->filename, fr_syserror(errno));
+		file_reload_file_close(el, file);
+
+		/*
+		 *	Whatever is there when it comes back is
+		 *	a change, even if it looks the same.
+		 */
+		file->exists = false;
+		return -1;
+	}
+
+	/*
+	 *	Replaced, so the fd is watching the old file.
+	 */
+	if ((file->fd >= 0) &&
+	    ((fstat(file->fd, &fd_st) < 0) || (fd_st.st_ino != st.st_ino) || (fd_st.st_dev != st.st_dev))) {
+		file_reload_file_close(el, file);
+	}
+	file_reload_file_open(el, file);
+
+	changed = file->written || file_reload_file_differs(file, &st);
+
+	file->st = st;
+	file->exists = true;
+	file->written = false;
+
+	return changed ? 1 : 0;
+}
+
+/** Build new data, publish it, and free the old data
+ *
+ */
+static void file_reload_rebuild(fr_file_reload_t *reload)
+{
+	void		*data, *old;
+	uint64_t	generation;
+	fr_time_t	start = fr_time();
+
+	INFO("%s - Files have changed, reloading", reload->name);
+
+	data = reload->build(reload->uctx);
+	if (!data) {
+		PERROR("%s - Failed reloading, continuing with existing data", reload->name);
+		return;
+	}
+
+	old = atomic_exchange(&reload->data, data);
+	generation = atomic_fetch_add(&reload->generation, 1) + 1;
+
+	if (file_reload_synchronize(reload) == 0) talloc_free(old);
+
+	INFO("%s - Loaded generation %" PRIu64 " in %pVs", reload->name, generation,
+	     fr_box_time_delta(fr_time_sub(fr_time(), start)));
+}
+
+static void _file_reload_timer(fr_event_list_t *el, UNUSED fr_time_t now, void *uctx)
+{
+	fr_file_reload_t	*reload = talloc_get_type_abort(uctx, fr_file_reload_t);
+	file_reload_file_t	*file = NULL;
+	bool			changed = false;
+
+	while ((file = fr_dlist_next(&reload->files, file))) {
+		switch (file_reload_file_check(el, file)) {
+		case 1:
+			changed = true;
+			break;
+
+		case 0:
+			break;
+
+		/*
+		 *	Probably being replaced.  Check again
+		 *	later, in case the directory watch doesn't
+		 *	tell us when it's back.
+		 */
+		default:
+			file_reload_schedule(el, reload);
+			return;
+		}
+	}
+
+	if (changed) file_reload_rebuild(reload);
+}
+
+static void file_reload_schedule(fr_event_list_t *el, fr_file_reload_t *reload)
+{
+	if (fr_event_timer_in(reload, el, &reload->ev, FILE_RELOAD_SETTLE, _file_reload_timer, reload) < 0) {
+		PERROR("%s - Failed scheduling reload", reload->name);
+	}
+}
+
+static void _file_reload_wakeup(fr_event_list_t *el, UNUSED int fd, UNUSED int flags, UNUSED void *uctx)
+{
+	fr_event_loop_exit(el, 1);
+}
+
+static void *file_reload_thread_main(UNUSED void *arg)
+{
+	fr_event_list_t		*el;
+	fr_file_reload_t	*reload;
+	file_reload_file_t	*file;
+
+	el = fr_event_list_alloc(NULL, NULL, NULL);
+	if (!el) {
+		PERROR("Failed creating event list for file reloads");
+		return NULL;
+	}
+
+	if (fr_event_fd_insert(NULL, el, file_reload_pipe[0], _file_reload_wakeup, NULL, NULL, NULL) < 0) {
+		PERROR("Failed adding wakeup pipe for file reloads");
+		talloc_free(el);
+		return NULL;
+	}
+
+	/*
+	 *	If anything changed while the server was
+	 *	starting, reload it now.
+	 */
+	pthread_mutex_lock(&file_reload_mutex);
+	for (reload = fr_dlist_head(&file_reload_list); reload; reload = fr_dlist_next(&file_reload_list, reload)) {
+		bool changed = false;
+
+		for (file = fr_dlist_head(&reload->files); file; file = fr_dlist_next(&reload->files, file)) {
+			struct stat st;
+
+			file_reload_file_open(el, file);
+
+			if ((stat(file->filename, &st) < 0) || file_reload_file_differs(file, &st)) {
+				file->written = true;
+				changed = true;
+			}
+		}
+
+		if (changed) file_reload_schedule(el, reload);
+	}
+	pthread_mutex_unlock(&file_reload_mutex);
+
+	(void) fr_event_loop(el);
+
+	pthread_mutex_lock(&file_reload_mutex);
+	for (reload = fr_dlist_head(&file_reload_list); reload; reload = fr_dlist_next(&file_reload_list, reload)) {
+		if (reload->ev) (void) fr_event_timer_delete(&reload->ev);
+
+		for (file = fr_dlist_head(&reload->files); file; file = fr_dlist_next(&reload->files, file)) {
+			file_reload_file_close(el, file);
+
+			if (file->dir_fd >= 0) {
+				(void) fr_event_fd_delete(el, file->dir_fd, FR_EVENT_FILTER_VNODE);
+				close(file->dir_fd);
+				file->dir_fd = -1;
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&file_reload_mutex);
+
+	(void) fr_event_fd_delete(el, file_reload_pipe[0], FR_EVENT_FILTER_IO);
+	talloc_free(el);
+
+	return NULL;
+}
+
+/** Start the reload thread
+ *
+ * Does nothing if no files are being watched.
+ *
+ * @note Must be called after the server has daemonized, as the reload
+ *	thread won't survive a fork.  Should be called after the workers
+ *	have started, so that no reload runs while modules are still
+ *	being instantiated for them.
+ *
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int fr_file_reload_start(void)
+{
+	fr_file_reload_t	*reload;
+	bool			watching = false;
+	int			ret;
+
+	if (file_reload_running) return 0;
+
+	pthread_mutex_lock(&file_reload_mutex);
+	if (fr_dlist_initialised(&file_reload_list)) {
+		for (reload = fr_dlist_head(&file_reload_list);
+		     reload;
+		     reload = fr_dlist_next(&file_reload_list, reload)) {
+			if (!fr_dlist_empty(&reload->files)) {
+				watching = true;
+				break;
+			}
+		}
+	}
+	pthread_mutex_unlock(&file_reload_mutex);
+
+	if (!watching) return 0;
+
+	if (pipe(file_reload_pipe) < 0) {
+		fr_strerror_printf("Failed creating pipe: %s", fr_syserror(errno));
+		return -1;
+	}
+
+	file_reload_running = true;
+
+	ret = pthread_create(&file_reload_thread, NULL, file_reload_thread_main, NULL);
+	if (ret != 0) {
+		fr_strerror_printf("Failed creating reload thread: %s", fr_syserror(ret));
+		file_reload_running = false;
+		close(file_reload_pipe[0]);
+		close(file_reload_pipe[1]);
+		file_reload_pipe[0] = file_reload_pipe[1] = -1;
+		return -1;
+	}
+
+	return 0;
+}
+
+/** Stop the reload thread
+ *
+ * Waits for any reload in progress to finish.
+ */
+void fr_file_reload_stop(void)
+{
+	if (!file_reload_running) return;
+
+	if (write(file_reload_pipe[1], "x", 1) < 0) {
+		ERROR("Failed waking reload thread: %s", fr_syserror(errno));
+	}
+	pthread_join(file_reload_thread, NULL);
+
+	close(file_reload_pipe[0]);
+	close(file_reload_pipe[1]);
+	file_reload_pipe[0] = file_reload_pipe[1] = -1;
+
+	file_reload_running = false;
+}
@@ -0,0 +1,71 @@
+#pragma once
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file lib/server/file_reload.h
+ * @brief Rebuild module data when the files it was read from change.
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+RCSIDH(file_reload_h, "$Id$")
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <freeradius-devel/build.h>
+#include <freeradius-devel/missing.h>
+#include <freeradius-devel/util/talloc.h>
+
+#include <stdint.h>
+
+typedef struct fr_file_reload_s fr_file_reload_t;
+
+/** Build a new copy of the data from the files
+ *
+ * Called from the reload thread.  Implementations must only read
+ * module configuration which doesn't change after instantiation,
+ * and must not bootstrap xlats or touch other global state.
+ *
+ * @param[in] uctx	passed to #fr_file_reload_alloc.
+ * @return
+ *	- The new data, talloced with a NULL parent.  It's freed when
+ *	  it's replaced, or when the #fr_file_reload_t is freed.
+ *	- NULL on error.  The existing data continues to be used.
+ */
+typedef void *(*fr_file_reload_build_t)(void *uctx);
+
+fr_file_reload_t	*fr_file_reload_alloc(TALLOC_CTX *ctx, char const *name, void *data,
+					      fr_file_reload_build_t build, void *uctx) CC_HINT(nonnull(2,3));
+
+int			fr_file_reload_watch(fr_file_reload_t *reload, char const *filename) CC_HINT(nonnull);
+
+void			*fr_file_reload_acquire(fr_file_reload_t const *reload) CC_HINT(nonnull);
+
+void			fr_file_reload_release(void);
+
+uint64_t		fr_file_reload_generation(fr_file_reload_t const *reload) CC_HINT(nonnull);
+
+int			fr_file_reload_start(void);
+
+void			fr_file_reload_stop(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,422 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Tests for publishing reloaded data, and freeing the old data
+ *
+ * @file src/lib/server/file_reload_tests.c
+ * @copyright 2026 The FreeRADIUS server project
+ */
+#define USE_CONSTRUCTOR
+
+#ifdef USE_CONSTRUCTOR
+static void test_init(void) __attribute__((constructor));
+#else
+static void test_init(void);
+#  define TEST_INIT  test_init()
+#endif
+
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+
+/*
+ *	Keep the timeout test short
+ */
+#define FILE_RELOAD_SYNC_TIMEOUT	fr_time_delta_from_msec(200)
+#include "file_reload.c"
+
+/** Data built by the test build callback
+ *
+ */
+typedef struct {
+	int			value;
+	bool			*freed;		//!< Set when the data is freed.
+} test_data_t;
+
+/** Passed to a thread which holds a read section open
+ *
+ */
+typedef struct {
+	fr_file_reload_t	*reload;
+	test_data_t		*seen;		//!< Data the thread acquired.
+	atomic_bool		acquired;	//!< Set once the thread is reading.
+	atomic_bool		release;	//!< Set to make the thread stop reading.
+} test_reader_t;
+
+static bool	test_next_freed;	//!< Freed flag for the next data built.
+
+/** Global initialisation
+ */
+static void test_init(void)
+{
+	if (fr_time_start() < 0) {
+		fr_perror("file_reload_tests");
+		fr_exit_now(EXIT_FAILURE);
+	}
+}
+
+static int _test_data_free(test_data_t *data)
+{
+	*data->freed = true;
+	return 0;
+}
+
+static test_data_t *test_data_alloc(int value, bool *freed)
+{
+	test_data_t *data;
+
+	MEM(data = talloc_zero(NULL, test_data_t));
+	data->value = value;
+	data->freed = freed;
+	*freed = false;
+	talloc_set_destructor(data, _test_data_free);
+
+	return data;
+}
+
+static void *test_build(void *uctx)
+{
+	int *value = uctx;
+
+	return test_data_alloc(++(*value), &test_next_freed);
+}
+
+static void test_sleep_msec(long msec)
+{
+	nanosleep(&(struct timespec){ .tv_sec = msec / 1000, .tv_nsec = (msec % 1000) * 1000000 }, NULL);
+}
+
+static bool test_in_read_section(void)
+{
+	return file_reload_reader && ((atomic_load(&file_reload_reader->ctr) & 0x01) != 0);
+}
+
+static void *test_reader_thread(void *arg)
+{
+	test_reader_t *ctx = arg;
+
+	ctx->seen = fr_file_reload_acquire(ctx->reload);
+	atomic_store(&ctx->acquired, true);
+
+	while (!atomic_load(&ctx->release)) test_sleep_msec(1);
+
+	fr_file_reload_release();
+
+	return NULL;
+}
+
+static void *test_rebuild_thread(void *arg)
+{
+	file_reload_rebuild(arg);
+
+	return NULL;
+}
+
+/*
+ *	Threads which start reading while the reload
+ *	thread waits must not block.
+ */
+static void *test_new_reader_thread(void *arg)
+{
+	fr_file_reload_t *reload = arg;
+
+	fr_file_reload_acquire(reload);
+	fr_file_reload_release();
+
+	return NULL;
+}
+
+/** Wait for the reload thread to start watching a file's directory
+ *
+ */
+static bool test_dir_watched(file_reload_file_t *file)
+{
+	int i;
+
+	for (i = 0; i < 1000; i++) {
+		bool watched;
+
+		pthread_mutex_lock(&file_reload_mutex);
+		watched = (file->dir_fd >= 0);
+		pthread_mutex_unlock(&file_reload_mutex);
+
+		if (watched) return true;
+
+		test_sleep_msec(1);
+	}
+
+	return false;
+}
+
+static void test_reader_start(test_reader_t *ctx, pthread_t *thread, fr_file_reload_t *reload)
+{
+	*ctx = (test_reader_t){ .reload = reload };
+
+	TEST_ASSERT(pthread_create(thread, NULL, test_reader_thread, ctx) == 0);
+	while (!atomic_load(&ctx->acquired)) test_sleep_msec(1);
+}
+
+/*
+ *	Read sections nest, and the thread is only marked
+ *	as not reading when the outermost one is released.
+ */
+static void test_acquire_release(void)
+{
+	int			value = 0;
+	bool			freed;
+	test_data_t		*data = test_data_alloc(value, &freed);
+	fr_file_reload_t	*reload;
+
+	reload = fr_file_reload_alloc(NULL, "test", data, test_build, &value);
+	TEST_ASSERT(reload != NULL);
+
+	TEST_CHECK(fr_file_reload_acquire(reload) == data);
+	TEST_CHECK(test_in_read_section());
+
+	TEST_CHECK(fr_file_reload_acquire(reload) == data);
+	fr_file_reload_release();
+	TEST_CHECK(test_in_read_section());
+	TEST_MSG("Releasing a nested read section must not end the outer one");
+
+	fr_file_reload_release();
+	TEST_CHECK(!test_in_read_section());
+	TEST_CHECK(file_reload_depth == 0);
+
+	TEST_CHECK(fr_file_reload_generation(reload) == 0);
+
+	talloc_free(reload);
+	TEST_CHECK(freed);
+	TEST_MSG("The current data should be freed with the reload structure");
+}
+
+/*
+ *	With no one reading, new data is published and
+ *	the old data freed straight away.
+ */
+static void test_rebuild(void)
+{
+	int			value = 0;
+	bool			freed;
+	test_data_t		*data = test_data_alloc(value, &freed), *new;
+	fr_file_reload_t	*reload;
+
+	reload = fr_file_reload_alloc(NULL, "test", data, test_build, &value);
+	TEST_ASSERT(reload != NULL);
+
+	file_reload_rebuild(reload);
+	TEST_CHECK(freed);
+	TEST_CHECK(fr_file_reload_generation(reload) == 1);
+
+	new = fr_file_reload_acquire(reload);
+	TEST_CHECK(new != NULL);
+	TEST_CHECK(new && (new->value == 1));
+	fr_file_reload_release();
+
+	talloc_free(reload);
+	TEST_CHECK(test_next_freed);
+}
+
+/*
+ *	Data is only freed after every thread which could
+ *	be reading it has left its read section.  Threads
+ *	which start reading after it's replaced don't hold
+ *	up the reload thread, and aren't held up by it.
+ */
+static void test_rebuild_waits(void)
+{
+	int			value = 0;
+	bool			freed;
+	test_data_t		*data = test_data_alloc(value, &freed);
+	fr_file_reload_t	*reload;
+	test_reader_t		reader;
+	pthread_t		reader_thread, rebuild_thread, new_thread;
+
+	reload = fr_file_reload_alloc(NULL, "test", data, test_build, &value);
+	TEST_ASSERT(reload != NULL);
+
+	test_reader_start(&reader, &reader_thread, reload);
+	TEST_CHECK(reader.seen == data);
+
+	TEST_ASSERT(pthread_create(&rebuild_thread, NULL, test_rebuild_thread, reload) == 0);
+	while (fr_file_reload_generation(reload) == 0) test_sleep_msec(1);
+
+	TEST_ASSERT(pthread_create(&new_thread, NULL, test_new_reader_thread, reload) == 0);
+	TEST_CHECK(pthread_join(new_thread, NULL) == 0);
+
+	test_sleep_msec(50);
+	TEST_CHECK(!freed);
+	TEST_MSG("Old data was freed while a thread was still reading it");
+
+	atomic_store(&reader.release, true);
+	TEST_CHECK(pthread_join(reader_thread, NULL) == 0);
+	TEST_CHECK(pthread_join(rebuild_thread, NULL) == 0);
+
+	TEST_CHECK(freed);
+	TEST_MSG("Old data should be freed once no thread is reading it");
+
+	talloc_free(reload);
+}
+
+/*
+ *	A thread which never leaves its read section must
+ *	not stall reloads forever.  The old data it may
+ *	be using is left alone.
+ */
+static void test_rebuild_timeout(void)
+{
+	int			value = 0;
+	bool			freed;
+	test_data_t		*data = test_data_alloc(value, &freed);
+	fr_file_reload_t	*reload;
+	test_reader_t		reader;
+	pthread_t		reader_thread;
+	fr_time_t		start;
+
+	reload = fr_file_reload_alloc(NULL, "test", data, test_build, &value);
+	TEST_ASSERT(reload != NULL);
+
+	test_reader_start(&reader, &reader_thread, reload);
+
+	start = fr_time();
+	file_reload_rebuild(reload);
+	TEST_CHECK(fr_time_delta_gteq(fr_time_sub(fr_time(), start), FILE_RELOAD_SYNC_TIMEOUT));
+	TEST_CHECK(fr_file_reload_generation(reload) == 1);
+	TEST_CHECK(!freed);
+	TEST_MSG("Old data must not be freed while a thread may still be reading it");
+
+	atomic_store(&reader.release, true);
+	TEST_CHECK(pthread_join(reader_thread, NULL) == 0);
+
+	talloc_free(data);
+	talloc_free(reload);
+}
+
+/*
+ *	The reload thread is only started if there are
+ *	files to watch.
+ */
+static void test_start(void)
+{
+	int			value = 0;
+	bool			freed;
+	test_data_t		*data = test_data_alloc(value, &freed);
+	fr_file_reload_t	*reload;
+	char			filename[] = "/tmp/file_reload_tests.XXXXXX";
+	int			fd;
+
+	reload = fr_file_reload_alloc(NULL, "test", data, test_build, &value);
+	TEST_ASSERT(reload != NULL);
+
+	TEST_CHECK(fr_file_reload_start() == 0);
+	TEST_CHECK(!file_reload_running);
+	TEST_MSG("Nothing to watch, the reload thread shouldn't be started");
+
+	fd = mkstemp(filename);
+	TEST_ASSERT(fd >= 0);
+	close(fd);
+
+	TEST_CHECK(fr_file_reload_watch(reload, filename) == 0);
+	TEST_CHECK(fr_file_reload_start() == 0);
+	TEST_CHECK(file_reload_running);
+
+	TEST_CASE("The directory containing the file is watched");
+	TEST_CHECK(test_dir_watched(fr_dlist_head(&reload->files)));
+
+	fr_file_reload_stop();
+	TEST_CHECK(!file_reload_running);
+
+	talloc_free(reload);
+	unlink(filename);
+}
+
+/*
+ *	A file which is deleted and then re-created is
+ *	reloaded, even if it was missing when the settle
+ *	timer fired.  The timer is called directly, so this
+ *	doesn't depend on how quickly the file watches fire.
+ */
+static void test_recreate(void)
+{
+	int			value = 0;
+	bool			freed;
+	test_data_t		*data = test_data_alloc(value, &freed);
+	fr_file_reload_t	*reload;
+	file_reload_file_t	*file;
+	fr_event_list_t		*el;
+	char			dirname[] = "/tmp/file_reload_tests.XXXXXX";
+	char			*filename;
+	int			fd;
+
+	reload = fr_file_reload_alloc(NULL, "test", data, test_build, &value);
+	TEST_ASSERT(reload != NULL);
+
+	el = fr_event_list_alloc(NULL, NULL, NULL);
+	TEST_ASSERT(el != NULL);
+
+	TEST_ASSERT(mkdtemp(dirname) != NULL);
+	filename = talloc_asprintf(reload, "%s/data", dirname);
+
+	fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	TEST_ASSERT(fd >= 0);
+	close(fd);
+
+	TEST_CHECK(fr_file_reload_watch(reload, filename) == 0);
+	file = fr_dlist_head(&reload->files);
+
+	file_reload_file_open(el, file);
+	TEST_CHECK(file->fd >= 0);
+	TEST_CHECK(file->dir_fd >= 0);
+
+	TEST_CASE("A missing file is checked for again");
+	TEST_CHECK(unlink(filename) == 0);
+	_file_reload_timer(el, fr_time(), reload);
+	TEST_CHECK(fr_file_reload_generation(reload) == 0);
+	TEST_CHECK(reload->ev != NULL);
+	TEST_MSG("Expected the check to be rescheduled while the file is missing");
+	TEST_CHECK(file->fd < 0);
+
+	TEST_CASE("The data is rebuilt once the file is back");
+	fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	TEST_ASSERT(fd >= 0);
+	close(fd);
+
+	_file_reload_timer(el, fr_time(), reload);
+	TEST_CHECK(fr_file_reload_generation(reload) == 1);
+	TEST_MSG("Expected generation 1, got %" PRIu64, fr_file_reload_generation(reload));
+	TEST_CHECK(freed);
+	TEST_CHECK(file->fd >= 0);
+	TEST_MSG("Expected the new file to be watched");
+
+	(void) fr_event_timer_delete(&reload->ev);
+	file_reload_file_close(el, file);
+	(void) fr_event_fd_delete(el, file->dir_fd, FR_EVENT_FILTER_VNODE);
+	close(file->dir_fd);
+	talloc_free(el);
+
+	unlink(filename);
+	rmdir(dirname);
+	talloc_free(reload);
+}
+
+TEST_LIST = {
+	{ "acquire_release",	test_acquire_release },
+	{ "rebuild",		test_rebuild },
+	{ "rebuild_waits",	test_rebuild_waits },
+	{ "rebuild_timeout",	test_rebuild_timeout },
+	{ "start",		test_start },
+	{ "recreate",		test_recreate },
+
+	{ NULL }
+};
@@ -16,6 +16,7 @@ SOURCES	:= \
 	exec.c \
 	exec_legacy.c \
 	exfile.c \
+	file_reload.c \
 	global_lib.c \
 	log.c \
 	main_config.c \
@@ -24,6 +25,7 @@ SOURCES	:= \
 	map_async.c \
 	map_proc.c \
 	method.c \
+	metrics.c \
 	module.c \
 	module_rlm.c \
 	paircmp.c \
@@ -32,6 +34,7 @@ SOURCES	:= \
 	pool.c \
 	rcode.c \
 	regex.c \
+	reload.c \
 	request.c \
 	request_data.c \
 	snmp.c \
@@ -43,6 +46,7 @@ SOURCES	:= \
 	trigger.c \
 	trunk.c \
 	users_file.c \
+	users_file_image.c \
 	util.c \
 	virtual_servers.c
 
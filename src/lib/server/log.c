@@ -29,6 +29,7 @@ RCSID("$Id$")
 
 #include <freeradius-devel/server/base.h>
 #include <freeradius-devel/util/debug.h>
+#include <freeradius-devel/util/log_async.h>
 
 #ifdef HAVE_SYS_STAT_H
 #  include <sys/stat.h>
@@ -265,6 +266,7 @@ void vlog_request(fr_log_type_t type, fr_log_lvl_t lvl, request_t *request,
 {
 	char const	*filename;
 	FILE		*fp = NULL;
+	char const	*path = NULL;	/* File for the log thread to append to */
 
 	char		*p;
 	char const	*extra = "";
@@ -315,6 +317,10 @@ void vlog_request(fr_log_type_t type, fr_log_lvl_t lvl, request_t *request,
 		 */
 		switch (log_dst->dst) {
 		case L_DST_FILES:
+			if (fr_log_async_running()) {
+				path = log_dst->file;
+				break;
+			}
 			fp = fopen(log_dst->file, "a");
 			if (!fp) goto finish;
 			break;
@@ -386,8 +392,12 @@ void vlog_request(fr_log_type_t type, fr_log_lvl_t lvl, request_t *request,
 			*p = FR_DIR_SEP;
 		}
 
-		fp = fopen(exp, "a");
-		talloc_free(exp);
+		if (fr_log_async_running()) {
+			path = talloc_steal(pool, exp);
+		} else {
+			fp = fopen(exp, "a");
+			talloc_free(exp);
+		}
 	}
 
 print_fmt:
@@ -441,8 +451,9 @@ print_fmt:
 	/*
 	 *	Logging to a file descriptor
 	 */
-	if (fp) {
+	if (fp || path) {
 		char time_buff[64];	/* The current timestamp */
+		char *buffer;
 
 		time_t timeval;
 		timeval = time(NULL);
@@ -468,22 +479,36 @@ print_fmt:
 		p = strrchr(time_buff, '\n');
 		if (p) p[0] = '\0';
 
-		fprintf(fp,
-			"%s"		/* location */
-			"%s"		/* prefix */
-			"%s : "		/* time */
-			"%s"		/* facility */
-			"%.*s"		/* indent */
-			"%s"		/* module */
-			"%s"		/* message */
-			"\n",
-			fmt_location,
-			fmt_prefix,
-			time_buff,
-			fr_table_str_by_value(fr_log_levels, type, ""),
-			unlang_indent, spaces,
-			fmt_module,
-			fmt_exp);
+		buffer = talloc_typed_asprintf(pool,
+					       "%s"		/* location */
+					       "%s"		/* prefix */
+					       "%s : "		/* time */
+					       "%s"		/* facility */
+					       "%.*s"		/* indent */
+					       "%s"		/* module */
+					       "%s"		/* message */
+					       "\n",
+					       fmt_location,
+					       fmt_prefix,
+					       time_buff,
+					       fr_table_str_by_value(fr_log_levels, type, ""),
+					       unlang_indent, spaces,
+					       fmt_module,
+					       fmt_exp);
+
+		/*
+		 *	The log thread appends to the file, keeping it
+		 *	open until it goes idle, so we don't block on
+		 *	the filesystem.
+		 */
+		if (path) {
+			if (fr_log_async_file_write(path, buffer, talloc_array_length(buffer) - 1) == 0) goto finish;
+
+			fp = fopen(path, "a");
+			if (!fp) goto finish;
+		}
+
+		fputs(buffer, fp);
 		fclose(fp);
 		goto finish;
 	}
@@ -41,6 +41,7 @@ RCSID("$Id$")
 #include <freeradius-devel/util/dict.h>
 #include <freeradius-devel/util/file.h>
 #include <freeradius-devel/util/hw.h>
+#include <freeradius-devel/util/log_async.h>
 #include <freeradius-devel/util/perm.h>
 #include <freeradius-devel/util/sem.h>
 
@@ -143,6 +144,8 @@ static const CONF_PARSER log_config[] = {
 	{ FR_CONF_OFFSET("line_number", FR_TYPE_BOOL, main_config_t, log_line_number) },
 	{ FR_CONF_OFFSET("timestamp", FR_TYPE_BOOL, main_config_t, log_timestamp) },
 	{ FR_CONF_OFFSET("use_utc", FR_TYPE_BOOL, main_config_t, log_dates_utc) },
+	{ FR_CONF_OFFSET("async", FR_TYPE_BOOL, main_config_t, log_async), .dflt = "no" },
+	{ FR_CONF_OFFSET("async_buffer_size", FR_TYPE_SIZE, main_config_t, log_async_buffer_size), .dflt = "1M" },
 	CONF_PARSER_TERMINATOR
 };
 
@@ -166,14 +169,28 @@ static const CONF_PARSER thread_config[] = {
 
 	{ FR_CONF_OFFSET("stats_interval", FR_TYPE_TIME_DELTA | FR_TYPE_HIDDEN, main_config_t, stats_interval), },
 
+	{ FR_CONF_OFFSET("trace_records", FR_TYPE_UINT32, main_config_t, trace_records), .dflt = STRINGIFY(0) },
+
+	{ FR_CONF_OFFSET("shed_low_priority", FR_TYPE_UINT32, main_config_t, shed_low_priority), .dflt = STRINGIFY(0) },
+	{ FR_CONF_OFFSET("shed_normal_priority", FR_TYPE_UINT32, main_config_t, shed_normal_priority), .dflt = STRINGIFY(0) },
+
 #ifdef WITH_TLS
 	{ FR_CONF_OFFSET("openssl_async_pool_init", FR_TYPE_SIZE, main_config_t, openssl_async_pool_init), .dflt = "64" },
 	{ FR_CONF_OFFSET("openssl_async_pool_max", FR_TYPE_SIZE, main_config_t, openssl_async_pool_max), .dflt = "1024" },
+	{ FR_CONF_OFFSET("openssl_offload_threads", FR_TYPE_UINT32, main_config_t, openssl_offload_threads), .dflt = "0" },
+	{ FR_CONF_OFFSET("openssl_offload_max_queued", FR_TYPE_UINT32, main_config_t, openssl_offload_max_queued), .dflt = "256" },
 #endif
 
 	CONF_PARSER_TERMINATOR
 };
 
+static const CONF_PARSER reload_config[] = {
+	{ FR_CONF_OFFSET("graceful", FR_TYPE_BOOL, main_config_t, reload_graceful), .dflt = "no" },
+	{ FR_CONF_OFFSET("start_timeout", FR_TYPE_TIME_DELTA, main_config_t, reload_start_timeout), .dflt = "120" },
+	{ FR_CONF_OFFSET("drain_timeout", FR_TYPE_TIME_DELTA, main_config_t, reload_drain_timeout), .dflt = "30" },
+	CONF_PARSER_TERMINATOR
+};
+
 /*
  *	Migration configuration.
  */
@@ -229,6 +246,8 @@ static const CONF_PARSER server_config[] = {
 
 	{ FR_CONF_POINTER("thread", FR_TYPE_SUBSECTION, NULL), .subcs = (void const *) thread_config, .ident2 = CF_IDENT_ANY },
 
+	{ FR_CONF_POINTER("reload", FR_TYPE_SUBSECTION, NULL), .subcs = (void const *) reload_config },
+
 	{ FR_CONF_POINTER("migrate", FR_TYPE_SUBSECTION, NULL), .subcs = (void const *) migrate_config, .ident2 = CF_IDENT_ANY },
 
 #ifndef NDEBUG
@@ -927,7 +946,15 @@ int main_config_exclusive_proc(main_config_t *config)
 
 	config->multi_proc_sem_id = -1;
 
-	ret = fr_sem_wait(sem_id, path, true, true);
+	/*
+	 *	The previous instance of the server still holds the
+	 *	semaphore, and releases it when it exits.
+	 */
+	if (config->reload_inherited) {
+		ret = (fr_sem_take(sem_id, path, true) < 0) ? -1 : 0;
+	} else {
+		ret = fr_sem_wait(sem_id, path, true, true);
+	}
 	switch (ret) {
 	case 0:	/* we have the semaphore */
 		talloc_free(config->multi_proc_sem_path);	/* Allow this to be called multiple times */
@@ -1410,6 +1437,13 @@ void hup_logfile(main_config_t *config)
 		 */
 		old_fd = default_log.fd;
 		default_log.fd = fd;
+
+		/*
+		 *	Messages queued for the log thread
+		 *	are written to the fd they were
+		 *	logged with.
+		 */
+		fr_log_async_flush();
 		close(old_fd);
 	}
 }
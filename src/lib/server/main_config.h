@@ -63,6 +63,14 @@ struct main_config_s {
 
 	bool		drop_requests;			//!< Administratively disable request processing.
 
+	bool		reload_graceful;		//!< On HUP, start a new server process and hand our
+							///< sockets over to it.
+	fr_time_delta_t	reload_start_timeout;		//!< How long the new process has to become ready.
+	fr_time_delta_t	reload_drain_timeout;		//!< How long we wait for outstanding requests to finish
+							///< after handing over.
+	bool		reload_inherited;		//!< We were started by a previous instance of the server,
+							///< which is handing its sockets over to us.
+
 	char const	*log_dir;
 	char const	*local_state_dir;
 	char const	*chroot_dir;
@@ -88,6 +96,9 @@ struct main_config_s {
 	bool		log_timestamp;
 	bool		log_timestamp_is_set;
 
+	bool		log_async;			//!< Write log messages from a dedicated thread.
+	size_t		log_async_buffer_size;		//!< Size of each thread's log message ring.
+
 	int32_t		syslog_facility;
 
 	char const	*dict_dir;			//!< Where to load dictionaries from.
@@ -120,6 +131,12 @@ struct main_config_s {
 
 	size_t		openssl_async_pool_max;		//!< Tuning option to set the maximum number of requests
 							///< in the async ctx pool.
+
+	uint32_t	openssl_offload_threads;	//!< Number of threads to run TLS handshakes on.
+							///< 0 means handshakes are run by the workers.
+
+	uint32_t	openssl_offload_max_queued;	//!< Handshake rounds which can be queued for each
+							///< offload thread, before workers run them themselves.
 #endif
 
 	fr_dict_t	*dict;				//!< Main dictionary.
@@ -149,6 +166,10 @@ struct main_config_s {
 	uint32_t	max_networks;			//!< for the scheduler
 	uint32_t	max_workers;			//!< for the scheduler
 	fr_time_delta_t	stats_interval;			//!< for the scheduler
+	uint32_t	trace_records;			//!< for the workers, 0 disables tracing
+
+	uint32_t	shed_low_priority;		//!< Outstanding requests per worker before we drop low priority packets.
+	uint32_t	shed_normal_priority;		//!< Outstanding requests per worker before we drop normal priority packets.
 
 #ifndef NDEBUG
 	uint32_t	ins_max;			//!< max instruction count
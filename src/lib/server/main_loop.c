@@ -48,6 +48,9 @@ extern pid_t			radius_pid;
 static fr_event_list_t		*event_list = NULL;
 static int			self_pipe[2] = { -1, -1 };
 
+static main_loop_hup_t		hup_func;		//!< Called on HUP instead of exiting the loop.
+static void			*hup_uctx;
+
 #ifdef HAVE_SYSTEMD_WATCHDOG
 #include <systemd/sd-daemon.h>
 
@@ -132,6 +135,12 @@ static void main_loop_signal_process(int flag)
 		last_hup = when;
 
 		trigger_exec(unlang_interpret_get_thread_default(), NULL, "server.signal.hup", true, NULL);
+
+		if (hup_func) {
+			hup_func(event_list, hup_uctx);
+			return;
+		}
+
 		fr_event_loop_exit(event_list, 0x80);
 	}
 }
@@ -156,6 +165,20 @@ static void main_loop_signal_recv(UNUSED fr_event_list_t *xel,
 	main_loop_signal_process(buffer[0]);
 }
 
+/** Set a function to be called when we receive a HUP
+ *
+ * By default, a HUP causes #main_loop_start to return.  When a
+ * function is set, it is called from the main event loop instead.
+ *
+ * @param[in] func	to call, or NULL to restore the default.
+ * @param[in] uctx	passed to func.
+ */
+void main_loop_hup_func_set(main_loop_hup_t func, void *uctx)
+{
+	hup_func = func;
+	hup_uctx = uctx;
+}
+
 /** Return the main loop event list
  *
  */
@@ -213,6 +236,12 @@ int main_loop_start(void)
 
 	ret = fr_event_loop(event_list);
 #ifdef HAVE_SYSTEMD_WATCHDOG
+	/*
+	 *	If we've handed over to a new process, it's now
+	 *	the one talking to systemd.
+	 */
+	under_systemd = (getenv("NOTIFY_SOCKET") != NULL);
+
 	if (ret != 0x80) {	/* Not HUP */
 		if (under_systemd) {
 			INFO("Informing systemd we're stopping");
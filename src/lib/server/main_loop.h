@@ -43,8 +43,17 @@ typedef enum {
 #include <freeradius-devel/server/listen.h>
 #include <freeradius-devel/server/signal.h>
 
+/** Called from the main event loop when we receive a HUP
+ *
+ * @param[in] el	the main event list.
+ * @param[in] uctx	passed to #main_loop_hup_func_set.
+ */
+typedef void (*main_loop_hup_t)(fr_event_list_t *el, void *uctx);
+
 fr_event_list_t		*main_loop_event_list(void);
 
+void			main_loop_hup_func_set(main_loop_hup_t func, void *uctx);
+
 void			main_loop_signal_raise(int flag);
 
 #ifdef HAVE_SYSTEMD_WATCHDOG
@@ -0,0 +1,179 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file src/lib/server/metrics.c
+ * @brief Export statistics in OpenMetrics text format.
+ *
+ * Subsystems which have statistics register an #fr_metrics_t, and
+ * print their own metric families when asked.  This file only keeps
+ * track of the sources, and has a few helpers to get the format right.
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/server/metrics.h>
+#include <freeradius-devel/util/time.h>
+
+#include <pthread.h>
+
+static pthread_mutex_t	metrics_mutex = PTHREAD_MUTEX_INITIALIZER;
+static fr_dlist_head_t	metrics_list;
+static bool		metrics_list_init;
+
+/** Add a source of metrics
+ *
+ * Registering a source which is already registered does nothing.
+ *
+ * @param[in] metrics	to add.
+ */
+void fr_metrics_register(fr_metrics_t *metrics)
+{
+	pthread_mutex_lock(&metrics_mutex);
+	if (!metrics_list_init) {
+		fr_dlist_init(&metrics_list, fr_metrics_t, entry);
+		metrics_list_init = true;
+	}
+
+	if (!fr_dlist_entry_in_list(&metrics->entry)) fr_dlist_insert_tail(&metrics_list, metrics);
+	pthread_mutex_unlock(&metrics_mutex);
+}
+
+/** Remove a source of metrics
+ *
+ * Once this function returns, the source's print function will not be
+ * called again.
+ *
+ * @param[in] metrics	to remove.
+ */
+void fr_metrics_unregister(fr_metrics_t *metrics)
+{
+	pthread_mutex_lock(&metrics_mutex);
+	if (metrics_list_init && fr_dlist_entry_in_list(&metrics->entry)) {
+		fr_dlist_remove(&metrics_list, metrics);
+		fr_dlist_entry_init(&metrics->entry);
+	}
+	pthread_mutex_unlock(&metrics_mutex);
+}
+
+/** Print all metrics, in OpenMetrics text format
+ *
+ * @param[in] fp	to print to.
+ */
+void fr_metrics_print(FILE *fp)
+{
+	fr_metrics_t *metrics;
+
+	pthread_mutex_lock(&metrics_mutex);
+	if (metrics_list_init) {
+		for (metrics = fr_dlist_head(&metrics_list);
+		     metrics != NULL;
+		     metrics = fr_dlist_next(&metrics_list, metrics)) {
+			metrics->func(fp, metrics->uctx);
+		}
+	}
+	pthread_mutex_unlock(&metrics_mutex);
+
+	fprintf(fp, "# EOF\n");
+}
+
+/** Print the metadata for a metric family
+ *
+ * All samples for the family must be printed immediately after this.
+ *
+ * @param[in] fp	to print to.
+ * @param[in] name	of the family.  Counters get "_total" appended to
+ *			the names of their samples.
+ * @param[in] type	of the family.
+ * @param[in] help	text.
+ */
+void fr_metrics_family(FILE *fp, char const *name, fr_metrics_type_t type, char const *help)
+{
+	static char const *type_names[] = {
+		[FR_METRICS_TYPE_COUNTER] = "counter",
+		[FR_METRICS_TYPE_GAUGE] = "gauge",
+		[FR_METRICS_TYPE_SUMMARY] = "summary"
+	};
+
+	fprintf(fp, "# TYPE %s %s\n", name, type_names[type]);
+	fprintf(fp, "# HELP %s %s\n", name, help);
+}
+
+/** Print a label, escaping the value
+ *
+ * @param[in] fp	to print to.
+ * @param[in] name	of the label.
+ * @param[in] value	of the label.
+ */
+void fr_metrics_label(FILE *fp, char const *name, char const *value)
+{
+	char const *p;
+
+	fprintf(fp, "%s=\"", name);
+	for (p = value; *p; p++) {
+		switch (*p) {
+		case '\\':
+			fputs("\\\\", fp);
+			break;
+
+		case '"':
+			fputs("\\\"", fp);
+			break;
+
+		case '\n':
+			fputs("\\n", fp);
+			break;
+
+		default:
+			fputc(*p, fp);
+			break;
+		}
+	}
+	fputc('"', fp);
+}
+
+/** Print a histogram of nanoseconds as a summary, in seconds
+ *
+ * @param[in] fp	to print to.
+ * @param[in] name	of the family.
+ * @param[in] label	name, to distinguish this summary from others in the family.
+ * @param[in] value	of the label.
+ * @param[in] hist	to print.
+ */
+void fr_metrics_summary(FILE *fp, char const *name, char const *label, char const *value,
+			fr_histogram_t const *hist)
+{
+	static double const quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+	size_t i;
+
+	for (i = 0; i < NUM_ELEMENTS(quantiles); i++) {
+		fprintf(fp, "%s{", name);
+		fr_metrics_label(fp, label, value);
+		fprintf(fp, ",quantile=\"%g\"} %.9f\n", quantiles[i],
+			fr_histogram_percentile(hist, quantiles[i] * 100) / (double)NSEC);
+	}
+
+	fprintf(fp, "%s_sum{", name);
+	fr_metrics_label(fp, label, value);
+	fprintf(fp, "} %.9f\n", hist->sum / (double)NSEC);
+
+	fprintf(fp, "%s_count{", name);
+	fr_metrics_label(fp, label, value);
+	fprintf(fp, "} %" PRIu64 "\n", hist->count);
+}
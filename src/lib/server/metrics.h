@@ -0,0 +1,84 @@
+#pragma once
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file lib/server/metrics.h
+ * @brief Export statistics in OpenMetrics text format.
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+RCSIDH(metrics_h, "$Id$")
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <freeradius-devel/util/dlist.h>
+#include <freeradius-devel/util/histogram.h>
+
+#include <stdio.h>
+
+/** Types of metric family
+ *
+ */
+typedef enum {
+	FR_METRICS_TYPE_COUNTER = 0,				//!< Monotonically increasing.
+	FR_METRICS_TYPE_GAUGE,					//!< Goes up and down.
+	FR_METRICS_TYPE_SUMMARY					//!< Quantiles, sum and count.
+} fr_metrics_type_t;
+
+/** Print one or more complete metric families
+ *
+ * Called from whichever thread is serving the metrics.  Implementations
+ * must not block, and should only read counters which other threads
+ * update, so that producing metrics has no effect on the hot path.
+ *
+ * @param[in] fp	to print to.
+ * @param[in] uctx	passed to #fr_metrics_register.
+ */
+typedef void (*fr_metrics_print_t)(FILE *fp, void *uctx);
+
+/** A source of metrics
+ *
+ * Storage is owned by the caller, and must remain valid until it's
+ * unregistered.
+ */
+typedef struct {
+	fr_dlist_t		entry;				//!< Entry in the list of sources.
+	char const		*name;				//!< Of the source, for debugging.
+	fr_metrics_print_t	func;				//!< Prints the metrics.
+	void			*uctx;				//!< Passed to func.
+} fr_metrics_t;
+
+void	fr_metrics_register(fr_metrics_t *metrics) CC_HINT(nonnull);
+
+void	fr_metrics_unregister(fr_metrics_t *metrics) CC_HINT(nonnull);
+
+void	fr_metrics_print(FILE *fp) CC_HINT(nonnull);
+
+void	fr_metrics_family(FILE *fp, char const *name, fr_metrics_type_t type, char const *help) CC_HINT(nonnull);
+
+void	fr_metrics_label(FILE *fp, char const *name, char const *value) CC_HINT(nonnull);
+
+void	fr_metrics_summary(FILE *fp, char const *name, char const *label, char const *value,
+			   fr_histogram_t const *hist) CC_HINT(nonnull);
+
+#ifdef __cplusplus
+}
+#endif
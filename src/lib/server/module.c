@@ -698,6 +698,8 @@ int module_instantiate(module_instance_t *instance)
 	 *	Call the instantiate method, if any.
 	 */
 	if (mi->module->instantiate) {
+		fr_time_t start;
+
 		cf_log_debug(cs, "Instantiating %s_%s \"%s\"",
 			     fr_table_str_by_value(dl_module_type_prefix, mi->dl_inst->module->type, "<INVALID>"),
 			     mi->dl_inst->module->common->name,
@@ -706,17 +708,58 @@ int module_instantiate(module_instance_t *instance)
 		/*
 		 *	Call the module's instantiation routine.
 		 */
+		start = fr_time();
 		if (mi->module->instantiate(MODULE_INST_CTX(mi->dl_inst)) < 0) {
 			cf_log_err(mi->dl_inst->conf, "Instantiation failed for module \"%s\"", mi->name);
 
 			return -1;
 		}
+		mi->instantiate_time = fr_time_sub(fr_time(), start);
 	}
 	mi->state = MODULE_INSTANCE_INSTANTIATED;
 
 	return 0;
 }
 
+static int8_t _module_time_cmp(void const *one, void const *two)
+{
+	module_instance_t const *a = one;
+	module_instance_t const *b = two;
+
+	return CMP(fr_time_delta_unwrap(fr_time_delta_add(b->bootstrap_time, b->instantiate_time)),
+		   fr_time_delta_unwrap(fr_time_delta_add(a->bootstrap_time, a->instantiate_time)));
+}
+
+/** Log how long each module took to start, slowest first
+ *
+ * @param[in] ml	containing the modules.
+ */
+static void modules_startup_report(module_list_t const *ml)
+{
+	void			*instance;
+	fr_rb_iter_inorder_t	iter;
+	module_instance_t	**mis;
+	size_t			i, num = 0;
+
+	if (!DEBUG_ENABLED || (fr_rb_num_elements(ml->name_tree) == 0)) return;
+
+	MEM(mis = talloc_array(NULL, module_instance_t *, fr_rb_num_elements(ml->name_tree)));
+	for (instance = fr_rb_iter_init_inorder(&iter, ml->name_tree);
+	     instance;
+	     instance = fr_rb_iter_next_inorder(&iter)) {
+		mis[num++] = talloc_get_type_abort(instance, module_instance_t);
+	}
+	fr_quick_sort((void const **)mis, 0, (int)num - 1, _module_time_cmp);
+
+	DEBUG("#### Startup times for %s modules ####", ml->name);
+	for (i = 0; i < num; i++) {
+		DEBUG("  %-32s bootstrap %pVs instantiate %pVs", mis[i]->name,
+		      fr_box_time_delta(mis[i]->bootstrap_time),
+		      fr_box_time_delta(mis[i]->instantiate_time));
+	}
+	talloc_free(mis);
+}
+
 /** Completes instantiation of modules
  *
  * Allows the module to initialise connection pools, and complete any registrations that depend on
@@ -731,6 +774,7 @@ int modules_instantiate(module_list_t const *ml)
 {
 	void			*instance;
 	fr_rb_iter_inorder_t	iter;
+	fr_time_t		start = fr_time();
 
 	DEBUG2("#### Instantiating %s modules ####", ml->name);
 
@@ -743,6 +787,10 @@ int modules_instantiate(module_list_t const *ml)
 		if (module_instantiate(mi) < 0) return -1;
 	}
 
+	DEBUG2("Instantiated %s modules in %pVs", ml->name, fr_box_time_delta(fr_time_sub(fr_time(), start)));
+
+	modules_startup_report(ml);
+
 	return 0;
 }
 
@@ -772,16 +820,19 @@ int module_bootstrap(module_instance_t *mi)
 	 */
 	if (mi->module->bootstrap) {
 		CONF_SECTION *cs = mi->dl_inst->conf;
+		fr_time_t start;
 
 		cf_log_debug(cs, "Bootstrapping %s_%s \"%s\"",
 			     fr_table_str_by_value(dl_module_type_prefix, mi->dl_inst->module->type, "<INVALID>"),
 			     mi->dl_inst->module->common->name,
 			     mi->name);
 
+		start = fr_time();
 		if (mi->module->bootstrap(MODULE_INST_CTX(mi->dl_inst)) < 0) {
 			cf_log_err(cs, "Bootstrap failed for module \"%s\"", mi->name);
 			return -1;
 		}
+		mi->bootstrap_time = fr_time_sub(fr_time(), start);
 	}
 	mi->state = MODULE_INSTANCE_BOOTSTRAPPED;
 
@@ -0,0 +1,199 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Tests for recording how long modules take to start
+ *
+ * @file src/lib/server/module_tests.c
+ * @copyright 2026 The FreeRADIUS server project
+ */
+#define USE_CONSTRUCTOR
+
+#ifdef USE_CONSTRUCTOR
+static void test_init(void) __attribute__((constructor));
+#else
+static void test_init(void);
+#  define TEST_INIT  test_init()
+#endif
+
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+
+#define _DL_MODULE_PRIVATE 1
+#include "module.c"
+
+/** Instance data of the test module
+ *
+ */
+typedef struct {
+	bool			fail;			//!< Return an error from instantiate.
+	unsigned int		calls;			//!< How many times instantiate was called.
+} test_inst_t;
+
+static TALLOC_CTX		*autofree;
+static CONF_SECTION		*test_cs;
+
+static int test_instantiate(module_inst_ctx_t const *mctx);
+
+static module_t const test_module = {
+	.magic		= MODULE_MAGIC_INIT,
+	.name		= "test",
+	.instantiate	= test_instantiate
+};
+
+static dl_module_t const test_dl_module = {
+	.type		= DL_MODULE_TYPE_MODULE,
+	.common		= (dl_module_common_t const *)&test_module
+};
+
+/** Global initialisation
+ */
+static void test_init(void)
+{
+	autofree = talloc_autofree_context();
+	if (!autofree) {
+	error:
+		fr_perror("module_tests");
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	/*
+	 *	Mismatch between the binary and the libraries it depends on
+	 */
+	if (fr_check_lib_magic(RADIUSD_MAGIC_NUMBER) < 0) goto error;
+
+	if (fr_time_start() < 0) goto error;
+
+	test_cs = cf_section_alloc(autofree, NULL, "test", NULL);
+	if (!test_cs) goto error;
+}
+
+static int test_instantiate(module_inst_ctx_t const *mctx)
+{
+	test_inst_t *inst = mctx->inst->data;
+
+	inst->calls++;
+
+	/*
+	 *	Take long enough to be measured
+	 */
+	nanosleep(&(struct timespec){ .tv_nsec = 1000000 }, NULL);
+
+	return inst->fail ? -1 : 0;
+}
+
+/** Allocate a module instance, which must be talloced
+ *
+ */
+static module_instance_t *test_module_alloc(dl_module_inst_t *dl_inst, test_inst_t *inst)
+{
+	module_instance_t *mi;
+
+	MEM(mi = talloc_zero(autofree, module_instance_t));
+
+	*inst = (test_inst_t){ .fail = false };
+	*dl_inst = (dl_module_inst_t){
+		.name = "test",
+		.module = &test_dl_module,
+		.data = inst,
+		.conf = test_cs
+	};
+	*mi = (module_instance_t){
+		.name = "test",
+		.dl_inst = dl_inst,
+		.module = &test_module,
+		.state = MODULE_INSTANCE_BOOTSTRAPPED
+	};
+
+	return mi;
+}
+
+/*
+ *	The time the instantiate method took is recorded,
+ *	and the method is only called once.
+ */
+static void test_instantiate_time(void)
+{
+	module_instance_t	*mi;
+	dl_module_inst_t	dl_inst;
+	test_inst_t		inst;
+
+	mi = test_module_alloc(&dl_inst, &inst);
+
+	TEST_CHECK(module_instantiate(mi) == 0);
+	TEST_CHECK(mi->state == MODULE_INSTANCE_INSTANTIATED);
+	TEST_CHECK(inst.calls == 1);
+	TEST_CHECK(fr_time_delta_gteq(mi->instantiate_time, fr_time_delta_from_msec(1)));
+	TEST_MSG("Expected at least 1ms, got %" PRId64 "ns", fr_time_delta_unwrap(mi->instantiate_time));
+
+	TEST_CHECK(module_instantiate(mi) == 0);
+	TEST_CHECK(inst.calls == 1);
+	TEST_MSG("Modules which are already instantiated must not be instantiated again");
+
+	talloc_free(mi);
+}
+
+/*
+ *	A failed module is left bootstrapped.
+ */
+static void test_instantiate_failure(void)
+{
+	module_instance_t	*mi;
+	dl_module_inst_t	dl_inst;
+	test_inst_t		inst;
+
+	mi = test_module_alloc(&dl_inst, &inst);
+	inst.fail = true;
+
+	TEST_CHECK(module_instantiate(mi) < 0);
+	TEST_CHECK(mi->state == MODULE_INSTANCE_BOOTSTRAPPED);
+	TEST_CHECK(inst.calls == 1);
+
+	talloc_free(mi);
+}
+
+/*
+ *	The report lists the modules which took longest
+ *	to bootstrap and instantiate first.
+ */
+static void test_report_order(void)
+{
+	module_instance_t	a = {
+					.name = "a",
+					.bootstrap_time = fr_time_delta_from_msec(5),
+					.instantiate_time = fr_time_delta_from_msec(1)
+				};
+	module_instance_t	b = {
+					.name = "b",
+					.instantiate_time = fr_time_delta_from_msec(10)
+				};
+	module_instance_t	c = { .name = "c" };
+	module_instance_t	*mis[] = { &c, &a, &b };
+
+	fr_quick_sort((void const **)mis, 0, NUM_ELEMENTS(mis) - 1, _module_time_cmp);
+
+	TEST_CHECK(mis[0] == &b);
+	TEST_CHECK(mis[1] == &a);
+	TEST_CHECK(mis[2] == &c);
+	TEST_MSG("Got %s, %s, %s", mis[0]->name, mis[1]->name, mis[2]->name);
+}
+
+TEST_LIST = {
+	{ "instantiate_time",		test_instantiate_time },
+	{ "instantiate_failure",	test_instantiate_failure },
+	{ "report_order",		test_report_order },
+
+	{ NULL }
+};
@@ -0,0 +1,162 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file lib/server/reload.c
+ * @brief Pass packets back to the previous instance of the server after a graceful reload.
+ *
+ * After a graceful reload, the previous instance of the server keeps
+ * its state entries until they expire.  When a request carries a
+ * State which we don't know about, the raw packet is passed back to
+ * the previous instance, along with the socket it was received on.
+ * The sockets are shared, so the previous instance can process the
+ * request, and send the reply itself.
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/server/log.h>
+#include <freeradius-devel/server/reload.h>
+#include <freeradius-devel/util/syserror.h>
+
+#include <sys/uio.h>
+
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+#else
+#  include <freeradius-devel/util/stdatomic.h>
+#endif
+
+/** Where to send packets for the previous instance of the server
+ *
+ * -1 if there isn't one, or if it has exited.
+ */
+static atomic_int forward_fd = -1;
+
+/** Set the socket which is connected to the previous instance of the server
+ *
+ * @param[in] fd	one end of a datagram socket pair.  The other end
+ *			is read by the previous instance of the server.
+ */
+void fr_reload_forward_fd_set(int fd)
+{
+	atomic_store(&forward_fd, fd);
+}
+
+/** Pass a request to the previous instance of the server
+ *
+ * Only requests received on UDP sockets can be passed back, as TCP
+ * connections aren't shared.
+ *
+ * @param[in] request	whose packet should be processed by the previous
+ *			instance of the server.
+ * @return
+ *	- true if the previous instance of the server is handling the request.
+ *	  The caller must not reply.
+ *	- false if the request should be processed here.
+ */
+bool fr_reload_forward(request_t *request)
+{
+	fr_radius_packet_t	*packet = request->packet;
+	struct iovec		iov[2];
+	struct msghdr		msg = { .msg_iov = iov, .msg_iovlen = NUM_ELEMENTS(iov) };
+	int			fd;
+
+	fd = atomic_load(&forward_fd);
+	if (fd < 0) return false;
+
+	if (!packet->data || (packet->socket.proto != IPPROTO_UDP)) return false;
+
+	iov[0].iov_base = &packet->socket;
+	iov[0].iov_len = sizeof(packet->socket);
+	iov[1].iov_base = packet->data;
+	iov[1].iov_len = packet->data_len;
+
+	if (sendmsg(fd, &msg, MSG_DONTWAIT) < 0) {
+		/*
+		 *	The previous instance can't keep up.  Drop the
+		 *	packet, and let the client retransmit it.
+		 */
+		if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == ENOBUFS)) {
+			RWDEBUG("Discarding request - the previous server process is busy");
+			return true;
+		}
+
+		/*
+		 *	The previous instance has exited.  The socket
+		 *	isn't closed, as other workers may be using it.
+		 */
+		RDEBUG2("The previous server process has exited: %s", fr_syserror(errno));
+		atomic_store(&forward_fd, -1);
+		return false;
+	}
+
+	RDEBUG("Passed request to the previous server process");
+
+	return true;
+}
+
+/** Read a packet which was passed to us by the next instance of the server
+ *
+ * @param[in] fd		our end of the socket pair.
+ * @param[out] socket		the packet was received on.  socket->fd is the
+ *				socket it was received on, which both instances share.
+ * @param[out] buffer		for the packet.
+ * @param[in] buffer_len	length of the buffer.
+ * @return
+ *	- >0 the length of the packet.
+ *	- 0 if there are no more packets.
+ *	- <0 on error.
+ */
+ssize_t fr_reload_forward_recv(int fd, fr_socket_t *socket, uint8_t *buffer, size_t buffer_len)
+{
+	struct iovec		iov[2];
+	struct msghdr		msg = { .msg_iov = iov, .msg_iovlen = NUM_ELEMENTS(iov) };
+	ssize_t			slen;
+
+	iov[0].iov_base = socket;
+	iov[0].iov_len = sizeof(*socket);
+	iov[1].iov_base = buffer;
+	iov[1].iov_len = buffer_len;
+
+	slen = recvmsg(fd, &msg, MSG_DONTWAIT);
+	if (slen < 0) {
+		if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) return 0;
+
+		fr_strerror_printf("Failed reading passed packet: %s", fr_syserror(errno));
+		return -1;
+	}
+
+	if ((size_t) slen <= sizeof(*socket)) {
+		fr_strerror_printf("Passed packet is too short (%zd bytes)", slen);
+		return -1;
+	}
+
+	if (msg.msg_flags & MSG_TRUNC) {
+		fr_strerror_const("Passed packet is too large");
+		return -1;
+	}
+
+	if (socket->proto != IPPROTO_UDP) {
+		fr_strerror_printf("Passed packet has unexpected protocol %d", socket->proto);
+		return -1;
+	}
+
+	return slen - sizeof(*socket);
+}
@@ -0,0 +1,43 @@
+#pragma once
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file lib/server/reload.h
+ * @brief Pass packets back to the previous instance of the server after a graceful reload.
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+RCSIDH(reload_h, "$Id$")
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <freeradius-devel/server/request.h>
+#include <freeradius-devel/util/socket.h>
+
+void	fr_reload_forward_fd_set(int fd);
+
+bool	fr_reload_forward(request_t *request) CC_HINT(nonnull);
+
+ssize_t	fr_reload_forward_recv(int fd, fr_socket_t *socket, uint8_t *buffer, size_t buffer_len) CC_HINT(nonnull);
+
+#ifdef __cplusplus
+}
+#endif
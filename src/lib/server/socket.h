@@ -36,6 +36,8 @@ typedef struct {
 	uint32_t	num_requests;
 	fr_time_delta_t	lifetime;
 	fr_time_delta_t	idle_timeout;
+	uint32_t	max_packets_per_second;	//!< Rate limit for packets from a client, 0 for no limit.
+	uint32_t	max_packet_burst;	//!< How many packets can arrive at once, 0 for one second's worth.
 } fr_socket_limit_t;
 
 #ifdef __cplusplus
@@ -46,6 +46,8 @@
  */
 RCSID("$Id$")
 
+#include <stdalign.h>
+
 #include <freeradius-devel/server/base.h>
 #include <freeradius-devel/server/request.h>
 #include <freeradius-devel/server/state.h>
@@ -54,10 +56,24 @@ RCSID("$Id$")
 
 #include <freeradius-devel/util/debug.h>
 #include <freeradius-devel/util/dlist.h>
+#include <freeradius-devel/util/hash.h>
 #include <freeradius-devel/util/md5.h>
 #include <freeradius-devel/util/misc.h>
 #include <freeradius-devel/util/rand.h>
 
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+#else
+#  include <freeradius-devel/util/stdatomic.h>
+#endif
+
+#define CACHE_LINE_SIZE		64
+
+#ifndef STATE_SHARDS
+#  define STATE_SHARDS		64			//!< Number of shards in a thread safe state tree.
+							//!< Must be a power of two.
+#endif
+
 /** Holds a state value, and associated fr_pair_ts and data
  *
  */
@@ -142,19 +158,32 @@ typedef struct {
 	request_t		*thawed;			//!< The request that thawed this entry.
 } state_child_entry_t;
 
+/** A subset of the state entries, selected by a hash of the state value
+ *
+ * Each shard has its own lock, lookup tree and expiry list, so requests
+ * belonging to different sessions rarely contend with each other, and
+ * expiry work is spread across the requests that touch each shard.
+ */
+typedef struct {
+	alignas(CACHE_LINE_SIZE) pthread_mutex_t mutex;	//!< Synchronisation mutex.
+	fr_rb_tree_t		*tree;				//!< rbtree used to lookup state value.
+	fr_dlist_head_t		to_expire;			//!< Linked list of entries to free.
+} fr_state_shard_t;
+
 struct fr_state_tree_s {
-	uint64_t		id;				//!< Next ID to assign.
-	uint64_t		timed_out;			//!< Number of states that were cleaned up due to
+	atomic_uint_fast64_t	id;				//!< Next ID to assign.
+	atomic_uint_fast64_t	timed_out;			//!< Number of states that were cleaned up due to
 								//!< timeout.
 	uint32_t		max_sessions;			//!< Maximum number of sessions we track.
-	uint32_t		used_sessions;			//!< How many sessions are currently in progress.
-	fr_rb_tree_t		*tree;				//!< rbtree used to lookup state value.
-	fr_dlist_head_t		to_expire;			//!< Linked list of entries to free.
+	atomic_uint_fast32_t	used_sessions;			//!< How many sessions are currently in progress.
+
+	fr_state_shard_t	*shards;			//!< Entries, partitioned by state value.
+	uint32_t		num_shards;			//!< How many shards there are.
+	atomic_uint_fast32_t	sweep;				//!< Next shard to check for expired entries.
 
 	fr_time_delta_t		timeout;			//!< How long to wait before cleaning up state entires.
 
-	bool			thread_safe;			//!< Whether we lock the tree whilst modifying it.
-	pthread_mutex_t		mutex;				//!< Synchronisation mutex.
+	bool			thread_safe;			//!< Whether we lock the shards whilst modifying them.
 
 	uint8_t			server_id;			//!< ID to use for load balancing.
 	uint32_t		context_id;			//!< ID binding state values to a context such
@@ -166,7 +195,24 @@ struct fr_state_tree_s {
 #define PTHREAD_MUTEX_LOCK if (state->thread_safe) pthread_mutex_lock
 #define PTHREAD_MUTEX_UNLOCK if (state->thread_safe) pthread_mutex_unlock
 
-static void state_entry_unlink(fr_state_tree_t *state, fr_state_entry_t *entry);
+/** When the last entry created in any state tree expires
+ *
+ * After a graceful reload, the previous server process keeps running
+ * until then, so that it can finish the sessions it started.
+ */
+static atomic_int_fast64_t state_entries_expiry;
+
+static inline CC_HINT(always_inline)
+void state_entries_expiry_update(fr_time_t cleanup)
+{
+	int_fast64_t expiry = atomic_load_explicit(&state_entries_expiry, memory_order_relaxed);
+
+	while ((fr_time_unwrap(cleanup) > expiry) &&
+	       !atomic_compare_exchange_weak_explicit(&state_entries_expiry, &expiry, fr_time_unwrap(cleanup),
+						      memory_order_relaxed, memory_order_relaxed));
+}
+
+static void state_entry_unlink(fr_state_shard_t *shard, fr_state_entry_t *entry);
 
 /** Compare two fr_state_entry_t based on their state value i.e. the value of the attribute
  *
@@ -185,22 +231,32 @@ static int8_t state_entry_cmp(void const *one, void const *two)
  */
 static int _state_tree_free(fr_state_tree_t *state)
 {
-	fr_state_entry_t *entry;
-
-	if (state->thread_safe) pthread_mutex_destroy(&state->mutex);
+	fr_state_entry_t	*entry;
+	uint32_t		i;
 
 	DEBUG4("Freeing state tree %p", state);
 
-	while ((entry = fr_dlist_head(&state->to_expire))) {
-		DEBUG4("Freeing state entry %p (%"PRIu64")", entry, entry->id);
-		state_entry_unlink(state, entry);
-		talloc_free(entry);
-	}
+	for (i = 0; i < state->num_shards; i++) {
+		fr_state_shard_t *shard = &state->shards[i];
 
-	/*
-	 *	Free the rbtree
-	 */
-	talloc_free(state->tree);
+		/*
+		 *	Shard was never initialised
+		 */
+		if (!shard->tree) continue;
+
+		if (state->thread_safe) pthread_mutex_destroy(&shard->mutex);
+
+		while ((entry = fr_dlist_head(&shard->to_expire))) {
+			DEBUG4("Freeing state entry %p (%"PRIu64")", entry, entry->id);
+			state_entry_unlink(shard, entry);
+			talloc_free(entry);
+		}
+
+		/*
+		 *	Free the rbtree
+		 */
+		talloc_free(shard->tree);
+	}
 
 	return 0;
 }
@@ -224,12 +280,14 @@ fr_state_tree_t *fr_state_tree_init(TALLOC_CTX *ctx, fr_dict_attr_t const *da, b
 				    uint8_t server_id, uint32_t context_id)
 {
 	fr_state_tree_t *state;
+	uint32_t	i;
 
 	state = talloc_zero(NULL, fr_state_tree_t);
 	if (!state) return 0;
 
 	state->max_sessions = max_sessions;
 	state->timeout = timeout;
+	state->num_shards = thread_safe ? STATE_SHARDS : 1;
 
 	/*
 	 *	Create a break in the contexts.
@@ -240,51 +298,179 @@ fr_state_tree_t *fr_state_tree_init(TALLOC_CTX *ctx, fr_dict_attr_t const *da, b
 	 */
 	talloc_link_ctx(ctx, state);
 
-	if (thread_safe && (pthread_mutex_init(&state->mutex, NULL) != 0)) {
-		talloc_free(state);
-		return NULL;
-	}
-
-	fr_dlist_talloc_init(&state->to_expire, fr_state_entry_t, free_entry);
+	state->da = da;		/* Remember which attribute we use to load/store state */
+	state->server_id = server_id;
+	state->context_id = context_id;
+	state->thread_safe = thread_safe;
 
-	/*
-	 *	We need to do controlled freeing of the
-	 *	rbtree, so that all the state entries
-	 *	are freed before it's destroyed.  Hence
-	 *	it being parented from the NULL ctx.
-	 */
-	state->tree = fr_rb_inline_talloc_alloc(NULL, fr_state_entry_t, node, state_entry_cmp, NULL);
-	if (!state->tree) {
+	state->shards = talloc_zero_array(state, fr_state_shard_t, state->num_shards);
+	if (!state->shards) {
 		talloc_free(state);
 		return NULL;
 	}
 	talloc_set_destructor(state, _state_tree_free);
 
-	state->da = da;		/* Remember which attribute we use to load/store state */
-	state->server_id = server_id;
-	state->context_id = context_id;
-	state->thread_safe = thread_safe;
+	for (i = 0; i < state->num_shards; i++) {
+		fr_state_shard_t *shard = &state->shards[i];
+
+		fr_dlist_talloc_init(&shard->to_expire, fr_state_entry_t, free_entry);
+
+		/*
+		 *	We need to do controlled freeing of the
+		 *	rbtree, so that all the state entries
+		 *	are freed before it's destroyed.  Hence
+		 *	it being parented from the NULL ctx.
+		 */
+		shard->tree = fr_rb_inline_talloc_alloc(NULL, fr_state_entry_t, node, state_entry_cmp, NULL);
+		if (!shard->tree) {
+			talloc_free(state);
+			return NULL;
+		}
+
+		if (thread_safe && (pthread_mutex_init(&shard->mutex, NULL) != 0)) {
+			talloc_free(shard->tree);
+			shard->tree = NULL;
+			talloc_free(state);
+			return NULL;
+		}
+	}
 
 	return state;
 }
 
+/** Return the shard a state value belongs to
+ *
+ */
+static inline CC_HINT(always_inline)
+fr_state_shard_t *state_shard(fr_state_tree_t *state, uint8_t const *value)
+{
+	if (state->num_shards == 1) return &state->shards[0];
+
+	return &state->shards[fr_hash(value, sizeof(((fr_state_entry_t *)NULL)->state)) & (state->num_shards - 1)];
+}
+
 /** Unlink an entry and remove if from the tree
  *
+ * @note Called with the shard mutex held.
  */
 static inline CC_HINT(always_inline)
-void state_entry_unlink(fr_state_tree_t *state, fr_state_entry_t *entry)
+void state_entry_unlink(fr_state_shard_t *shard, fr_state_entry_t *entry)
 {
 	/*
 	 *	Check the memory is still valid
 	 */
 	(void) talloc_get_type_abort(entry, fr_state_entry_t);
 
-	fr_dlist_remove(&state->to_expire, entry);
-	fr_rb_delete(state->tree, entry);
+	fr_dlist_remove(&shard->to_expire, entry);
+	fr_rb_delete(shard->tree, entry);
 
 	DEBUG4("State ID %" PRIu64 " unlinked", entry->id);
 }
 
+/** Unlink any entries in a shard which have passed their cleanup time
+ *
+ * The entries are moved to a list, so they can be freed after the
+ * shard mutex has been released.
+ *
+ * @note Called with the shard mutex held.
+ *
+ * @return The number of entries unlinked.
+ */
+static uint64_t state_shard_expire(fr_state_shard_t *shard, fr_dlist_head_t *to_free, fr_time_t now)
+{
+	fr_state_entry_t	*entry, *next;
+	uint64_t		timed_out = 0;
+
+	for (entry = fr_dlist_head(&shard->to_expire);
+	     entry != NULL;
+	     entry = next) {
+ 		(void)talloc_get_type_abort(entry, fr_state_entry_t);	/* Allow examination */
+		next = fr_dlist_next(&shard->to_expire, entry);		/* Advance *before* potential unlinking */
+
+		/*
+		 *	List is ordered by cleanup time, so we
+		 *	can stop at the first live entry.
+		 */
+		if (!fr_time_lt(entry->cleanup, now)) break;
+
+		state_entry_unlink(shard, entry);
+		fr_dlist_insert_tail(to_free, entry);
+		timed_out++;
+	}
+
+	return timed_out;
+}
+
+/** Clean up expired entries
+ *
+ * With many shards, an idle shard may not be touched for some time, so as
+ * well as the shard being inserted into, we check one other shard
+ * per call (round robin).  If all is true, every shard is checked.
+ *
+ * @note Called with no mutexes held.
+ */
+static void state_expire(fr_state_tree_t *state, request_t *request, fr_state_shard_t *skip,
+			 fr_time_t now, bool all)
+{
+	fr_state_entry_t	*entry;
+	fr_dlist_head_t		to_free;
+	uint64_t		timed_out = 0;
+	uint32_t		i, num = all ? state->num_shards : 1;
+
+	fr_dlist_init(&to_free, fr_state_entry_t, free_entry);
+
+	for (i = 0; i < num; i++) {
+		fr_state_shard_t *shard;
+
+		shard = &state->shards[atomic_fetch_add_explicit(&state->sweep, 1, memory_order_relaxed) &
+				       (state->num_shards - 1)];
+		if (shard == skip) continue;
+
+		PTHREAD_MUTEX_LOCK(&shard->mutex);
+		timed_out += state_shard_expire(shard, &to_free, now);
+		PTHREAD_MUTEX_UNLOCK(&shard->mutex);
+	}
+
+	if (timed_out == 0) return;
+
+	atomic_fetch_add_explicit(&state->timed_out, timed_out, memory_order_relaxed);
+	RWDEBUG("Cleaning up %"PRIu64" timed out state entries", timed_out);
+
+	/*
+	 *	Now free the unlinked entries.
+	 *
+	 *	We do it here as freeing may involve significantly more
+	 *	work than just freeing the data.
+	 *
+	 *	If there's request data that was persisted it will now
+	 *	be freed also, and it may have complex destructors associated
+	 *	with it.
+	 */
+	while ((entry = fr_dlist_head(&to_free)) != NULL) {
+		fr_dlist_remove(&to_free, entry);
+		talloc_free(entry);
+	}
+}
+
+/** Reserve a session slot
+ *
+ * @return
+ *	- true if a slot was reserved.
+ *	- false if we're at max_sessions.
+ */
+static inline CC_HINT(always_inline)
+bool state_session_reserve(fr_state_tree_t *state)
+{
+	uint_fast32_t used = atomic_load_explicit(&state->used_sessions, memory_order_relaxed);
+
+	do {
+		if (used >= state->max_sessions) return false;
+	} while (!atomic_compare_exchange_weak_explicit(&state->used_sessions, &used, used + 1,
+							memory_order_relaxed, memory_order_relaxed));
+
+	return true;
+}
+
 /** Frees any data associated with a state
  *
  */
@@ -320,28 +506,32 @@ static int _state_entry_free(fr_state_entry_t *entry)
 
 	DEBUG4("State ID %" PRIu64 " freed", entry->id);
 
-	entry->state_tree->used_sessions--;
+	atomic_fetch_sub_explicit(&entry->state_tree->used_sessions, 1, memory_order_relaxed);
 
 	return 0;
 }
 
 /** Create a new state entry
  *
- * @note Called with the mutex held.
+ * The entry takes ownership of the request's session-state ctx and of the
+ * persistable request data in data, before it's inserted into its shard.
+ *
+ * @note Called with no mutexes held.
  */
 static fr_state_entry_t *state_entry_create(fr_state_tree_t *state, request_t *request,
-					    fr_pair_list_t *reply_list, fr_state_entry_t *old)
+					    fr_pair_list_t *reply_list, fr_state_entry_t *old,
+					    fr_dlist_head_t *data)
 {
 	size_t			i;
 	uint32_t		x;
 	fr_time_t		now = fr_time();
 	fr_pair_t		*vp;
-	fr_state_entry_t	*entry, *next;
+	fr_state_entry_t	*entry;
+	fr_state_shard_t	*shard;
 
 	uint8_t			old_state[sizeof(old->state)];
 	int			old_tries = 0;
-	uint64_t		timed_out = 0;
-	bool			too_many = false;
+	uint64_t		timed_out;
 	fr_dlist_head_t		to_free;
 
 	/*
@@ -351,73 +541,26 @@ static fr_state_entry_t *state_entry_create(fr_state_tree_t *state, request_t *r
 		  (!fr_dlist_entry_in_list(&old->expire_entry) &&
 		   !fr_rb_node_inline_in_tree(&old->node)));
 
-	fr_dlist_init(&to_free, fr_state_entry_t, free_entry);
-
-	/*
-	 *	Clean up expired entries
-	 */
-	for (entry = fr_dlist_head(&state->to_expire);
-	     entry != NULL;
-	     entry = next) {
- 		(void)talloc_get_type_abort(entry, fr_state_entry_t);	/* Allow examination */
-		next = fr_dlist_next(&state->to_expire, entry);		/* Advance *before* potential unlinking */
-
-		if (entry == old) continue;
-
+	if (!old) {
 		/*
-		 *	Too old, we can delete it.
+		 *	Expired entries still count towards
+		 *	the limit, so clean up every shard
+		 *	before giving up.
 		 */
-		if (fr_time_lt(entry->cleanup, now)) {
-			state_entry_unlink(state, entry);
-			fr_dlist_insert_tail(&to_free, entry);
-			timed_out++;
-			continue;
-		}
-
-		break;
-	}
-
-	state->timed_out += timed_out;
+		if (!state_session_reserve(state)) {
+			state_expire(state, request, NULL, now, true);
 
-	if (!old) {
-		too_many = (state->used_sessions == (uint32_t) state->max_sessions);
-		if (!too_many) state->used_sessions++;	/* preemptively increment whilst we hold the mutex */
+			if (!state_session_reserve(state)) {
+				RERROR("Failed inserting state entry - At maximum ongoing session limit (%u)",
+				       state->max_sessions);
+				return NULL;
+			}
+		}
 	} else {
 		old_tries = old->tries;
 		memcpy(old_state, old->state, sizeof(old_state));
 	}
 
-	PTHREAD_MUTEX_UNLOCK(&state->mutex);
-
-	if (timed_out > 0) RWDEBUG("Cleaning up %"PRIu64" timed out state entries", timed_out);
-
-	/*
-	 *	Now free the unlinked entries.
-	 *
-	 *	We do it here as freeing may involve significantly more
-	 *	work than just freeing the data.
-	 *
-	 *	If there's request data that was persisted it will now
-	 *	be freed also, and it may have complex destructors associated
-	 *	with it.
-	 */
-	while ((entry = fr_dlist_head(&to_free)) != NULL) {
-		fr_dlist_remove(&to_free, entry);
-		talloc_free(entry);
-	}
-
-	/*
-	 *	Have to do this post-cleanup, else we end up returning with
-	 *	a list full of entries to free with none of them being
-	 *	freed which is bad...
-	 */
-	if (too_many) {
-		RERROR("Failed inserting state entry - At maximum ongoing session limit (%u)",
-		       state->max_sessions);
-		PTHREAD_MUTEX_LOCK(&state->mutex);	/* Caller expects this to be locked */
-		return NULL;
-	}
-
 	/*
 	 *	Allocation doesn't need to occur inside the critical region
 	 *	and would add significantly to contention.
@@ -435,13 +578,18 @@ static fr_state_entry_t *state_entry_create(fr_state_tree_t *state, request_t *r
 		talloc_free_children(old);
 		memset(old, 0, sizeof(*old));
 		entry = old;
+
+		/*
+		 *	The entry keeps its session slot
+		 */
+		atomic_fetch_add_explicit(&state->used_sessions, 1, memory_order_relaxed);
 	}
 
 	entry->state_tree = state;
 
 	request_data_list_init(&entry->data);
 
-	entry->id = state->id++;
+	entry->id = atomic_fetch_add_explicit(&state->id, 1, memory_order_relaxed);
 
 	/*
 	 *	Limit the lifetime of this entry based on how long the
@@ -451,6 +599,8 @@ static fr_state_entry_t *state_entry_create(fr_state_tree_t *state, request_t *r
 	 */
 	entry->cleanup = fr_time_add(now, state->timeout);
 
+	state_entries_expiry_update(entry->cleanup);
+
 	/*
 	 *	Some modules create their own magic
 	 *	state attributes.  If a state value already exists
@@ -531,8 +681,6 @@ static fr_state_entry_t *state_entry_create(fr_state_tree_t *state, request_t *r
 	       entry->id, fr_box_octets(entry->state, sizeof(entry->state)),
 	       fr_box_time_delta(fr_time_sub(entry->cleanup, now)));
 
-	PTHREAD_MUTEX_LOCK(&state->mutex);
-
 	/*
 	 *	XOR the server hash with four bytes of random data.
 	 *	We XOR is again before resolving, to ensure state lookups
@@ -541,28 +689,72 @@ static fr_state_entry_t *state_entry_create(fr_state_tree_t *state, request_t *r
 	 */
 	*((uint32_t *)(&entry->state_comp.context_id)) ^= state->context_id;
 
-	if (!fr_rb_insert(state->tree, entry)) {
+	entry->seq_start = request->seq_start;
+	entry->ctx = request->session_state_ctx;
+	fr_dlist_move(&entry->data, data);
+
+	shard = state_shard(state, entry->state);
+	fr_dlist_init(&to_free, fr_state_entry_t, free_entry);
+
+	PTHREAD_MUTEX_LOCK(&shard->mutex);
+
+	/*
+	 *	Clean up expired entries
+	 */
+	timed_out = state_shard_expire(shard, &to_free, now);
+
+	if (!fr_rb_insert(shard->tree, entry)) {
+		PTHREAD_MUTEX_UNLOCK(&shard->mutex);
+
 		RERROR("Failed inserting state entry - Insertion into state tree failed");
 		fr_pair_delete_by_da(reply_list, state->da);
+
+		/*
+		 *	Give the session-state and request
+		 *	data back to the caller.
+		 */
+		entry->ctx = NULL;
+		fr_dlist_move(data, &entry->data);
 		talloc_free(entry);
-		return NULL;
+		entry = NULL;
+		goto done;
 	}
 
 	/*
 	 *	Link it to the end of the list, which is implicitely
 	 *	ordered by cleanup time.
 	 */
-	fr_dlist_insert_tail(&state->to_expire, entry);
+	fr_dlist_insert_tail(&shard->to_expire, entry);
+
+	PTHREAD_MUTEX_UNLOCK(&shard->mutex);
+
+done:
+	if (timed_out > 0) {
+		atomic_fetch_add_explicit(&state->timed_out, timed_out, memory_order_relaxed);
+		RWDEBUG("Cleaning up %"PRIu64" timed out state entries", timed_out);
+
+		while ((old = fr_dlist_head(&to_free)) != NULL) {
+			fr_dlist_remove(&to_free, old);
+			talloc_free(old);
+		}
+	}
+
+	/*
+	 *	Amortise cleanup of shards we're not inserting into
+	 */
+	if (state->num_shards > 1) state_expire(state, request, shard, now, false);
 
 	return entry;
 }
 
 /** Find the entry based on the State attribute and remove it from the state tree
  *
+ * @note Called with no mutexes held.
  */
 static fr_state_entry_t *state_entry_find_and_unlink(fr_state_tree_t *state, fr_value_box_t const *vb)
 {
-	fr_state_entry_t *entry, my_entry;
+	fr_state_entry_t	*entry, my_entry;
+	fr_state_shard_t	*shard;
 
 	/*
 	 *	Assume our own State first.
@@ -591,11 +783,15 @@ static fr_state_entry_t *state_entry_find_and_unlink(fr_state_tree_t *state, fr_
 	 */
 	my_entry.state_comp.context_id ^= state->context_id;
 
-	entry = fr_rb_remove(state->tree, &my_entry);
+	shard = state_shard(state, my_entry.state);
+
+	PTHREAD_MUTEX_LOCK(&shard->mutex);
+	entry = fr_rb_remove(shard->tree, &my_entry);
 	if (entry) {
 		(void) talloc_get_type_abort(entry, fr_state_entry_t);
-		fr_dlist_remove(&state->to_expire, entry);
+		fr_dlist_remove(&shard->to_expire, entry);
 	}
+	PTHREAD_MUTEX_UNLOCK(&shard->mutex);
 
 	return entry;
 }
@@ -611,13 +807,8 @@ void fr_state_discard(fr_state_tree_t *state, request_t *request)
 	vp = fr_pair_find_by_da(&request->request_pairs, NULL, state->da);
 	if (!vp) return;
 
-	PTHREAD_MUTEX_LOCK(&state->mutex);
 	entry = state_entry_find_and_unlink(state, &vp->data);
-	if (!entry) {
-		PTHREAD_MUTEX_UNLOCK(&state->mutex);
-		return;
-	}
-	PTHREAD_MUTEX_UNLOCK(&state->mutex);
+	if (!entry) return;
 
 	/*
 	 *	If fr_state_to_request was never called, this ensures
@@ -675,14 +866,11 @@ int fr_state_to_request(fr_state_tree_t *state, request_t *request)
 		return 1;
 	}
 
-	PTHREAD_MUTEX_LOCK(&state->mutex);
 	entry = state_entry_find_and_unlink(state, &vp->data);
 	if (!entry) {
-		PTHREAD_MUTEX_UNLOCK(&state->mutex);
 		RDEBUG2("No state entry matching &request.%pP found", vp);
 		return 2;
 	}
-   	PTHREAD_MUTEX_UNLOCK(&state->mutex);
 
 	/* Probably impossible in the current code */
 	if (unlikely(entry->thawed != NULL)) {
@@ -755,27 +943,18 @@ int fr_request_to_state(fr_state_tree_t *state, request_t *request)
 		log_request_pair_list(L_DBG_LVL_2, request, NULL, &request->session_state_pairs, "&session-state.");
 	}
 
-	PTHREAD_MUTEX_LOCK(&state->mutex);
+	fr_assert(request->session_state_ctx);
 
 	/*
 	 *	Reuses old if possible
 	 */
-	entry = state_entry_create(state, request, &request->reply_pairs, old);
+	entry = state_entry_create(state, request, &request->reply_pairs, old, &data);
 	if (!entry) {
-		PTHREAD_MUTEX_UNLOCK(&state->mutex);
 		RERROR("Creating state entry failed");
 		request_data_restore(request, &data);	/* Put it back again */
 		return -1;
 	}
 
-	fr_assert(entry->ctx == NULL);
-	fr_assert(request->session_state_ctx);
-
-	entry->seq_start = request->seq_start;
-	entry->ctx = request->session_state_ctx;
-	fr_dlist_move(&entry->data, &data);
-	PTHREAD_MUTEX_UNLOCK(&state->mutex);
-
 	MEM(request->session_state_ctx = fr_pair_afrom_da(NULL, request_attr_state));	/* fixme - should use a pool */
 
 	RDEBUG3("%s - saved", state->da->name);
@@ -927,7 +1106,7 @@ void fr_state_discard_child(request_t *parent, void const *unique_ptr, int uniqu
  */
 uint64_t fr_state_entries_created(fr_state_tree_t *state)
 {
-	return state->id;
+	return atomic_load_explicit(&state->id, memory_order_relaxed);
 }
 
 /** Return number of entries that timed out
@@ -935,7 +1114,15 @@ uint64_t fr_state_entries_created(fr_state_tree_t *state)
  */
 uint64_t fr_state_entries_timeout(fr_state_tree_t *state)
 {
-	return state->timed_out;
+	return atomic_load_explicit(&state->timed_out, memory_order_relaxed);
+}
+
+/** Return when the last entry created in any state tree expires
+ *
+ */
+fr_time_t fr_state_entries_expiry(void)
+{
+	return fr_time_wrap(atomic_load_explicit(&state_entries_expiry, memory_order_relaxed));
 }
 
 /** Return number of entries we're currently tracking
@@ -943,5 +1130,16 @@ uint64_t fr_state_entries_timeout(fr_state_tree_t *state)
  */
 uint64_t fr_state_entries_tracked(fr_state_tree_t *state)
 {
-	return fr_rb_num_elements(state->tree);
+	uint64_t	tracked = 0;
+	uint32_t	i;
+
+	for (i = 0; i < state->num_shards; i++) {
+		fr_state_shard_t *shard = &state->shards[i];
+
+		PTHREAD_MUTEX_LOCK(&shard->mutex);
+		tracked += fr_rb_num_elements(shard->tree);
+		PTHREAD_MUTEX_UNLOCK(&shard->mutex);
+	}
+
+	return tracked;
 }
@@ -55,6 +55,8 @@ uint64_t fr_state_entries_created(fr_state_tree_t *state);
 uint64_t fr_state_entries_timeout(fr_state_tree_t *state);
 uint64_t fr_state_entries_tracked(fr_state_tree_t *state);
 
+fr_time_t fr_state_entries_expiry(void);
+
 #ifdef __cplusplus
 }
 #endif
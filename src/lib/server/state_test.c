@@ -1,28 +1,286 @@
+/*
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Lesser General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2.1 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *   Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Tests for the multi-packet state API
+ *
+ * @file src/lib/server/state_test.c
+ * @copyright 2026 The FreeRADIUS server project
+ */
+#define USE_CONSTRUCTOR
+
+#ifdef USE_CONSTRUCTOR
+static void test_init(void) __attribute__((constructor));
+#else
+static void test_init(void);
+#  define TEST_INIT  test_init()
+#endif
+
 #include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+#include <freeradius-devel/util/dict_test.h>
+
+#include <freeradius-devel/server/base.h>
+#include <freeradius-devel/server/pair.h>
+#include <freeradius-devel/server/state.h>
+#include <freeradius-devel/io/listen.h>
+
+#include <pthread.h>
+
+static TALLOC_CTX	*autofree;
+static fr_dict_t	*test_dict;
+
+/** Global initialisation
+ */
+static void test_init(void)
+{
+	autofree = talloc_autofree_context();
+	if (!autofree) {
+	error:
+		fr_perror("state_tests");
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	/*
+	 *	Mismatch between the binary and the libraries it depends on
+	 */
+	if (fr_check_lib_magic(RADIUSD_MAGIC_NUMBER) < 0) goto error;
+
+	if (fr_dict_test_init(autofree, &test_dict, NULL) < 0) goto error;
+
+	if (request_global_init() < 0) goto error;
+
+	/*
+	 *	Needed for request logging on failure
+	 */
+	if (log_global_init(&default_log, false) < 0) goto error;
+}
+
+static request_t *request_fake_alloc(TALLOC_CTX *ctx)
+{
+	request_t	*request;
 
-fr_time_t	test_time;
+	/*
+	 *	Create and initialize the new request.
+	 */
+	request = request_local_alloc_external(ctx, NULL);
+
+	request->packet = fr_radius_packet_alloc(request, false);
+	TEST_CHECK(request->packet != NULL);
+
+	request->reply = fr_radius_packet_alloc(request, false);
+	TEST_CHECK(request->reply != NULL);
+
+	MEM(request->async = talloc_zero(request, fr_async_t));
+
+	return request;
+}
 
-/** Allow us to arbitrarily manipulate time
+/** Run the first round of a session, returning the request holding the State value sent
  *
  */
-#define fr_time()	test_time
+static request_t *session_start(TALLOC_CTX *ctx, fr_state_tree_t *state, char const *value, int *ret)
+{
+	request_t	*request = request_fake_alloc(ctx);
+	fr_pair_t	*vp;
+
+	MEM(vp = fr_pair_afrom_da(request->session_state_ctx, fr_dict_attr_test_string));
+	fr_pair_value_strdup(vp, value, false);
+	fr_pair_append(&request->session_state_pairs, vp);
 
-#include <state_test.c>
+	*ret = fr_request_to_state(state, request);
 
-/** Test functions that read from dbuffs.
+	return request;
+}
+
+/** Run the next round of a session, using the State value from the previous reply
  *
  */
-static void state_entry_create(void)
+static request_t *session_continue(TALLOC_CTX *ctx, fr_state_tree_t *state, request_t *prev, int *ret)
 {
+	request_t	*request = request_fake_alloc(ctx);
+	fr_pair_t	*vp, *state_vp;
+
+	state_vp = fr_pair_find_by_da(&prev->reply_pairs, NULL, fr_dict_attr_test_octets);
+	TEST_ASSERT(state_vp != NULL);
 
+	MEM(vp = fr_pair_copy(request->request_ctx, state_vp));
+	fr_pair_append(&request->request_pairs, vp);
+
+	*ret = fr_state_to_request(state, request);
+
+	return request;
+}
+
+static void test_state_entry_create(void)
+{
+	fr_state_tree_t	*state;
+	request_t	*first, *second;
+	fr_pair_t	*vp;
+	int		ret;
+
+	state = fr_state_tree_init(autofree, fr_dict_attr_test_octets, true, 256,
+				   fr_time_delta_from_sec(30), 0, 0);
+	TEST_ASSERT(state != NULL);
+
+	TEST_CASE("Saving session-state creates an entry and a State value");
+	first = session_start(autofree, state, "hello", &ret);
+	TEST_CHECK_RET(ret, 0);
+	TEST_CHECK(fr_state_entries_tracked(state) == 1);
+	TEST_CHECK(fr_state_entries_created(state) == 1);
+
+	vp = fr_pair_find_by_da(&first->reply_pairs, NULL, fr_dict_attr_test_octets);
+	TEST_ASSERT(vp != NULL);
+	TEST_CHECK(vp->vp_length == 16);
+
+	TEST_CASE("The State value restores the session-state");
+	second = session_continue(autofree, state, first, &ret);
+	TEST_CHECK_RET(ret, 0);
+	TEST_CHECK(fr_state_entries_tracked(state) == 0);
+
+	vp = fr_pair_find_by_da(&second->session_state_pairs, NULL, fr_dict_attr_test_string);
+	TEST_ASSERT(vp != NULL);
+	TEST_CHECK(strcmp(vp->vp_strvalue, "hello") == 0);
+
+	TEST_CASE("The State value can only be used once");
+	talloc_free(second);
+	second = session_continue(autofree, state, first, &ret);
+	TEST_CHECK_RET(ret, 2);
+
+	talloc_free(second);
+	talloc_free(first);
+	talloc_free(state);
+}
+
+static void test_state_entry_too_many(void)
+{
+	fr_state_tree_t	*state;
+	request_t	*request[5];
+	TALLOC_CTX	*ctx = talloc_new(autofree);
+	size_t		i;
+	int		ret;
+
+	state = fr_state_tree_init(ctx, fr_dict_attr_test_octets, true, 4,
+				   fr_time_delta_from_msec(50), 0, 0);
+	TEST_ASSERT(state != NULL);
+
+	TEST_CASE("Entries are created up to max_sessions");
+	for (i = 0; i < 4; i++) {
+		request[i] = session_start(ctx, state, "hello", &ret);
+		TEST_CHECK_RET(ret, 0);
+	}
+	TEST_CHECK(fr_state_entries_tracked(state) == 4);
+
+	TEST_CASE("Entries beyond max_sessions are refused");
+	request[4] = session_start(ctx, state, "hello", &ret);
+	TEST_CHECK_RET(ret, -1);
+	talloc_free(request[4]);
+
+	TEST_CASE("Timed out entries are cleaned up to make room for new ones");
+	nanosleep(&(struct timespec){ .tv_nsec = 100 * 1000 * 1000 }, NULL);
+
+	request[4] = session_start(ctx, state, "hello", &ret);
+	TEST_CHECK_RET(ret, 0);
+	TEST_CHECK(fr_state_entries_timeout(state) == 4);
+	TEST_CHECK(fr_state_entries_tracked(state) == 1);
+
+	talloc_free(ctx);
+}
+
+#define BENCH_THREADS	4
+#define BENCH_ROUNDS	20000
+
+typedef struct {
+	fr_state_tree_t	*state;
+	pthread_t	thread;
+	int		failed;
+} state_bench_t;
+
+static void *state_bench_thread(void *uctx)
+{
+	state_bench_t	*b = uctx;
+	TALLOC_CTX	*ctx = talloc_new(NULL);
+	int		i, ret;
+
+	for (i = 0; i < BENCH_ROUNDS; i++) {
+		request_t *first, *second;
+
+		first = session_start(ctx, b->state, "hello", &ret);
+		if (ret != 0) b->failed++;
+
+		second = session_continue(ctx, b->state, first, &ret);
+		if (ret != 0) b->failed++;
+
+		talloc_free(second);
+		talloc_free(first);
+	}
+
+	talloc_free(ctx);
+
+	return NULL;
+}
+
+/** Measure the rate at which concurrent sessions can complete a round
+ *
+ */
+static void test_state_entry_benchmark(void)
+{
+	fr_state_tree_t	*state;
+	state_bench_t	bench[BENCH_THREADS];
+	fr_time_t	start, stop;
+	uint64_t	rate;
+	size_t		i;
+
+	state = fr_state_tree_init(autofree, fr_dict_attr_test_octets, true, BENCH_THREADS * 2,
+				   fr_time_delta_from_sec(30), 0, 0);
+	TEST_ASSERT(state != NULL);
+
+	start = fr_time();
+	for (i = 0; i < BENCH_THREADS; i++) {
+		bench[i] = (state_bench_t){ .state = state };
+		TEST_ASSERT(pthread_create(&bench[i].thread, NULL, state_bench_thread, &bench[i]) == 0);
+	}
+
+	for (i = 0; i < BENCH_THREADS; i++) {
+		pthread_join(bench[i].thread, NULL);
+		TEST_CHECK(bench[i].failed == 0);
+		TEST_MSG("Thread %zu failed %d rounds", i, bench[i].failed);
+	}
+	stop = fr_time();
+
+	rate = (uint64_t)((float)NSEC / (fr_time_delta_unwrap(fr_time_sub(stop, start)) /
+					 (BENCH_THREADS * BENCH_ROUNDS)));
+	printf("%u threads, round rate %" PRIu64 "\n", BENCH_THREADS, rate);
+
+	TEST_CHECK(fr_state_entries_tracked(state) == 0);
+	TEST_CHECK(fr_state_entries_created(state) == (BENCH_THREADS * BENCH_ROUNDS));
+
+	talloc_free(state);
 }
 
 TEST_LIST = {
 	/*
 	 *	Basic tests
 	 */
-	{ "state_entry_create",				state_entry_create },
-	{ "state_entry_too_many" }
+	{ "state_entry_create",				test_state_entry_create },
+	{ "state_entry_too_many",			test_state_entry_too_many },
+
+	/*
+	 *	Performance
+	 */
+	{ "state_entry_benchmark",			test_state_entry_benchmark },
 
 	{ NULL }
 };
@@ -1050,6 +1050,7 @@ int tmpl_attr_copy(tmpl_t *dst, tmpl_t const *src)
 	 	default:
 	 		if (!fr_cond_assert(0)) return -1;
 	 	}
+	 	dst_ar->ar_parent = src_ar->ar_parent;
 	 	dst_ar->ar_num = src_ar->ar_num;
 	}
 
@@ -33,16 +33,20 @@
 typedef struct fr_trunk_request_s fr_trunk_request_t;
 typedef struct fr_trunk_connection_s fr_trunk_connection_t;
 typedef struct fr_trunk_s fr_trunk_t;
+typedef struct fr_trunk_metrics_s fr_trunk_metrics_t;
 #define _TRUNK_PRIVATE 1
 #include <freeradius-devel/server/trunk.h>
 
 #include <freeradius-devel/server/connection.h>
+#include <freeradius-devel/server/metrics.h>
 #include <freeradius-devel/server/trigger.h>
 #include <freeradius-devel/util/misc.h>
 #include <freeradius-devel/util/syserror.h>
 #include <freeradius-devel/util/table.h>
 #include <freeradius-devel/util/minmax_heap.h>
 
+#include <pthread.h>
+
 #ifdef HAVE_STDATOMIC_H
 #  include <stdatomic.h>
 #else
@@ -192,6 +196,9 @@ struct fr_trunk_s {
 
 	char const		*log_prefix;		//!< What to prepend to messages.
 
+	fr_dlist_t		entry;			//!< Entry in the list of all trunks, for metrics.
+	fr_trunk_metrics_t	*metrics;		//!< Last published copy of our counters.
+
 	fr_event_list_t		*el;			//!< Event list used by this trunk and the connection.
 
 	fr_trunk_conf_t		conf;			//!< Trunk common configuration.
@@ -901,6 +908,120 @@ static void trunk_manage(fr_trunk_t *trunk, fr_time_t now);
 static void _trunk_timer(fr_event_list_t *el, fr_time_t now, void *uctx);
 static void trunk_backlog_drain(fr_trunk_t *trunk);
 
+/** All trunks, so that we can export metrics for them
+ *
+ * Trunks belong to a single thread, but metrics are printed from
+ * another, which can't safely look at the connection lists.  Each
+ * trunk publishes a copy of its counters from its management timer,
+ * and the mutex protects both the list, and the copies.
+ */
+static pthread_mutex_t	trunk_list_mutex = PTHREAD_MUTEX_INITIALIZER;
+static fr_dlist_head_t	trunk_list;
+static bool		trunk_list_init;
+
+/** Counters for one trunk, as last published by the thread which owns it
+ *
+ */
+struct fr_trunk_metrics_s {
+	uint64_t		connections[NUM_ELEMENTS(fr_trunk_connection_states)];	//!< Indexed the same as
+											///< fr_trunk_connection_states.
+	uint64_t		allocated;		//!< Requests allocated.
+	uint64_t		backlog;		//!< Requests in the backlog.
+};
+
+/** Publish a copy of the trunk's counters, for trunk_metrics_print()
+ *
+ * Must be called from the thread which owns the trunk.
+ */
+static void trunk_metrics_publish(fr_trunk_t *trunk)
+{
+	size_t	i;
+
+	pthread_mutex_lock(&trunk_list_mutex);
+	for (i = 0; i < fr_trunk_connection_states_len; i++) {
+		trunk->metrics->connections[i] = fr_trunk_connection_count_by_state(trunk,
+										     fr_trunk_connection_states[i].value);
+	}
+	trunk->metrics->allocated = trunk->pub.req_alloc;
+	trunk->metrics->backlog = fr_heap_num_elements(trunk->backlog);
+	pthread_mutex_unlock(&trunk_list_mutex);
+}
+
+/** Print OpenMetrics for all trunks
+ *
+ * Trunks with the same log prefix (usually the same module, in
+ * different threads) are summed.
+ */
+static void trunk_metrics_print(FILE *fp, UNUSED void *uctx)
+{
+	fr_trunk_t	*trunk, *other;
+	size_t		i;
+
+	pthread_mutex_lock(&trunk_list_mutex);
+
+	fr_metrics_family(fp, "freeradius_trunk_connections", FR_METRICS_TYPE_GAUGE,
+			  "Connections in a trunk, by state.");
+	for (trunk = fr_dlist_head(&trunk_list); trunk; trunk = fr_dlist_next(&trunk_list, trunk)) {
+		/*
+		 *	Already printed as part of an earlier trunk.
+		 */
+		for (other = fr_dlist_prev(&trunk_list, trunk); other; other = fr_dlist_prev(&trunk_list, other)) {
+			if (strcmp(other->log_prefix, trunk->log_prefix) == 0) break;
+		}
+		if (other) continue;
+
+		for (i = 0; i < fr_trunk_connection_states_len; i++) {
+			int		state = fr_trunk_connection_states[i].value;
+			uint64_t	count = 0;
+
+			if (state == FR_TRUNK_CONN_HALTED) continue;
+
+			for (other = trunk; other; other = fr_dlist_next(&trunk_list, other)) {
+				if (strcmp(other->log_prefix, trunk->log_prefix) != 0) continue;
+
+				count += other->metrics->connections[i];
+			}
+
+			fprintf(fp, "freeradius_trunk_connections{");
+			fr_metrics_label(fp, "trunk", trunk->log_prefix);
+			fprintf(fp, ",state=\"%s\"} %" PRIu64 "\n", fr_trunk_connection_states[i].name.str, count);
+		}
+	}
+
+	fr_metrics_family(fp, "freeradius_trunk_requests", FR_METRICS_TYPE_GAUGE,
+			  "Requests allocated by a trunk, and how many of those are in the backlog.");
+	for (trunk = fr_dlist_head(&trunk_list); trunk; trunk = fr_dlist_next(&trunk_list, trunk)) {
+		uint64_t allocated = 0, backlog = 0;
+
+		for (other = fr_dlist_prev(&trunk_list, trunk); other; other = fr_dlist_prev(&trunk_list, other)) {
+			if (strcmp(other->log_prefix, trunk->log_prefix) == 0) break;
+		}
+		if (other) continue;
+
+		for (other = trunk; other; other = fr_dlist_next(&trunk_list, other)) {
+			if (strcmp(other->log_prefix, trunk->log_prefix) != 0) continue;
+
+			allocated += other->metrics->allocated;
+			backlog += other->metrics->backlog;
+		}
+
+		fprintf(fp, "freeradius_trunk_requests{");
+		fr_metrics_label(fp, "trunk", trunk->log_prefix);
+		fprintf(fp, ",state=\"allocated\"} %" PRIu64 "\n", allocated);
+
+		fprintf(fp, "freeradius_trunk_requests{");
+		fr_metrics_label(fp, "trunk", trunk->log_prefix);
+		fprintf(fp, ",state=\"backlog\"} %" PRIu64 "\n", backlog);
+	}
+
+	pthread_mutex_unlock(&trunk_list_mutex);
+}
+
+static fr_metrics_t trunk_metrics = {
+	.name = "trunk",
+	.func = trunk_metrics_print
+};
+
 /** Compare two protocol requests
  *
  * Allows protocol requests to be prioritised with a function
@@ -4297,6 +4418,7 @@ static void _trunk_timer(fr_event_list_t *el, fr_time_t now, void *uctx)
 	fr_trunk_t *trunk = talloc_get_type_abort(uctx, fr_trunk_t);
 
 	trunk_manage(trunk, now);
+	trunk_metrics_publish(trunk);
 
 	if (fr_time_delta_ispos(trunk->conf.manage_interval)) {
 		if (fr_event_timer_in(trunk, el, &trunk->manage_ev, trunk->conf.manage_interval,
@@ -4652,6 +4774,10 @@ static int _trunk_free(fr_trunk_t *trunk)
 
 	DEBUG4("Trunk free %p", trunk);
 
+	pthread_mutex_lock(&trunk_list_mutex);
+	if (fr_dlist_entry_in_list(&trunk->entry)) fr_dlist_remove(&trunk_list, trunk);
+	pthread_mutex_unlock(&trunk_list_mutex);
+
 	trunk->freeing = true;	/* Prevent re-enqueuing */
 
 	/*
@@ -4787,6 +4913,22 @@ fr_trunk_t *fr_trunk_alloc(TALLOC_CTX *ctx, fr_event_list_t *el,
 		fr_dlist_talloc_init(&trunk->watch[i], fr_trunk_watch_entry_t, entry);
 	}
 
+	MEM(trunk->metrics = talloc_zero(trunk, fr_trunk_metrics_t));
+
+	pthread_mutex_lock(&trunk_list_mutex);
+	if (!trunk_list_init) {
+		fr_dlist_talloc_init(&trunk_list, fr_trunk_t, entry);
+		trunk_list_init = true;
+	}
+	fr_dlist_insert_tail(&trunk_list, trunk);
+	pthread_mutex_unlock(&trunk_list_mutex);
+
+	/*
+	 *	Outside of the trunk list mutex, as the metrics
+	 *	mutex is held when trunk_metrics_print() is called.
+	 */
+	fr_metrics_register(&trunk_metrics);
+
 	DEBUG4("Trunk allocated %p", trunk);
 
 	if (!delay_start) {
@@ -27,6 +27,7 @@ RCSID("$Id$")
 #include <freeradius-devel/server/log.h>
 #include <freeradius-devel/util/debug.h>
 #include <freeradius-devel/server/users_file.h>
+#include <freeradius-devel/unlang/xlat.h>
 
 #include <freeradius-devel/util/misc.h>
 #include <freeradius-devel/util/pair_legacy.h>
@@ -37,6 +38,23 @@ RCSID("$Id$")
 #include <ctype.h>
 #include <fcntl.h>
 
+/** State for reading one users file, and the files it includes
+ *
+ */
+typedef struct {
+	TALLOC_CTX		*ctx;		//!< Where entries are allocated.
+	fr_dict_t const		*dict;		//!< Default dictionary for attribute references.
+	fr_event_list_t		*runtime_el;	//!< If set, the entries are for a single request.
+
+	PAIR_LIST_LIST		*list;		//!< Where entries are added.
+	pairlist_entry_func_t	func;		//!< Called with each entry, instead of adding it to list.
+	void			*uctx;		//!< Passed to func.
+
+	int			order;		//!< Sequence of the next entry.
+} pairlist_read_t;
+
+static int pairlist_read_file(pairlist_read_t *rctx, char const *file, bool complain);
+
 static inline void line_error_marker(char const *src_file, int src_line,
 				     char const *user_file, int user_line,
 				     fr_sbuff_t *sbuff, char const *error)
@@ -143,8 +161,7 @@ static fr_sbuff_parse_rules_t const rhs_term = {
 /*
  *	Caller saw a $INCLUDE at the start of a line.
  */
-static int users_include(TALLOC_CTX *ctx, fr_dict_t const *dict, fr_sbuff_t *sbuff, PAIR_LIST_LIST *list,
-			 char const *file, int lineno)
+static int users_include(pairlist_read_t *rctx, fr_sbuff_t *sbuff, char const *file, int lineno)
 {
 	size_t		len;
 	char		*newfile, *p, c;
@@ -224,7 +241,7 @@ static int users_include(TALLOC_CTX *ctx, fr_dict_t const *dict, fr_sbuff_t *sbu
 	/*
 	 *	Read the $INCLUDEd file recursively.
 	 */
-	if (pairlist_read(ctx, dict, newfile, list, 0) != 0) {
+	if (pairlist_read_file(rctx, newfile, false) != 0) {
 		ERROR("%s[%d]: Could not read included file %s: %s",
 		      file, lineno, newfile, fr_syserror(errno));
 		talloc_free(newfile);
@@ -236,41 +253,48 @@ static int users_include(TALLOC_CTX *ctx, fr_dict_t const *dict, fr_sbuff_t *sbu
 }
 
 
-/*
- *	Read the users file. Return a PAIR_LIST.
+/** Hand a complete entry to the caller
+ *
  */
-int pairlist_read(TALLOC_CTX *ctx, fr_dict_t const *dict, char const *file, PAIR_LIST_LIST *list, int complain)
+static int pairlist_entry_add(pairlist_read_t *rctx, PAIR_LIST *t, fr_sbuff_marker_t *m)
 {
-	char			*q;
-	int			order = 0;
-	int			lineno		= 1;
-	map_t			*new_map, *relative_map;
-	FILE			*fp;
-	fr_sbuff_t		sbuff;
-	fr_sbuff_uctx_file_t	fctx;
-	tmpl_rules_t		lhs_rules, rhs_rules;
-	char			*filename = talloc_strdup(ctx, file);
-	char			buffer[8192];
+	int ret;
 
-	DEBUG2("Reading file %s", file);
+	if (!rctx->func) {
+		fr_dlist_insert_tail(&rctx->list->head, t);
+		return 0;
+	}
 
-	/*
-	 *	Open the file.  The error message should be a little
-	 *	more useful...
-	 */
-	if ((fp = fopen(file, "r")) == NULL) {
-		if (!complain) return -1;
+	ret = rctx->func(t, fr_sbuff_current(m), fr_sbuff_behind(m), rctx->uctx);
+	fr_sbuff_marker_release(m);
+	talloc_free(t);
 
-		ERROR("Couldn't open %s for reading: %s", file, fr_syserror(errno));
-		return -1;
-	}
+	return ret;
+}
+
+/** Read entries from a users file
+ *
+ * @param[in] rctx	holding the parse options, and where the entries go.
+ * @param[in] sbuff	to read the entries from.
+ * @param[in] file	the entries are being read from.
+ * @param[in] lineno	of the first line in sbuff.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+static int pairlist_read_sbuff(pairlist_read_t *rctx, fr_sbuff_t *sbuff, char const *file, int lineno)
+{
+	char			*q;
+	map_t			*new_map, *relative_map;
+	tmpl_rules_t		lhs_rules, rhs_rules;
+	fr_sbuff_marker_t	m;
+	char			*filename = talloc_strdup(rctx->ctx, file);
 
-	fr_sbuff_init_file(&sbuff, &fctx, buffer, sizeof(buffer), fp, SIZE_MAX);
 	relative_map = NULL;
 
 	lhs_rules = (tmpl_rules_t) {
 		.attr = {
-			.dict_def = dict,
+			.dict_def = rctx->dict,
 			.prefix = TMPL_ATTR_REF_PREFIX_NO,
 			.disallow_qualifiers = true, /* for now, until more tests are made */
 
@@ -286,12 +310,20 @@ int pairlist_read(TALLOC_CTX *ctx, fr_dict_t const *dict, char const *file, PAIR
 	};
 	rhs_rules = (tmpl_rules_t) {
 		.attr = {
-			.dict_def = dict,
+			.dict_def = rctx->dict,
 			.prefix = TMPL_ATTR_REF_PREFIX_YES,
 			.disallow_qualifiers = true, /* for now, until rlm_files supports it */
 		}
 	};
 
+	/*
+	 *	The entries are only being used for one request.
+	 */
+	if (rctx->runtime_el) {
+		lhs_rules.at_runtime = rhs_rules.at_runtime = true;
+		lhs_rules.xlat.runtime_el = rhs_rules.xlat.runtime_el = rctx->runtime_el;
+	}
+
 	while (true) {
 		size_t		len;
 		ssize_t		slen;
@@ -303,11 +335,11 @@ int pairlist_read(TALLOC_CTX *ctx, fr_dict_t const *dict, char const *file, PAIR
 		 *	If the line is empty or has only comments,
 		 *	then we don't care about leading spaces.
 		 */
-		leading_spaces = (fr_sbuff_adv_past_blank(&sbuff, SIZE_MAX, NULL) > 0);
-		if (fr_sbuff_next_if_char(&sbuff, '#')) {
-			(void) fr_sbuff_adv_to_chr(&sbuff, SIZE_MAX, '\n');
+		leading_spaces = (fr_sbuff_adv_past_blank(sbuff, SIZE_MAX, NULL) > 0);
+		if (fr_sbuff_next_if_char(sbuff, '#')) {
+			(void) fr_sbuff_adv_to_chr(sbuff, SIZE_MAX, '\n');
 		}
-		if (fr_sbuff_next_if_char(&sbuff, '\n')) {
+		if (fr_sbuff_next_if_char(sbuff, '\n')) {
 			lineno++;
 			continue;
 		}
@@ -318,38 +350,22 @@ int pairlist_read(TALLOC_CTX *ctx, fr_dict_t const *dict, char const *file, PAIR
 		 *	this is, it's wrong.
 		 */
 		if (leading_spaces) {
-	    		ERROR_MARKER(&sbuff, "Entry does not begin with a user name");
+	    		ERROR_MARKER(sbuff, "Entry does not begin with a user name");
 		fail:
-			fclose(fp);
 			return -1;
 		}
 
 		/*
 		 *	$INCLUDE filename
 		 */
-		if (fr_sbuff_is_str(&sbuff, "$INCLUDE", 8)) {
-			/*
-			 *	Temporary list for include entries to be read into
-			 */
-			PAIR_LIST_LIST tmp_list;
-
-			pairlist_list_init(&tmp_list);
-			if (users_include(ctx, dict, &sbuff, &tmp_list, file, lineno) < 0) goto fail;
-
+		if (fr_sbuff_is_str(sbuff, "$INCLUDE", 8)) {
 			/*
-			 *	The file may have read no entries, one
-			 *	entry, or it may be a linked list of
-			 *	entries.  Set the order of the entries
-			 *	then move them to the end of the main list.
+			 *	The included entries are numbered, and
+			 *	added, as if they were in this file.
 			 */
-			t = NULL;
-			while ((t = fr_dlist_next(&tmp_list.head, t))) {
-				t->order = order++;
-			}
+			if (users_include(rctx, sbuff, file, lineno) < 0) goto fail;
 
-			fr_dlist_move(&list->head, &tmp_list.head);
-
-			if (fr_sbuff_next_if_char(&sbuff, '\n')) {
+			if (fr_sbuff_next_if_char(sbuff, '\n')) {
 				lineno++;
 				continue;
 			}
@@ -366,18 +382,25 @@ int pairlist_read(TALLOC_CTX *ctx, fr_dict_t const *dict, char const *file, PAIR
 		/*
 		 *	We MUST be either at a valid entry, OR at EOF.
 		 */
-		MEM(t = talloc_zero(ctx, PAIR_LIST));
+		MEM(t = talloc_zero(rctx->ctx, PAIR_LIST));
 		map_list_init(&t->check);
 		map_list_init(&t->reply);
 		t->filename = filename;
 		t->lineno = lineno;
-		t->order = order++;
+		t->order = rctx->order++;
+
+		/*
+		 *	Remember where the entry started, so the
+		 *	callback can be given its text.
+		 */
+		if (rctx->func) fr_sbuff_marker(&m, sbuff);
 
 		/*
 		 *	Copy the name from the entry.
 		 */
-		len = fr_sbuff_out_abstrncpy_until(t, &q, &sbuff, SIZE_MAX, &name_terms, NULL);
+		len = fr_sbuff_out_abstrncpy_until(t, &q, sbuff, SIZE_MAX, &name_terms, NULL);
 		if (len == 0) {
+			if (rctx->func) fr_sbuff_marker_release(&m);
 			talloc_free(t);
 			break;
 		}
@@ -394,18 +417,19 @@ check_item:
 		 *	Note that we _don't_ call map_afrom_substr() to
 		 *	skip spaces, as it will skip LF, too!
 		 */
-		(void) fr_sbuff_adv_past_blank(&sbuff, SIZE_MAX, NULL);
-		if (fr_sbuff_is_char(&sbuff, '#')) goto check_item_comment;
-		if (fr_sbuff_is_char(&sbuff, '\n')) goto check_item_end;
+		(void) fr_sbuff_adv_past_blank(sbuff, SIZE_MAX, NULL);
+		if (fr_sbuff_is_char(sbuff, '#')) goto check_item_comment;
+		if (fr_sbuff_is_char(sbuff, '\n')) goto check_item_end;
 
 		/*
 		 *	Try to parse the check item.
 		 */
-		slen = map_afrom_substr(t, &new_map, NULL, &sbuff, check_cmp_op_table, check_cmp_op_table_len,
+		slen = map_afrom_substr(t, &new_map, NULL, sbuff, check_cmp_op_table, check_cmp_op_table_len,
 				       &lhs_rules, &rhs_rules, &rhs_term);
 		if (!new_map) {
-	    		ERROR_MARKER_ADJ(&sbuff, slen, fr_strerror());
+	    		ERROR_MARKER_ADJ(sbuff, slen, fr_strerror());
 		fail_entry:
+			if (rctx->func) fr_sbuff_marker_release(&m);
 			talloc_free(t);
 			goto fail;
 		}
@@ -432,7 +456,7 @@ check_item:
 			    (tmpl_regex_compile(new_map->rhs, false) < 0)) {
 				ERROR("%s[%d]: Failed compiling regular expression /%s/ - %s",
 				      file, lineno, new_map->rhs->name, fr_strerror());
-				return -1;
+				goto fail_entry;
 			}
 
 			goto do_insert;
@@ -452,13 +476,13 @@ check_item:
 		/*
 		 *	There can be spaces before any comma.
 		 */
-		(void) fr_sbuff_adv_past_blank(&sbuff, SIZE_MAX, NULL);
+		(void) fr_sbuff_adv_past_blank(sbuff, SIZE_MAX, NULL);
 
 		/*
 		 *	Allow a comma after this item.  But remember
 		 *	if we had a comma.
 		 */
-		if (fr_sbuff_next_if_char(&sbuff, ',')) {
+		if (fr_sbuff_next_if_char(sbuff, ',')) {
 			comma = true;
 			goto check_item;
 		}
@@ -472,17 +496,17 @@ check_item:
 		 *	If there IS stuff before the LF, then it's
 		 *	unknown text.
 		 */
-		if (fr_sbuff_next_if_char(&sbuff, '#')) {
-			(void) fr_sbuff_adv_to_chr(&sbuff, SIZE_MAX, '\n');
+		if (fr_sbuff_next_if_char(sbuff, '#')) {
+			(void) fr_sbuff_adv_to_chr(sbuff, SIZE_MAX, '\n');
 		}
 	check_item_end:
-		if (fr_sbuff_next_if_char(&sbuff, '\n')) {
+		if (fr_sbuff_next_if_char(sbuff, '\n')) {
 			/*
 			 *	The check item list ended with a comma.
 			 *	That's bad.
 			 */
 			if (comma) {
-				ERROR_MARKER(&sbuff, "Invalid comma ending the check item list");
+				ERROR_MARKER(sbuff, "Invalid comma ending the check item list");
 				goto fail_entry;
 			}
 
@@ -494,8 +518,8 @@ check_item:
 		 *	We didn't see SPACE LF or SPACE COMMENT LF.
 		 *	There's something else going on.
 		 */
-		if (fr_sbuff_adv_to_chr(&sbuff, SIZE_MAX, '\n') != NULL) {
-			ERROR_MARKER(&sbuff, "Unexpected text after check item");
+		if (fr_sbuff_adv_to_chr(sbuff, SIZE_MAX, '\n') != NULL) {
+			ERROR_MARKER(sbuff, "Unexpected text after check item");
 			goto fail_entry;
 		}
 
@@ -504,9 +528,8 @@ check_item:
 		 *	skipped to LF above.  So, by process
 		 *	of elimination, we must be at EOF.
 		 */
-		if (!fr_sbuff_is_char(&sbuff, '\n')) {
-		add_entry:
-			fr_dlist_insert_tail(&list->head, &t);
+		if (!fr_sbuff_is_char(sbuff, '\n')) {
+			if (pairlist_entry_add(rctx, t, &m) < 0) goto fail;
 			break;
 		}
 
@@ -524,7 +547,7 @@ reply_item:
 		 *	it to the list, and go back to reading the
 		 *	user name or $INCLUDE.
 		 */
-		if (fr_sbuff_adv_past_blank(&sbuff, SIZE_MAX, NULL) == 0) {
+		if (fr_sbuff_adv_past_blank(sbuff, SIZE_MAX, NULL) == 0) {
 			if (comma) {
 				ERROR("%s[%d]: Unexpected trailing comma in previous line", file, lineno);
 				goto fail_entry;
@@ -539,7 +562,7 @@ reply_item:
 			 *	the middle of the reply item list.  Oh
 			 *	well.
 			 */
-			fr_dlist_insert_tail(&list->head, t);
+			if (pairlist_entry_add(rctx, t, &m) < 0) goto fail;
 			continue;
 
 		} else if (lineno == (t->lineno + 1)) {
@@ -554,12 +577,13 @@ reply_item:
 		 *	SPACES COMMENT or SPACES LF means "end of
 		 *	reply item list"
 		 */
-		if (fr_sbuff_is_char(&sbuff, '#')) {
-			(void) fr_sbuff_adv_to_chr(&sbuff, SIZE_MAX, '\n');
+		if (fr_sbuff_is_char(sbuff, '#')) {
+			(void) fr_sbuff_adv_to_chr(sbuff, SIZE_MAX, '\n');
 		}
-		if (fr_sbuff_next_if_char(&sbuff, '\n')) {
+		if (fr_sbuff_next_if_char(sbuff, '\n')) {
 			lineno++;
-			goto add_entry;
+			if (pairlist_entry_add(rctx, t, &m) < 0) goto fail;
+			continue;
 		}
 
 next_reply_item:
@@ -569,11 +593,11 @@ next_reply_item:
 		 *	lead to here have already checked for those
 		 *	cases.
 		 */
-		slen = map_afrom_substr(t, &new_map, &relative_map, &sbuff, map_assignment_op_table, map_assignment_op_table_len,
+		slen = map_afrom_substr(t, &new_map, &relative_map, sbuff, map_assignment_op_table, map_assignment_op_table_len,
 				       &lhs_rules, &rhs_rules, &rhs_term);
 		if (!new_map) {
-			ERROR_MARKER_ADJ(&sbuff, slen, fr_strerror());
-			goto fail;
+			ERROR_MARKER_ADJ(sbuff, slen, fr_strerror());
+			goto fail_entry;
 		}
 
 		fr_assert(new_map->lhs != NULL);
@@ -600,15 +624,15 @@ next_reply_item:
 
 		if (!new_map->parent) map_list_insert_tail(&t->reply, new_map);
 
-		(void) fr_sbuff_adv_past_blank(&sbuff, SIZE_MAX, NULL);
+		(void) fr_sbuff_adv_past_blank(sbuff, SIZE_MAX, NULL);
 
 		/*
 		 *	Commas separate entries on the same line.  And
 		 *	we allow spaces after commas, too.
 		 */
-		if (fr_sbuff_next_if_char(&sbuff, ',')) {
+		if (fr_sbuff_next_if_char(sbuff, ',')) {
 			comma = true;
-			(void) fr_sbuff_adv_past_blank(&sbuff, SIZE_MAX, NULL);
+			(void) fr_sbuff_adv_past_blank(sbuff, SIZE_MAX, NULL);
 		} else {
 			comma = false;
 		}
@@ -619,11 +643,11 @@ next_reply_item:
 		 *	Reading the next line will cause a complaint
 		 *	if this line ended with a comma.
 		 */
-		if (fr_sbuff_next_if_char(&sbuff, '#')) {
-			(void) fr_sbuff_adv_to_chr(&sbuff, SIZE_MAX, '\n');
+		if (fr_sbuff_next_if_char(sbuff, '#')) {
+			(void) fr_sbuff_adv_to_chr(sbuff, SIZE_MAX, '\n');
 		}
 
-		if (fr_sbuff_next_if_char(&sbuff, '\n')) {
+		if (fr_sbuff_next_if_char(sbuff, '\n')) {
 			lineno++;
 			goto reply_item;
 		}
@@ -634,7 +658,7 @@ next_reply_item:
 		 */
 		if (comma) goto next_reply_item;
 
-		ERROR_MARKER(&sbuff, "Unexpected text after reply");
+		ERROR_MARKER(sbuff, "Unexpected text after reply");
 		goto fail_entry;
 	}
 
@@ -642,8 +666,158 @@ next_reply_item:
 	 *	Else we were looking for an entry.  We didn't get one
 	 *	because we were at EOF, so that's OK.
 	 */
+	return 0;
+}
 
+static int pairlist_read_file(pairlist_read_t *rctx, char const *file, bool complain)
+{
+	FILE			*fp;
+	fr_sbuff_t		sbuff;
+	fr_sbuff_uctx_file_t	fctx;
+	char			buffer[8192];
+	int			ret;
+
+	DEBUG2("Reading file %s", file);
+
+	/*
+	 *	Open the file.  The error message should be a little
+	 *	more useful...
+	 */
+	if ((fp = fopen(file, "r")) == NULL) {
+		if (!complain) return -1;
+
+		ERROR("Couldn't open %s for reading: %s", file, fr_syserror(errno));
+		return -1;
+	}
+
+	fr_sbuff_init_file(&sbuff, &fctx, buffer, sizeof(buffer), fp, SIZE_MAX);
+
+	ret = pairlist_read_sbuff(rctx, &sbuff, file, 1);
 	fclose(fp);
 
-	return 0;
+	return ret;
+}
+
+/*
+ *	Read the users file. Return a PAIR_LIST.
+ */
+int pairlist_read(TALLOC_CTX *ctx, fr_dict_t const *dict, char const *file, PAIR_LIST_LIST *list, int complain)
+{
+	pairlist_read_t rctx = {
+		.ctx = ctx,
+		.dict = dict,
+		.list = list
+	};
+
+	return pairlist_read_file(&rctx, file, complain);
+}
+
+/** Read the users file, passing each entry to a callback instead of building a list
+ *
+ * Only one entry is held in memory at a time, so this can be used to check,
+ * or convert, files which are too large to hold in memory as PAIR_LISTs.
+ *
+ * @note Each entry (including its reply lines) must fit in an 8k buffer.
+ *
+ * @param[in] ctx	to allocate entries in.
+ * @param[in] dict	to resolve attributes in.
+ * @param[in] file	to read.
+ * @param[in] func	called with each entry, and the text it was parsed from.
+ *			The entry is freed when the callback returns.
+ * @param[in] uctx	passed to func.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure, or if the callback returned < 0.
+ */
+int pairlist_read_foreach(TALLOC_CTX *ctx, fr_dict_t const *dict, char const *file,
+			  pairlist_entry_func_t func, void *uctx)
+{
+	pairlist_read_t rctx = {
+		.ctx = ctx,
+		.dict = dict,
+		.func = func,
+		.uctx = uctx
+	};
+
+	return pairlist_read_file(&rctx, file, true);
+}
+
+/** Parse entries from a string, for use by a single request
+ *
+ * Any xlats are instantiated as ephemeral xlats, which are freed along with
+ * the entries.
+ *
+ * @param[in] ctx	to allocate entries in.
+ * @param[in] dict	to resolve attributes in.
+ * @param[in] el	for ephemeral xlats.
+ * @param[in] file	the text was originally read from.
+ * @param[in] lineno	of the start of the text in the original file.
+ * @param[in] in	text to parse.
+ * @param[in] inlen	length of the text.
+ * @param[out] list	to add the entries to.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int pairlist_read_str(TALLOC_CTX *ctx, fr_dict_t const *dict, fr_event_list_t *el,
+		      char const *file, int lineno, char const *in, size_t inlen, PAIR_LIST_LIST *list)
+{
+	pairlist_read_t rctx = {
+		.ctx = ctx,
+		.dict = dict,
+		.runtime_el = el,
+		.list = list
+	};
+
+	return pairlist_read_sbuff(&rctx, &FR_SBUFF_IN(in, inlen), file, lineno);
+}
+
+static bool map_contains_func(map_t const *map)
+{
+	tmpl_t const *vpt = map->rhs;
+
+	if (!vpt || !tmpl_contains_xlat(vpt)) return false;
+
+	if (tmpl_needs_resolving(vpt) || !tmpl_xlat(vpt)) return true;
+
+	return xlat_contains_func(tmpl_xlat(vpt));
+}
+
+/** Check that entries can be used if they're loaded after the server has started
+ *
+ * Calls to xlat functions have instance data which is only created
+ * when the server starts.  Entries containing them can't be reloaded.
+ *
+ * @param[in] list	to check.
+ * @return
+ *	- 0 if all entries can be used.
+ *	- -1 if one or more entries call xlat functions.
+ */
+int pairlist_check_reload(PAIR_LIST_LIST const *list)
+{
+	PAIR_LIST const	*entry = NULL;
+	int		ret = 0;
+
+	while ((entry = fr_dlist_next(&list->head, entry))) {
+		map_t const *map = NULL;
+
+		while ((map = map_list_next(&entry->check, map))) {
+			if (!map_contains_func(map)) continue;
+
+			ERROR("%s[%d]: Check item %s calls a function, and can only be loaded at startup",
+			      entry->filename, entry->lineno, map->lhs->name);
+			ret = -1;
+		}
+
+		map = NULL;
+		while ((map = map_list_next(&entry->reply, map))) {
+			if (!map_contains_func(map)) continue;
+
+			ERROR("%s[%d]: Reply item %s calls a function, and can only be loaded at startup",
+			      entry->filename, entry->lineno, map->lhs->name);
+			ret = -1;
+		}
+	}
+
+	return ret;
 }
@@ -32,6 +32,7 @@ extern "C" {
 #endif
 
 #include <freeradius-devel/server/map.h>
+#include <freeradius-devel/util/event.h>
 #include <freeradius-devel/util/pair.h>
 #include <freeradius-devel/util/talloc.h>
 
@@ -51,9 +52,26 @@ typedef struct pair_list_list {
 	fr_value_box_t		*box;		//!< parsed version of "name".
 } PAIR_LIST_LIST;
 
+/** Called with each entry read by #pairlist_read_foreach
+ *
+ * @param[in] entry	which was parsed.
+ * @param[in] text	of the entry, as it appears in the file.
+ * @param[in] len	of the text.
+ * @param[in] uctx	passed to #pairlist_read_foreach.
+ * @return
+ *	- 0 to continue reading.
+ *	- -1 to stop, and return an error.
+ */
+typedef int (*pairlist_entry_func_t)(PAIR_LIST const *entry, char const *text, size_t len, void *uctx);
+
 /* users_file.c */
 int		pairlist_read(TALLOC_CTX *ctx, fr_dict_t const *dict, char const *file, PAIR_LIST_LIST *list, int complain);
+int		pairlist_read_foreach(TALLOC_CTX *ctx, fr_dict_t const *dict, char const *file,
+				      pairlist_entry_func_t func, void *uctx);
+int		pairlist_read_str(TALLOC_CTX *ctx, fr_dict_t const *dict, fr_event_list_t *el,
+				  char const *file, int lineno, char const *in, size_t inlen, PAIR_LIST_LIST *list);
 void		pairlist_free(PAIR_LIST_LIST *);
+int		pairlist_check_reload(PAIR_LIST_LIST const *list);
 
 static inline void pairlist_list_init(PAIR_LIST_LIST *list)
 {
@@ -0,0 +1,655 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file src/lib/server/users_file_image.c
+ * @brief Compiled, memory mapped, users files.
+ *
+ * Parsing a users file with millions of entries takes a long time, and the
+ * resulting PAIR_LISTs use far more memory than the file itself.
+ *
+ * An image holds the text of each entry, a sorted index of entry names, and
+ * nothing else.  The server maps it read only, so the pages are shared
+ * between processes, and only parses the entries which match a request.
+ *
+ * Each worker keeps the entries it has parsed in a #pairlist_image_cache_t,
+ * so entries for frequently seen keys are only parsed once per thread.
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/server/log.h>
+#include <freeradius-devel/server/users_file_image.h>
+#include <freeradius-devel/util/debug.h>
+#include <freeradius-devel/util/dlist.h>
+#include <freeradius-devel/util/rb.h>
+#include <freeradius-devel/util/syserror.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+#else
+#  include <freeradius-devel/util/stdatomic.h>
+#endif
+
+struct pairlist_image_s {
+	uint64_t			id;		//!< Unique to this mapping, so cached entries
+							///< from an image which was replaced are never used.
+	char const			*file;		//!< The image was read from.
+	uint8_t const			*base;		//!< Start of the mapping.
+	size_t				size;		//!< Of the mapping.
+
+	pairlist_image_hdr_t const	*hdr;
+	pairlist_image_key_t const	*keys;
+	pairlist_image_entry_t const	*entries;
+};
+
+/** An entry being added to an image
+ *
+ */
+typedef struct {
+	char const			*name;		//!< Only valid once all the text has been read.
+	uint64_t			name_off;	//!< Offset of the name in the text.
+	uint32_t			name_len;
+	pairlist_image_entry_t		entry;
+} pairlist_image_build_entry_t;
+
+typedef struct {
+	char				*text;		//!< Header, names, filenames and entry text.
+	size_t				text_len;	//!< How much of text is used.
+
+	pairlist_image_build_entry_t	*entries;
+	size_t				num_entries;
+
+	char const			*filename;	//!< Of the last entry.
+	uint64_t			filename_off;	//!< Where it was written.
+} pairlist_image_build_t;
+
+/** Entries parsed from an image
+ *
+ */
+typedef struct {
+	fr_rb_node_t			node;		//!< Entry in the cache's tree.
+	fr_dlist_t			entry;		//!< Entry in the LRU list.
+	uint64_t			image_id;	//!< Image the entries were parsed from.
+	uint32_t			index;		//!< Of the key in the image.
+	PAIR_LIST_LIST			list;		//!< The parsed entries.
+} pairlist_image_cache_entry_t;
+
+struct pairlist_image_cache_s {
+	fr_dict_t const			*dict;		//!< To parse entries with.
+	fr_event_list_t			*el;		//!< For ephemeral xlats.
+	uint32_t			max;		//!< Maximum number of keys to keep entries for.
+
+	pairlist_image_fixup_t		fixup;		//!< Called for each entry parsed.
+	void				*uctx;		//!< Passed to fixup.
+
+	fr_rb_tree_t			*tree;		//!< Cached entries, by image and key.
+	fr_dlist_head_t			lru;		//!< Most recently used first.
+};
+
+static _Atomic(uint64_t)		image_id;	//!< Last id given to an image.
+
+#define IMAGE_ALIGN(_x)	(((_x) + 7) & ~((uint64_t) 7))
+
+/** Append data to the text of the image
+ *
+ * @return the offset the data was written at.
+ */
+static uint64_t image_text_append(pairlist_image_build_t *build, void const *data, size_t len)
+{
+	uint64_t off = build->text_len;
+	size_t	 size = talloc_array_length(build->text);
+
+	if ((build->text_len + len) > size) {
+		while ((build->text_len + len) > size) size *= 2;
+		MEM(build->text = talloc_realloc(NULL, build->text, char, size));
+	}
+
+	memcpy(build->text + build->text_len, data, len);
+	build->text_len += len;
+
+	return off;
+}
+
+static int _image_build_entry(PAIR_LIST const *entry, char const *text, size_t len, void *uctx)
+{
+	pairlist_image_build_t		*build = uctx;
+	pairlist_image_build_entry_t	*e;
+	size_t				name_len = strlen(entry->name);
+
+	if ((len > UINT32_MAX) || (name_len > UINT32_MAX) || (build->num_entries >= UINT32_MAX)) {
+		ERROR("%s[%d]: Entry is too large", entry->filename, entry->lineno);
+		return -1;
+	}
+
+	if (build->num_entries == talloc_array_length(build->entries)) {
+		MEM(build->entries = talloc_realloc(NULL, build->entries, pairlist_image_build_entry_t,
+						    build->num_entries * 2));
+	}
+	e = &build->entries[build->num_entries++];
+
+	/*
+	 *	Entries from the same file share the same filename
+	 *	string, so only write it once per run of entries.
+	 */
+	if (!build->filename || (strcmp(build->filename, entry->filename) != 0)) {
+		build->filename = entry->filename;
+		build->filename_off = image_text_append(build, entry->filename, strlen(entry->filename) + 1);
+	}
+
+	*e = (pairlist_image_build_entry_t) {
+		.name_off = image_text_append(build, entry->name, name_len),
+		.name_len = name_len,
+		.entry = {
+			.filename = build->filename_off,
+			.text_len = len,
+			.lineno = entry->lineno,
+			.order = entry->order
+		}
+	};
+	e->entry.text = image_text_append(build, text, len);
+
+	return 0;
+}
+
+static int image_build_entry_cmp(void const *one, void const *two)
+{
+	pairlist_image_build_entry_t const *a = one, *b = two;
+	int ret;
+
+	ret = memcmp(a->name, b->name, (a->name_len < b->name_len) ? a->name_len : b->name_len);
+	if (ret != 0) return ret;
+
+	ret = CMP(a->name_len, b->name_len);
+	if (ret != 0) return ret;
+
+	return CMP(a->entry.order, b->entry.order);
+}
+
+static int image_write_all(int fd, void const *data, size_t len)
+{
+	uint8_t const	*p = data;
+	ssize_t		slen;
+
+	while (len > 0) {
+		slen = write(fd, p, len);
+		if (slen < 0) {
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		p += slen;
+		len -= slen;
+	}
+
+	return 0;
+}
+
+/** Compile a users file into an image
+ *
+ * The image is written to a temporary file, and renamed into place, so a
+ * server which is using the old image continues to see a consistent copy.
+ *
+ * @param[in] dict		to parse the users file with.
+ * @param[in] users_file	to compile.
+ * @param[in] image_file	to write.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int pairlist_image_write(fr_dict_t const *dict, char const *users_file, char const *image_file)
+{
+	TALLOC_CTX			*ctx;
+	pairlist_image_build_t		build = { 0 };
+	pairlist_image_hdr_t		hdr = { .magic = PAIRLIST_IMAGE_MAGIC, .version = PAIRLIST_IMAGE_VERSION };
+	pairlist_image_key_t		*keys;
+	pairlist_image_entry_t		*entries;
+	uint8_t const			pad[8] = { 0 };
+	size_t				i, num_keys = 0;
+	char				*tmp;
+	int				fd, ret = -1;
+
+	MEM(ctx = talloc_init_const("pairlist_image_write"));
+	MEM(build.text = talloc_array(NULL, char, 1024 * 1024));
+	MEM(build.entries = talloc_array(NULL, pairlist_image_build_entry_t, 1024));
+
+	/*
+	 *	The header is filled in at the end.
+	 */
+	(void) image_text_append(&build, &hdr, sizeof(hdr));
+
+	if (pairlist_read_foreach(ctx, dict, users_file, _image_build_entry, &build) < 0) goto done;
+
+	/*
+	 *	Group the entries by name, in the order they appear in
+	 *	the file.  The text won't move any more, so the names
+	 *	can be compared directly.
+	 */
+	for (i = 0; i < build.num_entries; i++) build.entries[i].name = build.text + build.entries[i].name_off;
+	if (build.num_entries > 0) qsort(build.entries, build.num_entries, sizeof(build.entries[0]), image_build_entry_cmp);
+
+	MEM(keys = talloc_array(ctx, pairlist_image_key_t, build.num_entries));
+	MEM(entries = talloc_array(ctx, pairlist_image_entry_t, build.num_entries));
+
+	for (i = 0; i < build.num_entries; i++) {
+		pairlist_image_build_entry_t const *e = &build.entries[i];
+
+		entries[i] = e->entry;
+
+		if ((num_keys > 0) && (keys[num_keys - 1].name_len == e->name_len) &&
+		    (memcmp(build.text + keys[num_keys - 1].name, e->name, e->name_len) == 0)) {
+			keys[num_keys - 1].num++;
+			continue;
+		}
+
+		keys[num_keys++] = (pairlist_image_key_t) {
+			.name = e->name_off,
+			.name_len = e->name_len,
+			.first = i,
+			.num = 1
+		};
+	}
+
+	hdr.num_keys = num_keys;
+	hdr.num_entries = build.num_entries;
+	hdr.entries = IMAGE_ALIGN(build.text_len);
+	hdr.keys = hdr.entries + (sizeof(entries[0]) * build.num_entries);
+	hdr.size = hdr.keys + (sizeof(keys[0]) * num_keys);
+	memcpy(build.text, &hdr, sizeof(hdr));
+
+	MEM(tmp = talloc_asprintf(ctx, "%s.tmp", image_file));
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		ERROR("Failed creating %s: %s", tmp, fr_syserror(errno));
+		goto done;
+	}
+
+	if ((image_write_all(fd, build.text, build.text_len) < 0) ||
+	    (image_write_all(fd, pad, hdr.entries - build.text_len) < 0) ||
+	    (image_write_all(fd, entries, sizeof(entries[0]) * build.num_entries) < 0) ||
+	    (image_write_all(fd, keys, sizeof(keys[0]) * num_keys) < 0) ||
+	    (fsync(fd) < 0)) {
+		ERROR("Failed writing %s: %s", tmp, fr_syserror(errno));
+		close(fd);
+		unlink(tmp);
+		goto done;
+	}
+	close(fd);
+
+	if (rename(tmp, image_file) < 0) {
+		ERROR("Failed renaming %s to %s: %s", tmp, image_file, fr_syserror(errno));
+		unlink(tmp);
+		goto done;
+	}
+
+	INFO("Wrote %zu entries, with %zu distinct names, to %s", build.num_entries, num_keys, image_file);
+	ret = 0;
+
+done:
+	talloc_free(build.text);
+	talloc_free(build.entries);
+	talloc_free(ctx);
+
+	return ret;
+}
+
+/** Check whether a file is an image, rather than a text users file
+ *
+ * @param[in] file	to check.
+ * @return true if the file starts with the image magic.
+ */
+bool pairlist_image_check(char const *file)
+{
+	char	magic[sizeof(PAIRLIST_IMAGE_MAGIC)];
+	int	fd;
+	bool	ret;
+
+	fd = open(file, O_RDONLY);
+	if (fd < 0) return false;
+
+	ret = (read(fd, magic, sizeof(magic)) == sizeof(magic)) &&
+	      (memcmp(magic, PAIRLIST_IMAGE_MAGIC, sizeof(magic)) == 0);
+	close(fd);
+
+	return ret;
+}
+
+static int _pairlist_image_free(pairlist_image_t *image)
+{
+	if (image->base) munmap(UNCONST(uint8_t *, image->base), image->size);
+
+	return 0;
+}
+
+/** Map an image, and check that all of its offsets are in bounds
+ *
+ * Lookups don't check offsets, so an image is validated in full before
+ * it's used.
+ *
+ * @param[in] ctx	to allocate the image handle in.
+ * @param[in] file	to map.
+ * @return
+ *	- The image.
+ *	- NULL on error.
+ */
+pairlist_image_t *pairlist_image_open(TALLOC_CTX *ctx, char const *file)
+{
+	pairlist_image_t		*image;
+	pairlist_image_hdr_t const	*hdr;
+	struct stat			st;
+	void				*base;
+	uint32_t			i;
+	int				fd;
+
+	fd = open(file, O_RDONLY);
+	if (fd < 0) {
+		ERROR("Couldn't open %s for reading: %s", file, fr_syserror(errno));
+		return NULL;
+	}
+
+	if (fstat(fd, &st) < 0) {
+		ERROR("Failed examining %s: %s", file, fr_syserror(errno));
+		close(fd);
+		return NULL;
+	}
+
+	if ((size_t) st.st_size < sizeof(*hdr)) {
+		ERROR("%s is too short to be a compiled users file", file);
+		close(fd);
+		return NULL;
+	}
+
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) {
+		ERROR("Failed mapping %s: %s", file, fr_syserror(errno));
+		return NULL;
+	}
+
+	MEM(image = talloc_zero(ctx, pairlist_image_t));
+	image->id = atomic_fetch_add(&image_id, 1) + 1;
+	image->file = talloc_strdup(image, file);
+	image->base = base;
+	image->size = st.st_size;
+	talloc_set_destructor(image, _pairlist_image_free);
+
+	hdr = image->hdr = base;
+
+#define IN_IMAGE(_off, _len) (((_off) <= image->size) && ((_len) <= (image->size - (_off))))
+
+	if (memcmp(hdr->magic, PAIRLIST_IMAGE_MAGIC, sizeof(hdr->magic)) != 0) {
+		ERROR("%s is not a compiled users file", file);
+	error:
+		talloc_free(image);
+		return NULL;
+	}
+
+	if (hdr->version != PAIRLIST_IMAGE_VERSION) {
+		ERROR("%s has version %u, expected version %u.  Recompile it",
+		      file, hdr->version, PAIRLIST_IMAGE_VERSION);
+		goto error;
+	}
+
+	if ((hdr->size != image->size) ||
+	    (hdr->keys & 7) || (hdr->entries & 7) ||
+	    !IN_IMAGE(hdr->keys, (uint64_t) hdr->num_keys * sizeof(pairlist_image_key_t)) ||
+	    !IN_IMAGE(hdr->entries, (uint64_t) hdr->num_entries * sizeof(pairlist_image_entry_t))) {
+	truncated:
+		ERROR("%s is truncated or corrupt.  Recompile it", file);
+		goto error;
+	}
+
+	image->keys = (pairlist_image_key_t const *) (image->base + hdr->keys);
+	image->entries = (pairlist_image_entry_t const *) (image->base + hdr->entries);
+
+	for (i = 0; i < hdr->num_keys; i++) {
+		pairlist_image_key_t const *key = &image->keys[i];
+
+		if (!IN_IMAGE(key->name, key->name_len) ||
+		    (key->first > hdr->num_entries) || (key->num > (hdr->num_entries - key->first))) goto truncated;
+	}
+
+	for (i = 0; i < hdr->num_entries; i++) {
+		pairlist_image_entry_t const *entry = &image->entries[i];
+
+		if (!IN_IMAGE(entry->text, entry->text_len) || (entry->filename >= image->size) ||
+		    !memchr(image->base + entry->filename, '\0', image->size - entry->filename)) goto truncated;
+	}
+
+	DEBUG2("Mapped %s, %u entries, with %u distinct names", file, hdr->num_entries, hdr->num_keys);
+
+	return image;
+}
+
+/** Return the number of entries in an image
+ *
+ */
+uint32_t pairlist_image_num_entries(pairlist_image_t const *image)
+{
+	return image->hdr->num_entries;
+}
+
+/** Find the entries with a particular name
+ *
+ * @param[in] image	to search.
+ * @param[in] name	to search for.
+ * @param[in] len	of the name.
+ * @return
+ *	- The key, which can be passed to #pairlist_image_read.
+ *	- NULL if there are no entries with that name.
+ */
+pairlist_image_key_t const *pairlist_image_find(pairlist_image_t const *image, char const *name, size_t len)
+{
+	uint32_t lo = 0, hi = image->hdr->num_keys;
+
+	while (lo < hi) {
+		uint32_t			mid = lo + ((hi - lo) / 2);
+		pairlist_image_key_t const	*key = &image->keys[mid];
+		int				ret;
+
+		ret = memcmp(image->base + key->name, name, (key->name_len < len) ? key->name_len : len);
+		if (ret == 0) ret = CMP(key->name_len, len);
+
+		if (ret == 0) return key;
+		if (ret < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return NULL;
+}
+
+/** Parse the entries with a particular name
+ *
+ * @param[in] ctx	to allocate the entries in.
+ * @param[in] dict	to resolve attributes in.  Should be the dictionary the image was compiled with.
+ * @param[in] el	if the entries are only for one request.  Any xlats are then instantiated as
+ *			ephemeral xlats.  NULL if the entries are being read at startup.
+ * @param[in] image	containing the entries.
+ * @param[in] key	returned by #pairlist_image_find.
+ * @param[out] list	to add the entries to.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int pairlist_image_read(TALLOC_CTX *ctx, fr_dict_t const *dict, fr_event_list_t *el,
+			pairlist_image_t const *image, pairlist_image_key_t const *key, PAIR_LIST_LIST *list)
+{
+	uint32_t i;
+
+	for (i = key->first; i < (key->first + key->num); i++) {
+		pairlist_image_entry_t const	*entry = &image->entries[i];
+		PAIR_LIST			*t;
+
+		if (pairlist_read_str(ctx, dict, el, (char const *) image->base + entry->filename, entry->lineno,
+				      (char const *) image->base + entry->text, entry->text_len, list) < 0) {
+			ERROR("Failed parsing entry from %s", image->file);
+			return -1;
+		}
+
+		/*
+		 *	So the entries are merged with DEFAULT
+		 *	entries in the right order.
+		 */
+		t = fr_dlist_tail(&list->head);
+		if (t) t->order = entry->order;
+	}
+
+	return 0;
+}
+
+static int8_t image_cache_entry_cmp(void const *one, void const *two)
+{
+	pairlist_image_cache_entry_t const *a = one, *b = two;
+	int8_t ret;
+
+	ret = CMP(a->image_id, b->image_id);
+	if (ret != 0) return ret;
+
+	return CMP(a->index, b->index);
+}
+
+static int _image_cache_entry_free(pairlist_image_cache_entry_t *ce)
+{
+	pairlist_image_cache_t *cache = talloc_parent(ce);
+
+	fr_dlist_remove(&cache->lru, ce);
+	if (fr_rb_node_inline_in_tree(&ce->node)) fr_rb_remove(cache->tree, ce);
+
+	return 0;
+}
+
+static int _image_cache_free(pairlist_image_cache_t *cache)
+{
+	pairlist_image_cache_entry_t *ce;
+
+	while ((ce = fr_dlist_head(&cache->lru))) talloc_free(ce);
+
+	return 0;
+}
+
+/** Allocate a cache of entries parsed from images
+ *
+ * The cache isn't thread safe, and must only be used by the thread
+ * which owns el.
+ *
+ * @param[in] ctx	to allocate the cache in.
+ * @param[in] dict	to resolve attributes in.
+ * @param[in] el	of the thread the cache belongs to.  Used for ephemeral xlats.
+ * @param[in] max	maximum number of keys to keep entries for.  The least recently used
+ *			are freed when it's reached.
+ * @param[in] fixup	called for each entry once it's parsed.  May be NULL.
+ * @param[in] uctx	passed to fixup.
+ * @return the new cache.
+ */
+pairlist_image_cache_t *pairlist_image_cache_alloc(TALLOC_CTX *ctx, fr_dict_t const *dict,
+						   fr_event_list_t *el, uint32_t max,
+						   pairlist_image_fixup_t fixup, void *uctx)
+{
+	pairlist_image_cache_t *cache;
+
+	fr_assert(max > 0);
+
+	MEM(cache = talloc_zero(ctx, pairlist_image_cache_t));
+	*cache = (pairlist_image_cache_t) {
+		.dict = dict,
+		.el = el,
+		.max = max,
+		.fixup = fixup,
+		.uctx = uctx
+	};
+	MEM(cache->tree = fr_rb_inline_alloc(cache, pairlist_image_cache_entry_t, node,
+					     image_cache_entry_cmp, NULL));
+	fr_dlist_talloc_init(&cache->lru, pairlist_image_cache_entry_t, entry);
+	talloc_set_destructor(cache, _image_cache_free);
+
+	return cache;
+}
+
+/** Find the parsed entries with a particular name, parsing them if needed
+ *
+ * The entries remain valid until the next call to this function, or
+ * until the cache is freed.
+ *
+ * @param[in] cache	to search.
+ * @param[in] image	containing the entries.
+ * @param[in] key	returned by #pairlist_image_find.
+ * @return
+ *	- The parsed entries.
+ *	- NULL if the entries couldn't be parsed.
+ */
+PAIR_LIST_LIST const *pairlist_image_cache_find(pairlist_image_cache_t *cache, pairlist_image_t const *image,
+						 pairlist_image_key_t const *key)
+{
+	pairlist_image_cache_entry_t	*ce, find;
+	PAIR_LIST			*entry = NULL;
+
+	find = (pairlist_image_cache_entry_t) {
+		.image_id = image->id,
+		.index = key - image->keys
+	};
+
+	ce = fr_rb_find(cache->tree, &find);
+	if (ce) {
+		fr_dlist_remove(&cache->lru, ce);
+		fr_dlist_insert_head(&cache->lru, ce);
+		return &ce->list;
+	}
+
+	/*
+	 *	Make room.  Entries from images which have been
+	 *	replaced are never used again, so they drift to
+	 *	the tail, and are freed first.
+	 */
+	while (fr_rb_num_elements(cache->tree) >= cache->max) talloc_free(fr_dlist_tail(&cache->lru));
+
+	MEM(ce = talloc_zero(cache, pairlist_image_cache_entry_t));
+	ce->image_id = find.image_id;
+	ce->index = find.index;
+	pairlist_list_init(&ce->list);
+
+	if (pairlist_image_read(ce, cache->dict, cache->el, image, key, &ce->list) < 0) {
+	error:
+		talloc_free(ce);
+		return NULL;
+	}
+
+	if (cache->fixup) while ((entry = fr_dlist_next(&ce->list.head, entry))) {
+		if (cache->fixup(entry, cache->uctx) < 0) goto error;
+	}
+
+	fr_rb_insert(cache->tree, ce);
+	fr_dlist_insert_head(&cache->lru, ce);
+	talloc_set_destructor(ce, _image_cache_entry_free);
+
+	return &ce->list;
+}
+
+/** Return how many keys a cache holds entries for
+ *
+ */
+uint32_t pairlist_image_cache_num(pairlist_image_cache_t const *cache)
+{
+	return fr_rb_num_elements(cache->tree);
+}
@@ -0,0 +1,129 @@
+#pragma once
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file lib/server/users_file_image.h
+ * @brief Compiled, memory mapped, users files.
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+RCSIDH(users_file_image_h, "$Id$")
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <freeradius-devel/server/users_file.h>
+
+#include <stdint.h>
+
+/** Identifies a compiled users file
+ *
+ * Text users files can't contain a NUL byte, so there's no chance
+ * of a text file being mistaken for an image.
+ */
+#define PAIRLIST_IMAGE_MAGIC	"FRUSERS"
+#define PAIRLIST_IMAGE_VERSION	1
+
+/** Header at the start of an image
+ *
+ * All offsets are from the start of the image.  Integers are in host
+ * byte order, images should be compiled on the same architecture as
+ * the server which uses them.
+ */
+typedef struct {
+	char		magic[8];		//!< #PAIRLIST_IMAGE_MAGIC, including the trailing NUL.
+	uint32_t	version;		//!< #PAIRLIST_IMAGE_VERSION.
+	uint32_t	num_keys;		//!< Number of distinct entry names.
+	uint32_t	num_entries;		//!< Number of entries, including DEFAULT entries.
+	uint32_t	pad;
+	uint64_t	keys;			//!< Offset of the key index, sorted by name.
+	uint64_t	entries;		//!< Offset of the entries, grouped by name, in file order.
+	uint64_t	size;			//!< Total size of the image.
+} pairlist_image_hdr_t;
+
+/** An entry name, and the entries which have it
+ *
+ */
+typedef struct {
+	uint64_t	name;			//!< Offset of the name (not NUL terminated).
+	uint32_t	name_len;		//!< Length of the name.
+	uint32_t	first;			//!< Index of the first entry with this name.
+	uint32_t	num;			//!< Number of entries with this name.
+	uint32_t	pad;
+} pairlist_image_key_t;
+
+/** One entry, stored as the text it was read from
+ *
+ * The text has already been parsed once by the compiler, so it's
+ * known to be valid for the dictionaries the image was compiled
+ * against.
+ */
+typedef struct {
+	uint64_t	text;			//!< Offset of the entry text.
+	uint64_t	filename;		//!< Offset of the NUL terminated name of the source file.
+	uint32_t	text_len;		//!< Length of the entry text.
+	uint32_t	lineno;			//!< Line the entry started on.
+	uint32_t	order;			//!< Sequence of the entry, across the file and its $INCLUDEs.
+	uint32_t	pad;
+} pairlist_image_entry_t;
+
+typedef struct pairlist_image_s pairlist_image_t;
+
+typedef struct pairlist_image_cache_s pairlist_image_cache_t;
+
+/** Called for each entry parsed into a #pairlist_image_cache_t
+ *
+ * @param[in] entry	which was parsed.
+ * @param[in] uctx	passed to #pairlist_image_cache_alloc.
+ * @return
+ *	- 0 on success.
+ *	- -1 if the entry can't be used.
+ */
+typedef int (*pairlist_image_fixup_t)(PAIR_LIST *entry, void *uctx);
+
+int				pairlist_image_write(fr_dict_t const *dict, char const *users_file, char const *image_file)
+							     CC_HINT(nonnull);
+
+bool				pairlist_image_check(char const *file) CC_HINT(nonnull);
+
+pairlist_image_t		*pairlist_image_open(TALLOC_CTX *ctx, char const *file) CC_HINT(nonnull(2));
+
+uint32_t			pairlist_image_num_entries(pairlist_image_t const *image) CC_HINT(nonnull);
+
+pairlist_image_key_t const	*pairlist_image_find(pairlist_image_t const *image, char const *name, size_t len)
+						     CC_HINT(nonnull);
+
+int				pairlist_image_read(TALLOC_CTX *ctx, fr_dict_t const *dict, fr_event_list_t *el,
+						    pairlist_image_t const *image, pairlist_image_key_t const *key,
+						    PAIR_LIST_LIST *list) CC_HINT(nonnull(1,2,4,5,6));
+
+pairlist_image_cache_t		*pairlist_image_cache_alloc(TALLOC_CTX *ctx, fr_dict_t const *dict,
+							    fr_event_list_t *el, uint32_t max,
+							    pairlist_image_fixup_t fixup, void *uctx)
+							    CC_HINT(nonnull(2,3));
+
+PAIR_LIST_LIST const		*pairlist_image_cache_find(pairlist_image_cache_t *cache, pairlist_image_t const *image,
+							   pairlist_image_key_t const *key) CC_HINT(nonnull);
+
+uint32_t			pairlist_image_cache_num(pairlist_image_cache_t const *cache) CC_HINT(nonnull);
+
+#ifdef __cplusplus
+}
+#endif
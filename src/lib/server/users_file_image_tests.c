@@ -0,0 +1,397 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Tests for compiled users files
+ *
+ * @file src/lib/server/users_file_image_tests.c
+ * @copyright 2026 The FreeRADIUS server project
+ */
+#define USE_CONSTRUCTOR
+
+#ifdef USE_CONSTRUCTOR
+static void test_init(void) __attribute__((constructor));
+#else
+static void test_init(void);
+#  define TEST_INIT  test_init()
+#endif
+
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+
+#include <freeradius-devel/server/users_file_image.h>
+#include <freeradius-devel/util/conf.h>
+#include <freeradius-devel/util/event.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+static TALLOC_CTX	*autofree;
+static fr_dict_t	*test_dict_internal;
+static fr_dict_t	*test_dict_radius;
+static fr_event_list_t	*test_el;
+
+static char		test_users[64];
+static char		test_image[64];
+
+/*
+ *	Entries are out of order, and names are repeated,
+ *	so the index has to group them.
+ */
+static char const	test_users_text[] =
+	"bob\n"
+	"	Framed-MTU := 1500\n"
+	"\n"
+	"DEFAULT\n"
+	"	Session-Timeout := 10\n"
+	"\n"
+	"alice\n"
+	"	Framed-MTU := 1400\n"
+	"\n"
+	"bob\n"
+	"	Session-Timeout := 20\n"
+	"\n"
+	"carol\n"
+	"	Framed-MTU := 1300\n";
+
+/** Global initialisation
+ */
+static void test_init(void)
+{
+	autofree = talloc_autofree_context();
+	if (!autofree) {
+	error:
+		fr_perror("users_file_image_tests");
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	/*
+	 *	Mismatch between the binary and the libraries it depends on
+	 */
+	if (fr_check_lib_magic(RADIUSD_MAGIC_NUMBER) < 0) goto error;
+
+	if (fr_time_start() < 0) goto error;
+
+	if (!fr_dict_global_ctx_init(autofree, false, "share/dictionary")) goto error;
+	if (fr_dict_internal_afrom_file(&test_dict_internal, FR_DICTIONARY_INTERNAL_DIR, __FILE__) < 0) goto error;
+	if (fr_dict_protocol_afrom_file(&test_dict_radius, "radius", NULL, __FILE__) < 0) goto error;
+
+	test_el = fr_event_list_alloc(autofree, NULL, NULL);
+	if (!test_el) goto error;
+
+	snprintf(test_users, sizeof(test_users), "/tmp/users_file_image_tests.%d", (int)getpid());
+	snprintf(test_image, sizeof(test_image), "/tmp/users_file_image_tests.%d.img", (int)getpid());
+}
+
+/** Write the test users file
+ *
+ * Each test creates and removes its own copy, as they may be run in
+ * separate processes.
+ */
+static void test_users_create(void)
+{
+	int fd;
+
+	fd = open(test_users, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	TEST_ASSERT(fd >= 0);
+	TEST_ASSERT(write(fd, test_users_text, sizeof(test_users_text) - 1) == (ssize_t)(sizeof(test_users_text) - 1));
+	close(fd);
+}
+
+static void test_users_remove(void)
+{
+	unlink(test_users);
+	unlink(test_image);
+}
+
+/** Compile the test users file, and map the image
+ *
+ */
+static pairlist_image_t *test_image_open(void)
+{
+	if (pairlist_image_write(test_dict_radius, test_users, test_image) < 0) {
+		fr_perror("users_file_image_tests");
+		return NULL;
+	}
+
+	return pairlist_image_open(autofree, test_image);
+}
+
+/** Read a copy of the image, so it can be damaged
+ *
+ */
+static uint8_t *test_image_load(size_t *len)
+{
+	struct stat	st;
+	uint8_t		*data;
+	int		fd;
+
+	fd = open(test_image, O_RDONLY);
+	if (fd < 0) return NULL;
+
+	if (fstat(fd, &st) < 0) {
+	error:
+		close(fd);
+		return NULL;
+	}
+
+	MEM(data = talloc_array(autofree, uint8_t, st.st_size));
+	if (read(fd, data, st.st_size) != st.st_size) goto error;
+	close(fd);
+
+	*len = st.st_size;
+
+	return data;
+}
+
+static void test_image_save(uint8_t const *data, size_t len)
+{
+	int fd;
+
+	fd = open(test_image, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	TEST_ASSERT(fd >= 0);
+	TEST_CHECK(write(fd, data, len) == (ssize_t)len);
+	close(fd);
+}
+
+static bool test_entry_has_reply(PAIR_LIST const *entry, char const *name)
+{
+	map_t *map = NULL;
+
+	while ((map = map_list_next(&entry->reply, map))) {
+		if (tmpl_is_attr(map->lhs) && (strcmp(tmpl_attr_tail_da(map->lhs)->name, name) == 0)) return true;
+	}
+
+	return false;
+}
+
+/*
+ *	The header describes the entries, and the image is
+ *	recognised by its magic.
+ */
+static void test_compile(void)
+{
+	pairlist_image_t		*image;
+	pairlist_image_hdr_t const	*hdr;
+	uint8_t				*data;
+	size_t				len;
+
+	test_users_create();
+	image = test_image_open();
+	TEST_ASSERT(image != NULL);
+
+	TEST_CHECK(pairlist_image_num_entries(image) == 5);
+	TEST_CHECK(pairlist_image_check(test_image));
+	TEST_CHECK(!pairlist_image_check(test_users));
+	TEST_MSG("Text users files must not be mistaken for images");
+
+	data = test_image_load(&len);
+	TEST_ASSERT(data != NULL);
+
+	hdr = (pairlist_image_hdr_t const *)data;
+	TEST_CHECK(memcmp(hdr->magic, PAIRLIST_IMAGE_MAGIC, sizeof(PAIRLIST_IMAGE_MAGIC)) == 0);
+	TEST_CHECK(hdr->version == PAIRLIST_IMAGE_VERSION);
+	TEST_CHECK(hdr->num_keys == 4);
+	TEST_CHECK(hdr->num_entries == 5);
+	TEST_CHECK(hdr->size == len);
+	TEST_CHECK((hdr->keys & 7) == 0);
+	TEST_CHECK((hdr->entries & 7) == 0);
+
+	talloc_free(data);
+	talloc_free(image);
+	test_users_remove();
+}
+
+/*
+ *	Names are found by binary search, and all entries
+ *	with a name are returned, in file order.
+ */
+static void test_lookup(void)
+{
+	pairlist_image_t		*image;
+	pairlist_image_key_t const	*key;
+	PAIR_LIST_LIST			list;
+	PAIR_LIST			*entry;
+
+	test_users_create();
+	image = test_image_open();
+	TEST_ASSERT(image != NULL);
+
+	TEST_CHECK((key = pairlist_image_find(image, "alice", 5)) != NULL);
+	TEST_CHECK(key && (key->num == 1));
+	TEST_CHECK((key = pairlist_image_find(image, "carol", 5)) != NULL);
+	TEST_CHECK((key = pairlist_image_find(image, "DEFAULT", 7)) != NULL);
+
+	TEST_CHECK(pairlist_image_find(image, "dave", 4) == NULL);
+	TEST_CHECK(pairlist_image_find(image, "bo", 2) == NULL);
+	TEST_MSG("Prefixes of names must not match");
+	TEST_CHECK(pairlist_image_find(image, "bobby", 5) == NULL);
+
+	key = pairlist_image_find(image, "bob", 3);
+	TEST_ASSERT(key != NULL);
+	TEST_CHECK(key->num == 2);
+
+	pairlist_list_init(&list);
+	TEST_CHECK(pairlist_image_read(autofree, test_dict_radius, NULL, image, key, &list) == 0);
+	TEST_ASSERT(fr_dlist_num_elements(&list.head) == 2);
+
+	entry = fr_dlist_head(&list.head);
+	TEST_CHECK(strcmp(entry->name, "bob") == 0);
+	TEST_CHECK(entry->lineno == 1);
+	TEST_CHECK(test_entry_has_reply(entry, "Framed-MTU"));
+
+	entry = fr_dlist_next(&list.head, entry);
+	TEST_CHECK(entry->lineno == 10);
+	TEST_CHECK(test_entry_has_reply(entry, "Session-Timeout"));
+	TEST_CHECK(entry->order > ((PAIR_LIST *)fr_dlist_head(&list.head))->order);
+	TEST_MSG("Entries must keep their order in the file, so they're merged with DEFAULT correctly");
+
+	talloc_free(image);
+	test_users_remove();
+}
+
+/*
+ *	Images which are damaged, or from another version,
+ *	are refused when they're mapped.
+ */
+static void test_format(void)
+{
+	pairlist_image_hdr_t		*hdr;
+	pairlist_image_key_t		*keys;
+	uint8_t				*data;
+	size_t				len;
+
+	test_users_create();
+	TEST_ASSERT(pairlist_image_write(test_dict_radius, test_users, test_image) == 0);
+	data = test_image_load(&len);
+	TEST_ASSERT(data != NULL);
+	hdr = (pairlist_image_hdr_t *)data;
+
+	/*
+	 *	Truncated
+	 */
+	test_image_save(data, len - 1);
+	TEST_CHECK(pairlist_image_open(autofree, test_image) == NULL);
+	test_image_save(data, sizeof(*hdr) - 1);
+	TEST_CHECK(pairlist_image_open(autofree, test_image) == NULL);
+
+	/*
+	 *	Wrong version
+	 */
+	hdr->version++;
+	test_image_save(data, len);
+	TEST_CHECK(pairlist_image_open(autofree, test_image) == NULL);
+	hdr->version--;
+
+	/*
+	 *	Key pointing outside the image
+	 */
+	keys = (pairlist_image_key_t *)(data + hdr->keys);
+	keys[0].name = len;
+	test_image_save(data, len);
+	TEST_CHECK(pairlist_image_open(autofree, test_image) == NULL);
+	TEST_MSG("Offsets must be checked when the image is mapped");
+
+	/*
+	 *	Key claiming more entries than there are
+	 */
+	talloc_free(data);
+	TEST_ASSERT(pairlist_image_write(test_dict_radius, test_users, test_image) == 0);
+	data = test_image_load(&len);
+	TEST_ASSERT(data != NULL);
+	hdr = (pairlist_image_hdr_t *)data;
+	keys = (pairlist_image_key_t *)(data + hdr->keys);
+	keys[hdr->num_keys - 1].num = hdr->num_entries + 1;
+	test_image_save(data, len);
+	TEST_CHECK(pairlist_image_open(autofree, test_image) == NULL);
+
+	talloc_free(data);
+	test_users_remove();
+}
+
+/*
+ *	Entries are parsed once, then found in the cache,
+ *	until they're the least recently used.
+ */
+static void test_cache(void)
+{
+	pairlist_image_t		*image, *replaced;
+	pairlist_image_cache_t		*cache;
+	pairlist_image_key_t const	*bob, *alice, *carol;
+	PAIR_LIST_LIST const		*list, *bob_list;
+
+	test_users_create();
+	image = test_image_open();
+	TEST_ASSERT(image != NULL);
+
+	bob = pairlist_image_find(image, "bob", 3);
+	alice = pairlist_image_find(image, "alice", 5);
+	carol = pairlist_image_find(image, "carol", 5);
+	TEST_ASSERT(bob && alice && carol);
+
+	cache = pairlist_image_cache_alloc(autofree, test_dict_radius, test_el, 2, NULL, NULL);
+	TEST_ASSERT(cache != NULL);
+
+	bob_list = pairlist_image_cache_find(cache, image, bob);
+	TEST_ASSERT(bob_list != NULL);
+	TEST_CHECK(fr_dlist_num_elements(&bob_list->head) == 2);
+
+	TEST_CHECK(pairlist_image_cache_find(cache, image, bob) == bob_list);
+	TEST_MSG("Entries should only be parsed once");
+	TEST_CHECK(pairlist_image_cache_num(cache) == 1);
+
+	list = pairlist_image_cache_find(cache, image, alice);
+	TEST_CHECK(list && (fr_dlist_num_elements(&list->head) == 1));
+	TEST_CHECK(pairlist_image_cache_num(cache) == 2);
+
+	/*
+	 *	bob was used more recently than alice, so
+	 *	alice is discarded to make room for carol.
+	 */
+	TEST_CHECK(pairlist_image_cache_find(cache, image, bob) == bob_list);
+	TEST_CHECK(pairlist_image_cache_find(cache, image, carol) != NULL);
+	TEST_CHECK(pairlist_image_cache_num(cache) == 2);
+	TEST_CHECK(pairlist_image_cache_find(cache, image, bob) == bob_list);
+	TEST_MSG("The most recently used entries should be kept");
+
+	/*
+	 *	The same key in a replacement image is a
+	 *	different set of entries.
+	 */
+	replaced = test_image_open();
+	TEST_ASSERT(replaced != NULL);
+	bob = pairlist_image_find(replaced, "bob", 3);
+	TEST_ASSERT(bob != NULL);
+
+	list = pairlist_image_cache_find(cache, replaced, bob);
+	TEST_CHECK(list != NULL);
+	TEST_CHECK(list != bob_list);
+	TEST_MSG("Entries from a replaced image must not be used");
+	TEST_CHECK(pairlist_image_cache_num(cache) == 2);
+
+	talloc_free(cache);
+	talloc_free(image);
+	talloc_free(replaced);
+	test_users_remove();
+}
+
+TEST_LIST = {
+	{ "compile",	test_compile },
+	{ "lookup",	test_lookup },
+	{ "format",	test_format },
+	{ "cache",	test_cache },
+
+	{ NULL }
+};
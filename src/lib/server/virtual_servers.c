@@ -42,6 +42,8 @@ RCSID("$Id$")
 #include <freeradius-devel/io/master.h>
 #include <freeradius-devel/io/listen.h>
 
+#include <freeradius-devel/unlang/latency.h>
+
 typedef struct {
 	module_instance_t		*proto_mi;		//!< The proto_* module for a listen section.
 	fr_app_t const			*proto_module;		//!< Public interface to the proto_mi.
@@ -104,6 +106,12 @@ static CONF_SECTION *virtual_server_root;
 
 static fr_rb_tree_t *listen_addr_root = NULL;
 
+/** Every socket opened by a listener, by file descriptor
+ *
+ * Handed over to a new instance of the server on reload.
+ */
+static fr_rb_tree_t *listen_fd_root = NULL;
+
 /** Lookup allowed section names for modules
  */
 static fr_rb_tree_t *server_section_name_tree = NULL;
@@ -729,6 +737,17 @@ fr_listen_t *listen_find_any(fr_listen_t *li)
 }
 
 
+/** Compare listeners by file descriptor
+ *
+ */
+static int8_t listen_fd_cmp(void const *one, void const *two)
+{
+	fr_listen_t const *a = one;
+	fr_listen_t const *b = two;
+
+	return CMP(a->fd, b->fd);
+}
+
 /**  Record that we're listening on a particular IP / port
  *
  */
@@ -736,11 +755,65 @@ bool listen_record(fr_listen_t *li)
 {
 	if (!listen_addr_root) return false;
 
-	if (!li->app_io_addr) return true;
+	if (li->app_io_addr) {
+		if (listen_find_any(li) != NULL) return false;
 
-	if (listen_find_any(li) != NULL) return false;
+		if (!fr_rb_insert(listen_addr_root, li)) return false;
+	}
 
-	return fr_rb_insert(listen_addr_root, li);
+	if ((li->fd >= 0) && !li->connected) (void) fr_rb_insert(listen_fd_root, li);
+
+	return true;
+}
+
+/** Find the listener which opened a socket
+ *
+ * @param[in] fd	of the socket, as returned by #listen_fds.
+ * @return
+ *	- The listener recorded by #listen_record.
+ *	- NULL if no listener opened the socket.
+ */
+fr_listen_t *listen_find_fd(int fd)
+{
+	if (!listen_fd_root) return NULL;
+
+	return fr_rb_find(listen_fd_root, &(fr_listen_t){ .fd = fd });
+}
+
+/** Return the sockets which listeners are receiving packets on
+ *
+ * These are the sockets recorded by #listen_record, i.e. the bound UDP
+ * sockets, and the listening TCP and unix sockets.  Sockets for TCP
+ * connections are not included.
+ *
+ * @param[in] ctx	to allocate the array in.
+ * @param[out] out	array of file descriptors.
+ * @return
+ *	- The number of sockets.
+ *	- -1 on error.
+ */
+int listen_fds(TALLOC_CTX *ctx, int **out)
+{
+	int		*fds;
+	int		num = 0;
+
+	if (!listen_fd_root) {
+		fr_strerror_const("Listeners have not been initialised");
+		return -1;
+	}
+
+	fds = talloc_array(ctx, int, fr_rb_num_elements(listen_fd_root));
+	if (!fds) {
+		fr_strerror_const("Out of memory");
+		return -1;
+	}
+
+	fr_rb_inorder_foreach(listen_fd_root, fr_listen_t, li) {
+		fds[num++] = li->fd;
+	}}
+
+	*out = fds;
+	return num;
 }
 
 /** Return virtual server matching the specified name
@@ -1173,6 +1246,11 @@ int virtual_servers_instantiate(void)
 		return -1;
 	}
 
+	if (fr_command_register_hook(NULL, NULL, NULL, unlang_latency_cmd_table) < 0) {
+		PERROR("Failed registering radmin commands for latency statistics");
+		return -1;
+	}
+
 	for (i = 0; i < server_cnt; i++) {
 		fr_virtual_listen_t		**listeners;
 		size_t				j, listener_cnt;
@@ -1293,6 +1371,8 @@ int virtual_servers_free(void)
 {
 	if (talloc_free(listen_addr_root) < 0) return -1;
 	listen_addr_root = NULL;
+	if (talloc_free(listen_fd_root) < 0) return -1;
+	listen_fd_root = NULL;
 	if (talloc_free(server_section_name_tree) < 0) return -1;
 	server_section_name_tree = NULL;
 	if (talloc_free(process_modules) < 0) return -1;
@@ -1332,6 +1412,7 @@ int virtual_servers_init(void)
 	MEM(process_modules = module_list_alloc(NULL, "process"));
 	MEM(proto_modules = module_list_alloc(NULL, "protocol"));
 	MEM(listen_addr_root = fr_rb_inline_alloc(NULL, fr_listen_t, virtual_server_node, listen_addr_cmp, NULL));
+	MEM(listen_fd_root = fr_rb_alloc(NULL, listen_fd_cmp, NULL));
 	MEM(server_section_name_tree = fr_rb_alloc(NULL, server_section_name_cmp, NULL));
 
 	/*
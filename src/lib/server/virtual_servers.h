@@ -65,6 +65,8 @@ int		virtual_server_cf_parse(TALLOC_CTX *ctx, void *out, void *parent,
 
 fr_listen_t *  	listen_find_any(fr_listen_t *li) CC_HINT(nonnull);
 bool		listen_record(fr_listen_t *li) CC_HINT(nonnull);
+fr_listen_t	*listen_find_fd(int fd);
+int		listen_fds(TALLOC_CTX *ctx, int **out) CC_HINT(nonnull(2));
 
 
 /** Module methods which are allowed in virtual servers.
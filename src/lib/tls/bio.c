@@ -28,6 +28,7 @@ USES_APPLE_DEPRECATED_API	/* OpenSSL API has been deprecated by Apple */
 #ifdef WITH_TLS
 #include <freeradius-devel/util/atexit.h>
 
+#include "base.h"
 #include "bio.h"
 
 /** Holds the state of a talloc aggregation 'write' BIO
@@ -357,6 +358,105 @@ BIO *fr_tls_bio_dbuff_thread_local(TALLOC_CTX *ctx, size_t init, size_t max)
 	return tls_bio_talloc_agg->bio;
 }
 
+/** Maximum number of free record buffers each thread keeps
+ *
+ * Bounds memory use after a burst of concurrent handshakes.
+ */
+#define TLS_BIO_RECORD_POOL_MAX	64
+
+/** A free record buffer
+ *
+ * Lives in the buffer it describes.
+ */
+typedef struct tls_bio_record_free_s tls_bio_record_free_t;
+struct tls_bio_record_free_s {
+	tls_bio_record_free_t	*next;
+};
+
+/** Free record buffers for this thread
+ *
+ */
+typedef struct {
+	tls_bio_record_free_t	*head;
+	unsigned int		num;
+} tls_bio_record_pool_t;
+
+static _Thread_local	tls_bio_record_pool_t		*tls_bio_record_pool;
+
+static int _tls_bio_record_pool_free(tls_bio_record_pool_t *pool)
+{
+	tls_bio_record_free_t *buffer, *next;
+
+	for (buffer = pool->head; buffer; buffer = next) {
+		next = buffer->next;
+		talloc_free(buffer);
+	}
+
+	return 0;
+}
+
+static int _tls_bio_record_pool_thread_local_free(void *pool)
+{
+	if (tls_bio_record_pool == pool) tls_bio_record_pool = NULL;
+
+	return talloc_free(pool);
+}
+
+/** Allocate a record buffer of FR_TLS_MAX_RECORD_SIZE bytes
+ *
+ * Buffers are reused where possible, as sessions allocate and free
+ * them for every round of every handshake.
+ *
+ * @return A record buffer.  Its contents are undefined.
+ */
+uint8_t *fr_tls_bio_record_buffer_alloc(void)
+{
+	tls_bio_record_pool_t	*pool = tls_bio_record_pool;
+	tls_bio_record_free_t	*buffer;
+	uint8_t			*out;
+
+	if (pool && pool->head) {
+		buffer = pool->head;
+		pool->head = buffer->next;
+		pool->num--;
+
+		return (uint8_t *)buffer;
+	}
+
+	MEM(out = talloc_array(NULL, uint8_t, FR_TLS_MAX_RECORD_SIZE));
+
+	return out;
+}
+
+/** Return a record buffer to this thread's pool
+ *
+ * Buffers may be returned by a different thread to the one which
+ * allocated them.
+ *
+ * @param[in] buffer	to return.
+ */
+void fr_tls_bio_record_buffer_free(uint8_t *buffer)
+{
+	tls_bio_record_pool_t	*pool = tls_bio_record_pool;
+	tls_bio_record_free_t	*entry;
+
+	if (unlikely(!pool)) {
+		MEM(pool = talloc_zero(NULL, tls_bio_record_pool_t));
+		talloc_set_destructor(pool, _tls_bio_record_pool_free);
+		fr_atexit_thread_local(tls_bio_record_pool, _tls_bio_record_pool_thread_local_free, pool);
+	}
+
+	if (pool->num >= TLS_BIO_RECORD_POOL_MAX) {
+		talloc_free(buffer);
+		return;
+	}
+
+	entry = (tls_bio_record_free_t *)buffer;
+	entry->next = pool->head;
+	pool->head = entry;
+	pool->num++;
+}
+
 /** Initialise the BIO logging meths which are used to create thread local logging BIOs
  *
  */
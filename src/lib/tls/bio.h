@@ -53,6 +53,10 @@ void		fr_tls_bio_dbuff_thread_local_clear(void);
 
 BIO		*fr_tls_bio_dbuff_thread_local(TALLOC_CTX *ctx, size_t init, size_t max);
 
+uint8_t		*fr_tls_bio_record_buffer_alloc(void);
+
+void		fr_tls_bio_record_buffer_free(uint8_t *buffer);
+
 int		fr_tls_bio_init(void);
 
 void		fr_tls_bio_free(void);
@@ -36,6 +36,9 @@ USES_APPLE_DEPRECATED_API	/* OpenSSL API has been deprecated by Apple */
 #include <freeradius-devel/unlang/subrequest.h>
 #include <freeradius-devel/unlang/interpret.h>
 #include <freeradius-devel/util/debug.h>
+#include <freeradius-devel/util/hash.h>
+#include <freeradius-devel/util/math.h>
+#include <freeradius-devel/util/nbo.h>
 
 #include "attrs.h"
 #include "base.h"
@@ -46,6 +49,14 @@ USES_APPLE_DEPRECATED_API	/* OpenSSL API has been deprecated by Apple */
 
 #include <openssl/ssl.h>
 #include <openssl/kdf.h>
+#include <openssl/rand.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#  include <openssl/core_names.h>
+#else
+#  include <openssl/hmac.h>
+#endif
+
+#include <pthread.h>
 
 /** Retrieve session ID (in binary form) from the session
  *
@@ -160,6 +171,205 @@ void _tls_cache_clear_state_reset(request_t *request, fr_tls_cache_t *cache, cha
 }
 #define tls_cache_clear_state_reset(_request, _cache) _tls_cache_clear_state_reset(_request, _cache, __FUNCTION__)
 
+/** Number of shards in the in-memory session store
+ *
+ * Each shard has its own mutex, so threads resuming different
+ * sessions rarely contend with each other.
+ */
+#define TLS_CACHE_MEMORY_SHARDS		16
+
+/** A serialised session in the in-memory session store
+ *
+ */
+typedef struct {
+	fr_rb_node_t			node;		//!< Entry in the shard's tree.
+	fr_dlist_t			entry;		//!< Entry in the shard's LRU list.
+	uint8_t				*id;		//!< Session ID.
+	size_t				id_len;		//!< Length of the session ID.
+	uint8_t				*data;		//!< Serialised session.
+	fr_time_t			expires;	//!< When the session can no longer be resumed.
+} tls_cache_memory_entry_t;
+
+/** One shard of the in-memory session store
+ *
+ */
+typedef struct {
+	pthread_mutex_t			mutex;		//!< Protects everything below, and the entries.
+	fr_rb_tree_t			*tree;		//!< Entries, ordered by session ID.
+	fr_dlist_head_t			lru;		//!< Entries, most recently used at the head.
+	uint32_t			max_entries;	//!< The maximum number of entries in this shard.
+} tls_cache_memory_shard_t;
+
+/** Session store shared between all threads using the same TLS configuration
+ *
+ */
+struct fr_tls_cache_memory_s {
+	tls_cache_memory_shard_t	*shard[TLS_CACHE_MEMORY_SHARDS];
+};
+
+static int8_t tls_cache_memory_entry_cmp(void const *one, void const *two)
+{
+	tls_cache_memory_entry_t const	*a = one, *b = two;
+	int				ret;
+
+	ret = CMP(a->id_len, b->id_len);
+	if (ret != 0) return ret;
+
+	ret = memcmp(a->id, b->id, a->id_len);
+	return CMP(ret, 0);
+}
+
+static int _tls_cache_memory_shard_free(tls_cache_memory_shard_t *shard)
+{
+	pthread_mutex_destroy(&shard->mutex);
+	return 0;
+}
+
+/** Allocate an in-memory session store
+ *
+ * @param[in] ctx		to allocate the store in.
+ * @param[in] max_entries	The maximum number of sessions to store.
+ * @return A new session store.
+ */
+fr_tls_cache_memory_t *fr_tls_cache_memory_alloc(TALLOC_CTX *ctx, uint32_t max_entries)
+{
+	fr_tls_cache_memory_t	*store;
+	size_t			i;
+
+	MEM(store = talloc_zero(ctx, fr_tls_cache_memory_t));
+	for (i = 0; i < NUM_ELEMENTS(store->shard); i++) {
+		tls_cache_memory_shard_t *shard;
+
+		/*
+		 *	Entries are allocated in the context of
+		 *	their shard, so that allocations only
+		 *	happen with the shard's mutex held.
+		 */
+		MEM(shard = store->shard[i] = talloc_zero(store, tls_cache_memory_shard_t));
+		pthread_mutex_init(&shard->mutex, NULL);
+		talloc_set_destructor(shard, _tls_cache_memory_shard_free);
+
+		MEM(shard->tree = fr_rb_inline_alloc(shard, tls_cache_memory_entry_t, node,
+						     tls_cache_memory_entry_cmp, NULL));
+		fr_dlist_init(&shard->lru, tls_cache_memory_entry_t, entry);
+		shard->max_entries = ROUND_UP_DIV(max_entries, NUM_ELEMENTS(store->shard));
+	}
+
+	return store;
+}
+
+static inline CC_HINT(always_inline)
+tls_cache_memory_shard_t *tls_cache_memory_shard(fr_tls_cache_memory_t *store, uint8_t const *id, size_t id_len)
+{
+	return store->shard[fr_hash(id, id_len) % NUM_ELEMENTS(store->shard)];
+}
+
+/** Remove an entry from its shard and free it
+ *
+ * @note Must be called with the shard's mutex held.
+ */
+static void tls_cache_memory_entry_free(tls_cache_memory_shard_t *shard, tls_cache_memory_entry_t *entry)
+{
+	fr_rb_remove_by_inline_node(shard->tree, &entry->node);
+	fr_dlist_remove(&shard->lru, entry);
+	talloc_free(entry);
+}
+
+/** Add a serialised session to the in-memory session store
+ *
+ * If the shard is full, the least recently used session is evicted.
+ *
+ * @param[in] store	to add the session to.
+ * @param[in] id	of the session.
+ * @param[in] id_len	Length of the session ID.
+ * @param[in] data	Serialised session.
+ * @param[in] data_len	Length of the serialised session.
+ * @param[in] expires	When the session can no longer be resumed.
+ */
+static void tls_cache_memory_insert(fr_tls_cache_memory_t *store, uint8_t const *id, size_t id_len,
+				    uint8_t const *data, size_t data_len, fr_time_t expires)
+{
+	tls_cache_memory_shard_t	*shard = tls_cache_memory_shard(store, id, id_len);
+	tls_cache_memory_entry_t	*entry, find = { .id = UNCONST(uint8_t *, id), .id_len = id_len };
+
+	pthread_mutex_lock(&shard->mutex);
+	entry = fr_rb_find(shard->tree, &find);
+	if (entry) tls_cache_memory_entry_free(shard, entry);
+
+	while (fr_rb_num_elements(shard->tree) >= shard->max_entries) {
+		tls_cache_memory_entry_free(shard, fr_dlist_tail(&shard->lru));
+	}
+
+	MEM(entry = talloc_zero(shard, tls_cache_memory_entry_t));
+	MEM(entry->id = talloc_memdup(entry, id, id_len));
+	entry->id_len = id_len;
+	MEM(entry->data = talloc_memdup(entry, data, data_len));
+	entry->expires = expires;
+
+	fr_rb_insert(shard->tree, entry);
+	fr_dlist_insert_head(&shard->lru, entry);
+	pthread_mutex_unlock(&shard->mutex);
+}
+
+/** Retrieve a session from the in-memory session store
+ *
+ * @param[in] store	to retrieve the session from.
+ * @param[in] id	of the session.
+ * @param[in] id_len	Length of the session ID.
+ * @return
+ *	- A new SSL_SESSION on success.
+ *	- NULL if the session wasn't found, had expired, or couldn't be deserialised.
+ */
+static SSL_SESSION *tls_cache_memory_find(fr_tls_cache_memory_t *store, uint8_t const *id, size_t id_len)
+{
+	tls_cache_memory_shard_t	*shard = tls_cache_memory_shard(store, id, id_len);
+	tls_cache_memory_entry_t	*entry, find = { .id = UNCONST(uint8_t *, id), .id_len = id_len };
+	uint8_t const			*p;
+	SSL_SESSION			*sess = NULL;
+
+	pthread_mutex_lock(&shard->mutex);
+	entry = fr_rb_find(shard->tree, &find);
+	if (!entry) goto done;
+
+	if (fr_time_lteq(entry->expires, fr_time())) {
+	remove:
+		tls_cache_memory_entry_free(shard, entry);
+		goto done;
+	}
+
+	p = entry->data;	/* openssl mutates p */
+	sess = d2i_SSL_SESSION(NULL, &p, talloc_array_length(entry->data));
+	if (!sess) {
+		fr_tls_strerror_printf(NULL);	/* Drain the OpenSSL error stack */
+		goto remove;
+	}
+
+	fr_dlist_remove(&shard->lru, entry);
+	fr_dlist_insert_head(&shard->lru, entry);
+
+done:
+	pthread_mutex_unlock(&shard->mutex);
+
+	return sess;
+}
+
+/** Remove a session from the in-memory session store
+ *
+ * @param[in] store	to remove the session from.
+ * @param[in] id	of the session.
+ * @param[in] id_len	Length of the session ID.
+ */
+static void tls_cache_memory_delete(fr_tls_cache_memory_t *store, uint8_t const *id, size_t id_len)
+{
+	tls_cache_memory_shard_t	*shard = tls_cache_memory_shard(store, id, id_len);
+	tls_cache_memory_entry_t	*entry, find = { .id = UNCONST(uint8_t *, id), .id_len = id_len };
+
+	pthread_mutex_lock(&shard->mutex);
+	entry = fr_rb_find(shard->tree, &find);
+	if (entry) tls_cache_memory_entry_free(shard, entry);
+	pthread_mutex_unlock(&shard->mutex);
+}
+
 /** Serialize the session-state list and store it in the SSL_SESSION *
  *
  */
@@ -334,8 +544,11 @@ static void tls_cache_delete_request(SSL_SESSION *sess)
 	 *
 	 *	We now check the 'can_pause' flag to determine
 	 *	if we're inside a yieldable SSL_read call.
+	 *
+	 *	Sessions stored in memory are cleared without
+	 *	yielding, when the pending operations are pushed.
 	 */
-	if (tls_session->can_pause) ASYNC_pause_job();
+	if (tls_session->can_pause && !fr_tls_session_conf(tls_session->ssl)->cache.memory.store) ASYNC_pause_job();
 }
 
 /** Process the result of `session load { ... }`
@@ -512,29 +725,6 @@ unlang_action_t tls_cache_store_push(request_t *request, fr_tls_conf_t *conf, fr
 	 */
 	if (tls_cache_app_data_set(request, sess) < 0) return UNLANG_ACTION_FAIL;
 
-	MEM(child = unlang_subrequest_alloc(request, dict_tls));
-	request = child;
-
-	/*
-	 *	Setup the child request for storing
-	 *	session resumption data.
-	 */
-	MEM(pair_prepend_request(&vp, attr_tls_packet_type) >= 0);
-	vp->vp_uint32 = enum_tls_packet_type_store_session->vb_uint32;
-
-	/*
-	 *	Add the session identifier we're trying
-	 *	to store.
-	 */
-	MEM(pair_update_request(&vp, attr_tls_session_id) >= 0);
-	fr_pair_value_memdup_buffer_shallow(vp, fr_tls_cache_id(vp, sess), true);
-
-	/*
-	 *	How long the session has to live
-	 */
-	MEM(pair_update_request(&vp, attr_tls_session_ttl) >= 0);
-	vp->vp_time_delta = fr_time_sub(expires, now);
-
 	/*
 	 *	Serialize the session
 	 */
@@ -549,12 +739,10 @@ unlang_action_t tls_cache_store_push(request_t *request, fr_tls_conf_t *conf, fr
 			 "required buffer length", &id);
 	error:
 		tls_cache_store_state_reset(request, tls_cache);
-		talloc_free(child);
 		return UNLANG_ACTION_FAIL;
 	}
 
-	MEM(pair_update_request(&vp, attr_tls_session_data) >= 0);
-	MEM(data = talloc_array(vp, uint8_t, len));
+	MEM(data = talloc_array(request, uint8_t, len));
 
 	/* openssl mutates &p */
 	p = data;
@@ -568,14 +756,61 @@ unlang_action_t tls_cache_store_push(request_t *request, fr_tls_conf_t *conf, fr
 		talloc_free(data);
 		goto error;
 	}
-	fr_pair_value_memdup_buffer_shallow(vp, data, true);
+
+	/*
+	 *	Sessions stored in memory don't need a
+	 *	call to the virtual server.
+	 */
+	if (conf->cache.memory.store) {
+		unsigned int	id_len;
+		uint8_t const	*id = SSL_SESSION_get_id(sess, &id_len);
+
+		tls_cache_memory_insert(conf->cache.memory.store, id, id_len, data, len, expires);
+		talloc_free(data);
+
+		RDEBUG3("Session ID %pV - Stored %zu bytes in memory", fr_box_octets(id, id_len), len);
+
+		tls_cache_store_state_reset(request, tls_cache);
+		tls_cache->store.state = FR_TLS_CACHE_STORE_PERSISTED;	/* Avoid spurious clear calls */
+		return UNLANG_ACTION_CALCULATE_RESULT;
+	}
+
+	MEM(child = unlang_subrequest_alloc(request, dict_tls));
+	request = child;
+
+	/*
+	 *	Setup the child request for storing
+	 *	session resumption data.
+	 */
+	MEM(pair_prepend_request(&vp, attr_tls_packet_type) >= 0);
+	vp->vp_uint32 = enum_tls_packet_type_store_session->vb_uint32;
+
+	/*
+	 *	Add the session identifier we're trying
+	 *	to store.
+	 */
+	MEM(pair_update_request(&vp, attr_tls_session_id) >= 0);
+	fr_pair_value_memdup_buffer_shallow(vp, fr_tls_cache_id(vp, sess), true);
+
+	/*
+	 *	How long the session has to live
+	 */
+	MEM(pair_update_request(&vp, attr_tls_session_ttl) >= 0);
+	vp->vp_time_delta = fr_time_sub(expires, now);
+
+	MEM(pair_update_request(&vp, attr_tls_session_data) >= 0);
+	fr_pair_value_memdup_buffer_shallow(vp, talloc_steal(vp, data), true);
 
 	/*
 	 *	Allocate a child, and set it up to call
 	 *      the TLS virtual server.
 	 */
 	ua = fr_tls_call_push(child, tls_cache_store_result, conf, tls_session);
-	if (ua < 0) goto error;
+	if (ua < 0) {
+		tls_cache_store_state_reset(request, tls_cache);
+		talloc_free(child);
+		return UNLANG_ACTION_FAIL;
+	}
 
 	return ua;
 }
@@ -623,6 +858,17 @@ unlang_action_t tls_cache_clear_push(request_t *request, fr_tls_conf_t *conf, fr
 	fr_assert(tls_cache->clear.state == FR_TLS_CACHE_CLEAR_REQUESTED);
 	fr_assert(tls_cache->clear.id);
 
+	/*
+	 *	Sessions stored in memory don't need a
+	 *	call to the virtual server.
+	 */
+	if (conf->cache.memory.store) {
+		tls_cache_memory_delete(conf->cache.memory.store,
+					tls_cache->clear.id, talloc_array_length(tls_cache->clear.id));
+		tls_cache_clear_state_reset(request, tls_cache);
+		return UNLANG_ACTION_CALCULATE_RESULT;
+	}
+
 	MEM(child = unlang_subrequest_alloc(request, dict_tls));
 	request = child;
 
@@ -665,6 +911,7 @@ unlang_action_t fr_tls_cache_pending_push(request_t *request, fr_tls_session_t *
 {
 	fr_tls_cache_t *tls_cache = tls_session->cache;
 	fr_tls_conf_t *conf = fr_tls_session_conf(tls_session->ssl);
+	unlang_action_t ua;
 
 	if (!tls_cache) return UNLANG_ACTION_CALCULATE_RESULT;	/* No caching allowed */
 
@@ -696,7 +943,13 @@ unlang_action_t fr_tls_cache_pending_push(request_t *request, fr_tls_session_t *
 			}
 		}
 
-		return tls_cache_clear_push(request, conf, tls_session);
+		/*
+		 *	Clearing sessions stored in memory doesn't
+		 *	push anything, so we can store a new session
+		 *	immediately afterwards.
+		 */
+		ua = tls_cache_clear_push(request, conf, tls_session);
+		if (ua != UNLANG_ACTION_CALCULATE_RESULT) return ua;
 	}
 
 	if (tls_cache->store.state == FR_TLS_CACHE_STORE_REQUESTED) {
@@ -706,6 +959,24 @@ unlang_action_t fr_tls_cache_pending_push(request_t *request, fr_tls_session_t *
 	return UNLANG_ACTION_CALCULATE_RESULT;
 }
 
+typedef struct {
+	SSL			*ssl;
+	SSL_SESSION		*sess;
+	int			ret;
+} tls_cache_store_cb_args_t;
+
+static int tls_cache_store_cb(SSL *ssl, SSL_SESSION *sess);
+
+/** Run the store callback on the worker
+ *
+ */
+static void tls_cache_store_cb_offload(UNUSED request_t *request, void *uctx)
+{
+	tls_cache_store_cb_args_t *args = uctx;
+
+	args->ret = tls_cache_store_cb(args->ssl, args->sess);
+}
+
 /** Write a newly created session data to the tls_session->cache structure
  *
  * @note If you hit an assert in this function, it was likely called twice, which shouldn't happen
@@ -727,6 +998,10 @@ static int tls_cache_store_cb(SSL *ssl, SSL_SESSION *sess)
 	unsigned int		id_len;
 	uint8_t const		*id;
 
+	tls_cache_store_cb_args_t	args = { .ssl = ssl, .sess = sess };
+
+	if (fr_tls_offload_callback(tls_cache_store_cb_offload, &args)) return args.ret;
+
 	/*
 	 *	This functions should only be called once during the lifetime
 	 *	of the tls_session, as the fields aren't re-populated on
@@ -754,6 +1029,26 @@ static int tls_cache_store_cb(SSL *ssl, SSL_SESSION *sess)
 	return 1;
 }
 
+typedef struct {
+	SSL			*ssl;
+	unsigned char const	*key;
+	int			key_len;
+	int			*copy;
+	SSL_SESSION		*ret;
+} tls_cache_load_cb_args_t;
+
+static SSL_SESSION *tls_cache_load_cb(SSL *ssl, unsigned char const *key, int key_len, int *copy);
+
+/** Run the load callback on the worker
+ *
+ */
+static void tls_cache_load_cb_offload(UNUSED request_t *request, void *uctx)
+{
+	tls_cache_load_cb_args_t *args = uctx;
+
+	args->ret = tls_cache_load_cb(args->ssl, args->key, args->key_len, args->copy);
+}
+
 /** Read session data from the cache
  *
  * @param[in] ssl session state.
@@ -771,10 +1066,16 @@ static SSL_SESSION *tls_cache_load_cb(SSL *ssl,
 				      int key_len, int *copy)
 {
 	fr_tls_session_t	*tls_session;
+	fr_tls_conf_t		*conf;
 	fr_tls_cache_t		*tls_cache;
 	request_t		*request;
 
+	tls_cache_load_cb_args_t	args = { .ssl = ssl, .key = key, .key_len = key_len, .copy = copy };
+
+	if (fr_tls_offload_callback(tls_cache_load_cb_offload, &args)) return args.ret;
+
 	tls_session = fr_tls_session(ssl);
+	conf = fr_tls_session_conf(ssl);
 	request = fr_tls_session_request(tls_session->ssl);
 	tls_cache = tls_session->cache;
 
@@ -801,6 +1102,9 @@ static SSL_SESSION *tls_cache_load_cb(SSL *ssl,
 	 *	   retrieved during the session session load.
 	 *	3. We call SSL_read() again, which in turn calls this callback
 	 *	   again.
+	 *
+	 *	If sessions are stored in memory, step 2 happens synchronously
+	 *	in this callback.
 	 */
 again:
 	switch (tls_cache->load.state) {
@@ -812,6 +1116,24 @@ again:
 
 		RDEBUG3("Requested session load - ID %pV", fr_box_octets_buffer(tls_cache->load.id));
 
+		if (conf->cache.memory.store) {
+			tls_cache->load.sess = tls_cache_memory_find(conf->cache.memory.store,
+								     (uint8_t const *)key, key_len);
+			if (!tls_cache->load.sess) {
+				RDEBUG3("Session ID %pV - Not found in memory", fr_box_octets_buffer(tls_cache->load.id));
+				tls_cache->load.state = FR_TLS_CACHE_LOAD_FAILED;
+				goto again;
+			}
+
+			/*
+			 *	ex_data isn't serialised, see
+			 *	tls_cache_load_result.
+			 */
+			SSL_SESSION_set_ex_data(tls_cache->load.sess, FR_TLS_EX_INDEX_TLS_SESSION, tls_session);
+			tls_cache->load.state = FR_TLS_CACHE_LOAD_RETRIEVED;
+			goto again;
+		}
+
 		/*
 		 *	Cache functions are only allowed during the handshake
 		 *	FIXME: With TLS 1.3 session tickets can be sent
@@ -881,47 +1203,51 @@ again:
 			return NULL;
 		}
 
-		/*
-		 *	This sets the validation state of the tls_session
-		 *	so that when we call ASYNC_pause_job(), and execution
-		 *	jumps back to tls_session_async_handshake_cont
-		 *	(just under SSL_read())
-		 *	the code there knows what job it needs to push onto
-		 *	the unlang stack.
-		 */
-		fr_tls_verify_cert_request(tls_session, true);
+		if (conf->virtual_server && tls_session->verify_client_cert) {
+			RDEBUG2("Requesting certificate re-validation for session-id");
+			/*
+			 *	This sets the validation state of the tls_session
+			 *	so that when we call ASYNC_pause_job(), and execution
+			 *	jumps back to tls_session_async_handshake_cont
+			 *	(just under SSL_read())
+			 *	the code there knows what job it needs to push onto
+			 *	the unlang stack.
+			 */
+			fr_tls_verify_cert_request(tls_session, true);
 
-		if (unlikely(!tls_session->can_pause)) goto cant_pause;
-		/*
-		 *	Jumps back to SSL_read() in session.c
-		 *
-		 *	Be aware that if the request is cancelled
-		 *	whatever was meant to be done during the
-		 *	time we yielded may not have been completed.
-		 */
-		ASYNC_pause_job();
+			if (unlikely(!tls_session->can_pause)) goto cant_pause;
+			/*
+			 *	Jumps back to SSL_read() in session.c
+			 *
+			 *	Be aware that if the request is cancelled
+			 *	whatever was meant to be done during the
+			 *	time we yielded may not have been completed.
+			 */
+			ASYNC_pause_job();
 
-		/*
-		 *	Certificate validation returned but the request
-		 *	was cancelled.  Free any data we have so far
-		 *	and reset the states, then let OpenSSL know
-		 *	we failed to load the session.
-		 */
-		if (unlang_request_is_cancelled(request)) {
-			tls_cache_load_state_reset(request, tls_cache);	/* Clears any loaded session data */
-			fr_tls_verify_cert_reset(tls_session);
-			return NULL;
+			/*
+			 *	Certificate validation returned but the request
+			 *	was cancelled.  Free any data we have so far
+			 *	and reset the states, then let OpenSSL know
+			 *	we failed to load the session.
+			 */
+			if (unlang_request_is_cancelled(request)) {
+				tls_cache_load_state_reset(request, tls_cache);	/* Clears any loaded session data */
+				fr_tls_verify_cert_reset(tls_session);
+				return NULL;
 
-		}
+			}
 
-		/*
-		 *	If we couldn't validate the client certificate
-		 *	then validation overall fails.
-		 */
-		if (!fr_tls_verify_cert_result(tls_session)) {
-			RDEBUG2("Certificate re-validation failed, denying session resumption via session-id");
-			goto verify_error;
+			/*
+			 *	If we couldn't validate the client certificate
+			 *	then validation overall fails.
+			 */
+			if (!fr_tls_verify_cert_result(tls_session)) {
+				RDEBUG2("Certificate re-validation failed, denying session resumption via session-id");
+				goto verify_error;
+			}
 		}
+
 		sess = tls_cache->load.sess;
 
 		/*
@@ -952,6 +1278,14 @@ again:
 	return NULL;
 }
 
+/** Run the delete callback on the worker
+ *
+ */
+static void tls_cache_delete_cb_offload(UNUSED request_t *request, void *uctx)
+{
+	tls_cache_delete_request(uctx);
+}
+
 /** Delete session data from the cache
  *
  * @param[in] ctx Current ssl context.
@@ -966,6 +1300,9 @@ static void tls_cache_delete_cb(UNUSED SSL_CTX *ctx, SSL_SESSION *sess)
 	 *	Maybe it's one OpenSSL created internally?
 	 */
 	if (!SSL_SESSION_get_ex_data(sess, FR_TLS_EX_INDEX_TLS_SESSION)) return;
+
+	if (fr_tls_offload_callback(tls_cache_delete_cb_offload, sess)) return;
+
 	tls_cache_delete_request(sess);
 }
 
@@ -1180,6 +1517,24 @@ void tls_cache_disable_statefull_resumption(SSL_CTX *ctx)
 	SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
 }
 
+typedef struct {
+	SSL			*ssl;
+	void			*arg;
+	int			ret;
+} tls_cache_session_ticket_app_data_set_args_t;
+
+static int tls_cache_session_ticket_app_data_set(SSL *ssl, void *arg);
+
+/** Run the ticket generation callback on the worker
+ *
+ */
+static void tls_cache_session_ticket_app_data_set_offload(UNUSED request_t *request, void *uctx)
+{
+	tls_cache_session_ticket_app_data_set_args_t *args = uctx;
+
+	args->ret = tls_cache_session_ticket_app_data_set(args->ssl, args->arg);
+}
+
 /** Called when new tickets are being generated
  *
  * This adds additional application data to the session ticket to
@@ -1193,6 +1548,10 @@ static int tls_cache_session_ticket_app_data_set(SSL *ssl, void *arg)
 	SSL_SESSION		*sess;
 	request_t		*request;
 
+	tls_cache_session_ticket_app_data_set_args_t	args = { .ssl = ssl, .arg = arg };
+
+	if (fr_tls_offload_callback(tls_cache_session_ticket_app_data_set_offload, &args)) return args.ret;
+
 	/*
 	 *	Check to see if we have a request bound
 	 *	to the session.  If we don't have a
@@ -1236,13 +1595,38 @@ static int tls_cache_session_ticket_app_data_set(SSL *ssl, void *arg)
 	return 1;
 }
 
+typedef struct {
+	SSL			*ssl;
+	SSL_SESSION		*sess;
+	unsigned char const	*keyname;
+	size_t			keyname_len;
+	SSL_TICKET_STATUS	status;
+	void			*arg;
+	SSL_TICKET_RETURN	ret;
+} tls_cache_session_ticket_app_data_get_args_t;
+
+static SSL_TICKET_RETURN tls_cache_session_ticket_app_data_get(SSL *ssl, SSL_SESSION *sess,
+							       unsigned char const *keyname, size_t keyname_len,
+							       SSL_TICKET_STATUS status, void *arg);
+
+/** Run the ticket decoding callback on the worker
+ *
+ */
+static void tls_cache_session_ticket_app_data_get_offload(UNUSED request_t *request, void *uctx)
+{
+	tls_cache_session_ticket_app_data_get_args_t *args = uctx;
+
+	args->ret = tls_cache_session_ticket_app_data_get(args->ssl, args->sess, args->keyname, args->keyname_len,
+							  args->status, args->arg);
+}
+
 /** Called when new tickets are being decoded
  *
  * This adds the session-state attributes back to the current request.
  */
 static SSL_TICKET_RETURN tls_cache_session_ticket_app_data_get(SSL *ssl, SSL_SESSION *sess,
-							       UNUSED unsigned char const *keyname,
-							       UNUSED size_t keyname_len,
+							       unsigned char const *keyname,
+							       size_t keyname_len,
 							       SSL_TICKET_STATUS status,
 							       void *arg)
 {
@@ -1251,6 +1635,12 @@ static SSL_TICKET_RETURN tls_cache_session_ticket_app_data_get(SSL *ssl, SSL_SES
 	fr_tls_cache_conf_t	*tls_cache_conf = arg;	/* Not talloced */
 	request_t		*request = NULL;
 
+	tls_cache_session_ticket_app_data_get_args_t	args = { .ssl = ssl, .sess = sess,
+								 .keyname = keyname, .keyname_len = keyname_len,
+								 .status = status, .arg = arg };
+
+	if (fr_tls_offload_callback(tls_cache_session_ticket_app_data_get_offload, &args)) return args.ret;
+
 	if (fr_tls_session_request_bound(ssl)) {
 		request = fr_tls_session_request(ssl);
 		if (unlang_request_is_cancelled(request)) return SSL_TICKET_RETURN_ABORT;
@@ -1354,6 +1744,181 @@ static SSL_TICKET_RETURN tls_cache_session_ticket_app_data_get(SSL *ssl, SSL_SES
 	return (status == SSL_TICKET_SUCCESS_RENEW) ? SSL_TICKET_RETURN_USE_RENEW : SSL_TICKET_RETURN_USE;
 }
 
+/** Derive key material from the session_ticket_key
+ *
+ * @param[out] out		Where to write the key material.
+ * @param[in] out_len		How many bytes of key material to derive.
+ * @param[in] cache_conf	containing the session_ticket_key.
+ * @param[in] info		HKDF label.
+ * @param[in] info_len		Length of the HKDF label.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+static int tls_cache_session_ticket_key_derive(uint8_t *out, size_t out_len, fr_tls_cache_conf_t const *cache_conf,
+					       uint8_t const *info, size_t info_len)
+{
+	EVP_PKEY_CTX *pkey_ctx = NULL;
+
+	if (unlikely((pkey_ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, NULL)) == NULL)) {
+		fr_tls_strerror_printf(NULL);
+		PERROR("Failed initialising KDF");
+	kdf_error:
+		if (pkey_ctx) EVP_PKEY_CTX_free(pkey_ctx);
+		return -1;
+	}
+	if (unlikely(EVP_PKEY_derive_init(pkey_ctx) != 1)) {
+		fr_tls_strerror_printf(NULL);
+		PERROR("Failed initialising KDF derivation ctx");
+		goto kdf_error;
+	}
+	if (unlikely(EVP_PKEY_CTX_set_hkdf_md(pkey_ctx, UNCONST(struct evp_md_st *, EVP_sha256())) != 1)) {
+		fr_tls_strerror_printf(NULL);
+		PERROR("Failed setting KDF MD");
+		goto kdf_error;
+	}
+	if (unlikely(EVP_PKEY_CTX_set1_hkdf_key(pkey_ctx,
+						UNCONST(unsigned char *, cache_conf->session_ticket_key),
+						talloc_array_length(cache_conf->session_ticket_key)) != 1)) {
+		fr_tls_strerror_printf(NULL);
+		PERROR("Failed setting KDF key");
+		goto kdf_error;
+	}
+	if (unlikely(EVP_PKEY_CTX_add1_hkdf_info(pkey_ctx, UNCONST(unsigned char *, info), info_len) != 1)) {
+		fr_tls_strerror_printf(NULL);
+		PERROR("Failed setting KDF label");
+		goto kdf_error;
+	}
+	if (EVP_PKEY_derive(pkey_ctx, out, &out_len) != 1) {
+		fr_tls_strerror_printf(NULL);
+		PERROR("Failed deriving session ticket key");
+		goto kdf_error;
+	}
+	EVP_PKEY_CTX_free(pkey_ctx);
+
+	return 0;
+}
+
+/** Session ticket keys for one rotation period
+ *
+ * Key names are the tag, followed by the period number in network
+ * byte order, so we know which keys to derive when decrypting.
+ */
+typedef struct {
+	uint8_t		tag[8];				//!< Start of the key name.
+	uint8_t		aes_key[32];			//!< Used to encrypt the ticket with AES-256-CBC.
+	uint8_t		hmac_key[32];			//!< Used to authenticate the ticket with HMAC-SHA256.
+} tls_cache_ticket_key_t;
+
+/** Derive the session ticket keys for a rotation period
+ *
+ * @param[out] key		Where to write the keys.
+ * @param[in] cache_conf	containing the session_ticket_key.
+ * @param[in] period		Number of rotation intervals since the unix epoch.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+static int tls_cache_session_ticket_key_period(tls_cache_ticket_key_t *key, fr_tls_cache_conf_t const *cache_conf,
+					       uint64_t period)
+{
+	uint8_t info[(sizeof("freeradius-session-ticket") - 1) + sizeof(uint64_t)];
+
+	memcpy(info, "freeradius-session-ticket", sizeof("freeradius-session-ticket") - 1);
+	fr_nbo_from_uint64(info + (sizeof("freeradius-session-ticket") - 1), period);
+
+	return tls_cache_session_ticket_key_derive((uint8_t *)key, sizeof(*key), cache_conf, info, sizeof(info));
+}
+
+/** Select the keys used to encrypt or decrypt a session ticket
+ *
+ * Called when session_ticket_key_rotation is set.  New tickets are
+ * always encrypted with the keys for the current rotation period.
+ * Tickets encrypted with keys from previous periods are accepted
+ * for as long as the session could be resumed, but the client is
+ * sent a new ticket encrypted with the current keys.
+ *
+ * Keys are derived from the session_ticket_key, so all threads,
+ * and all servers sharing the same session_ticket_key, agree on
+ * the keys without any coordination.
+ *
+ * @return
+ *	- 1 keys were set.
+ *	- 2 keys were set, and the client should be sent a new ticket.
+ *	- 0 no keys for this ticket.
+ *	- -1 on error.
+ */
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+static int tls_cache_session_ticket_key_cb(SSL *ssl, unsigned char key_name[16], unsigned char *iv,
+					   EVP_CIPHER_CTX *cipher_ctx, EVP_MAC_CTX *hmac_ctx, int enc)
+#else
+static int tls_cache_session_ticket_key_cb(SSL *ssl, unsigned char key_name[16], unsigned char *iv,
+					   EVP_CIPHER_CTX *cipher_ctx, HMAC_CTX *hmac_ctx, int enc)
+#endif
+{
+	fr_tls_cache_conf_t const	*cache_conf = &fr_tls_session_conf(ssl)->cache;
+	tls_cache_ticket_key_t		key;
+	uint64_t			rotation = fr_time_delta_to_sec(cache_conf->session_ticket_key_rotation);
+	uint64_t			period = fr_unix_time_to_sec(fr_time_to_unix_time(fr_time())) / rotation;
+	int				ret = 1;
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	OSSL_PARAM			params[] = {
+						OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST,
+										 UNCONST(char *, "SHA256"), 0),
+						OSSL_PARAM_construct_end()
+					};
+#endif
+
+	static_assert(sizeof(key.tag) + sizeof(uint64_t) == 16, "Session ticket key name must be 16 bytes");
+
+	if (enc) {
+		if (tls_cache_session_ticket_key_period(&key, cache_conf, period) < 0) return -1;
+
+		memcpy(key_name, key.tag, sizeof(key.tag));
+		fr_nbo_from_uint64(key_name + sizeof(key.tag), period);
+
+		if (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1) goto error;
+		if (EVP_EncryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), NULL, key.aes_key, iv) != 1) goto error;
+	} else {
+		uint64_t ticket_period = fr_nbo_to_uint64(key_name + sizeof(key.tag));
+
+		/*
+		 *	Don't bother deriving keys for tickets from
+		 *	the future, or tickets which were issued
+		 *	before any session could still be resumed.
+		 */
+		if ((ticket_period > period) ||
+		    ((period - ticket_period) > ((fr_time_delta_to_sec(cache_conf->lifetime) / rotation) + 1))) return 0;
+
+		if (tls_cache_session_ticket_key_period(&key, cache_conf, ticket_period) < 0) return -1;
+
+		if (CRYPTO_memcmp(key.tag, key_name, sizeof(key.tag)) != 0) {
+			OPENSSL_cleanse(&key, sizeof(key));
+			return 0;
+		}
+
+		if (EVP_DecryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), NULL, key.aes_key, iv) != 1) goto error;
+
+		if (ticket_period != period) ret = 2;
+	}
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	if (EVP_MAC_init(hmac_ctx, key.hmac_key, sizeof(key.hmac_key), params) != 1) goto error;
+#else
+	if (HMAC_Init_ex(hmac_ctx, key.hmac_key, sizeof(key.hmac_key), EVP_sha256(), NULL) != 1) goto error;
+#endif
+	OPENSSL_cleanse(&key, sizeof(key));
+
+	return ret;
+
+error:
+	fr_tls_strerror_printf(NULL);
+	PERROR("Failed initialising session ticket %s", enc ? "encryption" : "decryption");
+	OPENSSL_cleanse(&key, sizeof(key));
+
+	return -1;
+}
+
 /** Sets callbacks and flags on a SSL_CTX to enable/disable session resumption
  *
  * @param[in] ctx			to modify.
@@ -1406,10 +1971,26 @@ int fr_tls_cache_ctx_init(SSL_CTX *ctx, fr_tls_cache_conf_t const *cache_conf)
 	{
 		size_t key_len;
 		uint8_t *key_buff;
-		EVP_PKEY_CTX *pkey_ctx = NULL;
 
 		if (!(cache_conf->mode & FR_TLS_CACHE_STATEFUL)) tls_cache_disable_statefull_resumption(ctx);
 
+		/*
+		 *	Keys are derived from the session_ticket_key
+		 *	as tickets are encrypted and decrypted.
+		 */
+		if (fr_time_delta_ispos(cache_conf->session_ticket_key_rotation)) {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+			if (unlikely(SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, tls_cache_session_ticket_key_cb) != 1)) {
+#else
+			if (unlikely(SSL_CTX_set_tlsext_ticket_key_cb(ctx, tls_cache_session_ticket_key_cb) != 1)) {
+#endif
+				fr_tls_strerror_printf(NULL);
+				PERROR("Failed setting session ticket key callback");
+				return -1;
+			}
+			goto ticket_cb;
+		}
+
 		/*
 		 *	If keys is NULL, then OpenSSL returns the expected
 		 *	key length, which may be different across diferent
@@ -1421,53 +2002,18 @@ int fr_tls_cache_ctx_init(SSL_CTX *ctx, fr_tls_cache_conf_t const *cache_conf)
 		 */
 		key_len = SSL_CTX_set_tlsext_ticket_keys(ctx, NULL, 0);
 
-		if (unlikely((pkey_ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, NULL)) == NULL)) {
-			fr_tls_strerror_printf(NULL);
-			PERROR("Failed initialising KDF");
-		kdf_error:
-			if (pkey_ctx) EVP_PKEY_CTX_free(pkey_ctx);
-			return -1;
-		}
-		if (unlikely(EVP_PKEY_derive_init(pkey_ctx) != 1)) {
-			fr_tls_strerror_printf(NULL);
-			PERROR("Failed initialising KDF derivation ctx");
-			goto kdf_error;
-		}
-		if (unlikely(EVP_PKEY_CTX_set_hkdf_md(pkey_ctx, UNCONST(struct evp_md_st *, EVP_sha256())) != 1)) {
-			fr_tls_strerror_printf(NULL);
-			PERROR("Failed setting KDF MD");
-			goto kdf_error;
-		}
-		if (unlikely(EVP_PKEY_CTX_set1_hkdf_key(pkey_ctx,
-							UNCONST(unsigned char *, cache_conf->session_ticket_key),
-							talloc_array_length(cache_conf->session_ticket_key)) != 1)) {
-			fr_tls_strerror_printf(NULL);
-			PERROR("Failed setting KDF key");
-			goto kdf_error;
-		}
-		if (unlikely(EVP_PKEY_CTX_add1_hkdf_info(pkey_ctx,
-							 UNCONST(unsigned char *, "freeradius-session-ticket"),
-							 sizeof("freeradius-session-ticket") - 1) != 1)) {
-			fr_tls_strerror_printf(NULL);
-			PERROR("Failed setting KDF label");
-			goto kdf_error;
-		}
-
 		/*
 		 *	SSL_CTX_set_tlsext_ticket_keys memcpys its
 		 *	inputs so this is just a temporary buffer.
 		 */
 		MEM(key_buff = talloc_array(NULL, uint8_t, key_len));
-		if (EVP_PKEY_derive(pkey_ctx, key_buff, &key_len) != 1) {
-			fr_tls_strerror_printf(NULL);
-			PERROR("Failed deriving session ticket key");
-
+		if (tls_cache_session_ticket_key_derive(key_buff, key_len, cache_conf,
+							(uint8_t const *)"freeradius-session-ticket",
+							sizeof("freeradius-session-ticket") - 1) < 0) {
 			talloc_free(key_buff);
-			goto kdf_error;
+			return -1;
 		}
-		EVP_PKEY_CTX_free(pkey_ctx);
 
-		fr_assert(talloc_array_length(key_buff) == key_len);
 		/*
 		 *	Ensure the same keys are used across all threads
 		 */
@@ -1482,6 +2028,7 @@ int fr_tls_cache_ctx_init(SSL_CTX *ctx, fr_tls_cache_conf_t const *cache_conf)
 		HEXDUMP3(key_buff, key_len, NULL);
 		talloc_free(key_buff);
 
+	ticket_cb:
 		/*
 		 *	These callbacks embed and extract the
 		 *	session-state list from the session-ticket.
@@ -0,0 +1,475 @@
+/*
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Lesser General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2.1 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *   Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Tests for the in-memory session store, and session ticket key rotation
+ *
+ * @file src/lib/tls/cache_tests.c
+ * @copyright 2026 The FreeRADIUS server project
+ */
+#define USE_CONSTRUCTOR
+
+#ifdef USE_CONSTRUCTOR
+static void test_init(void) __attribute__((constructor));
+#else
+static void test_init(void);
+#  define TEST_INIT  test_init()
+#endif
+
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+
+#include "cache.c"
+
+/*
+ *	Only needed by the code which runs the session
+ *	virtual server, which isn't tested here.
+ */
+fr_dict_t const *dict_tls;
+fr_dict_attr_t const *attr_allow_session_resumption;
+fr_dict_attr_t const *attr_tls_packet_type;
+fr_dict_attr_t const *attr_tls_session_data;
+fr_dict_attr_t const *attr_tls_session_id;
+fr_dict_attr_t const *attr_tls_session_ttl;
+
+static TALLOC_CTX	*autofree;
+static SSL_CTX		*ssl_ctx;
+static SSL_CIPHER const	*cipher;
+
+/** Global initialisation
+ */
+static void test_init(void)
+{
+	autofree = talloc_autofree_context();
+	if (!autofree) {
+	error:
+		fr_perror("cache_tests");
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	if (fr_time_start() < 0) goto error;
+
+	if (fr_openssl_init() < 0) goto error;
+
+	ssl_ctx = SSL_CTX_new(TLS_server_method());
+	if (!ssl_ctx) goto error;
+
+	/*
+	 *	Sessions can't be serialised without one.
+	 */
+	cipher = sk_SSL_CIPHER_value(SSL_CTX_get_ciphers(ssl_ctx), 0);
+	if (!cipher) goto error;
+}
+
+/** Serialise a minimal session, as tls_cache_store_cb would
+ *
+ */
+static uint8_t *test_session(TALLOC_CTX *ctx, uint8_t const *id, size_t id_len)
+{
+	SSL_SESSION	*sess;
+	uint8_t		*data, *p;
+	int		len;
+
+	sess = SSL_SESSION_new();
+	TEST_ASSERT(sess != NULL);
+	TEST_ASSERT(SSL_SESSION_set1_id(sess, id, id_len) == 1);
+	TEST_ASSERT(SSL_SESSION_set_protocol_version(sess, TLS1_2_VERSION) == 1);
+	TEST_ASSERT(SSL_SESSION_set_cipher(sess, cipher) == 1);
+	TEST_ASSERT(SSL_SESSION_set1_master_key(sess, (uint8_t const *)"master key", sizeof("master key") - 1) == 1);
+
+	len = i2d_SSL_SESSION(sess, NULL);
+	TEST_ASSERT(len > 0);
+
+	data = p = talloc_array(ctx, uint8_t, len);
+	TEST_ASSERT(i2d_SSL_SESSION(sess, &p) == len);
+	SSL_SESSION_free(sess);
+
+	return data;
+}
+
+static void test_insert(fr_tls_cache_memory_t *store, uint32_t id, fr_time_t expires)
+{
+	uint8_t *data = test_session(NULL, (uint8_t *)&id, sizeof(id));
+
+	tls_cache_memory_insert(store, (uint8_t *)&id, sizeof(id), data, talloc_array_length(data), expires);
+	talloc_free(data);
+}
+
+static bool test_found(fr_tls_cache_memory_t *store, uint32_t id)
+{
+	SSL_SESSION		*sess;
+	unsigned int		len;
+	uint8_t const		*sess_id;
+
+	sess = tls_cache_memory_find(store, (uint8_t *)&id, sizeof(id));
+	if (!sess) return false;
+
+	sess_id = SSL_SESSION_get_id(sess, &len);
+	TEST_CHECK((len == sizeof(id)) && (memcmp(sess_id, &id, sizeof(id)) == 0));
+	SSL_SESSION_free(sess);
+
+	return true;
+}
+
+/** Find session IDs which hash to the same shard as the first one
+ *
+ */
+static void test_same_shard(fr_tls_cache_memory_t *store, uint32_t *ids, size_t num)
+{
+	tls_cache_memory_shard_t	*shard;
+	uint32_t			id = 0;
+	size_t				i;
+
+	shard = tls_cache_memory_shard(store, (uint8_t *)&id, sizeof(id));
+	ids[0] = id;
+
+	for (i = 1; i < num; i++) {
+		do {
+			id++;
+		} while (tls_cache_memory_shard(store, (uint8_t *)&id, sizeof(id)) != shard);
+		ids[i] = id;
+	}
+}
+
+static size_t test_num_entries(fr_tls_cache_memory_t *store)
+{
+	size_t i, num = 0;
+
+	for (i = 0; i < NUM_ELEMENTS(store->shard); i++) num += fr_rb_num_elements(store->shard[i]->tree);
+
+	return num;
+}
+
+static void test_memory_store_find(void)
+{
+	fr_tls_cache_memory_t	*store = fr_tls_cache_memory_alloc(autofree, 1024);
+	fr_time_t		expires = fr_time_add(fr_time(), fr_time_delta_from_sec(60));
+	uint32_t		i;
+
+	for (i = 0; i < 100; i++) test_insert(store, i, expires);
+
+	for (i = 0; i < 100; i++) {
+		TEST_CHECK(test_found(store, i));
+		TEST_MSG("Session %u should have been found", i);
+	}
+	TEST_CHECK(!test_found(store, 100));
+
+	/*
+	 *	Replacing a session doesn't duplicate it.
+	 */
+	test_insert(store, 0, expires);
+	TEST_CHECK(test_found(store, 0));
+	TEST_CHECK(test_num_entries(store) == 100);
+
+	tls_cache_memory_delete(store, (uint8_t *)&(uint32_t){ 0 }, sizeof(uint32_t));
+	TEST_CHECK(!test_found(store, 0));
+	TEST_CHECK(test_found(store, 1));
+	TEST_CHECK(test_num_entries(store) == 99);
+
+	talloc_free(store);
+}
+
+static void test_memory_store_eviction(void)
+{
+	/*
+	 *	Two entries per shard.
+	 */
+	fr_tls_cache_memory_t	*store = fr_tls_cache_memory_alloc(autofree, TLS_CACHE_MEMORY_SHARDS * 2);
+	fr_time_t		expires = fr_time_add(fr_time(), fr_time_delta_from_sec(60));
+	uint32_t		ids[3];
+
+	test_same_shard(store, ids, NUM_ELEMENTS(ids));
+
+	test_insert(store, ids[0], expires);
+	test_insert(store, ids[1], expires);
+	TEST_CHECK(test_found(store, ids[0]));
+	TEST_CHECK(test_found(store, ids[1]));
+
+	/*
+	 *	ids[1] was used least recently, so it's the
+	 *	one which is evicted.
+	 */
+	TEST_CHECK(test_found(store, ids[0]));
+	test_insert(store, ids[2], expires);
+
+	TEST_CHECK(test_found(store, ids[0]));
+	TEST_CHECK(!test_found(store, ids[1]));
+	TEST_MSG("Least recently used session should have been evicted");
+	TEST_CHECK(test_found(store, ids[2]));
+
+	TEST_CHECK(fr_rb_num_elements(tls_cache_memory_shard(store, (uint8_t *)&ids[0], sizeof(ids[0]))->tree) == 2);
+
+	talloc_free(store);
+}
+
+static void test_memory_store_expiry(void)
+{
+	fr_tls_cache_memory_t		*store = fr_tls_cache_memory_alloc(autofree, 1024);
+	fr_time_t			now = fr_time();
+	uint32_t			id = 1;
+	tls_cache_memory_shard_t	*shard = tls_cache_memory_shard(store, (uint8_t *)&id, sizeof(id));
+
+	test_insert(store, id, fr_time_sub(now, fr_time_delta_from_sec(1)));
+	TEST_CHECK(fr_rb_num_elements(shard->tree) == 1);
+
+	/*
+	 *	Expired sessions aren't returned, and are removed
+	 *	when they're found.
+	 */
+	TEST_CHECK(!test_found(store, id));
+	TEST_CHECK(fr_rb_num_elements(shard->tree) == 0);
+	TEST_CHECK(fr_dlist_num_elements(&shard->lru) == 0);
+
+	test_insert(store, id, fr_time_add(now, fr_time_delta_from_sec(60)));
+	TEST_CHECK(test_found(store, id));
+
+	talloc_free(store);
+}
+
+/** Set up a TLS session which uses ticket key rotation
+ *
+ */
+static SSL *test_ticket_ssl(fr_tls_conf_t **conf_out)
+{
+	fr_tls_conf_t	*conf;
+	SSL		*ssl;
+
+	conf = talloc_zero(autofree, fr_tls_conf_t);
+	conf->cache.session_ticket_key = talloc_memdup(conf, "not a very secret key", sizeof("not a very secret key") - 1);
+	conf->cache.session_ticket_key_rotation = fr_time_delta_from_sec(3600);
+	conf->cache.lifetime = fr_time_delta_from_sec(86400);
+
+	ssl = SSL_new(ssl_ctx);
+	TEST_ASSERT(ssl != NULL);
+	SSL_set_ex_data(ssl, FR_TLS_EX_INDEX_CONF, conf);
+
+	*conf_out = conf;
+	return ssl;
+}
+
+static uint64_t test_ticket_period(fr_tls_conf_t const *conf)
+{
+	return fr_unix_time_to_sec(fr_time_to_unix_time(fr_time())) /
+	       fr_time_delta_to_sec(conf->cache.session_ticket_key_rotation);
+}
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+typedef EVP_MAC_CTX test_hmac_ctx_t;
+
+static test_hmac_ctx_t *test_hmac_ctx_alloc(void)
+{
+	EVP_MAC		*mac = EVP_MAC_fetch(NULL, "HMAC", NULL);
+	EVP_MAC_CTX	*ctx;
+
+	TEST_ASSERT(mac != NULL);
+	ctx = EVP_MAC_CTX_new(mac);
+	EVP_MAC_free(mac);
+
+	return ctx;
+}
+
+static size_t test_hmac_final(test_hmac_ctx_t *ctx, uint8_t const *in, size_t in_len, uint8_t out[EVP_MAX_MD_SIZE])
+{
+	size_t len;
+
+	TEST_CHECK(EVP_MAC_update(ctx, in, in_len) == 1);
+	TEST_CHECK(EVP_MAC_final(ctx, out, &len, EVP_MAX_MD_SIZE) == 1);
+
+	return len;
+}
+#  define test_hmac_ctx_free EVP_MAC_CTX_free
+#else
+typedef HMAC_CTX test_hmac_ctx_t;
+
+#  define test_hmac_ctx_alloc HMAC_CTX_new
+
+static size_t test_hmac_final(test_hmac_ctx_t *ctx, uint8_t const *in, size_t in_len, uint8_t out[EVP_MAX_MD_SIZE])
+{
+	unsigned int len;
+
+	TEST_CHECK(HMAC_Update(ctx, in, in_len) == 1);
+	TEST_CHECK(HMAC_Final(ctx, out, &len) == 1);
+
+	return len;
+}
+#  define test_hmac_ctx_free HMAC_CTX_free
+#endif
+
+/** Encrypt a ticket body the way OpenSSL does, with the keys for a given period
+ *
+ */
+static size_t test_ticket_encrypt(uint8_t key_name[16], uint8_t iv[EVP_MAX_IV_LENGTH],
+				  uint8_t *out, uint8_t mac[EVP_MAX_MD_SIZE], size_t *mac_len,
+				  fr_tls_conf_t const *conf, uint64_t period, char const *plaintext)
+{
+	tls_cache_ticket_key_t	key;
+	EVP_CIPHER_CTX		*cipher_ctx = EVP_CIPHER_CTX_new();
+	int			len, final_len;
+	unsigned int		hmac_len;
+
+	TEST_ASSERT(tls_cache_session_ticket_key_period(&key, &conf->cache, period) == 0);
+	memcpy(key_name, key.tag, sizeof(key.tag));
+	fr_nbo_from_uint64(key_name + sizeof(key.tag), period);
+
+	TEST_ASSERT(RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) == 1);
+	TEST_ASSERT(EVP_EncryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), NULL, key.aes_key, iv) == 1);
+	TEST_ASSERT(EVP_EncryptUpdate(cipher_ctx, out, &len, (uint8_t const *)plaintext, strlen(plaintext)) == 1);
+	TEST_ASSERT(EVP_EncryptFinal_ex(cipher_ctx, out + len, &final_len) == 1);
+	EVP_CIPHER_CTX_free(cipher_ctx);
+	len += final_len;
+
+	TEST_ASSERT(HMAC(EVP_sha256(), key.hmac_key, sizeof(key.hmac_key), out, len, mac, &hmac_len) != NULL);
+	*mac_len = hmac_len;
+
+	return len;
+}
+
+/** Run the decryption side of the key callback, and check it recovers the ticket
+ *
+ * @return what the key callback returned.
+ */
+static int test_ticket_decrypt(SSL *ssl, uint8_t key_name[16], uint8_t iv[EVP_MAX_IV_LENGTH],
+			       uint8_t const *ciphertext, size_t ciphertext_len,
+			       uint8_t const *mac, size_t mac_len, char const *plaintext)
+{
+	EVP_CIPHER_CTX		*cipher_ctx = EVP_CIPHER_CTX_new();
+	test_hmac_ctx_t		*hmac_ctx = test_hmac_ctx_alloc();
+	uint8_t			out[256], our_mac[EVP_MAX_MD_SIZE];
+	int			ret, len, final_len;
+
+	ret = tls_cache_session_ticket_key_cb(ssl, key_name, iv, cipher_ctx, hmac_ctx, 0);
+	if (ret > 0) {
+		TEST_CHECK(test_hmac_final(hmac_ctx, ciphertext, ciphertext_len, our_mac) == mac_len);
+		TEST_CHECK(memcmp(our_mac, mac, mac_len) == 0);
+		TEST_MSG("Ticket HMAC doesn't match");
+
+		TEST_CHECK(EVP_DecryptUpdate(cipher_ctx, out, &len, ciphertext, ciphertext_len) == 1);
+		TEST_CHECK(EVP_DecryptFinal_ex(cipher_ctx, out + len, &final_len) == 1);
+		len += final_len;
+
+		TEST_CHECK((len == (int)strlen(plaintext)) && (memcmp(out, plaintext, len) == 0));
+		TEST_MSG("Ticket didn't decrypt to the original plaintext");
+	}
+
+	EVP_CIPHER_CTX_free(cipher_ctx);
+	test_hmac_ctx_free(hmac_ctx);
+
+	return ret;
+}
+
+static void test_ticket_current_key(void)
+{
+	fr_tls_conf_t	*conf;
+	SSL		*ssl = test_ticket_ssl(&conf);
+	uint8_t		key_name[16], iv[EVP_MAX_IV_LENGTH], ciphertext[256], mac[EVP_MAX_MD_SIZE];
+	size_t		len, mac_len;
+	uint64_t	period = test_ticket_period(conf);
+
+	len = test_ticket_encrypt(key_name, iv, ciphertext, mac, &mac_len, conf, period, "current ticket");
+
+	TEST_CHECK(test_ticket_decrypt(ssl, key_name, iv, ciphertext, len, mac, mac_len, "current ticket") == 1);
+	TEST_MSG("Tickets from the current period should be accepted without renewal");
+
+	SSL_free(ssl);
+	talloc_free(conf);
+}
+
+static void test_ticket_previous_key(void)
+{
+	fr_tls_conf_t	*conf;
+	SSL		*ssl = test_ticket_ssl(&conf);
+	uint8_t		key_name[16], iv[EVP_MAX_IV_LENGTH], ciphertext[256], mac[EVP_MAX_MD_SIZE];
+	size_t		len, mac_len;
+	uint64_t	period = test_ticket_period(conf);
+
+	/*
+	 *	Issued before the last rotation.
+	 */
+	len = test_ticket_encrypt(key_name, iv, ciphertext, mac, &mac_len, conf, period - 1, "previous ticket");
+
+	TEST_CHECK(test_ticket_decrypt(ssl, key_name, iv, ciphertext, len, mac, mac_len, "previous ticket") == 2);
+	TEST_MSG("Tickets from the previous period should be accepted, and renewed");
+
+	SSL_free(ssl);
+	talloc_free(conf);
+}
+
+static void test_ticket_rejected(void)
+{
+	fr_tls_conf_t	*conf;
+	SSL		*ssl = test_ticket_ssl(&conf);
+	uint8_t		key_name[16], iv[EVP_MAX_IV_LENGTH], ciphertext[256], mac[EVP_MAX_MD_SIZE];
+	size_t		len, mac_len;
+	uint64_t	period = test_ticket_period(conf);
+	uint64_t	periods = fr_time_delta_to_sec(conf->cache.lifetime) /
+				  fr_time_delta_to_sec(conf->cache.session_ticket_key_rotation);
+
+	/*
+	 *	Issued so long ago that the session can't be resumed.
+	 */
+	len = test_ticket_encrypt(key_name, iv, ciphertext, mac, &mac_len, conf, period - periods - 2, "old ticket");
+	TEST_CHECK(test_ticket_decrypt(ssl, key_name, iv, ciphertext, len, mac, mac_len, "old ticket") == 0);
+	TEST_MSG("Tickets older than the session lifetime should be rejected");
+
+	/*
+	 *	Issued in the future.
+	 */
+	len = test_ticket_encrypt(key_name, iv, ciphertext, mac, &mac_len, conf, period + 1, "future ticket");
+	TEST_CHECK(test_ticket_decrypt(ssl, key_name, iv, ciphertext, len, mac, mac_len, "future ticket") == 0);
+
+	/*
+	 *	Issued with a different session_ticket_key.
+	 */
+	len = test_ticket_encrypt(key_name, iv, ciphertext, mac, &mac_len, conf, period, "other ticket");
+	key_name[0] ^= 0xff;
+	TEST_CHECK(test_ticket_decrypt(ssl, key_name, iv, ciphertext, len, mac, mac_len, "other ticket") == 0);
+
+	SSL_free(ssl);
+	talloc_free(conf);
+}
+
+static void test_ticket_issue(void)
+{
+	fr_tls_conf_t	*conf;
+	SSL		*ssl = test_ticket_ssl(&conf);
+	uint8_t		key_name[16], iv[EVP_MAX_IV_LENGTH];
+	EVP_CIPHER_CTX	*cipher_ctx = EVP_CIPHER_CTX_new();
+	test_hmac_ctx_t	*hmac_ctx = test_hmac_ctx_alloc();
+
+	/*
+	 *	New tickets are issued with the key for the
+	 *	current period.
+	 */
+	TEST_CHECK(tls_cache_session_ticket_key_cb(ssl, key_name, iv, cipher_ctx, hmac_ctx, 1) == 1);
+	TEST_CHECK(fr_nbo_to_uint64(key_name + 8) == test_ticket_period(conf));
+
+	EVP_CIPHER_CTX_free(cipher_ctx);
+	test_hmac_ctx_free(hmac_ctx);
+	SSL_free(ssl);
+	talloc_free(conf);
+}
+
+TEST_LIST = {
+	{ "memory_store_find",		test_memory_store_find },
+	{ "memory_store_eviction",	test_memory_store_eviction },
+	{ "memory_store_expiry",	test_memory_store_expiry },
+
+	{ "ticket_issue",		test_ticket_issue },
+	{ "ticket_current_key",		test_ticket_current_key },
+	{ "ticket_previous_key",	test_ticket_previous_key },
+	{ "ticket_rejected",		test_ticket_rejected },
+
+	{ NULL }
+};
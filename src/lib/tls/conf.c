@@ -78,6 +78,12 @@ static fr_table_num_sorted_t const verify_mode_table[] = {
 };
 static size_t verify_mode_table_len = NUM_ELEMENTS(verify_mode_table);
 
+static CONF_PARSER tls_cache_memory_config[] = {
+	{ FR_CONF_OFFSET("max_entries", FR_TYPE_UINT32, fr_tls_cache_conf_t, memory.max_entries), .dflt = "0" },
+
+	CONF_PARSER_TERMINATOR
+};
+
 static CONF_PARSER tls_cache_config[] = {
 	{ FR_CONF_OFFSET("mode", FR_TYPE_UINT32, fr_tls_cache_conf_t, mode),
 			 .func = cf_table_parse_int,
@@ -96,6 +102,9 @@ static CONF_PARSER tls_cache_config[] = {
 #endif
 
 	{ FR_CONF_OFFSET("session_ticket_key", FR_TYPE_OCTETS, fr_tls_cache_conf_t, session_ticket_key) },
+	{ FR_CONF_OFFSET("session_ticket_key_rotation", FR_TYPE_TIME_DELTA, fr_tls_cache_conf_t, session_ticket_key_rotation), .dflt = "0" },
+
+	{ FR_CONF_POINTER("memory", FR_TYPE_SUBSECTION, NULL), .subcs = (void const *) tls_cache_memory_config },
 
 	/*
 	 *	Deprecated
@@ -153,6 +162,24 @@ static CONF_PARSER tls_verify_config[] = {
 	CONF_PARSER_TERMINATOR
 };
 
+#ifdef HAVE_OPENSSL_OCSP_H
+static CONF_PARSER ocsp_config[] = {
+	{ FR_CONF_OFFSET("enable", FR_TYPE_BOOL, fr_tls_ocsp_conf_t, enable), .dflt = "no" },
+
+	{ FR_CONF_OFFSET("override_cert_url", FR_TYPE_BOOL, fr_tls_ocsp_conf_t, override_url), .dflt = "no" },
+	{ FR_CONF_OFFSET("url", FR_TYPE_STRING, fr_tls_ocsp_conf_t, url) },
+	{ FR_CONF_OFFSET("use_nonce", FR_TYPE_BOOL, fr_tls_ocsp_conf_t, use_nonce), .dflt = "yes" },
+	{ FR_CONF_OFFSET("timeout", FR_TYPE_TIME_DELTA, fr_tls_ocsp_conf_t, timeout), .dflt = "0" },
+	{ FR_CONF_OFFSET("softfail", FR_TYPE_BOOL, fr_tls_ocsp_conf_t, softfail), .dflt = "no" },
+	{ FR_CONF_OFFSET("verifycert", FR_TYPE_BOOL, fr_tls_ocsp_conf_t, verifycert), .dflt = "yes" },
+
+	{ FR_CONF_OFFSET("cache_responses", FR_TYPE_BOOL, fr_tls_ocsp_conf_t, cache_responses), .dflt = "yes" },
+	{ FR_CONF_OFFSET("cache_max_entries", FR_TYPE_UINT32, fr_tls_ocsp_conf_t, cache_max_entries), .dflt = "4096" },
+
+	CONF_PARSER_TERMINATOR
+};
+#endif
+
 CONF_PARSER fr_tls_server_config[] = {
 	{ FR_CONF_OFFSET("virtual_server", FR_TYPE_VOID, fr_tls_conf_t, virtual_server), .func = virtual_server_cf_parse },
 
@@ -198,6 +225,12 @@ CONF_PARSER fr_tls_server_config[] = {
 
 	{ FR_CONF_OFFSET("verify", FR_TYPE_SUBSECTION, fr_tls_conf_t, verify), .subcs = (void const *) tls_verify_config },
 
+#ifdef HAVE_OPENSSL_OCSP_H
+	{ FR_CONF_OFFSET("ocsp", FR_TYPE_SUBSECTION, fr_tls_conf_t, ocsp), .subcs = (void const *) ocsp_config },
+
+	{ FR_CONF_OFFSET("staple", FR_TYPE_SUBSECTION, fr_tls_conf_t, staple), .subcs = (void const *) ocsp_config },
+#endif
+
 	{ FR_CONF_DEPRECATED("check_cert_issuer", FR_TYPE_STRING, fr_tls_conf_t, check_cert_issuer) },
 	{ FR_CONF_DEPRECATED("check_cert_cn", FR_TYPE_STRING, fr_tls_conf_t, check_cert_cn) },
 	CONF_PARSER_TERMINATOR
@@ -339,6 +372,13 @@ static X509_STORE *conf_ocsp_revocation_store(fr_tls_conf_t *conf)
  */
 static int _conf_server_free(fr_tls_conf_t *conf)
 {
+#ifdef HAVE_OPENSSL_OCSP_H
+	if (conf->ocsp.store) X509_STORE_free(conf->ocsp.store);
+	conf->ocsp.store = NULL;
+	if (conf->staple.store) X509_STORE_free(conf->staple.store);
+	conf->staple.store = NULL;
+#endif
+
 	memset(conf, 0, sizeof(*conf));
 	return 0;
 }
@@ -390,6 +430,11 @@ fr_tls_conf_t *fr_tls_conf_parse_server(CONF_SECTION *cs)
 
 	FR_INTEGER_BOUND_CHECK("padding", conf->padding_block_size, <=, SSL3_RT_MAX_PLAIN_LENGTH);
 
+	if (fr_time_delta_ispos(conf->cache.session_ticket_key_rotation)) {
+		FR_TIME_DELTA_BOUND_CHECK("session.session_ticket_key_rotation",
+					  conf->cache.session_ticket_key_rotation, >=, fr_time_delta_from_sec(60));
+	}
+
 #ifdef __APPLE__
 	if (conf_cert_admin_password(conf) < 0) goto error;
 #endif
@@ -405,6 +450,17 @@ fr_tls_conf_t *fr_tls_conf_parse_server(CONF_SECTION *cs)
 		break;
 
 	case FR_TLS_CACHE_STATEFUL:
+		if (conf->tls_min_version >= (float)1.3) {
+			ERROR("cache.mode = \"stateful\" is not supported with tls_min_version >= 1.3");
+			goto error;
+		}
+
+		/*
+		 *	Sessions are stored in memory, the
+		 *	virtual server isn't used.
+		 */
+		if (conf->cache.memory.max_entries > 0) break;
+
 		if (!conf->virtual_server) {
 			ERROR("A virtual_server must be set when cache.mode = \"stateful\"");
 			goto error;
@@ -427,14 +483,14 @@ fr_tls_conf_t *fr_tls_conf_parse_server(CONF_SECTION *cs)
 			      "when cache.mode = \"stateful\"");
 			goto error;
 		}
-
-		if (conf->tls_min_version >= (float)1.3) {
-			ERROR("cache.mode = \"stateful\" is not supported with tls_min_version >= 1.3");
-			goto error;
-		}
 		break;
 
 	case FR_TLS_CACHE_AUTO:
+		if (conf->cache.memory.max_entries > 0) {
+			if (conf->tls_min_version >= (float)1.3) goto cache_stateless;
+			break;
+		}
+
 		if (!conf->virtual_server) {
 			WARN("A virtual_server must be provided for stateful caching. "
 			     "cache.mode = \"auto\" rewritten to cache.mode = \"stateless\"");
@@ -469,6 +525,48 @@ fr_tls_conf_t *fr_tls_conf_parse_server(CONF_SECTION *cs)
 		break;
 	}
 
+	/*
+	 *	Allocate the in-memory session store.  This is
+	 *	shared by all the SSL_CTXs created from this
+	 *	configuration, i.e. by all the worker threads.
+	 */
+	if ((conf->cache.mode & FR_TLS_CACHE_STATEFUL) && (conf->cache.memory.max_entries > 0)) {
+		conf->cache.memory.store = fr_tls_cache_memory_alloc(conf, conf->cache.memory.max_entries);
+		if (!conf->cache.memory.store) goto error;
+	}
+
+#ifdef HAVE_OPENSSL_OCSP_H
+	/*
+	 *	@fixme:  This is all pretty terrible.
+	 *	The stores initialized here are for validating
+	 *	OCSP responses.  They have nothing to do with
+	 *	verifying other certificates.
+	 */
+
+	/*
+	 * 	Initialize OCSP Revocation Store
+	 */
+	if (conf->ocsp.enable) {
+		conf->ocsp.store = conf_ocsp_revocation_store(conf);
+		if (conf->ocsp.store == NULL) goto error;
+
+		if (conf->ocsp.cache_responses) {
+			conf->ocsp.resp_cache = fr_tls_ocsp_cache_alloc(conf, conf->ocsp.cache_max_entries);
+			if (!conf->ocsp.resp_cache) goto error;
+		}
+	}
+
+	if (conf->staple.enable) {
+		conf->staple.store = conf_ocsp_revocation_store(conf);
+		if (conf->staple.store == NULL) goto error;
+
+		if (conf->staple.cache_responses) {
+			conf->staple.resp_cache = fr_tls_ocsp_cache_alloc(conf, conf->staple.cache_max_entries);
+			if (!conf->staple.resp_cache) goto error;
+		}
+	}
+#endif /*HAVE_OPENSSL_OCSP_H*/
+
 	/*
 	 *	Generate random, ephemeral, session-ticket keys.
 	 */
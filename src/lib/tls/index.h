@@ -34,6 +34,7 @@ extern "C" {
 #define FR_TLS_EX_INDEX_REQUEST			(12)
 #define FR_TLS_EX_INDEX_IDENTITY		(13)
 #define FR_TLS_EX_INDEX_OCSP_STORE		(14)
+#define FR_TLS_EX_INDEX_OCSP_PENDING		(15)
 #define FR_TLS_EX_INDEX_TLS_SESSION		(16)
 #define FR_TLS_EX_INDEX_TALLOC			(17)
 
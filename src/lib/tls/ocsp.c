@@ -0,0 +1,1218 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file tls/ocsp.c
+ * @brief Validate client certificates using an OCSP service.
+ *
+ * @copyright 2006-2016 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+USES_APPLE_DEPRECATED_API	/* OpenSSL API has been deprecated by Apple */
+
+#ifdef WITH_TLS
+#ifdef HAVE_OPENSSL_OCSP_H
+#define LOG_PREFIX "tls - ocsp"
+
+#include <freeradius-devel/server/pair.h>
+#include <freeradius-devel/util/debug.h>
+
+#include <freeradius-devel/util/misc.h>
+
+#include <freeradius-devel/unlang/function.h>
+#include <freeradius-devel/unlang/interpret.h>
+
+#include <freeradius-devel/tls/openssl_user_macros.h>
+#include <openssl/async.h>
+#include <openssl/ocsp.h>
+
+#include "attrs.h"
+#include "base.h"
+#include "log.h"
+#include "utils.h"
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#  include <openssl/http.h>
+
+/*
+ *	The OCSP_REQ_CTX wrappers are deprecated in OpenSSL 3.0,
+ *	so use the OSSL_HTTP_REQ_CTX functions they wrap directly.
+ */
+#  define OCSP_REQ_CTX			OSSL_HTTP_REQ_CTX
+#  define OCSP_REQ_CTX_free		OSSL_HTTP_REQ_CTX_free
+#  define OCSP_REQ_CTX_add1_header	OSSL_HTTP_REQ_CTX_add1_header
+#  define OCSP_REQ_CTX_set1_req(_ctx, _req) \
+	OSSL_HTTP_REQ_CTX_set1_req(_ctx, "application/ocsp-request", \
+				   ASN1_ITEM_rptr(OCSP_REQUEST), (ASN1_VALUE const *)(_req))
+#  define OCSP_sendreq_nbio(_resp, _ctx) \
+	OSSL_HTTP_REQ_CTX_nbio_d2i(_ctx, (ASN1_VALUE **)(_resp), ASN1_ITEM_rptr(OCSP_RESPONSE))
+#endif
+
+/** Maximum leeway in validity period of OCSP response
+ *
+ * Default 5 minutes.
+ */
+#define OCSP_MAX_VALIDITY_PERIOD (5 * 60)
+
+DIAG_OFF(DIAG_UNKNOWN_PRAGMAS)
+DIAG_OFF(used-but-marked-unused)	/* fix spurious warnings for sk macros */
+/** Extract components of OCSP responser URL from a certificate
+ *
+ * @param[in] cert to extract URL from.
+ * @param[out] host_out Portion of the URL (must be freed with free()).
+ * @param[out] port_out Port portion of the URL (must be freed with free()).
+ * @param[out] path_out Path portion of the URL (must be freed with free()).
+ * @param[out] is_https Whether the responder should be contacted using https.
+ * @return
+ *	- 0 if no valid URL is contained in the certificate.
+ *	- 1 if a URL was found and parsed.
+ *	- -1 if at least one URL was found, but none could be parsed.
+ */
+static int ocsp_cert_url_parse(X509 *cert, char **host_out, char **port_out, char **path_out, int *is_https)
+{
+	int			i;
+	bool			found_uri = false;
+
+	AUTHORITY_INFO_ACCESS	*aia;
+	ACCESS_DESCRIPTION	*ad;
+
+	aia = X509_get_ext_d2i(cert, NID_info_access, NULL, NULL);
+
+	for (i = 0; i < sk_ACCESS_DESCRIPTION_num(aia); i++) {
+		ad = sk_ACCESS_DESCRIPTION_value(aia, i);
+		if (OBJ_obj2nid(ad->method) != NID_ad_OCSP) continue;
+		if (ad->location->type != GEN_URI) continue;
+		found_uri = true;
+
+		if (OCSP_parse_url((char *) ad->location->d.ia5->data, host_out,
+				   port_out, path_out, is_https)) return 1;
+	}
+	return found_uri ? -1 : 0;
+}
+DIAG_ON(used-but-marked-unused)
+DIAG_ON(DIAG_UNKNOWN_PRAGMAS)
+
+/** Set the OCSP TLS stapling extension for a SSL session, from cached response data
+ *
+ * @param ssl		The current SSL session.
+ * @param vp		containing the response.
+ * @return
+ *	- -1 on error.
+ *	- 0 on success.
+ */
+static int ocsp_staple_from_pair(request_t *request, SSL *ssl, fr_pair_t *vp)
+{
+	uint8_t *p;
+
+	/*
+	 *	OpenSSL should free the buffer itself.
+	 */
+	p = OPENSSL_malloc(vp->vp_length);
+	if (!p) return -1;
+
+	memcpy(p, vp->vp_octets, vp->vp_length);
+
+	RDEBUG2("Adding OCSP stapling extension");
+	if (SSL_set_tlsext_status_ocsp_resp(ssl, p, vp->vp_length) == 0) {
+		OPENSSL_free(p);
+		return -1;
+	}
+
+	return 0;
+}
+
+/** Store OCSP response as a TLS-OCSP-Response attribute
+ *
+ * @note Adds &request.TLS-OCSP-Response to the current request, and adds
+ *	stapling data to the current SSL session.
+ *
+ * @param out		Where to write the TLS-OCSP-Response attribute.  Will also
+ *			have been added to the request list of the current request.
+ * @param request 	The current request.
+ * @param resp		to serialize.
+ * @return
+ *	- -1 on error.
+ *	- 0 on success.
+ */
+static int ocsp_staple_to_pair(fr_pair_t **out, request_t *request, OCSP_RESPONSE *resp)
+{
+	fr_pair_t	*vp;
+	size_t		len;
+	uint8_t		*p;
+
+	if (!resp) {
+		REDEBUG("No OCSP response available");
+		return -1;
+	}
+
+	len = i2d_OCSP_RESPONSE(resp, NULL);
+	if (len <= 0) {
+		REDEBUG("Failed getting OCSP response length");
+		return -1;
+	}
+
+	MEM(pair_update_request(&vp, attr_tls_ocsp_response) >= 0);
+	MEM(fr_pair_value_mem_alloc(vp, &p, len, true) == 0);
+	len = i2d_OCSP_RESPONSE(resp, &p);
+	if (len <= 0) {
+		REDEBUG("Failed serialising OCSP response");
+		pair_delete_request(vp);
+		return -1;
+	}
+
+	RDEBUG2("Serializing OCSP response");
+	RINDENT();
+	RDEBUG2("&%pP", vp);
+	REXDENT();
+
+	*out = vp;
+
+	return 0;
+}
+
+typedef struct {
+	SSL			*ssl;
+	void			*data;
+	int			ret;
+} tls_ocsp_staple_cb_args_t;
+
+/** Run the stapling callback on the worker
+ *
+ */
+static void tls_ocsp_staple_cb_offload(UNUSED request_t *request, void *uctx)
+{
+	tls_ocsp_staple_cb_args_t *args = uctx;
+
+	args->ret = fr_tls_ocsp_staple_cb(args->ssl, args->data);
+}
+
+DIAG_OFF(DIAG_UNKNOWN_PRAGMAS)
+DIAG_OFF(used-but-marked-unused)	/* fix spurious warnings for sk macros */
+/** Callback used to get stapling data for the current server cert
+ *
+ * @param ssl	Current SSL session.
+ * @param data	OCSP configuration.
+ */
+int fr_tls_ocsp_staple_cb(SSL *ssl, void *data)
+{
+	fr_tls_ocsp_conf_t	*conf = data;	/* Alloced as part of fr_tls_conf_t (not talloced) */
+	request_t		*request = fr_tls_session_request(ssl);
+
+	X509			*cert;
+	X509			*issuer_cert;
+	X509_STORE		*server_store = NULL;
+	X509_STORE_CTX		*server_store_ctx = NULL;
+
+	STACK_OF(X509)		*our_chain = NULL;
+
+	int			ret;
+
+	tls_ocsp_staple_cb_args_t	args = { .ssl = ssl, .data = data };
+
+	if (fr_tls_offload_callback(tls_ocsp_staple_cb_offload, &args)) return args.ret;
+
+	cert = SSL_get_certificate(ssl);
+	if (!cert) {
+		fr_tls_log(request, "No server certificate found in SSL session");
+	error:
+		X509_STORE_CTX_free(server_store_ctx);
+		X509_STORE_free(server_store);
+
+		return conf->softfail ? SSL_TLSEXT_ERR_NOACK : SSL_TLSEXT_ERR_ALERT_FATAL;
+	}
+
+	/*
+	 *	Ignore the return code for older versions of
+	 *	OpenSSL.
+	 *
+	 *	https://github.com/openssl/openssl/pull/9395
+	 */
+	(void)SSL_get0_chain_certs(ssl, &our_chain);
+	if (!our_chain) {
+		fr_tls_log(request, "Failed retrieving chain certificates from current SSL session");
+		goto error;
+	}
+
+	/*
+	 *	Print out the current chain in the certificate store
+	 *	to help with debugging issues where we can't find the
+	 *	server cert's issuer.
+	 */
+	if (RDEBUG_ENABLED3) {
+		RDEBUG3("Current SSL session cert store contents");
+		RINDENT();
+		fr_tls_chain_log(request, L_DBG, our_chain, cert);
+		REXDENT();
+	}
+
+	MEM(server_store = X509_STORE_new());
+	X509_STORE_set_trust(server_store, 1);	/* All certs are trusted */
+
+	/*
+	 *	Add the chain certificates from the current SSL*
+	 *	to the trusted store so that we can determine
+	 *	the issuer cert of the certificate we presented.
+	 */
+	{
+		int num = sk_X509_num(our_chain);
+		int i;
+
+		for (i = 0; i < num; i++) {
+			if (X509_STORE_add_cert(server_store, sk_X509_value(our_chain, i)) != 1) {
+				fr_tls_log(request, "Failed adding certificate to trusted store");
+				goto error;
+			}
+		}
+	}
+
+	/*
+	 *	This is what OpenSSL uses to construct SSL chains
+	 *	for validation.  We just need to use it to find
+	 *	who issued our server certificate.
+	 */
+	MEM(server_store_ctx = X509_STORE_CTX_new());
+	if (X509_STORE_CTX_init(server_store_ctx, server_store, NULL, NULL) == 0) {
+		fr_tls_log(request, "Failed initialising SSL session cert store ctx");
+		goto error;
+	}
+
+	ret = X509_STORE_CTX_get1_issuer(&issuer_cert, server_store_ctx, cert);
+	if (ret != 1) {
+		X509_NAME	*subject;
+		X509_NAME	*issuer;
+		char		*subject_str;
+		char		*issuer_str;
+
+ 		subject = X509_get_subject_name(cert);
+		if (!subject) {
+			fr_tls_log(request, "Couldn't retrieve subject name of SSL session cert");
+			goto error;
+		}
+		MEM(subject_str = X509_NAME_oneline(subject, NULL, 0));
+
+		issuer = X509_get_issuer_name(cert);
+		if (!issuer) {
+			fr_tls_log(request, "Couldn't retrieve issuer name of SSL session cert");
+			OPENSSL_free(subject_str);
+			goto error;
+		}
+		MEM(issuer_str = X509_NAME_oneline(issuer, NULL, 0));
+
+		switch (ret) {
+		case 0:
+			fr_tls_log(request, "Issuer \"%s\" of \"%s\" not found in certificate store",
+				      issuer_str, subject_str);
+			break;
+		default:
+			fr_tls_log(request, "Error retrieving issuer \"%s\" of \"%s\" from certificate store",
+				      issuer_str, subject_str);
+			break;
+		}
+
+		OPENSSL_free(subject_str);
+		OPENSSL_free(issuer_str);
+		goto error;
+	}
+
+	fr_assert(issuer_cert);
+
+	switch (fr_tls_ocsp_check(request, ssl, server_store, issuer_cert, cert, conf, true)) {
+	default:
+	case FR_TLS_OCSP_STATUS_FAILED:		/* server cert is invalid */
+		ret = SSL_TLSEXT_ERR_ALERT_FATAL;
+		break;
+
+	case FR_TLS_OCSP_STATUS_OK:
+		ret = SSL_TLSEXT_ERR_OK;
+		break;
+
+	case FR_TLS_OCSP_STATUS_SKIPPED:
+		ret = SSL_TLSEXT_ERR_NOACK;
+		break;
+	}
+
+	X509_free(issuer_cert);	/* Decrement reference count on issuer cert */
+	X509_STORE_CTX_free(server_store_ctx);
+	X509_STORE_free(server_store);
+
+	return ret;
+}
+DIAG_ON(used-but-marked-unused)
+DIAG_ON(DIAG_UNKNOWN_PRAGMAS)
+
+/** A cached OCSP response
+ *
+ * Responses are definitive until their nextUpdate time, so there's no need
+ * to contact the responder again for the same certificate before then.
+ *
+ * The complete response is cached, not just the status, so that it can be
+ * verified again each time it's used.
+ */
+typedef struct {
+	fr_rb_node_t		node;			//!< Entry in the tree of cached responses.
+	fr_dlist_t		entry;			//!< Entry in the LRU list.
+
+	uint8_t			*id;			//!< DER encoded OCSP_CERTID.
+	size_t			id_len;			//!< Length of the certificate ID.
+
+	uint8_t			*resp;			//!< DER encoded OCSP response.
+	size_t			resp_len;		//!< Length of the response.
+
+	time_t			next_update;		//!< When the responder will have new information.
+} ocsp_cache_entry_t;
+
+/** Shared cache of OCSP responses
+ *
+ * Shared between all workers, so protected by a mutex.
+ */
+struct fr_tls_ocsp_cache_s {
+	pthread_mutex_t		mutex;			//!< Protects the tree and LRU list.
+	fr_rb_tree_t		*tree;			//!< Cached responses, keyed by certificate ID.
+	fr_dlist_head_t		lru;			//!< Least recently used entries at the tail.
+	uint32_t		max_entries;		//!< Maximum number of responses to cache.
+};
+
+/** State of an OCSP check
+ *
+ * Allocated by the libssl callback, and serviced asynchronously by
+ * #fr_tls_ocsp_pending_push whilst the callback is paused.
+ */
+typedef struct {
+	request_t		*request;		//!< Request the check is being performed for.
+	fr_tls_ocsp_conf_t	*conf;			//!< OCSP configuration.
+
+	OCSP_CERTID		*certid;		//!< ID of the certificate being checked.
+	OCSP_REQUEST		*req;			//!< OCSP request to send.
+	OCSP_RESPONSE		*resp;			//!< OCSP response received, or loaded from the cache.
+
+	char			*host;			//!< Host portion of the responder URL.
+	char			*port;			//!< Port portion of the responder URL.
+	char			*path;			//!< Path portion of the responder URL.
+	int			use_ssl;		//!< Whether the responder URL is https, which we refuse.
+
+	BIO			*conn;			//!< Non-blocking connection to the responder.
+	OCSP_REQ_CTX		*ctx;			//!< Outstanding HTTP exchange.
+	int			fd;			//!< Socket the exchange is running on.
+	fr_event_list_t		*el;			//!< Event list the socket is inserted into.
+	fr_event_timer_t const	*ev;			//!< Timeout for the exchange.
+
+	bool			pending;		//!< The exchange should be started by the next call
+							///< to #fr_tls_ocsp_pending_push.
+	bool			timed_out;		//!< The responder didn't respond in time.
+	int			rc;			//!< Result of the last call to OCSP_sendreq_nbio.
+} ocsp_check_t;
+
+static int8_t ocsp_cache_entry_cmp(void const *one, void const *two)
+{
+	ocsp_cache_entry_t const *a = one, *b = two;
+
+	MEMCMP_RETURN(a, b, id, id_len);
+
+	return 0;
+}
+
+static int _ocsp_cache_free(fr_tls_ocsp_cache_t *cache)
+{
+	pthread_mutex_destroy(&cache->mutex);
+
+	return 0;
+}
+
+/** Allocate a shared cache for OCSP responses
+ *
+ * @param[in] ctx		to allocate the cache in.
+ * @param[in] max_entries	Maximum number of responses to cache.
+ * @return
+ *	- A new cache.
+ *	- NULL on error.
+ */
+fr_tls_ocsp_cache_t *fr_tls_ocsp_cache_alloc(TALLOC_CTX *ctx, uint32_t max_entries)
+{
+	fr_tls_ocsp_cache_t *cache;
+
+	MEM(cache = talloc_zero(ctx, fr_tls_ocsp_cache_t));
+	cache->tree = fr_rb_inline_talloc_alloc(cache, ocsp_cache_entry_t, node, ocsp_cache_entry_cmp, NULL);
+	if (!cache->tree) {
+		talloc_free(cache);
+		return NULL;
+	}
+	fr_dlist_talloc_init(&cache->lru, ocsp_cache_entry_t, entry);
+	cache->max_entries = max_entries;
+
+	pthread_mutex_init(&cache->mutex, NULL);
+	talloc_set_destructor(cache, _ocsp_cache_free);
+
+	return cache;
+}
+
+static void ocsp_cache_entry_remove(fr_tls_ocsp_cache_t *cache, ocsp_cache_entry_t *c)
+{
+	fr_rb_delete_by_inline_node(cache->tree, &c->node);
+	fr_dlist_remove(&cache->lru, c);
+	talloc_free(c);
+}
+
+/** Lookup a cached response for the certificate being checked
+ *
+ * The response must be passed to #ocsp_response_verify before it's used.
+ *
+ * @param[in] ocsp	check being performed.  On a hit, the cached response
+ *			is loaded into ocsp->resp.
+ * @return
+ *	- 0 on a hit.
+ *	- -1 on a miss.
+ */
+static int ocsp_cache_find(ocsp_check_t *ocsp)
+{
+	request_t		*request = ocsp->request;
+	fr_tls_ocsp_cache_t	*cache = ocsp->conf->resp_cache;
+	ocsp_cache_entry_t	find, *c;
+	uint8_t			*id = NULL;
+	int			len;
+	int			ret = -1;
+
+	len = i2d_OCSP_CERTID(ocsp->certid, &id);
+	if (len <= 0) return -1;
+
+	find.id = id;
+	find.id_len = (size_t)len;
+
+	pthread_mutex_lock(&cache->mutex);
+	c = fr_rb_find(cache->tree, &find);
+	if (!c) goto done;
+
+	/*
+	 *	The responder has newer information,
+	 *	so this entry is no longer valid.
+	 */
+	if (c->next_update <= fr_time_to_sec(fr_time())) {
+		RDEBUG2("Cached OCSP response has expired");
+		ocsp_cache_entry_remove(cache, c);
+		goto done;
+	}
+
+	{
+		uint8_t const *p = c->resp;
+
+		ocsp->resp = d2i_OCSP_RESPONSE(NULL, &p, c->resp_len);
+		if (!ocsp->resp) goto done;
+	}
+
+	fr_dlist_remove(&cache->lru, c);
+	fr_dlist_insert_head(&cache->lru, c);
+
+	ret = 0;
+
+done:
+	pthread_mutex_unlock(&cache->mutex);
+	OPENSSL_free(id);
+
+	return ret;
+}
+
+/** Add a response to the shared cache
+ *
+ * Only definitive responses with a nextUpdate time are cached.
+ */
+static void ocsp_cache_insert(ocsp_check_t *ocsp, time_t next)
+{
+	request_t		*request = ocsp->request;
+	fr_tls_ocsp_cache_t	*cache = ocsp->conf->resp_cache;
+	ocsp_cache_entry_t	*c, *old;
+	uint8_t			*p;
+	int			len;
+
+	MEM(c = talloc_zero(NULL, ocsp_cache_entry_t));
+
+	len = i2d_OCSP_CERTID(ocsp->certid, NULL);
+	if (len <= 0) {
+	error:
+		talloc_free(c);
+		RWDEBUG("Failed caching OCSP response");
+		return;
+	}
+	MEM(c->id = p = talloc_array(c, uint8_t, len));
+	c->id_len = i2d_OCSP_CERTID(ocsp->certid, &p);
+
+	len = i2d_OCSP_RESPONSE(ocsp->resp, NULL);
+	if (len <= 0) goto error;
+	MEM(c->resp = p = talloc_array(c, uint8_t, len));
+	c->resp_len = i2d_OCSP_RESPONSE(ocsp->resp, &p);
+
+	c->next_update = next;
+
+	pthread_mutex_lock(&cache->mutex);
+	old = fr_rb_find(cache->tree, c);
+	if (old) ocsp_cache_entry_remove(cache, old);
+
+	while (cache->max_entries && (fr_rb_num_elements(cache->tree) >= cache->max_entries)) {
+		ocsp_cache_entry_remove(cache, fr_dlist_tail(&cache->lru));
+	}
+
+	talloc_steal(cache, c);
+	fr_rb_insert(cache->tree, c);
+	fr_dlist_insert_head(&cache->lru, c);
+	pthread_mutex_unlock(&cache->mutex);
+
+	RDEBUG2("Cached OCSP response until its nextUpdate time");
+}
+
+static int _ocsp_check_free(ocsp_check_t *ocsp)
+{
+	if (ocsp->fd >= 0) (void) fr_event_fd_delete(ocsp->el, ocsp->fd, FR_EVENT_FILTER_IO);
+	OCSP_REQ_CTX_free(ocsp->ctx);
+	BIO_free_all(ocsp->conn);
+	OCSP_REQUEST_free(ocsp->req);	/* Frees certid too */
+	OCSP_RESPONSE_free(ocsp->resp);
+	OPENSSL_free(ocsp->host);
+	OPENSSL_free(ocsp->port);
+	OPENSSL_free(ocsp->path);
+
+	return 0;
+}
+
+static void ocsp_fd_io(fr_event_list_t *el, int fd, int flags, void *uctx);
+
+/** Advance the HTTP exchange with the responder
+ *
+ * @return
+ *	- 1 if the exchange is complete, or failed.
+ *	- 0 if we need to wait for the socket.
+ */
+static int ocsp_io(ocsp_check_t *ocsp)
+{
+	request_t	*request = ocsp->request;
+
+	ocsp->rc = OCSP_sendreq_nbio(&ocsp->resp, ocsp->ctx);
+	if ((ocsp->rc != -1) || !BIO_should_retry(ocsp->conn)) return 1;
+
+	if (ocsp->fd < 0) {
+		if (BIO_get_fd(ocsp->conn, &ocsp->fd) < 0) {
+			REDEBUG("Failed getting OCSP responder socket");
+			ocsp->rc = 0;
+			return 1;
+		}
+	} else {
+		(void) fr_event_fd_delete(ocsp->el, ocsp->fd, FR_EVENT_FILTER_IO);
+	}
+
+	/*
+	 *	Only wait for the direction OpenSSL needs,
+	 *	otherwise we'd spin on a writable socket.
+	 */
+	if (fr_event_fd_insert(ocsp, ocsp->el, ocsp->fd,
+			       BIO_should_read(ocsp->conn) ? ocsp_fd_io : NULL,
+			       BIO_should_write(ocsp->conn) ? ocsp_fd_io : NULL,
+			       NULL, ocsp) < 0) {
+		RPEDEBUG("Failed inserting OCSP responder socket into event loop");
+		ocsp->fd = -1;
+		ocsp->rc = 0;
+		return 1;
+	}
+
+	return 0;
+}
+
+static void ocsp_fd_io(UNUSED fr_event_list_t *el, UNUSED int fd, UNUSED int flags, void *uctx)
+{
+	ocsp_check_t	*ocsp = talloc_get_type_abort(uctx, ocsp_check_t);
+
+	if (ocsp_io(ocsp) == 0) return;
+
+	unlang_interpret_mark_runnable(ocsp->request);
+}
+
+static void ocsp_timeout(UNUSED fr_event_list_t *el, UNUSED fr_time_t now, void *uctx)
+{
+	ocsp_check_t	*ocsp = talloc_get_type_abort(uctx, ocsp_check_t);
+
+	ocsp->timed_out = true;
+	unlang_interpret_mark_runnable(ocsp->request);
+}
+
+/** Stop waiting for the responder
+ *
+ */
+static void ocsp_exchange_done(ocsp_check_t *ocsp)
+{
+	if (ocsp->fd >= 0) {
+		(void) fr_event_fd_delete(ocsp->el, ocsp->fd, FR_EVENT_FILTER_IO);
+		ocsp->fd = -1;
+	}
+	if (ocsp->ev) fr_event_timer_delete(&ocsp->ev);
+
+	OCSP_REQ_CTX_free(ocsp->ctx);
+	ocsp->ctx = NULL;
+	BIO_free_all(ocsp->conn);
+	ocsp->conn = NULL;
+}
+
+/** Resume the request once the exchange with the responder has completed
+ *
+ */
+static unlang_action_t ocsp_exchange_resume(UNUSED rlm_rcode_t *p_result, UNUSED int *priority,
+					    request_t *request, void *uctx)
+{
+	ocsp_check_t	*ocsp = talloc_get_type_abort(uctx, ocsp_check_t);
+
+	if (ocsp->timed_out) {
+		REDEBUG("Response timed out");
+		ocsp->rc = 0;
+	}
+
+	ocsp_exchange_done(ocsp);
+
+	return UNLANG_ACTION_CALCULATE_RESULT;
+}
+
+static void ocsp_exchange_signal(request_t *request, fr_state_signal_t action, void *uctx)
+{
+	ocsp_check_t	*ocsp = talloc_get_type_abort(uctx, ocsp_check_t);
+
+	if (action != FR_SIGNAL_CANCEL) return;
+
+	RDEBUG2("Cancelling OCSP request");
+
+	ocsp_exchange_done(ocsp);
+}
+
+/** Start the exchange with the responder
+ *
+ * The socket is non-blocking and serviced by the request's event loop,
+ * so the worker can process other requests whilst we wait.
+ */
+static unlang_action_t ocsp_exchange_start(UNUSED rlm_rcode_t *p_result, UNUSED int *priority,
+					   request_t *request, void *uctx)
+{
+	ocsp_check_t	*ocsp = talloc_get_type_abort(uctx, ocsp_check_t);
+	char		host_header[1024];
+
+	ocsp->el = unlang_interpret_event_list(request);
+	ocsp->fd = -1;
+	ocsp->rc = 0;
+
+	RDEBUG2("Using responder URL \"http://%s:%s%s\"", ocsp->host, ocsp->port, ocsp->path);
+
+	/* Check host and port length are sane, then create Host: HTTP header */
+	if ((strlen(ocsp->host) + strlen(ocsp->port) + 2) > sizeof(host_header)) {
+		RWDEBUG("Host and port too long");
+		return UNLANG_ACTION_CALCULATE_RESULT;
+	}
+	snprintf(host_header, sizeof(host_header), "%s:%s", ocsp->host, ocsp->port);
+
+	/* Setup BIO socket to OCSP responder */
+	ocsp->conn = BIO_new_connect(ocsp->host);
+	if (!ocsp->conn) {
+		REDEBUG("Couldn't create connection to OCSP responder");
+		return UNLANG_ACTION_CALCULATE_RESULT;
+	}
+	BIO_set_conn_port(ocsp->conn, ocsp->port);
+	BIO_set_nbio(ocsp->conn, 1);
+
+	if ((BIO_do_connect(ocsp->conn) <= 0) && !BIO_should_retry(ocsp->conn)) {
+		REDEBUG("Couldn't connect to OCSP responder");
+		return UNLANG_ACTION_CALCULATE_RESULT;
+	}
+
+	ocsp->ctx = OCSP_sendreq_new(ocsp->conn, ocsp->path, NULL, -1);
+	if (!ocsp->ctx) {
+		REDEBUG("Couldn't create OCSP request");
+		return UNLANG_ACTION_CALCULATE_RESULT;
+	}
+
+	if (!OCSP_REQ_CTX_add1_header(ocsp->ctx, "Host", host_header)) {
+		REDEBUG("Couldn't set Host header");
+		return UNLANG_ACTION_CALCULATE_RESULT;
+	}
+
+	if (!OCSP_REQ_CTX_set1_req(ocsp->ctx, ocsp->req)) {
+		REDEBUG("Couldn't add data to OCSP request");
+		return UNLANG_ACTION_CALCULATE_RESULT;
+	}
+
+	if (ocsp_io(ocsp) == 1) return UNLANG_ACTION_CALCULATE_RESULT;
+
+	if (fr_time_delta_ispos(ocsp->conf->timeout) &&
+	    (fr_event_timer_in(ocsp, ocsp->el, &ocsp->ev, ocsp->conf->timeout, ocsp_timeout, ocsp) < 0)) {
+		RPEDEBUG("Failed inserting OCSP timeout");
+		ocsp_exchange_done(ocsp);
+		return UNLANG_ACTION_CALCULATE_RESULT;
+	}
+
+	return UNLANG_ACTION_YIELD;
+}
+
+/** Push any pending OCSP exchange
+ *
+ * Should be called when libssl returns SSL_ERROR_WANT_ASYNC, in the
+ * same way as #fr_tls_verify_cert_pending_push.
+ *
+ * @param[in] request		The current request.
+ * @param[in] tls_session	The current TLS session.
+ * @return
+ *	- UNLANG_ACTION_CALCULATE_RESULT	- No pending exchanges.
+ *	- UNLANG_ACTION_PUSHED_CHILD		- Exchange pushed.
+ *	- UNLANG_ACTION_FAIL			- Failed pushing the exchange.
+ */
+unlang_action_t fr_tls_ocsp_pending_push(request_t *request, fr_tls_session_t *tls_session)
+{
+	ocsp_check_t	*ocsp = SSL_get_ex_data(tls_session->ssl, FR_TLS_EX_INDEX_OCSP_PENDING);
+
+	if (!ocsp || !ocsp->pending) return UNLANG_ACTION_CALCULATE_RESULT;
+
+	ocsp->pending = false;
+
+	if (unlang_function_push(request, ocsp_exchange_start, ocsp_exchange_resume, ocsp_exchange_signal,
+				 UNLANG_SUB_FRAME, ocsp) < 0) return UNLANG_ACTION_FAIL;
+
+	return UNLANG_ACTION_PUSHED_CHILD;
+}
+
+/** Validate an OCSP response
+ *
+ * Cached responses are validated in the same way as responses from the
+ * responder, except for the nonce, which belonged to the request that
+ * originally retrieved the response.  The signature and the thisUpdate
+ * and nextUpdate times are always checked.
+ *
+ * @param[in] ocsp	check the response was received for.
+ * @param[in] store	to verify the response against.
+ * @param[in] ssl_log	to accumulate OpenSSL messages in.
+ * @param[out] next	nextUpdate time from the response, or 0 if there was none.
+ * @param[in] cached	whether the response came from the cache.
+ * @return The status of the certificate.
+ */
+static fr_tls_ocsp_status_t ocsp_response_verify(ocsp_check_t *ocsp, X509_STORE *store, BIO *ssl_log,
+						 time_t *next, int *cert_status, bool cached)
+{
+	request_t		*request = ocsp->request;
+	fr_tls_ocsp_conf_t	*conf = ocsp->conf;
+	OCSP_BASICRESP		*bresp = NULL;
+	int			status;
+	ASN1_GENERALIZEDTIME	*rev, *this_update, *next_update;
+	int			reason;
+	long			this_fudge = OCSP_MAX_VALIDITY_PERIOD, this_max_age = -1;
+	fr_tls_ocsp_status_t		ocsp_status = FR_TLS_OCSP_STATUS_FAILED;
+
+	*next = 0;
+	*cert_status = -1;
+
+	/* Verify OCSP response status */
+	status = OCSP_response_status(ocsp->resp);
+	if (status != OCSP_RESPONSE_STATUS_SUCCESSFUL) {
+		REDEBUG("Response status: %s", OCSP_response_status_str(status));
+		return FR_TLS_OCSP_STATUS_FAILED;
+	}
+	bresp = OCSP_response_get1_basic(ocsp->resp);
+	if (!bresp) {
+		REDEBUG("Response is not a basic OCSP response");
+		return FR_TLS_OCSP_STATUS_FAILED;
+	}
+
+	if (!cached && conf->use_nonce && OCSP_check_nonce(ocsp->req, bresp) != 1) {
+		REDEBUG("Response has wrong nonce value");
+		goto finish;
+	}
+
+	if (conf->verifycert) {
+		if (OCSP_basic_verify(bresp, NULL, store, 0) != 1){
+			REDEBUG("Couldn't verify OCSP basic response");
+			goto finish;
+		}
+	}
+
+	/*	Verify OCSP cert status */
+	if (!OCSP_resp_find_status(bresp, ocsp->certid, &status, &reason, &rev, &this_update, &next_update)) {
+		REDEBUG("No Status found");
+		goto finish;
+	}
+
+	/*
+	 *	Here we check the fields 'thisUpdate' and 'nextUpdate'
+	 *	from the OCSP response against the server's time.
+	 *
+	 *	this_fudge is the number of seconds +- between the current
+	 *	time and this_update.
+	 *
+	 *	The default for this_fudge is 300, defined by OCSP_MAX_VALIDITY_PERIOD.
+	 */
+	if (!OCSP_check_validity(this_update, next_update, this_fudge, this_max_age)) {
+		/*
+		 *	We want this to show up in the global log
+		 *	so someone will fix it...
+		 */
+		RATE_LIMIT_GLOBAL(RERROR, "Delta +/- between OCSP response time and our time is greater than %li "
+				  "seconds.  Check servers are synchronised to a common time source",
+				  this_fudge);
+		FR_OPENSSL_DRAIN_ERROR_QUEUE(REDEBUG, "", ssl_log);
+		goto finish;
+	}
+
+	/*
+	 *	Print any messages we may have accumulated
+	 */
+	FR_OPENSSL_DRAIN_ERROR_QUEUE(RDEBUG2, "", ssl_log);
+	if (RDEBUG_ENABLED) {
+		RDEBUG2("OCSP response valid from:");
+		ASN1_GENERALIZEDTIME_print(ssl_log, this_update);
+		RINDENT();
+		FR_OPENSSL_DRAIN_LOG_QUEUE(RDEBUG2, "", ssl_log);
+		REXDENT();
+
+		if (next_update) {
+			RDEBUG2("New information available at:");
+			ASN1_GENERALIZEDTIME_print(ssl_log, next_update);
+			RINDENT();
+			FR_OPENSSL_DRAIN_LOG_QUEUE(RDEBUG2, "", ssl_log);
+			REXDENT();
+		}
+	}
+
+	/*
+	 *	When an OCSP validation command is used with OpenSSL
+	 *	next_update is NULL.
+	 */
+	if (next_update && (fr_tls_utils_asn1time_to_epoch(next, next_update) < 0)) {
+		RPEDEBUG("Failed parsing next_update time");
+		ocsp_status = FR_TLS_OCSP_STATUS_SKIPPED;
+		goto finish;
+	}
+
+	*cert_status = status;
+
+	switch (status) {
+	case V_OCSP_CERTSTATUS_GOOD:
+		RDEBUG2("Cert status: good");
+		ocsp_status = FR_TLS_OCSP_STATUS_OK;
+		break;
+
+	default:
+		/* REVOKED / UNKNOWN */
+		REDEBUG("Cert status: %s", OCSP_cert_status_str(status));
+		if (reason != -1) REDEBUG("Reason: %s", OCSP_crl_reason_str(reason));
+
+		/*
+		 *	Print any messages we may have accumulated
+		 */
+		FR_OPENSSL_DRAIN_LOG_QUEUE(RDEBUG, "", ssl_log);
+		if (RDEBUG_ENABLED2) {
+			RDEBUG2("Revocation time:");
+			ASN1_GENERALIZEDTIME_print(ssl_log, rev);
+			RINDENT();
+			FR_OPENSSL_DRAIN_LOG_QUEUE(RDEBUG2, "", ssl_log);
+			REXDENT();
+		}
+		break;
+	}
+
+	/*
+	 *	Only cache responses we'll get again if
+	 *	we ask before nextUpdate.
+	 */
+	if (!cached && conf->resp_cache && *next && (status != V_OCSP_CERTSTATUS_UNKNOWN)) {
+		ocsp_cache_insert(ocsp, *next);
+	}
+
+finish:
+	OCSP_BASICRESP_free(bresp);
+
+	return ocsp_status;
+}
+
+/** Check the status of a certificate with an OCSP responder
+ *
+ * Must be called from a libssl callback.  If the responder needs to be
+ * contacted, the callback is paused with ASYNC_pause_job(), and the exchange
+ * is run by #fr_tls_ocsp_pending_push from the request's event loop.
+ */
+fr_tls_ocsp_status_t fr_tls_ocsp_check(request_t *request, SSL *ssl,
+				       X509_STORE *store, X509 *issuer_cert, X509 *client_cert,
+				       fr_tls_ocsp_conf_t *conf, bool staple_response)
+{
+	fr_tls_session_t	*tls_session = fr_tls_session(ssl);
+	ocsp_check_t		*ocsp = NULL;
+	BIO			*ssl_log = NULL;
+	fr_tls_ocsp_status_t	ocsp_status = FR_TLS_OCSP_STATUS_FAILED;
+	time_t			next = 0;
+
+	fr_pair_t		*vp;
+
+	/*
+	 *	Allow us to cache the OCSP verified state externally
+	 */
+	vp = fr_pair_find_by_da(&request->control_pairs, NULL, attr_tls_ocsp_cert_valid);
+	if (vp) switch (vp->vp_uint32) {
+	case 0:	/* no */
+		RDEBUG2("Found &control.TLS-OCSP-Cert-Valid = no, forcing OCSP failure");
+		return FR_TLS_OCSP_STATUS_FAILED;
+
+	case 1: /* yes */
+		RDEBUG2("Found &control.TLS-OCSP-Cert-Valid = yes, forcing OCSP success");
+
+		/*
+		 *	If this fails, and an OCSP stapled response is required,
+		 *	we need to run the full OCSP check.
+		 */
+		if (staple_response) {
+			vp = fr_pair_find_by_da(&request->control_pairs, NULL, attr_tls_ocsp_response);
+			if (!vp) {
+				RDEBUG2("No &control.TLS-OCSP-Response attribute found, performing full OCSP check");
+				break;
+			}
+			if (ocsp_staple_from_pair(request, ssl, vp) < 0) {
+				RWDEBUG("Failed setting OCSP staple response in SSL session");
+				return FR_TLS_OCSP_STATUS_FAILED;
+			}
+		}
+
+		return FR_TLS_OCSP_STATUS_OK;
+
+	case 2: /* skipped */
+		RDEBUG2("Found &control.TLS-OCSP-Cert-Valid = skipped, skipping OCSP check");
+		return conf->softfail ? FR_TLS_OCSP_STATUS_OK : FR_TLS_OCSP_STATUS_FAILED;
+
+	case 3: /* unknown */
+	default:
+		break;
+	}
+
+	/*
+	 *	Setup logging for this OCSP operation
+	 */
+	ssl_log = BIO_new(BIO_s_mem());
+	if (!ssl_log) {
+		REDEBUG("Failed creating log queue");
+		return conf->softfail ? FR_TLS_OCSP_STATUS_OK : FR_TLS_OCSP_STATUS_FAILED;
+	}
+
+	if (issuer_cert == NULL) {
+		RWDEBUG("Could not get issuer certificate");
+		goto skipped;
+	}
+
+	MEM(ocsp = talloc_zero(request, ocsp_check_t));
+	talloc_set_destructor(ocsp, _ocsp_check_free);
+	ocsp->request = request;
+	ocsp->conf = conf;
+	ocsp->fd = -1;
+	ocsp->use_ssl = -1;
+
+	/*
+	 *	Create OCSP Request
+	 */
+	ocsp->certid = OCSP_cert_to_id(NULL, client_cert, issuer_cert);
+	ocsp->req = OCSP_REQUEST_new();
+	OCSP_request_add0_id(ocsp->req, ocsp->certid);
+	if (conf->use_nonce) OCSP_request_add1_nonce(ocsp->req, NULL, 8);
+
+	/*
+	 *	Another request may have already asked
+	 *	the responder about this certificate.
+	 *
+	 *	The cached response is verified again
+	 *	before we trust it.  If it's no longer
+	 *	acceptable, ask the responder instead.
+	 *	A valid response saying the certificate
+	 *	was revoked is as final as a good one.
+	 */
+	if (conf->resp_cache && (ocsp_cache_find(ocsp) == 0)) {
+		int cert_status;
+
+		RDEBUG2("Using cached OCSP response");
+
+		ocsp_status = ocsp_response_verify(ocsp, store, ssl_log, &next, &cert_status, true);
+		if ((ocsp_status == FR_TLS_OCSP_STATUS_OK) || (cert_status == V_OCSP_CERTSTATUS_REVOKED)) goto next_update;
+
+		RDEBUG2("Cached OCSP response not accepted, querying responder");
+		OCSP_RESPONSE_free(ocsp->resp);
+		ocsp->resp = NULL;
+		next = 0;
+		ocsp_status = FR_TLS_OCSP_STATUS_FAILED;
+	}
+
+	/* Get OCSP responder URL */
+	if (conf->override_url) {
+		char *url;
+
+	use_url:
+		memcpy(&url, &conf->url, sizeof(url));
+		/* Reading the libssl src, they do a strdup on the URL, so it could of been const *sigh* */
+		OCSP_parse_url(url, &ocsp->host, &ocsp->port, &ocsp->path, &ocsp->use_ssl);
+		if (!ocsp->host || !ocsp->port || !ocsp->path) {
+			RWDEBUG("Host or port or path missing from configured URL \"%s\".  Not doing OCSP", url);
+			goto skipped;
+		}
+	} else {
+		int ret;
+
+		ret = ocsp_cert_url_parse(client_cert, &ocsp->host, &ocsp->port, &ocsp->path, &ocsp->use_ssl);
+		switch (ret) {
+		case -1:
+			RWDEBUG("Invalid URL in certificate.  Not doing OCSP");
+			goto skipped;
+
+		case 0:
+			if (conf->url) {
+				RWDEBUG("No OCSP URL in certificate, falling back to configured URL");
+				goto use_url;
+			}
+			RWDEBUG("No OCSP URL in certificate.  Not doing OCSP");
+			goto skipped;
+
+		case 1:
+			fr_assert(ocsp->host && ocsp->port && ocsp->path);
+			break;
+		}
+	}
+
+	/*
+	 *	The exchange is plain HTTP.  Sending it to
+	 *	an https responder would only fail, or worse,
+	 *	reach something other than what was configured.
+	 */
+	if (ocsp->use_ssl == 1) {
+		RWDEBUG("OCSP responder \"%s\" uses https, which isn't supported.  Not doing OCSP", ocsp->host);
+		goto skipped;
+	}
+
+	/*
+	 *	Querying the responder inline would block
+	 *	the worker for the entire round trip.
+	 */
+	if (!tls_session->can_pause) {
+		RWDEBUG("Can't query OCSP responder outside of an async job");
+		goto skipped;
+	}
+
+	/*
+	 *	This sets the pending OCSP state of the SSL session
+	 *	so that when we call ASYNC_pause_job(), and execution
+	 *	jumps back to tls_session_async_handshake_cont
+	 *	(just under SSL_read()) the code there knows to push
+	 *	the exchange onto the unlang stack.
+	 */
+	ocsp->pending = true;
+	SSL_set_ex_data(ssl, FR_TLS_EX_INDEX_OCSP_PENDING, ocsp);
+
+	ASYNC_pause_job();
+
+	SSL_set_ex_data(ssl, FR_TLS_EX_INDEX_OCSP_PENDING, NULL);
+
+	/*
+	 *	Just try and bail out as quickly as possible.
+	 */
+	if (unlang_request_is_cancelled(request)) {
+		talloc_free(ocsp);
+		BIO_free(ssl_log);
+		return FR_TLS_OCSP_STATUS_FAILED;
+	}
+
+	if (ocsp->rc != 1) {
+		REDEBUG("Couldn't get OCSP response");
+		FR_OPENSSL_DRAIN_ERROR_QUEUE(REDEBUG, "", ssl_log);
+		ocsp_status = FR_TLS_OCSP_STATUS_SKIPPED;
+		goto finish;
+	}
+
+	ocsp_status = ocsp_response_verify(ocsp, store, ssl_log, &next, &(int){ -1 }, false);
+
+next_update:
+	if (next) {
+		time_t now = fr_time_to_sec(fr_time());
+
+		if (now < next) {
+			RDEBUG2("Adding OCSP TTL attribute");
+
+			MEM(pair_update_request(&vp, attr_tls_ocsp_next_update) >= 0);
+			vp->vp_uint32 = next - now;
+			RINDENT();
+			RDEBUG2("&%pP", vp);
+			REXDENT();
+		} else {
+			RDEBUG2("Update time is in the past.  Not adding &TLS-OCSP-Next-Update");
+		}
+	} else {
+		RDEBUG2("Update time not provided.  Not adding &TLS-OCSP-Next-Update");
+	}
+
+finish:
+	switch (ocsp_status) {
+	case FR_TLS_OCSP_STATUS_OK:
+		RDEBUG2("Certificate is valid");
+
+		if (staple_response) {
+			/*
+			 *	Convert the OCSP response to a fr_pair_t
+			 *	and add it to the current request.
+			 */
+			if (ocsp_staple_to_pair(&vp, request, ocsp->resp) < 0) goto skipped;
+
+			/*
+			 *	Set the stapled response for the current
+			 *	SSL session.
+			 */
+			if (ocsp_staple_from_pair(request, ssl, vp) < 0) {
+				ocsp_status = FR_TLS_OCSP_STATUS_FAILED;
+				break;
+			}
+			vp = NULL;	/* It's in the request, don't need to free it! */
+		}
+
+		MEM(pair_update_request(&vp, attr_tls_ocsp_cert_valid) >= 0);
+		vp->vp_uint32 = 1;	/* yes */
+		ocsp_status = FR_TLS_OCSP_STATUS_OK;
+
+		break;
+
+	case FR_TLS_OCSP_STATUS_SKIPPED:
+	skipped:
+		FR_OPENSSL_DRAIN_ERROR_QUEUE(RWDEBUG, "", ssl_log);
+		MEM(pair_update_request(&vp, attr_tls_ocsp_cert_valid) >= 0);
+		vp->vp_uint32 = 2;	/* skipped */
+		if (conf->softfail) {
+			RWDEBUG("Unable to check certificate: %s",
+				staple_response ?
+					"Cannot provide TLS client with stapled OCSP response":
+					"TLS clients presenting revoked certificates may be granted access");
+
+			ocsp_status = FR_TLS_OCSP_STATUS_OK;
+
+			/* Remove OpenSSL errors from queue or handshake will fail */
+			while (ERR_get_error());	/* Not always debugging */
+		} else {
+			REDEBUG("Unable to check certificate, failing");
+			ocsp_status = FR_TLS_OCSP_STATUS_FAILED;
+		}
+		break;
+
+	default:
+		FR_OPENSSL_DRAIN_ERROR_QUEUE(REDEBUG, "", ssl_log);
+		MEM(pair_update_request(&vp, attr_tls_ocsp_cert_valid) >= 0);
+		vp->vp_uint32 = 0;	/* no */
+		REDEBUG("Failed to validate certificate");
+		break;
+	}
+
+	/* Free OCSP Stuff */
+	talloc_free(ocsp);
+	BIO_free(ssl_log);
+
+	return ocsp_status;
+}
+#endif /* HAVE_OPENSSL_OCSP_H */
+#endif /* WITH_TLS */
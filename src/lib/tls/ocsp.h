@@ -0,0 +1,61 @@
+#pragma once
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+#ifdef WITH_TLS
+/**
+ * $Id$
+ *
+ * @file lib/tls/ocsp.h
+ * @brief Validate certificates using an OCSP service.
+ *
+ * @copyright 2006-2016 The FreeRADIUS server project
+ */
+RCSIDH(ocsp_h, "$Id$")
+
+#include "openssl_user_macros.h"
+
+#include <openssl/ssl.h>
+#include <openssl/ocsp.h>
+
+#include "conf.h"
+#include "session.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Rcodes returned by the OCSP check function
+ */
+typedef enum {
+	FR_TLS_OCSP_STATUS_FAILED	= 0,
+	FR_TLS_OCSP_STATUS_OK		= 1,
+	FR_TLS_OCSP_STATUS_SKIPPED	= 2,
+} fr_tls_ocsp_status_t;
+
+int			fr_tls_ocsp_staple_cb(SSL *ssl, void *data);
+
+fr_tls_ocsp_status_t	fr_tls_ocsp_check(request_t *request, SSL *ssl,
+					  X509_STORE *store, X509 *issuer_cert, X509 *client_cert,
+					  fr_tls_ocsp_conf_t *conf, bool staple_response);
+
+unlang_action_t		fr_tls_ocsp_pending_push(request_t *request, fr_tls_session_t *tls_session);
+
+fr_tls_ocsp_cache_t	*fr_tls_ocsp_cache_alloc(TALLOC_CTX *ctx, uint32_t max_entries);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* WITH_TLS */
@@ -0,0 +1,712 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file tls/offload.c
+ * @brief Run expensive TLS operations on a dedicated pool of crypto threads.
+ *
+ * Full handshakes involve private key operations and certificate chain
+ * validation, which are orders of magnitude more expensive than anything
+ * else a worker does.  If these run on the worker threads, a burst of
+ * clients performing full handshakes will starve all other requests.
+ *
+ * Instead, a worker submits the operation as a job to a bounded pool of
+ * crypto threads, and yields the request.  When the job completes, the
+ * crypto thread places the job on the worker's completion list and writes
+ * to the worker's pipe.  The worker then marks the request as runnable.
+ *
+ * Each job is pinned to a single crypto thread.  This is because OpenSSL
+ * async jobs which have been paused must be resumed on the thread which
+ * started them.
+ *
+ * If a crypto thread has too many jobs queued, the caller is told, and
+ * is expected to perform the operation itself.
+ *
+ * Only OpenSSL itself runs on the crypto threads.  Our OpenSSL callbacks
+ * (certificate validation, session caching, logging) access the request,
+ * which belongs to the worker.  When one of them is called on a crypto
+ * thread, it hands itself back with #fr_tls_offload_callback, which pauses
+ * the OpenSSL async job.  The job completes, and the worker runs the
+ * callback with #fr_tls_offload_callback_run before resubmitting the job,
+ * which resumes OpenSSL where it left off.  The OpenSSL error stack is
+ * per-thread, so errors raised on the crypto thread are copied back to the
+ * worker with #fr_tls_offload_error_restore.
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+USES_APPLE_DEPRECATED_API	/* OpenSSL API has been deprecated by Apple */
+
+#define LOG_PREFIX "tls"
+
+#include <freeradius-devel/unlang/interpret.h>
+#include <freeradius-devel/util/debug.h>
+#include <freeradius-devel/util/dlist.h>
+#include <freeradius-devel/util/strerror.h>
+#include <freeradius-devel/util/syserror.h>
+
+#include "base.h"
+#include "offload.h"
+
+#include <openssl/async.h>
+#include <openssl/err.h>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+#else
+#  include <freeradius-devel/util/stdatomic.h>
+#endif
+
+typedef enum {
+	TLS_OFFLOAD_JOB_IDLE = 0,			//!< Not queued, or complete.
+	TLS_OFFLOAD_JOB_QUEUED,				//!< Waiting for a crypto thread.
+	TLS_OFFLOAD_JOB_RUNNING				//!< Being run by a crypto thread.
+} tls_offload_job_state_t;
+
+/** Maximum number of OpenSSL errors copied back from a crypto thread
+ *
+ */
+#define TLS_OFFLOAD_MAX_ERRORS	16
+
+/** An OpenSSL error raised on a crypto thread
+ *
+ */
+typedef struct {
+	unsigned long			code;
+	char const			*file;
+	int				line;
+	char const			*func;		//!< Always NULL for OpenSSL < 3.0.
+	char				data[256];	//!< Additional error data, if any.
+} tls_offload_error_t;
+
+/** A crypto thread
+ *
+ */
+typedef struct {
+	pthread_t			thread;
+	pthread_mutex_t			mutex;		//!< Protects the queue, and the state of jobs pinned
+							///< to this thread.
+	pthread_cond_t			cond;		//!< Signalled when a job is queued.
+	pthread_cond_t			done;		//!< Signalled when a synchronous job completes.
+	fr_dlist_head_t			queue;		//!< Of jobs to run.
+	bool				stopping;	//!< Exit once the queue is empty.
+	int				started;	//!< 1 if the thread started, -1 if it failed.
+} tls_offload_crypto_t;
+
+/** Per-worker completion state
+ *
+ */
+typedef struct {
+	pthread_mutex_t			mutex;		//!< Protects the list of completed jobs.
+	fr_dlist_head_t			complete;	//!< Jobs which have been run, and whose requests
+							///< need to be resumed.
+	int				pipe[2];	//!< Written to by crypto threads to wake the worker.
+	fr_event_list_t			*el;		//!< The pipe is registered with.
+} tls_offload_thread_t;
+
+struct fr_tls_offload_job_s {
+	fr_dlist_t			entry;		//!< Entry in the crypto thread's queue, or the
+							///< worker's completion list.
+	tls_offload_crypto_t		*crypto;	//!< Thread the job is pinned to.
+	tls_offload_thread_t		*thread;	//!< Worker to notify on completion.
+
+	tls_offload_job_state_t		state;		//!< Protected by crypto->mutex.
+	bool				sync;		//!< Submitter is waiting on crypto->done, don't
+							///< notify the worker.
+
+	fr_tls_offload_func_t		func;		//!< To call.
+	request_t			*request;	//!< Passed to func.
+	void				*uctx;		//!< Passed to func.
+
+	fr_tls_offload_func_t		callback;	//!< OpenSSL callback to run on the worker.
+	void				*callback_uctx;	//!< Passed to callback.
+
+	tls_offload_error_t		error[TLS_OFFLOAD_MAX_ERRORS];	//!< Raised by func.
+	unsigned int			num_errors;	//!< How many errors were raised.
+};
+
+static tls_offload_crypto_t		*offload_crypto;
+static uint32_t				offload_num_threads;
+static uint32_t				offload_max_queued;
+static size_t				offload_async_pool_init;
+static size_t				offload_async_pool_max;
+static _Atomic(uint32_t)		offload_next;		//!< For distributing jobs between threads.
+
+static _Thread_local tls_offload_thread_t *offload_thread;
+
+static _Thread_local fr_tls_offload_job_t *offload_job;		//!< Being run by this crypto thread.
+
+/** Move the current thread's OpenSSL errors into the job
+ *
+ */
+static void tls_offload_error_save(fr_tls_offload_job_t *job)
+{
+	unsigned long		code;
+	char const		*file, *func = NULL, *data;
+	int			line, flags;
+
+	job->num_errors = 0;
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	while ((code = ERR_get_error_all(&file, &line, &func, &data, &flags))) {
+#else
+	while ((code = ERR_get_error_line_data(&file, &line, &data, &flags))) {
+#endif
+		tls_offload_error_t *error;
+
+		/*
+		 *	Keep the oldest errors, they're usually
+		 *	the most useful.
+		 */
+		if (job->num_errors == NUM_ELEMENTS(job->error)) continue;
+
+		error = &job->error[job->num_errors++];
+		error->code = code;
+		error->file = file;
+		error->line = line;
+		error->func = func;
+		strlcpy(error->data, (data && (flags & ERR_TXT_STRING)) ? data : "", sizeof(error->data));
+	}
+}
+
+/** Run jobs
+ *
+ */
+static void *tls_offload_crypto_main(void *uctx)
+{
+	tls_offload_crypto_t	*crypto = uctx;
+	fr_tls_offload_job_t	*job;
+	int			started;
+
+	/*
+	 *	Paused async jobs need somewhere to live.
+	 */
+	started = (fr_openssl_thread_init(offload_async_pool_init, offload_async_pool_max) < 0) ? -1 : 1;
+
+	pthread_mutex_lock(&crypto->mutex);
+	crypto->started = started;
+	pthread_cond_broadcast(&crypto->done);
+	if (started < 0) {
+		pthread_mutex_unlock(&crypto->mutex);
+		return NULL;
+	}
+
+	for (;;) {
+		while (!(job = fr_dlist_pop_head(&crypto->queue))) {
+			if (crypto->stopping) goto done;
+			pthread_cond_wait(&crypto->cond, &crypto->mutex);
+		}
+		job->state = TLS_OFFLOAD_JOB_RUNNING;
+		pthread_mutex_unlock(&crypto->mutex);
+
+		offload_job = job;
+		job->func(job->request, job->uctx);
+		offload_job = NULL;
+
+		tls_offload_error_save(job);
+
+		pthread_mutex_lock(&crypto->mutex);
+		job->state = TLS_OFFLOAD_JOB_IDLE;
+		if (job->sync) {
+			pthread_cond_broadcast(&crypto->done);
+			continue;
+		}
+
+		/*
+		 *	Still holding crypto->mutex, so anyone
+		 *	cancelling the job will find it on the
+		 *	completion list.
+		 */
+		pthread_mutex_lock(&job->thread->mutex);
+		fr_dlist_insert_tail(&job->thread->complete, job);
+		pthread_mutex_unlock(&job->thread->mutex);
+
+		/*
+		 *	If the pipe is full, the worker has
+		 *	plenty of wakeups pending already.
+		 */
+		if (write(job->thread->pipe[1], "", 1) < 0) {
+			if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+				ERROR("Failed waking worker: %s", fr_syserror(errno));
+			}
+		}
+	}
+
+done:
+	pthread_mutex_unlock(&crypto->mutex);
+
+	return NULL;
+}
+
+/** Start the crypto threads
+ *
+ * @note Must be called after the server has daemonized, as the crypto
+ *	threads won't survive a fork.
+ *
+ * @param[in] num_threads		to start.  If 0, no operations are offloaded.
+ * @param[in] max_queued		number of jobs per crypto thread, before callers
+ *					have to perform operations themselves.
+ * @param[in] async_pool_size_init	initial size of each crypto thread's async job pool.
+ * @param[in] async_pool_size_max	maximum size of each crypto thread's async job pool.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int fr_tls_offload_start(uint32_t num_threads, uint32_t max_queued,
+			 size_t async_pool_size_init, size_t async_pool_size_max)
+{
+	uint32_t	i;
+	int		ret;
+
+	if (offload_crypto || (num_threads == 0)) return 0;
+
+	offload_max_queued = max_queued;
+	offload_async_pool_init = async_pool_size_init;
+	offload_async_pool_max = async_pool_size_max;
+
+	MEM(offload_crypto = talloc_zero_array(NULL, tls_offload_crypto_t, num_threads));
+	for (i = 0; i < num_threads; i++) {
+		tls_offload_crypto_t *crypto = &offload_crypto[i];
+
+		pthread_mutex_init(&crypto->mutex, NULL);
+		pthread_cond_init(&crypto->cond, NULL);
+		pthread_cond_init(&crypto->done, NULL);
+		fr_dlist_init(&crypto->queue, fr_tls_offload_job_t, entry);
+
+		ret = pthread_create(&crypto->thread, NULL, tls_offload_crypto_main, crypto);
+		if (ret != 0) {
+			fr_strerror_printf("Failed creating crypto thread: %s", fr_syserror(ret));
+		error:
+			offload_num_threads = i;
+			fr_tls_offload_stop();
+			return -1;
+		}
+
+		pthread_mutex_lock(&crypto->mutex);
+		while (crypto->started == 0) pthread_cond_wait(&crypto->done, &crypto->mutex);
+		pthread_mutex_unlock(&crypto->mutex);
+
+		if (crypto->started < 0) {
+			pthread_join(crypto->thread, NULL);
+			fr_strerror_const("Failed initialising crypto thread");
+			goto error;
+		}
+	}
+	offload_num_threads = num_threads;
+
+	return 0;
+}
+
+/** Stop the crypto threads, once they've run all queued jobs
+ *
+ */
+void fr_tls_offload_stop(void)
+{
+	uint32_t i;
+
+	if (!offload_crypto) return;
+
+	for (i = 0; i < offload_num_threads; i++) {
+		tls_offload_crypto_t *crypto = &offload_crypto[i];
+
+		pthread_mutex_lock(&crypto->mutex);
+		crypto->stopping = true;
+		pthread_cond_signal(&crypto->cond);
+		pthread_mutex_unlock(&crypto->mutex);
+
+		pthread_join(crypto->thread, NULL);
+	}
+
+	for (i = 0; i < talloc_array_length(offload_crypto); i++) {
+		tls_offload_crypto_t *crypto = &offload_crypto[i];
+
+		pthread_cond_destroy(&crypto->done);
+		pthread_cond_destroy(&crypto->cond);
+		pthread_mutex_destroy(&crypto->mutex);
+	}
+
+	TALLOC_FREE(offload_crypto);
+	offload_num_threads = 0;
+}
+
+/** Whether operations may be offloaded
+ *
+ */
+bool fr_tls_offload_enabled(void)
+{
+	return (offload_num_threads > 0);
+}
+
+/** Resume the requests for completed jobs
+ *
+ */
+static void tls_offload_complete(UNUSED fr_event_list_t *el, int fd, UNUSED int flags, void *uctx)
+{
+	tls_offload_thread_t	*thread = talloc_get_type_abort(uctx, tls_offload_thread_t);
+	fr_tls_offload_job_t	*job;
+	char			buffer[64];
+
+	while (read(fd, buffer, sizeof(buffer)) > 0);
+
+	pthread_mutex_lock(&thread->mutex);
+	while ((job = fr_dlist_pop_head(&thread->complete))) unlang_interpret_mark_runnable(job->request);
+	pthread_mutex_unlock(&thread->mutex);
+}
+
+static int _tls_offload_thread_free(tls_offload_thread_t *thread)
+{
+	if (thread->el) (void) fr_event_fd_delete(thread->el, thread->pipe[0], FR_EVENT_FILTER_IO);
+	close(thread->pipe[0]);
+	close(thread->pipe[1]);
+	pthread_mutex_destroy(&thread->mutex);
+
+	if (offload_thread == thread) offload_thread = NULL;
+
+	return 0;
+}
+
+/** Allow a worker to submit jobs
+ *
+ * @param[in] ctx	to allocate the per-worker state in.
+ * @param[in] el	the worker's event list.  Completed jobs are
+ *			signalled via a pipe registered with it.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int fr_tls_offload_thread_init(TALLOC_CTX *ctx, fr_event_list_t *el)
+{
+	tls_offload_thread_t *thread;
+
+	if (!fr_tls_offload_enabled() || offload_thread) return 0;
+
+	MEM(thread = talloc_zero(ctx, tls_offload_thread_t));
+	if (pipe(thread->pipe) < 0) {
+		fr_strerror_printf("Failed creating offload pipe: %s", fr_syserror(errno));
+		talloc_free(thread);
+		return -1;
+	}
+	pthread_mutex_init(&thread->mutex, NULL);
+	fr_dlist_init(&thread->complete, fr_tls_offload_job_t, entry);
+	talloc_set_destructor(thread, _tls_offload_thread_free);
+
+	if ((fcntl(thread->pipe[0], F_SETFL, O_NONBLOCK) < 0) ||
+	    (fcntl(thread->pipe[0], F_SETFD, FD_CLOEXEC) < 0) ||
+	    (fcntl(thread->pipe[1], F_SETFL, O_NONBLOCK) < 0) ||
+	    (fcntl(thread->pipe[1], F_SETFD, FD_CLOEXEC) < 0)) {
+		fr_strerror_printf("Failed setting offload pipe flags: %s", fr_syserror(errno));
+	error:
+		talloc_free(thread);
+		return -1;
+	}
+
+	if (fr_event_fd_insert(thread, el, thread->pipe[0], tls_offload_complete, NULL, NULL, thread) < 0) goto error;
+	thread->el = el;
+
+	offload_thread = thread;
+
+	return 0;
+}
+
+static int _tls_offload_job_free(fr_tls_offload_job_t *job)
+{
+	if (offload_crypto) fr_tls_offload_cancel(job);
+
+	return 0;
+}
+
+/** Allocate a job, pinned to one of the crypto threads
+ *
+ * @param[in] ctx	to allocate the job in.  Must be freed by the same
+ *			worker which submits it.
+ * @return
+ *	- A new job.
+ *	- NULL if offloading is disabled.
+ */
+fr_tls_offload_job_t *fr_tls_offload_job_alloc(TALLOC_CTX *ctx)
+{
+	fr_tls_offload_job_t *job;
+
+	if (!fr_tls_offload_enabled()) return NULL;
+
+	MEM(job = talloc_zero(ctx, fr_tls_offload_job_t));
+	fr_dlist_entry_init(&job->entry);
+	job->crypto = &offload_crypto[atomic_fetch_add_explicit(&offload_next, 1, memory_order_relaxed) %
+				      offload_num_threads];
+	talloc_set_destructor(job, _tls_offload_job_free);
+
+	return job;
+}
+
+/** Run a function on the job's crypto thread
+ *
+ * On success, the caller should yield the request.  Once func has been run,
+ * the request is marked as runnable.
+ *
+ * @param[in] job	to submit.  Must not already be queued or running.
+ * @param[in] request	to resume once func has been run.
+ * @param[in] func	to run.
+ * @param[in] uctx	passed to func.
+ * @param[in] force	queue the job even if the crypto thread is busy.
+ *			Used to continue an operation which has to complete
+ *			on the crypto thread it was started on.
+ * @return
+ *	- 0 if the job was queued.
+ *	- -1 if the job wasn't queued, and the caller should call func itself.
+ */
+int fr_tls_offload_submit(fr_tls_offload_job_t *job, request_t *request,
+			  fr_tls_offload_func_t func, void *uctx, bool force)
+{
+	tls_offload_crypto_t *crypto = job->crypto;
+
+	if (!offload_thread) return -1;
+
+	pthread_mutex_lock(&crypto->mutex);
+	fr_assert(job->state == TLS_OFFLOAD_JOB_IDLE);
+	fr_assert(!fr_dlist_entry_in_list(&job->entry));
+
+	if (!force && (offload_max_queued > 0) && (fr_dlist_num_elements(&crypto->queue) >= offload_max_queued)) {
+		pthread_mutex_unlock(&crypto->mutex);
+		return -1;
+	}
+
+	job->thread = offload_thread;
+	job->sync = false;
+	job->func = func;
+	job->request = request;
+	job->uctx = uctx;
+	job->state = TLS_OFFLOAD_JOB_QUEUED;
+	fr_dlist_insert_tail(&crypto->queue, job);
+	pthread_cond_signal(&crypto->cond);
+	pthread_mutex_unlock(&crypto->mutex);
+
+	return 0;
+}
+
+/** Ensure a job isn't queued, running, or waiting for its request to be resumed
+ *
+ * If the job is running, this waits for it to complete.  The request
+ * won't be marked as runnable.
+ *
+ * @param[in] job	to cancel.
+ */
+void fr_tls_offload_cancel(fr_tls_offload_job_t *job)
+{
+	tls_offload_crypto_t *crypto = job->crypto;
+
+	pthread_mutex_lock(&crypto->mutex);
+	switch (job->state) {
+	case TLS_OFFLOAD_JOB_QUEUED:
+		fr_dlist_remove(&crypto->queue, job);
+		job->state = TLS_OFFLOAD_JOB_IDLE;
+		break;
+
+	case TLS_OFFLOAD_JOB_RUNNING:
+		job->sync = true;
+		while (job->state != TLS_OFFLOAD_JOB_IDLE) pthread_cond_wait(&crypto->done, &crypto->mutex);
+		break;
+
+	/*
+	 *	Only this worker removes jobs from its
+	 *	completion list, and crypto threads only add
+	 *	jobs to it whilst holding crypto->mutex, so
+	 *	whether the job is in the list can't change
+	 *	under us.
+	 */
+	case TLS_OFFLOAD_JOB_IDLE:
+		if (job->thread && fr_dlist_entry_in_list(&job->entry)) {
+			pthread_mutex_lock(&job->thread->mutex);
+			fr_dlist_remove(&job->thread->complete, job);
+			pthread_mutex_unlock(&job->thread->mutex);
+		}
+		break;
+	}
+	pthread_mutex_unlock(&crypto->mutex);
+}
+
+/** Run a function on the job's crypto thread, waiting for it to complete
+ *
+ * Any outstanding job is cancelled first.
+ *
+ * @param[in] job	to run.
+ * @param[in] request	passed to func.
+ * @param[in] func	to run.
+ * @param[in] uctx	passed to func.
+ */
+void fr_tls_offload_run(fr_tls_offload_job_t *job, request_t *request,
+			fr_tls_offload_func_t func, void *uctx)
+{
+	tls_offload_crypto_t *crypto = job->crypto;
+
+	fr_tls_offload_cancel(job);
+
+	pthread_mutex_lock(&crypto->mutex);
+	job->sync = true;
+	job->func = func;
+	job->request = request;
+	job->uctx = uctx;
+	job->state = TLS_OFFLOAD_JOB_QUEUED;
+	fr_dlist_insert_tail(&crypto->queue, job);
+	pthread_cond_signal(&crypto->cond);
+
+	while (job->state != TLS_OFFLOAD_JOB_IDLE) pthread_cond_wait(&crypto->done, &crypto->mutex);
+	pthread_mutex_unlock(&crypto->mutex);
+
+	fr_tls_offload_error_restore(job);
+}
+
+/** Copy any OpenSSL errors raised by the last job into the current thread's error stack
+ *
+ * Should be called by the worker before examining the result of the
+ * job, so the errors can be logged.
+ *
+ * @param[in] job	which has completed.
+ */
+void fr_tls_offload_error_restore(fr_tls_offload_job_t *job)
+{
+	unsigned int i;
+
+	for (i = 0; i < job->num_errors; i++) {
+		tls_offload_error_t *error = &job->error[i];
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+		ERR_new();
+		ERR_set_debug(error->file, error->line, error->func);
+		if (error->data[0]) {
+			ERR_set_error(ERR_GET_LIB(error->code), ERR_GET_REASON(error->code), "%s", error->data);
+		} else {
+			ERR_set_error(ERR_GET_LIB(error->code), ERR_GET_REASON(error->code), NULL);
+		}
+#else
+		ERR_put_error(ERR_GET_LIB(error->code), ERR_GET_FUNC(error->code), ERR_GET_REASON(error->code),
+			      error->file, error->line);
+		if (error->data[0]) ERR_add_error_data(1, error->data);
+#endif
+	}
+	job->num_errors = 0;
+}
+
+/** Whether OpenSSL callbacks called on this thread are handed back to a worker
+ *
+ * Callbacks which can't pause, because OpenSSL has already decided what
+ * to return, should record what they need and let the worker act on it
+ * when the job completes.
+ *
+ * @return
+ *	- true if this is a crypto thread, running a job for a worker which
+ *	  isn't waiting for it.
+ *	- false if callbacks should be run inline.
+ */
+bool fr_tls_offload_callback_marshalled(void)
+{
+	fr_tls_offload_job_t	*job = offload_job;
+	bool			sync;
+
+	if (!job) return false;
+
+	pthread_mutex_lock(&job->crypto->mutex);
+	sync = job->sync;
+	pthread_mutex_unlock(&job->crypto->mutex);
+
+	return !sync;
+}
+
+/** Hand an OpenSSL callback back to the worker which owns the request
+ *
+ * Should be called at the start of every OpenSSL callback which accesses
+ * the request, or any other worker state.  If it returns true, the callback
+ * has already been run by the worker, and should return the result func
+ * left in uctx.
+ *
+ * When called on a crypto thread, the OpenSSL async job is paused, and
+ * the worker runs func when the job completes.  When the worker resubmits
+ * the job, this function returns.
+ *
+ * If the job is being run synchronously, i.e. the worker is blocked waiting
+ * for it, func is run on the crypto thread.
+ *
+ * @param[in] func	to run on the worker.  This should call the OpenSSL
+ *			callback again, with the same arguments.
+ * @param[in] uctx	passed to func.  Usually a structure on the stack
+ *			holding the arguments and result of the callback.
+ * @return
+ *	- true if func has been run.
+ *	- false if the caller should run the callback itself.
+ */
+bool fr_tls_offload_callback(fr_tls_offload_func_t func, void *uctx)
+{
+	fr_tls_offload_job_t	*job = offload_job;
+
+	if (!fr_tls_offload_callback_marshalled()) return false;
+
+	/*
+	 *	Should never happen, as OpenSSL runs
+	 *	all handshakes in async jobs.
+	 */
+	if (!fr_cond_assert_msg(ASYNC_get_current_job(), "OpenSSL callback run on crypto thread outside async job")) {
+		return false;
+	}
+
+	job->callback = func;
+	job->callback_uctx = uctx;
+	ASYNC_pause_job();
+
+	/*
+	 *	May have been resumed to drain the SSL *, before
+	 *	the worker ran the callback.  The worker is
+	 *	blocked waiting for us, so run it here.
+	 */
+	job = offload_job;
+	if (job->callback) {
+		job->callback = NULL;
+		func(job->request, uctx);
+	}
+
+	return true;
+}
+
+/** Whether an OpenSSL callback is waiting to be run by the worker
+ *
+ * @param[in] job	which has completed.
+ */
+bool fr_tls_offload_callback_pending(fr_tls_offload_job_t *job)
+{
+	return (job->callback != NULL);
+}
+
+/** Run an OpenSSL callback which was handed back by a crypto thread
+ *
+ * The job must then be resubmitted with force, so the crypto thread
+ * can continue from where the callback was called.
+ *
+ * @param[in] job	which has completed.
+ * @param[in] request	which owns the job.
+ */
+void fr_tls_offload_callback_run(fr_tls_offload_job_t *job, request_t *request)
+{
+	fr_tls_offload_func_t func = job->callback;
+
+	if (!func) return;
+
+	func(request, job->callback_uctx);
+	job->callback = NULL;
+}
@@ -0,0 +1,77 @@
+#pragma once
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+#ifdef WITH_TLS
+/**
+ * $Id$
+ *
+ * @file lib/tls/offload.h
+ * @brief Run expensive TLS operations on a dedicated pool of crypto threads.
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+RCSIDH(offload_h, "$Id$")
+
+#include <freeradius-devel/server/request.h>
+#include <freeradius-devel/util/event.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct fr_tls_offload_job_s fr_tls_offload_job_t;
+
+/** Function to run on a crypto thread
+ *
+ * @param[in] request	the job was submitted for.
+ * @param[in] uctx	passed to #fr_tls_offload_submit or #fr_tls_offload_run.
+ */
+typedef void (*fr_tls_offload_func_t)(request_t *request, void *uctx);
+
+int			fr_tls_offload_start(uint32_t num_threads, uint32_t max_queued,
+					     size_t async_pool_size_init, size_t async_pool_size_max);
+
+void			fr_tls_offload_stop(void);
+
+bool			fr_tls_offload_enabled(void);
+
+int			fr_tls_offload_thread_init(TALLOC_CTX *ctx, fr_event_list_t *el);
+
+fr_tls_offload_job_t	*fr_tls_offload_job_alloc(TALLOC_CTX *ctx);
+
+int			fr_tls_offload_submit(fr_tls_offload_job_t *job, request_t *request,
+					      fr_tls_offload_func_t func, void *uctx, bool force)
+					      CC_HINT(nonnull(1,2,3));
+
+void			fr_tls_offload_cancel(fr_tls_offload_job_t *job) CC_HINT(nonnull);
+
+void			fr_tls_offload_run(fr_tls_offload_job_t *job, request_t *request,
+					   fr_tls_offload_func_t func, void *uctx) CC_HINT(nonnull(1,2,3));
+
+void			fr_tls_offload_error_restore(fr_tls_offload_job_t *job) CC_HINT(nonnull);
+
+bool			fr_tls_offload_callback_marshalled(void);
+
+bool			fr_tls_offload_callback(fr_tls_offload_func_t func, void *uctx) CC_HINT(nonnull(1));
+
+bool			fr_tls_offload_callback_pending(fr_tls_offload_job_t *job) CC_HINT(nonnull);
+
+void			fr_tls_offload_callback_run(fr_tls_offload_job_t *job, request_t *request) CC_HINT(nonnull);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* WITH_TLS */
@@ -0,0 +1,737 @@
+/*
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Lesser General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2.1 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *   Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Tests for running TLS operations on crypto threads
+ *
+ * @file src/lib/tls/offload_tests.c
+ * @copyright 2026 The FreeRADIUS server project
+ */
+#define USE_CONSTRUCTOR
+
+#ifdef USE_CONSTRUCTOR
+static void test_init(void) __attribute__((constructor));
+#else
+static void test_init(void);
+#  define TEST_INIT  test_init()
+#endif
+
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+
+#include <freeradius-devel/util/dict_test.h>
+#include <freeradius-devel/unlang/unlang_priv.h>
+
+#include "offload.c"
+
+#include <openssl/x509.h>
+
+static TALLOC_CTX	*autofree;
+static fr_dict_t	*test_dict;
+static pthread_t	test_main;		//!< Thread the tests run on, i.e. the "worker".
+static request_t	*test_request;		//!< Never run, just marked runnable.
+static bool		test_resumed;
+
+static void test_request_init(UNUSED request_t *request, UNUSED void *uctx) {}
+static void test_request_done(UNUSED request_t *request, UNUSED rlm_rcode_t rcode, UNUSED void *uctx) {}
+static bool test_request_scheduled(UNUSED request_t const *request, UNUSED void *uctx) { return false; }
+
+static void test_request_runnable(request_t *request, UNUSED void *uctx)
+{
+	TEST_CHECK(request == test_request);
+	test_resumed = true;
+}
+
+/** Only marking requests as runnable is used
+ *
+ */
+static unlang_request_func_t test_funcs = {
+	.init_internal = test_request_init,
+
+	.done_external = test_request_done,
+	.done_internal = test_request_done,
+	.done_detached = test_request_done,
+
+	.detach = test_request_init,
+	.stop = test_request_init,
+	.yield = test_request_init,
+	.resume = test_request_init,
+	.mark_runnable = test_request_runnable,
+	.scheduled = test_request_scheduled
+};
+
+/** Global initialisation
+ */
+static void test_init(void)
+{
+	unlang_stack_t *stack;
+
+	autofree = talloc_autofree_context();
+	if (!autofree) {
+	error:
+		fr_perror("offload_tests");
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	if (fr_time_start() < 0) goto error;
+
+	if (fr_openssl_init() < 0) goto error;
+
+	if (fr_dict_test_init(autofree, &test_dict, NULL) < 0) goto error;
+
+	if (request_global_init() < 0) goto error;
+
+	/*
+	 *	Completed jobs mark the request as runnable, which
+	 *	is only done if the request has yielded.
+	 */
+	test_request = request_local_alloc_external(autofree, NULL);
+	unlang_interpret_set(test_request, unlang_interpret_init(autofree, NULL, &test_funcs, NULL));
+	stack = test_request->stack;
+	yielded_set(&stack->frame[stack->depth]);
+}
+
+/** Start the crypto threads, and allow this thread to submit jobs
+ *
+ * Threads don't survive the fork before each test, so this is done
+ * per test.
+ */
+static fr_event_list_t *test_start(TALLOC_CTX *ctx, uint32_t num_threads, uint32_t max_queued)
+{
+	fr_event_list_t *el;
+
+	test_main = pthread_self();
+
+	TEST_ASSERT(fr_openssl_thread_init(16, 64) == 0);
+	TEST_ASSERT(fr_tls_offload_start(num_threads, max_queued, 16, 64) == 0);
+	TEST_ASSERT(fr_tls_offload_enabled());
+
+	el = fr_event_list_alloc(ctx, NULL, NULL);
+	TEST_ASSERT(el != NULL);
+	TEST_ASSERT(fr_tls_offload_thread_init(ctx, el) == 0);
+
+	return el;
+}
+
+static void test_stop(TALLOC_CTX *ctx)
+{
+	talloc_free(ctx);
+	fr_tls_offload_stop();
+	TEST_CHECK(!fr_tls_offload_enabled());
+}
+
+/** Service the event list until a job completes
+ *
+ */
+static void test_wait(fr_event_list_t *el)
+{
+	fr_time_t start = fr_time();
+
+	while (!test_resumed) {
+		TEST_ASSERT(fr_time_delta_lt(fr_time_sub(fr_time(), start), fr_time_delta_from_sec(10)));
+		if (fr_event_corral(el, fr_time(), true) > 0) fr_event_service(el);
+	}
+	test_resumed = false;
+}
+
+static void test_submit(fr_tls_offload_job_t *job, fr_tls_offload_func_t func, void *uctx, bool force)
+{
+	TEST_ASSERT(fr_tls_offload_submit(job, test_request, func, uctx, force) == 0);
+}
+
+typedef struct {
+	pthread_t	thread;			//!< The job ran on.
+	bool		ran;
+} test_thread_t;
+
+static void test_record_thread(request_t *request, void *uctx)
+{
+	test_thread_t *t = uctx;
+
+	TEST_CHECK(request == test_request);
+	t->thread = pthread_self();
+	t->ran = true;
+}
+
+static void test_submit_complete(void)
+{
+	TALLOC_CTX		*ctx = talloc_new(autofree);
+	fr_event_list_t		*el = test_start(ctx, 2, 0);
+	fr_tls_offload_job_t	*job = fr_tls_offload_job_alloc(ctx);
+	test_thread_t		t = {};
+
+	TEST_ASSERT(job != NULL);
+
+	test_submit(job, test_record_thread, &t, false);
+	test_wait(el);
+
+	TEST_CHECK(t.ran);
+	TEST_CHECK(!pthread_equal(t.thread, test_main));
+	TEST_MSG("Job should have been run by a crypto thread");
+
+	test_stop(ctx);
+}
+
+/*
+ *	Synchronous jobs block until complete, and don't
+ *	resume the request.
+ */
+static void test_run_sync(void)
+{
+	TALLOC_CTX		*ctx = talloc_new(autofree);
+	fr_tls_offload_job_t	*job;
+	test_thread_t		t = {};
+
+	test_start(ctx, 1, 0);
+	job = fr_tls_offload_job_alloc(ctx);
+
+	fr_tls_offload_run(job, test_request, test_record_thread, &t);
+	TEST_CHECK(t.ran);
+	TEST_CHECK(!pthread_equal(t.thread, test_main));
+	TEST_CHECK(!test_resumed);
+
+	test_stop(ctx);
+}
+
+typedef struct {
+	pthread_mutex_t	mutex;
+	pthread_cond_t	cond;
+	bool		running;
+	bool		release;
+} test_block_t;
+
+static void test_block(UNUSED request_t *request, void *uctx)
+{
+	test_block_t *b = uctx;
+
+	pthread_mutex_lock(&b->mutex);
+	b->running = true;
+	pthread_cond_broadcast(&b->cond);
+	while (!b->release) pthread_cond_wait(&b->cond, &b->mutex);
+	pthread_mutex_unlock(&b->mutex);
+}
+
+/*
+ *	When a crypto thread has too many jobs queued,
+ *	the caller is told to run the operation itself,
+ *	unless the job has to run on that thread.
+ */
+static void test_queue_full(void)
+{
+	TALLOC_CTX		*ctx = talloc_new(autofree);
+	fr_event_list_t		*el = test_start(ctx, 1, 1);
+	fr_tls_offload_job_t	*blocker = fr_tls_offload_job_alloc(ctx);
+	fr_tls_offload_job_t	*queued = fr_tls_offload_job_alloc(ctx);
+	fr_tls_offload_job_t	*rejected = fr_tls_offload_job_alloc(ctx);
+	fr_tls_offload_job_t	*forced = fr_tls_offload_job_alloc(ctx);
+	test_block_t		b = { .mutex = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER };
+	test_thread_t		t1 = {}, t2 = {};
+
+	test_submit(blocker, test_block, &b, false);
+
+	pthread_mutex_lock(&b.mutex);
+	while (!b.running) pthread_cond_wait(&b.cond, &b.mutex);
+	pthread_mutex_unlock(&b.mutex);
+
+	test_submit(queued, test_record_thread, &t1, false);
+	TEST_CHECK(fr_tls_offload_submit(rejected, test_request, test_record_thread, &t2, false) < 0);
+	TEST_MSG("Job should have been rejected, the crypto thread's queue is full");
+	test_submit(forced, test_record_thread, &t2, true);
+
+	pthread_mutex_lock(&b.mutex);
+	b.release = true;
+	pthread_cond_broadcast(&b.cond);
+	pthread_mutex_unlock(&b.mutex);
+
+	/*
+	 *	Each job resumes the request
+	 */
+	test_wait(el);
+	if (!(t1.ran && t2.ran)) test_wait(el);
+	if (!(t1.ran && t2.ran)) test_wait(el);
+	TEST_CHECK(t1.ran && t2.ran);
+
+	test_stop(ctx);
+}
+
+/*
+ *	Cancelling a queued job means it's never run.
+ */
+static void test_cancel(void)
+{
+	TALLOC_CTX		*ctx = talloc_new(autofree);
+	fr_event_list_t		*el = test_start(ctx, 1, 0);
+	fr_tls_offload_job_t	*blocker = fr_tls_offload_job_alloc(ctx);
+	fr_tls_offload_job_t	*cancelled = fr_tls_offload_job_alloc(ctx);
+	test_block_t		b = { .mutex = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER };
+	test_thread_t		t = {};
+
+	test_submit(blocker, test_block, &b, false);
+	test_submit(cancelled, test_record_thread, &t, false);
+	fr_tls_offload_cancel(cancelled);
+
+	pthread_mutex_lock(&b.mutex);
+	b.release = true;
+	pthread_cond_broadcast(&b.cond);
+	pthread_mutex_unlock(&b.mutex);
+
+	test_wait(el);
+	TEST_CHECK(!t.ran);
+
+	test_stop(ctx);
+}
+
+static void test_raise_error(UNUSED request_t *request, UNUSED void *uctx)
+{
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	ERR_raise_data(ERR_LIB_SSL, SSL_R_BAD_PACKET, "raised on %s", "crypto thread");
+#else
+	SSLerr(SSL_F_SSL_READ, SSL_R_BAD_PACKET);
+	ERR_add_error_data(2, "raised on ", "crypto thread");
+#endif
+}
+
+/*
+ *	Errors are raised on the crypto thread's error
+ *	stack, and have to be copied back.
+ */
+static void test_error_restore(void)
+{
+	TALLOC_CTX		*ctx = talloc_new(autofree);
+	fr_event_list_t		*el = test_start(ctx, 1, 0);
+	fr_tls_offload_job_t	*job = fr_tls_offload_job_alloc(ctx);
+	unsigned long		code;
+	char const		*data;
+	int			flags;
+
+	ERR_clear_error();
+
+	test_submit(job, test_raise_error, NULL, false);
+	test_wait(el);
+	TEST_CHECK(ERR_peek_error() == 0);
+
+	fr_tls_offload_error_restore(job);
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	code = ERR_get_error_all(NULL, NULL, NULL, &data, &flags);
+#else
+	code = ERR_get_error_line_data(NULL, NULL, &data, &flags);
+#endif
+	TEST_CHECK(ERR_GET_LIB(code) == ERR_LIB_SSL);
+	TEST_CHECK(ERR_GET_REASON(code) == SSL_R_BAD_PACKET);
+	TEST_CHECK((flags & ERR_TXT_STRING) && (strcmp(data, "raised on crypto thread") == 0));
+	TEST_MSG("Got error data \"%s\"", data);
+	TEST_CHECK(ERR_peek_error() == 0);
+
+	/*
+	 *	Only restored once
+	 */
+	fr_tls_offload_error_restore(job);
+	TEST_CHECK(ERR_peek_error() == 0);
+
+	test_stop(ctx);
+}
+
+/** A callback which must be run by the worker
+ *
+ */
+typedef struct {
+	int		in;
+	int		out;
+	pthread_t	thread;			//!< The callback body ran on.
+} test_callback_args_t;
+
+static void test_callback(test_callback_args_t *args);
+
+static void test_callback_offload(UNUSED request_t *request, void *uctx)
+{
+	test_callback(uctx);
+}
+
+static void test_callback(test_callback_args_t *args)
+{
+	if (fr_tls_offload_callback(test_callback_offload, args)) return;
+
+	args->thread = pthread_self();
+	args->out = args->in * 2;
+}
+
+typedef struct {
+	ASYNC_JOB		*job;
+	ASYNC_WAIT_CTX		*wait_ctx;	//!< Required for jobs which pause.
+	int			status;		//!< Of the last ASYNC_start_job.
+	test_callback_args_t	args;
+	pthread_t		thread;		//!< The async job ran on.
+} test_async_t;
+
+static int test_async_job(void *arg)
+{
+	test_async_t *a = *((test_async_t **)arg);
+
+	a->thread = pthread_self();
+	test_callback(&a->args);
+
+	return 1;
+}
+
+/** Emulates SSL_read() in async mode
+ *
+ */
+static void test_async_start(UNUSED request_t *request, void *uctx)
+{
+	test_async_t	*a = uctx;
+	int		ret;
+
+	if (!a->wait_ctx) a->wait_ctx = ASYNC_WAIT_CTX_new();
+	a->status = ASYNC_start_job(&a->job, a->wait_ctx, &ret, test_async_job, &a, sizeof(a));
+}
+
+/*
+ *	Callbacks called on a crypto thread are handed
+ *	back to the worker, and the async job resumes
+ *	with the result.
+ */
+static void test_callback_marshal(void)
+{
+	TALLOC_CTX		*ctx = talloc_new(autofree);
+	fr_event_list_t		*el = test_start(ctx, 1, 0);
+	fr_tls_offload_job_t	*job = fr_tls_offload_job_alloc(ctx);
+	test_async_t		a = { .args = { .in = 21 } };
+
+	test_submit(job, test_async_start, &a, false);
+	test_wait(el);
+
+	TEST_CHECK(a.status == ASYNC_PAUSE);
+	TEST_CHECK(fr_tls_offload_callback_pending(job));
+	TEST_CHECK(a.args.out == 0);
+
+	fr_tls_offload_callback_run(job, test_request);
+	TEST_CHECK(!fr_tls_offload_callback_pending(job));
+	TEST_CHECK(a.args.out == 42);
+	TEST_CHECK(pthread_equal(a.args.thread, test_main));
+	TEST_MSG("Callback should have been run by the worker");
+
+	/*
+	 *	Paused jobs must be resumed on the thread
+	 *	which paused them.
+	 */
+	test_submit(job, test_async_start, &a, true);
+	test_wait(el);
+
+	TEST_CHECK(a.status == ASYNC_FINISH);
+	TEST_CHECK(!pthread_equal(a.thread, test_main));
+	TEST_CHECK(!fr_tls_offload_callback_pending(job));
+
+	ASYNC_WAIT_CTX_free(a.wait_ctx);
+	test_stop(ctx);
+}
+
+/*
+ *	Callbacks run inline if they're not on a crypto
+ *	thread, or the worker is waiting for the job.
+ */
+static void test_callback_inline(void)
+{
+	TALLOC_CTX		*ctx = talloc_new(autofree);
+	fr_tls_offload_job_t	*job;
+	test_callback_args_t	args = { .in = 1 };
+	test_async_t		a = { .args = { .in = 2 } };
+
+	test_start(ctx, 1, 0);
+	job = fr_tls_offload_job_alloc(ctx);
+
+	test_callback(&args);
+	TEST_CHECK(args.out == 2);
+	TEST_CHECK(pthread_equal(args.thread, test_main));
+
+	fr_tls_offload_run(job, test_request, test_async_start, &a);
+	TEST_CHECK(a.status == ASYNC_FINISH);
+	TEST_CHECK(a.args.out == 4);
+	TEST_CHECK(!pthread_equal(a.args.thread, test_main));
+	TEST_CHECK(!fr_tls_offload_callback_pending(job));
+
+	ASYNC_WAIT_CTX_free(a.wait_ctx);
+	test_stop(ctx);
+}
+
+/*
+ *	A job paused in a callback is drained
+ *	synchronously, e.g. when the request is
+ *	cancelled.  The callback is run by the crypto
+ *	thread, as the worker is blocked.
+ */
+static void test_callback_drain(void)
+{
+	TALLOC_CTX		*ctx = talloc_new(autofree);
+	fr_event_list_t		*el = test_start(ctx, 1, 0);
+	fr_tls_offload_job_t	*job = fr_tls_offload_job_alloc(ctx);
+	test_async_t		a = { .args = { .in = 5 } };
+
+	test_submit(job, test_async_start, &a, false);
+	test_wait(el);
+	TEST_CHECK(a.status == ASYNC_PAUSE);
+	TEST_CHECK(fr_tls_offload_callback_pending(job));
+
+	fr_tls_offload_run(job, test_request, test_async_start, &a);
+	TEST_CHECK(a.status == ASYNC_FINISH);
+	TEST_CHECK(a.args.out == 10);
+	TEST_CHECK(!pthread_equal(a.args.thread, test_main));
+	TEST_CHECK(!fr_tls_offload_callback_pending(job));
+
+	ASYNC_WAIT_CTX_free(a.wait_ctx);
+	test_stop(ctx);
+}
+
+/*
+ *	Full TLS handshake, with the server side run on a
+ *	crypto thread, as tls_session_async_handshake_cont
+ *	does.
+ */
+static int test_info_cb_calls;
+static int test_info_cb_off_thread;
+static int test_msg_cb_calls;
+static int test_msg_cb_off_thread;
+static int test_info_cb_exit_where;		//!< Left by the crypto thread, as session.c does.
+static int test_info_cb_exit_ret;
+
+typedef struct {
+	SSL const	*ssl;
+	int		where;
+	int		ret;
+} test_info_cb_args_t;
+
+static void test_info_cb(SSL const *ssl, int where, int ret);
+
+static void test_info_cb_offload(UNUSED request_t *request, void *uctx)
+{
+	test_info_cb_args_t *args = uctx;
+
+	test_info_cb(args->ssl, args->where, args->ret);
+}
+
+static void test_info_cb(SSL const *ssl, int where, int ret)
+{
+	if ((where & SSL_CB_EXIT) && fr_tls_offload_callback_marshalled()) {
+		test_info_cb_exit_where = where;
+		test_info_cb_exit_ret = ret;
+		return;
+	}
+
+	if (fr_tls_offload_callback(test_info_cb_offload,
+				    &(test_info_cb_args_t){ .ssl = ssl, .where = where, .ret = ret })) return;
+
+	test_info_cb_calls++;
+	if (!pthread_equal(pthread_self(), test_main)) test_info_cb_off_thread++;
+}
+
+typedef struct {
+	int		write_p;
+	int		version;
+	int		content_type;
+	void const	*buf;
+	size_t		len;
+	SSL		*ssl;
+	void		*arg;
+} test_msg_cb_args_t;
+
+static void test_msg_cb(int write_p, int version, int content_type, void const *buf, size_t len, SSL *ssl, void *arg);
+
+static void test_msg_cb_offload(UNUSED request_t *request, void *uctx)
+{
+	test_msg_cb_args_t *args = uctx;
+
+	test_msg_cb(args->write_p, args->version, args->content_type, args->buf, args->len, args->ssl, args->arg);
+}
+
+static void test_msg_cb(int write_p, int version, int content_type, void const *buf, size_t len, SSL *ssl, void *arg)
+{
+	if (fr_tls_offload_callback(test_msg_cb_offload,
+				    &(test_msg_cb_args_t){ .write_p = write_p, .version = version,
+							   .content_type = content_type,
+							   .buf = buf, .len = len, .ssl = ssl, .arg = arg })) return;
+
+	test_msg_cb_calls++;
+	if (!pthread_equal(pthread_self(), test_main)) test_msg_cb_off_thread++;
+}
+
+static int test_verify_cb(UNUSED int ok, UNUSED X509_STORE_CTX *x509_ctx)
+{
+	return 1;
+}
+
+/** Create a self-signed certificate for the server
+ *
+ */
+static void test_server_cert(SSL_CTX *ssl_ctx)
+{
+	EVP_PKEY_CTX	*pkey_ctx;
+	EVP_PKEY	*pkey = NULL;
+	X509		*cert;
+	X509_NAME	*name;
+
+	pkey_ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, NULL);
+	TEST_ASSERT(pkey_ctx != NULL);
+	TEST_ASSERT(EVP_PKEY_keygen_init(pkey_ctx) == 1);
+	TEST_ASSERT(EVP_PKEY_CTX_set_ec_paramgen_curve_nid(pkey_ctx, NID_X9_62_prime256v1) == 1);
+	TEST_ASSERT(EVP_PKEY_keygen(pkey_ctx, &pkey) == 1);
+	EVP_PKEY_CTX_free(pkey_ctx);
+
+	cert = X509_new();
+	TEST_ASSERT(cert != NULL);
+	TEST_ASSERT(X509_set_version(cert, 2) == 1);
+	TEST_ASSERT(ASN1_INTEGER_set(X509_get_serialNumber(cert), 1) == 1);
+	TEST_ASSERT(X509_gmtime_adj(X509_getm_notBefore(cert), -60) != NULL);
+	TEST_ASSERT(X509_gmtime_adj(X509_getm_notAfter(cert), 3600) != NULL);
+	TEST_ASSERT(X509_set_pubkey(cert, pkey) == 1);
+
+	name = X509_get_subject_name(cert);
+	TEST_ASSERT(X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+					       (unsigned char const *)"offload test", -1, -1, 0) == 1);
+	TEST_ASSERT(X509_set_issuer_name(cert, name) == 1);
+	TEST_ASSERT(X509_sign(cert, pkey, EVP_sha256()) > 0);
+
+	TEST_ASSERT(SSL_CTX_use_certificate(ssl_ctx, cert) == 1);
+	TEST_ASSERT(SSL_CTX_use_PrivateKey(ssl_ctx, pkey) == 1);
+
+	X509_free(cert);
+	EVP_PKEY_free(pkey);
+}
+
+typedef struct {
+	SSL		*ssl;
+	int		ret;
+	int		err;
+	pthread_t	thread;
+} test_handshake_t;
+
+static void test_server_handshake(UNUSED request_t *request, void *uctx)
+{
+	test_handshake_t	*h = uctx;
+	uint8_t			buf[16];
+
+	h->thread = pthread_self();
+
+	/*
+	 *	SSL_read(), as session.c uses.  SSL_do_handshake()
+	 *	won't resume a job paused after the handshake is
+	 *	marked as complete.
+	 */
+	h->ret = SSL_read(h->ssl, buf, sizeof(buf));
+	h->err = (h->ret > 0) ? SSL_ERROR_NONE : SSL_get_error(h->ssl, h->ret);
+}
+
+static void test_handshake(void)
+{
+	TALLOC_CTX		*ctx = talloc_new(autofree);
+	fr_event_list_t		*el = test_start(ctx, 2, 0);
+	fr_tls_offload_job_t	*job = fr_tls_offload_job_alloc(ctx);
+	SSL_CTX			*server_ctx, *client_ctx;
+	SSL			*client;
+	BIO			*client_bio, *server_bio;
+	test_handshake_t	server = {};
+	int			rounds, callbacks = 0, exits = 0, ret;
+
+	server_ctx = SSL_CTX_new(TLS_server_method());
+	TEST_ASSERT(server_ctx != NULL);
+	test_server_cert(server_ctx);
+	SSL_CTX_set_mode(server_ctx, SSL_MODE_ASYNC);
+	SSL_CTX_set_info_callback(server_ctx, test_info_cb);
+	SSL_CTX_set_msg_callback(server_ctx, test_msg_cb);
+
+	client_ctx = SSL_CTX_new(TLS_client_method());
+	TEST_ASSERT(client_ctx != NULL);
+	SSL_CTX_set_verify(client_ctx, SSL_VERIFY_PEER, test_verify_cb);
+
+	TEST_ASSERT(BIO_new_bio_pair(&client_bio, 0, &server_bio, 0) == 1);
+
+	server.ssl = SSL_new(server_ctx);
+	SSL_set_bio(server.ssl, server_bio, server_bio);
+	SSL_set_accept_state(server.ssl);
+
+	client = SSL_new(client_ctx);
+	SSL_set_bio(client, client_bio, client_bio);
+	SSL_set_connect_state(client);
+
+	for (rounds = 0; rounds < 100; rounds++) {
+		ret = SSL_do_handshake(client);
+		if (ret <= 0) TEST_ASSERT(SSL_get_error(client, ret) == SSL_ERROR_WANT_READ);
+
+		/*
+		 *	Keep continuing the server's round until
+		 *	no more callbacks are handed back.
+		 */
+		test_submit(job, test_server_handshake, &server, SSL_waiting_for_async(server.ssl));
+		test_wait(el);
+		TEST_CHECK(!pthread_equal(server.thread, test_main));
+
+		while (fr_tls_offload_callback_pending(job)) {
+			TEST_ASSERT(server.err == SSL_ERROR_WANT_ASYNC);
+			fr_tls_offload_callback_run(job, test_request);
+			callbacks++;
+
+			test_submit(job, test_server_handshake, &server, true);
+			test_wait(el);
+		}
+		fr_tls_offload_error_restore(job);
+
+		/*
+		 *	Pausing on exit would have clobbered the
+		 *	result, so it's logged once the round is over.
+		 */
+		if (test_info_cb_exit_where) {
+			test_info_cb(server.ssl, test_info_cb_exit_where, test_info_cb_exit_ret);
+			test_info_cb_exit_where = 0;
+			exits++;
+		}
+
+		TEST_ASSERT(server.err == SSL_ERROR_WANT_READ);
+		if ((ret > 0) && SSL_is_init_finished(server.ssl)) break;
+	}
+
+	TEST_CHECK(SSL_is_init_finished(client));
+	TEST_CHECK(SSL_is_init_finished(server.ssl));
+	TEST_MSG("Handshake didn't complete after %i rounds", rounds);
+
+	TEST_CHECK(test_info_cb_calls > 0);
+	TEST_CHECK(test_msg_cb_calls > 0);
+	TEST_CHECK(exits > 0);
+	TEST_CHECK((callbacks + exits) == (test_info_cb_calls + test_msg_cb_calls));
+	TEST_CHECK(test_info_cb_off_thread == 0);
+	TEST_CHECK(test_msg_cb_off_thread == 0);
+	TEST_MSG("All callbacks should have been run by the worker");
+
+	SSL_free(client);
+	SSL_free(server.ssl);
+	SSL_CTX_free(client_ctx);
+	SSL_CTX_free(server_ctx);
+
+	test_stop(ctx);
+}
+
+TEST_LIST = {
+	{ "submit_complete",	test_submit_complete },
+	{ "run_sync",		test_run_sync },
+	{ "queue_full",		test_queue_full },
+	{ "cancel",		test_cancel },
+	{ "error_restore",	test_error_restore },
+
+	{ "callback_marshal",	test_callback_marshal },
+	{ "callback_inline",	test_callback_inline },
+	{ "callback_drain",	test_callback_drain },
+
+	{ "handshake",		test_handshake },
+
+	{ NULL }
+};
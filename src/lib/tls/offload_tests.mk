@@ -0,0 +1,9 @@
+ifneq ($(OPENSSL_LIBS),)
+TARGET		:= offload_tests$(E)
+endif
+
+SOURCES		:= offload_tests.c
+
+TGT_LDLIBS	:= $(LIBS) $(OPENSSL_LIBS) $(GPERFTOOLS_LIBS)
+TGT_LDFLAGS	:= $(LDFLAGS) $(OPENSSL_FLAGS) $(GPERFTOOLS_LDFLAGS)
+TGT_PREREQS	:= libfreeradius-tls$(L) libfreeradius-util$(L) libfreeradius-server$(L) libfreeradius-unlang$(L)
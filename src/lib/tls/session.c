@@ -44,6 +44,7 @@
 
 #include "attrs.h"
 #include "base.h"
+#include "bio.h"
 #include "log.h"
 
 #include <openssl/x509v3.h>
@@ -179,6 +180,27 @@ static char const *tls_handshake_type_str[] = {
 #endif
 };
 
+/** Ensure a record has a buffer to write to
+ *
+ * @param record buffer to allocate.
+ */
+inline static void record_alloc(fr_tls_record_t *record)
+{
+	if (!record->data) record->data = fr_tls_bio_record_buffer_alloc();
+}
+
+/** Release a record's buffer if it holds no data
+ *
+ * @param record buffer to release.
+ */
+inline static void record_trim(fr_tls_record_t *record)
+{
+	if (record->data && (record->used == 0)) {
+		fr_tls_bio_record_buffer_free(record->data);
+		record->data = NULL;
+	}
+}
+
 /** Clear a record buffer
  *
  * @param record buffer to clear.
@@ -186,6 +208,7 @@ static char const *tls_handshake_type_str[] = {
 inline static void record_init(fr_tls_record_t *record)
 {
 	record->used = 0;
+	record_trim(record);
 }
 
 /** Destroy a record buffer
@@ -195,6 +218,7 @@ inline static void record_init(fr_tls_record_t *record)
 inline static void record_close(fr_tls_record_t *record)
 {
 	record->used = 0;
+	record_trim(record);
 }
 
 /** Copy data to the intermediate buffer, before we send it somewhere
@@ -211,6 +235,7 @@ inline static unsigned int record_from_buff(fr_tls_record_t *record, void const
 	if (added > inlen) added = inlen;
 	if (added == 0) return 0;
 
+	record_alloc(record);
 	memcpy(record->data + record->used, in, added);
 	record->used += added;
 
@@ -237,7 +262,11 @@ inline static unsigned int record_to_buff(fr_tls_record_t *record, void *out, un
 	/*
 	 *	This is pretty bad...
 	 */
-	if (record->used > 0) memmove(record->data, record->data + taken, record->used);
+	if (record->used > 0) {
+		memmove(record->data, record->data + taken, record->used);
+	} else {
+		record_trim(record);
+	}
 
 	return taken;
 }
@@ -333,6 +362,24 @@ unsigned int fr_tls_session_psk_client_cb(SSL *ssl, UNUSED char const *hint,
 			  &FR_SBUFF_IN(conf->psk_password, (size_t)psk_len), false);
 }
 
+typedef struct {
+	SSL			*ssl;
+	char const		*identity;
+	unsigned char		*psk;
+	unsigned int		max_psk_len;
+	unsigned int		ret;
+} tls_session_psk_server_cb_args_t;
+
+/** Run the PSK callback on the worker
+ *
+ */
+static void tls_session_psk_server_cb_offload(UNUSED request_t *request, void *uctx)
+{
+	tls_session_psk_server_cb_args_t *args = uctx;
+
+	args->ret = fr_tls_session_psk_server_cb(args->ssl, args->identity, args->psk, args->max_psk_len);
+}
+
 /** Determine the PSK to use for an incoming connection
  *
  * @param[in] ssl		session.
@@ -350,6 +397,11 @@ unsigned int fr_tls_session_psk_server_cb(SSL *ssl, const char *identity,
 	fr_tls_conf_t	*conf;
 	request_t	*request;
 
+	tls_session_psk_server_cb_args_t	args = { .ssl = ssl, .identity = identity,
+						     .psk = psk, .max_psk_len = max_psk_len };
+
+	if (fr_tls_offload_callback(tls_session_psk_server_cb_offload, &args)) return args.ret;
+
 	conf = (fr_tls_conf_t *)SSL_get_ex_data(ssl, FR_TLS_EX_INDEX_CONF);
 	if (!conf) return 0;
 
@@ -424,6 +476,22 @@ unsigned int fr_tls_session_psk_server_cb(SSL *ssl, const char *identity,
 }
 #endif /* PSK_MAX_IDENTITY_LEN */
 
+typedef struct {
+	SSL const		*ssl;
+	int			where;
+	int			ret;
+} tls_session_info_cb_args_t;
+
+/** Run the state change callback on the worker
+ *
+ */
+static void tls_session_info_cb_offload(UNUSED request_t *request, void *uctx)
+{
+	tls_session_info_cb_args_t *args = uctx;
+
+	fr_tls_session_info_cb(args->ssl, args->where, args->ret);
+}
+
 DIAG_OFF(DIAG_UNKNOWN_PRAGMAS)
 DIAG_OFF(used-but-marked-unused)	/* Fix spurious warnings for sk_ macros */
 /** Record session state changes
@@ -441,6 +509,27 @@ void fr_tls_session_info_cb(SSL const *ssl, int where, int ret)
 	char const	*role, *state;
 	request_t	*request = SSL_get_ex_data(ssl, FR_TLS_EX_INDEX_REQUEST);
 
+	/*
+	 *	OpenSSL has already decided what to return, and
+	 *	pausing here would overwrite it.  Leave the exit
+	 *	state for the worker to log when it processes the
+	 *	result.  The SSL * doesn't change in between.
+	 */
+	if ((where & SSL_CB_EXIT) && fr_tls_offload_callback_marshalled()) {
+		fr_tls_session_t *tls_session = talloc_get_type_abort(SSL_get_ex_data(ssl, FR_TLS_EX_INDEX_TLS_SESSION),
+								      fr_tls_session_t);
+
+		tls_session->exit_where = where;
+		tls_session->exit_ret = ret;
+		return;
+	}
+
+	/*
+	 *	Logs to the request, so must be run by the worker.
+	 */
+	if (fr_tls_offload_callback(tls_session_info_cb_offload,
+				    &(tls_session_info_cb_args_t){ .ssl = ssl, .where = where, .ret = ret })) return;
+
 	if ((where & ~SSL_ST_MASK) & SSL_ST_CONNECT) {
 		role = "Client ";
 	} else if (((where & ~SSL_ST_MASK)) & SSL_ST_ACCEPT) {
@@ -706,6 +795,27 @@ static void session_msg_log(request_t *request, fr_tls_session_t *tls_session, u
 	}
 }
 
+typedef struct {
+	int			write_p;
+	int			msg_version;
+	int			content_type;
+	void const		*inbuf;
+	size_t			len;
+	SSL			*ssl;
+	void			*arg;
+} tls_session_msg_cb_args_t;
+
+/** Run the protocol message callback on the worker
+ *
+ */
+static void tls_session_msg_cb_offload(UNUSED request_t *request, void *uctx)
+{
+	tls_session_msg_cb_args_t *args = uctx;
+
+	fr_tls_session_msg_cb(args->write_p, args->msg_version, args->content_type,
+			      args->inbuf, args->len, args->ssl, args->arg);
+}
+
 /** Record the progression of the TLS handshake
  *
  * This callback is called by OpenSSL whenever a protocol message relating to a handshake is sent
@@ -743,6 +853,12 @@ void fr_tls_session_msg_cb(int write_p, int msg_version, int content_type,
 	fr_tls_session_t	*tls_session = talloc_get_type_abort(arg, fr_tls_session_t);
 	request_t		*request = fr_tls_session_request(tls_session->ssl);
 
+	if (fr_tls_offload_callback(tls_session_msg_cb_offload,
+				    &(tls_session_msg_cb_args_t){ .write_p = write_p, .msg_version = msg_version,
+								  .content_type = content_type,
+								  .inbuf = inbuf, .len = len,
+								  .ssl = ssl, .arg = arg })) return;
+
 	/*
 	 *	Mostly to check for memory corruption...
 	 */
@@ -964,13 +1080,14 @@ int fr_tls_session_recv(request_t *request, fr_tls_session_t *tls_session)
 	 *      and init the clean_out buffer to store decrypted data
 	 */
 	record_init(&tls_session->clean_out);
+	record_alloc(&tls_session->clean_out);
 
 	/*
 	 *      Read (and decrypt) the tunneled data from the
 	 *      SSL session, and put it into the decrypted
 	 *      data buffer.
 	 */
-	ret = SSL_read(tls_session->ssl, tls_session->clean_out.data, sizeof(tls_session->clean_out.data));
+	ret = SSL_read(tls_session->ssl, tls_session->clean_out.data, FR_TLS_MAX_RECORD_SIZE);
 	if (ret < 0) {
 		int code;
 
@@ -1012,6 +1129,7 @@ int fr_tls_session_recv(request_t *request, fr_tls_session_t *tls_session)
 		RDEBUG2("Decrypted TLS application data (%zu bytes)", tls_session->clean_out.used);
 	}
 finish:
+	record_trim(&tls_session->clean_out);
 	fr_tls_session_request_unbind(tls_session->ssl);
 
 	return ret;
@@ -1063,8 +1181,8 @@ int fr_tls_session_send(request_t *request, fr_tls_session_t *tls_session)
 		record_to_buff(&tls_session->clean_in, NULL, ret);
 
 		/* Get the dirty data from Bio to send it */
-		ret = BIO_read(tls_session->from_ssl, tls_session->dirty_out.data,
-			       sizeof(tls_session->dirty_out.data));
+		record_alloc(&tls_session->dirty_out);
+		ret = BIO_read(tls_session->from_ssl, tls_session->dirty_out.data, FR_TLS_MAX_RECORD_SIZE);
 		if (ret > 0) {
 			tls_session->dirty_out.used = ret;
 			ret = 0;
@@ -1072,6 +1190,7 @@ int fr_tls_session_send(request_t *request, fr_tls_session_t *tls_session)
 			if (fr_tls_log_io_error(request, SSL_get_error(tls_session->ssl, ret),
 						"SSL_write (%s)", __FUNCTION__) < 0) ret = -1;
 		}
+		record_trim(&tls_session->dirty_out);
 	}
 
 finish:
@@ -1109,6 +1228,7 @@ static void fr_tls_session_alert_send(request_t *request, fr_tls_session_t *sess
 	session->info.alert_level = session->pending_alert_level;
 	session->info.alert_description = session->pending_alert_description;
 
+	record_alloc(&session->dirty_out);
 	session->dirty_out.data[0] = session->info.content_type;
 	session->dirty_out.data[1] = 3;
 	session->dirty_out.data[2] = 1;
@@ -1241,8 +1361,8 @@ static unlang_action_t tls_session_async_handshake_done_round(UNUSED rlm_rcode_t
 	 */
 	ret = BIO_ctrl_pending(tls_session->from_ssl);
 	if (ret > 0) {
-		ret = BIO_read(tls_session->from_ssl, tls_session->dirty_out.data,
-			       sizeof(tls_session->dirty_out.data));
+		record_alloc(&tls_session->dirty_out);
+		ret = BIO_read(tls_session->from_ssl, tls_session->dirty_out.data, FR_TLS_MAX_RECORD_SIZE);
 		if (ret > 0) {
 			tls_session->dirty_out.used = ret;
 		} else if (BIO_should_retry(tls_session->from_ssl)) {
@@ -1271,32 +1391,79 @@ static unlang_action_t tls_session_async_handshake_done_round(UNUSED rlm_rcode_t
 
 	/* We are done with dirty_in, reinitialize it */
 	record_init(&tls_session->dirty_in);
+	record_trim(&tls_session->dirty_out);
+	record_trim(&tls_session->clean_out);
 
 	tls_session->result = FR_TLS_RESULT_SUCCESS;
 	fr_tls_session_request_unbind(tls_session->ssl);
 	return UNLANG_ACTION_CALCULATE_RESULT;
 }
 
-/** Try very hard to get the SSL * into a consistent state where it's not yielded
+/** Run a callback handed back by a crypto thread
  *
- * ...because if it's yielded, we'll probably leak thread contexts and all kinds of memory.
+ * This is run in an async job of our own, so the callback can pause to
+ * run a virtual server, as it would if it had been called by the worker.
+ */
+static int tls_session_async_callback_job(void *arg)
+{
+	fr_tls_session_t	*tls_session = *((fr_tls_session_t **)arg);
+
+	fr_tls_offload_callback_run(tls_session->offload, fr_tls_session_request(tls_session->ssl));
+
+	return 1;
+}
+
+/** Start or continue a callback handed back by a crypto thread
  *
- * @param[in] request	being cancelled.
- * @param[in] action	we're being signalled with.
- * @param[in] uctx	the SSL * to cancell.
+ * @param[in] request		The current request.
+ * @param[in] tls_session	the callback was called for.
+ * @return
+ *	- 1 if the callback completed.
+ *	- 0 if the callback paused, and async actions need to be serviced.
+ *	- -1 on error.
  */
-static void tls_session_async_handshake_signal(UNUSED request_t *request, fr_state_signal_t action, void *uctx)
+static int tls_session_async_callback(request_t *request, fr_tls_session_t *tls_session)
 {
-	fr_tls_session_t	*tls_session = talloc_get_type_abort(uctx, fr_tls_session_t);
-	int			ret;
+	int ret, job_ret;
 
-	if (action != FR_SIGNAL_CANCEL) return;
+	if (!tls_session->callback_wait_ctx) {
+		tls_session->callback_wait_ctx = ASYNC_WAIT_CTX_new();
+		if (!tls_session->callback_wait_ctx) {
+			fr_tls_log(request, "Failed allocating async wait context");
+			return -1;
+		}
+	}
 
-	/*
-	 *	We might want to set can_pause = false here
-	 *	but that would trigger asserts in the
-	 *	cache code.
-	 */
+	tls_session->can_pause = true;
+	ret = ASYNC_start_job(&tls_session->callback_job, tls_session->callback_wait_ctx, &job_ret,
+			      tls_session_async_callback_job, &tls_session, sizeof(tls_session));
+	tls_session->can_pause = false;
+
+	switch (ret) {
+	case ASYNC_FINISH:
+		return 1;
+
+	case ASYNC_PAUSE:
+		return 0;
+
+	case ASYNC_NO_JOBS:
+		RERROR("No async jobs available in pool, increase thread.openssl_async_pool_max");
+		return -1;
+
+	default:
+		fr_tls_log(request, "Failed running callback for crypto thread");
+		return -1;
+	}
+}
+
+/** Drive any paused async job in the SSL * to completion
+ *
+ * Must be run on the same thread as the SSL_read() which paused it.
+ */
+static void tls_session_async_handshake_drain(UNUSED request_t *request, void *uctx)
+{
+	fr_tls_session_t	*tls_session = talloc_get_type_abort(uctx, fr_tls_session_t);
+	int			ret;
 
 	/*
 	 *	If SSL_get_error returns SSL_ERROR_WANT_ASYNC
@@ -1310,10 +1477,57 @@ static void tls_session_async_handshake_signal(UNUSED request_t *request, fr_sta
 	 *	It'll get freed later when the request is
 	 *	freed.
 	 */
+	record_alloc(&tls_session->clean_out);
 	for (ret = tls_session->last_ret;
 	     SSL_get_error(tls_session->ssl, ret) == SSL_ERROR_WANT_ASYNC;
 	     ret = SSL_read(tls_session->ssl, tls_session->clean_out.data + tls_session->clean_out.used,
-        		    sizeof(tls_session->clean_out.data) - tls_session->clean_out.used));
+        		    FR_TLS_MAX_RECORD_SIZE - tls_session->clean_out.used));
+}
+
+/** Try very hard to get the SSL * into a consistent state where it's not yielded
+ *
+ * ...because if it's yielded, we'll probably leak thread contexts and all kinds of memory.
+ *
+ * @param[in] request	being cancelled.
+ * @param[in] action	we're being signalled with.
+ * @param[in] uctx	the SSL * to cancell.
+ */
+static void tls_session_async_handshake_signal(request_t *request, fr_state_signal_t action, void *uctx)
+{
+	fr_tls_session_t	*tls_session = talloc_get_type_abort(uctx, fr_tls_session_t);
+
+	if (action != FR_SIGNAL_CANCEL) return;
+
+	/*
+	 *	We might want to set can_pause = false here
+	 *	but that would trigger asserts in the
+	 *	cache code.
+	 */
+
+	/*
+	 *	Let any callback we were running for a crypto
+	 *	thread complete.  It'll find the results of
+	 *	its async actions missing, and fail.
+	 */
+	if (tls_session->callback_job) {
+		int ret;
+
+		while (ASYNC_start_job(&tls_session->callback_job, tls_session->callback_wait_ctx, &ret,
+				       tls_session_async_callback_job, NULL, 0) == ASYNC_PAUSE);
+		tls_session->callback_job = NULL;
+	}
+
+	/*
+	 *	If the last round was run by a crypto thread,
+	 *	wait for any round in progress, and drain the
+	 *	SSL * on the same thread.
+	 */
+	if (tls_session->offloaded) {
+		fr_tls_offload_run(tls_session->offload, request, tls_session_async_handshake_drain, tls_session);
+		tls_session->offloaded = false;
+	} else {
+		tls_session_async_handshake_drain(request, tls_session);
+	}
 
 	/*
 	 *	Unbind the cancelled request from the SSL *
@@ -1323,23 +1537,17 @@ static void tls_session_async_handshake_signal(UNUSED request_t *request, fr_sta
 
 /** Call SSL_read() to continue the TLS state machine
  *
- * This function may be called multiple times, once after every asynchronous request.
+ * This is where private key operations and certificate validation
+ * happen, so this may be run on a crypto thread.  It must not access
+ * the request, or log, as both belong to the worker.  Callbacks which
+ * do are handed back to the worker by #fr_tls_offload_callback.
  *
- * @param[in,out] p_result	UNUSED.
- * @param[out] priority		UNUSED
  * @param[in] request		The current request.
  * @param[in] uctx		#fr_tls_session_t to continue.
- * @return
- *	- UNLANG_ACTION_CALCULATE_RESULT - We're done with this round.
- *	- UNLANG_ACTION_PUSHED_CHILD - Need to perform more asynchronous actions.
  */
-static unlang_action_t tls_session_async_handshake_cont(rlm_rcode_t *p_result, int *priority,
-							request_t *request, void *uctx)
+static void tls_session_async_handshake_read(UNUSED request_t *request, void *uctx)
 {
 	fr_tls_session_t	*tls_session = talloc_get_type_abort(uctx, fr_tls_session_t);
-	int			err;
-
-	RDEBUG3("(re-)entered state %s", __FUNCTION__);
 
 	/*
 	 *	Magic/More magic? Although SSL_read is normally
@@ -1363,22 +1571,11 @@ static unlang_action_t tls_session_async_handshake_cont(rlm_rcode_t *p_result, i
 	 */
 	tls_session->can_pause = true;
 	tls_session->last_ret = SSL_read(tls_session->ssl, tls_session->clean_out.data + tls_session->clean_out.used,
-					 sizeof(tls_session->clean_out.data) - tls_session->clean_out.used);
+					 FR_TLS_MAX_RECORD_SIZE - tls_session->clean_out.used);
 	tls_session->can_pause = false;
 	if (tls_session->last_ret > 0) {
-		tls_session->clean_out.used += tls_session->last_ret;
-
-		/*
-		 *	Round successful, and we don't need to do any
-		 *	further processing.
-		 */
-		tls_session->result = FR_TLS_RESULT_SUCCESS;
-	finish:
-		/*
-		 *	Was bound by caller
-		 */
-		fr_tls_session_request_unbind(tls_session->ssl);
-		return UNLANG_ACTION_CALCULATE_RESULT;
+		tls_session->last_err = SSL_ERROR_NONE;
+		return;
 	}
 
 #if OPENSSL_VERSION_NUMBER >= 0x30000000L
@@ -1419,6 +1616,54 @@ DIAG_ON(DIAG_UNKNOWN_PRAGMAS)
 	}
 #endif
 
+	tls_session->last_err = SSL_get_error(tls_session->ssl, tls_session->last_ret);
+}
+
+static unlang_action_t tls_session_async_handshake_cont(rlm_rcode_t *p_result, int *priority,
+							request_t *request, void *uctx);
+
+/** Process the result of SSL_read()
+ *
+ * @param[in,out] p_result	UNUSED.
+ * @param[out] priority		UNUSED
+ * @param[in] request		The current request.
+ * @param[in] uctx		#fr_tls_session_t to continue.
+ * @return
+ *	- UNLANG_ACTION_CALCULATE_RESULT - We're done with this round.
+ *	- UNLANG_ACTION_PUSHED_CHILD - Need to perform more asynchronous actions.
+ */
+static unlang_action_t tls_session_async_handshake_process(rlm_rcode_t *p_result, int *priority,
+							   request_t *request, void *uctx)
+{
+	fr_tls_session_t	*tls_session = talloc_get_type_abort(uctx, fr_tls_session_t);
+
+	RDEBUG3("entered state %s", __FUNCTION__);
+
+	if (tls_session->offloaded) {
+		fr_tls_offload_error_restore(tls_session->offload);
+
+		if (tls_session->exit_where) {
+			fr_tls_session_info_cb(tls_session->ssl, tls_session->exit_where, tls_session->exit_ret);
+			tls_session->exit_where = 0;
+		}
+	}
+
+	if (tls_session->last_ret > 0) {
+		tls_session->clean_out.used += tls_session->last_ret;
+
+		/*
+		 *	Round successful, and we don't need to do any
+		 *	further processing.
+		 */
+		tls_session->result = FR_TLS_RESULT_SUCCESS;
+	finish:
+		/*
+		 *	Was bound by caller
+		 */
+		fr_tls_session_request_unbind(tls_session->ssl);
+		return UNLANG_ACTION_CALCULATE_RESULT;
+	}
+
 	/*
 	 *	Deal with asynchronous requests from OpenSSL.
 	 *      These aren't actually errors, they're the
@@ -1426,11 +1671,20 @@ DIAG_ON(DIAG_UNKNOWN_PRAGMAS)
 	 *	it'd like to perform the operation
 	 *	asynchronously.
 	 */
-	switch (err = SSL_get_error(tls_session->ssl, tls_session->last_ret)) {
+	switch (tls_session->last_err) {
 	case SSL_ERROR_WANT_ASYNC:	/* Certification validation or cache loads */
 	{
 		unlang_action_t ua;
 
+		/*
+		 *	A crypto thread handed one of our
+		 *	callbacks back to us.
+		 */
+		if (!tls_session->callback_job && tls_session->offloaded &&
+		    fr_tls_offload_callback_pending(tls_session->offload)) {
+			return tls_session_async_handshake_cont(p_result, priority, request, uctx);
+		}
+
 		RDEBUG3("Performing async action for libssl");
 
 		/*
@@ -1471,9 +1725,35 @@ DIAG_ON(DIAG_UNKNOWN_PRAGMAS)
 			if (unlang_function_clear(request) < 0) goto error;
 			goto error;
 
+#ifdef HAVE_OPENSSL_OCSP_H
+		/*
+		 *	No validation pending, so there may
+		 *	be an OCSP exchange instead.
+		 */
+		case UNLANG_ACTION_CALCULATE_RESULT:
+			break;
+#endif
+
+		default:
+			return ua;
+		}
+
+#ifdef HAVE_OPENSSL_OCSP_H
+		/*
+		 *	Finally service any pending OCSP
+		 *	exchanges with the responder.
+		 */
+		ua = fr_tls_ocsp_pending_push(request, tls_session);
+		switch (ua) {
+		case UNLANG_ACTION_FAIL:
+			/* coverity[identical_branches] */
+			if (unlang_function_clear(request) < 0) goto error;
+			goto error;
+
 		default:
 			return ua;
 		}
+#endif
 	}
 
 	case SSL_ERROR_WANT_ASYNC_JOB:
@@ -1486,11 +1766,103 @@ DIAG_ON(DIAG_UNKNOWN_PRAGMAS)
 		 *	Returns -1 if we encountered a fatal error.
 		 */
 		if (fr_tls_log_io_error(request,
-					err, "SSL_read (%s)", __FUNCTION__) < 0) goto error;
+					tls_session->last_err, "SSL_read (%s)", __FUNCTION__) < 0) goto error;
 		return tls_session_async_handshake_done_round(p_result, priority, request, uctx);
 	}
 }
 
+/** Continue the TLS state machine, possibly on a crypto thread
+ *
+ * This function may be called multiple times, once after every asynchronous request.
+ *
+ * @param[in,out] p_result	UNUSED.
+ * @param[out] priority		UNUSED
+ * @param[in] request		The current request.
+ * @param[in] uctx		#fr_tls_session_t to continue.
+ * @return
+ *	- UNLANG_ACTION_CALCULATE_RESULT - We're done with this round.
+ *	- UNLANG_ACTION_PUSHED_CHILD - Need to perform more asynchronous actions.
+ *	- UNLANG_ACTION_YIELD - SSL_read() is being run by a crypto thread.
+ */
+static unlang_action_t tls_session_async_handshake_cont(rlm_rcode_t *p_result, int *priority,
+							request_t *request, void *uctx)
+{
+	fr_tls_session_t	*tls_session = talloc_get_type_abort(uctx, fr_tls_session_t);
+	bool			paused;
+
+	RDEBUG3("(re-)entered state %s", __FUNCTION__);
+
+	if (!tls_session->offload) tls_session->offload = fr_tls_offload_job_alloc(tls_session);
+
+	/*
+	 *	Finish running any callback a crypto thread
+	 *	handed back to us, before it continues.
+	 */
+	if (tls_session->offloaded && fr_tls_offload_callback_pending(tls_session->offload)) {
+		switch (tls_session_async_callback(request, tls_session)) {
+		case 1:
+			break;
+
+		/*
+		 *	Service the callback's async actions
+		 */
+		case 0:
+			return tls_session_async_handshake_process(p_result, priority, request, uctx);
+
+		default:
+			tls_session->result = FR_TLS_RESULT_ERROR;
+			fr_tls_session_request_unbind(tls_session->ssl);
+			return UNLANG_ACTION_CALCULATE_RESULT;
+		}
+	}
+
+	/*
+	 *	Allocated here so crypto threads don't
+	 *	take buffers from their own pools.
+	 */
+	record_alloc(&tls_session->clean_out);
+
+	/*
+	 *	A paused handshake has to be continued by the
+	 *	thread which paused it.  Otherwise we only run
+	 *	the round ourselves if the crypto threads are
+	 *	too busy.
+	 */
+	paused = SSL_waiting_for_async(tls_session->ssl);
+	if (tls_session->offload && (!paused || tls_session->offloaded)) {
+		if (fr_tls_offload_submit(tls_session->offload, request,
+					  tls_session_async_handshake_read, tls_session, paused) == 0) {
+			tls_session->offloaded = true;
+
+			if (unlikely(unlang_function_repeat_set(request, tls_session_async_handshake_process) < 0)) {
+				fr_tls_offload_cancel(tls_session->offload);
+				goto error;
+			}
+
+			RDEBUG3("Continuing handshake on crypto thread");
+			return UNLANG_ACTION_YIELD;
+		}
+
+		/*
+		 *	The ASYNC job was paused on a crypto thread,
+		 *	and its state lives there.  It can't be
+		 *	resumed here.
+		 */
+		if (paused) {
+			REDEBUG("Failed continuing handshake on crypto thread");
+		error:
+			tls_session->result = FR_TLS_RESULT_ERROR;
+			fr_tls_session_request_unbind(tls_session->ssl);
+			return UNLANG_ACTION_CALCULATE_RESULT;
+		}
+	}
+
+	tls_session->offloaded = false;
+	tls_session_async_handshake_read(request, tls_session);
+
+	return tls_session_async_handshake_process(p_result, priority, request, uctx);
+}
+
 /** Ingest data for another handshake round
  *
  * Advance the TLS handshake by feeding OpenSSL data from dirty_in,
@@ -1582,6 +1954,119 @@ unlang_action_t fr_tls_session_async_handshake_push(request_t *request, fr_tls_s
 				    tls_session);
 }
 
+/** Maximum number of reset SSL * each thread keeps for reuse
+ *
+ */
+#define TLS_SESSION_SSL_POOL_MAX	64
+
+/** A reset SSL *, waiting to be reused
+ *
+ */
+typedef struct {
+	fr_dlist_t		entry;			//!< Entry in the pool.
+	SSL			*ssl;			//!< With its memory BIOs still attached.
+} tls_session_ssl_t;
+
+/** SSL * which can be reused by this thread
+ *
+ * Most recently released first.
+ */
+static _Thread_local fr_dlist_head_t *tls_session_ssl_pool;
+
+static int _tls_session_ssl_free(tls_session_ssl_t *pooled)
+{
+	SSL_free(pooled->ssl);
+
+	return 0;
+}
+
+static int _tls_session_ssl_pool_free(void *pool)
+{
+	if (tls_session_ssl_pool == pool) tls_session_ssl_pool = NULL;
+
+	return talloc_free(pool);
+}
+
+/** Get a reset SSL * for the ssl_ctx from this thread's pool
+ *
+ * @param[in] ssl_ctx	the SSL * must have been created from.
+ * @return
+ *	- An SSL *, with memory BIOs attached.
+ *	- NULL if the pool holds none for this ssl_ctx.
+ */
+static SSL *tls_session_ssl_pool_get(SSL_CTX *ssl_ctx)
+{
+	tls_session_ssl_t	*pooled;
+	SSL			*ssl;
+
+	if (!tls_session_ssl_pool) return NULL;
+
+	for (pooled = fr_dlist_head(tls_session_ssl_pool);
+	     pooled;
+	     pooled = fr_dlist_next(tls_session_ssl_pool, pooled)) {
+		if (SSL_get_SSL_CTX(pooled->ssl) != ssl_ctx) continue;
+
+		fr_dlist_remove(tls_session_ssl_pool, pooled);
+		ssl = pooled->ssl;
+		talloc_set_destructor(pooled, NULL);
+		talloc_free(pooled);
+
+		return ssl;
+	}
+
+	return NULL;
+}
+
+/** Reset an SSL * and add it to this thread's pool
+ *
+ * @param[in] ssl	to reset.  Freed if it can't be reused.
+ */
+static void tls_session_ssl_pool_put(SSL *ssl)
+{
+	tls_session_ssl_t	*pooled;
+	int			i;
+
+	/*
+	 *	Paused in the middle of a callback
+	 */
+	if (SSL_waiting_for_async(ssl) || (SSL_clear(ssl) != 1)) {
+	free:
+		SSL_free(ssl);
+		return;
+	}
+
+	/*
+	 *	SSL_clear() leaves the session in place
+	 *	for clients, which we don't want either.
+	 */
+	if (SSL_set_session(ssl, NULL) != 1) goto free;
+
+	for (i = FR_TLS_EX_INDEX_EAP_SESSION; i <= FR_TLS_EX_INDEX_TALLOC; i++) SSL_set_ex_data(ssl, i, NULL);
+	SSL_set_msg_callback_arg(ssl, NULL);
+	(void) BIO_reset(SSL_get_rbio(ssl));
+	(void) BIO_reset(SSL_get_wbio(ssl));
+
+	if (unlikely(!tls_session_ssl_pool)) {
+		fr_dlist_head_t *pool;
+
+		MEM(pool = talloc_zero(NULL, fr_dlist_head_t));
+		fr_dlist_talloc_init(pool, tls_session_ssl_t, entry);
+		fr_atexit_thread_local(tls_session_ssl_pool, _tls_session_ssl_pool_free, pool);
+	}
+
+	/*
+	 *	Evict the least recently used
+	 */
+	if (fr_dlist_num_elements(tls_session_ssl_pool) >= TLS_SESSION_SSL_POOL_MAX) {
+		talloc_free(fr_dlist_pop_tail(tls_session_ssl_pool));
+	}
+
+	MEM(pooled = talloc_zero(tls_session_ssl_pool, tls_session_ssl_t));
+	pooled->ssl = ssl;
+	talloc_set_destructor(pooled, _tls_session_ssl_free);
+	fr_dlist_insert_head(tls_session_ssl_pool, pooled);
+}
+
 /** Free a TLS session and any associated OpenSSL data
  *
  * @param session to free.
@@ -1589,13 +2074,32 @@ unlang_action_t fr_tls_session_async_handshake_push(request_t *request, fr_tls_s
  */
 static int _fr_tls_session_free(fr_tls_session_t *session)
 {
+	/*
+	 *	Must not be running when the SSL * is freed
+	 */
+	TALLOC_FREE(session->offload);
+
+	if (session->callback_wait_ctx) {
+		ASYNC_WAIT_CTX_free(session->callback_wait_ctx);
+		session->callback_wait_ctx = NULL;
+	}
+
 	if (session->ssl) {
 		SSL_set_quiet_shutdown(session->ssl, 1);
 		SSL_shutdown(session->ssl);
-		SSL_free(session->ssl);
+		if (session->reuse_ssl) {
+			tls_session_ssl_pool_put(session->ssl);
+		} else {
+			SSL_free(session->ssl);
+		}
 		session->ssl = NULL;
 	}
 
+	record_close(&session->clean_in);
+	record_close(&session->clean_out);
+	record_close(&session->dirty_in);
+	record_close(&session->dirty_out);
+
 	return 0;
 }
 
@@ -1708,16 +2212,24 @@ fr_tls_session_t *fr_tls_session_alloc_server(TALLOC_CTX *ctx, SSL_CTX *ssl_ctx,
 
 	MEM(tls_session = talloc_zero(ctx, fr_tls_session_t));
 
-	ssl = SSL_new(ssl_ctx);
-	if (ssl == NULL) {
-		fr_tls_log(request, "Error creating new TLS session");
-		return NULL;
+	/*
+	 *	Creating an SSL * is expensive, so reuse one
+	 *	from a previous session if we can.
+	 */
+	ssl = tls_session_ssl_pool_get(ssl_ctx);
+	if (!ssl) {
+		ssl = SSL_new(ssl_ctx);
+		if (ssl == NULL) {
+			fr_tls_log(request, "Error creating new TLS session");
+			return NULL;
+		}
 	}
 	fr_pair_list_init(&tls_session->extra_pairs);
 
 	session_init(tls_session);
 	tls_session->ctx = ssl_ctx;
 	tls_session->ssl = ssl;
+	tls_session->reuse_ssl = true;
 	talloc_set_destructor(tls_session, _fr_tls_session_free);
 
 	fr_tls_session_request_bind(tls_session->ssl, request);	/* Is unbound in this function */
@@ -1740,9 +2252,13 @@ fr_tls_session_t *fr_tls_session_alloc_server(TALLOC_CTX *ctx, SSL_CTX *ssl_ctx,
 	 *	and we can update those BIOs from the packets we've
 	 *	received.
 	 */
-	MEM(tls_session->into_ssl = BIO_new(BIO_s_mem()));
-	MEM(tls_session->from_ssl = BIO_new(BIO_s_mem()));
-	SSL_set_bio(tls_session->ssl, tls_session->into_ssl, tls_session->from_ssl);
+	tls_session->into_ssl = SSL_get_rbio(tls_session->ssl);
+	tls_session->from_ssl = SSL_get_wbio(tls_session->ssl);
+	if (!tls_session->into_ssl) {
+		MEM(tls_session->into_ssl = BIO_new(BIO_s_mem()));
+		MEM(tls_session->from_ssl = BIO_new(BIO_s_mem()));
+		SSL_set_bio(tls_session->ssl, tls_session->into_ssl, tls_session->from_ssl);
+	}
 
 	/*
 	 *	Add the message callback to identify what type of
@@ -1803,6 +2319,11 @@ fr_tls_session_t *fr_tls_session_alloc_server(TALLOC_CTX *ctx, SSL_CTX *ssl_ctx,
 	if (vp) {
 		RDEBUG2("Loading TLS session certificate \"%pV\"", &vp->data);
 
+		/*
+		 *	Would be inherited by the next session
+		 */
+		tls_session->reuse_ssl = false;
+
 		if (SSL_use_certificate_file(tls_session->ssl, vp->vp_strvalue, SSL_FILETYPE_PEM) != 1) {
 			fr_tls_log(request, "Failed loading TLS session certificate \"%s\"",
 				      vp->vp_strvalue);
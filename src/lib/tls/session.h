@@ -27,6 +27,7 @@ RCSIDH(session_h, "$Id$")
 
 #include "openssl_user_macros.h"
 
+#include <openssl/async.h>
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 
@@ -37,6 +38,7 @@ typedef struct fr_tls_session_s fr_tls_session_t;
 #include "cache.h"
 #include "conf.h"
 #include "index.h"
+#include "offload.h"
 #include "verify.h"
 
 #ifdef __cplusplus
@@ -62,9 +64,12 @@ extern "C" {
 /*
  * FIXME: Dynamic allocation of buffer to overcome FR_TLS_MAX_RECORD_SIZE overflows.
  * 	or configure TLS not to exceed FR_TLS_MAX_RECORD_SIZE.
+ *
+ * The buffer is only allocated whilst the record holds data, so that
+ * idle sessions don't hold FR_TLS_MAX_RECORD_SIZE bytes per record.
  */
 typedef struct {
-	uint8_t		data[FR_TLS_MAX_RECORD_SIZE];
+	uint8_t		*data;				//!< FR_TLS_MAX_RECORD_SIZE bytes, or NULL.
 	size_t 		used;
 } fr_tls_record_t;
 
@@ -117,6 +122,23 @@ struct fr_tls_session_s {
 	fr_tls_record_t 	dirty_in;			//!< Encrypted data to decrypt.
 	fr_tls_record_t 	dirty_out;			//!< Encrypted data that's been decrypted.
 	int			last_ret;			//!< Last result returned by SSL_read().
+	int			last_err;			//!< SSL_get_error() for last_ret.
+
+	fr_tls_offload_job_t	*offload;			//!< For running handshake rounds on a crypto thread.
+	bool			offloaded;			//!< Whether the last SSL_read() was run by a
+								///< crypto thread.
+	ASYNC_JOB		*callback_job;			//!< Running a callback handed back by a crypto
+								///< thread, which has paused.
+	ASYNC_WAIT_CTX		*callback_wait_ctx;		//!< For callback_job.  OpenSSL requires one
+								///< for any job which pauses.
+	int			exit_where;			//!< Handshake exit recorded by a crypto thread,
+								///< for the worker to log.  0 if none.
+	int			exit_ret;			//!< Passed to the info callback with exit_where.
+
+	bool			reuse_ssl;			//!< Whether the SSL * can be reset and reused
+								///< when the session is freed.  Must be cleared
+								///< by anything which changes settings which
+								///< SSL_clear() doesn't reset.
 
 	void 			(*record_init)(fr_tls_record_t *buf);
 	void 			(*record_close)(fr_tls_record_t *buf);
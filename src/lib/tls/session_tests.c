@@ -0,0 +1,356 @@
+/*
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Lesser General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2.1 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *   Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Tests for reusing SSL * and record buffers between sessions
+ *
+ * @file src/lib/tls/session_tests.c
+ * @copyright 2026 The FreeRADIUS server project
+ */
+#define USE_CONSTRUCTOR
+
+#ifdef USE_CONSTRUCTOR
+static void test_init(void) __attribute__((constructor));
+#else
+static void test_init(void);
+#  define TEST_INIT  test_init()
+#endif
+
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+
+#include "session.c"
+
+#include <openssl/async.h>
+
+/*
+ *	Only needed by the code which processes handshakes,
+ *	which isn't tested here.
+ */
+fr_dict_attr_t const *attr_framed_mtu;
+fr_dict_attr_t const *attr_session_resumed;
+fr_dict_attr_t const *attr_tls_client_error_code;
+fr_dict_attr_t const *attr_tls_psk_identity;
+fr_dict_attr_t const *attr_tls_session_cert_file;
+fr_dict_attr_t const *attr_tls_session_cipher_suite;
+fr_dict_attr_t const *attr_tls_session_require_client_cert;
+fr_dict_attr_t const *attr_tls_session_version;
+
+static TALLOC_CTX	*autofree;
+static SSL_CTX		*server_ctx;
+static SSL_CTX		*client_ctx;
+static bool		test_pause;		//!< Pause the next handshake in the info callback.
+
+static void test_info_cb(UNUSED SSL const *ssl, int where, UNUSED int ret)
+{
+	if (!test_pause || !(where & SSL_CB_LOOP) || !ASYNC_get_current_job()) return;
+
+	test_pause = false;
+	ASYNC_pause_job();
+}
+
+static int test_verify_cb(UNUSED int ok, UNUSED X509_STORE_CTX *x509_ctx)
+{
+	return 1;
+}
+
+/** Create a self-signed certificate for the server
+ *
+ */
+static int test_server_cert(SSL_CTX *ssl_ctx)
+{
+	EVP_PKEY_CTX	*pkey_ctx;
+	EVP_PKEY	*pkey = NULL;
+	X509		*cert;
+	X509_NAME	*name;
+	int		ret = -1;
+
+	pkey_ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, NULL);
+	if (!pkey_ctx) return -1;
+	if ((EVP_PKEY_keygen_init(pkey_ctx) != 1) ||
+	    (EVP_PKEY_CTX_set_ec_paramgen_curve_nid(pkey_ctx, NID_X9_62_prime256v1) != 1) ||
+	    (EVP_PKEY_keygen(pkey_ctx, &pkey) != 1)) {
+		EVP_PKEY_CTX_free(pkey_ctx);
+		return -1;
+	}
+	EVP_PKEY_CTX_free(pkey_ctx);
+
+	cert = X509_new();
+	if (!cert) goto finish;
+
+	name = X509_get_subject_name(cert);
+	if ((X509_set_version(cert, 2) != 1) ||
+	    (ASN1_INTEGER_set(X509_get_serialNumber(cert), 1) != 1) ||
+	    !X509_gmtime_adj(X509_getm_notBefore(cert), -60) ||
+	    !X509_gmtime_adj(X509_getm_notAfter(cert), 3600) ||
+	    (X509_set_pubkey(cert, pkey) != 1) ||
+	    (X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+					(unsigned char const *)"session test", -1, -1, 0) != 1) ||
+	    (X509_set_issuer_name(cert, name) != 1) ||
+	    (X509_sign(cert, pkey, EVP_sha256()) <= 0) ||
+	    (SSL_CTX_use_certificate(ssl_ctx, cert) != 1) ||
+	    (SSL_CTX_use_PrivateKey(ssl_ctx, pkey) != 1)) goto finish;
+
+	ret = 0;
+
+finish:
+	X509_free(cert);
+	EVP_PKEY_free(pkey);
+
+	return ret;
+}
+
+/** Global initialisation
+ */
+static void test_init(void)
+{
+	autofree = talloc_autofree_context();
+	if (!autofree) {
+	error:
+		fr_perror("session_tests");
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	if (fr_time_start() < 0) goto error;
+
+	if (fr_openssl_init() < 0) goto error;
+
+	server_ctx = SSL_CTX_new(TLS_server_method());
+	if (!server_ctx || (test_server_cert(server_ctx) < 0)) goto error;
+	SSL_CTX_set_mode(server_ctx, SSL_MODE_ASYNC);
+	SSL_CTX_set_info_callback(server_ctx, test_info_cb);
+
+	client_ctx = SSL_CTX_new(TLS_client_method());
+	if (!client_ctx) goto error;
+	SSL_CTX_set_verify(client_ctx, SSL_VERIFY_PEER, test_verify_cb);
+}
+
+/** Create a server SSL *, with memory BIOs, as fr_tls_session_alloc_server does
+ *
+ */
+static SSL *test_server_new(void)
+{
+	SSL *ssl;
+
+	ssl = SSL_new(server_ctx);
+	TEST_ASSERT(ssl != NULL);
+	SSL_set_bio(ssl, BIO_new(BIO_s_mem()), BIO_new(BIO_s_mem()));
+
+	return ssl;
+}
+
+static size_t test_pool_size(void)
+{
+	return tls_session_ssl_pool ? fr_dlist_num_elements(tls_session_ssl_pool) : 0;
+}
+
+/** Move pending records from one SSL * to the other
+ *
+ */
+static void test_transfer(SSL *from, SSL *to)
+{
+	uint8_t	buff[4096];
+	int	len;
+
+	while ((len = BIO_read(SSL_get_wbio(from), buff, sizeof(buff))) > 0) {
+		TEST_ASSERT(BIO_write(SSL_get_rbio(to), buff, len) == len);
+	}
+}
+
+/** Run a handshake between a new client and the server SSL *
+ *
+ * @return the server's last SSL_get_error().
+ */
+static int test_handshake(SSL *server)
+{
+	SSL	*client;
+	int	rounds, ret, err = SSL_ERROR_NONE;
+
+	client = SSL_new(client_ctx);
+	TEST_ASSERT(client != NULL);
+	SSL_set_bio(client, BIO_new(BIO_s_mem()), BIO_new(BIO_s_mem()));
+	SSL_set_connect_state(client);
+	SSL_set_accept_state(server);
+
+	for (rounds = 0; rounds < 10; rounds++) {
+		ret = SSL_do_handshake(client);
+		if (ret <= 0) TEST_ASSERT(SSL_get_error(client, ret) == SSL_ERROR_WANT_READ);
+		test_transfer(client, server);
+
+		ret = SSL_do_handshake(server);
+		err = (ret > 0) ? SSL_ERROR_NONE : SSL_get_error(server, ret);
+		if ((err != SSL_ERROR_NONE) && (err != SSL_ERROR_WANT_READ)) break;
+		test_transfer(server, client);
+
+		if (SSL_is_init_finished(client) && SSL_is_init_finished(server)) break;
+	}
+
+	SSL_free(client);
+
+	return err;
+}
+
+/*
+ *	The pool only hands out SSL * for the SSL_CTX
+ *	they were created from.
+ */
+static void test_checkout(void)
+{
+	SSL_CTX	*other_ctx;
+	SSL	*ssl = test_server_new();
+	BIO	*rbio = SSL_get_rbio(ssl), *wbio = SSL_get_wbio(ssl);
+
+	TEST_CHECK(tls_session_ssl_pool_get(server_ctx) == NULL);
+
+	tls_session_ssl_pool_put(ssl);
+	TEST_CHECK(test_pool_size() == 1);
+
+	other_ctx = SSL_CTX_new(TLS_server_method());
+	TEST_ASSERT(other_ctx != NULL);
+	TEST_CHECK(tls_session_ssl_pool_get(other_ctx) == NULL);
+	TEST_CHECK(test_pool_size() == 1);
+	SSL_CTX_free(other_ctx);
+
+	TEST_CHECK(tls_session_ssl_pool_get(server_ctx) == ssl);
+	TEST_MSG("Expected the pooled SSL *");
+	TEST_CHECK(test_pool_size() == 0);
+
+	/*
+	 *	Keeps its memory BIOs
+	 */
+	TEST_CHECK(SSL_get_rbio(ssl) == rbio);
+	TEST_CHECK(SSL_get_wbio(ssl) == wbio);
+
+	SSL_free(ssl);
+}
+
+/*
+ *	A pooled SSL * has to be as good as a new one.
+ */
+static void test_reuse(void)
+{
+	SSL	*ssl = test_server_new();
+	int	dummy;
+
+	TEST_CHECK(test_handshake(ssl) == SSL_ERROR_NONE);
+	TEST_CHECK(SSL_is_init_finished(ssl));
+
+	/*
+	 *	Leave state the next session mustn't see
+	 */
+	SSL_set_ex_data(ssl, FR_TLS_EX_INDEX_REQUEST, &dummy);
+	TEST_CHECK(BIO_write(SSL_get_rbio(ssl), "stale", 5) == 5);
+
+	tls_session_ssl_pool_put(ssl);
+	TEST_ASSERT(tls_session_ssl_pool_get(server_ctx) == ssl);
+
+	TEST_CHECK(!SSL_is_init_finished(ssl));
+	TEST_CHECK(SSL_get_session(ssl) == NULL);
+	TEST_CHECK(SSL_get_ex_data(ssl, FR_TLS_EX_INDEX_REQUEST) == NULL);
+	TEST_CHECK(BIO_ctrl_pending(SSL_get_rbio(ssl)) == 0);
+	TEST_CHECK(BIO_ctrl_pending(SSL_get_wbio(ssl)) == 0);
+
+	TEST_CHECK(test_handshake(ssl) == SSL_ERROR_NONE);
+	TEST_CHECK(SSL_is_init_finished(ssl));
+	TEST_MSG("Handshake should succeed with a reused SSL *");
+
+	SSL_free(ssl);
+}
+
+/*
+ *	An SSL * paused in the middle of a handshake
+ *	can't be reset, so it must be freed.
+ */
+static void test_discard_broken(void)
+{
+	SSL	*ssl = test_server_new();
+
+	test_pause = true;
+	TEST_CHECK(test_handshake(ssl) == SSL_ERROR_WANT_ASYNC);
+	TEST_CHECK(SSL_waiting_for_async(ssl));
+
+	tls_session_ssl_pool_put(ssl);
+	TEST_CHECK(test_pool_size() == 0);
+	TEST_CHECK(tls_session_ssl_pool_get(server_ctx) == NULL);
+}
+
+/*
+ *	The pool is bounded, and the least recently
+ *	used SSL * is evicted.
+ */
+static void test_pool_max(void)
+{
+	SSL	*ssl[TLS_SESSION_SSL_POOL_MAX + 1];
+	size_t	i;
+
+	for (i = 0; i < NUM_ELEMENTS(ssl); i++) {
+		ssl[i] = test_server_new();
+		tls_session_ssl_pool_put(ssl[i]);
+	}
+	TEST_CHECK(test_pool_size() == TLS_SESSION_SSL_POOL_MAX);
+
+	/*
+	 *	Most recently released first, ssl[0] was evicted.
+	 */
+	for (i = NUM_ELEMENTS(ssl) - 1; i > 0; i--) {
+		SSL *got = tls_session_ssl_pool_get(server_ctx);
+
+		TEST_CHECK(got == ssl[i]);
+		TEST_MSG("Expected ssl[%zu]", i);
+		SSL_free(got);
+	}
+	TEST_CHECK(tls_session_ssl_pool_get(server_ctx) == NULL);
+}
+
+/*
+ *	Records only hold a buffer while they hold data.
+ */
+static void test_record_buffers(void)
+{
+	fr_tls_record_t	record = {};
+	uint8_t		out[4];
+	uint8_t		*data;
+
+	TEST_CHECK(record_from_buff(&record, "abcd", 4) == 4);
+	TEST_ASSERT(record.data != NULL);
+	data = record.data;
+
+	TEST_CHECK(record_to_buff(&record, out, 2) == 2);
+	TEST_CHECK(record.data == data);
+	TEST_CHECK(record_to_buff(&record, out, 2) == 2);
+	TEST_CHECK(memcmp(out, "cd", 2) == 0);
+	TEST_CHECK(record.data == NULL);
+	TEST_MSG("Drained records should release their buffer");
+
+	/*
+	 *	The buffer is reused by the next record
+	 */
+	TEST_CHECK(record_from_buff(&record, "efgh", 4) == 4);
+	TEST_CHECK(record.data == data);
+
+	record_close(&record);
+	TEST_CHECK(record.data == NULL);
+}
+
+TEST_LIST = {
+	{ "checkout",		test_checkout },
+	{ "reuse",		test_reuse },
+	{ "discard_broken",	test_discard_broken },
+	{ "pool_max",		test_pool_max },
+
+	{ "record_buffers",	test_record_buffers },
+
+	{ NULL }
+};
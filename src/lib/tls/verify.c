@@ -101,6 +101,22 @@ static void tls_verify_error_detail(request_t *request, SSL_CTX *ctx, int err)
 	}
 }
 
+typedef struct {
+	int			ok;
+	X509_STORE_CTX		*x509_ctx;
+	int			ret;
+} tls_verify_cert_cb_args_t;
+
+/** Run the certificate validation callback on the worker
+ *
+ */
+static void tls_verify_cert_cb_offload(UNUSED request_t *request, void *uctx)
+{
+	tls_verify_cert_cb_args_t *args = uctx;
+
+	args->ret = fr_tls_verify_cert_cb(args->ok, args->x509_ctx);
+}
+
 /** Validates a certificate using custom logic
  *
  * Before trusting a certificate, we make sure that the certificate is
@@ -142,6 +158,14 @@ int fr_tls_verify_cert_cb(int ok, X509_STORE_CTX *x509_ctx)
 	request_t		*request;
 	fr_pair_t		*container = NULL;
 
+	tls_verify_cert_cb_args_t	args = { .ok = ok, .x509_ctx = x509_ctx };
+
+	/*
+	 *	Adds attributes to the request, so must be
+	 *	run by the worker.
+	 */
+	if (fr_tls_offload_callback(tls_verify_cert_cb_offload, &args)) return args.ret;
+
 	cert = X509_STORE_CTX_get_current_cert(x509_ctx);
 	err = X509_STORE_CTX_get_error(x509_ctx);
 	depth = X509_STORE_CTX_get_error_depth(x509_ctx);
@@ -321,6 +345,31 @@ done:
 				X509_STORE_CTX_set_error(x509_ctx, X509_V_ERR_APPLICATION_VERIFICATION);
 			}
 		}
+
+#ifdef HAVE_OPENSSL_OCSP_H
+		/*
+		 *	Do OCSP last, so we have the complete set of attributes
+		 *	available for the virtual server.
+		 */
+		if (my_ok && conf->ocsp.enable) {
+			X509	*issuer_cert;
+
+			RDEBUG2("Starting OCSP Request");
+
+			/*
+			 *	If we don't have an issuer, then we can't send
+			 *	and OCSP request, but pass the NULL issuer in
+			 *	so fr_tls_ocsp_check can decide on the correct
+			 *	return code.
+			 */
+			issuer_cert = X509_STORE_CTX_get0_current_issuer(x509_ctx);
+			if (fr_tls_ocsp_check(request, ssl, conf->ocsp.store, issuer_cert, cert,
+					      &conf->ocsp, false) != FR_TLS_OCSP_STATUS_OK) {
+				my_ok = 0;
+				X509_STORE_CTX_set_error(x509_ctx, X509_V_ERR_APPLICATION_VERIFICATION);
+			}
+		}
+#endif
 	}
 
 	tls_session->client_cert_ok = (my_ok > 0);
@@ -82,6 +82,7 @@ int unlang_init_global(void)
 	if (xlat_init() < 0) return -1;
 
 	unlang_interpret_init_global();
+	if (unlang_latency_init_global() < 0) return -1;
 
 	/* Register operations for the default keywords */
 	unlang_compile_init();
@@ -117,5 +118,6 @@ void unlang_free_global(void)
 	unlang_compile_free();
 	unlang_foreach_free();
 	unlang_subrequest_op_free();
+	unlang_latency_free_global();
 	xlat_free();
 }
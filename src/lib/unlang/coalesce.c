@@ -0,0 +1,290 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file unlang/coalesce.c
+ * @brief Coalesce identical backend lookups into a single call.
+ *
+ * When many requests ask a backend the same question at the same time
+ * (e.g. after a NAS reboot), only the first one needs to send the query.
+ * The rest yield until it completes, and receive a copy of its result.
+ *
+ * Calls are tracked per module thread instance, so only requests running
+ * on the same worker are coalesced.
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/server/base.h>
+#include <freeradius-devel/unlang/interpret.h>
+#include <freeradius-devel/util/rb.h>
+
+#include "coalesce.h"
+
+struct unlang_coalesce_s {
+	fr_rb_tree_t		*calls;			//!< In-flight calls, keyed by the lookup.
+};
+
+struct unlang_coalesce_call_s {
+	fr_rb_node_t		node;			//!< Entry in the table of in-flight calls.
+	unlang_coalesce_t	*co;			//!< Table this call was inserted into.
+							///< NULL if the table has been freed.
+	request_t		*request;		//!< Request making the backend call.
+
+	uint8_t const		*key;			//!< Identifies the lookup.
+	size_t			key_len;		//!< Length of the key.
+
+	fr_dlist_head_t		waiters;		//!< Requests waiting on the result.
+	bool			done;			//!< Whether the call has completed.
+};
+
+typedef struct {
+	fr_dlist_t		entry;			//!< Entry in the call's list of waiters.
+	unlang_coalesce_call_t	*call;			//!< Call we're waiting on.  NULL once it's completed.
+	request_t		*request;		//!< Request which is waiting.
+
+	bool			success;		//!< Whether the call succeeded.
+	FR_DLIST_HEAD(fr_value_box_list) result;	//!< Our copy of the result.
+} unlang_coalesce_waiter_t;
+
+static int8_t coalesce_call_cmp(void const *one, void const *two)
+{
+	unlang_coalesce_call_t const *a = one, *b = two;
+
+	MEMCMP_RETURN(a, b, key, key_len);
+
+	return 0;
+}
+
+/** Unlink the calls still in the table
+ *
+ * During thread teardown the table may be freed before the calls,
+ * which are freed with the resume contexts of their requests.
+ */
+static int _coalesce_free(unlang_coalesce_t *co)
+{
+	fr_rb_iter_inorder_t	iter;
+	unlang_coalesce_call_t	*call;
+
+	for (call = fr_rb_iter_init_inorder(&iter, co->calls);
+	     call;
+	     call = fr_rb_iter_next_inorder(&iter)) {
+		call->co = NULL;
+	}
+
+	return 0;
+}
+
+/** Allocate a table to track in-flight calls
+ *
+ * This should be allocated in the module thread instance.
+ *
+ * @param[in] ctx	to allocate the table in.
+ * @return
+ *	- A new coalescing table.
+ *	- NULL on error.
+ */
+unlang_coalesce_t *unlang_coalesce_alloc(TALLOC_CTX *ctx)
+{
+	unlang_coalesce_t *co;
+
+	MEM(co = talloc_zero(ctx, unlang_coalesce_t));
+	co->calls = fr_rb_inline_talloc_alloc(co, unlang_coalesce_call_t, node, coalesce_call_cmp, NULL);
+	if (!co->calls) {
+		talloc_free(co);
+		return NULL;
+	}
+	talloc_set_destructor(co, _coalesce_free);
+
+	return co;
+}
+
+/** Find an in-flight call for a lookup
+ *
+ * @param[in] co	table of in-flight calls.
+ * @param[in] key	identifying the lookup.  Must include everything
+ *			which may change the result, e.g. the expanded query
+ *			and the server it's sent to.
+ * @param[in] key_len	length of the key.
+ * @return
+ *	- The in-flight call.  The caller should wait on it with
+ *	  #unlang_coalesce_xlat_yield.
+ *	- NULL if there's no call in flight.  The caller should make
+ *	  the call itself, and register it with #unlang_coalesce_start.
+ */
+unlang_coalesce_call_t *unlang_coalesce_find(unlang_coalesce_t *co, void const *key, size_t key_len)
+{
+	return fr_rb_find(co->calls, &(unlang_coalesce_call_t){ .key = key, .key_len = key_len });
+}
+
+/** Remove a call from its table, and resume all the requests waiting on it
+ *
+ */
+static void coalesce_call_complete(unlang_coalesce_call_t *call, bool success,
+				   FR_DLIST_HEAD(fr_value_box_list) const *result)
+{
+	unlang_coalesce_waiter_t	*waiter;
+
+	if (call->done) return;
+	call->done = true;
+
+	if (call->co) fr_rb_delete_by_inline_node(call->co->calls, &call->node);
+
+	while ((waiter = fr_dlist_pop_head(&call->waiters))) {
+		request_t *request = waiter->request;
+
+		waiter->call = NULL;
+		waiter->success = success;
+
+		if (success && result && (fr_value_box_list_acopy(waiter, &waiter->result, result) < 0)) {
+			RPERROR("Failed copying result of coalesced call");
+			waiter->success = false;
+		}
+
+		unlang_interpret_mark_runnable(request);
+	}
+}
+
+static int _coalesce_call_free(unlang_coalesce_call_t *call)
+{
+	/*
+	 *	The request making the call went away before
+	 *	the call completed, so there's no result for
+	 *	anyone else either.
+	 */
+	coalesce_call_complete(call, false, NULL);
+
+	return 0;
+}
+
+/** Register a backend call so other requests can wait on it
+ *
+ * @param[in] ctx	to allocate the call in.  This should be the
+ *			resume context of the backend call, so that if the
+ *			request making the call is cancelled, the waiters
+ *			are failed too.
+ * @param[in] co	table of in-flight calls.
+ * @param[in] request	making the backend call.
+ * @param[in] key	identifying the lookup.
+ * @param[in] key_len	length of the key.
+ * @return
+ *	- The new call.  #unlang_coalesce_done must be called with the result.
+ *	- NULL if a call is already in flight for this key.
+ */
+unlang_coalesce_call_t *unlang_coalesce_start(TALLOC_CTX *ctx, unlang_coalesce_t *co, request_t *request,
+					      void const *key, size_t key_len)
+{
+	unlang_coalesce_call_t *call;
+
+	MEM(call = talloc_zero(ctx, unlang_coalesce_call_t));
+	call->co = co;
+	call->request = request;
+	MEM(call->key = talloc_memdup(call, key, key_len));
+	call->key_len = key_len;
+	fr_dlist_talloc_init(&call->waiters, unlang_coalesce_waiter_t, entry);
+
+	if (!fr_rb_insert(co->calls, call)) {
+		talloc_free(call);
+		return NULL;
+	}
+	talloc_set_destructor(call, _coalesce_call_free);
+
+	return call;
+}
+
+/** Provide the result of a backend call to all the requests waiting on it
+ *
+ * After this is called, new lookups with the same key will result in a new
+ * backend call.  The call itself is freed with the context it was allocated in.
+ *
+ * @param[in] call	which has completed.
+ * @param[in] success	whether the call succeeded.
+ * @param[in] result	of the call.  Each waiting request gets its own copy.
+ */
+void unlang_coalesce_done(unlang_coalesce_call_t *call, bool success, FR_DLIST_HEAD(fr_value_box_list) const *result)
+{
+	coalesce_call_complete(call, success, result);
+}
+
+static int _coalesce_waiter_free(unlang_coalesce_waiter_t *waiter)
+{
+	if (waiter->call) fr_dlist_remove(&waiter->call->waiters, waiter);
+	waiter->call = NULL;
+
+	return 0;
+}
+
+static xlat_action_t coalesce_xlat_resume(TALLOC_CTX *ctx, fr_dcursor_t *out,
+					  xlat_ctx_t const *xctx,
+					  request_t *request, UNUSED FR_DLIST_HEAD(fr_value_box_list) *in)
+{
+	unlang_coalesce_waiter_t	*waiter = talloc_get_type_abort(xctx->rctx, unlang_coalesce_waiter_t);
+	fr_value_box_t			*vb;
+
+	if (!waiter->success) {
+		REDEBUG("Coalesced call failed");
+		talloc_free(waiter);
+		return XLAT_ACTION_FAIL;
+	}
+
+	while ((vb = fr_value_box_list_pop_head(&waiter->result))) {
+		talloc_steal(ctx, vb);
+		fr_dcursor_append(out, vb);
+	}
+	talloc_free(waiter);
+
+	return XLAT_ACTION_DONE;
+}
+
+static void coalesce_xlat_signal(xlat_ctx_t const *xctx, request_t *request, fr_state_signal_t action)
+{
+	unlang_coalesce_waiter_t	*waiter = talloc_get_type_abort(xctx->rctx, unlang_coalesce_waiter_t);
+
+	if (action != FR_SIGNAL_CANCEL) return;
+
+	RDEBUG2("No longer waiting on coalesced call");
+
+	(void) _coalesce_waiter_free(waiter);
+}
+
+/** Yield an xlat until an in-flight call completes
+ *
+ * When the call completes, the xlat returns a copy of its result.
+ *
+ * @param[in] request	which should wait.
+ * @param[in] call	to wait on.
+ * @return XLAT_ACTION_YIELD.
+ */
+xlat_action_t unlang_coalesce_xlat_yield(request_t *request, unlang_coalesce_call_t *call)
+{
+	unlang_coalesce_waiter_t	*waiter;
+
+	fr_assert(!call->done);
+
+	MEM(waiter = talloc_zero(unlang_interpret_frame_talloc_ctx(request), unlang_coalesce_waiter_t));
+	waiter->call = call;
+	waiter->request = request;
+	fr_value_box_list_init(&waiter->result);
+	fr_dlist_insert_tail(&call->waiters, waiter);
+	talloc_set_destructor(waiter, _coalesce_waiter_free);
+
+	RDEBUG2("Waiting on identical call in progress for request %s", call->request->name);
+
+	return unlang_xlat_yield(request, coalesce_xlat_resume, coalesce_xlat_signal, waiter);
+}
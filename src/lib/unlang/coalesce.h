@@ -0,0 +1,57 @@
+#pragma once
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * $Id$
+ *
+ * @file unlang/coalesce.h
+ * @brief Coalesce identical backend lookups into a single call.
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <freeradius-devel/server/request.h>
+#include <freeradius-devel/unlang/xlat.h>
+
+/** Table of in-flight backend calls, one per module thread instance
+ *
+ */
+typedef struct unlang_coalesce_s unlang_coalesce_t;
+
+/** A single in-flight backend call, which other requests can wait on
+ *
+ */
+typedef struct unlang_coalesce_call_s unlang_coalesce_call_t;
+
+unlang_coalesce_t	*unlang_coalesce_alloc(TALLOC_CTX *ctx);
+
+unlang_coalesce_call_t	*unlang_coalesce_find(unlang_coalesce_t *co, void const *key, size_t key_len);
+
+unlang_coalesce_call_t	*unlang_coalesce_start(TALLOC_CTX *ctx, unlang_coalesce_t *co, request_t *request,
+					       void const *key, size_t key_len);
+
+void			unlang_coalesce_done(unlang_coalesce_call_t *call, bool success,
+					     FR_DLIST_HEAD(fr_value_box_list) const *result);
+
+xlat_action_t		unlang_coalesce_xlat_yield(request_t *request, unlang_coalesce_call_t *call);
+
+#ifdef __cplusplus
+}
+#endif
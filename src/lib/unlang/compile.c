@@ -49,6 +49,20 @@ RCSID("$Id$")
 
 static unsigned int unlang_number = 1;
 
+/*
+ *	What the compiler was able to do at compile time, instead of
+ *	for each request.  Reset, and reported, for each section
+ *	passed to unlang_compile().
+ *
+ *	The branches of if / elsif conditions which are always true
+ *	or false have always been removed, so they aren't counted.
+ */
+static struct {
+	unsigned int	switches_folded;	//!< Switches over constant data.
+	unsigned int	cases_removed;		//!< Cases of those switches which can never be run.
+	unsigned int	values_cast;		//!< Literal data cast to the attribute type.
+} unlang_compile_stats;
+
 /*
  *	For simplicity, this is just array[unlang_number].  Once we
  *	call unlang_thread_instantiate(), the "unlang_number" above MUST
@@ -826,6 +840,50 @@ static int unlang_fixup_map(map_t *map, UNUSED void *ctx)
  *	- 0 if valid.
  *	- -1 not valid.
  */
+/** Cast a literal on the RHS of a map to the type of the attribute on the LHS
+ *
+ * This is done once here, instead of for every request.  If the cast
+ * fails, the RHS is left alone, and the error is reported when the edit
+ * is run, as before.
+ */
+static void unlang_fixup_literal(map_t *map)
+{
+	fr_dict_attr_t const	*da = tmpl_attr_tail_da(map->lhs);
+	tmpl_t			*vpt;
+
+	if (!fr_type_is_leaf(da->type)) return;
+
+	if (tmpl_is_data(map->rhs)) {
+		if (tmpl_value_type(map->rhs) == da->type) return;
+
+		/*
+		 *	Casting data ignores enumeration names, so
+		 *	strings which may be names are resolved when
+		 *	the edit is run.
+		 */
+		if (fr_type_is_string(tmpl_value_type(map->rhs)) &&
+		    fr_dict_attr_has_ext(da, FR_DICT_ATTR_EXT_ENUMV)) return;
+	}
+
+	/*
+	 *	A failed cast may leave the tmpl half converted, so
+	 *	cast a copy.
+	 */
+	vpt = tmpl_copy(map, map->rhs);
+	if (!vpt) return;
+
+	if (tmpl_cast_in_place(vpt, da->type, da) < 0) {
+		fr_strerror_clear();
+		talloc_free(vpt);
+		return;
+	}
+
+	talloc_free(map->rhs);
+	map->rhs = vpt;
+
+	unlang_compile_stats.values_cast++;
+}
+
 int unlang_fixup_update(map_t *map, void *ctx)
 {
 	CONF_PAIR *cp = cf_item_to_pair(map->ci);
@@ -993,6 +1051,11 @@ int unlang_fixup_update(map_t *map, void *ctx)
 	 */
 	if (map->op == T_OP_CMP_FALSE) return 0;
 
+	if (tmpl_is_attr(map->lhs) && tmpl_is_data(map->rhs)) {
+		unlang_fixup_literal(map);
+		return 0;
+	}
+
 	if (!tmpl_is_unresolved(map->rhs)) return 0;
 
 	/*
@@ -1784,6 +1847,14 @@ static int unlang_fixup_edit(map_t *map, void *ctx)
 		return -1;
 	}
 
+	/*
+	 *	Literal values which are being assigned are cast
+	 *	now, as with top-level edits.  Comparisons for '-='
+	 *	are left alone.
+	 */
+	if ((map->op == T_OP_EQ) && tmpl_is_attr(map->lhs) &&
+	    (tmpl_is_data(map->rhs) || tmpl_is_unresolved(map->rhs))) unlang_fixup_literal(map);
+
 	return 0;
 }
 
@@ -2877,6 +2948,7 @@ static int case_to_key(uint8_t **out, size_t *outlen, void const *data)
 	return fr_value_box_to_key(out, outlen, tmpl_value(a->vpt));
 }
 
+static tmpl_t *compile_case_value(unlang_switch_t const *switch_gext, unlang_compile_t *unlang_ctx, CONF_SECTION *cs);
 static unlang_t *compile_case(unlang_t *parent, unlang_compile_t *unlang_ctx, CONF_SECTION *cs);
 
 static unlang_t *compile_switch(unlang_t *parent, unlang_compile_t *unlang_ctx, CONF_SECTION *cs)
@@ -2896,6 +2968,8 @@ static unlang_t *compile_switch(unlang_t *parent, unlang_compile_t *unlang_ctx,
 	fr_type_t		type;
 	fr_htrie_type_t		htype;
 
+	CONF_SECTION		*match_cs = NULL;
+
 	static unlang_ext_t const switch_ext = {
 		.type = UNLANG_TYPE_SWITCH,
 		.len = sizeof(unlang_switch_t),
@@ -2978,12 +3052,20 @@ static unlang_t *compile_switch(unlang_t *parent, unlang_compile_t *unlang_ctx,
 		goto error;
 	}
 
+	/*
+	 *	Constant data is cast now, so that the matching 'case'
+	 *	statement can be picked when the switch is compiled.
+	 */
 	if (tmpl_is_data(gext->vpt)) {
-		cf_log_err(cs, "Cannot use constant data for 'switch' statement");
-		goto error;
-	}
+		type = tmpl_rules_cast(gext->vpt);
+		if (fr_type_is_null(type)) type = FR_TYPE_STRING;
 
-	if (!tmpl_is_attr(gext->vpt)) {
+		if (tmpl_cast_in_place(gext->vpt, type, NULL) < 0) {
+			cf_log_perr(cs, "Invalid argument for 'switch' statement");
+			goto error;
+		}
+
+	} else if (!tmpl_is_attr(gext->vpt)) {
 		if (tmpl_cast_set(gext->vpt, FR_TYPE_STRING) < 0) {
 			cf_log_perr(cs, "Failed setting cast type");
 			goto error;
@@ -2996,6 +3078,9 @@ static unlang_t *compile_switch(unlang_t *parent, unlang_compile_t *unlang_ctx,
 
 	} else if (tmpl_is_attr(gext->vpt)) {
 		type = tmpl_attr_tail_da(gext->vpt)->type;
+
+	} else if (tmpl_is_data(gext->vpt)) {
+		type = tmpl_value_type(gext->vpt);
 	}
 
 	htype = fr_htrie_hint(type);
@@ -3015,6 +3100,50 @@ static unlang_t *compile_switch(unlang_t *parent, unlang_compile_t *unlang_ctx,
 		goto error;
 	}
 
+	/*
+	 *	Only one 'case' of a switch over constant data can
+	 *	ever be run.  Find it before compiling anything, so
+	 *	that the contents of the others can be discarded.
+	 */
+	if (tmpl_is_data(gext->vpt)) {
+		CONF_SECTION *default_cs = NULL;
+
+		for (ci = cf_item_next(cs, NULL);
+		     ci != NULL;
+		     ci = cf_item_next(cs, ci)) {
+			CONF_SECTION	*subcs;
+			tmpl_t		*vpt;
+			int		cmp;
+
+			if (!cf_item_is_section(ci)) continue;
+
+			subcs = cf_item_to_section(ci);
+			name1 = cf_section_name1(subcs);
+
+			if ((strcmp(name1, "default") == 0) ||
+			    ((strcmp(name1, "case") == 0) && !cf_section_name2(subcs))) {
+				if (!default_cs) default_cs = subcs;
+				continue;
+			}
+
+			if (strcmp(name1, "case") != 0) continue;	/* Complained about below */
+
+			vpt = compile_case_value(gext, unlang_ctx, subcs);
+			if (!vpt) goto error;
+
+			cmp = fr_value_box_cmp(tmpl_value(gext->vpt), tmpl_value(vpt));
+			talloc_free(vpt);
+
+			if (cmp == 0) {
+				match_cs = subcs;
+				break;
+			}
+		}
+
+		if (!match_cs) match_cs = default_cs;
+		unlang_compile_stats.switches_folded++;
+	}
+
 	/*
 	 *	Walk through the children of the switch section,
 	 *	ensuring that they're all 'case' statements, and then compiling them.
@@ -3061,6 +3190,13 @@ static unlang_t *compile_switch(unlang_t *parent, unlang_compile_t *unlang_ctx,
 			}
 		}
 
+		/*
+		 *	The 'case' can never be run, so don't compile
+		 *	its contents.  The 'case' itself is still
+		 *	compiled, to check for errors and duplicates.
+		 */
+		if (tmpl_is_data(gext->vpt) && (subcs != match_cs)) cf_section_free_children(subcs);
+
 		/*
 		 *	Compile the subsection.
 		 */
@@ -3095,26 +3231,66 @@ static unlang_t *compile_switch(unlang_t *parent, unlang_compile_t *unlang_ctx,
 		g->num_children++;
 	}
 
+	/*
+	 *	Discard the 'case' statements which can never be run.
+	 *	They're all empty, so nothing else refers to them.
+	 */
+	if (tmpl_is_data(gext->vpt)) {
+		unlang_t	*child, *next, *found = NULL;
+
+		for (child = g->children; child; child = next) {
+			next = child->next;
+
+			if (unlang_generic_to_group(child)->cs == match_cs) {
+				found = child;
+				continue;
+			}
+
+			if (unlang_group_to_case(unlang_generic_to_group(child))->vpt) fr_htrie_delete(gext->ht, child);
+			talloc_free(child);
+			unlang_compile_stats.cases_removed++;
+		}
+
+		if (!found) {
+			cf_log_debug_prefix(cs, "Skipping 'switch' as no 'case' matches %pV", tmpl_value(gext->vpt));
+			talloc_free(g);
+			return UNLANG_IGNORE;
+		}
+
+		/*
+		 *	unlang_switch() runs the "default" case for
+		 *	constant data.
+		 */
+		found->next = NULL;
+		g->children = found;
+		g->tail = &found->next;
+		g->num_children = 1;
+		gext->default_case = found;
+	}
+
 	compile_action_defaults(c, unlang_ctx);
 
 	return c;
 }
 
-static unlang_t *compile_case(unlang_t *parent, unlang_compile_t *unlang_ctx, CONF_SECTION *cs)
+/** Parse the value of a 'case' statement
+ *
+ * Unresolved values are cast to the data type of the parent 'switch'.
+ *
+ * @return
+ *	- The value, as TMPL_TYPE_DATA.
+ *	- NULL on error.
+ */
+static tmpl_t *compile_case_value(unlang_switch_t const *switch_gext, unlang_compile_t *unlang_ctx, CONF_SECTION *cs)
 {
-	int			i;
-	char const		*name2;
-	unlang_t		*c;
-	unlang_group_t		*case_g;
-	unlang_case_t		*case_gext;
+	char const		*name2 = cf_section_name2(cs);
+	ssize_t			slen;
+	fr_token_t		type;
 	tmpl_t			*vpt = NULL;
 	tmpl_rules_t		t_rules;
 
-	static unlang_ext_t const case_ext = {
-		.type = UNLANG_TYPE_CASE,
-		.len = sizeof(unlang_case_t),
-		.type_name = "unlang_case_t",
-	};
+	fr_assert(name2 != NULL);
+	fr_assert(switch_gext->vpt != NULL);
 
 	/*
 	 *	We allow unknown attributes here.
@@ -3123,73 +3299,94 @@ static unlang_t *compile_case(unlang_t *parent, unlang_compile_t *unlang_ctx, CO
 	t_rules.attr.allow_unknown = true;
 	RULES_VERIFY(&t_rules);
 
-	if (!parent || (parent->type != UNLANG_TYPE_SWITCH)) {
-		cf_log_err(cs, "\"case\" statements may only appear within a \"switch\" section");
+	type = cf_section_name2_quote(cs);
+
+	slen = tmpl_afrom_substr(cs, &vpt,
+				 &FR_SBUFF_IN(name2, strlen(name2)),
+				 type,
+				 NULL,
+				 &t_rules);
+	if (!vpt) {
+		char *spaces, *text;
+
+		fr_canonicalize_error(cs, &spaces, &text, slen, fr_strerror());
+
+		cf_log_err(cs, "Syntax error");
+		cf_log_err(cs, "%s", name2);
+		cf_log_err(cs, "%s^ %s", spaces, text);
+
+		talloc_free(spaces);
+		talloc_free(text);
+
 		return NULL;
 	}
 
 	/*
-	 *	case THING means "match THING"
-	 *	case       means "match anything"
+	 *      This "case" statement is unresolved.  Try to
+	 *      resolve it to the data type of the parent
+	 *      "switch" tmpl.
 	 */
-	name2 = cf_section_name2(cs);
-	if (name2) {
-		ssize_t			slen;
-		fr_token_t		type;
-		unlang_group_t		*switch_g;
-		unlang_switch_t	*switch_gext;
-
-		type = cf_section_name2_quote(cs);
+	if (tmpl_is_unresolved(vpt)) {
+		fr_type_t cast_type = tmpl_rules_cast(switch_gext->vpt);
+		fr_dict_attr_t const *da = NULL;
 
-		slen = tmpl_afrom_substr(cs, &vpt,
-					 &FR_SBUFF_IN(name2, strlen(name2)),
-					 type,
-					 NULL,
-					 &t_rules);
-		if (!vpt) {
-			char *spaces, *text;
+		if (tmpl_is_attr(switch_gext->vpt)) da = tmpl_attr_tail_da(switch_gext->vpt);
 
-			fr_canonicalize_error(cs, &spaces, &text, slen, fr_strerror());
-
-			cf_log_err(cs, "Syntax error");
-			cf_log_err(cs, "%s", name2);
-			cf_log_err(cs, "%s^ %s", spaces, text);
+		if (fr_type_is_null(cast_type)) {
+			if (da) {
+				cast_type = da->type;
 
-			talloc_free(spaces);
-			talloc_free(text);
+			/*
+			 *	Constant data was cast when the
+			 *	switch was compiled.
+			 */
+			} else if (tmpl_is_data(switch_gext->vpt)) {
+				cast_type = tmpl_value_type(switch_gext->vpt);
+			}
+		}
 
+		if (tmpl_cast_in_place(vpt, cast_type, da) < 0) {
+			cf_log_perr(cs, "Invalid argument for 'case' statement");
+			talloc_free(vpt);
 			return NULL;
 		}
+	}
 
-		switch_g = unlang_generic_to_group(parent);
-		switch_gext = unlang_group_to_switch(switch_g);
-		fr_assert(switch_gext->vpt != NULL);
+	if (!tmpl_is_data(vpt)) {
+		talloc_free(vpt);
+		cf_log_err(cs, "arguments to 'case' statements MUST be static data.");
+		return NULL;
+	}
 
-		/*
-		 *      This "case" statement is unresolved.  Try to
-		 *      resolve it to the data type of the parent
-		 *      "switch" tmpl.
-		 */
-		if (tmpl_is_unresolved(vpt)) {
-			fr_type_t cast_type = tmpl_rules_cast(switch_gext->vpt);
-			fr_dict_attr_t const *da = NULL;
+	return vpt;
+}
 
- 			if (tmpl_is_attr(switch_gext->vpt)) da = tmpl_attr_tail_da(switch_gext->vpt);
+static unlang_t *compile_case(unlang_t *parent, unlang_compile_t *unlang_ctx, CONF_SECTION *cs)
+{
+	int			i;
+	unlang_t		*c;
+	unlang_group_t		*case_g;
+	unlang_case_t		*case_gext;
+	tmpl_t			*vpt = NULL;
 
-			if (fr_type_is_null(cast_type) && da) cast_type = da->type;
+	static unlang_ext_t const case_ext = {
+		.type = UNLANG_TYPE_CASE,
+		.len = sizeof(unlang_case_t),
+		.type_name = "unlang_case_t",
+	};
 
-			if (tmpl_cast_in_place(vpt, cast_type, da) < 0) {
-				cf_log_perr(cs, "Invalid argument for 'case' statement");
-				talloc_free(vpt);
-				return NULL;
-			}
-		}
+	if (!parent || (parent->type != UNLANG_TYPE_SWITCH)) {
+		cf_log_err(cs, "\"case\" statements may only appear within a \"switch\" section");
+		return NULL;
+	}
 
-		if (!tmpl_is_data(vpt)) {
-			talloc_free(vpt);
-			cf_log_err(cs, "arguments to 'case' statements MUST be static data.");
-			return NULL;
-		}
+	/*
+	 *	case THING means "match THING"
+	 *	case       means "match anything"
+	 */
+	if (cf_section_name2(cs)) {
+		vpt = compile_case_value(unlang_group_to_switch(unlang_generic_to_group(parent)), unlang_ctx, cs);
+		if (!vpt) return NULL;
 	} /* else it's a default 'case' statement */
 
 	/*
@@ -4802,6 +4999,26 @@ static unlang_t *compile_module(unlang_t *parent, unlang_compile_t *unlang_ctx,
 		    return NULL;
 	}
 
+	/*
+	 *	Record latency per module instance and method.  Calls
+	 *	to an explicit method, e.g. "sql.accounting", are named
+	 *	for that method, otherwise we use the section name.
+	 */
+	{
+		char *latency_name;
+
+		if (strchr(realname, '.') || !unlang_ctx->section_name1) {
+			latency_name = talloc_asprintf(NULL, "module.%s", realname);
+		} else if (unlang_ctx->section_name2) {
+			latency_name = talloc_asprintf(NULL, "module.%s.%s.%s", inst->name,
+						       unlang_ctx->section_name1, unlang_ctx->section_name2);
+		} else {
+			latency_name = talloc_asprintf(NULL, "module.%s.%s", inst->name, unlang_ctx->section_name1);
+		}
+		c->latency_id = unlang_latency_register(latency_name);
+		talloc_free(latency_name);
+	}
+
 	return c;
 }
 
@@ -5095,6 +5312,8 @@ int unlang_compile(CONF_SECTION *cs, rlm_components_t component, tmpl_rules_t co
 		rules = &my_rules;
 	}
 
+	memset(&unlang_compile_stats, 0, sizeof(unlang_compile_stats));
+
 	c = compile_section(NULL,
 			    &(unlang_compile_t){
 				.component = component,
@@ -5106,6 +5325,34 @@ int unlang_compile(CONF_SECTION *cs, rlm_components_t component, tmpl_rules_t co
 			    cs, &group_ext);
 	if (!c) return -1;
 
+	/*
+	 *	Record latency for each processing section of a
+	 *	virtual server.
+	 */
+	{
+		CONF_SECTION *server_cs = cf_item_to_section(cf_parent(cs));
+
+		if (server_cs && cf_section_name2(server_cs) && (strcmp(cf_section_name1(server_cs), "server") == 0)) {
+			char *latency_name;
+
+			if (*name2) {
+				latency_name = talloc_asprintf(NULL, "server.%s.%s.%s",
+							       cf_section_name2(server_cs), name1, name2);
+			} else {
+				latency_name = talloc_asprintf(NULL, "server.%s.%s", cf_section_name2(server_cs), name1);
+			}
+			c->latency_id = unlang_latency_register(latency_name);
+			talloc_free(latency_name);
+		}
+	}
+
+	if (unlang_compile_stats.switches_folded || unlang_compile_stats.values_cast) {
+		cf_log_debug(cs, "Optimised %s %s {...} - folded %u constant switch(es), removed %u "
+			     "unreachable case(s), pre-cast %u literal value(s)", name1, name2,
+			     unlang_compile_stats.switches_folded, unlang_compile_stats.cases_removed,
+			     unlang_compile_stats.values_cast);
+	}
+
 	if (DEBUG_ENABLED4) unlang_dump(c, 2);
 
 	/*
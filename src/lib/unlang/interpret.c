@@ -455,6 +455,9 @@ unlang_frame_action_t frame_eval(request_t *request, unlang_stack_frame_t *frame
 		if (is_yielded(frame)) {
 			RDEBUG("%s - Resuming execution", instruction->debug_name);
 			yielded_clear(frame);
+
+			if (stack->intp->trace) unlang_trace_instruction(stack->intp->trace, request, instruction,
+									 UNLANG_TRACE_RESUME, frame->result, stack->depth);
 		}
 
 #ifndef NDEBUG
@@ -580,6 +583,10 @@ unlang_frame_action_t frame_eval(request_t *request, unlang_stack_frame_t *frame
 		case UNLANG_ACTION_YIELD:
 			unlang_frame_perf_yield(frame);
 			yielded_set(frame);
+
+			if (stack->intp->trace) unlang_trace_instruction(stack->intp->trace, request, instruction,
+									 UNLANG_TRACE_YIELD, frame->result, stack->depth);
+
 			RDEBUG4("** [%i] %s - yielding with current (%s %d)", stack->depth, __FUNCTION__,
 				fr_table_str_by_value(mod_rcode_table, frame->result, "<invalid>"),
 				frame->priority);
@@ -616,6 +623,9 @@ unlang_frame_action_t frame_eval(request_t *request, unlang_stack_frame_t *frame
 				}
 			}
 
+			if (stack->intp->trace) unlang_trace_instruction(stack->intp->trace, request, instruction,
+									 UNLANG_TRACE_INSTRUCTION, *result, stack->depth);
+
 			/*
 			 *	RLM_MODULE_NOT_SET means the instruction
 			 *	doesn't want to modify the result.
@@ -1486,6 +1496,16 @@ unlang_interpret_t *unlang_interpret_get_thread_default(void)
 	return talloc_get_type_abort(intp_thread_default, unlang_interpret_t);
 }
 
+/** Record execution of requests run by this interpreter
+ *
+ * @param[in] intp	to record execution for.
+ * @param[in] trace	ring to write records to.  NULL disables tracing.
+ */
+void unlang_interpret_set_trace(unlang_interpret_t *intp, unlang_trace_t *trace)
+{
+	intp->trace = trace;
+}
+
 void unlang_interpret_init_global(void)
 {
 	xlat_t	*xlat;
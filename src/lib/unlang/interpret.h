@@ -31,6 +31,7 @@ extern "C" {
 #include <freeradius-devel/server/cf_util.h>
 #include <freeradius-devel/server/request.h>
 #include <freeradius-devel/unlang/action.h>
+#include <freeradius-devel/unlang/trace.h>
 
 #define UNLANG_TOP_FRAME (true)
 #define UNLANG_SUB_FRAME (false)
@@ -142,6 +143,8 @@ void			unlang_interpret_set_thread_default(unlang_interpret_t *intp);
 
 unlang_interpret_t	*unlang_interpret_get_thread_default(void);
 
+void			unlang_interpret_set_trace(unlang_interpret_t *intp, unlang_trace_t *trace);
+
 rlm_rcode_t		unlang_interpret(request_t *request) CC_HINT(hot);
 
 rlm_rcode_t		unlang_interpret_synchronous(fr_event_list_t *el, request_t *request);
@@ -36,6 +36,7 @@ struct unlang_interpret_s {
 	fr_event_list_t		*el;
 	unlang_request_func_t	funcs;
 	void			*uctx;
+	unlang_trace_t		*trace;		//!< Optional ring to record execution in.
 };
 
 static inline void interpret_child_init(request_t *request)
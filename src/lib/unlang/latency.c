@@ -0,0 +1,478 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file unlang/latency.c
+ * @brief Latency histograms for module calls and virtual server sections.
+ *
+ * Each module method, and each virtual server section is assigned an
+ * identifier when it's compiled.  When the interpreter finishes running
+ * one of them, the elapsed time (including any time spent yielded) is
+ * recorded in a histogram belonging to the current thread.
+ *
+ * The hot path takes no locks.  When the statistics are read, the
+ * histograms from all threads are merged.  Histograms from threads
+ * which have exited are merged into a global set, so nothing is lost.
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/server/base.h>
+#include <freeradius-devel/server/metrics.h>
+#include <freeradius-devel/unlang/xlat.h>
+#include <freeradius-devel/util/atexit.h>
+
+#include "latency.h"
+
+#include <pthread.h>
+
+typedef struct {
+	fr_rb_node_t		node;			//!< Entry in the tree of names.
+	uint32_t		id;			//!< Index into the per-thread histograms.
+	char const		*name;			//!< e.g. "module.sql.recv.Access-Request".
+} unlang_latency_point_t;
+
+typedef struct {
+	fr_dlist_t		entry;			//!< Entry in the list of threads.
+	uint32_t		num;			//!< Number of entries in hist.
+	fr_histogram_t		**hist;			//!< Indexed by id, allocated on first use.
+} unlang_latency_thread_t;
+
+static pthread_mutex_t		latency_mutex = PTHREAD_MUTEX_INITIALIZER;
+static TALLOC_CTX		*latency_ctx;
+static fr_rb_tree_t		*latency_points;	//!< Indexed by name.
+static unlang_latency_point_t	**latency_by_id;	//!< Indexed by id.
+static uint32_t			latency_num;		//!< Highest id allocated.
+static fr_dlist_head_t		latency_threads;	//!< All threads which have recorded something.
+static fr_histogram_t		**latency_retired;	//!< Histograms of threads which have exited.
+
+static _Thread_local unlang_latency_thread_t *latency_thread;
+
+static int8_t latency_point_cmp(void const *one, void const *two)
+{
+	unlang_latency_point_t const *a = one, *b = two;
+	int ret;
+
+	ret = strcmp(a->name, b->name);
+	return CMP(ret, 0);
+}
+
+/** Register a point which latency is recorded for
+ *
+ * Registering the same name more than once returns the same identifier.
+ *
+ * @param[in] name	of the point, e.g. "module.sql.recv.Access-Request".
+ * @return
+ *	- The identifier to pass to #unlang_latency_record.
+ *	- 0 on error.
+ */
+uint32_t unlang_latency_register(char const *name)
+{
+	unlang_latency_point_t	*point;
+	uint32_t		id;
+
+	if (!latency_points) return 0;
+
+	pthread_mutex_lock(&latency_mutex);
+	point = fr_rb_find(latency_points, &(unlang_latency_point_t){ .name = name });
+	if (point) {
+		id = point->id;
+		goto done;
+	}
+
+	MEM(point = talloc_zero(latency_ctx, unlang_latency_point_t));
+	point->name = talloc_typed_strdup(point, name);
+	point->id = id = latency_num + 1;
+
+	MEM(latency_by_id = talloc_realloc(latency_ctx, latency_by_id, unlang_latency_point_t *, id + 1));
+	latency_by_id[id] = point;
+	latency_num = id;
+
+	(void) fr_rb_insert(latency_points, point);
+
+done:
+	pthread_mutex_unlock(&latency_mutex);
+
+	return id;
+}
+
+/** Merge a thread's histograms into the retired set, and forget about the thread
+ *
+ */
+static int _latency_thread_free(void *uctx)
+{
+	unlang_latency_thread_t	*t = talloc_get_type_abort(uctx, unlang_latency_thread_t);
+	size_t			i, num;
+
+	pthread_mutex_lock(&latency_mutex);
+	if (fr_dlist_entry_in_list(&t->entry)) {
+		fr_dlist_remove(&latency_threads, t);
+
+		num = talloc_array_length(latency_retired);
+		if (num <= latency_num) {
+			MEM(latency_retired = talloc_realloc(latency_ctx, latency_retired, fr_histogram_t *,
+							     latency_num + 1));
+			memset(latency_retired + num, 0, sizeof(latency_retired[0]) * (latency_num + 1 - num));
+		}
+
+		for (i = 1; i < t->num; i++) {
+			if (!t->hist[i]) continue;
+
+			if (!latency_retired[i]) MEM(latency_retired[i] = talloc_zero(latency_ctx, fr_histogram_t));
+			fr_histogram_merge(latency_retired[i], t->hist[i]);
+		}
+	}
+	pthread_mutex_unlock(&latency_mutex);
+
+	talloc_free(t);
+
+	return 0;
+}
+
+static unlang_latency_thread_t *latency_thread_alloc(void)
+{
+	unlang_latency_thread_t *t;
+
+	if (fr_atexit_is_exiting()) return NULL;
+
+	MEM(t = talloc_zero(NULL, unlang_latency_thread_t));
+	fr_dlist_entry_init(&t->entry);
+
+	pthread_mutex_lock(&latency_mutex);
+	if (!latency_ctx) {
+		pthread_mutex_unlock(&latency_mutex);
+		talloc_free(t);
+		return NULL;
+	}
+
+	t->num = latency_num + 1;
+	MEM(t->hist = talloc_zero_array(t, fr_histogram_t *, t->num));
+	fr_dlist_insert_tail(&latency_threads, t);
+	pthread_mutex_unlock(&latency_mutex);
+
+	fr_atexit_thread_local(latency_thread, _latency_thread_free, t);
+
+	return t;
+}
+
+/** Grow a thread's array of histograms to cover points registered since it was allocated
+ *
+ * Points may be registered at any time, e.g. when a virtual server is
+ * compiled after the workers have started.
+ *
+ * @return
+ *	- 0 on success.
+ *	- -1 if the id isn't registered.
+ */
+static int latency_thread_grow(unlang_latency_thread_t *t, uint32_t id)
+{
+	uint32_t num;
+
+	pthread_mutex_lock(&latency_mutex);
+	if (id > latency_num) {
+		pthread_mutex_unlock(&latency_mutex);
+		return -1;
+	}
+
+	num = latency_num + 1;
+	MEM(t->hist = talloc_realloc(t, t->hist, fr_histogram_t *, num));
+	memset(t->hist + t->num, 0, sizeof(t->hist[0]) * (num - t->num));
+	t->num = num;
+	pthread_mutex_unlock(&latency_mutex);
+
+	return 0;
+}
+
+/** Record how long it took to run a module method or section
+ *
+ * @param[in] id	returned by #unlang_latency_register.
+ * @param[in] elapsed	time spent, including time spent yielded.
+ */
+void unlang_latency_record(uint32_t id, fr_time_delta_t elapsed)
+{
+	unlang_latency_thread_t	*t = latency_thread;
+	fr_histogram_t		*hist;
+
+	if (unlikely(!t)) {
+		t = latency_thread_alloc();
+		if (!t) return;
+	}
+
+	/*
+	 *	Registered after this thread started recording.
+	 */
+	if (unlikely(id >= t->num) && (latency_thread_grow(t, id) < 0)) return;
+
+	hist = t->hist[id];
+	if (unlikely(!hist)) {
+		MEM(hist = talloc_zero(t, fr_histogram_t));
+
+		pthread_mutex_lock(&latency_mutex);
+		t->hist[id] = hist;
+		pthread_mutex_unlock(&latency_mutex);
+	}
+
+	fr_histogram_record(hist, fr_time_delta_ispos(elapsed) ? (uint64_t) fr_time_delta_unwrap(elapsed) : 0);
+}
+
+/** Merge the histograms for a point from all threads
+ *
+ * Must be called with the mutex held.
+ */
+static void latency_merge(fr_histogram_t *out, uint32_t id)
+{
+	unlang_latency_thread_t *t;
+
+	memset(out, 0, sizeof(*out));
+
+	if ((id < talloc_array_length(latency_retired)) && latency_retired[id]) {
+		fr_histogram_merge(out, latency_retired[id]);
+	}
+
+	for (t = fr_dlist_head(&latency_threads);
+	     t != NULL;
+	     t = fr_dlist_next(&latency_threads, t)) {
+		if ((id >= t->num) || !t->hist[id]) continue;
+
+		fr_histogram_merge(out, t->hist[id]);
+	}
+}
+
+/** Get the merged histogram for a point
+ *
+ * @param[out] out	where to write the histogram.
+ * @param[in] name	of the point.
+ * @return
+ *	- 0 on success.
+ *	- -1 if no point with that name exists.
+ */
+int unlang_latency_get(fr_histogram_t *out, char const *name)
+{
+	unlang_latency_point_t *point;
+
+	if (!latency_points) return -1;
+
+	pthread_mutex_lock(&latency_mutex);
+	point = fr_rb_find(latency_points, &(unlang_latency_point_t){ .name = name });
+	if (!point) {
+		pthread_mutex_unlock(&latency_mutex);
+		return -1;
+	}
+	latency_merge(out, point->id);
+	pthread_mutex_unlock(&latency_mutex);
+
+	return 0;
+}
+
+#define LATENCY_SEC(_x) ((_x) / (double)NSEC)
+
+typedef void (*latency_walk_t)(FILE *fp, char const *name, fr_histogram_t const *hist);
+
+/** Call a function for each point which has recorded something
+ *
+ * The histograms are merged one at a time, so that we don't hold the
+ * mutex while printing.
+ */
+static void latency_walk(FILE *fp, char const *prefix, latency_walk_t func)
+{
+	fr_histogram_t	*hist;
+	size_t		prefix_len = prefix ? strlen(prefix) : 0;
+	uint32_t	i, num;
+
+	if (!latency_points) return;
+
+	MEM(hist = talloc(NULL, fr_histogram_t));
+
+	pthread_mutex_lock(&latency_mutex);
+	num = latency_num;
+	pthread_mutex_unlock(&latency_mutex);
+
+	for (i = 1; i <= num; i++) {
+		char const *name;
+
+		pthread_mutex_lock(&latency_mutex);
+		name = latency_by_id[i]->name;
+		if (prefix && (strncmp(name, prefix, prefix_len) != 0)) {
+			pthread_mutex_unlock(&latency_mutex);
+			continue;
+		}
+		latency_merge(hist, i);
+		pthread_mutex_unlock(&latency_mutex);
+
+		if (!hist->count) continue;
+
+		func(fp, name, hist);
+	}
+
+	talloc_free(hist);
+}
+
+static void latency_dump(FILE *fp, char const *name, fr_histogram_t const *hist)
+{
+	fprintf(fp, "%s\tcount %" PRIu64 "\tmean %.6f\tp50 %.6f\tp90 %.6f\tp99 %.6f\tp99.9 %.6f\tmax %.6f\n",
+		name, hist->count,
+		LATENCY_SEC(fr_histogram_mean(hist)),
+		LATENCY_SEC(fr_histogram_percentile(hist, 50)),
+		LATENCY_SEC(fr_histogram_percentile(hist, 90)),
+		LATENCY_SEC(fr_histogram_percentile(hist, 99)),
+		LATENCY_SEC(fr_histogram_percentile(hist, 99.9)),
+		LATENCY_SEC(hist->max));
+}
+
+/** Print percentiles for all points which have recorded something
+ *
+ * @param[in] fp	to print to.
+ * @param[in] prefix	only print points whose names start with this.  May be NULL.
+ */
+void unlang_latency_dump(FILE *fp, char const *prefix)
+{
+	latency_walk(fp, prefix, latency_dump);
+}
+
+static void latency_metrics_summary(FILE *fp, char const *name, fr_histogram_t const *hist)
+{
+	fr_metrics_summary(fp, "freeradius_latency_seconds", "point", name, hist);
+}
+
+static void latency_metrics_print(FILE *fp, UNUSED void *uctx)
+{
+	fr_metrics_family(fp, "freeradius_latency_seconds", FR_METRICS_TYPE_SUMMARY,
+			  "Time taken by module calls and virtual server sections.");
+	latency_walk(fp, NULL, latency_metrics_summary);
+}
+
+static fr_metrics_t latency_metrics = {
+	.name = "latency",
+	.func = latency_metrics_print
+};
+
+static int cmd_show_latency(FILE *fp, UNUSED FILE *fp_err, UNUSED void *ctx, fr_cmd_info_t const *info)
+{
+	unlang_latency_dump(fp, (info->argc > 0) ? info->argv[0] : NULL);
+
+	return 0;
+}
+
+fr_cmd_table_t unlang_latency_cmd_table[] = {
+	{
+		.parent = "show",
+		.name = "latency",
+		.syntax = "[STRING]",
+		.func = cmd_show_latency,
+		.help = "Show latency of module calls and virtual server sections.  "
+			"If STRING is given, only names starting with STRING are shown.",
+		.read_only = true
+	},
+
+	CMD_TABLE_END
+};
+
+static xlat_arg_parser_t const unlang_latency_xlat_args[] = {
+	{ .required = true, .single = true, .type = FR_TYPE_STRING },
+	{ .single = true, .type = FR_TYPE_FLOAT64 },
+	XLAT_ARG_PARSER_TERMINATOR
+};
+
+/** Return a latency percentile for a module method or virtual server section
+ *
+ * The percentile defaults to 50.
+ *
+ * Example:
+@verbatim
+%(latency:module.sql.recv.Access-Request 99)
+@endverbatim
+ *
+ * @ingroup xlat_functions
+ */
+static xlat_action_t unlang_latency_xlat(TALLOC_CTX *ctx, fr_dcursor_t *out,
+					 UNUSED xlat_ctx_t const *xctx,
+					 request_t *request, FR_DLIST_HEAD(fr_value_box_list) *in)
+{
+	fr_value_box_t	*name = fr_value_box_list_head(in);
+	fr_value_box_t	*pct = fr_value_box_list_next(in, name);
+	fr_value_box_t	*vb;
+	fr_histogram_t	*hist;
+	double		percentile = pct ? pct->vb_float64 : 50;
+
+	if ((percentile < 0) || (percentile > 100)) {
+		REDEBUG("Percentile must be between 0 and 100");
+		return XLAT_ACTION_FAIL;
+	}
+
+	MEM(hist = talloc(NULL, fr_histogram_t));
+	if (unlang_latency_get(hist, name->vb_strvalue) < 0) {
+		REDEBUG("No latency statistics for \"%pV\"", name);
+		talloc_free(hist);
+		return XLAT_ACTION_FAIL;
+	}
+
+	MEM(vb = fr_value_box_alloc(ctx, FR_TYPE_TIME_DELTA, NULL, false));
+	vb->vb_time_delta = fr_time_delta_wrap(fr_histogram_percentile(hist, percentile));
+	talloc_free(hist);
+
+	fr_dcursor_append(out, vb);
+
+	return XLAT_ACTION_DONE;
+}
+
+int unlang_latency_init_global(void)
+{
+	xlat_t *xlat;
+
+	pthread_mutex_lock(&latency_mutex);
+	MEM(latency_ctx = talloc_named_const(NULL, 0, "unlang_latency"));
+	latency_points = fr_rb_inline_talloc_alloc(latency_ctx, unlang_latency_point_t, node, latency_point_cmp, NULL);
+	if (!latency_points) {
+		TALLOC_FREE(latency_ctx);
+		pthread_mutex_unlock(&latency_mutex);
+		return -1;
+	}
+	fr_dlist_talloc_init(&latency_threads, unlang_latency_thread_t, entry);
+	pthread_mutex_unlock(&latency_mutex);
+
+	xlat = xlat_register(NULL, "latency", unlang_latency_xlat, FR_TYPE_TIME_DELTA, NULL);
+	if (!xlat) return -1;
+	xlat_func_args(xlat, unlang_latency_xlat_args);
+
+	fr_metrics_register(&latency_metrics);
+
+	return 0;
+}
+
+void unlang_latency_free_global(void)
+{
+	unlang_latency_thread_t *t;
+
+	fr_metrics_unregister(&latency_metrics);
+
+	pthread_mutex_lock(&latency_mutex);
+
+	/*
+	 *	Any threads which are still running own their
+	 *	histograms, and will free them when they exit.
+	 */
+	while ((t = fr_dlist_pop_head(&latency_threads))) fr_dlist_entry_init(&t->entry);
+
+	TALLOC_FREE(latency_ctx);
+	latency_points = NULL;
+	latency_by_id = NULL;
+	latency_retired = NULL;
+	latency_num = 0;
+	pthread_mutex_unlock(&latency_mutex);
+}
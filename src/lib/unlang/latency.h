@@ -0,0 +1,52 @@
+#pragma once
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * $Id$
+ *
+ * @file unlang/latency.h
+ * @brief Latency histograms for module calls and virtual server sections.
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <freeradius-devel/server/command.h>
+#include <freeradius-devel/util/histogram.h>
+#include <freeradius-devel/util/time.h>
+
+#include <stdio.h>
+
+extern fr_cmd_table_t unlang_latency_cmd_table[];
+
+uint32_t	unlang_latency_register(char const *name) CC_HINT(nonnull);
+
+void		unlang_latency_record(uint32_t id, fr_time_delta_t elapsed);
+
+int		unlang_latency_get(fr_histogram_t *out, char const *name) CC_HINT(nonnull);
+
+void		unlang_latency_dump(FILE *fp, char const *prefix) CC_HINT(nonnull(1));
+
+int		unlang_latency_init_global(void);
+
+void		unlang_latency_free_global(void);
+
+#ifdef __cplusplus
+}
+#endif
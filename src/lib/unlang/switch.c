@@ -62,6 +62,15 @@ static unlang_action_t unlang_switch(rlm_rcode_t *p_result, request_t *request,
 
 	found = NULL;
 
+	/*
+	 *	Switch over constant data.  The matching 'case' was
+	 *	found when the switch was compiled.
+	 */
+	if (tmpl_is_data(switch_gext->vpt)) {
+		found = switch_gext->default_case;
+		goto do_null_case;
+	}
+
 	/*
 	 *	The attribute doesn't exist.  We can skip
 	 *	directly to the default 'case' statement.
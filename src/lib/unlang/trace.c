@@ -0,0 +1,382 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file unlang/trace.c
+ * @brief Binary trace of request execution.
+ *
+ * Each worker writes fixed size records into a ring as its requests
+ * start, execute instructions, yield, resume and finish.  Nothing is
+ * formatted when a record is written, so tracing can be left enabled
+ * in production.  When something goes wrong, the last few seconds of
+ * the ring can be dumped and decoded via radmin.
+ *
+ * Records are written by the worker thread only, and may be read
+ * concurrently by the main thread.  Each record carries a sequence
+ * number which is cleared while the record is being written, and set
+ * once it's complete.  Readers discard records whose sequence number
+ * changed while they were copying them.
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/server/base.h>
+#include <freeradius-devel/util/math.h>
+
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+#else
+#  include <freeradius-devel/util/stdatomic.h>
+#endif
+
+#include "trace.h"
+#include "unlang_priv.h"
+
+typedef struct {
+	atomic_uint_fast64_t	seq;			//!< Sequence number of the record.  0 while it's being written.
+	fr_time_t		when;			//!< When the event occurred.
+	uint64_t		number;			//!< Request number.
+	union {
+		char const	*debug_name;		//!< Of the instruction which was executed.
+		struct {
+			fr_ipaddr_t	client;		//!< Client which sent the request.
+			uint32_t	code;		//!< Packet code of the request.
+		};
+	};
+	uint8_t			type;			//!< #unlang_type_t of the instruction.
+	uint8_t			event;			//!< #unlang_trace_event_t.
+	uint8_t			rcode;			//!< Result of the instruction, or the request.
+	uint16_t		depth;			//!< Stack depth of the instruction.
+} unlang_trace_record_t;
+
+/** A snapshot of a record, without the sequence number
+ *
+ */
+typedef struct {
+	uint64_t		seq;
+	fr_time_t		when;
+	uint64_t		number;
+	union {
+		char const	*debug_name;
+		struct {
+			fr_ipaddr_t	client;
+			uint32_t	code;
+		};
+	};
+	uint8_t			type;
+	uint8_t			event;
+	uint8_t			rcode;
+	uint16_t		depth;
+} unlang_trace_copy_t;
+
+struct unlang_trace_s {
+	unlang_trace_record_t	*records;		//!< The ring.
+	uint64_t		mask;			//!< Number of records - 1.
+	atomic_uint_fast64_t	head;			//!< Sequence number of the next record.
+};
+
+static fr_table_num_sorted_t const unlang_trace_event_table[] = {
+	{ L("done"),		UNLANG_TRACE_REQUEST_DONE	},
+	{ L("instruction"),	UNLANG_TRACE_INSTRUCTION	},
+	{ L("resume"),		UNLANG_TRACE_RESUME		},
+	{ L("start"),		UNLANG_TRACE_REQUEST_START	},
+	{ L("yield"),		UNLANG_TRACE_YIELD		}
+};
+static size_t unlang_trace_event_table_len = NUM_ELEMENTS(unlang_trace_event_table);
+
+/** Allocate a trace ring
+ *
+ * @param[in] ctx		to allocate the ring in.
+ * @param[in] num_records	to keep.  Rounded up to a power of 2.
+ * @return
+ *	- A new trace ring.
+ *	- NULL on error.
+ */
+unlang_trace_t *unlang_trace_alloc(TALLOC_CTX *ctx, uint32_t num_records)
+{
+	unlang_trace_t	*trace;
+	uint64_t	i, num;
+
+	if (!num_records) {
+		fr_strerror_const("Number of trace records must be greater than zero");
+		return NULL;
+	}
+	num = (uint64_t)1 << fr_high_bit_pos(num_records - 1);
+
+	MEM(trace = talloc_zero(ctx, unlang_trace_t));
+	trace->records = talloc_array(trace, unlang_trace_record_t, num);
+	if (!trace->records) {
+		fr_strerror_printf("Failed allocating %" PRIu64 " trace records", num);
+		talloc_free(trace);
+		return NULL;
+	}
+	trace->mask = num - 1;
+
+	for (i = 0; i < num; i++) {
+		trace->records[i] = (unlang_trace_record_t){};
+		atomic_init(&trace->records[i].seq, 0);
+	}
+	atomic_init(&trace->head, 1);
+
+	return trace;
+}
+
+/** Claim the next record in the ring, and mark it as being written
+ *
+ */
+static inline CC_HINT(always_inline) unlang_trace_record_t *trace_record_start(unlang_trace_t *trace, uint64_t *seq)
+{
+	unlang_trace_record_t *rec;
+
+	*seq = atomic_load_explicit(&trace->head, memory_order_relaxed);
+	atomic_store_explicit(&trace->head, *seq + 1, memory_order_relaxed);
+
+	rec = &trace->records[*seq & trace->mask];
+	atomic_store_explicit(&rec->seq, 0, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	return rec;
+}
+
+static inline CC_HINT(always_inline) void trace_record_end(unlang_trace_record_t *rec, uint64_t seq)
+{
+	atomic_store_explicit(&rec->seq, seq, memory_order_release);
+}
+
+/** Record that a request is about to run
+ *
+ * @param[in] trace	to write to.
+ * @param[in] request	which was decoded.
+ */
+void unlang_trace_request_start(unlang_trace_t *trace, request_t *request)
+{
+	unlang_trace_record_t	*rec;
+	uint64_t		seq;
+
+	rec = trace_record_start(trace, &seq);
+	rec->when = fr_time();
+	rec->number = request->number;
+	if (request->client) {
+		rec->client = request->client->ipaddr;
+	} else {
+		rec->client = (fr_ipaddr_t){ .af = AF_UNSPEC };
+	}
+	rec->code = request->packet ? request->packet->code : 0;
+	rec->type = UNLANG_TYPE_NULL;
+	rec->event = UNLANG_TRACE_REQUEST_START;
+	rec->rcode = RLM_MODULE_NOT_SET;
+	rec->depth = 0;
+	trace_record_end(rec, seq);
+}
+
+/** Record that a request has finished running
+ *
+ * @param[in] trace	to write to.
+ * @param[in] request	which finished.
+ * @param[in] rcode	the request finished with.
+ */
+void unlang_trace_request_done(unlang_trace_t *trace, request_t *request, rlm_rcode_t rcode)
+{
+	unlang_trace_record_t	*rec;
+	uint64_t		seq;
+
+	rec = trace_record_start(trace, &seq);
+	rec->when = fr_time();
+	rec->number = request->number;
+	rec->debug_name = NULL;
+	rec->type = UNLANG_TYPE_NULL;
+	rec->event = UNLANG_TRACE_REQUEST_DONE;
+	rec->rcode = rcode;
+	rec->depth = 0;
+	trace_record_end(rec, seq);
+}
+
+/** Record an instruction completing, yielding, or resuming
+ *
+ * @param[in] trace		to write to.
+ * @param[in] request		running the instruction.
+ * @param[in] instruction	the #unlang_t being executed.
+ * @param[in] event		what happened.
+ * @param[in] rcode		result of the instruction.
+ * @param[in] depth		of the instruction's frame on the stack.
+ */
+void unlang_trace_instruction(unlang_trace_t *trace, request_t *request, unlang_t const *instruction,
+			      unlang_trace_event_t event, rlm_rcode_t rcode, int depth)
+{
+	unlang_trace_record_t	*rec;
+	uint64_t		seq;
+
+	rec = trace_record_start(trace, &seq);
+	rec->when = fr_time();
+	rec->number = request->number;
+
+	/*
+	 *	Instructions created at run time are freed with the
+	 *	request, but their names point to the configuration,
+	 *	or to module names, so we record the name instead.
+	 */
+	rec->debug_name = instruction->debug_name;
+	rec->type = instruction->type;
+	rec->event = event;
+	rec->rcode = rcode;
+	rec->depth = depth;
+	trace_record_end(rec, seq);
+}
+
+/** Copy all complete records out of the ring, oldest first
+ *
+ */
+static size_t trace_snapshot(unlang_trace_copy_t *out, unlang_trace_t const *trace)
+{
+	unlang_trace_t		*t = UNCONST(unlang_trace_t *, trace);
+	uint64_t		head, start, seq, s1, s2;
+	size_t			num = 0;
+
+	head = atomic_load_explicit(&t->head, memory_order_acquire);
+	start = (head > (trace->mask + 1)) ? head - (trace->mask + 1) : 1;
+
+	for (seq = start; seq < head; seq++) {
+		unlang_trace_record_t	*rec = &t->records[seq & trace->mask];
+		unlang_trace_copy_t	*copy = &out[num];
+
+		s1 = atomic_load_explicit(&rec->seq, memory_order_acquire);
+		if (s1 != seq) continue;	/* Being written, or overwritten */
+
+		copy->when = rec->when;
+		copy->number = rec->number;
+		copy->type = rec->type;
+		copy->event = rec->event;
+		copy->rcode = rec->rcode;
+		copy->depth = rec->depth;
+		if (copy->event == UNLANG_TRACE_REQUEST_START) {
+			copy->client = rec->client;
+			copy->code = rec->code;
+		} else {
+			copy->debug_name = rec->debug_name;
+		}
+
+		atomic_thread_fence(memory_order_acquire);
+		s2 = atomic_load_explicit(&rec->seq, memory_order_relaxed);
+		if (s1 != s2) continue;
+
+		copy->seq = seq;
+		num++;
+	}
+
+	return num;
+}
+
+static int trace_number_cmp(void const *one, void const *two)
+{
+	uint64_t const *a = one, *b = two;
+
+	return CMP(*a, *b);
+}
+
+/** Print decoded trace records
+ *
+ * @param[in] fp	to print to.
+ * @param[in] trace	to print.
+ * @param[in] window	only print records from the last window.
+ *			If zero, print all records.
+ * @param[in] number	only print records for this request number.
+ *			If zero, print records for all requests.
+ * @param[in] client	only print records for requests from this client.
+ *			May be NULL.
+ * @return the number of records printed.
+ */
+int unlang_trace_dump(FILE *fp, unlang_trace_t const *trace, fr_time_delta_t window,
+		      uint64_t number, fr_ipaddr_t const *client)
+{
+	unlang_trace_copy_t	*copies;
+	uint64_t		*numbers = NULL;
+	size_t			num_copies, num_numbers = 0, i;
+	fr_time_t		now = fr_time(), cutoff = fr_time_wrap(0);
+	int			printed = 0;
+
+	MEM(copies = talloc_array(NULL, unlang_trace_copy_t, trace->mask + 1));
+	num_copies = trace_snapshot(copies, trace);
+
+	if (fr_time_delta_ispos(window)) cutoff = fr_time_sub(now, window);
+
+	/*
+	 *	Find all the requests from this client.  Records
+	 *	other than the start record only have the request
+	 *	number.
+	 */
+	if (client) {
+		MEM(numbers = talloc_array(copies, uint64_t, num_copies + 1));
+
+		for (i = 0; i < num_copies; i++) {
+			if (copies[i].event != UNLANG_TRACE_REQUEST_START) continue;
+			if (fr_ipaddr_cmp(&copies[i].client, client) != 0) continue;
+
+			numbers[num_numbers++] = copies[i].number;
+		}
+
+		qsort(numbers, num_numbers, sizeof(numbers[0]), trace_number_cmp);
+	}
+
+	for (i = 0; i < num_copies; i++) {
+		unlang_trace_copy_t const	*copy = &copies[i];
+		fr_time_delta_t			age = fr_time_sub(now, copy->when);
+
+		if (fr_time_lt(copy->when, cutoff)) continue;
+		if (number && (copy->number != number)) continue;
+		if (numbers && !bsearch(&copy->number, numbers, num_numbers, sizeof(numbers[0]),
+					trace_number_cmp)) continue;
+
+		fprintf(fp, "-%" PRId64 ".%06" PRId64 "s request %" PRIu64 " %s",
+			fr_time_delta_unwrap(age) / NSEC, (fr_time_delta_unwrap(age) % NSEC) / 1000,
+			copy->number,
+			fr_table_str_by_value(unlang_trace_event_table, copy->event, "<INVALID>"));
+
+		switch (copy->event) {
+		case UNLANG_TRACE_REQUEST_START:
+		{
+			char buffer[FR_IPADDR_STRLEN];
+
+			fprintf(fp, " client %s code %u\n",
+				(copy->client.af == AF_UNSPEC) ? "none" :
+				fr_inet_ntop(buffer, sizeof(buffer), &copy->client), copy->code);
+		}
+			break;
+
+		case UNLANG_TRACE_REQUEST_DONE:
+			fprintf(fp, " (%s)\n", fr_table_str_by_value(rcode_table, copy->rcode, "<invalid>"));
+			break;
+
+		default:
+		{
+			fprintf(fp, " [%u] %s %s", copy->depth, unlang_ops[copy->type].name, copy->debug_name);
+			if (copy->event == UNLANG_TRACE_INSTRUCTION) {
+				fprintf(fp, " (%s)", fr_table_str_by_value(rcode_table, copy->rcode, "<invalid>"));
+			}
+			fprintf(fp, "\n");
+		}
+			break;
+		}
+
+		printed++;
+	}
+
+	talloc_free(copies);
+
+	return printed;
+}
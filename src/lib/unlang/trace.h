@@ -0,0 +1,70 @@
+#pragma once
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * $Id$
+ *
+ * @file unlang/trace.h
+ * @brief Binary trace of request execution.
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <freeradius-devel/server/request.h>
+#include <freeradius-devel/server/rcode.h>
+#include <freeradius-devel/util/inet.h>
+#include <freeradius-devel/util/time.h>
+
+#include <stdio.h>
+
+/** Ring of trace records, one per worker
+ *
+ */
+typedef struct unlang_trace_s unlang_trace_t;
+
+struct unlang_s;
+
+/** Types of trace record
+ *
+ */
+typedef enum {
+	UNLANG_TRACE_INVALID = 0,
+	UNLANG_TRACE_REQUEST_START,				//!< Request was decoded, and is about to run.
+	UNLANG_TRACE_INSTRUCTION,				//!< Instruction completed.
+	UNLANG_TRACE_YIELD,					//!< Instruction yielded.
+	UNLANG_TRACE_RESUME,					//!< Instruction resumed.
+	UNLANG_TRACE_REQUEST_DONE				//!< Request finished running.
+} unlang_trace_event_t;
+
+unlang_trace_t	*unlang_trace_alloc(TALLOC_CTX *ctx, uint32_t num_records);
+
+void		unlang_trace_request_start(unlang_trace_t *trace, request_t *request) CC_HINT(nonnull);
+
+void		unlang_trace_request_done(unlang_trace_t *trace, request_t *request, rlm_rcode_t rcode) CC_HINT(nonnull);
+
+void		unlang_trace_instruction(unlang_trace_t *trace, request_t *request, struct unlang_s const *instruction,
+					 unlang_trace_event_t event, rlm_rcode_t rcode, int depth) CC_HINT(nonnull);
+
+int		unlang_trace_dump(FILE *fp, unlang_trace_t const *trace, fr_time_delta_t window,
+				  uint64_t number, fr_ipaddr_t const *client) CC_HINT(nonnull(1,2));
+
+#ifdef __cplusplus
+}
+#endif
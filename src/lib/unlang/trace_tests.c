@@ -0,0 +1,288 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Tests for the request trace ring
+ *
+ * @file src/lib/unlang/trace_tests.c
+ * @copyright 2026 The FreeRADIUS server project
+ */
+#define USE_CONSTRUCTOR
+
+#ifdef USE_CONSTRUCTOR
+static void test_init(void) __attribute__((constructor));
+#else
+static void test_init(void);
+#  define TEST_INIT  test_init()
+#endif
+
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+
+#include "trace.c"
+
+#include <pthread.h>
+
+#define TEST_RECORDS		8
+#define TEST_CONCURRENT		200000
+
+static TALLOC_CTX		*autofree;
+
+static RADCLIENT		test_client_a;
+static RADCLIENT		test_client_b;
+static fr_radius_packet_t	test_packet = { .code = 1 };
+
+static unlang_t const		test_instruction = {
+	.debug_name	= "test",
+	.type		= UNLANG_TYPE_GROUP
+};
+
+/** Global initialisation
+ */
+static void test_init(void)
+{
+	autofree = talloc_autofree_context();
+	if (!autofree) {
+	error:
+		fr_perror("trace_tests");
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	if (fr_time_start() < 0) goto error;
+
+	/*
+	 *	Normally set by unlang_init_global(), which needs
+	 *	the dictionaries.  Only the name is printed.
+	 */
+	unlang_ops[UNLANG_TYPE_GROUP].name = "group";
+
+	if (fr_inet_pton(&test_client_a.ipaddr, "192.0.2.1", -1, AF_INET, false, false) < 0) goto error;
+	if (fr_inet_pton(&test_client_b.ipaddr, "192.0.2.2", -1, AF_INET, false, false) < 0) goto error;
+}
+
+/** Write the start and done records of a request
+ *
+ */
+static void test_request(unlang_trace_t *trace, uint64_t number, RADCLIENT *client)
+{
+	request_t request = { .number = number, .client = client, .packet = &test_packet };
+
+	unlang_trace_request_start(trace, &request);
+	unlang_trace_request_done(trace, &request, RLM_MODULE_OK);
+}
+
+/** Dump a trace to a temporary file, returning the number of records printed
+ *
+ */
+static int test_dump(unlang_trace_t const *trace, uint64_t number, fr_ipaddr_t const *client)
+{
+	FILE	*fp = tmpfile();
+	int	printed;
+
+	TEST_ASSERT(fp != NULL);
+	printed = unlang_trace_dump(fp, trace, fr_time_delta_wrap(0), number, client);
+	fclose(fp);
+
+	return printed;
+}
+
+static void test_alloc(void)
+{
+	unlang_trace_t *trace;
+
+	TEST_CASE("Zero records are refused");
+	TEST_CHECK(unlang_trace_alloc(autofree, 0) == NULL);
+
+	TEST_CASE("The number of records is rounded up to a power of 2");
+	trace = unlang_trace_alloc(autofree, 5);
+	TEST_ASSERT(trace != NULL);
+	TEST_CHECK_RET((int)(trace->mask + 1), 8);
+	talloc_free(trace);
+
+	trace = unlang_trace_alloc(autofree, 8);
+	TEST_ASSERT(trace != NULL);
+	TEST_CHECK_RET((int)(trace->mask + 1), 8);
+	talloc_free(trace);
+
+	trace = unlang_trace_alloc(autofree, 1);
+	TEST_ASSERT(trace != NULL);
+	TEST_CHECK_RET((int)(trace->mask + 1), 1);
+	talloc_free(trace);
+}
+
+static void test_snapshot(void)
+{
+	unlang_trace_t		*trace;
+	unlang_trace_copy_t	copies[TEST_RECORDS];
+	request_t		request = { .number = 1 };
+
+	trace = unlang_trace_alloc(autofree, TEST_RECORDS);
+	TEST_ASSERT(trace != NULL);
+
+	TEST_CASE("An empty ring has no records");
+	TEST_CHECK_LEN(trace_snapshot(copies, trace), 0);
+
+	TEST_CASE("Records are copied in the order they were written");
+	unlang_trace_instruction(trace, &request, &test_instruction, UNLANG_TRACE_YIELD, RLM_MODULE_NOT_SET, 1);
+	unlang_trace_instruction(trace, &request, &test_instruction, UNLANG_TRACE_RESUME, RLM_MODULE_NOT_SET, 1);
+	unlang_trace_instruction(trace, &request, &test_instruction, UNLANG_TRACE_INSTRUCTION, RLM_MODULE_OK, 1);
+
+	TEST_CHECK_LEN(trace_snapshot(copies, trace), 3);
+	TEST_CHECK(copies[0].event == UNLANG_TRACE_YIELD);
+	TEST_CHECK(copies[1].event == UNLANG_TRACE_RESUME);
+	TEST_CHECK(copies[2].event == UNLANG_TRACE_INSTRUCTION);
+	TEST_CHECK(copies[2].rcode == RLM_MODULE_OK);
+	TEST_CHECK(copies[2].type == UNLANG_TYPE_GROUP);
+	TEST_CHECK(copies[2].depth == 1);
+	TEST_CHECK(strcmp(copies[2].debug_name, "test") == 0);
+
+	talloc_free(trace);
+}
+
+static void test_wrap(void)
+{
+	unlang_trace_t		*trace;
+	unlang_trace_copy_t	copies[TEST_RECORDS];
+	size_t			num, i;
+
+	trace = unlang_trace_alloc(autofree, TEST_RECORDS);
+	TEST_ASSERT(trace != NULL);
+
+	/*
+	 *	10 requests, 20 records, so the ring has wrapped
+	 *	twice and only the last 4 requests are left.
+	 */
+	for (i = 1; i <= 10; i++) test_request(trace, i, &test_client_a);
+
+	TEST_CASE("Only the newest records are kept once the ring wraps");
+	num = trace_snapshot(copies, trace);
+	TEST_CHECK_LEN(num, TEST_RECORDS);
+
+	for (i = 0; i < num; i++) {
+		TEST_CHECK(copies[i].seq == 13 + i);
+		TEST_MSG("Expected seq %zu, got %" PRIu64, 13 + i, copies[i].seq);
+
+		TEST_CHECK(copies[i].number == 7 + (i / 2));
+		TEST_CHECK(copies[i].event == ((i & 0x01) ? UNLANG_TRACE_REQUEST_DONE : UNLANG_TRACE_REQUEST_START));
+	}
+
+	TEST_CASE("The client is only recorded in the start record");
+	TEST_CHECK(fr_ipaddr_cmp(&copies[0].client, &test_client_a.ipaddr) == 0);
+	TEST_CHECK(copies[0].code == 1);
+
+	talloc_free(trace);
+}
+
+static void test_dump_filter(void)
+{
+	unlang_trace_t	*trace;
+	request_t	request = { .number = 2 };
+
+	trace = unlang_trace_alloc(autofree, 64);
+	TEST_ASSERT(trace != NULL);
+
+	test_request(trace, 1, &test_client_a);
+	test_request(trace, 2, &test_client_b);
+	unlang_trace_instruction(trace, &request, &test_instruction, UNLANG_TRACE_INSTRUCTION, RLM_MODULE_OK, 1);
+	test_request(trace, 3, &test_client_a);
+	test_request(trace, 4, NULL);
+
+	TEST_CASE("All records are printed without a filter");
+	TEST_CHECK_RET(test_dump(trace, 0, NULL), 9);
+
+	TEST_CASE("Filtering by request number");
+	TEST_CHECK_RET(test_dump(trace, 2, NULL), 3);
+	TEST_CHECK_RET(test_dump(trace, 4, NULL), 2);
+	TEST_CHECK_RET(test_dump(trace, 5, NULL), 0);
+
+	TEST_CASE("Filtering by client includes records without the client");
+	TEST_CHECK_RET(test_dump(trace, 0, &test_client_a.ipaddr), 4);
+	TEST_CHECK_RET(test_dump(trace, 0, &test_client_b.ipaddr), 3);
+	TEST_CHECK_RET(test_dump(trace, 0, &(fr_ipaddr_t){ .af = AF_INET }), 0);
+
+	TEST_CASE("Filtering by request number and client");
+	TEST_CHECK_RET(test_dump(trace, 2, &test_client_a.ipaddr), 0);
+	TEST_CHECK_RET(test_dump(trace, 3, &test_client_a.ipaddr), 2);
+
+	talloc_free(trace);
+}
+
+static void *test_writer_thread(void *uctx)
+{
+	unlang_trace_t	*trace = uctx;
+	uint64_t	i;
+
+	/*
+	 *	The request number matches the sequence number of
+	 *	the record, so readers can tell if they got a torn
+	 *	record.
+	 */
+	for (i = 1; i <= TEST_CONCURRENT; i++) {
+		request_t request = { .number = i };
+
+		unlang_trace_instruction(trace, &request, &test_instruction,
+					 UNLANG_TRACE_INSTRUCTION, RLM_MODULE_OK, (int)(i & 0xffff));
+	}
+
+	return NULL;
+}
+
+static void test_concurrent(void)
+{
+	unlang_trace_t		*trace;
+	unlang_trace_copy_t	*copies;
+	pthread_t		writer;
+	size_t			num, i, snapshots = 0, torn = 0;
+
+	trace = unlang_trace_alloc(autofree, TEST_RECORDS);
+	TEST_ASSERT(trace != NULL);
+	copies = talloc_array(trace, unlang_trace_copy_t, TEST_RECORDS);
+
+	TEST_CASE("Snapshots taken while the ring is written only contain complete records");
+	TEST_ASSERT(pthread_create(&writer, NULL, test_writer_thread, trace) == 0);
+
+	while (atomic_load(&trace->head) <= TEST_CONCURRENT) {
+		num = trace_snapshot(copies, trace);
+		snapshots++;
+
+		for (i = 0; i < num; i++) {
+			if ((copies[i].number != copies[i].seq) ||
+			    (copies[i].depth != (copies[i].seq & 0xffff))) torn++;
+			if ((i > 0) && (copies[i].seq <= copies[i - 1].seq)) torn++;
+		}
+	}
+
+	pthread_join(writer, NULL);
+
+	TEST_CHECK(torn == 0);
+	TEST_MSG("%zu torn or out of order records in %zu snapshots", torn, snapshots);
+
+	TEST_CASE("All records are complete once the writer has finished");
+	num = trace_snapshot(copies, trace);
+	TEST_CHECK_LEN(num, TEST_RECORDS);
+	TEST_CHECK(copies[num - 1].number == TEST_CONCURRENT);
+
+	talloc_free(trace);
+}
+
+TEST_LIST = {
+	{ "alloc",		test_alloc },
+	{ "snapshot",		test_snapshot },
+	{ "wrap",		test_wrap },
+	{ "dump_filter",	test_dump_filter },
+	{ "concurrent",		test_concurrent },
+
+	{ NULL }
+};
@@ -31,6 +31,7 @@
 #include <freeradius-devel/server/modpriv.h>
 #include <freeradius-devel/util/debug.h>
 #include <freeradius-devel/unlang/base.h>
+#include <freeradius-devel/unlang/latency.h>
 #include <freeradius-devel/io/listen.h>
 
 #ifdef __cplusplus
@@ -127,6 +128,7 @@ struct unlang_s {
 	bool			closed;		//!< whether or not this section is closed to new statements
 	CONF_ITEM		*ci;		//!< used to generate this item
 	unsigned int		number;		//!< unique node number
+	uint32_t		latency_id;	//!< Latency histogram to record to, or 0 for none.
 	unlang_actions_t	actions;	//!< Priorities, etc. for the various return codes.
 };
 
@@ -302,6 +304,8 @@ struct unlang_stack_frame_s {
 								///< frame lower in the stack to determine if the
 								///< result stored in the lower stack frame should
 	uint8_t			uflags;				//!< Unwind markers
+	fr_time_t		latency_start;			//!< When we started running an instruction
+								///< with a latency histogram.
 #ifdef WITH_PERF
 	fr_time_tracking_t	tracking;			//!< track this instance of this instruction
 #endif
@@ -404,6 +408,14 @@ static inline void frame_state_init(unlang_stack_t *stack, unlang_stack_frame_t
 
 	unlang_frame_perf_init(frame);
 
+	/*
+	 *	Retries don't reset the start time, so the
+	 *	latency includes all attempts.
+	 */
+	if (instruction->latency_id && fr_time_eq(frame->latency_start, fr_time_wrap(0))) {
+		frame->latency_start = fr_time();
+	}
+
 	op = &unlang_ops[instruction->type];
 	name = op->frame_state_type ? op->frame_state_type : __location__;
 
@@ -448,6 +460,11 @@ static inline void frame_cleanup(unlang_stack_frame_t *frame)
 {
 	unlang_frame_perf_cleanup(frame);
 
+	if (fr_time_neq(frame->latency_start, fr_time_wrap(0))) {
+		unlang_latency_record(frame->instruction->latency_id, fr_time_sub(fr_time(), frame->latency_start));
+		frame->latency_start = fr_time_wrap(0);
+	}
+
 	/*
 	 *	Don't clear top_frame flag, bad things happen...
 	 */
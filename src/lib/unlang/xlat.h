@@ -422,6 +422,8 @@ void		xlat_debug(xlat_exp_head_t const *head);
 
 bool		xlat_is_literal(xlat_exp_head_t const *head);
 
+bool		xlat_contains_func(xlat_exp_head_t const *head);
+
 bool		xlat_needs_resolving(xlat_exp_head_t const *head);
 
 bool		xlat_to_string(TALLOC_CTX *ctx, char **str, xlat_exp_head_t **head);
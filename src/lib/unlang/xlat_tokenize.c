@@ -1700,6 +1700,27 @@ bool xlat_is_literal(xlat_exp_head_t const *head)
 	return true;
 }
 
+static int _xlat_contains_func_walker(UNUSED xlat_exp_t *node, UNUSED void *uctx)
+{
+	return -1;	/* Stop walking */
+}
+
+/** Check to see if the expansion calls any xlat functions
+ *
+ * Function calls have instance data, which is only created when
+ * the server starts.
+ *
+ * @param[in] head	to check.
+ * @return
+ *	- true if expansion contains function calls.
+ *	- false otherwise.
+ */
+bool xlat_contains_func(xlat_exp_head_t const *head)
+{
+	return (xlat_eval_walk(UNCONST(xlat_exp_head_t *, head), _xlat_contains_func_walker,
+			       XLAT_FUNC | XLAT_FUNC_UNRESOLVED, NULL) < 0);
+}
+
 /** Check to see if the expansion needs resolving
  *
  * @param[in] head	to check.
@@ -6,8 +6,10 @@ SUBMAKEFILES := \
 	dlist_tests.mk \
 	edit_tests.mk \
 	heap_tests.mk \
+	histogram_tests.mk \
 	hmac_tests.mk \
 	libfreeradius-util.mk \
+	log_async_tests.mk \
 	lst_tests.mk \
 	minmax_heap_tests.mk \
 	pair_legacy_tests.mk \
@@ -16,6 +18,7 @@ SUBMAKEFILES := \
 	rb_tests.mk \
 	sbuff_tests.mk \
 	size_tests.mk \
+	socket_tests.mk \
 	strerror_tests.mk \
 	time_tests.mk
 
@@ -0,0 +1,125 @@
+/*
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Lesser General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2.1 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *   Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Log-linear histograms for latency measurements
+ *
+ * Recording a value is a handful of instructions and touches a single
+ * bucket, so histograms can be updated on every request.  Percentiles
+ * are calculated when the histogram is read.
+ *
+ * @file src/lib/util/histogram.c
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/util/histogram.h>
+
+/** Return the largest value which is recorded in a bucket
+ *
+ */
+static uint64_t histogram_bucket_max(unsigned int bucket)
+{
+	unsigned int	shift;
+	uint64_t	mantissa;
+
+	if (bucket < (FR_HISTOGRAM_SUB_COUNT << 1)) return bucket;
+
+	shift = (bucket / FR_HISTOGRAM_SUB_COUNT) - 1;
+	mantissa = (bucket % FR_HISTOGRAM_SUB_COUNT) + FR_HISTOGRAM_SUB_COUNT;
+
+	return ((mantissa + 1) << shift) - 1;
+}
+
+/** Add the values from one histogram to another
+ *
+ * @param[in,out] out	histogram to add values to.
+ * @param[in] in	histogram to add.
+ */
+void fr_histogram_merge(fr_histogram_t *out, fr_histogram_t const *in)
+{
+	unsigned int	i;
+	uint64_t	count = in->count;
+
+	if (!count) return;
+
+	if (!out->count || (in->min < out->min)) out->min = in->min;
+	if (in->max > out->max) out->max = in->max;
+	out->sum += in->sum;
+
+	for (i = 0; i < FR_HISTOGRAM_BUCKETS; i++) out->buckets[i] += in->buckets[i];
+
+	out->count += count;
+}
+
+/** Return the value below which a percentage of the recorded values fall
+ *
+ * @param[in] hist		to examine.
+ * @param[in] percentile	between 0 and 100, e.g. 99.9.
+ * @return
+ *	- The upper bound of the bucket containing the percentile,
+ *	  limited to the largest value recorded.
+ *	- 0 if nothing has been recorded.
+ */
+uint64_t fr_histogram_percentile(fr_histogram_t const *hist, double percentile)
+{
+	unsigned int	i;
+	uint64_t	target, seen = 0, total = 0;
+	double		rank;
+
+	/*
+	 *	The writer may be updating the histogram, so
+	 *	count the buckets instead of trusting hist->count.
+	 */
+	for (i = 0; i < FR_HISTOGRAM_BUCKETS; i++) total += hist->buckets[i];
+	if (!total) return 0;
+
+	if (percentile <= 0) return hist->min;
+	if (percentile >= 100) return hist->max;
+
+	/*
+	 *	The number of values which must be less than or
+	 *	equal to the result, rounded up.
+	 */
+	rank = (percentile / 100.0) * total;
+	target = (uint64_t) rank;
+	if ((double) target < rank) target++;
+	if (!target) target = 1;
+
+	for (i = 0; i < FR_HISTOGRAM_BUCKETS; i++) {
+		uint64_t max;
+
+		seen += hist->buckets[i];
+		if (seen < target) continue;
+
+		max = histogram_bucket_max(i);
+		return (max < hist->max) ? max : hist->max;
+	}
+
+	return hist->max;
+}
+
+/** Return the mean of the recorded values
+ *
+ * @param[in] hist	to examine.
+ * @return the mean, or 0 if nothing has been recorded.
+ */
+uint64_t fr_histogram_mean(fr_histogram_t const *hist)
+{
+	if (!hist->count) return 0;
+
+	return hist->sum / hist->count;
+}
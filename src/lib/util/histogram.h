@@ -0,0 +1,114 @@
+#pragma once
+/*
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Lesser General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2.1 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *   Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Log-linear histograms for latency measurements
+ *
+ * @file src/lib/util/histogram.h
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+RCSIDH(histogram_h, "$Id$")
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <freeradius-devel/build.h>
+#include <freeradius-devel/missing.h>
+#include <freeradius-devel/util/math.h>
+
+#include <stdint.h>
+#include <stdio.h>
+
+/** Number of sub-buckets per power of 2, as a power of 2
+ *
+ * 3 gives 8 sub-buckets, so each value is recorded with a
+ * relative error of at most 12.5%.
+ */
+#define FR_HISTOGRAM_SUB_BITS	3
+#define FR_HISTOGRAM_SUB_COUNT	(1 << FR_HISTOGRAM_SUB_BITS)
+
+/** Largest value which can be recorded accurately, as a power of 2
+ *
+ * Values larger than 2^40 (about 18 minutes in nanoseconds) are
+ * recorded in the last bucket.
+ */
+#define FR_HISTOGRAM_MAX_BITS	40
+
+#define FR_HISTOGRAM_BUCKETS	((FR_HISTOGRAM_MAX_BITS - FR_HISTOGRAM_SUB_BITS + 1) * FR_HISTOGRAM_SUB_COUNT)
+
+/** A histogram of values, usually nanoseconds
+ *
+ * Values less than #FR_HISTOGRAM_SUB_COUNT * 2 are counted exactly.  Above
+ * that, each power of 2 is divided into #FR_HISTOGRAM_SUB_COUNT buckets.
+ *
+ * Histograms have a single writer, and no locks.  Readers in other threads
+ * may see a histogram which is being updated, which means the counts may be
+ * out by one or two.  That's fine for statistics.
+ */
+typedef struct {
+	uint64_t	count;					//!< Number of values recorded.
+	uint64_t	sum;					//!< Of all values recorded.
+	uint64_t	min;					//!< Smallest value recorded.
+	uint64_t	max;					//!< Largest value recorded.
+	uint64_t	buckets[FR_HISTOGRAM_BUCKETS];
+} fr_histogram_t;
+
+/** Return the bucket a value is recorded in
+ *
+ */
+static inline unsigned int fr_histogram_bucket(uint64_t value)
+{
+	unsigned int shift;
+
+	if (value < (FR_HISTOGRAM_SUB_COUNT << 1)) return value;
+
+	if (value >= ((uint64_t)1 << FR_HISTOGRAM_MAX_BITS)) return FR_HISTOGRAM_BUCKETS - 1;
+
+	/*
+	 *	Keep the top FR_HISTOGRAM_SUB_BITS + 1 bits of the
+	 *	value.  The most significant bit is always set, so
+	 *	the result is in [SUB_COUNT, 2 * SUB_COUNT).
+	 */
+	shift = fr_high_bit_pos(value) - (FR_HISTOGRAM_SUB_BITS + 1);
+
+	return (shift * FR_HISTOGRAM_SUB_COUNT) + (value >> shift);
+}
+
+/** Record a value
+ *
+ * @param[in] hist	to record the value in.
+ * @param[in] value	to record.
+ */
+static inline void fr_histogram_record(fr_histogram_t *hist, uint64_t value)
+{
+	if (!hist->count || (value < hist->min)) hist->min = value;
+	if (value > hist->max) hist->max = value;
+	hist->sum += value;
+	hist->buckets[fr_histogram_bucket(value)]++;
+	hist->count++;
+}
+
+void		fr_histogram_merge(fr_histogram_t *out, fr_histogram_t const *in) CC_HINT(nonnull);
+
+uint64_t	fr_histogram_percentile(fr_histogram_t const *hist, double percentile) CC_HINT(nonnull);
+
+uint64_t	fr_histogram_mean(fr_histogram_t const *hist) CC_HINT(nonnull);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,109 @@
+/*
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Lesser General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2.1 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *   Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Tests for log-linear histograms
+ *
+ * @file src/lib/util/histogram_tests.c
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+
+#include <freeradius-devel/util/acutest.h>
+
+#include "histogram.h"
+
+static void test_histogram_buckets(void)
+{
+	uint64_t	value;
+	unsigned int	prev = 0;
+
+	TEST_CASE("Small values have their own bucket");
+	for (value = 0; value < (FR_HISTOGRAM_SUB_COUNT << 1); value++) {
+		TEST_CHECK(fr_histogram_bucket(value) == (unsigned int) value);
+	}
+
+	TEST_CASE("Buckets increase monotonically, and don't overflow");
+	for (value = 1; value < ((uint64_t)1 << 42); value += (value >> 3) + 1) {
+		unsigned int bucket = fr_histogram_bucket(value);
+
+		TEST_CHECK(bucket >= prev);
+		TEST_CHECK(bucket < FR_HISTOGRAM_BUCKETS);
+		prev = bucket;
+	}
+	TEST_CHECK(fr_histogram_bucket(UINT64_MAX) == FR_HISTOGRAM_BUCKETS - 1);
+}
+
+static void test_histogram_percentile(void)
+{
+	fr_histogram_t	hist = {};
+	uint64_t	i, p50, p99;
+
+	TEST_CASE("Empty histogram");
+	TEST_CHECK(fr_histogram_percentile(&hist, 50) == 0);
+	TEST_CHECK(fr_histogram_mean(&hist) == 0);
+
+	TEST_CASE("Values 1..1000 microseconds");
+	for (i = 1; i <= 1000; i++) fr_histogram_record(&hist, i * 1000);
+
+	TEST_CHECK(hist.count == 1000);
+	TEST_CHECK(hist.min == 1000);
+	TEST_CHECK(hist.max == 1000000);
+	TEST_CHECK(fr_histogram_mean(&hist) == 500500);
+
+	/*
+	 *	Percentiles are the upper bound of a bucket, so they're
+	 *	never less than the exact value, and at most 12.5% more.
+	 */
+	p50 = fr_histogram_percentile(&hist, 50);
+	TEST_CHECK(p50 >= 500000);
+	TEST_CHECK(p50 <= 562500);
+	TEST_MSG("p50 %" PRIu64, p50);
+
+	p99 = fr_histogram_percentile(&hist, 99);
+	TEST_CHECK(p99 >= 990000);
+	TEST_CHECK(p99 <= 1000000);
+	TEST_MSG("p99 %" PRIu64, p99);
+
+	TEST_CHECK(fr_histogram_percentile(&hist, 0) == 1000);
+	TEST_CHECK(fr_histogram_percentile(&hist, 100) == 1000000);
+}
+
+static void test_histogram_merge(void)
+{
+	fr_histogram_t	a = {}, b = {}, total = {};
+	uint64_t	i;
+
+	for (i = 0; i < 100; i++) fr_histogram_record(&a, 10);
+	for (i = 0; i < 100; i++) fr_histogram_record(&b, 1000000);
+
+	TEST_CASE("Merging adds counts, and keeps the extremes");
+	fr_histogram_merge(&total, &a);
+	fr_histogram_merge(&total, &b);
+
+	TEST_CHECK(total.count == 200);
+	TEST_CHECK(total.min == 10);
+	TEST_CHECK(total.max == 1000000);
+	TEST_CHECK(fr_histogram_percentile(&total, 50) == 10);
+	TEST_CHECK(fr_histogram_percentile(&total, 51) >= 1000000);
+}
+
+TEST_LIST = {
+	{ "buckets",		test_histogram_buckets },
+	{ "percentile",		test_histogram_percentile },
+	{ "merge",		test_histogram_merge },
+
+	{ NULL }
+};
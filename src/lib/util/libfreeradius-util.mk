@@ -41,6 +41,7 @@ SOURCES		:= \
 		   getaddrinfo.c \
 		   hash.c \
 		   heap.c \
+		   histogram.c \
 		   hmac_md5.c \
 		   hmac_sha1.c \
 		   htrie.c \
@@ -48,6 +49,7 @@ SOURCES		:= \
 		   inet.c \
 		   isaac.c \
 		   log.c \
+		   log_async.c \
 		   lst.c \
 		   machine.c \
 		   md4.c \
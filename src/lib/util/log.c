@@ -24,6 +24,7 @@ RCSID("$Id$")
 
 #include <freeradius-devel/util/debug.h>
 #include <freeradius-devel/util/log.h>
+#include <freeradius-devel/util/log_async.h>
 #include <freeradius-devel/util/print.h>
 #include <freeradius-devel/util/sbuff.h>
 #include <freeradius-devel/util/syserror.h>
@@ -535,6 +536,15 @@ void fr_vlog(fr_log_t const *log, fr_log_type_t type, char const *file, int line
 			syslog_priority = LOG_AUTH | LOG_INFO;
 			break;
 		}
+
+		/*
+		 *	Let the log thread deal with the syslog socket
+		 */
+		if (fr_log_async_running()) {
+			buffer = talloc_asprintf(pool, "%s%s%s", fmt_time, fmt_time[0] ? ": " : "", fmt_msg);
+			if (fr_log_async_syslog(syslog_priority, buffer, talloc_array_length(buffer) - 1) == 0) break;
+		}
+
 		syslog(syslog_priority,
 		       "%s"	/* time */
 		       "%s"	/* time sep */
@@ -572,6 +582,8 @@ void fr_vlog(fr_log_t const *log, fr_log_type_t type, char const *file, int line
 				 	 colourise ? VTC_RESET : "");
 
 		len = talloc_array_length(buffer) - 1;
+		if (fr_log_async_fd_write(log->fd, buffer, len) == 0) break;
+
 		wrote = write(log->fd, buffer, len);
 		if (wrote < len) return;
 	}
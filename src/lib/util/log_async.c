@@ -0,0 +1,807 @@
+/*
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Lesser General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2.1 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *   Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Write log messages from a dedicated thread
+ *
+ * Writing log messages synchronously means a slow disk or syslog socket
+ * stalls whichever thread is logging, and concurrent writers contend in
+ * the kernel.
+ *
+ * Instead, each thread copies its formatted messages into its own single
+ * producer, single consumer ring buffer.  A dedicated log thread drains the
+ * rings, batching consecutive messages for the same file descriptor into
+ * a single writev() call.
+ *
+ * Logging threads never block.  If a thread's ring is full, the message is
+ * discarded and counted, and the log thread reports the number of messages
+ * dropped.  Memory use is bounded by ring_size per logging thread.
+ *
+ * Files which messages are appended to (e.g. per-request debug logs) are
+ * kept open by the log thread whilst it's busy, and closed when it goes
+ * idle, so that log rotation isn't held up.
+ *
+ * Messages from a single thread are written in order, messages from
+ * different threads may be interleaved.
+ *
+ * @file src/lib/util/log_async.c
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/util/atexit.h>
+#include <freeradius-devel/util/debug.h>
+#include <freeradius-devel/util/dlist.h>
+#include <freeradius-devel/util/log.h>
+#include <freeradius-devel/util/log_async.h>
+#include <freeradius-devel/util/math.h>
+#include <freeradius-devel/util/syserror.h>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/uio.h>
+
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+#else
+#  include <freeradius-devel/util/stdatomic.h>
+#endif
+#ifdef HAVE_SYSLOG_H
+#  include <syslog.h>
+#endif
+
+/** Maximum number of messages written with a single writev() call
+ *
+ */
+#define LOG_ASYNC_MAX_IOV	64
+
+/** How long the log thread sleeps for if it's not woken up
+ *
+ * Bounds the delay on a message being written if the wakeup is missed.
+ */
+#define LOG_ASYNC_IDLE_MSEC	10
+
+/** Maximum number of files the log thread keeps open
+ *
+ */
+#define LOG_ASYNC_MAX_FILES	16
+
+typedef enum {
+	LOG_ASYNC_ENTRY_PAD = 0,		//!< Skip to the start of the ring.
+	LOG_ASYNC_ENTRY_FD,			//!< Write to a file descriptor.
+	LOG_ASYNC_ENTRY_FILE,			//!< Append to a file, opening it first.
+	LOG_ASYNC_ENTRY_SYSLOG			//!< Send to syslog.
+} log_async_entry_type_t;
+
+/** Header for a message in a ring
+ *
+ * Followed by the path (for #LOG_ASYNC_ENTRY_FILE), then the message.
+ */
+typedef struct {
+	uint32_t		len;			//!< Length of the message.
+	uint16_t		path_len;		//!< Length of the path, including the '\0'.
+	uint8_t			type;			//!< One of #log_async_entry_type_t.
+	int32_t			fd;			//!< File descriptor, or syslog priority.
+} log_async_entry_t;
+
+#define LOG_ASYNC_ALIGN		8
+#define LOG_ASYNC_HDR_SIZE	ROUND_UP_POW2(sizeof(log_async_entry_t), LOG_ASYNC_ALIGN)
+
+/** A ring owned by a single logging thread
+ *
+ */
+typedef struct {
+	fr_dlist_t		entry;			//!< Entry in the list of rings.
+
+	uint8_t			*buff;			//!< Message data.
+	size_t			size;			//!< Size of the buffer, a power of 2.
+
+	_Atomic(uint64_t)	head;			//!< Written by the producer.
+	_Atomic(uint64_t)	tail;			//!< Written by the consumer.
+	_Atomic(uint64_t)	dropped;		//!< Messages discarded because the ring was full.
+
+	_Atomic(bool)		busy;			//!< The owning thread is queueing a message.
+	_Atomic(bool)		exited;			//!< The owning thread has exited.
+} log_async_ring_t;
+
+/** A file the log thread is appending to
+ *
+ */
+typedef struct {
+	char			*path;			//!< Of the file.  NULL if the slot is unused.
+	int			fd;			//!< Open for appending.
+	uint64_t		last_used;		//!< For evicting the least recently used file.
+} log_async_file_t;
+
+static _Thread_local log_async_ring_t *log_async_ring;
+
+static pthread_mutex_t		log_async_mutex = PTHREAD_MUTEX_INITIALIZER;	//!< Protects the list of rings.
+static pthread_cond_t		log_async_cond = PTHREAD_COND_INITIALIZER;	//!< Wakes the log thread.
+static fr_dlist_head_t		log_async_rings;
+static pthread_t		log_async_thread;
+static size_t			log_async_ring_size;
+
+static _Atomic(bool)		log_async_running;	//!< Messages should be sent via the log thread.
+static _Atomic(bool)		log_async_stopping;	//!< Log thread should exit after draining the rings.
+static _Atomic(bool)		log_async_sleeping;	//!< Log thread is waiting for messages.
+
+static pthread_cond_t		log_async_flush_cond = PTHREAD_COND_INITIALIZER;	//!< Signalled after each drain.
+static uint64_t			log_async_flush_requested;	//!< Protected by log_async_mutex.
+static uint64_t			log_async_flush_done;		//!< Protected by log_async_mutex.
+
+static log_async_file_t		log_async_files[LOG_ASYNC_MAX_FILES];	//!< Only used by the log thread.
+static uint64_t			log_async_files_used;
+
+static uint64_t			log_async_dropped_exited;	//!< Drops from rings which have been freed.
+static uint64_t			log_async_dropped_reported;	//!< Drops we've already logged.
+
+static void log_async_ring_free(log_async_ring_t *ring)
+{
+	log_async_dropped_exited += atomic_load(&ring->dropped);
+	fr_dlist_remove(&log_async_rings, ring);
+	free(ring->buff);
+	free(ring);
+}
+
+static int _log_async_ring_exit(void *uctx)
+{
+	log_async_ring_t *ring = uctx;
+
+	/*
+	 *	The log thread, or fr_log_async_stop(), will
+	 *	free the ring once it's written out the last
+	 *	messages.
+	 */
+	pthread_mutex_lock(&log_async_mutex);
+	if (atomic_load(&log_async_running) || atomic_load(&log_async_stopping)) {
+		atomic_store(&ring->exited, true);
+	} else {
+		log_async_ring_free(ring);
+	}
+	pthread_mutex_unlock(&log_async_mutex);
+
+	log_async_ring = NULL;
+
+	return 0;
+}
+
+/** Get the ring for the current thread, allocating one if needed
+ *
+ */
+static log_async_ring_t *log_async_ring_get(void)
+{
+	log_async_ring_t *ring;
+
+	if (likely(log_async_ring != NULL)) return log_async_ring;
+
+	if (fr_atexit_is_exiting()) return NULL;
+
+	ring = calloc(1, sizeof(*ring));
+	if (!ring) return NULL;
+
+	ring->size = log_async_ring_size;
+	ring->buff = malloc(ring->size);
+	if (!ring->buff) {
+		free(ring);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&log_async_mutex);
+	fr_dlist_insert_tail(&log_async_rings, ring);
+	pthread_mutex_unlock(&log_async_mutex);
+
+	fr_atexit_thread_local(log_async_ring, _log_async_ring_exit, ring);
+
+	return ring;
+}
+
+/** Copy a message into the current thread's ring
+ *
+ * @return
+ *	- 0 if the message was queued, or discarded because the ring was full.
+ *	- -1 if the log thread isn't running, and the caller should write the message itself.
+ */
+static int log_async_push(log_async_entry_type_t type, int fd, char const *path,
+			  char const *buffer, size_t len)
+{
+	log_async_ring_t	*ring;
+	log_async_entry_t	*hdr;
+	size_t			path_len = path ? strlen(path) + 1 : 0;
+	size_t			need, offset, contig, pad = 0;
+	uint64_t		head, tail;
+	uint8_t			*p;
+
+	if (!atomic_load_explicit(&log_async_running, memory_order_acquire)) return -1;
+
+	ring = log_async_ring_get();
+	if (unlikely(!ring)) return -1;
+
+	/*
+	 *	Pairs with fr_log_async_stop().  Either it sees
+	 *	we're busy and waits for us, or we see that
+	 *	the log thread is stopping.
+	 */
+	atomic_store(&ring->busy, true);
+	if (unlikely(!atomic_load(&log_async_running))) {
+		atomic_store_explicit(&ring->busy, false, memory_order_release);
+		return -1;
+	}
+
+	need = ROUND_UP_POW2(LOG_ASYNC_HDR_SIZE + path_len + len, LOG_ASYNC_ALIGN);
+
+	head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+	/*
+	 *	Messages are contiguous, so if there's not
+	 *	enough space before the end of the buffer
+	 *	skip to the start.
+	 */
+	offset = head & (ring->size - 1);
+	contig = ring->size - offset;
+	if (contig < need) pad = contig;
+
+	if ((path_len > UINT16_MAX) || (len > UINT32_MAX) || ((head + pad + need) - tail > ring->size)) {
+		atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+		atomic_store_explicit(&ring->busy, false, memory_order_release);
+		return 0;
+	}
+
+	if (pad) {
+		/*
+		 *	If there's not even enough space for a
+		 *	header, the consumer skips it implicitly.
+		 */
+		if (pad >= LOG_ASYNC_HDR_SIZE) {
+			hdr = (log_async_entry_t *)(ring->buff + offset);
+			hdr->type = LOG_ASYNC_ENTRY_PAD;
+		}
+		head += pad;
+		offset = 0;
+	}
+
+	hdr = (log_async_entry_t *)(ring->buff + offset);
+	hdr->type = type;
+	hdr->fd = fd;
+	hdr->len = len;
+	hdr->path_len = path_len;
+
+	p = ring->buff + offset + LOG_ASYNC_HDR_SIZE;
+	if (path_len) {
+		memcpy(p, path, path_len);
+		p += path_len;
+	}
+	memcpy(p, buffer, len);
+
+	atomic_store_explicit(&ring->head, head + need, memory_order_release);
+	atomic_store_explicit(&ring->busy, false, memory_order_release);
+
+	/*
+	 *	Only wake the log thread if it's idle.  If we
+	 *	race with it going to sleep, the message is
+	 *	written when it next wakes up.
+	 */
+	if (atomic_load_explicit(&log_async_sleeping, memory_order_relaxed)) pthread_cond_signal(&log_async_cond);
+
+	return 0;
+}
+
+/** Write an array of buffers, retrying after short writes
+ *
+ */
+static void log_async_writev(int fd, struct iovec *iov, int iov_cnt)
+{
+	while (iov_cnt > 0) {
+		ssize_t slen;
+
+		slen = writev(fd, iov, iov_cnt);
+		if (slen < 0) {
+			if (errno == EINTR) continue;
+			return;
+		}
+
+		while ((iov_cnt > 0) && ((size_t)slen >= iov->iov_len)) {
+			slen -= iov->iov_len;
+			iov++;
+			iov_cnt--;
+		}
+
+		if (iov_cnt > 0) {
+			iov->iov_base = (uint8_t *)iov->iov_base + slen;
+			iov->iov_len -= slen;
+		}
+	}
+}
+
+/** Find a file we're already appending to
+ *
+ * @return
+ *	- The fd of the file.
+ *	- -1 if the file isn't open.
+ */
+static int log_async_file_find(char const *path)
+{
+	size_t i;
+
+	for (i = 0; i < NUM_ELEMENTS(log_async_files); i++) {
+		log_async_file_t *file = &log_async_files[i];
+
+		if (!file->path || (strcmp(file->path, path) != 0)) continue;
+
+		file->last_used = ++log_async_files_used;
+		return file->fd;
+	}
+
+	return -1;
+}
+
+/** Open a file to append to, closing the least recently used file if needed
+ *
+ * @return
+ *	- The fd of the file.
+ *	- -1 if the file couldn't be opened.
+ */
+static int log_async_file_open(char const *path)
+{
+	log_async_file_t	*file = NULL;
+	int			fd;
+	size_t			i;
+
+	for (i = 0; i < NUM_ELEMENTS(log_async_files); i++) {
+		if (!log_async_files[i].path) {
+			file = &log_async_files[i];
+			break;
+		}
+
+		if (!file || (log_async_files[i].last_used < file->last_used)) file = &log_async_files[i];
+	}
+
+	fd = open(path, O_WRONLY | O_APPEND | O_CREAT, 0666);
+	if (fd < 0) return -1;
+
+	if (file->path) {
+		close(file->fd);
+		free(file->path);
+	}
+
+	file->path = strdup(path);
+	if (!file->path) {
+		close(fd);
+		return -1;
+	}
+	file->fd = fd;
+	file->last_used = ++log_async_files_used;
+
+	return fd;
+}
+
+/** Close all the files we're appending to
+ *
+ * This is done whenever the log thread goes idle, so a rotated
+ * file is only written to until the messages already queued for
+ * it have been written.
+ */
+static void log_async_files_close(void)
+{
+	size_t i;
+
+	for (i = 0; i < NUM_ELEMENTS(log_async_files); i++) {
+		log_async_file_t *file = &log_async_files[i];
+
+		if (!file->path) continue;
+
+		close(file->fd);
+		free(file->path);
+		file->path = NULL;
+	}
+}
+
+/** Write out all the messages in a ring
+ *
+ * @return The number of messages written.
+ */
+static unsigned int log_async_ring_drain(log_async_ring_t *ring)
+{
+	uint64_t	pos, head;
+	struct iovec	iov[LOG_ASYNC_MAX_IOV];
+	int		iov_cnt = 0;
+	int		iov_fd = -1;
+	unsigned int	count = 0;
+
+	pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+	/*
+	 *	The space used by a message can only be released
+	 *	once it's been written, as the iovecs point into
+	 *	the ring.
+	 */
+#define FLUSH_IOV \
+	do { \
+		if (iov_cnt) { \
+			log_async_writev(iov_fd, iov, iov_cnt); \
+			iov_cnt = 0; \
+		} \
+		atomic_store_explicit(&ring->tail, pos, memory_order_release); \
+	} while (0)
+
+	while (pos != head) {
+		size_t			offset = pos & (ring->size - 1);
+		size_t			contig = ring->size - offset;
+		log_async_entry_t	*hdr;
+		uint8_t			*data;
+
+		if ((contig < LOG_ASYNC_HDR_SIZE) ||
+		    ((hdr = (log_async_entry_t *)(ring->buff + offset))->type == LOG_ASYNC_ENTRY_PAD)) {
+			pos += contig;
+			continue;
+		}
+
+		data = ring->buff + offset + LOG_ASYNC_HDR_SIZE + hdr->path_len;
+
+		switch (hdr->type) {
+		case LOG_ASYNC_ENTRY_FD:
+			if ((iov_cnt == LOG_ASYNC_MAX_IOV) || (iov_cnt && (iov_fd != hdr->fd))) FLUSH_IOV;
+
+			iov_fd = hdr->fd;
+			iov[iov_cnt++] = (struct iovec){ .iov_base = data, .iov_len = hdr->len };
+			pos += ROUND_UP_POW2(LOG_ASYNC_HDR_SIZE + hdr->path_len + hdr->len, LOG_ASYNC_ALIGN);
+			break;
+
+		case LOG_ASYNC_ENTRY_FILE:
+		{
+			char const	*path = (char const *)(ring->buff + offset + LOG_ASYNC_HDR_SIZE);
+			int		fd;
+
+			fd = log_async_file_find(path);
+			if (fd < 0) {
+				/*
+				 *	Opening a file may close another,
+				 *	which may have writes pending.
+				 */
+				FLUSH_IOV;
+				fd = log_async_file_open(path);
+			}
+
+			if (fd >= 0) {
+				if ((iov_cnt == LOG_ASYNC_MAX_IOV) || (iov_cnt && (iov_fd != fd))) FLUSH_IOV;
+
+				iov_fd = fd;
+				iov[iov_cnt++] = (struct iovec){ .iov_base = data, .iov_len = hdr->len };
+			}
+			pos += ROUND_UP_POW2(LOG_ASYNC_HDR_SIZE + hdr->path_len + hdr->len, LOG_ASYNC_ALIGN);
+		}
+			break;
+
+#ifdef HAVE_SYSLOG_H
+		case LOG_ASYNC_ENTRY_SYSLOG:
+			FLUSH_IOV;
+			syslog(hdr->fd, "%.*s", (int)hdr->len, (char const *)data);
+			pos += ROUND_UP_POW2(LOG_ASYNC_HDR_SIZE + hdr->path_len + hdr->len, LOG_ASYNC_ALIGN);
+			FLUSH_IOV;
+			break;
+#endif
+
+		default:
+			pos += ROUND_UP_POW2(LOG_ASYNC_HDR_SIZE + hdr->path_len + hdr->len, LOG_ASYNC_ALIGN);
+			break;
+		}
+		count++;
+	}
+	FLUSH_IOV;
+
+#undef FLUSH_IOV
+
+	return count;
+}
+
+/** Write out the messages in all the rings
+ *
+ * @return The number of messages written.
+ */
+static unsigned int log_async_drain(void)
+{
+	log_async_ring_t	*ring, *next;
+	unsigned int		count = 0;
+	uint64_t		dropped;
+
+	/*
+	 *	The mutex is only held whilst walking the list, not
+	 *	whilst writing, so a blocked write doesn't stop
+	 *	other threads registering their rings.
+	 *
+	 *	Rings are only freed by this thread whilst we're
+	 *	running, so they can't disappear from under us.
+	 */
+	pthread_mutex_lock(&log_async_mutex);
+	ring = fr_dlist_head(&log_async_rings);
+	pthread_mutex_unlock(&log_async_mutex);
+
+	while (ring) {
+		/*
+		 *	Check before draining, so we don't
+		 *	miss any messages written just
+		 *	before the thread exited.
+		 */
+		bool exited = atomic_load(&ring->exited);
+
+		count += log_async_ring_drain(ring);
+
+		pthread_mutex_lock(&log_async_mutex);
+		next = fr_dlist_next(&log_async_rings, ring);
+		if (exited) log_async_ring_free(ring);
+		pthread_mutex_unlock(&log_async_mutex);
+
+		ring = next;
+	}
+
+	/*
+	 *	Goes via our own ring, so it's written
+	 *	the next time we drain.
+	 */
+	dropped = fr_log_async_dropped();
+	if (dropped > log_async_dropped_reported) {
+		fr_log(&default_log, L_WARN, __FILE__, __LINE__,
+		       "Log buffer full, discarded %" PRIu64 " messages", dropped - log_async_dropped_reported);
+		log_async_dropped_reported = dropped;
+	}
+
+	return count;
+}
+
+static void *log_async_thread_main(UNUSED void *uctx)
+{
+	while (!atomic_load(&log_async_stopping)) {
+		struct timespec ts;
+		uint64_t	flush;
+		unsigned int	count;
+
+		pthread_mutex_lock(&log_async_mutex);
+		flush = log_async_flush_requested;
+		pthread_mutex_unlock(&log_async_mutex);
+
+		count = log_async_drain();
+
+		/*
+		 *	Everything queued before the flush was
+		 *	requested has now been written.
+		 */
+		if (flush != log_async_flush_done) {
+			log_async_files_close();
+
+			pthread_mutex_lock(&log_async_mutex);
+			log_async_flush_done = flush;
+			pthread_cond_broadcast(&log_async_flush_cond);
+			pthread_mutex_unlock(&log_async_mutex);
+		}
+
+		if (count > 0) continue;
+
+		log_async_files_close();
+
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_nsec += LOG_ASYNC_IDLE_MSEC * 1000000;
+		if (ts.tv_nsec >= 1000000000) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+
+		pthread_mutex_lock(&log_async_mutex);
+		atomic_store(&log_async_sleeping, true);
+		if (!atomic_load(&log_async_stopping) && (log_async_flush_requested == log_async_flush_done)) {
+			pthread_cond_timedwait(&log_async_cond, &log_async_mutex, &ts);
+		}
+		atomic_store(&log_async_sleeping, false);
+		pthread_mutex_unlock(&log_async_mutex);
+	}
+
+	/*
+	 *	Write out anything which was logged
+	 *	before we were told to stop.
+	 */
+	while (log_async_drain() > 0);
+
+	return NULL;
+}
+
+/** Start the log thread
+ *
+ * After this is called, messages logged via #fr_log_async_fd_write,
+ * #fr_log_async_file_write and #fr_log_async_syslog are written by
+ * the log thread.
+ *
+ * @note Must be called after the server has daemonized, as the log
+ *	thread won't survive a fork.
+ *
+ * @param[in] ring_size	Size of each logging thread's ring.  Rounded up to a power of 2.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int fr_log_async_start(size_t ring_size)
+{
+	int ret;
+
+	if (atomic_load(&log_async_running)) return 0;
+
+	if (ring_size < 4096) ring_size = 4096;
+	log_async_ring_size = (size_t)1 << fr_high_bit_pos(ring_size - 1);
+
+	if (!log_async_rings.offset) fr_dlist_init(&log_async_rings, log_async_ring_t, entry);
+	atomic_store(&log_async_stopping, false);
+	log_async_dropped_exited = 0;
+	log_async_dropped_reported = 0;
+
+	ret = pthread_create(&log_async_thread, NULL, log_async_thread_main, NULL);
+	if (ret != 0) {
+		fr_strerror_printf("Failed creating log thread: %s", fr_syserror(ret));
+		return -1;
+	}
+
+	atomic_store_explicit(&log_async_running, true, memory_order_release);
+
+	return 0;
+}
+
+/** Write out all outstanding messages, and stop the log thread
+ *
+ * Messages logged after this is called are written synchronously.
+ */
+void fr_log_async_stop(void)
+{
+	log_async_ring_t *ring, *next;
+
+	if (!atomic_load(&log_async_running)) return;
+
+	/*
+	 *	Stop any more messages being queued.  After the
+	 *	fence, any thread still queueing a message has
+	 *	marked its ring as busy.
+	 */
+	atomic_store(&log_async_stopping, true);
+	atomic_store(&log_async_running, false);
+	atomic_thread_fence(memory_order_seq_cst);
+
+	pthread_mutex_lock(&log_async_mutex);
+	pthread_cond_signal(&log_async_cond);
+	pthread_mutex_unlock(&log_async_mutex);
+	pthread_join(log_async_thread, NULL);
+
+	pthread_mutex_lock(&log_async_mutex);
+
+	/*
+	 *	Catch anything logged between the log
+	 *	thread's last drain and now.
+	 */
+	for (ring = fr_dlist_head(&log_async_rings); ring; ring = next) {
+		next = fr_dlist_next(&log_async_rings, ring);
+
+		while (atomic_load(&ring->busy)) sched_yield();
+
+		log_async_ring_drain(ring);
+
+		/*
+		 *	Rings for threads which are still running
+		 *	are freed when they exit.
+		 */
+		if (atomic_load(&ring->exited)) log_async_ring_free(ring);
+	}
+	log_async_files_close();
+
+	/*
+	 *	Release anyone waiting on a flush
+	 */
+	log_async_flush_done = log_async_flush_requested;
+	pthread_cond_broadcast(&log_async_flush_cond);
+
+	atomic_store(&log_async_stopping, false);
+	pthread_mutex_unlock(&log_async_mutex);
+}
+
+/** Wait until all the messages queued by this thread have been written
+ *
+ * Must be called before closing a file descriptor which messages may
+ * have been queued for, e.g. when the log file is reopened.
+ */
+void fr_log_async_flush(void)
+{
+	uint64_t flush;
+
+	if (!atomic_load(&log_async_running) || pthread_equal(pthread_self(), log_async_thread)) return;
+
+	pthread_mutex_lock(&log_async_mutex);
+	flush = ++log_async_flush_requested;
+	pthread_cond_signal(&log_async_cond);
+	while (log_async_flush_done < flush) pthread_cond_wait(&log_async_flush_cond, &log_async_mutex);
+	pthread_mutex_unlock(&log_async_mutex);
+}
+
+/** Whether messages are being written by the log thread
+ *
+ */
+bool fr_log_async_running(void)
+{
+	return atomic_load_explicit(&log_async_running, memory_order_relaxed);
+}
+
+/** Queue a message to be written to a file descriptor
+ *
+ * @param[in] fd	to write the message to.
+ * @param[in] buffer	containing the complete message, including any trailing '\\n'.
+ * @param[in] len	of the message.
+ * @return
+ *	- 0 if the message was queued, or discarded because the ring was full.
+ *	- -1 if the log thread isn't running, and the caller should write the message itself.
+ */
+int fr_log_async_fd_write(int fd, char const *buffer, size_t len)
+{
+	return log_async_push(LOG_ASYNC_ENTRY_FD, fd, NULL, buffer, len);
+}
+
+/** Queue a message to be appended to a file
+ *
+ * The log thread keeps a small set of files open, closing the least
+ * recently used one when it needs another, and closes them all when it
+ * goes idle.
+ *
+ * @param[in] path	of the file to append to.
+ * @param[in] buffer	containing the complete message, including any trailing '\\n'.
+ * @param[in] len	of the message.
+ * @return
+ *	- 0 if the message was queued, or discarded because the ring was full.
+ *	- -1 if the log thread isn't running, and the caller should write the message itself.
+ */
+int fr_log_async_file_write(char const *path, char const *buffer, size_t len)
+{
+	return log_async_push(LOG_ASYNC_ENTRY_FILE, -1, path, buffer, len);
+}
+
+/** Queue a message to be sent to syslog
+ *
+ * @param[in] priority	of the message.
+ * @param[in] buffer	containing the message.
+ * @param[in] len	of the message.
+ * @return
+ *	- 0 if the message was queued, or discarded because the ring was full.
+ *	- -1 if the log thread isn't running, and the caller should write the message itself.
+ */
+int fr_log_async_syslog(int priority, char const *buffer, size_t len)
+{
+#ifdef HAVE_SYSLOG_H
+	return log_async_push(LOG_ASYNC_ENTRY_SYSLOG, priority, NULL, buffer, len);
+#else
+	return -1;
+#endif
+}
+
+/** Return the total number of messages discarded because a ring was full
+ *
+ */
+uint64_t fr_log_async_dropped(void)
+{
+	log_async_ring_t	*ring;
+	uint64_t		dropped;
+
+	pthread_mutex_lock(&log_async_mutex);
+	dropped = log_async_dropped_exited;
+	for (ring = fr_dlist_head(&log_async_rings); ring; ring = fr_dlist_next(&log_async_rings, ring)) {
+		dropped += atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+	}
+	pthread_mutex_unlock(&log_async_mutex);
+
+	return dropped;
+}
@@ -0,0 +1,55 @@
+#pragma once
+/*
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Lesser General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2.1 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *   Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Write log messages from a dedicated thread
+ *
+ * @file src/lib/util/log_async.h
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+RCSIDH(log_async_h, "$Id$")
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <freeradius-devel/build.h>
+#include <freeradius-devel/missing.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+int		fr_log_async_start(size_t ring_size);
+
+void		fr_log_async_stop(void);
+
+void		fr_log_async_flush(void);
+
+bool		fr_log_async_running(void);
+
+int		fr_log_async_fd_write(int fd, char const *buffer, size_t len) CC_HINT(nonnull);
+
+int		fr_log_async_file_write(char const *path, char const *buffer, size_t len) CC_HINT(nonnull);
+
+int		fr_log_async_syslog(int priority, char const *buffer, size_t len) CC_HINT(nonnull);
+
+uint64_t	fr_log_async_dropped(void);
+
+#ifdef __cplusplus
+}
+#endif
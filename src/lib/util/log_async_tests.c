@@ -0,0 +1,268 @@
+/*
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Lesser General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2.1 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *   Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Tests for the asynchronous log pipeline
+ *
+ * @file src/lib/util/log_async_tests.c
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+
+#include "log_async.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <sys/stat.h>
+
+#define WRITER_THREADS	4
+#define WRITER_LINES	5000
+
+typedef struct {
+	pthread_t	thread;
+	int		fd;
+	int		id;
+	bool		fallback;	//!< Write the message ourselves if it's not queued.
+} log_writer_t;
+
+static void *log_writer_thread(void *uctx)
+{
+	log_writer_t	*w = uctx;
+	char		line[64];
+	int		i;
+
+	for (i = 0; i < WRITER_LINES; i++) {
+		size_t len = snprintf(line, sizeof(line), "thread %i line %05i\n", w->id, i);
+
+		if ((fr_log_async_fd_write(w->fd, line, len) < 0) && w->fallback) {
+			if (write(w->fd, line, len) < 0) break;
+		}
+	}
+
+	return NULL;
+}
+
+/** Count the lines in a file
+ *
+ */
+static unsigned int log_file_lines(char const *path)
+{
+	FILE		*fp;
+	char		line[256];
+	unsigned int	lines = 0;
+
+	fp = fopen(path, "r");
+	if (!fp) return 0;
+
+	while (fgets(line, sizeof(line), fp)) lines++;
+	fclose(fp);
+
+	return lines;
+}
+
+static void test_log_async_not_running(void)
+{
+	TEST_CASE("Messages are rejected if the log thread isn't running");
+	TEST_CHECK(!fr_log_async_running());
+	TEST_CHECK_RET(fr_log_async_fd_write(STDOUT_FILENO, "foo\n", 4), -1);
+}
+
+static void test_log_async_write(void)
+{
+	char		path[] = "/tmp/log_async_tests.XXXXXX";
+	log_writer_t	writer[WRITER_THREADS];
+	FILE		*fp;
+	char		line[64];
+	int		fd, i;
+	int		next[WRITER_THREADS] = { 0 };
+	unsigned int	lines = 0;
+	bool		ordered = true;
+
+	fd = mkstemp(path);
+	TEST_ASSERT(fd >= 0);
+
+	TEST_CHECK_RET(fr_log_async_start(1024 * 1024), 0);
+	TEST_CHECK(fr_log_async_running());
+
+	TEST_CASE("Messages from multiple threads are all written");
+	for (i = 0; i < WRITER_THREADS; i++) {
+		writer[i] = (log_writer_t){ .fd = fd, .id = i };
+		TEST_ASSERT(pthread_create(&writer[i].thread, NULL, log_writer_thread, &writer[i]) == 0);
+	}
+	for (i = 0; i < WRITER_THREADS; i++) pthread_join(writer[i].thread, NULL);
+
+	fr_log_async_stop();
+	TEST_CHECK(!fr_log_async_running());
+	TEST_CHECK(fr_log_async_dropped() == 0);
+
+	fp = fdopen(fd, "r");
+	TEST_ASSERT(fp != NULL);
+	rewind(fp);
+
+	TEST_CASE("Messages from each thread are written in order");
+	while (fgets(line, sizeof(line), fp)) {
+		int id, num;
+
+		TEST_ASSERT(sscanf(line, "thread %d line %d", &id, &num) == 2);
+		TEST_ASSERT((id >= 0) && (id < WRITER_THREADS));
+		if (num != next[id]) ordered = false;
+		next[id] = num + 1;
+		lines++;
+	}
+	TEST_CHECK(ordered);
+	TEST_CHECK(lines == (WRITER_THREADS * WRITER_LINES));
+	TEST_MSG("Expected %u lines, got %u", WRITER_THREADS * WRITER_LINES, lines);
+
+	fclose(fp);
+	unlink(path);
+}
+
+static void test_log_async_drop(void)
+{
+	int	fds[2];
+	char	line[128];
+	int	i;
+
+	/*
+	 *	The log thread blocks writing to the pipe
+	 *	once it's full, so our ring fills up.
+	 */
+	TEST_ASSERT(pipe(fds) == 0);
+	signal(SIGPIPE, SIG_IGN);
+
+	TEST_CHECK_RET(fr_log_async_start(4096), 0);
+
+	TEST_CASE("Messages are discarded, not blocked on, when the ring is full");
+	memset(line, 'x', sizeof(line) - 1);
+	line[sizeof(line) - 1] = '\n';
+	for (i = 0; i < 20000; i++) TEST_CHECK_RET(fr_log_async_fd_write(fds[1], line, sizeof(line)), 0);
+
+	TEST_CHECK(fr_log_async_dropped() > 0);
+
+	/*
+	 *	Unblock the log thread
+	 */
+	close(fds[0]);
+	fr_log_async_stop();
+	close(fds[1]);
+}
+
+static void test_log_async_stop_race(void)
+{
+	char		path[] = "/tmp/log_async_tests.XXXXXX";
+	log_writer_t	writer[WRITER_THREADS];
+	int		fd, i;
+	unsigned int	lines;
+
+	fd = mkstemp(path);
+	TEST_ASSERT(fd >= 0);
+
+	TEST_CHECK_RET(fr_log_async_start(1024 * 1024), 0);
+
+	TEST_CASE("No messages are lost if the log thread is stopped whilst threads are logging");
+	for (i = 0; i < WRITER_THREADS; i++) {
+		writer[i] = (log_writer_t){ .fd = fd, .id = i, .fallback = true };
+		TEST_ASSERT(pthread_create(&writer[i].thread, NULL, log_writer_thread, &writer[i]) == 0);
+	}
+	fr_log_async_stop();
+	for (i = 0; i < WRITER_THREADS; i++) pthread_join(writer[i].thread, NULL);
+	close(fd);
+
+	TEST_CHECK(fr_log_async_dropped() == 0);
+
+	lines = log_file_lines(path);
+	TEST_CHECK(lines == (WRITER_THREADS * WRITER_LINES));
+	TEST_MSG("Expected %u lines, got %u", WRITER_THREADS * WRITER_LINES, lines);
+
+	unlink(path);
+}
+
+static void test_log_async_flush(void)
+{
+	char		path[] = "/tmp/log_async_tests.XXXXXX";
+	char		line[64];
+	int		fd, i;
+	unsigned int	lines;
+
+	fd = mkstemp(path);
+	TEST_ASSERT(fd >= 0);
+
+	TEST_CHECK_RET(fr_log_async_start(1024 * 1024), 0);
+
+	TEST_CASE("Queued messages are written before a flush returns, so the fd can be closed");
+	for (i = 0; i < 1000; i++) {
+		size_t len = snprintf(line, sizeof(line), "line %05i\n", i);
+
+		TEST_CHECK_RET(fr_log_async_fd_write(fd, line, len), 0);
+	}
+	fr_log_async_flush();
+	close(fd);
+
+	lines = log_file_lines(path);
+	TEST_CHECK(lines == 1000);
+	TEST_MSG("Expected 1000 lines, got %u", lines);
+
+	fr_log_async_stop();
+	unlink(path);
+}
+
+static void test_log_async_file(void)
+{
+	char		dir[] = "/tmp/log_async_tests.XXXXXX";
+	char		path[64][sizeof(dir) + 16];
+	char		line[64];
+	int		i, j;
+	bool		all = true;
+
+	TEST_ASSERT(mkdtemp(dir) != NULL);
+	for (i = 0; i < (int)NUM_ELEMENTS(path); i++) snprintf(path[i], sizeof(path[i]), "%s/%02i.log", dir, i);
+
+	TEST_CHECK_RET(fr_log_async_start(1024 * 1024), 0);
+
+	/*
+	 *	More files than the log thread keeps
+	 *	open, so some are closed and reopened.
+	 */
+	TEST_CASE("Messages appended to many files are all written");
+	for (j = 0; j < 100; j++) {
+		for (i = 0; i < (int)NUM_ELEMENTS(path); i++) {
+			size_t len = snprintf(line, sizeof(line), "file %02i line %03i\n", i, j);
+
+			TEST_CHECK_RET(fr_log_async_file_write(path[i], line, len), 0);
+		}
+	}
+	fr_log_async_stop();
+
+	for (i = 0; i < (int)NUM_ELEMENTS(path); i++) {
+		if (log_file_lines(path[i]) != 100) all = false;
+		unlink(path[i]);
+	}
+	TEST_CHECK(all);
+	rmdir(dir);
+}
+
+TEST_LIST = {
+	{ "log_async_not_running",	test_log_async_not_running },
+	{ "log_async_write",		test_log_async_write },
+	{ "log_async_drop",		test_log_async_drop },
+	{ "log_async_stop_race",	test_log_async_stop_race },
+	{ "log_async_flush",		test_log_async_flush },
+	{ "log_async_file",		test_log_async_file },
+
+	{ NULL }
+};
@@ -34,12 +34,28 @@
 #include <freeradius-devel/util/cap.h>
 
 #include <fcntl.h>
+#include <pthread.h>
 
 #ifndef SO_BINDTODEVICE
 #endif
 
 #include <ifaddrs.h>
 
+/** A listening socket passed to us by the previous instance of the server
+ *
+ */
+typedef struct {
+	int			fd;		//!< The inherited socket.
+	int			type;		//!< SOCK_DGRAM, SOCK_STREAM, etc.
+	fr_ipaddr_t		ipaddr;		//!< Address the socket is bound to.
+	uint16_t		port;		//!< Port the socket is bound to.
+	char			*path;		//!< Path of a unix socket.
+	bool			claimed;	//!< Whether a listener is using the socket.
+} socket_inherited_t;
+
+static socket_inherited_t	*socket_inherited;	//!< Array of inherited sockets.
+static pthread_mutex_t		socket_inherited_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 /** Resolve a named service to a port
  *
  * @param[in] proto	The protocol. Either IPPROTO_TCP or IPPROTO_UDP.
@@ -212,6 +228,74 @@ static int socket_dont_fragment(UNUSED int sockfd, UNUSED int af)
 }
 #endif	/* lots of things */
 
+/** Find an unclaimed inherited socket which is bound to the given address and port
+ *
+ * @param[in] type	of socket, i.e. SOCK_DGRAM or SOCK_STREAM.
+ * @param[in] ipaddr	the listener is configured with.
+ * @param[in] port	the listener is configured with.
+ * @return
+ *	- The socket on success.
+ *	- -1 if no socket matches.
+ */
+static int socket_inherit_find(int type, fr_ipaddr_t const *ipaddr, uint16_t port)
+{
+	size_t	i, num;
+	int	sockfd = -1;
+
+	pthread_mutex_lock(&socket_inherited_mutex);
+	num = talloc_array_length(socket_inherited);
+	for (i = 0; i < num; i++) {
+		socket_inherited_t *si = &socket_inherited[i];
+
+		if (si->claimed || si->path || (si->type != type) || (si->port != port)) continue;
+		if (si->ipaddr.af != ipaddr->af) continue;
+
+		switch (ipaddr->af) {
+		case AF_INET:
+			if (memcmp(&si->ipaddr.addr.v4, &ipaddr->addr.v4, sizeof(ipaddr->addr.v4)) != 0) continue;
+			break;
+
+#ifdef HAVE_STRUCT_SOCKADDR_IN6
+		case AF_INET6:
+			if (memcmp(&si->ipaddr.addr.v6, &ipaddr->addr.v6, sizeof(ipaddr->addr.v6)) != 0) continue;
+			if (ipaddr->scope_id && (si->ipaddr.scope_id != ipaddr->scope_id)) continue;
+			break;
+#endif
+
+		default:
+			continue;
+		}
+
+		si->claimed = true;
+		sockfd = si->fd;
+		break;
+	}
+	pthread_mutex_unlock(&socket_inherited_mutex);
+
+	return sockfd;
+}
+
+/** Check whether a socket was inherited, and is in use by a listener
+ *
+ */
+static bool socket_inherit_claimed(int sockfd)
+{
+	size_t	i, num;
+	bool	claimed = false;
+
+	pthread_mutex_lock(&socket_inherited_mutex);
+	num = talloc_array_length(socket_inherited);
+	for (i = 0; i < num; i++) {
+		if (socket_inherited[i].fd != sockfd) continue;
+
+		claimed = socket_inherited[i].claimed;
+		break;
+	}
+	pthread_mutex_unlock(&socket_inherited_mutex);
+
+	return claimed;
+}
+
 #ifdef HAVE_SYS_UN_H
 /** Open a Unix socket
  *
@@ -656,6 +740,19 @@ int fr_socket_server_udp(fr_ipaddr_t const *src_ipaddr, uint16_t *src_port, char
 		my_port = ret;
 	}
 
+	/*
+	 *	Use the socket from the previous instance of the
+	 *	server if there is one.  It's already bound.
+	 */
+	if (my_port) {
+		sockfd = socket_inherit_find(SOCK_DGRAM, src_ipaddr, my_port);
+		if (sockfd >= 0) {
+			if (async && (fr_nonblock(sockfd) < 0)) return -1;
+			if (src_port) *src_port = my_port;
+			return sockfd;
+		}
+	}
+
 	/*
 	 *	Open the socket
 	 */
@@ -758,6 +855,19 @@ int fr_socket_server_tcp(fr_ipaddr_t const *src_ipaddr, uint16_t *src_port, char
 		my_port = ret;
 	}
 
+	/*
+	 *	Use the socket from the previous instance of the
+	 *	server if there is one.  It's already bound.
+	 */
+	if (my_port) {
+		sockfd = socket_inherit_find(SOCK_STREAM, src_ipaddr, my_port);
+		if (sockfd >= 0) {
+			if (async && (fr_nonblock(sockfd) < 0)) return -1;
+			if (src_port) *src_port = my_port;
+			return sockfd;
+		}
+	}
+
 	/*
 	 *	Open the socket
 	 */
@@ -833,6 +943,11 @@ int fr_socket_bind(int sockfd, fr_ipaddr_t const *src_ipaddr, uint16_t *src_port
 	 */
 	fr_strerror_clear();
 
+	/*
+	 *	Inherited sockets are already bound.
+	 */
+	if (socket_inherit_claimed(sockfd)) return 0;
+
 	if (src_port) my_port = *src_port;
 	if (src_ipaddr) {
 		my_ipaddr = *src_ipaddr;
@@ -1038,3 +1153,135 @@ done:
 #endif
 	return 0;
 }
+
+/** Make a socket from the previous instance of the server available to listeners
+ *
+ * When the server is reloaded, the new process is passed the listening sockets
+ * of the old process.  Listeners which are configured with the same transport,
+ * address and port as an inherited socket use it, instead of binding a new one.
+ * Packets which arrive during the hand-over are queued on the socket, as it
+ * is never closed.
+ *
+ * @param[in] sockfd	inherited from the previous instance of the server.
+ * @return
+ *	- 0 on success.
+ *	- -1 if sockfd is not a bound socket.
+ */
+int fr_socket_inherit(int sockfd)
+{
+	socket_inherited_t	si = { .fd = sockfd };
+	struct sockaddr_storage	salocal;
+	socklen_t		salen = sizeof(salocal);
+	socklen_t		len = sizeof(si.type);
+	char const		*path = NULL;
+	socket_inherited_t	*array;
+	size_t			num;
+
+	if (getsockopt(sockfd, SOL_SOCKET, SO_TYPE, &si.type, &len) < 0) {
+		fr_strerror_printf("Inherited file descriptor %d is not a socket: %s", sockfd, fr_syserror(errno));
+		return -1;
+	}
+
+	memset(&salocal, 0, sizeof(salocal));
+	if (getsockname(sockfd, (struct sockaddr *) &salocal, &salen) < 0) {
+		fr_strerror_printf("Failed getting name of inherited socket %d: %s", sockfd, fr_syserror(errno));
+		return -1;
+	}
+
+	switch (salocal.ss_family) {
+#ifdef HAVE_SYS_UN_H
+	case AF_UNIX:
+	{
+		struct sockaddr_un *sun = (struct sockaddr_un *) &salocal;
+
+		if ((salen <= offsetof(struct sockaddr_un, sun_path)) || !sun->sun_path[0]) goto unbound;
+		path = sun->sun_path;
+	}
+		break;
+#endif
+
+	case AF_INET:
+#ifdef HAVE_STRUCT_SOCKADDR_IN6
+	case AF_INET6:
+#endif
+		if (fr_ipaddr_from_sockaddr(&si.ipaddr, &si.port, &salocal, salen) < 0) return -1;
+		if (!si.port) goto unbound;
+		break;
+
+	default:
+	unbound:
+		fr_strerror_printf("Inherited socket %d is not bound", sockfd);
+		return -1;
+	}
+
+	if (socket_dont_inherit(sockfd) < 0) return -1;
+
+	pthread_mutex_lock(&socket_inherited_mutex);
+	num = talloc_array_length(socket_inherited);
+	array = talloc_realloc(NULL, socket_inherited, socket_inherited_t, num + 1);
+	if (!array) {
+	oom:
+		pthread_mutex_unlock(&socket_inherited_mutex);
+		fr_strerror_const("Out of memory");
+		return -1;
+	}
+	socket_inherited = array;
+
+	if (path) {
+		si.path = talloc_typed_strdup(socket_inherited, path);
+		if (!si.path) {
+			socket_inherited = talloc_realloc(NULL, socket_inherited, socket_inherited_t, num);
+			goto oom;
+		}
+	}
+	socket_inherited[num] = si;
+	pthread_mutex_unlock(&socket_inherited_mutex);
+
+	return 0;
+}
+
+/** Find an inherited unix socket which is bound to the given path
+ *
+ * @param[in] path	the listener is configured with.
+ * @return
+ *	- The socket on success.
+ *	- -1 if no socket matches.
+ */
+int fr_socket_inherit_unix(char const *path)
+{
+	size_t	i, num;
+	int	sockfd = -1;
+
+	pthread_mutex_lock(&socket_inherited_mutex);
+	num = talloc_array_length(socket_inherited);
+	for (i = 0; i < num; i++) {
+		socket_inherited_t *si = &socket_inherited[i];
+
+		if (si->claimed || !si->path || (strcmp(si->path, path) != 0)) continue;
+
+		si->claimed = true;
+		sockfd = si->fd;
+		break;
+	}
+	pthread_mutex_unlock(&socket_inherited_mutex);
+
+	return sockfd;
+}
+
+/** Close inherited sockets which weren't claimed by any listener
+ *
+ * Called once all listeners have been opened.  Sockets for listeners which
+ * were removed from the configuration are closed here.
+ */
+void fr_socket_inherit_done(void)
+{
+	size_t	i, num;
+
+	pthread_mutex_lock(&socket_inherited_mutex);
+	num = talloc_array_length(socket_inherited);
+	for (i = 0; i < num; i++) {
+		if (!socket_inherited[i].claimed) close(socket_inherited[i].fd);
+	}
+	TALLOC_FREE(socket_inherited);
+	pthread_mutex_unlock(&socket_inherited_mutex);
+}
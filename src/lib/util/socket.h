@@ -312,6 +312,12 @@ int		fr_socket_server_tcp(fr_ipaddr_t const *ipaddr, uint16_t *port, char const
 
 int		fr_socket_bind(int sockfd, fr_ipaddr_t const *ipaddr, uint16_t *port, char const *interface);
 
+int		fr_socket_inherit(int sockfd);
+
+int		fr_socket_inherit_unix(char const *path);
+
+void		fr_socket_inherit_done(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,248 @@
+/*
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Lesser General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2.1 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *   Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Tests for listeners re-using sockets inherited from a previous instance of the server
+ *
+ * @file src/lib/util/socket_tests.c
+ * @copyright 2026 The FreeRADIUS server project
+ */
+#define USE_CONSTRUCTOR
+
+#ifdef USE_CONSTRUCTOR
+static void test_init(void) __attribute__((constructor));
+#else
+static void test_init(void);
+#  define TEST_INIT  test_init()
+#endif
+
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+#include <freeradius-devel/util/socket.h>
+
+#include <fcntl.h>
+#include <sys/un.h>
+
+static fr_ipaddr_t	test_ipaddr;	//!< Listeners are configured with.
+
+/** Global initialisation
+ */
+static void test_init(void)
+{
+	test_ipaddr = (fr_ipaddr_t) {
+		.af = AF_INET,
+		.prefix = 32,
+		.addr.v4.s_addr = htonl(INADDR_LOOPBACK)
+	};
+}
+
+/** Open a socket bound to an ephemeral port on the loopback address, as the previous instance would have
+ *
+ */
+static int test_socket_bound(int type, uint16_t *port)
+{
+	struct sockaddr_storage	salocal;
+	socklen_t		salen;
+	int			sockfd;
+
+	sockfd = socket(AF_INET, type, 0);
+	TEST_ASSERT(sockfd >= 0);
+
+	TEST_ASSERT(fr_ipaddr_to_sockaddr(&salocal, &salen, &test_ipaddr, 0) == 0);
+	TEST_ASSERT(bind(sockfd, (struct sockaddr *)&salocal, salen) == 0);
+	if (type == SOCK_STREAM) TEST_ASSERT(listen(sockfd, 8) == 0);
+
+	salen = sizeof(salocal);
+	TEST_ASSERT(getsockname(sockfd, (struct sockaddr *)&salocal, &salen) == 0);
+	TEST_ASSERT(fr_ipaddr_from_sockaddr(&(fr_ipaddr_t){}, port, &salocal, salen) == 0);
+
+	return sockfd;
+}
+
+static bool test_fd_open(int fd)
+{
+	return (fcntl(fd, F_GETFD) >= 0);
+}
+
+/*
+ *	A listener configured with the same address and
+ *	port gets the inherited UDP socket, only once.
+ */
+static void test_inherit_udp(void)
+{
+	uint16_t	port, my_port;
+	int		sockfd, fd;
+
+	sockfd = test_socket_bound(SOCK_DGRAM, &port);
+	TEST_CHECK(fr_socket_inherit(sockfd) == 0);
+
+	/*
+	 *	Inherited sockets must not leak into
+	 *	anything we exec.
+	 */
+	TEST_CHECK((fcntl(sockfd, F_GETFD) & FD_CLOEXEC) != 0);
+
+	my_port = port;
+	fd = fr_socket_server_udp(&test_ipaddr, &my_port, NULL, true);
+	TEST_CHECK(fd == sockfd);
+	TEST_MSG("Expected inherited socket %d, got %d", sockfd, fd);
+	TEST_CHECK(my_port == port);
+	TEST_CHECK((fcntl(fd, F_GETFL) & O_NONBLOCK) != 0);
+
+	/*
+	 *	Already bound, so binding again is a no-op
+	 */
+	my_port = port;
+	TEST_CHECK(fr_socket_bind(fd, &test_ipaddr, &my_port, NULL) == 0);
+
+	/*
+	 *	Claimed, so the next listener gets its own socket.
+	 */
+	my_port = port;
+	fd = fr_socket_server_udp(&test_ipaddr, &my_port, NULL, true);
+	TEST_CHECK(fd != sockfd);
+	if (fd >= 0) close(fd);
+
+	fr_socket_inherit_done();
+	TEST_CHECK(test_fd_open(sockfd));
+	TEST_MSG("Claimed sockets must stay open");
+	close(sockfd);
+}
+
+/*
+ *	Sockets are only re-used for listeners with the
+ *	same transport, address and port.
+ */
+static void test_inherit_mismatch(void)
+{
+	uint16_t	port, my_port;
+	int		sockfd, fd;
+	fr_ipaddr_t	other = test_ipaddr;
+
+	sockfd = test_socket_bound(SOCK_STREAM, &port);
+	TEST_CHECK(fr_socket_inherit(sockfd) == 0);
+
+	my_port = port;
+	fd = fr_socket_server_udp(&test_ipaddr, &my_port, NULL, false);
+	TEST_CHECK(fd != sockfd);
+	if (fd >= 0) close(fd);
+
+	other.addr.v4.s_addr = htonl(INADDR_LOOPBACK + 1);
+	my_port = port;
+	fd = fr_socket_server_tcp(&other, &my_port, NULL, false);
+	TEST_CHECK(fd != sockfd);
+	if (fd >= 0) close(fd);
+
+	my_port = port;
+	fd = fr_socket_server_tcp(&test_ipaddr, &my_port, NULL, false);
+	TEST_CHECK(fd == sockfd);
+	TEST_MSG("Expected inherited socket %d, got %d", sockfd, fd);
+
+	fr_socket_inherit_done();
+	close(sockfd);
+}
+
+/*
+ *	Unix sockets are matched by path.
+ */
+static void test_inherit_unix(void)
+{
+	struct sockaddr_un	sun = { .sun_family = AF_UNIX };
+	int			sockfd;
+
+	snprintf(sun.sun_path, sizeof(sun.sun_path), "/tmp/socket_tests.%d.sock", (int)getpid());
+	unlink(sun.sun_path);
+
+	sockfd = socket(AF_UNIX, SOCK_STREAM, 0);
+	TEST_ASSERT(sockfd >= 0);
+	TEST_ASSERT(bind(sockfd, (struct sockaddr *)&sun, sizeof(sun)) == 0);
+	TEST_ASSERT(listen(sockfd, 8) == 0);
+
+	TEST_CHECK(fr_socket_inherit(sockfd) == 0);
+	TEST_CHECK(fr_socket_inherit_unix("/tmp/socket_tests.no_such.sock") < 0);
+	TEST_CHECK(fr_socket_inherit_unix(sun.sun_path) == sockfd);
+	TEST_CHECK(fr_socket_inherit_unix(sun.sun_path) < 0);
+	TEST_MSG("Sockets can only be claimed once");
+
+	fr_socket_inherit_done();
+	close(sockfd);
+	unlink(sun.sun_path);
+}
+
+/*
+ *	Sockets for listeners which were removed from the
+ *	configuration are closed.
+ */
+static void test_inherit_done(void)
+{
+	uint16_t	port, unused_port, my_port;
+	int		sockfd, unused;
+
+	sockfd = test_socket_bound(SOCK_DGRAM, &port);
+	unused = test_socket_bound(SOCK_DGRAM, &unused_port);
+	TEST_CHECK(fr_socket_inherit(sockfd) == 0);
+	TEST_CHECK(fr_socket_inherit(unused) == 0);
+
+	my_port = port;
+	TEST_CHECK(fr_socket_server_udp(&test_ipaddr, &my_port, NULL, false) == sockfd);
+
+	fr_socket_inherit_done();
+	TEST_CHECK(test_fd_open(sockfd));
+	TEST_CHECK(!test_fd_open(unused));
+	TEST_MSG("Unclaimed sockets should be closed");
+
+	/*
+	 *	Nothing left to claim
+	 */
+	my_port = port;
+	unused = fr_socket_server_udp(&test_ipaddr, &my_port, NULL, false);
+	TEST_CHECK(unused != sockfd);
+	if (unused >= 0) close(unused);
+
+	close(sockfd);
+}
+
+/*
+ *	Only bound sockets can be inherited.
+ */
+static void test_inherit_invalid(void)
+{
+	int	fds[2];
+	int	sockfd;
+
+	TEST_ASSERT(pipe(fds) == 0);
+	TEST_CHECK(fr_socket_inherit(fds[0]) < 0);
+	close(fds[0]);
+	close(fds[1]);
+
+	sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+	TEST_ASSERT(sockfd >= 0);
+	TEST_CHECK(fr_socket_inherit(sockfd) < 0);
+	TEST_MSG("Unbound sockets should be rejected");
+
+	fr_socket_inherit_done();
+	TEST_CHECK(test_fd_open(sockfd));
+	close(sockfd);
+}
+
+TEST_LIST = {
+	{ "inherit_udp",	test_inherit_udp },
+	{ "inherit_mismatch",	test_inherit_mismatch },
+	{ "inherit_unix",	test_inherit_unix },
+	{ "inherit_done",	test_inherit_done },
+	{ "inherit_invalid",	test_inherit_invalid },
+
+	{ NULL }
+};
@@ -0,0 +1,582 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ * @file proto_control_http.c
+ * @brief Serve OpenMetrics over HTTP, for Prometheus and friends.
+ *
+ * This is a minimal HTTP/1.x server.  It answers "GET /metrics" with
+ * the output of fr_metrics_print(), and then closes the connection.
+ * Everything is done in the network thread.  Nothing is sent to the
+ * workers, so scraping has no effect on request processing.
+ *
+ * The network thread never blocks.  If the client doesn't read the
+ * whole response immediately, the rest is written as the socket
+ * becomes writable, and the connection is closed once the response
+ * has been sent, or after write_timeout.
+ *
+ * @copyright 2026 The FreeRADIUS server project.
+ */
+#include <freeradius-devel/io/application.h>
+#include <freeradius-devel/io/listen.h>
+#include <freeradius-devel/io/schedule.h>
+#include <freeradius-devel/server/metrics.h>
+#include <freeradius-devel/server/protocol.h>
+#include <freeradius-devel/util/misc.h>
+#include <freeradius-devel/util/trie.h>
+#include <netdb.h>
+
+#include "proto_control.h"
+
+extern fr_app_io_t proto_control_http;
+
+typedef struct proto_control_http_thread_s proto_control_http_thread_t;
+
+/** A response which couldn't be written all at once
+ *
+ */
+typedef struct {
+	proto_control_http_thread_t	*thread;		//!< Connection this response is for.
+
+	uint8_t				*data;			//!< Complete response, headers and body.
+	size_t				written;		//!< How much of it the client has been sent.
+
+	int				fd;			//!< dup() of the socket, for write events.
+								///< The network side owns the read events on
+								///< the socket itself.
+	fr_event_timer_t const		*ev;			//!< Give up if the client won't read.
+} proto_control_http_response_t;
+
+struct proto_control_http_thread_s {
+	char const			*name;			//!< socket name
+
+	int				sockfd;
+
+	fr_io_address_t			*connection;		//!< for connected sockets.
+
+	fr_event_list_t			*el;			//!< Event list of the network thread.
+
+	char				*body;			//!< Response being built.
+
+	proto_control_http_response_t	*response;		//!< Response waiting to be written.
+
+	bool				done;			//!< The response has been written, and we're
+								///< waiting for the network side to close the socket.
+
+	RADCLIENT			radclient;		//!< for faking out clients
+};
+
+typedef struct {
+	CONF_SECTION			*cs;			//!< our configuration
+
+	fr_ipaddr_t			ipaddr;			//!< IP address to listen on.
+
+	char const			*interface;		//!< Interface to bind to.
+
+	uint16_t			port;			//!< Port to listen on.
+
+	fr_time_delta_t			write_timeout;		//!< How long to wait for the client to read.
+
+	uint32_t			max_packet_size;	//!< Maximum size of the HTTP request headers.
+
+	fr_trie_t			*trie;			//!< for parsed networks
+	fr_ipaddr_t			*allow;			//!< allowed networks
+	fr_ipaddr_t			*deny;			//!< denied networks
+} proto_control_http_t;
+
+static const CONF_PARSER networks_config[] = {
+	{ FR_CONF_OFFSET("allow", FR_TYPE_COMBO_IP_PREFIX | FR_TYPE_MULTI, proto_control_http_t, allow) },
+	{ FR_CONF_OFFSET("deny", FR_TYPE_COMBO_IP_PREFIX | FR_TYPE_MULTI, proto_control_http_t, deny) },
+
+	CONF_PARSER_TERMINATOR
+};
+
+static const CONF_PARSER http_listen_config[] = {
+	{ FR_CONF_OFFSET("ipaddr", FR_TYPE_COMBO_IP_ADDR, proto_control_http_t, ipaddr), .dflt = "127.0.0.1" },
+	{ FR_CONF_OFFSET("ipv4addr", FR_TYPE_IPV4_ADDR, proto_control_http_t, ipaddr) },
+	{ FR_CONF_OFFSET("ipv6addr", FR_TYPE_IPV6_ADDR, proto_control_http_t, ipaddr) },
+
+	{ FR_CONF_OFFSET("interface", FR_TYPE_STRING, proto_control_http_t, interface) },
+
+	{ FR_CONF_OFFSET("port", FR_TYPE_UINT16, proto_control_http_t, port), .dflt = "9812" },
+
+	{ FR_CONF_POINTER("networks", FR_TYPE_SUBSECTION, NULL), .subcs = (void const *) networks_config },
+
+	{ FR_CONF_OFFSET("write_timeout", FR_TYPE_TIME_DELTA, proto_control_http_t, write_timeout), .dflt = "1.0" },
+
+	{ FR_CONF_OFFSET("max_packet_size", FR_TYPE_UINT32, proto_control_http_t, max_packet_size), .dflt = "4096" } ,
+
+	CONF_PARSER_TERMINATOR
+};
+
+#undef INT
+#define INT size_t
+#define SINT ssize_t
+
+static SINT write_body(void *instance, char const *buffer, INT buffer_size)
+{
+	proto_control_http_thread_t	*thread = talloc_get_type_abort(instance, proto_control_http_thread_t);
+	size_t				len = talloc_array_length(thread->body);
+
+	MEM(thread->body = talloc_realloc(thread, thread->body, char, len + buffer_size));
+	memcpy(thread->body + len, buffer, buffer_size);
+
+	return buffer_size;
+}
+
+/** Tell the network side to close the connection
+ *
+ * Shutting the socket down makes it readable.  mod_read() then sees EOF,
+ * and returns an error, which closes the connection.
+ */
+static void http_finish(proto_control_http_thread_t *thread)
+{
+	thread->done = true;
+	TALLOC_FREE(thread->response);
+
+	(void) shutdown(thread->sockfd, SHUT_RDWR);
+}
+
+/** Write as much of the response as the socket will take
+ *
+ * @return
+ *	- 1 if the whole response has been written.
+ *	- 0 if the socket is full.
+ *	- -1 on error.
+ */
+static int http_write(proto_control_http_response_t *response)
+{
+	size_t		len = talloc_array_length(response->data);
+	ssize_t		rcode;
+
+	while (response->written < len) {
+		rcode = write(response->thread->sockfd, response->data + response->written, len - response->written);
+		if (rcode < 0) {
+			if (errno == EINTR) continue;
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) return 0;
+
+			DEBUG2("proto_control_http - Failed writing response to %s: %s",
+			       response->thread->name, fr_syserror(errno));
+			return -1;
+		}
+
+		response->written += rcode;
+	}
+
+	return 1;
+}
+
+static void http_write_ready(UNUSED fr_event_list_t *el, UNUSED int fd, UNUSED int flags, void *uctx)
+{
+	proto_control_http_response_t	*response = talloc_get_type_abort(uctx, proto_control_http_response_t);
+
+	if (http_write(response) == 0) return;
+
+	http_finish(response->thread);
+}
+
+static void http_write_error(UNUSED fr_event_list_t *el, UNUSED int fd, UNUSED int flags, int fd_errno, void *uctx)
+{
+	proto_control_http_response_t	*response = talloc_get_type_abort(uctx, proto_control_http_response_t);
+
+	DEBUG2("proto_control_http - Failed writing response to %s: %s",
+	       response->thread->name, fr_syserror(fd_errno));
+
+	http_finish(response->thread);
+}
+
+static void http_write_timeout(UNUSED fr_event_list_t *el, UNUSED fr_time_t now, void *uctx)
+{
+	proto_control_http_response_t	*response = talloc_get_type_abort(uctx, proto_control_http_response_t);
+
+	DEBUG2("proto_control_http - Timed out writing response to %s", response->thread->name);
+
+	http_finish(response->thread);
+}
+
+static int _http_response_free(proto_control_http_response_t *response)
+{
+	if (response->fd < 0) return 0;
+
+	(void) fr_event_fd_delete(response->thread->el, response->fd, FR_EVENT_FILTER_IO);
+	close(response->fd);
+
+	return 0;
+}
+
+/** Send a complete HTTP response
+ *
+ * We try to write the whole response immediately.  Scrapers read
+ * responses promptly, and the responses are small, so that almost
+ * always works.  If it doesn't, the rest is written from the event loop.
+ *
+ * @return
+ *	- 1 if the response has been sent, or sending it failed.  The
+ *	  connection should be closed.
+ *	- 0 if the response is still being sent.
+ */
+static int http_respond(proto_control_http_t const *inst, proto_control_http_thread_t *thread,
+			char const *status, char const *content_type, bool head)
+{
+	proto_control_http_response_t	*response;
+	char				header[256];
+	size_t				header_len, body_len = talloc_array_length(thread->body);
+	int				rcode;
+
+	header_len = snprintf(header, sizeof(header),
+			      "HTTP/1.1 %s\r\n"
+			      "Content-Type: %s\r\n"
+			      "Content-Length: %zu\r\n"
+			      "Connection: close\r\n"
+			      "\r\n", status, content_type, body_len);
+
+	if (head) body_len = 0;
+
+	MEM(response = talloc_zero(thread, proto_control_http_response_t));
+	response->thread = thread;
+	response->fd = -1;
+	MEM(response->data = talloc_array(response, uint8_t, header_len + body_len));
+	memcpy(response->data, header, header_len);
+	if (body_len) memcpy(response->data + header_len, thread->body, body_len);
+	TALLOC_FREE(thread->body);
+
+	rcode = http_write(response);
+	if ((rcode != 0) || !thread->el) {
+		talloc_free(response);
+		return 1;
+	}
+
+	/*
+	 *	The network side owns the events for the socket, so
+	 *	we wait for it to become writable via a copy of it.
+	 */
+	response->fd = dup(thread->sockfd);
+	if (response->fd < 0) {
+		DEBUG2("proto_control_http - Failed duplicating socket for %s: %s", thread->name, fr_syserror(errno));
+		talloc_free(response);
+		return 1;
+	}
+	talloc_set_destructor(response, _http_response_free);
+
+	if (fr_event_fd_insert(response, thread->el, response->fd,
+			       NULL, http_write_ready, http_write_error, response) < 0) {
+		PERROR("proto_control_http - Failed inserting write event for %s", thread->name);
+		talloc_free(response);
+		return 1;
+	}
+
+	if (fr_event_timer_in(response, thread->el, &response->ev, inst->write_timeout,
+			      http_write_timeout, response) < 0) {
+		PERROR("proto_control_http - Failed inserting write timeout for %s", thread->name);
+		talloc_free(response);
+		return 1;
+	}
+
+	thread->response = response;
+
+	return 0;
+}
+
+static ssize_t mod_read(fr_listen_t *li, UNUSED void **packet_ctx, UNUSED fr_time_t *recv_time_p, uint8_t *buffer, size_t buffer_len, size_t *leftover, UNUSED uint32_t *priority, UNUSED bool *is_dup)
+{
+	proto_control_http_t const     	*inst = talloc_get_type_abort_const(li->app_io_instance, proto_control_http_t);
+	proto_control_http_thread_t	*thread = talloc_get_type_abort(li->thread_instance, proto_control_http_thread_t);
+	ssize_t				data_size;
+	size_t				in_buffer;
+	char const			*p, *end, *path;
+	bool				head = false;
+
+	/*
+	 *	The headers have to fit into the buffer, and into
+	 *	the configured limit.
+	 */
+	if (buffer_len > inst->max_packet_size) buffer_len = inst->max_packet_size;
+
+	/*
+	 *      Read data into the buffer.
+	 */
+	data_size = read(thread->sockfd, buffer + *leftover, buffer_len - *leftover);
+	if (data_size < 0) {
+		if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) return 0;
+
+		DEBUG2("proto_control_http got read error %zd: %s", data_size, fr_syserror(errno));
+		return data_size;
+	}
+
+	/*
+	 *	TCP read of zero means the socket is dead.
+	 */
+	if (!data_size) {
+		if (!thread->done) DEBUG2("proto_control_http - other side closed the socket.");
+		return -1;
+	}
+
+	/*
+	 *	We only answer one request per connection.  Ignore
+	 *	anything else the client sends.
+	 */
+	if (thread->response || thread->done) return 0;
+
+	in_buffer = data_size + *leftover;
+
+	/*
+	 *	We don't care about anything after the headers, so
+	 *	wait until we've seen all of them.
+	 */
+	end = memmem(buffer, in_buffer, "\r\n\r\n", 4);
+	if (!end) {
+		if (in_buffer >= buffer_len) {
+			DEBUG("proto_control_http - HTTP request headers from %s are too large", thread->name);
+			return -1;
+		}
+
+		*leftover = in_buffer;
+		return 0;
+	}
+	*leftover = 0;
+
+	p = (char const *) buffer;
+	if ((end - p >= 4) && (memcmp(p, "GET ", 4) == 0)) {
+		path = p + 4;
+
+	} else if ((end - p >= 5) && (memcmp(p, "HEAD ", 5) == 0)) {
+		path = p + 5;
+		head = true;
+
+	} else {
+		DEBUG("proto_control_http - Unsupported HTTP method from %s", thread->name);
+		return http_respond(inst, thread, "405 Method Not Allowed", "text/plain", false) ? -1 : 0;
+	}
+
+	/*
+	 *	Ignore any query string.
+	 */
+	if ((end - path >= 8) && (memcmp(path, "/metrics", 8) == 0) &&
+	    ((path[8] == ' ') || (path[8] == '?'))) {
+		cookie_io_functions_t	io = { .write = write_body };
+		FILE			*fp;
+
+		DEBUG2("proto_control_http - Sending metrics to %s", thread->name);
+
+		fp = fopencookie(thread, "w", io);
+		if (!fp) return http_respond(inst, thread, "500 Internal Server Error", "text/plain", head) ? -1 : 0;
+
+		fr_metrics_print(fp);
+		fclose(fp);
+
+		return http_respond(inst, thread, "200 OK",
+				    "application/openmetrics-text; version=1.0.0; charset=utf-8", head) ? -1 : 0;
+	}
+
+	DEBUG("proto_control_http - Unknown path from %s", thread->name);
+
+	/*
+	 *	Once we've sent the response, tell the network side
+	 *	to close the connection.
+	 */
+	return http_respond(inst, thread, "404 Not Found", "text/plain", head) ? -1 : 0;
+}
+
+static ssize_t mod_write(UNUSED fr_listen_t *li, UNUSED void *packet_ctx, UNUSED fr_time_t request_time,
+			 UNUSED uint8_t *buffer, size_t buffer_len, UNUSED size_t written)
+{
+	/*
+	 *	We never send packets to the workers, so there are
+	 *	never any replies.
+	 */
+	return buffer_len;
+}
+
+static void mod_event_list_set(fr_listen_t *li, fr_event_list_t *el, UNUSED void *nr)
+{
+	proto_control_http_thread_t	*thread = talloc_get_type_abort(li->thread_instance, proto_control_http_thread_t);
+
+	thread->el = el;
+}
+
+static int mod_connection_set(fr_listen_t *li, fr_io_address_t *connection)
+{
+	proto_control_http_thread_t	*thread = talloc_get_type_abort(li->thread_instance, proto_control_http_thread_t);
+
+	thread->connection = connection;
+
+	return 0;
+}
+
+static void mod_network_get(UNUSED void *instance, int *ipproto, bool *dynamic_clients, fr_trie_t const **trie)
+{
+	*ipproto = IPPROTO_TCP;
+	*dynamic_clients = false;
+	*trie = NULL;
+}
+
+/** Open a TCP listener for HTTP
+ *
+ */
+static int mod_open(fr_listen_t *li)
+{
+	proto_control_http_t const     	*inst = talloc_get_type_abort_const(li->app_io_instance, proto_control_http_t);
+	proto_control_http_thread_t	*thread = talloc_get_type_abort(li->thread_instance, proto_control_http_thread_t);
+
+	int				sockfd;
+	uint16_t			port = inst->port;
+	CONF_ITEM			*ci;
+	CONF_SECTION			*server_cs;
+
+	fr_assert(!thread->connection);
+
+	li->fd = sockfd = fr_socket_server_tcp(&inst->ipaddr, &port, NULL, true);
+	if (sockfd < 0) {
+		PERROR("Failed opening TCP socket");
+	error:
+		return -1;
+	}
+
+	if (fr_socket_bind(sockfd, &inst->ipaddr, &port, inst->interface) < 0) {
+		close(sockfd);
+		PERROR("Failed binding socket");
+		goto error;
+	}
+
+	if (listen(sockfd, 8) < 0) {
+		close(sockfd);
+		PERROR("Failed listening on socket");
+		goto error;
+	}
+
+	thread->sockfd = sockfd;
+
+	ci = cf_parent(inst->cs); /* listen { ... } */
+	fr_assert(ci != NULL);
+	ci = cf_parent(ci);
+	fr_assert(ci != NULL);
+
+	server_cs = cf_item_to_section(ci);
+
+	thread->name = fr_app_io_socket_name(thread, &proto_control_http,
+					     NULL, 0,
+					     &inst->ipaddr, inst->port,
+					     inst->interface);
+
+	/*
+	 *	Set up the fake client
+	 */
+	thread->radclient.longname = thread->name;
+	thread->radclient.ipaddr = inst->ipaddr;
+	thread->radclient.src_ipaddr = inst->ipaddr;
+
+	thread->radclient.server_cs = server_cs;
+	fr_assert(thread->radclient.server_cs != NULL);
+	thread->radclient.server = cf_section_name2(thread->radclient.server_cs);
+
+	return 0;
+}
+
+/** Set the file descriptor for this socket.
+ *
+ */
+static int mod_fd_set(fr_listen_t *li, int fd)
+{
+	proto_control_http_t const  *inst = talloc_get_type_abort_const(li->app_io_instance, proto_control_http_t);
+	proto_control_http_thread_t *thread = talloc_get_type_abort(li->thread_instance, proto_control_http_thread_t);
+
+	thread->sockfd = fd;
+
+	thread->name = fr_app_io_socket_name(thread, &proto_control_http,
+					     &thread->connection->socket.inet.src_ipaddr, thread->connection->socket.inet.src_port,
+					     &inst->ipaddr, inst->port,
+					     inst->interface);
+
+	return 0;
+}
+
+static char const *mod_name(fr_listen_t *li)
+{
+	proto_control_http_thread_t	*thread = talloc_get_type_abort(li->thread_instance, proto_control_http_thread_t);
+
+	return thread->name;
+}
+
+static int mod_bootstrap(module_inst_ctx_t const *mctx)
+{
+	proto_control_http_t	*inst = talloc_get_type_abort(mctx->inst->data, proto_control_http_t);
+	CONF_SECTION		*conf = mctx->inst->conf;
+
+	inst->cs = conf;
+
+	if (!inst->port) {
+		cf_log_err(conf, "No 'port' was specified in the 'http' section");
+		return -1;
+	}
+
+	FR_TIME_DELTA_BOUND_CHECK("write_timeout", inst->write_timeout, >=, fr_time_delta_from_msec(10));
+	FR_TIME_DELTA_BOUND_CHECK("write_timeout", inst->write_timeout, <=, fr_time_delta_from_sec(10));
+
+	FR_INTEGER_BOUND_CHECK("max_packet_size", inst->max_packet_size, >=, 1024);
+	FR_INTEGER_BOUND_CHECK("max_packet_size", inst->max_packet_size, <=, 65536);
+
+	/*
+	 *	No "allow" means anyone who can reach the socket can
+	 *	read the metrics.
+	 */
+	if (talloc_array_length(inst->allow) > 0) {
+		inst->trie = fr_master_io_network(inst, inst->ipaddr.af, inst->allow, inst->deny);
+		if (!inst->trie) {
+			cf_log_perr(conf, "Failed creating list of networks");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static RADCLIENT *mod_client_find(fr_listen_t *li, fr_ipaddr_t const *ipaddr, UNUSED int ipproto)
+{
+	proto_control_http_t const	*inst = talloc_get_type_abort_const(li->app_io_instance, proto_control_http_t);
+	proto_control_http_thread_t    	*thread = talloc_get_type_abort(li->thread_instance, proto_control_http_thread_t);
+
+	if (inst->trie) {
+		fr_ipaddr_t const *network;
+
+		network = fr_trie_lookup_by_key(inst->trie, &ipaddr->addr, ipaddr->prefix);
+		if (!network || (network->af == AF_UNSPEC)) return NULL;
+	}
+
+	return &thread->radclient;
+}
+
+fr_app_io_t proto_control_http = {
+	.common = {
+		.magic			= MODULE_MAGIC_INIT,
+		.name			= "control_http",
+		.config			= http_listen_config,
+		.inst_size		= sizeof(proto_control_http_t),
+		.thread_inst_size	= sizeof(proto_control_http_thread_t),
+		.bootstrap		= mod_bootstrap,
+	},
+	.default_message_size	= 4096,
+
+	.open			= mod_open,
+	.read			= mod_read,
+	.write			= mod_write,
+	.fd_set			= mod_fd_set,
+	.event_list_set		= mod_event_list_set,
+	.connection_set		= mod_connection_set,
+	.network_get		= mod_network_get,
+	.client_find		= mod_client_find,
+	.get_name      		= mod_name,
+};
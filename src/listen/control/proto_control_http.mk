@@ -0,0 +1,9 @@
+TARGETNAME	:= proto_control_http
+
+ifneq "$(TARGETNAME)" ""
+TARGET		:= $(TARGETNAME)$(L)
+endif
+
+SOURCES		:= proto_control_http.c
+
+TGT_PREREQS	:= libfreeradius-control$(L)
@@ -951,6 +951,13 @@ static int mod_open(fr_listen_t *li)
 
 	fr_assert(!thread->connection);
 
+	/*
+	 *	Use the socket from the previous instance of the
+	 *	server if there is one.
+	 */
+	sockfd = fr_socket_inherit_unix(inst->filename);
+	if (sockfd >= 0) goto done;
+
 	if (inst->peercred) {
 		sockfd = fr_server_domain_socket_peercred(inst->filename, inst->uid, inst->gid);
 	} else {
@@ -967,6 +974,7 @@ static int mod_open(fr_listen_t *li)
 		return -1;
 	}
 
+done:
 	li->fd = thread->sockfd = sockfd;
 
 	ci = cf_parent(inst->cs); /* listen { ... } */
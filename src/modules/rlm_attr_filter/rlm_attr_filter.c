@@ -27,6 +27,7 @@ RCSID("$Id$")
 #define LOG_PREFIX mctx->inst->name
 
 #include <freeradius-devel/server/base.h>
+#include <freeradius-devel/server/file_reload.h>
 #include <freeradius-devel/server/module_rlm.h>
 #include <freeradius-devel/util/debug.h>
 #include <freeradius-devel/server/users_file.h>
@@ -44,13 +45,69 @@ typedef struct {
 	char const	*filename;
 	tmpl_t		*key;
 	bool		relaxed;
-	PAIR_LIST_LIST	attrs;
+	bool		reload_on_change;
+
+	dl_module_inst_t const	*dl_inst;	//!< For log messages when reloading.
+	fr_file_reload_t	*reload;	//!< Holds the current attr_filter_t.
 } rlm_attr_filter_t;
 
+/** A filter rule, with its value cast, or its regex compiled, at load time
+ *
+ */
+typedef struct {
+	fr_token_t		op;		//!< Comparison operator.
+	fr_value_box_t		value;		//!< Cast to the type of the attribute, or the regex.
+#ifdef HAVE_REGEX
+	regex_t			*preg;		//!< Pre-compiled regex, for =~ and !~.
+#endif
+} attr_filter_rule_t;
+
+/** The rules for one attribute in an entry
+ *
+ */
+typedef struct {
+	fr_dict_attr_t const	*da;		//!< The rules apply to.
+	attr_filter_rule_t	**rules;	//!< Array of rules.
+	fr_rb_node_t		node;		//!< Entry in the tree of attributes.
+} attr_filter_attr_t;
+
+/** A compiled entry from the filter file
+ *
+ */
+typedef struct {
+	PAIR_LIST const		*pl;		//!< The entry was compiled from.
+	bool			dynamic;	//!< Some values must be expanded per request,
+						///< so the entry can't be compiled.
+	bool			fall_through;	//!< Fall-Through = yes.
+	int			relax;		//!< Value of Relax-Filter, or -1 if not set.
+	unsigned int		vsa_any;	//!< Number of Vendor-Specific =* rules.
+	fr_rb_tree_t		*attrs;		//!< attr_filter_attr_t by da.
+	fr_pair_list_t		set;		//!< := pairs, copied to the output.
+} attr_filter_entry_t;
+
+/** The entries which apply to a key
+ *
+ */
+typedef struct {
+	char const		*name;		//!< Key.
+	attr_filter_entry_t	**entries;	//!< Matching entries and DEFAULT entries, in file order.
+	fr_rb_node_t		node;		//!< Entry in the tree of keys.
+} attr_filter_key_t;
+
+/** A compiled filter file
+ *
+ */
+typedef struct {
+	PAIR_LIST_LIST		*attrs;		//!< As read from the file.
+	fr_rb_tree_t		*keys;		//!< attr_filter_key_t by name.
+	attr_filter_entry_t	**defaults;	//!< DEFAULT entries, for keys with no entries of their own.
+} attr_filter_t;
+
 static const CONF_PARSER module_config[] = {
 	{ FR_CONF_OFFSET("filename", FR_TYPE_FILE_INPUT | FR_TYPE_REQUIRED, rlm_attr_filter_t, filename) },
 	{ FR_CONF_OFFSET("key", FR_TYPE_TMPL, rlm_attr_filter_t, key), .dflt = "&Realm", .quote = T_BARE_WORD },
 	{ FR_CONF_OFFSET("relaxed", FR_TYPE_BOOL, rlm_attr_filter_t, relaxed), .dflt = "no" },
+	{ FR_CONF_OFFSET("reload", FR_TYPE_BOOL, rlm_attr_filter_t, reload_on_change), .dflt = "no" },
 	CONF_PARSER_TERMINATOR
 };
 
@@ -100,6 +157,287 @@ static void check_pair(request_t *request, fr_pair_t *check_item, fr_pair_t *rep
 	return;
 }
 
+/** Compare an attribute with a compiled rule
+ *
+ * Gives the same results as fr_pair_cmp() with a check pair, without
+ * building the check pair, or compiling the regex, for each comparison.
+ */
+static void check_rule(request_t *request, fr_dict_attr_t const *da, attr_filter_rule_t const *rule,
+		       fr_pair_t *reply_item, int *pass, int *fail)
+{
+	int compare;
+
+	switch (rule->op) {
+	case T_OP_CMP_TRUE:
+		compare = 1;
+		break;
+
+	case T_OP_CMP_FALSE:
+		compare = 0;
+		break;
+
+#ifdef HAVE_REGEX
+	case T_OP_REG_EQ:
+	case T_OP_REG_NE:
+	{
+		char *value;
+
+		fr_pair_aprint(NULL, &value, NULL, reply_item);
+		if (!value) {
+			compare = -1;
+			break;
+		}
+
+		compare = regex_exec(rule->preg, value, talloc_array_length(value) - 1, NULL);
+		talloc_free(value);
+
+		if ((compare >= 0) && (rule->op == T_OP_REG_NE)) compare = !compare;
+	}
+		break;
+#endif
+
+	default:
+		compare = fr_value_box_cmp_op(rule->op, &reply_item->data, &rule->value);
+		break;
+	}
+	if (compare < 0) RPEDEBUG("Comparison failed");
+
+	if (compare == 1) {
+		++*(pass);
+	} else {
+		++*(fail);
+	}
+
+	RDEBUG3("%pP %s %s %s %pV", reply_item, compare == 1 ? "allowed by" : "disallowed by",
+		da->name, fr_tokens[rule->op], &rule->value);
+}
+
+static int8_t attr_filter_attr_cmp(void const *one, void const *two)
+{
+	attr_filter_attr_t const *a = one, *b = two;
+
+	return CMP(a->da, b->da);
+}
+
+static int8_t attr_filter_key_cmp(void const *one, void const *two)
+{
+	attr_filter_key_t const *a = one, *b = two;
+
+	return CMP(strcmp(a->name, b->name), 0);
+}
+
+/** Compile a rule for an entry
+ *
+ * @return
+ *	- 0 on success, or if the rule should be skipped.
+ *	- -1 if the entry can't be compiled.
+ */
+static int attr_filter_compile_rule(module_inst_ctx_t const *mctx, attr_filter_entry_t *entry, map_t const *map)
+{
+	fr_dict_attr_t const	*da = tmpl_attr_tail_da(map->lhs);
+	attr_filter_attr_t	*attr;
+	attr_filter_rule_t	*rule;
+	size_t			num;
+
+	/*
+	 *	Pairs which are added to the output unchecked.
+	 */
+	if (map->op == T_OP_SET) {
+		fr_pair_t *vp;
+
+		MEM(vp = fr_pair_afrom_da(entry, da));
+		if (fr_value_box_cast(vp, &vp->data, da->type, da, tmpl_value(map->rhs)) < 0) {
+			PWARN("%s[%d] Failed parsing %s, skipping it", entry->pl->filename, entry->pl->lineno, da->name);
+			talloc_free(vp);
+			return 0;
+		}
+		vp->op = map->op;
+		fr_pair_append(&entry->set, vp);
+		return 0;
+	}
+
+	attr = fr_rb_find(entry->attrs, &(attr_filter_attr_t){ .da = da });
+	if (!attr) {
+		MEM(attr = talloc_zero(entry->attrs, attr_filter_attr_t));
+		attr->da = da;
+		MEM(attr->rules = talloc_array(attr, attr_filter_rule_t *, 0));
+		fr_rb_insert(entry->attrs, attr);
+	}
+
+	MEM(rule = talloc_zero(attr, attr_filter_rule_t));
+	rule->op = map->op;
+
+	switch (map->op) {
+	case T_OP_CMP_TRUE:
+		if (da == attr_vendor_specific) entry->vsa_any++;
+		FALL_THROUGH;
+
+	case T_OP_CMP_FALSE:
+		fr_value_box_init_null(&rule->value);
+		break;
+
+	case T_OP_REG_EQ:
+	case T_OP_REG_NE:
+#ifndef HAVE_REGEX
+		ERROR("%s[%d] Regular expressions are not supported", entry->pl->filename, entry->pl->lineno);
+		talloc_free(rule);
+		return -1;
+#else
+	{
+		ssize_t slen;
+
+		if (fr_value_box_cast(rule, &rule->value, FR_TYPE_STRING, NULL, tmpl_value(map->rhs)) < 0) {
+			PERROR("%s[%d] Failed parsing regex for %s", entry->pl->filename, entry->pl->lineno, da->name);
+			talloc_free(rule);
+			return -1;
+		}
+
+		slen = regex_compile(rule, &rule->preg, rule->value.vb_strvalue, rule->value.vb_length,
+				     NULL, false, false);
+		if (slen <= 0) {
+			PERROR("%s[%d] Error at offset %zu compiling regex for %s", entry->pl->filename,
+			       entry->pl->lineno, -slen, da->name);
+			talloc_free(rule);
+			return -1;
+		}
+	}
+		break;
+#endif
+
+	default:
+		if (fr_value_box_cast(rule, &rule->value, da->type, da, tmpl_value(map->rhs)) < 0) {
+			PWARN("%s[%d] Failed parsing %s, skipping it", entry->pl->filename, entry->pl->lineno, da->name);
+			talloc_free(rule);
+			return 0;
+		}
+		break;
+	}
+
+	num = talloc_array_length(attr->rules);
+	MEM(attr->rules = talloc_realloc(attr, attr->rules, attr_filter_rule_t *, num + 1));
+	attr->rules[num] = rule;
+
+	return 0;
+}
+
+/** Compile an entry from the filter file
+ *
+ */
+static attr_filter_entry_t *attr_filter_compile_entry(TALLOC_CTX *ctx, module_inst_ctx_t const *mctx, PAIR_LIST const *pl)
+{
+	attr_filter_entry_t	*entry;
+	map_t			*map = NULL;
+
+	MEM(entry = talloc_zero(ctx, attr_filter_entry_t));
+	entry->pl = pl;
+	entry->relax = -1;
+	fr_pair_list_init(&entry->set);
+	MEM(entry->attrs = fr_rb_inline_talloc_alloc(entry, attr_filter_attr_t, node, attr_filter_attr_cmp, NULL));
+
+	/*
+	 *	Values which have to be expanded for each request
+	 *	are handled by the slow path.
+	 */
+	while ((map = map_list_next(&pl->reply, map))) {
+		if (!tmpl_is_data(map->rhs)) {
+			entry->dynamic = true;
+			return entry;
+		}
+	}
+
+	while ((map = map_list_next(&pl->reply, map))) {
+		fr_dict_attr_t const *da = tmpl_attr_tail_da(map->lhs);
+
+		if (da == attr_fall_through) {
+			fr_value_box_t fall_through;
+
+			if ((fr_value_box_cast(NULL, &fall_through, FR_TYPE_BOOL, NULL, tmpl_value(map->rhs)) == 0) &&
+			    fall_through.vb_bool) {
+				entry->fall_through = true;
+				continue;
+			}
+
+		} else if (da == attr_relax_filter) {
+			fr_value_box_t relax;
+
+			if (fr_value_box_cast(NULL, &relax, FR_TYPE_BOOL, NULL, tmpl_value(map->rhs)) == 0) {
+				entry->relax = relax.vb_bool;
+			}
+		}
+
+		if (attr_filter_compile_rule(mctx, entry, map) < 0) {
+			talloc_free(entry);
+			return NULL;
+		}
+	}
+
+	return entry;
+}
+
+/** Add an entry to the list of entries for a key
+ *
+ */
+static void attr_filter_entries_add(attr_filter_entry_t ***entries, attr_filter_entry_t *entry)
+{
+	size_t num = talloc_array_length(*entries);
+
+	MEM(*entries = talloc_realloc(NULL, *entries, attr_filter_entry_t *, num + 1));
+	(*entries)[num] = entry;
+}
+
+/** Build the per-key lists of entries
+ *
+ * Each key's list contains the entries with its name, and the DEFAULT
+ * entries, in file order.  So finding the entries which apply to a
+ * request is a single lookup.
+ */
+static attr_filter_t *attr_filter_compile(module_inst_ctx_t const *mctx, PAIR_LIST_LIST *attrs)
+{
+	attr_filter_t		*filter;
+	PAIR_LIST		*pl = NULL;
+
+	MEM(filter = talloc_zero(NULL, attr_filter_t));
+	talloc_steal(filter, attrs);
+	filter->attrs = attrs;
+	MEM(filter->keys = fr_rb_inline_talloc_alloc(filter, attr_filter_key_t, node, attr_filter_key_cmp, NULL));
+	MEM(filter->defaults = talloc_array(filter, attr_filter_entry_t *, 0));
+
+	while ((pl = fr_dlist_next(&attrs->head, pl))) {
+		attr_filter_entry_t	*entry;
+		attr_filter_key_t	*key;
+		fr_rb_iter_inorder_t	iter;
+
+		entry = attr_filter_compile_entry(filter, mctx, pl);
+		if (!entry) {
+			talloc_free(filter);
+			return NULL;
+		}
+
+		if (strcmp(pl->name, "DEFAULT") == 0) {
+			attr_filter_entries_add(&filter->defaults, entry);
+
+			for (key = fr_rb_iter_init_inorder(&iter, filter->keys);
+			     key;
+			     key = fr_rb_iter_next_inorder(&iter)) {
+				attr_filter_entries_add(&key->entries, entry);
+			}
+			continue;
+		}
+
+		key = fr_rb_find(filter->keys, &(attr_filter_key_t){ .name = pl->name });
+		if (!key) {
+			MEM(key = talloc_zero(filter->keys, attr_filter_key_t));
+			key->name = pl->name;
+			MEM(key->entries = talloc_array(key, attr_filter_entry_t *, talloc_array_length(filter->defaults)));
+			memcpy(key->entries, filter->defaults, talloc_array_length(filter->defaults) * sizeof(entry));
+			fr_rb_insert(filter->keys, key);
+		}
+		attr_filter_entries_add(&key->entries, entry);
+	}
+
+	return filter;
+}
+
 static int attr_filter_getfile(TALLOC_CTX *ctx, module_inst_ctx_t const *mctx, char const *filename, PAIR_LIST_LIST *pair_list)
 {
 	int rcode;
@@ -160,24 +498,224 @@ static int attr_filter_getfile(TALLOC_CTX *ctx, module_inst_ctx_t const *mctx, c
 }
 
 /*
- *	(Re-)read the "attrs" file into memory.
+ *	(Re-)read the "attrs" file into memory, and compile it.
  */
-static int mod_instantiate(module_inst_ctx_t const *mctx)
+static void *attr_filter_build(void *uctx)
 {
-	rlm_attr_filter_t *inst = talloc_get_type_abort(mctx->inst->data, rlm_attr_filter_t);
+	rlm_attr_filter_t const *inst = talloc_get_type_abort_const(uctx, rlm_attr_filter_t);
+	module_inst_ctx_t const *mctx = MODULE_INST_CTX(inst->dl_inst);
+	PAIR_LIST_LIST *attrs;
+	attr_filter_t *filter;
 	int rcode;
-	pairlist_list_init(&inst->attrs);
 
-	rcode = attr_filter_getfile(inst, mctx, inst->filename, &inst->attrs);
+	MEM(attrs = talloc_zero(NULL, PAIR_LIST_LIST));
+	pairlist_list_init(attrs);
+
+	rcode = attr_filter_getfile(attrs, mctx, inst->filename, attrs);
+	if ((rcode == 0) && inst->reload) rcode = pairlist_check_reload(attrs);	/* Not the initial load */
 	if (rcode != 0) {
+	error:
 		ERROR("Errors reading %s", inst->filename);
+		talloc_free(attrs);
+		return NULL;
+	}
+
+	filter = attr_filter_compile(mctx, attrs);
+	if (!filter) goto error;
+
+	return filter;
+}
+
+static int mod_instantiate(module_inst_ctx_t const *mctx)
+{
+	rlm_attr_filter_t *inst = talloc_get_type_abort(mctx->inst->data, rlm_attr_filter_t);
+	attr_filter_t *filter;
+
+	inst->dl_inst = mctx->inst;
+
+	filter = attr_filter_build(inst);
+	if (!filter) return -1;
 
+	inst->reload = fr_file_reload_alloc(inst, mctx->inst->name, filter, attr_filter_build, inst);
+	if (inst->reload_on_change && (fr_file_reload_watch(inst->reload, inst->filename) < 0)) {
+		cf_log_perr(mctx->inst->conf, "Failed watching %s", inst->filename);
 		return -1;
 	}
 
 	return 0;
 }
 
+/** Move an input attribute to the output list if the rules allow it
+ *
+ * @return the attribute the caller should continue iterating from.
+ */
+static fr_pair_t *attr_filter_move(request_t *request, fr_pair_list_t *list, fr_pair_list_t *output,
+				   fr_pair_t *input_item, int pass, int fail, bool relax_filter)
+{
+	fr_pair_t *prev;
+
+	RDEBUG3("Attribute \"%s\" allowed by %i rules, disallowed by %i rules",
+		input_item->da->name, pass, fail);
+
+	/*
+	 *  Only move attribute if it passed all rules, or if the config says we
+	 *  should copy unmatched attributes ('relaxed' mode).
+	 */
+	if ((fail != 0) || (!pass && !relax_filter)) return input_item;
+
+	if (!pass) {
+		RDEBUG3("Attribute \"%s\" allowed by relaxed mode", input_item->da->name);
+	}
+
+	prev = fr_pair_list_prev(list, input_item);
+	fr_pair_remove(list, input_item);
+	fr_pair_append(output, input_item);
+
+	return prev;	/* Set input_item to previous in the list for outer loop */
+}
+
+/** Apply an entry whose values must be expanded for each request
+ *
+ * @return true if the entry has Fall-Through = yes.
+ */
+static bool attr_filter_apply_dynamic(request_t *request, fr_radius_packet_t *packet,
+				      fr_pair_list_t *list, fr_pair_list_t *output,
+				      PAIR_LIST const *pl, bool relaxed)
+{
+	bool		fall_through = false;
+	int		relax_filter = relaxed;
+	int		pass, fail;
+	map_t		*map = NULL;
+	fr_pair_list_t	tmp_list;
+	fr_pair_t	*check_item, *input_item;
+	fr_pair_list_t	check_list;
+
+	fr_pair_list_init(&tmp_list);
+	fr_pair_list_init(&check_list);
+
+	while ((map = map_list_next(&pl->reply, map))) {
+		if (map_to_vp(packet, &tmp_list, request, map, NULL) < 0) {
+			RPWARN("Failed parsing map %s for check item, skipping it", map->lhs->name);
+			continue;
+		}
+
+		check_item = fr_pair_list_head(&tmp_list);
+		if (check_item->da == attr_fall_through) {
+			if (check_item->vp_uint32 == 1) {
+				fall_through = true;
+				fr_pair_list_free(&tmp_list);
+				continue;
+			}
+		} else if (check_item->da == attr_relax_filter) {
+			relax_filter = check_item->vp_uint32;
+		}
+
+		/*
+		 *	Remove pair from temporary list ready to
+		 *	add to the correct destination
+		 */
+		fr_pair_remove(&tmp_list, check_item);
+
+		/*
+		 *    If it is a SET operator, add the attribute to
+		 *    the output list without checking it.
+		 */
+		if (check_item->op == T_OP_SET ) {
+			fr_pair_append(output, check_item);
+			continue;
+		}
+
+		/*
+		 *	Append the realized VP to the check list.
+		 */
+		fr_pair_append(&check_list, check_item);
+	}
+
+	/*
+	 *	Iterate through the input items, comparing
+	 *	each item to every rule, then moving it to the
+	 *	output list only if it matches all rules
+	 *	for that attribute.  IE, Idle-Timeout is moved
+	 *	only if it matches all rules that describe an
+	 *	Idle-Timeout.
+	 */
+	for (input_item = fr_pair_list_head(list);
+	     input_item;
+	     input_item = fr_pair_list_next(list, input_item)) {
+		pass = fail = 0; /* reset the pass,fail vars for each reply item */
+
+		/*
+		 *  Reset the check_item pointer to beginning of the list
+		 */
+		for (check_item = fr_pair_list_head(&check_list);
+		     check_item;
+		     check_item = fr_pair_list_next(&check_list, check_item)) {
+			/*
+			 *  Vendor-Specific is special, and matches any VSA if the
+			 *  comparison is always true.
+			 */
+			if ((check_item->da == attr_vendor_specific) &&
+			    (fr_dict_vendor_num_by_da(input_item->da) != 0) &&
+			    (check_item->op == T_OP_CMP_TRUE)) {
+				pass++;
+				continue;
+			}
+
+			if (input_item->da == check_item->da) {
+				check_pair(request, check_item, input_item, &pass, &fail);
+			}
+		}
+
+		input_item = attr_filter_move(request, list, output, input_item, pass, fail, relax_filter);
+	}
+
+	fr_pair_list_free(&check_list);
+
+	return fall_through;
+}
+
+/** Apply a compiled entry
+ *
+ * Each input attribute is checked against only the rules for its
+ * attribute, found with a single lookup.
+ *
+ * @return true if the entry has Fall-Through = yes.
+ */
+static bool attr_filter_apply(request_t *request, fr_radius_packet_t *packet,
+			      fr_pair_list_t *list, fr_pair_list_t *output,
+			      attr_filter_entry_t const *entry, bool relaxed)
+{
+	bool		relax_filter = (entry->relax < 0) ? relaxed : entry->relax;
+	fr_pair_t	*input_item;
+
+	if (fr_pair_list_copy(packet, output, &entry->set) < 0) {
+		RPWARN("Failed copying attributes for entry %s", entry->pl->name);
+	}
+
+	for (input_item = fr_pair_list_head(list);
+	     input_item;
+	     input_item = fr_pair_list_next(list, input_item)) {
+		attr_filter_attr_t const	*attr;
+		int				pass = 0, fail = 0;
+
+		/*
+		 *  Vendor-Specific is special, and matches any VSA if the
+		 *  comparison is always true.
+		 */
+		if (entry->vsa_any && (fr_dict_vendor_num_by_da(input_item->da) != 0)) pass += entry->vsa_any;
+
+		attr = fr_rb_find(entry->attrs, &(attr_filter_attr_t){ .da = input_item->da });
+		if (attr) {
+			size_t i, num = talloc_array_length(attr->rules);
+
+			for (i = 0; i < num; i++) check_rule(request, attr->da, attr->rules[i], input_item, &pass, &fail);
+		}
+
+		input_item = attr_filter_move(request, list, output, input_item, pass, fail, relax_filter);
+	}
+
+	return entry->fall_through;
+}
 
 /*
  *	Common attr_filter checks
@@ -187,13 +725,14 @@ static unlang_action_t CC_HINT(nonnull(1,2)) attr_filter_common(rlm_rcode_t *p_r
 								fr_radius_packet_t *packet, fr_pair_list_t *list)
 {
 	rlm_attr_filter_t const *inst = talloc_get_type_abort_const(mctx->inst->data, rlm_attr_filter_t);
-	fr_pair_list_t	output;
-	PAIR_LIST	*pl = NULL;
-	int		found = 0;
-	int		pass, fail = 0;
-	char const	*keyname = NULL;
-	char		buffer[256];
-	ssize_t		slen;
+	fr_pair_list_t		output;
+	attr_filter_t const	*filter;
+	attr_filter_key_t const	*key;
+	attr_filter_entry_t	**entries;
+	size_t			i, num;
+	char const		*keyname = NULL;
+	char			buffer[256];
+	ssize_t			slen;
 
 	if (!packet) {
 		RETURN_MODULE_NOOP;
@@ -214,137 +753,37 @@ static unlang_action_t CC_HINT(nonnull(1,2)) attr_filter_common(rlm_rcode_t *p_r
 	fr_pair_list_init(&output);
 
 	/*
-	 *      Find the attr_filter profile entry for the entry.
+	 *      Find the attr_filter profile entries for the key.
 	 */
-	while ((pl = fr_dlist_next(&inst->attrs.head, pl))) {
-		int fall_through = 0;
-		int relax_filter = inst->relaxed;
-		map_t *map = NULL;
-		fr_pair_list_t tmp_list;
-		fr_pair_t *check_item, *input_item;
-		fr_pair_list_t check_list;
-
-		fr_pair_list_init(&tmp_list);
-		/*
-		 *  If the current entry is NOT a default,
-		 *  AND the realm does NOT match the current entry,
-		 *  then skip to the next entry.
-		 */
-		if ((strcmp(pl->name, "DEFAULT") != 0) &&
-		    (strcmp(keyname, pl->name) != 0))  {
-			continue;
-		}
-
-		RDEBUG2("Matched entry %s at line %d", pl->name, pl->lineno);
-		found = 1;
-
-		fr_pair_list_init(&check_list);
-
-		while ((map = map_list_next(&pl->reply, map))) {
-			if (map_to_vp(packet, &tmp_list, request, map, NULL) < 0) {
-				RPWARN("Failed parsing map %s for check item, skipping it", map->lhs->name);
-				continue;
-			}
-
-			check_item = fr_pair_list_head(&tmp_list);
-		     	if (check_item->da == attr_fall_through) {
-				if (check_item->vp_uint32 == 1) {
-					fall_through = 1;
-					fr_pair_list_free(&tmp_list);
-					continue;
-				}
-		     	} else if (check_item->da == attr_relax_filter) {
-				relax_filter = check_item->vp_uint32;
-		     	}
-
-			/*
-			 *	Remove pair from temporary list ready to
-			 *	add to the correct destination
-			 */
-			fr_pair_remove(&tmp_list, check_item);
+	filter = fr_file_reload_acquire(inst->reload);
+	key = fr_rb_find(filter->keys, &(attr_filter_key_t){ .name = keyname });
+	entries = key ? key->entries : filter->defaults;
 
-			/*
-			 *    If it is a SET operator, add the attribute to
-			 *    the output list without checking it.
-			 */
-			if (check_item->op == T_OP_SET ) {
-				fr_pair_append(&output, check_item);
-				continue;
-			}
+	/*
+	 *	No entry matched.  We didn't do anything.
+	 */
+	num = talloc_array_length(entries);
+	if (num == 0) {
+		fr_file_reload_release();
+		RETURN_MODULE_NOOP;
+	}
 
-			/*
-			 *	Append the realized VP to the check list.
-			 */
-			fr_pair_append(&check_list, check_item);
-		}
+	for (i = 0; i < num; i++) {
+		attr_filter_entry_t const *entry = entries[i];
+		bool fall_through;
 
-		/*
-		 *	Iterate through the input items, comparing
-		 *	each item to every rule, then moving it to the
-		 *	output list only if it matches all rules
-		 *	for that attribute.  IE, Idle-Timeout is moved
-		 *	only if it matches all rules that describe an
-		 *	Idle-Timeout.
-		 */
-		for (input_item = fr_pair_list_head(list);
-		     input_item;
-		     input_item = fr_pair_list_next(list, input_item)) {
-			pass = fail = 0; /* reset the pass,fail vars for each reply item */
+		RDEBUG2("Matched entry %s at line %d", entry->pl->name, entry->pl->lineno);
 
-			/*
-			 *  Reset the check_item pointer to beginning of the list
-			 */
-			for (check_item = fr_pair_list_head(&check_list);
-			     check_item;
-			     check_item = fr_pair_list_next(&check_list, check_item)) {
-				/*
-				 *  Vendor-Specific is special, and matches any VSA if the
-				 *  comparison is always true.
-				 */
-				if ((check_item->da == attr_vendor_specific) &&
-				    (fr_dict_vendor_num_by_da(input_item->da) != 0) &&
-				    (check_item->op == T_OP_CMP_TRUE)) {
-					pass++;
-					continue;
-				}
-
-				if (input_item->da == check_item->da) {
-					check_pair(request, check_item, input_item, &pass, &fail);
-				}
-			}
-
-			RDEBUG3("Attribute \"%s\" allowed by %i rules, disallowed by %i rules",
-				input_item->da->name, pass, fail);
-			/*
-			 *  Only move attribute if it passed all rules, or if the config says we
-			 *  should copy unmatched attributes ('relaxed' mode).
-			 */
-			if (fail == 0 && (pass > 0 || relax_filter)) {
-				fr_pair_t *prev = fr_pair_list_prev(list, input_item);
-
-				if (!pass) {
-					RDEBUG3("Attribute \"%s\" allowed by relaxed mode", input_item->da->name);
-				}
-				fr_pair_remove(list, input_item);
-				fr_assert(input_item != NULL);
-				fr_pair_append(&output, input_item);
-				input_item = prev; /* Set input_item to previous in the list for outer loop */
-			}
+		if (entry->dynamic) {
+			fall_through = attr_filter_apply_dynamic(request, packet, list, &output, entry->pl, inst->relaxed);
+		} else {
+			fall_through = attr_filter_apply(request, packet, list, &output, entry, inst->relaxed);
 		}
 
 		/* If we shouldn't fall through, break */
-		if (!fall_through) {
-			break;
-		}
-	}
-
-	/*
-	 *	No entry matched.  We didn't do anything.
-	 */
-	if (!found) {
-		fr_assert(fr_pair_list_empty(&output));
-		RETURN_MODULE_NOOP;
+		if (!fall_through) break;
 	}
+	fr_file_reload_release();
 
 	/*
 	 *	Replace the existing request list with our filtered one
@@ -0,0 +1,672 @@
+/*
+ *   This program is is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or (at
+ *   your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ * @file rlm_cache_sharded.c
+ * @brief Sharded in-memory cache.
+ *
+ * Entries are distributed over a power of two number of shards by the hash
+ * of their key.  Each shard has its own mutex, an open addressing index,
+ * a timer wheel for expiry, and a CLOCK hand for evicting entries when the
+ * shard exceeds its share of max_entries or max_size.
+ *
+ * Unlike rlm_cache_rbtree, requests only contend with other requests whose
+ * keys hash to the same shard.
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+#include <stdalign.h>
+
+#include <freeradius-devel/server/base.h>
+#include <freeradius-devel/util/debug.h>
+#include <freeradius-devel/util/dlist.h>
+#include <freeradius-devel/util/hash.h>
+#include "../../rlm_cache.h"
+
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+#else
+#  include <freeradius-devel/util/stdatomic.h>
+#endif
+
+#define CACHE_LINE_SIZE		64
+
+#define SHARD_INDEX_MIN		64		//!< Initial number of slots in each shard's index.
+#define SHARD_WHEEL_SLOTS	256		//!< Number of one second buckets in each shard's timer wheel.
+
+/** Marks a slot which previously held an entry
+ *
+ * Probing must continue past tombstones, but they may be reused on insert.
+ */
+#define SLOT_TOMBSTONE		((rlm_cache_sharded_entry_t *)(uintptr_t)1)
+#define SLOT_IS_LIVE(_slot)	((_slot)->c && ((_slot)->c != SLOT_TOMBSTONE))
+
+typedef struct {
+	rlm_cache_entry_t	fields;		//!< Entry data.
+
+	uint32_t		hash;		//!< Hash of the key, selects shard and slot.
+	size_t			size;		//!< Memory accounted to this entry.
+	bool			referenced;	//!< CLOCK reference bit, set on every hit.
+	fr_dlist_t		wheel_entry;	//!< Entry in a timer wheel bucket.
+} rlm_cache_sharded_entry_t;
+
+typedef struct {
+	uint32_t			hash;	//!< Copy of the entry's hash, avoids dereferencing on mismatch.
+	rlm_cache_sharded_entry_t	*c;	//!< Entry, NULL, or #SLOT_TOMBSTONE.
+} rlm_cache_sharded_slot_t;
+
+typedef struct {
+	alignas(CACHE_LINE_SIZE) pthread_mutex_t mutex;	//!< Protects everything in the shard.
+
+	rlm_cache_sharded_slot_t	*index;		//!< Open addressing (linear probing) index.
+	uint32_t			index_size;	//!< Number of slots, always a power of two.
+	uint32_t			num_entries;	//!< Live entries in the index.
+	uint32_t			num_tombstones;	//!< Deleted slots still in the index.
+
+	uint32_t			clock_hand;	//!< Next slot to consider for eviction.
+	size_t				size;		//!< Memory used by entries in this shard.
+
+	fr_dlist_head_t			wheel[SHARD_WHEEL_SLOTS];	//!< Entries bucketed by expiry second.
+	int64_t				wheel_time;	//!< Last second the wheel was advanced to.
+} rlm_cache_shard_t;
+
+typedef struct {
+	uint32_t		num_shards;	//!< How many shards to split the cache into.
+	size_t			max_size;	//!< Maximum memory used by entries, 0 is unlimited.
+
+	uint32_t		shard_mask;	//!< num_shards - 1.
+	uint32_t		shard_max_entries;	//!< Per-shard share of max_entries.
+	size_t			shard_max_size;	//!< Per-shard share of max_size.
+
+	TALLOC_CTX		*shards_chunk;	//!< Over-allocated chunk holding the shards.
+	rlm_cache_shard_t	*shards;	//!< Array of shards, cache line aligned within shards_chunk.
+
+	atomic_uint_fast64_t	num_entries;	//!< Total entries, so count doesn't need to lock.
+} rlm_cache_sharded_t;
+
+/** Per-call handle, records which shard's mutex is held
+ *
+ */
+typedef struct {
+	rlm_cache_sharded_t	*driver;
+	rlm_cache_shard_t	*shard;		//!< Shard currently locked, or NULL.
+} rlm_cache_sharded_handle_t;
+
+static const CONF_PARSER driver_config[] = {
+	{ FR_CONF_OFFSET("shards", FR_TYPE_UINT32, rlm_cache_sharded_t, num_shards), .dflt = "64" },
+	{ FR_CONF_OFFSET("max_size", FR_TYPE_SIZE, rlm_cache_sharded_t, max_size), .dflt = "0" },
+	CONF_PARSER_TERMINATOR
+};
+
+/** Map a hash to a shard
+ *
+ * Uses the high bits so the low bits remain independent for slot selection.
+ */
+static inline CC_HINT(always_inline) rlm_cache_shard_t *shard_by_hash(rlm_cache_sharded_t *driver, uint32_t hash)
+{
+	return &driver->shards[(hash >> 16) & driver->shard_mask];
+}
+
+/** Acquire the mutex for the shard a key hashes to
+ *
+ * rlm_cache uses the same key for every operation between acquire and release,
+ * so in practice this locks once and subsequent calls are no-ops.
+ */
+static inline rlm_cache_shard_t *shard_lock(rlm_cache_sharded_handle_t *handle, uint32_t hash)
+{
+	rlm_cache_shard_t *shard = shard_by_hash(handle->driver, hash);
+
+	if (handle->shard == shard) return shard;
+	if (handle->shard) pthread_mutex_unlock(&handle->shard->mutex);
+
+	pthread_mutex_lock(&shard->mutex);
+	handle->shard = shard;
+
+	return shard;
+}
+
+/** Find the slot holding an entry with the given key
+ *
+ * @return
+ *	- The slot containing the entry.
+ *	- NULL if no entry with this key exists.
+ */
+static rlm_cache_sharded_slot_t *index_find(rlm_cache_shard_t *shard, uint32_t hash,
+					    uint8_t const *key, size_t key_len)
+{
+	uint32_t mask = shard->index_size - 1;
+	uint32_t i;
+
+	for (i = hash & mask; shard->index[i].c; i = (i + 1) & mask) {
+		rlm_cache_sharded_slot_t *slot = &shard->index[i];
+
+		if (slot->c == SLOT_TOMBSTONE) continue;
+		if (slot->hash != hash) continue;
+		if (slot->c->fields.key_len != key_len) continue;
+		if (memcmp(slot->c->fields.key, key, key_len) != 0) continue;
+
+		return slot;
+	}
+
+	return NULL;
+}
+
+/** Place an entry in the first empty or tombstoned slot of its probe sequence
+ *
+ * The caller must ensure there is free space, and that the key isn't already present.
+ *
+ * @return
+ *	- true if a tombstone was reused.
+ *	- false if an empty slot was used.
+ */
+static bool index_place(rlm_cache_sharded_slot_t *index, uint32_t index_size, rlm_cache_sharded_entry_t *c)
+{
+	uint32_t	mask = index_size - 1;
+	uint32_t	i;
+	bool		reused;
+
+	for (i = c->hash & mask; SLOT_IS_LIVE(&index[i]); i = (i + 1) & mask);
+
+	reused = (index[i].c == SLOT_TOMBSTONE);
+	index[i] = (rlm_cache_sharded_slot_t){ .hash = c->hash, .c = c };
+
+	return reused;
+}
+
+/** Grow the index, or rebuild it to clear out tombstones
+ *
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+static int index_resize(rlm_cache_sharded_t *driver, rlm_cache_shard_t *shard)
+{
+	rlm_cache_sharded_slot_t	*index;
+	uint32_t			size = shard->index_size;
+	uint32_t			i;
+
+	/*
+	 *	Only grow if live entries would still be over half
+	 *	the table, otherwise just sweep the tombstones.
+	 */
+	if ((shard->num_entries + 1) * 2 > size) size *= 2;
+
+	index = talloc_zero_array(driver->shards_chunk, rlm_cache_sharded_slot_t, size);
+	if (!index) return -1;
+
+	for (i = 0; i < shard->index_size; i++) {
+		if (!SLOT_IS_LIVE(&shard->index[i])) continue;
+		index_place(index, size, shard->index[i].c);
+	}
+
+	talloc_free(shard->index);
+	shard->index = index;
+	shard->index_size = size;
+	shard->num_tombstones = 0;
+	shard->clock_hand &= (size - 1);
+
+	return 0;
+}
+
+/** Place an entry in a timer wheel bucket according to its expiry
+ *
+ */
+static inline void wheel_insert(rlm_cache_shard_t *shard, rlm_cache_sharded_entry_t *c)
+{
+	int64_t when = fr_unix_time_to_sec(c->fields.expires);
+
+	/*
+	 *	Entries that are already due go in the next bucket
+	 *	the wheel will visit.
+	 */
+	if (when <= shard->wheel_time) when = shard->wheel_time + 1;
+
+	fr_dlist_insert_tail(&shard->wheel[when % SHARD_WHEEL_SLOTS], c);
+}
+
+/** Remove an entry from the index, wheel and accounting, and free it
+ *
+ */
+static void shard_entry_free(rlm_cache_sharded_t *driver, rlm_cache_shard_t *shard,
+			     rlm_cache_sharded_slot_t *slot)
+{
+	rlm_cache_sharded_entry_t *c = slot->c;
+
+	fr_dlist_entry_unlink(&c->wheel_entry);
+
+	slot->c = SLOT_TOMBSTONE;
+	shard->num_entries--;
+	shard->num_tombstones++;
+	shard->size -= c->size;
+	atomic_fetch_sub_explicit(&driver->num_entries, 1, memory_order_relaxed);
+
+	talloc_free(c);
+}
+
+/** Advance the timer wheel, freeing any entries which have expired
+ *
+ * Each call visits at most #SHARD_WHEEL_SLOTS buckets, and each bucket only
+ * contains entries due within the same second (modulo wheel size), so the
+ * cost of expiry is amortised over the operations which trigger it.
+ */
+static void shard_expire(rlm_cache_sharded_t *driver, rlm_cache_shard_t *shard, fr_unix_time_t now)
+{
+	int64_t	now_sec = fr_unix_time_to_sec(now);
+	int64_t	t;
+
+	if (now_sec <= shard->wheel_time) return;
+
+	/*
+	 *	If we've been idle for longer than a full rotation
+	 *	we only need to look at every bucket once.
+	 */
+	t = shard->wheel_time + 1;
+	if ((now_sec - t) >= SHARD_WHEEL_SLOTS) t = now_sec - SHARD_WHEEL_SLOTS + 1;
+
+	for (; t <= now_sec; t++) {
+		fr_dlist_head_t			*bucket = &shard->wheel[t % SHARD_WHEEL_SLOTS];
+		rlm_cache_sharded_entry_t	*c, *next;
+
+		for (c = fr_dlist_head(bucket); c; c = next) {
+			rlm_cache_sharded_slot_t *slot;
+
+			next = fr_dlist_next(bucket, c);
+
+			/*
+			 *	Belongs to a later rotation of the wheel.
+			 */
+			if (fr_unix_time_gt(c->fields.expires, now)) continue;
+
+			slot = index_find(shard, c->hash, c->fields.key, c->fields.key_len);
+			if (!fr_cond_assert(slot && (slot->c == c))) {
+				fr_dlist_remove(bucket, c);
+				continue;
+			}
+			shard_entry_free(driver, shard, slot);
+		}
+	}
+
+	shard->wheel_time = now_sec;
+}
+
+/** Evict entries using the CLOCK algorithm until the shard is within its limits
+ *
+ * Entries which have been hit since the hand last passed get a second chance.
+ */
+static void shard_evict(rlm_cache_sharded_t *driver, rlm_cache_shard_t *shard, size_t needed)
+{
+	uint32_t mask = shard->index_size - 1;
+	uint32_t visited;
+
+	for (visited = 0; visited < (shard->index_size * 2); visited++) {
+		rlm_cache_sharded_slot_t *slot;
+
+		if ((!driver->shard_max_entries || (shard->num_entries < driver->shard_max_entries)) &&
+		    (!driver->shard_max_size || ((shard->size + needed) <= driver->shard_max_size))) break;
+
+		if (shard->num_entries == 0) break;
+
+		slot = &shard->index[shard->clock_hand];
+		shard->clock_hand = (shard->clock_hand + 1) & mask;
+
+		if (!SLOT_IS_LIVE(slot)) continue;
+
+		if (slot->c->referenced) {
+			slot->c->referenced = false;
+			continue;
+		}
+
+		shard_entry_free(driver, shard, slot);
+	}
+}
+
+/** Cleanup a cache_sharded instance
+ *
+ */
+static int mod_detach(module_detach_ctx_t const *mctx)
+{
+	rlm_cache_sharded_t	*driver = talloc_get_type_abort(mctx->inst->data, rlm_cache_sharded_t);
+	uint32_t		i, j;
+
+	if (!driver->shards) return 0;
+
+	for (i = 0; i < driver->num_shards; i++) {
+		rlm_cache_shard_t *shard = &driver->shards[i];
+
+		if (shard->index) for (j = 0; j < shard->index_size; j++) {
+			if (!SLOT_IS_LIVE(&shard->index[j])) continue;
+			shard_entry_free(driver, shard, &shard->index[j]);
+		}
+		pthread_mutex_destroy(&shard->mutex);
+	}
+
+	return 0;
+}
+
+/** Create a new cache_sharded instance
+ *
+ * @param[in] mctx		Data required for instantiation.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+static int mod_instantiate(module_inst_ctx_t const *mctx)
+{
+	rlm_cache_sharded_t	*driver = talloc_get_type_abort(mctx->inst->data, rlm_cache_sharded_t);
+	rlm_cache_t const	*parent = talloc_get_type_abort(mctx->inst->parent->data, rlm_cache_t);
+	CONF_SECTION		*conf = mctx->inst->conf;
+	uint32_t		i, j;
+	int			ret;
+
+	FR_INTEGER_BOUND_CHECK("shards", driver->num_shards, >=, 1);
+	FR_INTEGER_BOUND_CHECK("shards", driver->num_shards, <=, 65536);
+
+	if ((driver->num_shards & (driver->num_shards - 1)) != 0) {
+		cf_log_err(conf, "'shards' must be a power of two, got %u", driver->num_shards);
+		return -1;
+	}
+	driver->shard_mask = driver->num_shards - 1;
+
+	/*
+	 *	Limits are enforced per shard, round down so
+	 *	the total never exceeds what was configured.
+	 */
+	if (parent->config.max_entries) {
+		driver->shard_max_entries = parent->config.max_entries / driver->num_shards;
+		if (!driver->shard_max_entries) driver->shard_max_entries = 1;
+	}
+	if (driver->max_size) {
+		driver->shard_max_size = driver->max_size / driver->num_shards;
+		if (!driver->shard_max_size) driver->shard_max_size = 1;
+	}
+
+	/*
+	 *	talloc only guarantees 16 byte alignment, so the
+	 *	alignas() on the shard mutex only keeps the shards on
+	 *	separate cache lines if the array itself is aligned.
+	 */
+	driver->shards_chunk = talloc_aligned_array(driver, (void **)&driver->shards, CACHE_LINE_SIZE,
+						    sizeof(rlm_cache_shard_t) * driver->num_shards);
+	if (!driver->shards_chunk) {
+		ERROR("Failed allocating shards");
+		return -1;
+	}
+	memset(driver->shards, 0, sizeof(rlm_cache_shard_t) * driver->num_shards);
+
+	for (i = 0; i < driver->num_shards; i++) {
+		rlm_cache_shard_t *shard = &driver->shards[i];
+
+		shard->index = talloc_zero_array(driver->shards_chunk, rlm_cache_sharded_slot_t, SHARD_INDEX_MIN);
+		if (!shard->index) {
+			ERROR("Failed allocating shard index");
+			return -1;
+		}
+		shard->index_size = SHARD_INDEX_MIN;
+
+		for (j = 0; j < SHARD_WHEEL_SLOTS; j++) {
+			fr_dlist_talloc_init(&shard->wheel[j], rlm_cache_sharded_entry_t, wheel_entry);
+		}
+		shard->wheel_time = fr_unix_time_to_sec(fr_time_to_unix_time(fr_time()));
+
+		if ((ret = pthread_mutex_init(&shard->mutex, NULL)) != 0) {
+			ERROR("Failed initializing mutex: %s", fr_syserror(ret));
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/** Custom allocation function for the driver
+ *
+ * Allows allocation of cache entry structures with additional fields.
+ *
+ * @copydetails cache_entry_alloc_t
+ */
+static rlm_cache_entry_t *cache_entry_alloc(UNUSED rlm_cache_config_t const *config, UNUSED void *instance,
+					    request_t *request)
+{
+	rlm_cache_sharded_entry_t *c;
+
+	c = talloc_zero(NULL, rlm_cache_sharded_entry_t);
+	if (!c) {
+		RERROR("Failed allocating cache entry");
+		return NULL;
+	}
+	fr_dlist_entry_init(&c->wheel_entry);
+
+	return (rlm_cache_entry_t *)c;
+}
+
+/** Locate a cache entry
+ *
+ * @copydetails cache_entry_find_t
+ */
+static cache_status_t cache_entry_find(rlm_cache_entry_t **out,
+				       UNUSED rlm_cache_config_t const *config, void *instance,
+				       request_t *request, void *handle, uint8_t const *key, size_t key_len)
+{
+	rlm_cache_sharded_t		*driver = talloc_get_type_abort(instance, rlm_cache_sharded_t);
+	rlm_cache_sharded_slot_t	*slot;
+	rlm_cache_shard_t		*shard;
+	uint32_t			hash = fr_hash(key, key_len);
+
+	shard = shard_lock(talloc_get_type_abort(handle, rlm_cache_sharded_handle_t), hash);
+
+	shard_expire(driver, shard, fr_time_to_unix_time(request->packet->timestamp));
+
+	slot = index_find(shard, hash, key, key_len);
+	if (!slot) {
+		*out = NULL;
+		return CACHE_MISS;
+	}
+
+	slot->c->referenced = true;
+	*out = &slot->c->fields;
+
+	return CACHE_OK;
+}
+
+/** Free an entry and remove it from the data store
+ *
+ * @copydetails cache_entry_expire_t
+ */
+static cache_status_t cache_entry_expire(UNUSED rlm_cache_config_t const *config, void *instance,
+					 request_t *request, void *handle,
+					 uint8_t const *key, size_t key_len)
+{
+	rlm_cache_sharded_t		*driver = talloc_get_type_abort(instance, rlm_cache_sharded_t);
+	rlm_cache_sharded_slot_t	*slot;
+	rlm_cache_shard_t		*shard;
+	uint32_t			hash = fr_hash(key, key_len);
+
+	if (!request) return CACHE_ERROR;
+
+	shard = shard_lock(talloc_get_type_abort(handle, rlm_cache_sharded_handle_t), hash);
+
+	slot = index_find(shard, hash, key, key_len);
+	if (!slot) return CACHE_MISS;
+
+	shard_entry_free(driver, shard, slot);
+
+	return CACHE_OK;
+}
+
+/** Insert a new entry into the data store
+ *
+ * @copydetails cache_entry_insert_t
+ */
+static cache_status_t cache_entry_insert(UNUSED rlm_cache_config_t const *config, void *instance,
+					 request_t *request, void *handle,
+					 rlm_cache_entry_t const *to_insert)
+{
+	rlm_cache_sharded_t		*driver = talloc_get_type_abort(instance, rlm_cache_sharded_t);
+	rlm_cache_sharded_entry_t	*c = UNCONST(rlm_cache_sharded_entry_t *, to_insert);
+	rlm_cache_sharded_slot_t	*slot;
+	rlm_cache_shard_t		*shard;
+
+	if (!request) return CACHE_ERROR;
+
+	c->hash = fr_hash(c->fields.key, c->fields.key_len);
+	shard = shard_lock(talloc_get_type_abort(handle, rlm_cache_sharded_handle_t), c->hash);
+
+	shard_expire(driver, shard, fr_time_to_unix_time(request->packet->timestamp));
+
+	/*
+	 *	Allow overwriting
+	 */
+	slot = index_find(shard, c->hash, c->fields.key, c->fields.key_len);
+	if (slot) {
+		if (slot->c == c) {
+			fr_dlist_entry_unlink(&c->wheel_entry);
+			wheel_insert(shard, c);
+			return CACHE_OK;
+		}
+		shard_entry_free(driver, shard, slot);
+	}
+
+	c->size = talloc_total_size(c);
+	if (driver->shard_max_size && (c->size > driver->shard_max_size)) {
+		RWDEBUG("Entry of %zu bytes is larger than the per-shard limit of %zu bytes",
+			c->size, driver->shard_max_size);
+		return CACHE_ERROR;
+	}
+
+	if (driver->shard_max_entries || driver->shard_max_size) shard_evict(driver, shard, c->size);
+
+	/*
+	 *	Keep the load factor (including tombstones) under 3/4
+	 */
+	if (((shard->num_entries + shard->num_tombstones + 1) * 4) > (shard->index_size * 3)) {
+		if (index_resize(driver, shard) < 0) {
+			RERROR("Failed resizing cache index");
+			return CACHE_ERROR;
+		}
+	}
+
+	if (index_place(shard->index, shard->index_size, c)) shard->num_tombstones--;
+
+	c->referenced = false;
+	shard->num_entries++;
+	shard->size += c->size;
+	atomic_fetch_add_explicit(&driver->num_entries, 1, memory_order_relaxed);
+
+	wheel_insert(shard, c);
+
+	return CACHE_OK;
+}
+
+/** Update the TTL of an entry
+ *
+ * @copydetails cache_entry_set_ttl_t
+ */
+static cache_status_t cache_entry_set_ttl(UNUSED rlm_cache_config_t const *config, UNUSED void *instance,
+					  request_t *request, void *handle,
+					  rlm_cache_entry_t *entry)
+{
+	rlm_cache_sharded_entry_t	*c = (rlm_cache_sharded_entry_t *)entry;
+	rlm_cache_shard_t		*shard;
+
+#ifdef NDEBUG
+	if (!request) return CACHE_ERROR;
+#endif
+
+	shard = shard_lock(talloc_get_type_abort(handle, rlm_cache_sharded_handle_t), c->hash);
+
+	if (!fr_cond_assert(fr_dlist_entry_in_list(&c->wheel_entry))) {
+		RERROR("Entry not in timer wheel");
+		return CACHE_ERROR;
+	}
+
+	fr_dlist_entry_unlink(&c->wheel_entry);
+	wheel_insert(shard, c);
+
+	return CACHE_OK;
+}
+
+/** Return the number of entries in the cache
+ *
+ * Doesn't lock, so the value may be slightly stale.
+ *
+ * @copydetails cache_entry_count_t
+ */
+static uint64_t cache_entry_count(UNUSED rlm_cache_config_t const *config, void *instance,
+				  UNUSED request_t *request, UNUSED void *handle)
+{
+	rlm_cache_sharded_t *driver = talloc_get_type_abort(instance, rlm_cache_sharded_t);
+
+	return atomic_load_explicit(&driver->num_entries, memory_order_relaxed);
+}
+
+/** Allocate a handle
+ *
+ * No lock is taken until the key is known.
+ *
+ * @copydetails cache_acquire_t
+ */
+static int cache_acquire(void **handle, UNUSED rlm_cache_config_t const *config, void *instance,
+			 request_t *request)
+{
+	rlm_cache_sharded_handle_t *h;
+
+	MEM(h = talloc_zero(request, rlm_cache_sharded_handle_t));
+	h->driver = talloc_get_type_abort(instance, rlm_cache_sharded_t);
+
+	*handle = h;
+
+	return 0;
+}
+
+/** Release the shard mutex (if held), and free the handle
+ *
+ * @copydetails cache_release_t
+ */
+static void cache_release(UNUSED rlm_cache_config_t const *config, UNUSED void *instance, request_t *request,
+			  rlm_cache_handle_t *handle)
+{
+	rlm_cache_sharded_handle_t *h = talloc_get_type_abort(handle, rlm_cache_sharded_handle_t);
+
+	if (h->shard) {
+		pthread_mutex_unlock(&h->shard->mutex);
+		RDEBUG3("Shard mutex released");
+	}
+
+	talloc_free(h);
+}
+
+extern rlm_cache_driver_t rlm_cache_sharded;
+rlm_cache_driver_t rlm_cache_sharded = {
+	.common = {
+		.magic		= MODULE_MAGIC_INIT,
+		.name		= "cache_sharded",
+		.config		= driver_config,
+		.instantiate	= mod_instantiate,
+		.detach		= mod_detach,
+		.inst_size	= sizeof(rlm_cache_sharded_t),
+		.inst_type	= "rlm_cache_sharded_t",
+	},
+	.alloc		= cache_entry_alloc,
+
+	.find		= cache_entry_find,
+	.insert		= cache_entry_insert,
+	.expire		= cache_entry_expire,
+	.set_ttl	= cache_entry_set_ttl,
+	.count		= cache_entry_count,
+
+	.acquire	= cache_acquire,
+	.release	= cache_release,
+};
@@ -35,6 +35,12 @@ RCSID("$Id$")
 
 extern module_rlm_t rlm_cache;
 
+static const CONF_PARSER local_config[] = {
+	{ FR_CONF_OFFSET("max_entries", FR_TYPE_UINT32, rlm_cache_t, local.max_entries), .dflt = "0" },
+	{ FR_CONF_OFFSET("ttl", FR_TYPE_TIME_DELTA, rlm_cache_t, local.ttl), .dflt = "5s" },
+	CONF_PARSER_TERMINATOR
+};
+
 static const CONF_PARSER module_config[] = {
 	{ FR_CONF_OFFSET("driver", FR_TYPE_VOID, rlm_cache_t, driver_submodule), .dflt = "rbtree",
 			 .func = module_rlm_submodule_parse },
@@ -45,6 +51,8 @@ static const CONF_PARSER module_config[] = {
 	/* Should be a type which matches time_t, @fixme before 2038 */
 	{ FR_CONF_OFFSET("epoch", FR_TYPE_INT32, rlm_cache_config_t, epoch), .dflt = "0" },
 	{ FR_CONF_OFFSET("add_stats", FR_TYPE_BOOL, rlm_cache_config_t, stats), .dflt = "no" },
+
+	{ FR_CONF_POINTER("local", FR_TYPE_SUBSECTION, NULL), .subcs = (void const *) local_config },
 	CONF_PARSER_TERMINATOR
 };
 
@@ -62,6 +70,7 @@ static fr_dict_attr_t const *attr_cache_allow_merge;
 static fr_dict_attr_t const *attr_cache_allow_insert;
 static fr_dict_attr_t const *attr_cache_ttl;
 static fr_dict_attr_t const *attr_cache_entry_hits;
+static fr_dict_attr_t const *attr_cache_local_hit;
 
 extern fr_dict_attr_autoload_t rlm_cache_dict_attr[];
 fr_dict_attr_autoload_t rlm_cache_dict_attr[] = {
@@ -71,6 +80,7 @@ fr_dict_attr_autoload_t rlm_cache_dict_attr[] = {
 	{ .out = &attr_cache_allow_insert, .name = "Cache-Allow-Insert", .type = FR_TYPE_BOOL, .dict = &dict_freeradius },
 	{ .out = &attr_cache_ttl, .name = "Cache-TTL", .type = FR_TYPE_INT32, .dict = &dict_freeradius },
 	{ .out = &attr_cache_entry_hits, .name = "Cache-Entry-Hits", .type = FR_TYPE_UINT32, .dict = &dict_freeradius },
+	{ .out = &attr_cache_local_hit, .name = "Cache-Local-Hit", .type = FR_TYPE_BOOL, .dict = &dict_freeradius },
 	{ NULL }
 };
 
@@ -146,6 +156,177 @@ static void cache_free(rlm_cache_t const *inst, rlm_cache_entry_t **c)
 	*c = NULL;
 }
 
+/** An entry in a thread's local cache
+ *
+ * Holds a private copy of an entry retrieved from the driver, so it remains
+ * valid irrespective of what the driver does with its own copy.
+ */
+typedef struct {
+	rlm_cache_entry_t	c;		//!< Copy of the driver's entry.  Must be first.
+	fr_unix_time_t		expires;	//!< When we stop serving the entry locally.
+	fr_rb_node_t		node;		//!< Entry in the local lookup tree.
+	fr_dlist_t		entry;		//!< Entry in the LRU list.
+} rlm_cache_local_entry_t;
+
+/** Compare two local entries by key
+ *
+ */
+static int8_t cache_local_entry_cmp(void const *one, void const *two)
+{
+	rlm_cache_entry_t const *a = one, *b = two;
+
+	MEMCMP_RETURN(a, b, key, key_len);
+	return 0;
+}
+
+/** Remove an entry from a thread's local cache and free it
+ *
+ */
+static void cache_local_entry_free(rlm_cache_thread_t *t, rlm_cache_local_entry_t *le)
+{
+	fr_rb_remove(t->local, le);
+	fr_dlist_remove(&t->lru, le);
+	talloc_free(le);
+}
+
+/** Record whether a lookup was served from the thread's local cache
+ *
+ */
+static void cache_local_stats(rlm_cache_t const *inst, rlm_cache_thread_t *t, request_t *request, bool hit)
+{
+	fr_pair_t	*vp;
+
+	if (hit) {
+		t->local_hits++;
+	} else {
+		t->local_misses++;
+	}
+
+	if (!inst->config.stats) return;
+
+	MEM(pair_update_request(&vp, attr_cache_local_hit) >= 0);
+	vp->vp_bool = hit;
+}
+
+/** Find an entry in the thread's local cache
+ *
+ * Entries returned are owned by the local cache, and must not be passed to
+ * any of the driver callbacks, or freed with #cache_free.
+ *
+ * @return
+ *	- The local entry.
+ *	- NULL if the local cache is disabled, or no valid entry was found.
+ */
+static rlm_cache_entry_t *cache_local_find(rlm_cache_t const *inst, rlm_cache_thread_t *t, request_t *request,
+					   uint8_t const *key, size_t key_len)
+{
+	rlm_cache_local_entry_t	*le;
+
+	if (!t->local) return NULL;
+
+	le = fr_rb_find(t->local, &(rlm_cache_entry_t){ .key = key, .key_len = key_len });
+	if (!le) {
+		cache_local_stats(inst, t, request, false);
+		return NULL;
+	}
+
+	if (fr_unix_time_lt(le->expires, fr_time_to_unix_time(request->packet->timestamp))) {
+		RDEBUG3("Local entry for \"%pV\" expired, removing it", fr_box_strvalue_len((char const *)key, key_len));
+		cache_local_entry_free(t, le);
+		cache_local_stats(inst, t, request, false);
+		return NULL;
+	}
+
+	/*
+	 *	Keep the most recently used entries at the head
+	 */
+	fr_dlist_remove(&t->lru, le);
+	fr_dlist_insert_head(&t->lru, le);
+
+	RDEBUG2("Found local entry for \"%pV\"", fr_box_strvalue_len((char const *)key, key_len));
+	cache_local_stats(inst, t, request, true);
+	le->c.hits++;
+
+	return &le->c;
+}
+
+/** Remove an entry from the thread's local cache
+ *
+ * Called whenever we modify the entry in the driver, so that this thread sees
+ * its own changes immediately.  Other threads will continue to serve their
+ * local copies until they expire.
+ */
+static void cache_local_expire(rlm_cache_thread_t *t, uint8_t const *key, size_t key_len)
+{
+	rlm_cache_local_entry_t	*le;
+
+	if (!t->local) return;
+
+	le = fr_rb_find(t->local, &(rlm_cache_entry_t){ .key = key, .key_len = key_len });
+	if (le) cache_local_entry_free(t, le);
+}
+
+/** Copy an entry retrieved from the driver into the thread's local cache
+ *
+ * If the local cache is full, the least recently used entry is evicted.
+ */
+static void cache_local_insert(rlm_cache_t const *inst, rlm_cache_thread_t *t, request_t *request,
+			       rlm_cache_entry_t const *c)
+{
+	rlm_cache_local_entry_t	*le;
+	map_t const		*map = NULL;
+	map_t			*c_map;
+	fr_unix_time_t		expires;
+
+	if (!t->local) return;
+
+	cache_local_expire(t, c->key, c->key_len);
+
+	while (fr_rb_num_elements(t->local) >= inst->local.max_entries) {
+		cache_local_entry_free(t, fr_dlist_tail(&t->lru));
+	}
+
+	MEM(le = talloc_zero(t, rlm_cache_local_entry_t));
+	map_list_init(&le->c.maps);
+	le->c.key = talloc_memdup(le, c->key, c->key_len);
+	le->c.key_len = c->key_len;
+	le->c.created = c->created;
+	le->c.expires = c->expires;
+	le->c.hits = c->hits;
+
+	while ((map = map_list_next(&c->maps, map))) {
+		MEM(c_map = talloc_zero(le, map_t));
+		c_map->op = map->op;
+		map_list_init(&c_map->child);
+		MEM(c_map->lhs = tmpl_copy(c_map, map->lhs));
+
+		/*
+		 *	tmpl_copy doesn't copy literal values
+		 */
+		if (tmpl_is_data(map->rhs)) {
+			MEM(c_map->rhs = tmpl_alloc(c_map, TMPL_TYPE_DATA,
+						    map->rhs->quote, map->rhs->name, map->rhs->len));
+			if (fr_value_box_copy(c_map->rhs, tmpl_value(c_map->rhs), tmpl_value(map->rhs)) < 0) {
+				RPWDEBUG("Failed copying entry to local cache");
+				talloc_free(le);
+				return;
+			}
+		} else {
+			MEM(c_map->rhs = tmpl_copy(c_map, map->rhs));
+		}
+		map_list_insert_tail(&le->c.maps, c_map);
+	}
+
+	/*
+	 *	Never serve an entry locally for longer than it's valid
+	 */
+	expires = fr_unix_time_add(fr_time_to_unix_time(request->packet->timestamp), inst->local.ttl);
+	le->expires = fr_unix_time_lt(c->expires, expires) ? c->expires : expires;
+
+	fr_rb_insert(t->local, le);
+	fr_dlist_insert_head(&t->lru, le);
+}
+
 /** Merge a cached entry into a #request_t
  *
  * @return
@@ -200,7 +381,7 @@ static rlm_rcode_t cache_merge(rlm_cache_t const *inst, request_t *request, rlm_
  *	- #RLM_MODULE_NOTFOUND on cache miss.
  */
 static unlang_action_t cache_find(rlm_rcode_t *p_result, rlm_cache_entry_t **out,
-				  rlm_cache_t const *inst, request_t *request,
+				  rlm_cache_t const *inst, rlm_cache_thread_t *t, request_t *request,
 				  rlm_cache_handle_t **handle, uint8_t const *key, size_t key_len)
 {
 	cache_status_t ret;
@@ -222,6 +403,7 @@ static unlang_action_t cache_find(rlm_rcode_t *p_result, rlm_cache_entry_t **out
 
 		case CACHE_MISS:
 			RDEBUG2("No cache entry found for \"%pV\"", fr_box_strvalue_len((char const *)key, key_len));
+			t->misses++;
 			RETURN_MODULE_NOTFOUND;
 
 		default:
@@ -244,8 +426,10 @@ static unlang_action_t cache_find(rlm_rcode_t *p_result, rlm_cache_entry_t **out
 			fr_box_time(request->packet->timestamp));
 
 	expired:
-		inst->driver->expire(&inst->config, inst->driver_submodule->dl_inst->data, request, handle, c->key, c->key_len);
+		inst->driver->expire(&inst->config, inst->driver_submodule->dl_inst->data, request, *handle, c->key, c->key_len);
+		cache_local_expire(t, key, key_len);
 		cache_free(inst, &c);
+		t->misses++;
 		RETURN_MODULE_NOTFOUND;	/* Couldn't find a non-expired entry */
 	}
 
@@ -257,6 +441,7 @@ static unlang_action_t cache_find(rlm_rcode_t *p_result, rlm_cache_entry_t **out
 	RDEBUG2("Found entry for \"%pV\"", fr_box_strvalue_len((char const *)key, key_len));
 
 	c->hits++;
+	t->hits++;
 	*out = c;
 
 	RETURN_MODULE_OK;
@@ -270,10 +455,11 @@ static unlang_action_t cache_find(rlm_rcode_t *p_result, rlm_cache_entry_t **out
  *	- #RLM_MODULE_FAIL on failure.
  */
 static unlang_action_t cache_expire(rlm_rcode_t *p_result,
-				    rlm_cache_t const *inst, request_t *request,
+				    rlm_cache_t const *inst, rlm_cache_thread_t *t, request_t *request,
 				    rlm_cache_handle_t **handle, uint8_t const *key, size_t key_len)
 {
 	RDEBUG2("Expiring cache entry");
+	cache_local_expire(t, key, key_len);
 	for (;;) switch (inst->driver->expire(&inst->config, inst->driver_submodule->dl_inst->data, request,
 					      *handle, key, key_len)) {
 	case CACHE_RECONNECT:
@@ -299,8 +485,8 @@ static unlang_action_t cache_expire(rlm_rcode_t *p_result,
  *	- #RLM_MODULE_FAIL on failure.
  */
 static unlang_action_t cache_insert(rlm_rcode_t *p_result,
-				    rlm_cache_t const *inst, request_t *request, rlm_cache_handle_t **handle,
-				    uint8_t const *key, size_t key_len, fr_time_delta_t ttl)
+				    rlm_cache_t const *inst, rlm_cache_thread_t *t, request_t *request,
+				    rlm_cache_handle_t **handle, uint8_t const *key, size_t key_len, fr_time_delta_t ttl)
 {
 	map_t			const *map = NULL;
 	map_t			*c_map;
@@ -312,7 +498,7 @@ static unlang_action_t cache_insert(rlm_rcode_t *p_result,
 	TALLOC_CTX		*pool;
 
 	if ((inst->config.max_entries > 0) && inst->driver->count &&
-	    (inst->driver->count(&inst->config, inst->driver_submodule->dl_inst->data, request, handle) > inst->config.max_entries)) {
+	    (inst->driver->count(&inst->config, inst->driver_submodule->dl_inst->data, request, *handle) > inst->config.max_entries)) {
 		RWDEBUG("Cache is full: %d entries", inst->config.max_entries);
 		RETURN_MODULE_FAIL;
 	}
@@ -440,6 +626,8 @@ static unlang_action_t cache_insert(rlm_rcode_t *p_result,
 
 	if (merge) cache_merge(inst, request, c);
 
+	cache_local_expire(t, key, key_len);
+
 	for (;;) {
 		cache_status_t ret;
 
@@ -468,9 +656,11 @@ static unlang_action_t cache_insert(rlm_rcode_t *p_result,
  *	- #RLM_MODULE_FAIL on failure.
  */
 static unlang_action_t cache_set_ttl(rlm_rcode_t *p_result,
-				     rlm_cache_t const *inst, request_t *request,
+				     rlm_cache_t const *inst, rlm_cache_thread_t *t, request_t *request,
 				     rlm_cache_handle_t **handle, rlm_cache_entry_t *c)
 {
+	cache_local_expire(t, c->key, c->key_len);
+
 	/*
 	 *	Call the driver's insert method to overwrite the old entry
 	 */
@@ -543,8 +733,9 @@ static unlang_action_t CC_HINT(nonnull) mod_cache_it(rlm_rcode_t *p_result, modu
 {
 	rlm_cache_entry_t	*c = NULL;
 	rlm_cache_t const	*inst = talloc_get_type_abort_const(mctx->inst->data, rlm_cache_t);
+	rlm_cache_thread_t	*t = talloc_get_type_abort(mctx->thread, rlm_cache_thread_t);
 
-	rlm_cache_handle_t	*handle;
+	rlm_cache_handle_t	*handle = NULL;
 
 	fr_dcursor_t		cursor;
 	fr_pair_t		*vp;
@@ -580,14 +771,21 @@ static unlang_action_t CC_HINT(nonnull) mod_cache_it(rlm_rcode_t *p_result, modu
 		RDEBUG3("status-only: yes");
 		REXDENT();
 
+		if (cache_local_find(inst, t, request, key, key_len)) {
+			rcode = RLM_MODULE_OK;
+			goto finish;
+		}
+
 		if (cache_acquire(&handle, inst, request) < 0) {
 			RETURN_MODULE_FAIL;
 		}
 
-		cache_find(&rcode, &c, inst, request, &handle, key, key_len);
+		cache_find(&rcode, &c, inst, t, request, &handle, key, key_len);
 		if (rcode == RLM_MODULE_FAIL) goto finish;
 		fr_assert(!inst->driver->acquire || handle);
 
+		if (c) cache_local_insert(inst, t, request, c);
+
 		rcode = c ? RLM_MODULE_OK:
 			    RLM_MODULE_NOTFOUND;
 		goto finish;
@@ -622,6 +820,21 @@ static unlang_action_t CC_HINT(nonnull) mod_cache_it(rlm_rcode_t *p_result, modu
 	RDEBUG3("expire : %s", expire ? "yes" : "no");
 	RDEBUG3("ttl    : %pV", fr_box_time_delta(ttl));
 	REXDENT();
+
+	/*
+	 *	Plain lookups can be satisfied from the local cache
+	 *	without touching the driver.
+	 */
+	if (merge && !expire && !set_ttl) {
+		rlm_cache_entry_t *local;
+
+		local = cache_local_find(inst, t, request, key, key_len);
+		if (local) {
+			rcode = cache_merge(inst, request, local);
+			goto finish;
+		}
+	}
+
 	if (cache_acquire(&handle, inst, request) < 0) {
 		RETURN_MODULE_FAIL;
 	}
@@ -631,7 +844,7 @@ static unlang_action_t CC_HINT(nonnull) mod_cache_it(rlm_rcode_t *p_result, modu
 	 *	recording whether the entry existed.
 	 */
 	if (merge) {
-		cache_find(&rcode, &c, inst, request, &handle, key, key_len);
+		cache_find(&rcode, &c, inst, t, request, &handle, key, key_len);
 		switch (rcode) {
 		case RLM_MODULE_FAIL:
 			goto finish;
@@ -639,6 +852,7 @@ static unlang_action_t CC_HINT(nonnull) mod_cache_it(rlm_rcode_t *p_result, modu
 		case RLM_MODULE_OK:
 			rcode = cache_merge(inst, request, c);
 			exists = 1;
+			if (!expire && !set_ttl) cache_local_insert(inst, t, request, c);
 			break;
 
 		case RLM_MODULE_NOTFOUND:
@@ -664,7 +878,7 @@ static unlang_action_t CC_HINT(nonnull) mod_cache_it(rlm_rcode_t *p_result, modu
 			rlm_rcode_t tmp;
 
 			fr_assert(!set_ttl);
-			cache_expire(&tmp, inst, request, &handle, key, key_len);
+			cache_expire(&tmp, inst, t, request, &handle, key, key_len);
 			switch (tmp) {
 			case RLM_MODULE_FAIL:
 				rcode = RLM_MODULE_FAIL;
@@ -696,7 +910,7 @@ static unlang_action_t CC_HINT(nonnull) mod_cache_it(rlm_rcode_t *p_result, modu
 	if ((exists < 0) && (insert || set_ttl)) {
 		rlm_rcode_t tmp;
 
-		cache_find(&tmp, &c, inst, request, &handle, key, key_len);
+		cache_find(&tmp, &c, inst, t, request, &handle, key, key_len);
 		switch (tmp) {
 		case RLM_MODULE_FAIL:
 			rcode = RLM_MODULE_FAIL;
@@ -727,7 +941,7 @@ static unlang_action_t CC_HINT(nonnull) mod_cache_it(rlm_rcode_t *p_result, modu
 
 		c->expires = fr_unix_time_add(fr_time_to_unix_time(request->packet->timestamp), ttl);
 
-		cache_set_ttl(&tmp, inst, request, &handle, c);
+		cache_set_ttl(&tmp, inst, t, request, &handle, c);
 		switch (tmp) {
 		case RLM_MODULE_FAIL:
 			rcode = RLM_MODULE_FAIL;
@@ -752,7 +966,7 @@ static unlang_action_t CC_HINT(nonnull) mod_cache_it(rlm_rcode_t *p_result, modu
 	if (insert && (exists == 0)) {
 		rlm_rcode_t tmp;
 
-		cache_insert(&tmp, inst, request, &handle, key, key_len, ttl);
+		cache_insert(&tmp, inst, t, request, &handle, key, key_len, ttl);
 		switch (tmp) {
 		case RLM_MODULE_FAIL:
 			rcode = RLM_MODULE_FAIL;
@@ -819,8 +1033,9 @@ xlat_action_t cache_xlat(TALLOC_CTX *ctx, fr_dcursor_t *out,
 			 xlat_ctx_t const *xctx,
 			 request_t *request, FR_DLIST_HEAD(fr_value_box_list) *in)
 {
-	rlm_cache_entry_t 		*c = NULL;
+	rlm_cache_entry_t 		*c = NULL, *found;
 	rlm_cache_t			*inst = talloc_get_type_abort(xctx->mctx->inst->data, rlm_cache_t);
+	rlm_cache_thread_t		*t = talloc_get_type_abort(xctx->mctx->thread, rlm_cache_thread_t);
 	rlm_cache_handle_t		*handle = NULL;
 
 	ssize_t				slen;
@@ -853,25 +1068,29 @@ xlat_action_t cache_xlat(TALLOC_CTX *ctx, fr_dcursor_t *out,
 		return XLAT_ACTION_FAIL;
 	}
 
-	if (cache_acquire(&handle, inst, request) < 0) {
-		talloc_free(target);
-		return XLAT_ACTION_FAIL;
-	}
+	found = cache_local_find(inst, t, request, key, key_len);
+	if (!found) {
+		if (cache_acquire(&handle, inst, request) < 0) {
+			talloc_free(target);
+			return XLAT_ACTION_FAIL;
+		}
 
-	cache_find(&rcode, &c, inst, request, &handle, key, key_len);
-	switch (rcode) {
-	case RLM_MODULE_OK:		/* found */
-		break;
+		cache_find(&rcode, &c, inst, t, request, &handle, key, key_len);
+		switch (rcode) {
+		case RLM_MODULE_OK:		/* found */
+			break;
 
-	case RLM_MODULE_NOTFOUND:	/* not found */
-		return XLAT_ACTION_FAIL;
+		default:
+			cache_release(inst, request, &handle);
+			talloc_free(target);
+			return XLAT_ACTION_FAIL;
+		}
 
-	default:
-		talloc_free(target);
-		return XLAT_ACTION_FAIL;
+		cache_local_insert(inst, t, request, c);
+		found = c;
 	}
 
-	while ((map = map_list_next(&c->maps, map))) {
+	while ((map = map_list_next(&found->maps, map))) {
 		if ((tmpl_attr_tail_da(map->lhs) != tmpl_attr_tail_da(target)) ||
 		    (tmpl_list(map->lhs) != tmpl_list(target))) continue;
 
@@ -883,14 +1102,14 @@ xlat_action_t cache_xlat(TALLOC_CTX *ctx, fr_dcursor_t *out,
 
 	talloc_free(target);
 
+	cache_free(inst, &c);
+	cache_release(inst, request, &handle);
+
 	/*
 	 *	Check if we found a matching map
 	 */
 	if (!map) return XLAT_ACTION_FAIL;
 
-	cache_free(inst, &c);
-	cache_release(inst, request, &handle);
-
 	return XLAT_ACTION_DONE;
 }
 
@@ -1001,6 +1220,19 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 		return -1;
 	}
 
+	if (inst->local.max_entries > 0) {
+		if (!fr_time_delta_ispos(inst->local.ttl)) {
+			cf_log_err(conf, "Must set 'local.ttl' to non-zero");
+			return -1;
+		}
+
+		if (fr_time_delta_gt(inst->local.ttl, inst->config.ttl)) {
+			cf_log_warn(conf, "'local.ttl' is greater than 'ttl', forcing to %pV",
+				    fr_box_time_delta(inst->config.ttl));
+			inst->local.ttl = inst->config.ttl;
+		}
+	}
+
 	update = cf_section_find(conf, "update", CF_IDENT_ANY);
 	if (!update) {
 		cf_log_err(conf, "Must have an 'update' section in order to cache anything");
@@ -1033,6 +1265,41 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 	return 0;
 }
 
+/** Allocate the thread local cache
+ *
+ */
+static int mod_thread_instantiate(module_thread_inst_ctx_t const *mctx)
+{
+	rlm_cache_t const	*inst = talloc_get_type_abort(mctx->inst->data, rlm_cache_t);
+	rlm_cache_thread_t	*t = talloc_get_type_abort(mctx->thread, rlm_cache_thread_t);
+
+	if (inst->local.max_entries == 0) return 0;
+
+	t->local = fr_rb_inline_talloc_alloc(t, rlm_cache_local_entry_t, node, cache_local_entry_cmp, NULL);
+	if (!t->local) {
+		ERROR("Failed to create local cache");
+		return -1;
+	}
+	fr_dlist_talloc_init(&t->lru, rlm_cache_local_entry_t, entry);
+
+	return 0;
+}
+
+/** Report how effective each cache tier was
+ *
+ */
+static int mod_thread_detach(module_thread_inst_ctx_t const *mctx)
+{
+	rlm_cache_thread_t	*t = talloc_get_type_abort(mctx->thread, rlm_cache_thread_t);
+
+	if (t->local) {
+		DEBUG2("local hits %" PRIu64 ", local misses %" PRIu64, t->local_hits, t->local_misses);
+	}
+	DEBUG2("driver hits %" PRIu64 ", driver misses %" PRIu64, t->hits, t->misses);
+
+	return 0;
+}
+
 /** Get the status by ${key} (without load)
  *
  * @return
@@ -1043,6 +1310,7 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 static unlang_action_t CC_HINT(nonnull) mod_method_status(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request)
 {
 	rlm_cache_t const	*inst = talloc_get_type_abort(mctx->inst->data, rlm_cache_t);
+	rlm_cache_thread_t	*t = talloc_get_type_abort(mctx->thread, rlm_cache_thread_t);
 	rlm_rcode_t		rcode = RLM_MODULE_NOOP;
 	uint8_t			buffer[1024];
 	uint8_t const		*key;
@@ -1063,6 +1331,11 @@ static unlang_action_t CC_HINT(nonnull) mod_method_status(rlm_rcode_t *p_result,
 		RETURN_MODULE_FAIL;
 	}
 
+	if (cache_local_find(inst, t, request, key, key_len)) {
+		rcode = RLM_MODULE_OK;
+		goto finish;
+	}
+
 	/* Good to go? */
 	if (cache_acquire(&handle, inst, request) < 0) {
 		RETURN_MODULE_FAIL;
@@ -1070,9 +1343,11 @@ static unlang_action_t CC_HINT(nonnull) mod_method_status(rlm_rcode_t *p_result,
 
 	fr_assert(!inst->driver->acquire || handle);
 
-	cache_find(&rcode, &entry, inst, request, &handle, key, key_len);
+	cache_find(&rcode, &entry, inst, t, request, &handle, key, key_len);
 	if (rcode == RLM_MODULE_FAIL) goto finish;
 
+	if (entry) cache_local_insert(inst, t, request, entry);
+
 	rcode = (entry) ? RLM_MODULE_OK : RLM_MODULE_NOTFOUND;
 
 finish:
@@ -1091,11 +1366,12 @@ finish:
 static unlang_action_t CC_HINT(nonnull) mod_method_load(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request)
 {
 	rlm_cache_t const	*inst = talloc_get_type_abort(mctx->inst->data, rlm_cache_t);
+	rlm_cache_thread_t	*t = talloc_get_type_abort(mctx->thread, rlm_cache_thread_t);
 	rlm_rcode_t		rcode = RLM_MODULE_NOOP;
 	uint8_t			buffer[1024];
 	uint8_t const		*key;
 	ssize_t			key_len;
-	rlm_cache_entry_t 	*entry = NULL;
+	rlm_cache_entry_t 	*entry = NULL, *local;
 	rlm_cache_handle_t 	*handle = NULL;
 
 	DEBUG3("Calling %s.load", mctx->inst->name);
@@ -1111,12 +1387,18 @@ static unlang_action_t CC_HINT(nonnull) mod_method_load(rlm_rcode_t *p_result, m
 		RETURN_MODULE_FAIL;
 	}
 
+	local = cache_local_find(inst, t, request, key, key_len);
+	if (local) {
+		rcode = cache_merge(inst, request, local);
+		goto finish;
+	}
+
 	/* Good to go? */
 	if (cache_acquire(&handle, inst, request) < 0) {
 		RETURN_MODULE_FAIL;
 	}
 
-	cache_find(&rcode, &entry, inst, request, &handle, key, key_len);
+	cache_find(&rcode, &entry, inst, t, request, &handle, key, key_len);
 	if (rcode == RLM_MODULE_FAIL) goto finish;
 
 	if (!entry) {
@@ -1125,6 +1407,8 @@ static unlang_action_t CC_HINT(nonnull) mod_method_load(rlm_rcode_t *p_result, m
 		goto finish;
 	}
 
+	cache_local_insert(inst, t, request, entry);
+
 	rcode = cache_merge(inst, request, entry);
 
 finish:
@@ -1143,6 +1427,7 @@ finish:
 static unlang_action_t CC_HINT(nonnull) mod_method_store(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request)
 {
 	rlm_cache_t const	*inst = talloc_get_type_abort(mctx->inst->data, rlm_cache_t);
+	rlm_cache_thread_t	*t = talloc_get_type_abort(mctx->thread, rlm_cache_thread_t);
 	rlm_rcode_t		rcode = RLM_MODULE_NOOP;
 	uint8_t			buffer[1024];
 	uint8_t const		*key;
@@ -1190,7 +1475,7 @@ static unlang_action_t CC_HINT(nonnull) mod_method_store(rlm_rcode_t *p_result,
 	/*
 	 *	We can only alter the TTL on an entry if it exists.
 	 */
-	cache_find(&rcode, &entry, inst, request, &handle, key, key_len);
+	cache_find(&rcode, &entry, inst, t, request, &handle, key, key_len);
 	if (rcode == RLM_MODULE_FAIL) goto finish;
 
 	if (rcode == RLM_MODULE_OK) {
@@ -1200,7 +1485,7 @@ static unlang_action_t CC_HINT(nonnull) mod_method_store(rlm_rcode_t *p_result,
 
 		entry->expires = fr_unix_time_add(fr_time_to_unix_time(request->packet->timestamp), ttl);
 
-		cache_set_ttl(&rcode, inst, request, &handle, entry);
+		cache_set_ttl(&rcode, inst, t, request, &handle, entry);
 		if (rcode == RLM_MODULE_FAIL) goto finish;
 	}
 
@@ -1214,7 +1499,7 @@ static unlang_action_t CC_HINT(nonnull) mod_method_store(rlm_rcode_t *p_result,
 	if (expire) {
 		DEBUG4("Set the cache expire");
 
-		cache_expire(&rcode, inst, request, &handle, key, key_len);
+		cache_expire(&rcode, inst, t, request, &handle, key, key_len);
 		if (rcode == RLM_MODULE_FAIL) goto finish;
 	}
 
@@ -1224,7 +1509,7 @@ static unlang_action_t CC_HINT(nonnull) mod_method_store(rlm_rcode_t *p_result,
 	 *	setting the TTL, which precludes performing an
 	 *	insert.
 	 */
-	cache_insert(&rcode, inst, request, &handle, key, key_len, ttl);
+	cache_insert(&rcode, inst, t, request, &handle, key, key_len, ttl);
 	if (rcode == RLM_MODULE_OK) rcode = RLM_MODULE_UPDATED;
 
 finish:
@@ -1243,6 +1528,7 @@ finish:
 static unlang_action_t CC_HINT(nonnull) mod_method_clear(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request)
 {
 	rlm_cache_t const	*inst = talloc_get_type_abort(mctx->inst->data, rlm_cache_t);
+	rlm_cache_thread_t	*t = talloc_get_type_abort(mctx->thread, rlm_cache_thread_t);
 	rlm_rcode_t		rcode = RLM_MODULE_NOOP;
 	uint8_t			buffer[1024];
 	uint8_t const		*key;
@@ -1268,7 +1554,7 @@ static unlang_action_t CC_HINT(nonnull) mod_method_clear(rlm_rcode_t *p_result,
 		RETURN_MODULE_FAIL;
 	}
 
-	cache_find(&rcode, &entry, inst, request, &handle, key, key_len);
+	cache_find(&rcode, &entry, inst, t, request, &handle, key, key_len);
 	if (rcode == RLM_MODULE_FAIL) goto finish;
 
 	if (!entry) {
@@ -1277,7 +1563,7 @@ static unlang_action_t CC_HINT(nonnull) mod_method_clear(rlm_rcode_t *p_result,
 		goto finish;
 	}
 
-	cache_expire(&rcode, inst, request, &handle, key, key_len);
+	cache_expire(&rcode, inst, t, request, &handle, key, key_len);
 
 finish:
 	cache_unref(request, inst, entry, handle);
@@ -1295,6 +1581,7 @@ finish:
 static unlang_action_t CC_HINT(nonnull) mod_method_ttl(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request)
 {
 	rlm_cache_t const	*inst = talloc_get_type_abort(mctx->inst->data, rlm_cache_t);
+	rlm_cache_thread_t	*t = talloc_get_type_abort(mctx->thread, rlm_cache_thread_t);
 	rlm_rcode_t		rcode = RLM_MODULE_NOOP;
 	uint8_t			buffer[1024];
 	uint8_t const		*key;
@@ -1339,7 +1626,7 @@ static unlang_action_t CC_HINT(nonnull) mod_method_ttl(rlm_rcode_t *p_result, mo
 	/*
 	 *	We can only alter the TTL on an entry if it exists.
 	 */
-	cache_find(&rcode, &entry, inst, request, &handle, key, key_len);
+	cache_find(&rcode, &entry, inst, t, request, &handle, key, key_len);
 	if (rcode == RLM_MODULE_FAIL) goto finish;
 
 	if (rcode == RLM_MODULE_OK) {
@@ -1349,7 +1636,7 @@ static unlang_action_t CC_HINT(nonnull) mod_method_ttl(rlm_rcode_t *p_result, mo
 
 		entry->expires = fr_unix_time_add(fr_time_to_unix_time(request->packet->timestamp), ttl);
 
-		cache_set_ttl(&rcode, inst, request, &handle, entry);
+		cache_set_ttl(&rcode, inst, t, request, &handle, entry);
 		if (rcode == RLM_MODULE_FAIL) goto finish;
 
 		rcode = RLM_MODULE_UPDATED;
@@ -1374,11 +1661,16 @@ module_rlm_t rlm_cache = {
 	.common = {
 		.magic		= MODULE_MAGIC_INIT,
 		.name		= "cache",
-		.inst_size	= sizeof(rlm_cache_t),
-		.config		= module_config,
-		.bootstrap	= mod_bootstrap,
-		.instantiate	= mod_instantiate,
-		.detach		= mod_detach
+		.inst_size		= sizeof(rlm_cache_t),
+		.config			= module_config,
+		.bootstrap		= mod_bootstrap,
+		.instantiate		= mod_instantiate,
+		.detach			= mod_detach,
+
+		.thread_inst_size	= sizeof(rlm_cache_thread_t),
+		.thread_inst_type	= "rlm_cache_thread_t",
+		.thread_instantiate	= mod_thread_instantiate,
+		.thread_detach		= mod_thread_detach
 	},
 	.method_names = (module_method_name_t[]){
 		{ .name1 = "status", .name2 = CF_IDENT_ANY,		.method = mod_method_status },
@@ -71,8 +71,31 @@ typedef struct {
 
 	map_list_t		maps;			//!< Attribute map applied to users.
 							//!< and profiles.
+
+	struct {
+		uint32_t		max_entries;		//!< Maximum entries in each thread's local cache.
+							//!< 0 disables the local cache.
+		fr_time_delta_t		ttl;			//!< Maximum time an entry will be served from
+							//!< the local cache without consulting the driver.
+	} local;
 } rlm_cache_t;
 
+/** Per-thread instance data
+ *
+ * Holds a small, bounded, lock free cache of entries previously retrieved
+ * from the driver, so that hot keys don't incur a round trip to shared
+ * storage on every request.
+ */
+typedef struct {
+	fr_rb_tree_t		*local;			//!< Local entries, keyed on the cache key.
+	fr_dlist_head_t		lru;			//!< Local entries, most recently used first.
+
+	uint64_t		local_hits;		//!< Lookups served from the local cache.
+	uint64_t		local_misses;		//!< Lookups not found in the local cache.
+	uint64_t		hits;			//!< Lookups served by the driver.
+	uint64_t		misses;			//!< Lookups not found by the driver.
+} rlm_cache_thread_t;
+
 typedef struct {
 	uint8_t const		*key;			//!< Key used to identify entry.
 	size_t			key_len;		//!< Length of key data.
@@ -25,6 +25,7 @@
 RCSID("$Id$")
 
 #include <freeradius-devel/server/base.h>
+#include <freeradius-devel/server/file_reload.h>
 #include <freeradius-devel/server/module_rlm.h>
 #include <freeradius-devel/util/htrie.h>
 #include <freeradius-devel/util/debug.h>
@@ -59,12 +60,15 @@ typedef struct {
 	int		*field_offsets; /* field X from the file maps to array entry Y here */
 	fr_type_t	*field_types;
 	fr_rb_tree_t	*tree;
-	fr_htrie_t	*trie;
 
 	tmpl_t		*key;
 	fr_type_t	key_data_type;
 
 	map_list_t	map;		//!< if there is an "update" section in the configuration.
+
+	bool		reload_on_change;	//!< Watch the file, and reload it when it changes.
+	fr_file_reload_t *reload;		//!< Holds the current fr_htrie_t of entries.
+	CONF_SECTION	*conf;			//!< For log messages when reloading.
 } rlm_csv_t;
 
 typedef struct rlm_csv_entry_s rlm_csv_entry_t;
@@ -86,6 +90,7 @@ static const CONF_PARSER module_config[] = {
 	{ FR_CONF_OFFSET("allow_multiple_keys", FR_TYPE_BOOL, rlm_csv_t, allow_multiple_keys) },
 	{ FR_CONF_OFFSET("index_field", FR_TYPE_STRING | FR_TYPE_REQUIRED | FR_TYPE_NOT_EMPTY, rlm_csv_t, index_field_name) },
 	{ FR_CONF_OFFSET("key", FR_TYPE_TMPL, rlm_csv_t, key) },
+	{ FR_CONF_OFFSET("reload", FR_TYPE_BOOL, rlm_csv_t, reload_on_change), .dflt = "no" },
 	CONF_PARSER_TERMINATOR
 };
 
@@ -185,13 +190,13 @@ static int csv_to_key(uint8_t **out, size_t *outlen, void const *data)
 }
 
 
-static bool insert_entry(CONF_SECTION *conf, rlm_csv_t *inst, rlm_csv_entry_t *e, int lineno)
+static bool insert_entry(CONF_SECTION *conf, rlm_csv_t *inst, fr_htrie_t *trie, rlm_csv_entry_t *e, int lineno)
 {
 	rlm_csv_entry_t *old;
 
 	fr_assert(e != NULL);
 
-	old = fr_htrie_find(inst->trie, e);
+	old = fr_htrie_find(trie, e);
 	if (old) {
 		if (!inst->allow_multiple_keys && !inst->multiple_index_fields) {
 			cf_log_err(conf, "%s[%d]: Multiple entries are disallowed", inst->filename, lineno);
@@ -207,7 +212,7 @@ static bool insert_entry(CONF_SECTION *conf, rlm_csv_t *inst, rlm_csv_entry_t *e
 		return true;
 	}
 
-	if (!fr_htrie_insert(inst->trie, e)) {
+	if (!fr_htrie_insert(trie, e)) {
 		cf_log_err(conf, "Failed inserting entry for file %s line %d: %s",
 			   inst->filename, lineno, fr_strerror());
 fail:
@@ -219,13 +224,14 @@ fail:
 }
 
 
-static bool duplicate_entry(CONF_SECTION *conf, rlm_csv_t *inst, rlm_csv_entry_t *old, char *p, int lineno)
+static bool duplicate_entry(CONF_SECTION *conf, rlm_csv_t *inst, fr_htrie_t *trie, rlm_csv_entry_t *old,
+			    char *p, int lineno)
 {
 	int i;
 	fr_type_t type = inst->key_data_type;
 	rlm_csv_entry_t *e;
 
-	MEM(e = (rlm_csv_entry_t *)talloc_zero_array(inst, uint8_t,
+	MEM(e = (rlm_csv_entry_t *)talloc_zero_array(trie, uint8_t,
 						     sizeof(*e) + (inst->used_fields * sizeof(e->data[0]))));
 	talloc_set_type(e, rlm_csv_entry_t);
 
@@ -247,19 +253,19 @@ static bool duplicate_entry(CONF_SECTION *conf, rlm_csv_t *inst, rlm_csv_entry_t
 		if (old->data[i]) e->data[i] = old->data[i]; /* no need to dup it, it's never freed... */
 	}
 
-	return insert_entry(conf, inst, e, lineno);
+	return insert_entry(conf, inst, trie, e, lineno);
 }
 
 /*
  *	Convert a buffer to a CSV entry
  */
-static bool file2csv(CONF_SECTION *conf, rlm_csv_t *inst, int lineno, char *buffer)
+static bool file2csv(CONF_SECTION *conf, rlm_csv_t *inst, fr_htrie_t *trie, int lineno, char *buffer)
 {
 	rlm_csv_entry_t *e;
 	int i;
 	char *p, *q;
 
-	MEM(e = (rlm_csv_entry_t *)talloc_zero_array(inst, uint8_t,
+	MEM(e = (rlm_csv_entry_t *)talloc_zero_array(trie, uint8_t,
 						     sizeof(*e) + (inst->used_fields * sizeof(e->data[0]))));
 	talloc_set_type(e, rlm_csv_entry_t);
 
@@ -305,7 +311,7 @@ static bool file2csv(CONF_SECTION *conf, rlm_csv_t *inst, int lineno, char *buff
 				while (l) {
 					*l = '\0';
 
-					if (!duplicate_entry(conf, inst, e, p, lineno)) goto fail;
+					if (!duplicate_entry(conf, inst, trie, e, p, lineno)) goto fail;
 
 					p = l + 1;
 					l = strchr(p, ',');
@@ -359,7 +365,7 @@ static bool file2csv(CONF_SECTION *conf, rlm_csv_t *inst, int lineno, char *buff
 		goto fail;
 	}
 
-	return insert_entry(conf, inst, e, lineno);
+	return insert_entry(conf, inst, trie, e, lineno);
 }
 
 
@@ -523,7 +529,6 @@ static int mod_bootstrap(module_inst_ctx_t const *mctx)
 	char const	*p;
 	char		*q;
 	char		*fields;
-	fr_htrie_type_t	htype;
 
 	if (inst->delimiter[1]) {
 		cf_log_err(conf, "'delimiter' must be one character long");
@@ -553,23 +558,12 @@ static int mod_bootstrap(module_inst_ctx_t const *mctx)
 	/*
 	 *	IP addresses go into tries.  Everything else into binary tries.
 	 */
-	htype = fr_htrie_hint(inst->key_data_type);
-	if (htype == FR_HTRIE_INVALID) {
+	if (fr_htrie_hint(inst->key_data_type) == FR_HTRIE_INVALID) {
 		cf_log_err(conf, "Invalid data type '%s' used for CSV file.",
 			   fr_type_to_str(inst->key_data_type));
 		return -1;
 	}
 
-	inst->trie = fr_htrie_alloc(inst, htype,
-				    (fr_hash_t) csv_hash,
-				    (fr_cmp_t) csv_cmp,
-				    (fr_trie_key_t) csv_to_key,
-				    NULL);
-	if (!inst->trie) {
-		cf_log_err(conf, "Failed creating internal trie: %s", fr_strerror());
-		return -1;
-	}
-
 	if ((*inst->index_field_name == ',') || (*inst->index_field_name == *inst->delimiter)) {
 		cf_log_err(conf, "Field names cannot begin with the '%c' character", *inst->index_field_name);
 		return -1;
@@ -746,6 +740,80 @@ static int mod_bootstrap(module_inst_ctx_t const *mctx)
 }
 
 
+/*
+ *	Read the file into a new trie.
+ */
+static void *csv_file_read(void *uctx)
+{
+	rlm_csv_t	*inst = talloc_get_type_abort(uctx, rlm_csv_t);
+	CONF_SECTION	*conf = inst->conf;
+	fr_htrie_t	*trie;
+	int		lineno;
+	FILE		*fp;
+	char		buffer[8192];
+
+	trie = fr_htrie_alloc(NULL, fr_htrie_hint(inst->key_data_type),
+			      (fr_hash_t) csv_hash,
+			      (fr_cmp_t) csv_cmp,
+			      (fr_trie_key_t) csv_to_key,
+			      NULL);
+	if (!trie) {
+		cf_log_err(conf, "Failed creating internal trie: %s", fr_strerror());
+		return NULL;
+	}
+
+	fp = fopen(inst->filename, "r");
+	if (!fp) {
+		cf_log_err(conf, "Error opening filename %s: %s", inst->filename, fr_syserror(errno));
+		talloc_free(trie);
+		return NULL;
+	}
+	lineno = 1;
+
+	/*
+	 *	If there is a header in the file, then read that first.
+	 *	The field names were taken from it in mod_bootstrap(),
+	 *	and the maps refer to them, so when reloading it
+	 *	must not have changed.
+	 */
+	if (inst->header) {
+		char *p = fgets(buffer, sizeof(buffer), fp);
+		if (!p) {
+			cf_log_err(conf, "Error reading filename %s: Unexpected EOF", inst->filename);
+			goto error;
+		}
+
+		if (inst->reload) {
+			p = strchr(buffer, '\n');
+			if (p) *p = '\0';
+
+			if (strcmp(buffer, inst->fields) != 0) {
+				cf_log_err(conf, "Header of %s has changed.  The server must be restarted to use "
+					   "the new fields", inst->filename);
+				goto error;
+			}
+		}
+		lineno++;
+	}
+
+	/*
+	 *	Read the rest of the file.
+	 */
+	while (fgets(buffer, sizeof(buffer), fp) != NULL) {
+		if (!file2csv(conf, inst, trie, lineno, buffer)) {
+		error:
+			fclose(fp);
+			talloc_free(trie);
+			return NULL;
+		}
+
+		lineno++;
+	}
+	fclose(fp);
+
+	return trie;
+}
+
 /** Instantiate the module
  *
  * Creates a new instance of the module reading parameters from a configuration section.
@@ -760,14 +828,12 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 	rlm_csv_t	*inst = talloc_get_type_abort(mctx->inst->data, rlm_csv_t);
 	CONF_SECTION	*conf = mctx->inst->conf;
 	CONF_SECTION	*cs;
-	int		lineno;
-	FILE		*fp;
+	fr_htrie_t	*trie;
 	tmpl_rules_t	parse_rules = {
 		.attr = {
 			.allow_foreign = true	/* Because we don't know where we'll be called */
 		}
 	};
-	char buffer[8192];
 
 	map_list_init(&inst->map);
 	/*
@@ -800,39 +866,15 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 	/*
 	 *	Re-open the file and read it all.
 	 */
-	fp = fopen(inst->filename, "r");
-	if (!fp) {
-		cf_log_err(conf, "Error opening filename %s: %s", inst->filename, fr_syserror(errno));
-		return -1;
-	}
-	lineno = 1;
+	inst->conf = conf;
+	trie = csv_file_read(inst);
+	if (!trie) return -1;
 
-	/*
-	 *	If there is a header in the file, then read that first.
-	 *	This time we just ignore it.
-	 */
-	if (inst->header) {
-		char *p = fgets(buffer, sizeof(buffer), fp);
-		if (!p) {
-			cf_log_err(conf, "Error reading filename %s: Unexpected EOF", inst->filename);
-			fclose(fp);
-			return -1;
-		}
-		lineno++;
-	}
-
-	/*
-	 *	Read the rest of the file.
-	 */
-	while (fgets(buffer, sizeof(buffer), fp) != NULL) {
-		if (!file2csv(conf, inst, lineno, buffer)) {
-			fclose(fp);
-			return -1;
-		}
-
-		lineno++;
+	inst->reload = fr_file_reload_alloc(inst, mctx->inst->name, trie, csv_file_read, inst);
+	if (inst->reload_on_change && (fr_file_reload_watch(inst->reload, inst->filename) < 0)) {
+		cf_log_perr(conf, "Failed watching %s", inst->filename);
+		return -1;
 	}
-	fclose(fp);
 
 	return 0;
 }
@@ -904,8 +946,9 @@ static rlm_rcode_t mod_map_apply(rlm_csv_t const *inst, request_t *request,
 	rlm_rcode_t		rcode = RLM_MODULE_UPDATED;
 	rlm_csv_entry_t		*e;
 	map_t const		*map = NULL;
+	fr_htrie_t		*trie = fr_file_reload_acquire(inst->reload);
 
-	e = fr_htrie_find(inst->trie, &(rlm_csv_entry_t) { .key = UNCONST(fr_value_box_t *, key) } );
+	e = fr_htrie_find(trie, &(rlm_csv_entry_t) { .key = UNCONST(fr_value_box_t *, key) } );
 	if (!e) {
 		rcode = RLM_MODULE_NOOP;
 		goto finish;
@@ -961,6 +1004,8 @@ redo:
 	}
 
 finish:
+	fr_file_reload_release();
+
 	return rcode;
 }
 
@@ -551,6 +551,12 @@ static unlang_action_t mod_session_init(rlm_rcode_t *p_result, module_ctx_t cons
 
 	tls_session = eap_tls_session->tls_session;
 
+	/*
+	 *	We change the cipher list, options and callbacks
+	 *	of the SSL *, which SSL_clear() doesn't reset.
+	 */
+	tls_session->reuse_ssl = false;
+
 	if (inst->cipher_list) {
 		RDEBUG2("Over-riding main cipher list with '%s'", inst->cipher_list);
 
@@ -1,6 +1 @@
-TARGETNAME	:= rlm_files
-
-TARGET		:= $(TARGETNAME)$(L)
-SOURCES		:= $(TARGETNAME).c
-
-LOG_ID_LIB	= 19
+SUBMAKEFILES := rlm_files.mk rlm_files_compile.mk
@@ -25,43 +25,67 @@
 RCSID("$Id$")
 
 #include <freeradius-devel/server/base.h>
+#include <freeradius-devel/server/file_reload.h>
 #include <freeradius-devel/server/module_rlm.h>
 #include <freeradius-devel/server/pairmove.h>
 #include <freeradius-devel/server/users_file.h>
+#include <freeradius-devel/server/users_file_image.h>
+#include <freeradius-devel/unlang/interpret.h>
 #include <freeradius-devel/util/htrie.h>
 
 #include <ctype.h>
 #include <fcntl.h>
 
+/** Data read from the users files
+ *
+ * Replaced as a whole when the files are reloaded.
+ */
 typedef struct {
-	tmpl_t *key;
-	fr_type_t	key_data_type;
-
-	char const *filename;
 	fr_htrie_t *common;
 	PAIR_LIST_LIST *common_def;
+	pairlist_image_t *common_image;
 
 	/* autz */
-	char const *usersfile;
 	fr_htrie_t *users;
 	PAIR_LIST_LIST *users_def;
+	pairlist_image_t *users_image;
 
 	/* authenticate */
-	char const *auth_usersfile;
 	fr_htrie_t *auth_users;
 	PAIR_LIST_LIST *auth_users_def;
+	pairlist_image_t *auth_users_image;
 
 	/* preacct */
-	char const *acct_usersfile;
 	fr_htrie_t *acct_users;
 	PAIR_LIST_LIST *acct_users_def;
+	pairlist_image_t *acct_users_image;
 
 	/* post-authenticate */
-	char const *postauth_usersfile;
 	fr_htrie_t *postauth_users;
 	PAIR_LIST_LIST *postauth_users_def;
+	pairlist_image_t *postauth_users_image;
+} rlm_files_data_t;
+
+typedef struct {
+	tmpl_t *key;
+	fr_type_t	key_data_type;
+
+	char const *filename;
+	char const *usersfile;
+	char const *auth_usersfile;
+	char const *acct_usersfile;
+	char const *postauth_usersfile;
+
+	bool		reload_on_change;	//!< Watch the files, and reload them when they change.
+	fr_file_reload_t *reload;		//!< Holds the current #rlm_files_data_t.
+
+	uint32_t	image_cache_size;	//!< How many keys each thread keeps parsed image entries for.
 } rlm_files_t;
 
+typedef struct {
+	pairlist_image_cache_t *image_cache;	//!< Entries parsed from compiled users files.
+} rlm_files_thread_t;
+
 static fr_dict_t const *dict_freeradius;
 static fr_dict_t const *dict_radius;
 
@@ -91,6 +115,8 @@ static const CONF_PARSER module_config[] = {
 	{ FR_CONF_OFFSET("auth_usersfile", FR_TYPE_FILE_INPUT, rlm_files_t, auth_usersfile) },
 	{ FR_CONF_OFFSET("postauth_usersfile", FR_TYPE_FILE_INPUT, rlm_files_t, postauth_usersfile) },
 	{ FR_CONF_OFFSET("key", FR_TYPE_TMPL | FR_TYPE_NOT_EMPTY, rlm_files_t, key), .dflt = "%{%{Stripped-User-Name}:-%{User-Name}}", .quote = T_DOUBLE_QUOTED_STRING },
+	{ FR_CONF_OFFSET("reload", FR_TYPE_BOOL, rlm_files_t, reload_on_change), .dflt = "no" },
+	{ FR_CONF_OFFSET("image_cache_size", FR_TYPE_UINT32, rlm_files_t, image_cache_size), .dflt = "1024" },
 	CONF_PARSER_TERMINATOR
 };
 
@@ -113,7 +139,162 @@ static int pairlist_to_key(uint8_t **out, size_t *outlen, void const *a)
 	return fr_value_box_to_key(out, outlen, ((PAIR_LIST_LIST const *)a)->box);
 }
 
-static int getusersfile(TALLOC_CTX *ctx, char const *filename, fr_htrie_t **ptree, PAIR_LIST_LIST **pdefault, fr_type_t data_type)
+/** Check, and fix up, the items of an entry
+ *
+ * @param[in] entry	to check.
+ * @param[in] htype	of the tree the entry will be found with.
+ * @param[in] complain	about common mistakes.  False if the entry has
+ *			already been checked, e.g. it's from an image.
+ * @return
+ *	- 0 on success.
+ *	- -1 if the entry can't be used.
+ */
+static int files_entry_fixup(PAIR_LIST *entry, fr_htrie_type_t htype, bool complain)
+{
+	map_t *map = NULL;
+	fr_dict_attr_t const *da;
+
+	/*
+	 *	Look for improper use of '=' in the
+	 *	check items.  They should be using
+	 *	'==' for on-the-wire RADIUS attributes,
+	 *	and probably ':=' for server
+	 *	configuration items.
+	 */
+	while ((map = map_list_next(&entry->check, map))) {
+		if (!tmpl_is_attr(map->lhs)) {
+			ERROR("%s[%d] Left side of check item %s is not an attribute",
+			      entry->filename, entry->lineno, map->lhs->name);
+			return -1;
+
+		}
+		da = tmpl_attr_tail_da(map->lhs);
+
+		/*
+		 *	Ignore attributes which are set
+		 *	properly.
+		 */
+		if (map->op != T_OP_EQ) {
+			continue;
+		}
+
+		/*
+		 *	If it's a vendor attribute,
+		 *	or it's a wire protocol,
+		 *	ensure it has '=='.
+		 */
+		if ((fr_dict_vendor_num_by_da(da) != 0) ||
+		    (da->attr < 0x100)) {
+			if (complain) {
+				WARN("%s[%d] Changing '%s =' to '%s =='\n\tfor comparing RADIUS attribute in check item list for user %s",
+				     entry->filename, entry->lineno,
+				     da->name, da->name,
+				     entry->name);
+			}
+			map->op = T_OP_CMP_EQ;
+			continue;
+		}
+	} /* end of loop over check items */
+
+	/*
+	 *	Look for server configuration items
+	 *	in the reply list.
+	 *
+	 *	It's a common enough mistake, that it's
+	 *	worth doing.
+	 */
+	map = NULL;
+	while ((map = map_list_next(&entry->reply, map))) {
+		if (!tmpl_is_attr(map->lhs)) {
+			ERROR("%s[%d] Left side of reply item %s is not an attribute",
+			      entry->filename, entry->lineno, map->lhs->name);
+			return -1;
+		}
+		da = tmpl_attr_tail_da(map->lhs);
+
+		if ((htype != FR_HTRIE_TRIE) && (da == attr_next_shortest_prefix)) {
+			ERROR("%s[%d] Cannot use %s when key is not an IP / IP prefix",
+			      entry->filename, entry->lineno, da->name);
+			return -1;
+		}
+
+		/*
+		 *	If it's NOT a vendor attribute,
+		 *	and it's NOT a wire protocol
+		 *	and we ignore Fall-Through,
+		 *	then bitch about it, giving a
+		 *	good warning message.
+		 */
+		if (complain && fr_dict_attr_is_top_level(da) && (da->attr > 1000)) {
+			WARN("%s[%d] Check item \"%s\"\n"
+			     "\tfound in reply item list for user \"%s\".\n"
+			     "\tThis attribute MUST go on the first line"
+			     " with the other check items", entry->filename, entry->lineno, da->name,
+			     entry->name);
+		}
+
+		/*
+		 *	If we allow list qualifiers in
+		 *	users_file.c, then this module also
+		 *	needs to be updated.  Ensure via an
+		 *	assertion that they do not get out of
+		 *	sync.
+		 */
+		fr_assert(tmpl_list(map->lhs) == PAIR_LIST_REPLY);
+	}
+
+	return 0;
+}
+
+/** Map a compiled users file, and read its DEFAULT entries
+ *
+ * Entries with other names are only parsed when a request matches them.
+ */
+static int getusersimage(TALLOC_CTX *ctx, char const *filename, pairlist_image_t **pimage, PAIR_LIST_LIST **pdefault,
+			 fr_type_t data_type, bool reload)
+{
+	pairlist_image_t		*image;
+	pairlist_image_key_t const	*key;
+	PAIR_LIST_LIST			*default_list;
+	PAIR_LIST			*entry = NULL;
+
+	/*
+	 *	Entries are found by name, so the key has to be
+	 *	the same as the name.
+	 */
+	if (data_type != FR_TYPE_STRING) {
+		ERROR("%s is a compiled users file, which requires a 'string' key, not '%s'",
+		      filename, fr_type_to_str(data_type));
+		return -1;
+	}
+
+	image = pairlist_image_open(ctx, filename);
+	if (!image) return -1;
+
+	key = pairlist_image_find(image, "DEFAULT", 7);
+	if (key) {
+		MEM(default_list = talloc_zero(ctx, PAIR_LIST_LIST));
+		pairlist_list_init(default_list);
+		default_list->name = "DEFAULT";
+
+		if ((pairlist_image_read(default_list, dict_radius, NULL, image, key, default_list) < 0) ||
+		    (reload && (pairlist_check_reload(default_list) < 0))) return -1;
+
+		while ((entry = fr_dlist_next(&default_list->head, entry))) {
+			if (files_entry_fixup(entry, FR_HTRIE_HASH, false) < 0) return -1;
+		}
+		*pdefault = default_list;
+	}
+
+	INFO("Mapped %s, with %u entries", filename, pairlist_image_num_entries(image));
+
+	*pimage = image;
+
+	return 0;
+}
+
+static int getusersfile(TALLOC_CTX *ctx, char const *filename, fr_htrie_t **ptree, PAIR_LIST_LIST **pdefault,
+		       pairlist_image_t **pimage, fr_type_t data_type, bool reload)
 {
 	int rcode;
 	PAIR_LIST_LIST users;
@@ -129,12 +310,16 @@ static int getusersfile(TALLOC_CTX *ctx, char const *filename, fr_htrie_t **ptre
 		return 0;
 	}
 
+	if (pairlist_image_check(filename)) return getusersimage(ctx, filename, pimage, pdefault, data_type, reload);
+
 	pairlist_list_init(&users);
 	rcode = pairlist_read(ctx, dict_radius, filename, &users, 1);
 	if (rcode < 0) {
 		return -1;
 	}
 
+	if (reload && (pairlist_check_reload(&users) < 0)) return -1;
+
 	htype = fr_htrie_hint(data_type);
 
 	/*
@@ -142,95 +327,7 @@ static int getusersfile(TALLOC_CTX *ctx, char const *filename, fr_htrie_t **ptre
 	 */
 	entry = NULL;
 	while ((entry = fr_dlist_next(&users.head, entry))) {
-		map_t *map = NULL;
-		fr_dict_attr_t const *da;
-
-		/*
-		 *	Look for improper use of '=' in the
-		 *	check items.  They should be using
-		 *	'==' for on-the-wire RADIUS attributes,
-		 *	and probably ':=' for server
-		 *	configuration items.
-		 */
-		while ((map = map_list_next(&entry->check, map))) {
-			if (!tmpl_is_attr(map->lhs)) {
-				ERROR("%s[%d] Left side of check item %s is not an attribute",
-				      entry->filename, entry->lineno, map->lhs->name);
-				return -1;
-
-			}
-			da = tmpl_attr_tail_da(map->lhs);
-
-			/*
-			 *	Ignore attributes which are set
-			 *	properly.
-			 */
-			if (map->op != T_OP_EQ) {
-				continue;
-			}
-
-			/*
-			 *	If it's a vendor attribute,
-			 *	or it's a wire protocol,
-			 *	ensure it has '=='.
-			 */
-			if ((fr_dict_vendor_num_by_da(da) != 0) ||
-			    (da->attr < 0x100)) {
-				WARN("%s[%d] Changing '%s =' to '%s =='\n\tfor comparing RADIUS attribute in check item list for user %s",
-				     entry->filename, entry->lineno,
-				     da->name, da->name,
-				     entry->name);
-				map->op = T_OP_CMP_EQ;
-				continue;
-			}
-		} /* end of loop over check items */
-
-		/*
-		 *	Look for server configuration items
-		 *	in the reply list.
-		 *
-		 *	It's a common enough mistake, that it's
-		 *	worth doing.
-		 */
-		map = NULL;
-		while ((map = map_list_next(&entry->reply, map))) {
-			if (!tmpl_is_attr(map->lhs)) {
-				ERROR("%s[%d] Left side of reply item %s is not an attribute",
-				      entry->filename, entry->lineno, map->lhs->name);
-				return -1;
-			}
-			da = tmpl_attr_tail_da(map->lhs);
-
-			if ((htype != FR_HTRIE_TRIE) && (da == attr_next_shortest_prefix)) {
-				ERROR("%s[%d] Cannot use %s when key is not an IP / IP prefix",
-				      entry->filename, entry->lineno, da->name);
-				return -1;
-			}
-
-			/*
-			 *	If it's NOT a vendor attribute,
-			 *	and it's NOT a wire protocol
-			 *	and we ignore Fall-Through,
-			 *	then bitch about it, giving a
-			 *	good warning message.
-			 */
-			if (fr_dict_attr_is_top_level(da) && (da->attr > 1000)) {
-				WARN("%s[%d] Check item \"%s\"\n"
-				     "\tfound in reply item list for user \"%s\".\n"
-				     "\tThis attribute MUST go on the first line"
-				     " with the other check items", entry->filename, entry->lineno, da->name,
-				     entry->name);
-			}
-
-			/*
-			 *	If we allow list qualifiers in
-			 *	users_file.c, then this module also
-			 *	needs to be updated.  Ensure via an
-			 *	assertion that they do not get out of
-			 *	sync.
-			 */
-			fr_assert(tmpl_list(map->lhs) == PAIR_LIST_REPLY);
-		}
+		if (files_entry_fixup(entry, htype, true) < 0) return -1;
 	}
 
 	tree = fr_htrie_alloc(ctx,  htype, pairlist_hash, pairlist_cmp, pairlist_to_key, NULL);
@@ -348,11 +445,32 @@ static int getusersfile(TALLOC_CTX *ctx, char const *filename, fr_htrie_t **ptre
 
 
 /*
- *	(Re-)read the "users" file into memory.
+ *	(Re-)read the "users" files into memory.
  */
+static void *files_data_build(void *uctx)
+{
+	rlm_files_t const *inst = talloc_get_type_abort_const(uctx, rlm_files_t);
+	rlm_files_data_t *data;
+	bool reload = (inst->reload != NULL);	/* Not the initial load */
+
+	MEM(data = talloc_zero(NULL, rlm_files_data_t));
+
+#undef READFILE
+#define READFILE(_x, _y, _d) do { if (getusersfile(data, inst->_x, &data->_y, &data->_d, &data->_y ## _image, inst->key_data_type, reload) != 0) { ERROR("Failed reading %s", inst->_x); talloc_free(data); return NULL;} } while (0)
+
+	READFILE(filename, common, common_def);
+	READFILE(usersfile, users, users_def);
+	READFILE(acct_usersfile, acct_users, acct_users_def);
+	READFILE(auth_usersfile, auth_users, auth_users_def);
+	READFILE(postauth_usersfile, postauth_users, postauth_users_def);
+
+	return data;
+}
+
 static int mod_instantiate(module_inst_ctx_t const *mctx)
 {
 	rlm_files_t *inst = talloc_get_type_abort(mctx->inst->data, rlm_files_t);
+	rlm_files_data_t *data;
 
 	inst->key_data_type = tmpl_expanded_type(inst->key);
 	if (fr_htrie_hint(inst->key_data_type) == FR_HTRIE_INVALID) {
@@ -361,14 +479,38 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 		return -1;
 	}
 
-#undef READFILE
-#define READFILE(_x, _y, _d) do { if (getusersfile(inst, inst->_x, &inst->_y, &inst->_d, inst->key_data_type) != 0) { ERROR("Failed reading %s", inst->_x); return -1;} } while (0)
+	FR_INTEGER_BOUND_CHECK("image_cache_size", inst->image_cache_size, >=, 1);
 
-	READFILE(filename, common, common_def);
-	READFILE(usersfile, users, users_def);
-	READFILE(acct_usersfile, acct_users, acct_users_def);
-	READFILE(auth_usersfile, auth_users, auth_users_def);
-	READFILE(postauth_usersfile, postauth_users, postauth_users_def);
+	data = files_data_build(inst);
+	if (!data) return -1;
+
+	inst->reload = fr_file_reload_alloc(inst, mctx->inst->name, data, files_data_build, inst);
+	if (!inst->reload_on_change) return 0;
+
+#undef WATCHFILE
+#define WATCHFILE(_x) do { if (inst->_x && (fr_file_reload_watch(inst->reload, inst->_x) < 0)) { cf_log_perr(mctx->inst->conf, "Failed watching %s", inst->_x); return -1; } } while (0)
+
+	WATCHFILE(filename);
+	WATCHFILE(usersfile);
+	WATCHFILE(acct_usersfile);
+	WATCHFILE(auth_usersfile);
+	WATCHFILE(postauth_usersfile);
+
+	return 0;
+}
+
+static int _files_image_fixup(PAIR_LIST *entry, UNUSED void *uctx)
+{
+	return files_entry_fixup(entry, FR_HTRIE_HASH, false);
+}
+
+static int mod_thread_instantiate(module_thread_inst_ctx_t const *mctx)
+{
+	rlm_files_t const	*inst = talloc_get_type_abort_const(mctx->inst->data, rlm_files_t);
+	rlm_files_thread_t	*t = talloc_get_type_abort(mctx->thread, rlm_files_thread_t);
+
+	t->image_cache = pairlist_image_cache_alloc(t, dict_radius, mctx->el, inst->image_cache_size,
+						    _files_image_fixup, NULL);
 
 	return 0;
 }
@@ -376,8 +518,9 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 /*
  *	Common code called by everything below.
  */
-static unlang_action_t file_common(rlm_rcode_t *p_result, rlm_files_t const *inst,
-				   request_t *request, char const *filename, fr_htrie_t *tree, PAIR_LIST_LIST *default_list)
+static unlang_action_t file_common(rlm_rcode_t *p_result, rlm_files_t const *inst, rlm_files_thread_t *t,
+				   request_t *request, char const *filename, fr_htrie_t *tree,
+				   pairlist_image_t const *image, PAIR_LIST_LIST *default_list)
 {
 	PAIR_LIST_LIST const	*user_list;
 	PAIR_LIST const 	*user_pl, *default_pl;
@@ -386,7 +529,7 @@ static unlang_action_t file_common(rlm_rcode_t *p_result, rlm_files_t const *ins
 	uint8_t			key_buffer[16], *key;
 	size_t			keylen = 0;
 
-	if (!tree && !default_list) RETURN_MODULE_NOOP;
+	if (!tree && !image && !default_list) RETURN_MODULE_NOOP;
 
 	if (tree) {
 		fr_value_box_t *box;
@@ -433,6 +576,35 @@ static unlang_action_t file_common(rlm_rcode_t *p_result, rlm_files_t const *ins
 		talloc_free(box);
 
 		user_pl = user_list ? fr_dlist_head(&user_list->head) : NULL;
+
+	} else if (image) {
+		fr_value_box_t			*box;
+		pairlist_image_key_t const	*image_key;
+
+		if (tmpl_aexpand(request, &box, request, inst->key, NULL, NULL) < 0) {
+			REDEBUG("Failed expanding key %s", inst->key->name);
+			RETURN_MODULE_FAIL;
+		}
+
+		/*
+		 *	The key is found in the mapped image.  Only
+		 *	the entries for it are parsed, the first time
+		 *	this thread sees it.
+		 */
+		user_list = NULL;
+		image_key = pairlist_image_find(image, box->vb_strvalue, box->vb_length);
+		if (image_key && (strcmp(box->vb_strvalue, "DEFAULT") != 0)) {
+			user_list = pairlist_image_cache_find(t->image_cache, image, image_key);
+			if (!user_list) {
+				RPEDEBUG("Failed reading entries for %pV from %s", box, filename);
+				talloc_free(box);
+				RETURN_MODULE_FAIL;
+			}
+		}
+		talloc_free(box);
+
+		user_pl = user_list ? fr_dlist_head(&user_list->head) : NULL;
+
 	} else {
 		user_pl = NULL;
 		user_list = NULL;
@@ -629,10 +801,18 @@ redo:
 static unlang_action_t CC_HINT(nonnull) mod_authorize(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request)
 {
 	rlm_files_t const *inst = talloc_get_type_abort_const(mctx->inst->data, rlm_files_t);
-
-	return file_common(p_result, inst, request, inst->filename,
-			   inst->users ? inst->users : inst->common,
-			   inst->users ? inst->users_def : inst->common_def);
+	rlm_files_thread_t *t = talloc_get_type_abort(mctx->thread, rlm_files_thread_t);
+	rlm_files_data_t const *data = fr_file_reload_acquire(inst->reload);
+	bool own = (data->users || data->users_image);
+	unlang_action_t ret;
+
+	ret = file_common(p_result, inst, t, request, inst->filename,
+			  own ? data->users : data->common,
+			  own ? data->users_image : data->common_image,
+			  own ? data->users_def : data->common_def);
+	fr_file_reload_release();
+
+	return ret;
 }
 
 
@@ -644,28 +824,52 @@ static unlang_action_t CC_HINT(nonnull) mod_authorize(rlm_rcode_t *p_result, mod
 static unlang_action_t CC_HINT(nonnull) mod_preacct(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request)
 {
 	rlm_files_t const *inst = talloc_get_type_abort_const(mctx->inst->data, rlm_files_t);
-
-	return file_common(p_result, inst, request, inst->acct_usersfile,
-			   inst->acct_users ? inst->acct_users : inst->common,
-			   inst->acct_users ? inst->acct_users_def : inst->common_def);
+	rlm_files_thread_t *t = talloc_get_type_abort(mctx->thread, rlm_files_thread_t);
+	rlm_files_data_t const *data = fr_file_reload_acquire(inst->reload);
+	bool own = (data->acct_users || data->acct_users_image);
+	unlang_action_t ret;
+
+	ret = file_common(p_result, inst, t, request, inst->acct_usersfile,
+			  own ? data->acct_users : data->common,
+			  own ? data->acct_users_image : data->common_image,
+			  own ? data->acct_users_def : data->common_def);
+	fr_file_reload_release();
+
+	return ret;
 }
 
 static unlang_action_t CC_HINT(nonnull) mod_authenticate(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request)
 {
 	rlm_files_t const *inst = talloc_get_type_abort_const(mctx->inst->data, rlm_files_t);
-
-	return file_common(p_result, inst, request, inst->auth_usersfile,
-			   inst->auth_users ? inst->auth_users : inst->common,
-			   inst->auth_users ? inst->auth_users_def : inst->common_def);
+	rlm_files_thread_t *t = talloc_get_type_abort(mctx->thread, rlm_files_thread_t);
+	rlm_files_data_t const *data = fr_file_reload_acquire(inst->reload);
+	bool own = (data->auth_users || data->auth_users_image);
+	unlang_action_t ret;
+
+	ret = file_common(p_result, inst, t, request, inst->auth_usersfile,
+			  own ? data->auth_users : data->common,
+			  own ? data->auth_users_image : data->common_image,
+			  own ? data->auth_users_def : data->common_def);
+	fr_file_reload_release();
+
+	return ret;
 }
 
 static unlang_action_t CC_HINT(nonnull) mod_post_auth(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request)
 {
 	rlm_files_t const *inst = talloc_get_type_abort_const(mctx->inst->data, rlm_files_t);
-
-	return file_common(p_result, inst, request, inst->postauth_usersfile,
-			   inst->postauth_users ? inst->postauth_users : inst->common,
-			   inst->postauth_users ? inst->postauth_users_def : inst->common_def);
+	rlm_files_thread_t *t = talloc_get_type_abort(mctx->thread, rlm_files_thread_t);
+	rlm_files_data_t const *data = fr_file_reload_acquire(inst->reload);
+	bool own = (data->postauth_users || data->postauth_users_image);
+	unlang_action_t ret;
+
+	ret = file_common(p_result, inst, t, request, inst->postauth_usersfile,
+			  own ? data->postauth_users : data->common,
+			  own ? data->postauth_users_image : data->common_image,
+			  own ? data->postauth_users_def : data->common_def);
+	fr_file_reload_release();
+
+	return ret;
 }
 
 
@@ -677,7 +881,10 @@ module_rlm_t rlm_files = {
 		.name		= "files",
 		.inst_size	= sizeof(rlm_files_t),
 		.config		= module_config,
-		.instantiate	= mod_instantiate
+		.instantiate	= mod_instantiate,
+		.thread_inst_size	= sizeof(rlm_files_thread_t),
+		.thread_inst_type	= "rlm_files_thread_t",
+		.thread_instantiate	= mod_thread_instantiate
 	},
 	.method_names = (module_method_name_t[]){
 		/*
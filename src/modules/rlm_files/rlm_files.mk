@@ -0,0 +1,6 @@
+TARGETNAME	:= rlm_files
+
+TARGET		:= $(TARGETNAME)$(L)
+SOURCES		:= $(TARGETNAME).c
+
+LOG_ID_LIB	= 19
@@ -0,0 +1,178 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ * @file rlm_files_compile.c
+ * @brief Compile a users file into an image rlm_files can memory map.
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/server/base.h>
+#include <freeradius-devel/server/users_file_image.h>
+#include <freeradius-devel/util/atexit.h>
+
+#ifdef HAVE_GETOPT_H
+#  include <getopt.h>
+#endif
+
+#define EXIT_WITH_FAILURE \
+do { \
+	ret = EXIT_FAILURE; \
+	goto cleanup; \
+} while (0)
+
+static fr_dict_t const *dict_freeradius;
+static fr_dict_t const *dict_radius;
+
+extern fr_dict_autoload_t rlm_files_compile_dict[];
+fr_dict_autoload_t rlm_files_compile_dict[] = {
+	{ .out = &dict_freeradius, .proto = "freeradius" },
+	{ .out = &dict_radius, .proto = "radius" },
+	{ NULL }
+};
+
+static NEVER_RETURNS void usage(char *argv[])
+{
+	fprintf(stderr, "usage: %s [OPTS] <users file> <image file>\n", argv[0]);
+	fprintf(stderr, "  -d <raddb>         Set user dictionary directory (defaults to " RADDBDIR ").\n");
+	fprintf(stderr, "  -D <dictdir>       Set main dictionary directory (defaults to " DICTDIR ").\n");
+	fprintf(stderr, "  -x                 Debugging mode.\n");
+	fprintf(stderr, "\n");
+	fprintf(stderr, "The image must be compiled with the same dictionaries as the server which uses it.\n");
+
+	fr_exit_now(EXIT_FAILURE);
+}
+
+/**
+ *
+ * @hidecallgraph
+ */
+int main(int argc, char *argv[])
+{
+	int			c, ret = EXIT_SUCCESS;
+	char const		*raddb_dir = RADDBDIR;
+	char const		*dict_dir = DICTDIR;
+	fr_dict_t		*dict = NULL;
+
+	TALLOC_CTX		*autofree;
+
+	/*
+	 *	Must be called first, so the handler is called last
+	 */
+	fr_atexit_global_setup();
+
+	autofree = talloc_autofree_context();
+
+#ifndef NDEBUG
+	if (fr_fault_setup(autofree, getenv("PANIC_ACTION"), argv[0]) < 0) {
+		fr_perror("rlm_files_compile");
+		fr_exit(EXIT_FAILURE);
+	}
+#else
+	fr_disable_null_tracking_on_free(autofree);
+#endif
+
+	fr_time_start();
+
+	default_log.dst = L_DST_STDERR;
+	default_log.fd = STDERR_FILENO;
+	default_log.print_level = true;
+
+	while ((c = getopt(argc, argv, "d:D:xh")) != -1) switch (c) {
+		case 'd':
+			raddb_dir = optarg;
+			break;
+
+		case 'D':
+			dict_dir = optarg;
+			break;
+
+		case 'x':
+			fr_debug_lvl++;
+			break;
+
+		case 'h':
+		default:
+			usage(argv);
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc != 2) usage(argv - optind);
+
+	/*
+	 *	Mismatch between the binary and the libraries it depends on
+	 */
+	if (fr_check_lib_magic(RADIUSD_MAGIC_NUMBER) < 0) {
+		fr_perror("rlm_files_compile");
+		EXIT_WITH_FAILURE;
+	}
+
+	if (!fr_dict_global_ctx_init(NULL, true, dict_dir)) {
+		fr_perror("rlm_files_compile");
+		EXIT_WITH_FAILURE;
+	}
+
+	if (fr_dict_internal_afrom_file(&dict, FR_DICTIONARY_INTERNAL_DIR, __FILE__) < 0) {
+		fr_perror("rlm_files_compile");
+		EXIT_WITH_FAILURE;
+	}
+
+	/*
+	 *	Load the custom dictionary
+	 */
+	if (fr_dict_read(dict, raddb_dir, FR_DICTIONARY_FILE) == -1) {
+		fr_strerror_const_push("Failed to initialize the dictionaries");
+		fr_perror("rlm_files_compile");
+		EXIT_WITH_FAILURE;
+	}
+
+	if (fr_dict_autoload(rlm_files_compile_dict) < 0) {
+		fr_perror("rlm_files_compile");
+		EXIT_WITH_FAILURE;
+	}
+
+	if (pairlist_image_write(dict_radius, argv[0], argv[1]) < 0) {
+		fr_perror("rlm_files_compile");
+		EXIT_WITH_FAILURE;
+	}
+
+cleanup:
+	fr_atexit_thread_trigger_all();
+
+	xlat_free();
+
+	if (fr_dict_autofree(rlm_files_compile_dict) < 0) {
+		fr_perror("rlm_files_compile");
+		ret = EXIT_FAILURE;
+	}
+
+	if (fr_dict_free(&dict, __FILE__) < 0) {
+		fr_perror("rlm_files_compile");
+		ret = EXIT_FAILURE;
+	}
+
+	/*
+	 *	Ensure our atexit handlers run before any other
+	 *	atexit handlers registered by third party libraries.
+	 */
+	fr_atexit_global_trigger_all();
+
+	return ret;
+}
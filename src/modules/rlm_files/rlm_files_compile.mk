@@ -0,0 +1,5 @@
+TARGET		:= rlm_files_compile$(E)
+SOURCES		:= rlm_files_compile.c
+
+TGT_PREREQS	:= $(LIBFREERADIUS_SERVER)
+TGT_LDLIBS	:= $(LIBS)
@@ -111,6 +111,8 @@ static const CONF_PARSER module_config[] = {
 
 	{ FR_CONF_OFFSET("valuepair_attribute", FR_TYPE_STRING, rlm_ldap_t, valuepair_attr) },
 
+	{ FR_CONF_OFFSET("coalesce", FR_TYPE_BOOL, rlm_ldap_t, coalesce), .dflt = "no" },
+
 #ifdef LDAP_CONTROL_X_SESSION_TRACKING
 	{ FR_CONF_OFFSET("session_tracking", FR_TYPE_BOOL, rlm_ldap_t, session_tracking), .dflt = "no" },
 #endif
@@ -303,6 +305,11 @@ static void ldap_query_timeout(UNUSED fr_event_list_t *el, UNUSED fr_time_t now,
 	unlang_interpret_mark_runnable(request);
 }
 
+typedef struct {
+	fr_ldap_query_t		*query;		//!< Query being run.
+	unlang_coalesce_call_t	*call;		//!< Identical xlat queries waiting on this one.
+} ldap_xlat_rctx_t;
+
 /** Callback when resuming after async ldap query is completed
  *
  */
@@ -310,15 +317,22 @@ static xlat_action_t ldap_xlat_resume(TALLOC_CTX *ctx, fr_dcursor_t *out,
 				      xlat_ctx_t const *xctx,
 	 			      request_t *request, UNUSED FR_DLIST_HEAD(fr_value_box_list) *in)
 {
-	fr_ldap_query_t		*query = talloc_get_type_abort(xctx->rctx, fr_ldap_query_t);
+	ldap_xlat_rctx_t	*rctx = talloc_get_type_abort(xctx->rctx, ldap_xlat_rctx_t);
+	fr_ldap_query_t		*query = rctx->query;
 	fr_ldap_connection_t	*ldap_conn = query->ldap_conn;
 	fr_value_box_t		*vb = NULL;
 	LDAPMessage		*msg;
 	struct berval		**values;
 	char const		**attr;
 	int			count, i;
+	FR_DLIST_HEAD(fr_value_box_list) result;
+
+	if (query->ret != LDAP_RESULT_SUCCESS) {
+		talloc_free(rctx);
+		return XLAT_ACTION_FAIL;
+	}
 
-	if (query->ret != LDAP_RESULT_SUCCESS) return XLAT_ACTION_FAIL;
+	fr_value_box_list_init(&result);
 
 	/*
 	 *	We only parse "entries"
@@ -339,13 +353,17 @@ static xlat_action_t ldap_xlat_resume(TALLOC_CTX *ctx, fr_dcursor_t *out,
 					RPERROR("Failed creating value from LDAP response");
 					break;
 				}
-				fr_dcursor_append(out, vb);
+				fr_value_box_list_insert_tail(&result, vb);
 			}
 			ldap_value_free_len(values);
 		}
 	}
 
-	talloc_free(query);
+	if (rctx->call) unlang_coalesce_done(rctx->call, true, &result);
+
+	while ((vb = fr_value_box_list_pop_head(&result))) fr_dcursor_append(out, vb);
+
+	talloc_free(rctx);
 
 	return XLAT_ACTION_DONE;
 }
@@ -355,13 +373,13 @@ static xlat_action_t ldap_xlat_resume(TALLOC_CTX *ctx, fr_dcursor_t *out,
  */
 static void ldap_xlat_signal(xlat_ctx_t const *xctx, request_t *request, fr_state_signal_t action)
 {
-	fr_ldap_query_t		*query = talloc_get_type_abort(xctx->rctx, fr_ldap_query_t);
+	ldap_xlat_rctx_t	*rctx = talloc_get_type_abort(xctx->rctx, ldap_xlat_rctx_t);
 
 	if (action != FR_SIGNAL_CANCEL) return;
 
 	RDEBUG2("Forcefully cancelling pending LDAP query");
 
-	fr_trunk_request_signal_cancel(query->treq);
+	fr_trunk_request_signal_cancel(rctx->query->treq);
 }
 
 
@@ -400,6 +418,7 @@ static xlat_action_t ldap_xlat(UNUSED TALLOC_CTX *ctx, UNUSED fr_dcursor_t *out,
 	fr_ldap_config_t const	*handle_config = t->config;
 	fr_ldap_thread_trunk_t	*ttrunk;
 	fr_ldap_query_t		*query = NULL;
+	ldap_xlat_rctx_t	*rctx = NULL;
 
 	LDAPURLDesc		*ldap_url;
 
@@ -412,6 +431,17 @@ static xlat_action_t ldap_xlat(UNUSED TALLOC_CTX *ctx, UNUSED fr_dcursor_t *out,
 		return XLAT_ACTION_FAIL;
 	}
 
+	/*
+	 *	An identical query is already in progress,
+	 *	wait for its result instead.
+	 */
+	if (t->coalesce) {
+		unlang_coalesce_call_t *call;
+
+		call = unlang_coalesce_find(t->coalesce, in_vb->vb_strvalue, in_vb->vb_length);
+		if (call) return unlang_coalesce_xlat_yield(request, call);
+	}
+
 	if (!ldap_is_ldap_url(in_vb->vb_strvalue)) {
 		REDEBUG("String passed does not look like an LDAP URL");
 		return XLAT_ACTION_FAIL;
@@ -421,7 +451,7 @@ static xlat_action_t ldap_xlat(UNUSED TALLOC_CTX *ctx, UNUSED fr_dcursor_t *out,
 		REDEBUG("Parsing LDAP URL failed");
 	error:
 		ldap_free_urldesc(ldap_url);
-		talloc_free(query);
+		talloc_free(rctx);
 		return XLAT_ACTION_FAIL;
 	}
 
@@ -435,9 +465,10 @@ static xlat_action_t ldap_xlat(UNUSED TALLOC_CTX *ctx, UNUSED fr_dcursor_t *out,
 		goto error;
 	}
 
-	query = fr_ldap_search_alloc(unlang_interpret_frame_talloc_ctx(request),
-				     ldap_url->lud_dn, ldap_url->lud_scope, ldap_url->lud_filter,
-				     (char const * const*)ldap_url->lud_attrs, NULL, NULL);
+	MEM(rctx = talloc_zero(unlang_interpret_frame_talloc_ctx(request), ldap_xlat_rctx_t));
+	rctx->query = query = fr_ldap_search_alloc(rctx,
+						   ldap_url->lud_dn, ldap_url->lud_scope, ldap_url->lud_filter,
+						   (char const * const*)ldap_url->lud_attrs, NULL, NULL);
 	if (ldap_url->lud_exts) {
 		LDAPControl	*serverctrls[LDAP_MAX_CONTROLS];
 		int		i;
@@ -483,7 +514,12 @@ static xlat_action_t ldap_xlat(UNUSED TALLOC_CTX *ctx, UNUSED fr_dcursor_t *out,
 		goto error;
 	}
 
-	return unlang_xlat_yield(request, ldap_xlat_resume, ldap_xlat_signal, query);
+	if (t->coalesce) {
+		rctx->call = unlang_coalesce_start(rctx, t->coalesce, request,
+						   in_vb->vb_strvalue, in_vb->vb_length);
+	}
+
+	return unlang_xlat_yield(request, ldap_xlat_resume, ldap_xlat_signal, rctx);
 }
 
 /*
@@ -1684,6 +1720,8 @@ static int mod_thread_instatiate(module_thread_inst_ctx_t const *mctx)
 
 	MEM(t->binds = fr_rb_inline_talloc_alloc(t, fr_ldap_bind_auth_ctx_t, node, fr_ldap_bind_auth_cmp, NULL));
 
+	if (inst->coalesce) MEM(t->coalesce = unlang_coalesce_alloc(t));
+
 	return 0;
 }
 
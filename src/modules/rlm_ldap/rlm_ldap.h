@@ -133,6 +133,9 @@ typedef struct {
 							//!< to perform additional authorisation checks.
 #endif
 
+	bool		coalesce;			//!< Whether identical concurrent xlat queries share
+							//!< a single search.
+
 	fr_pool_t	*pool;				//!< Connection pool instance.
 	fr_ldap_config_t handle_config;			//!< Connection configuration instance.
 	fr_trunk_conf_t	trunk_conf;			//!< Trunk configuration
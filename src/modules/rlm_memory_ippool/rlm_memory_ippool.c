@@ -0,0 +1,1663 @@
+/*
+ *   This program is is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or (at
+ *   your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ * @file rlm_memory_ippool.c
+ * @brief IP Allocation module with the pools held in memory.
+ *
+ * For single node deployments which don't need the pools to be shared
+ * with other servers.
+ *
+ * Each pool is a contiguous range of IPv4 addresses.  Which addresses
+ * are in use is recorded in a bitmap, one bit per address, and each
+ * address has a lease slot holding its expiry time and the hash of the
+ * owner which last held it.
+ *
+ * Addresses are claimed by setting their bit with a compare and swap,
+ * and leases are renewed and released by a compare and swap of the
+ * lease state, so none of these take a lock.  The state holds a
+ * generation number as well as the expiry, which changes every time the
+ * address is allocated, so an operation can never act on an older lease.
+ *
+ * An address is only ever free (bit clear) when its expiry is zero, and
+ * the expiry is always zeroed before the bit is cleared.
+ *
+ * Each pool also maps owners to the address they were last given, so a
+ * device finds its lease wherever in the pool it is.  The map is a hash
+ * table guarded by a mutex, so allocations take the mutex twice: once
+ * to look the owner up, and once to record the new address.  It's only
+ * held for a single lookup or change, and never around I/O.  The map
+ * has to be exact, or a device which already holds a lease could be
+ * given a second address, and the entries for an owner and its address
+ * have to change together, which a lock free table can't do with a
+ * single compare and swap.  Renewals and releases don't use the map.
+ *
+ * Changes can be appended to a journal, which is replayed, and then
+ * compacted, when the module is instantiated.  It's compacted again by
+ * a separate thread once enough records have been appended, so workers
+ * never wait for the snapshot to be written and synced.
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+
+#define LOG_PREFIX mctx->inst->name
+
+#include <freeradius-devel/server/base.h>
+#include <freeradius-devel/server/module_rlm.h>
+
+#include <freeradius-devel/util/debug.h>
+#include <freeradius-devel/util/hash.h>
+#include <freeradius-devel/util/math.h>
+
+#include <freeradius-devel/dhcpv4/dhcpv4.h>
+
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+#else
+#  include <freeradius-devel/util/stdatomic.h>
+#endif
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+/** The largest pool we allow, a /8
+ *
+ */
+#define MEMORY_IPPOOL_MAX_SIZE		(1 << 24)
+
+/** How many bitmap words each thread checks for expired leases, per pool, per sweep
+ *
+ */
+#define MEMORY_IPPOOL_SWEEP_WORDS	64
+
+#define MEMORY_IPPOOL_JOURNAL_MAGIC	0x4950504c	/* IPPL */
+
+/** How many records are written to the journal at once when compacting it
+ *
+ */
+#define MEMORY_IPPOOL_JOURNAL_BATCH	256
+
+#define STATE_EXPIRES(_state)		((uint32_t)((_state) >> 32))
+#define STATE_GEN(_state)		((uint32_t)((_state) & 0xffffffff))
+#define STATE(_expires, _gen)		((((uint64_t)(_expires)) << 32) | (uint64_t)(_gen))
+
+typedef enum {
+	IPPOOL_RCODE_SUCCESS = 0,
+	IPPOOL_RCODE_NOT_FOUND = -1,
+	IPPOOL_RCODE_EXPIRED = -2,
+	IPPOOL_RCODE_DEVICE_MISMATCH = -3,
+	IPPOOL_RCODE_POOL_EMPTY = -4,
+	IPPOOL_RCODE_FAIL = -5
+} ippool_rcode_t;
+
+typedef enum {
+	POOL_ACTION_ALLOCATE = 1,
+	POOL_ACTION_UPDATE = 2,
+	POOL_ACTION_RELEASE = 3,
+	POOL_ACTION_BULK_RELEASE = 4,
+} ippool_action_t;
+
+/** Entry in the owner map
+ *
+ * There's one per address, which is in the map while an owner is
+ * associated with the address.
+ */
+typedef struct {
+	uint64_t		owner;		//!< Hash of the owner, or 0 if the entry isn't in the map.
+	uint32_t		idx;		//!< Of the address.
+} memory_ippool_owner_t;
+
+/** The lease slot for one address
+ *
+ */
+typedef struct {
+	atomic_uint_fast64_t	state;		//!< Expiry (upper 32 bits), and generation (lower 32 bits).
+						///< An expiry of 0 means the address isn't leased.
+	atomic_uint_fast64_t	owner;		//!< Hash of the owner which last held the address.
+						///< Kept after the lease ends, so a returning device
+						///< can be given the same address.
+} memory_ippool_lease_t;
+
+/** A pool of addresses
+ *
+ */
+typedef struct {
+	char const		*name;		//!< Of the pool, the name2 of its section.
+	uint32_t		start;		//!< First address, host byte order.
+	uint32_t		num;		//!< Number of addresses.
+	uint32_t		num_words;	//!< Number of bitmap words.
+
+	atomic_uint_fast64_t	*used;		//!< One bit per address, set if the address is leased.
+						///< Bits past the end of the pool are always set.
+	memory_ippool_lease_t	*leases;	//!< One per address.
+
+	atomic_uint_fast32_t	sweep;		//!< Next bitmap word to check for expired leases.
+
+	memory_ippool_owner_t	*owners;	//!< One per address, the entries of the owner map.
+	fr_hash_table_t		*owner_map;	//!< Owners to the address they were last given.
+	pthread_mutex_t		mutex;		//!< Guards the owner map.
+
+	fr_rb_node_t		node;		//!< Entry in the tree of pools.
+} memory_ippool_t;
+
+/** Parsed pool section
+ *
+ */
+typedef struct {
+	fr_ipaddr_t		start;
+	fr_ipaddr_t		end;
+} memory_ippool_conf_t;
+
+/** A journal record
+ *
+ * Records are written with a single write() to a file opened with O_APPEND,
+ * so records from different threads don't interleave.  They may however be
+ * written out of order, so replay doesn't depend on the order of the records.
+ * Integers are in host byte order.
+ */
+typedef struct {
+	uint32_t		magic;		//!< #MEMORY_IPPOOL_JOURNAL_MAGIC.
+	uint32_t		address;	//!< Host byte order.
+	uint64_t		owner;		//!< Hash of the lease owner.
+	uint32_t		expires;	//!< Seconds since the epoch, or 0 if the lease was released.
+	uint32_t		gen;		//!< Generation of the lease.
+} memory_ippool_journal_t;
+
+/** rlm_memory_ippool module instance
+ *
+ */
+typedef struct {
+	tmpl_t			*pool_name;	//!< Name of the pool we're allocating IP addresses from.
+
+	tmpl_t			*offer_time;	//!< How long we should reserve a lease for during
+						//!< the pre-allocation stage (typically responding
+						//!< to DHCP discover).
+	tmpl_t			*lease_time;	//!< How long an IP address should be allocated for.
+
+	tmpl_t			*owner;		//!< Unique Lease owner identifier.  Could be mac-address
+						//!< or a combination of User-Name and something
+						//!< unique to the device.
+
+	tmpl_t			*requested_address;	//!< Attribute to read the IP for renewal from.
+	tmpl_t			*allocated_address_attr;	//!< Attribute to populate with allocated IP.
+	tmpl_t			*expiry_attr;	//!< Time as which the lease will expire.
+
+	bool			copy_on_update;	//!< Copy the address provided by ip_address to the
+						//!< allocated_address_attr if updates are successful.
+
+	char const		*journal;	//!< File to record lease changes in.
+	uint32_t		journal_max_records;	//!< Compact the journal after this many records.
+	fr_time_delta_t		sweep_interval;	//!< How often each thread checks for expired leases.
+
+	fr_rb_tree_t		*pools;		//!< Pools, by name.
+
+	int			journal_fd;	//!< Open for appending.  The file it refers to is
+						///< replaced with dup2() when the journal is compacted,
+						///< so the descriptor itself never changes.
+	atomic_uint_fast32_t	journal_records;	//!< Appended since the journal was last compacted.
+
+	module_inst_ctx_t	*mctx;		//!< Copy of the instantiation ctx, for the compaction thread.
+	pthread_t		journal_thread;	//!< Compacts the journal.
+	pthread_mutex_t		journal_mutex;	//!< Protects the fields below.
+	pthread_cond_t		journal_cond;	//!< Signalled when the journal should be compacted,
+						///< or the compaction thread should exit.
+	bool			journal_thread_running;	//!< Whether the compaction thread was started.
+	bool			journal_compact;	//!< Compaction was requested.
+	bool			journal_stop;	//!< The compaction thread should exit.
+} rlm_memory_ippool_t;
+
+/** Thread specific data
+ *
+ */
+typedef struct {
+	module_thread_inst_ctx_t *mctx;		//!< Copy of the thread instantiation ctx, for the sweep timer.
+	rlm_memory_ippool_t	*inst;		//!< Instance of the module.
+	fr_event_timer_t const	*ev;		//!< Sweep timer.
+} rlm_memory_ippool_thread_t;
+
+static CONF_PARSER module_config[] = {
+	{ FR_CONF_OFFSET("pool_name", FR_TYPE_TMPL | FR_TYPE_REQUIRED, rlm_memory_ippool_t, pool_name) },
+
+	{ FR_CONF_OFFSET("owner", FR_TYPE_TMPL | FR_TYPE_REQUIRED, rlm_memory_ippool_t, owner) },
+
+	{ FR_CONF_OFFSET("offer_time", FR_TYPE_TMPL, rlm_memory_ippool_t, offer_time) },
+	{ FR_CONF_OFFSET("lease_time", FR_TYPE_TMPL | FR_TYPE_REQUIRED, rlm_memory_ippool_t, lease_time) },
+
+	{ FR_CONF_OFFSET("requested_address", FR_TYPE_TMPL, rlm_memory_ippool_t, requested_address), .dflt = "%{%{Requested-IP-Address}:-%{Client-IP-Address}}", .quote = T_DOUBLE_QUOTED_STRING },
+
+	{ FR_CONF_OFFSET("allocated_address_attr", FR_TYPE_TMPL | FR_TYPE_ATTRIBUTE, rlm_memory_ippool_t, allocated_address_attr), .dflt = "&reply.Your-IP-Address", .quote = T_BARE_WORD },
+	{ FR_CONF_OFFSET("expiry_attr", FR_TYPE_TMPL | FR_TYPE_ATTRIBUTE, rlm_memory_ippool_t, expiry_attr) },
+
+	{ FR_CONF_OFFSET("copy_on_update", FR_TYPE_BOOL, rlm_memory_ippool_t, copy_on_update), .dflt = "yes", .quote = T_BARE_WORD },
+
+	{ FR_CONF_OFFSET("journal", FR_TYPE_FILE_OUTPUT, rlm_memory_ippool_t, journal) },
+	{ FR_CONF_OFFSET("journal_max_records", FR_TYPE_UINT32, rlm_memory_ippool_t, journal_max_records), .dflt = "1048576" },
+	{ FR_CONF_OFFSET("sweep_interval", FR_TYPE_TIME_DELTA, rlm_memory_ippool_t, sweep_interval), .dflt = "1" },
+
+	CONF_PARSER_TERMINATOR
+};
+
+static CONF_PARSER pool_config[] = {
+	{ FR_CONF_OFFSET("start", FR_TYPE_IPV4_ADDR | FR_TYPE_REQUIRED, memory_ippool_conf_t, start) },
+	{ FR_CONF_OFFSET("end", FR_TYPE_IPV4_ADDR | FR_TYPE_REQUIRED, memory_ippool_conf_t, end) },
+
+	CONF_PARSER_TERMINATOR
+};
+
+static fr_dict_t const *dict_freeradius;
+static fr_dict_t const *dict_radius;
+static fr_dict_t const *dict_dhcpv4;
+
+extern fr_dict_autoload_t rlm_memory_ippool_dict[];
+fr_dict_autoload_t rlm_memory_ippool_dict[] = {
+	{ .out = &dict_freeradius, .proto = "freeradius" },
+	{ .out = &dict_radius, .proto = "radius" },
+	{ .out = &dict_dhcpv4, .proto = "dhcpv4" },
+	{ NULL }
+};
+
+static fr_dict_attr_t const *attr_pool_action;
+static fr_dict_attr_t const *attr_acct_status_type;
+static fr_dict_attr_t const *attr_message_type;
+
+extern fr_dict_attr_autoload_t rlm_memory_ippool_dict_attr[];
+fr_dict_attr_autoload_t rlm_memory_ippool_dict_attr[] = {
+	{ .out = &attr_pool_action, .name = "IP-Pool.Action", .type = FR_TYPE_UINT32, .dict = &dict_freeradius },
+	{ .out = &attr_acct_status_type, .name = "Acct-Status-Type", .type = FR_TYPE_UINT32, .dict = &dict_radius },
+	{ .out = &attr_message_type, .name = "Message-Type", .type = FR_TYPE_UINT8, .dict = &dict_dhcpv4 },
+	{ NULL }
+};
+
+static fr_value_box_t const	*enum_acct_status_type_start;
+static fr_value_box_t const	*enum_acct_status_type_interim_update;
+static fr_value_box_t const	*enum_acct_status_type_stop;
+static fr_value_box_t const	*enum_acct_status_type_on;
+static fr_value_box_t const	*enum_acct_status_type_off;
+
+extern fr_dict_enum_autoload_t rlm_memory_ippool_dict_enum[];
+fr_dict_enum_autoload_t rlm_memory_ippool_dict_enum[] = {
+	{ .out = &enum_acct_status_type_start, .name = "Start", .attr = &attr_acct_status_type },
+	{ .out = &enum_acct_status_type_interim_update, .name = "Interim-Update", .attr = &attr_acct_status_type },
+	{ .out = &enum_acct_status_type_stop, .name = "Stop", .attr = &attr_acct_status_type },
+	{ .out = &enum_acct_status_type_on, .name = "Accounting-On", .attr = &attr_acct_status_type },
+	{ .out = &enum_acct_status_type_off, .name = "Accounting-Off", .attr = &attr_acct_status_type },
+	{ NULL }
+};
+
+static int8_t pool_cmp(void const *one, void const *two)
+{
+	memory_ippool_t const *a = one, *b = two;
+
+	return CMP(strcmp(a->name, b->name), 0);
+}
+
+static uint32_t owner_hash(void const *data)
+{
+	memory_ippool_owner_t const *entry = data;
+
+	/*
+	 *	The owner is already a hash.
+	 */
+	return (uint32_t)entry->owner;
+}
+
+static int8_t owner_cmp(void const *one, void const *two)
+{
+	memory_ippool_owner_t const *a = one, *b = two;
+
+	return CMP(a->owner, b->owner);
+}
+
+/** Find the address an owner was last given
+ *
+ * @return the index of the address, or -1 if the owner isn't in the map.
+ */
+static int64_t ippool_owner_find(memory_ippool_t *pool, uint64_t owner)
+{
+	memory_ippool_owner_t	*entry;
+	int64_t			idx = -1;
+
+	pthread_mutex_lock(&pool->mutex);
+	entry = fr_hash_table_find(pool->owner_map, &(memory_ippool_owner_t){ .owner = owner });
+	if (entry) idx = entry->idx;
+	pthread_mutex_unlock(&pool->mutex);
+
+	return idx;
+}
+
+/** Associate an address with an owner
+ *
+ * Any previous owner of the address loses its entry, as does any
+ * address the owner had before.
+ *
+ * @note pool->mutex must be held.
+ */
+static void ippool_owner_set(memory_ippool_t *pool, uint32_t idx, uint64_t owner)
+{
+	memory_ippool_owner_t	*entry = &pool->owners[idx];
+	memory_ippool_owner_t	*old;
+
+	if (entry->owner == owner) return;
+
+	if (entry->owner) fr_hash_table_remove(pool->owner_map, entry);
+
+	old = fr_hash_table_remove(pool->owner_map, &(memory_ippool_owner_t){ .owner = owner });
+	if (old) old->owner = 0;
+
+	entry->owner = owner;
+	MEM(fr_hash_table_insert(pool->owner_map, entry));
+}
+
+static inline uint32_t ippool_now(void)
+{
+	return (uint32_t)fr_unix_time_to_sec(fr_time_to_unix_time(fr_time()));
+}
+
+/** Hash the owner identifier
+ *
+ * 0 is reserved for "no owner".
+ */
+static uint64_t ippool_owner_hash(uint8_t const *owner, size_t owner_len)
+{
+	uint64_t hash;
+
+	hash = ((uint64_t)fr_hash(owner, owner_len) << 32) | fr_hash_update(owner, owner_len, 0x9e3779b9);
+
+	return hash ? hash : 1;
+}
+
+/** Read the lease state and owner consistently
+ *
+ */
+static inline void ippool_lease_read(uint64_t *state, uint64_t *owner, memory_ippool_lease_t *lease)
+{
+	uint64_t check;
+
+	do {
+		*state = atomic_load_explicit(&lease->state, memory_order_acquire);
+		*owner = atomic_load_explicit(&lease->owner, memory_order_acquire);
+		check = atomic_load_explicit(&lease->state, memory_order_acquire);
+	} while (check != *state);
+}
+
+/** Record a change to a lease in the journal
+ *
+ */
+static void ippool_journal(rlm_memory_ippool_t *inst, request_t *request, memory_ippool_t const *pool,
+			   uint32_t idx, uint64_t owner, uint64_t state)
+{
+	memory_ippool_journal_t	record = {
+		.magic = MEMORY_IPPOOL_JOURNAL_MAGIC,
+		.address = pool->start + idx,
+		.owner = owner,
+		.expires = STATE_EXPIRES(state),
+		.gen = STATE_GEN(state)
+	};
+
+	if (inst->journal_fd < 0) return;
+
+	/*
+	 *	The lease is held in memory regardless, so failing
+	 *	to write the journal doesn't fail the request.
+	 */
+	if (write(inst->journal_fd, &record, sizeof(record)) != sizeof(record)) {
+		RWDEBUG("Failed writing to journal \"%s\": %s", inst->journal, fr_syserror(errno));
+		return;
+	}
+
+	atomic_fetch_add_explicit(&inst->journal_records, 1, memory_order_relaxed);
+}
+
+/** Take the lease on a claimed address
+ *
+ * The caller must have set the address' bit.  The owner map is updated
+ * to point at the address.
+ */
+static uint64_t ippool_lease_take(memory_ippool_t *pool, uint32_t idx, uint64_t owner, uint32_t expires)
+{
+	memory_ippool_lease_t	*lease = &pool->leases[idx];
+	uint64_t		state;
+
+	state = atomic_load_explicit(&lease->state, memory_order_acquire);
+	fr_assert(STATE_EXPIRES(state) == 0);
+
+	atomic_store_explicit(&lease->owner, owner, memory_order_release);
+	state = STATE(expires, STATE_GEN(state) + 1);
+	atomic_store_explicit(&lease->state, state, memory_order_release);
+
+	pthread_mutex_lock(&pool->mutex);
+	ippool_owner_set(pool, idx, owner);
+	pthread_mutex_unlock(&pool->mutex);
+
+	return state;
+}
+
+/** Try to claim a specific free address
+ *
+ */
+static bool ippool_claim(memory_ippool_t *pool, uint32_t idx)
+{
+	atomic_uint_fast64_t	*word = &pool->used[idx / 64];
+	uint64_t		bit = (uint64_t)1 << (idx % 64);
+	uint64_t		old;
+
+	old = atomic_load_explicit(word, memory_order_acquire);
+	while (!(old & bit)) {
+		if (atomic_compare_exchange_weak_explicit(word, &old, old | bit,
+							  memory_order_acq_rel, memory_order_acquire)) return true;
+	}
+
+	return false;
+}
+
+/** Try to claim any free address in a bitmap word
+ *
+ * @return the index of the address, or -1 if the word is full.
+ */
+static int64_t ippool_claim_word(memory_ippool_t *pool, uint32_t w)
+{
+	atomic_uint_fast64_t	*word = &pool->used[w];
+	uint64_t		old, bit;
+
+	old = atomic_load_explicit(word, memory_order_acquire);
+	while (~old) {
+		bit = (uint64_t)1 << (fr_low_bit_pos(~old) - 1);
+
+		if (atomic_compare_exchange_weak_explicit(word, &old, old | bit,
+							  memory_order_acq_rel, memory_order_acquire)) {
+			return ((int64_t)w * 64) + fr_low_bit_pos(bit) - 1;
+		}
+	}
+
+	return -1;
+}
+
+/** End a lease
+ *
+ * @return true if we ended it, false if the state changed underneath us.
+ */
+static bool ippool_lease_end(memory_ippool_t *pool, uint32_t idx, uint64_t state)
+{
+	if (!atomic_compare_exchange_strong_explicit(&pool->leases[idx].state, &state, STATE(0, STATE_GEN(state)),
+						     memory_order_acq_rel, memory_order_acquire)) return false;
+
+	atomic_fetch_and_explicit(&pool->used[idx / 64], ~((uint64_t)1 << (idx % 64)), memory_order_acq_rel);
+
+	return true;
+}
+
+/** Free addresses whose leases have expired
+ *
+ * @return the number of addresses freed.
+ */
+static uint32_t ippool_sweep(memory_ippool_t *pool, uint32_t first, uint32_t num_words, uint32_t now)
+{
+	uint32_t	i, freed = 0;
+
+	for (i = 0; i < num_words; i++) {
+		uint32_t	w = (first + i) % pool->num_words;
+		uint64_t	bits = atomic_load_explicit(&pool->used[w], memory_order_acquire);
+
+		while (bits) {
+			uint8_t		pos = fr_low_bit_pos(bits) - 1;
+			uint32_t	idx = (w * 64) + pos;
+			uint64_t	state;
+
+			bits &= ~((uint64_t)1 << pos);
+
+			if (idx >= pool->num) break;	/* Padding at the end of the bitmap */
+
+			/*
+			 *	An expiry of 0 means the address is being
+			 *	claimed, and the lease isn't written yet.
+			 */
+			state = atomic_load_explicit(&pool->leases[idx].state, memory_order_acquire);
+			if ((STATE_EXPIRES(state) == 0) || (STATE_EXPIRES(state) > now)) continue;
+
+			if (ippool_lease_end(pool, idx, state)) freed++;
+		}
+	}
+
+	return freed;
+}
+
+/** Allocate a new lease, or return the owner's existing one
+ *
+ */
+static ippool_rcode_t memory_ippool_allocate(rlm_memory_ippool_t *inst, request_t *request,
+					     memory_ippool_t *pool, uint64_t owner, uint32_t lease_time)
+{
+	uint32_t	now = ippool_now();
+	uint32_t	expires = now + lease_time;
+	uint32_t	home = (uint32_t)(owner % pool->num) / 64;
+	uint32_t	i, idx;
+	int64_t		claimed = -1;
+	uint64_t	state, lease_owner;
+	bool		swept = false;
+
+	/*
+	 *	Look for the owner's existing lease, or the address
+	 *	it had before.
+	 */
+	claimed = ippool_owner_find(pool, owner);
+	if (claimed >= 0) {
+		idx = (uint32_t)claimed;
+		claimed = -1;
+
+		/*
+		 *	The address may have been given to someone else
+		 *	since we looked it up.
+		 */
+		ippool_lease_read(&state, &lease_owner, &pool->leases[idx]);
+		if (lease_owner != owner) goto search;
+
+		/*
+		 *	The owner already has a lease, extend it if
+		 *	needed, and give it to them again.
+		 */
+		if (STATE_EXPIRES(state) > now) {
+			uint32_t gen = STATE_GEN(state);
+
+			while (STATE_EXPIRES(state) < expires) {
+				uint64_t new_state = STATE(expires, STATE_GEN(state));
+
+				if (atomic_compare_exchange_weak_explicit(&pool->leases[idx].state, &state, new_state,
+									  memory_order_acq_rel, memory_order_acquire)) {
+					ippool_journal(inst, request, pool, idx, owner, new_state);
+					break;
+				}
+
+				/*
+				 *	Swept, released, or even allocated to
+				 *	someone else, look for another address.
+				 */
+				if ((STATE_GEN(state) != gen) || (STATE_EXPIRES(state) <= now)) goto search;
+			}
+			claimed = idx;
+			state = atomic_load_explicit(&pool->leases[idx].state, memory_order_acquire);
+			goto done;
+		}
+
+		/*
+		 *	The owner's lease expired, but hasn't been swept yet.
+		 */
+		if ((STATE_EXPIRES(state) != 0) && ippool_lease_end(pool, idx, state)) {
+			state = STATE(0, STATE_GEN(state));
+		}
+
+		/*
+		 *	The address the owner had before is free.
+		 */
+		if ((STATE_EXPIRES(state) == 0) && ippool_claim(pool, idx)) {
+			claimed = idx;
+			goto take;
+		}
+	}
+
+	/*
+	 *	Devices start searching at a word picked by the hash
+	 *	of their owner identifier, so concurrent allocations
+	 *	are spread over the pool.
+	 */
+search:
+	for (;;) {
+		for (i = 0; i < pool->num_words; i++) {
+			claimed = ippool_claim_word(pool, (home + i) % pool->num_words);
+			if (claimed >= 0) goto take;
+		}
+
+		/*
+		 *	The pool may only look full because the sweep
+		 *	timers haven't got to some expired leases yet.
+		 */
+		if (swept || (ippool_sweep(pool, 0, pool->num_words, now) == 0)) return IPPOOL_RCODE_POOL_EMPTY;
+		swept = true;
+	}
+
+take:
+	state = ippool_lease_take(pool, (uint32_t)claimed, owner, expires);
+	ippool_journal(inst, request, pool, (uint32_t)claimed, owner, state);
+
+done:
+	/*
+	 *	Add the allocated address and expiry to the request
+	 */
+	{
+		tmpl_t	ip_rhs;
+		map_t	ip_map = {
+			.lhs = inst->allocated_address_attr,
+			.op = T_OP_SET,
+			.rhs = &ip_rhs
+		};
+
+		tmpl_init_shallow(&ip_rhs, TMPL_TYPE_DATA, T_BARE_WORD, "", 0, NULL);
+		fr_value_box(&ip_map.rhs->data.literal, (uint32_t)(pool->start + claimed), true);
+		if (fr_value_box_cast_in_place(request, &ip_map.rhs->data.literal, FR_TYPE_IPV4_ADDR, NULL) < 0) {
+			RPEDEBUG("Failed converting integer to IPv4 address");
+			return IPPOOL_RCODE_FAIL;
+		}
+		if (map_to_request(request, &ip_map, map_to_vp, NULL) < 0) return IPPOOL_RCODE_FAIL;
+	}
+
+	if (inst->expiry_attr) {
+		tmpl_t	expiry_rhs;
+		map_t	expiry_map = {
+			.lhs = inst->expiry_attr,
+			.op = T_OP_SET,
+			.rhs = &expiry_rhs
+		};
+
+		tmpl_init_shallow(&expiry_rhs, TMPL_TYPE_DATA, T_DOUBLE_QUOTED_STRING, "", 0, NULL);
+		fr_value_box(&expiry_map.rhs->data.literal, STATE_EXPIRES(state) - now, true);
+		if (map_to_request(request, &expiry_map, map_to_vp, NULL) < 0) return IPPOOL_RCODE_FAIL;
+	}
+
+	return IPPOOL_RCODE_SUCCESS;
+}
+
+/** Extend an existing lease
+ *
+ */
+static ippool_rcode_t memory_ippool_update(rlm_memory_ippool_t *inst, request_t *request,
+					   memory_ippool_t *pool, uint32_t idx, uint64_t owner, uint32_t lease_time)
+{
+	memory_ippool_lease_t	*lease = &pool->leases[idx];
+	uint32_t		now = ippool_now();
+	uint64_t		state, new_state, lease_owner;
+
+	for (;;) {
+		ippool_lease_read(&state, &lease_owner, lease);
+
+		if (lease_owner != owner) return IPPOOL_RCODE_DEVICE_MISMATCH;
+		if (STATE_EXPIRES(state) <= now) return IPPOOL_RCODE_EXPIRED;
+
+		new_state = STATE(now + lease_time, STATE_GEN(state));
+		if (atomic_compare_exchange_strong_explicit(&lease->state, &state, new_state,
+							    memory_order_acq_rel, memory_order_acquire)) break;
+	}
+
+	ippool_journal(inst, request, pool, idx, owner, new_state);
+
+	if (inst->expiry_attr) {
+		tmpl_t	expiry_rhs;
+		map_t	expiry_map = {
+			.lhs = inst->expiry_attr,
+			.op = T_OP_SET,
+			.rhs = &expiry_rhs
+		};
+
+		tmpl_init_shallow(&expiry_rhs, TMPL_TYPE_DATA, T_DOUBLE_QUOTED_STRING, "", 0, NULL);
+		fr_value_box(&expiry_map.rhs->data.literal, lease_time, true);
+		if (map_to_request(request, &expiry_map, map_to_vp, NULL) < 0) return IPPOOL_RCODE_FAIL;
+	}
+
+	return IPPOOL_RCODE_SUCCESS;
+}
+
+/** Release a lease
+ *
+ */
+static ippool_rcode_t memory_ippool_release(rlm_memory_ippool_t *inst, request_t *request,
+					    memory_ippool_t *pool, uint32_t idx, uint64_t owner)
+{
+	uint64_t state, lease_owner;
+
+	for (;;) {
+		ippool_lease_read(&state, &lease_owner, &pool->leases[idx]);
+
+		if (lease_owner != owner) return IPPOOL_RCODE_DEVICE_MISMATCH;
+		if (STATE_EXPIRES(state) == 0) return IPPOOL_RCODE_SUCCESS;	/* Already free */
+
+		if (ippool_lease_end(pool, idx, state)) break;
+	}
+
+	ippool_journal(inst, request, pool, idx, owner, STATE(0, STATE_GEN(state)));
+
+	return IPPOOL_RCODE_SUCCESS;
+}
+
+/** Expand a time tmpl to an integer number of seconds
+ *
+ */
+static int ippool_expand_time(uint32_t *out, request_t *request, tmpl_t const *vpt, char const *name)
+{
+	char		buff[20];
+	char const	*p;
+	char		*q;
+	unsigned long	value;
+
+	if (tmpl_expand(&p, buff, sizeof(buff), request, vpt, NULL, NULL) < 0) {
+		REDEBUG("Failed expanding %s (%s)", name, vpt->name);
+		return -1;
+	}
+
+	value = strtoul(p, &q, 10);
+	if ((q == p) || (*q != '\0') || (value > UINT32_MAX / 2)) {
+		REDEBUG("Invalid %s.  Must be an integer value", name);
+		return -1;
+	}
+	*out = (uint32_t)value;
+
+	return 0;
+}
+
+/** Find the requested address in the pool
+ *
+ * If no address was requested, the address the owner was last given
+ * is used instead.
+ *
+ * @return
+ *	- 0 on success.
+ *	- -1 on error.
+ *	- -2 if the address isn't in the pool.
+ *	- -3 if no address was requested, and the owner hasn't been given one.
+ */
+static int ippool_requested_address(uint32_t *idx, char const **ip_str, char buff[static FR_IPADDR_STRLEN],
+				    rlm_memory_ippool_t const *inst, request_t *request, memory_ippool_t *pool,
+				    uint64_t owner)
+{
+	fr_ipaddr_t	ip;
+	uint32_t	addr;
+	ssize_t		slen;
+	int64_t		found;
+
+	if (tmpl_is_attr(inst->requested_address) && (tmpl_find_vp(NULL, request, inst->requested_address) < 0)) {
+		slen = 0;
+	} else {
+		slen = tmpl_expand(ip_str, buff, FR_IPADDR_STRLEN, request, inst->requested_address, NULL, NULL);
+		if (slen < 0) {
+			REDEBUG("Failed expanding requested_address (%s)", inst->requested_address->name);
+			return -1;
+		}
+	}
+
+	if (slen == 0) {
+		found = ippool_owner_find(pool, owner);
+		if (found < 0) return -3;
+
+		ip = (fr_ipaddr_t){
+			.af = AF_INET,
+			.prefix = 32,
+			.addr.v4.s_addr = htonl(pool->start + (uint32_t)found)
+		};
+		*ip_str = fr_inet_ntop(buff, FR_IPADDR_STRLEN, &ip);
+		*idx = (uint32_t)found;
+
+		return 0;
+	}
+
+	if (fr_inet_pton(&ip, *ip_str, -1, AF_UNSPEC, false, true) < 0) {
+		RPEDEBUG("Failed parsing address");
+		return -1;
+	}
+
+	if (ip.af != AF_INET) return -2;
+
+	addr = ntohl(ip.addr.v4.s_addr);
+	if ((addr < pool->start) || ((addr - pool->start) >= pool->num)) return -2;
+
+	*idx = addr - pool->start;
+
+	return 0;
+}
+
+static unlang_action_t mod_action(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request, ippool_action_t action)
+{
+	rlm_memory_ippool_t		*inst = talloc_get_type_abort(mctx->inst->data, rlm_memory_ippool_t);
+	char				pool_name_buff[256], owner_buff[256], ip_buff[FR_IPADDR_STRLEN];
+	char const			*pool_name, *owner, *ip_str;
+	ssize_t				slen;
+	memory_ippool_t			*pool;
+	uint64_t			owner_hash;
+	uint32_t			lease_time, idx;
+
+	slen = tmpl_expand(&pool_name, pool_name_buff, sizeof(pool_name_buff), request, inst->pool_name, NULL, NULL);
+	if (slen < 0) {
+		REDEBUG("Failed expanding pool name (%s)", inst->pool_name->name);
+		RETURN_MODULE_FAIL;
+	}
+	if (slen == 0) {
+		RDEBUG2("Empty pool name.  Doing nothing");
+		RETURN_MODULE_NOOP;
+	}
+
+	pool = fr_rb_find(inst->pools, &(memory_ippool_t){ .name = pool_name });
+	if (!pool) {
+		RWDEBUG("No pool named \"%s\"", pool_name);
+		RETURN_MODULE_NOTFOUND;
+	}
+
+	slen = tmpl_expand(&owner, owner_buff, sizeof(owner_buff), request, inst->owner, NULL, NULL);
+	if (slen < 0) {
+		REDEBUG("Failed expanding device (%s)", inst->owner->name);
+		RETURN_MODULE_FAIL;
+	}
+	owner_hash = ippool_owner_hash((uint8_t const *)owner, (size_t)slen);
+
+	switch (action) {
+	case POOL_ACTION_ALLOCATE:
+		if (ippool_expand_time(&lease_time, request, inst->offer_time, "offer_time") < 0) RETURN_MODULE_FAIL;
+
+		RDEBUG2("Allocating lease from pool \"%s\" to owner \"%s\" for %u seconds", pool->name, owner, lease_time);
+
+		switch (memory_ippool_allocate(inst, request, pool, owner_hash, lease_time)) {
+		case IPPOOL_RCODE_SUCCESS:
+			RDEBUG2("IP address lease allocated");
+			RETURN_MODULE_UPDATED;
+
+		case IPPOOL_RCODE_POOL_EMPTY:
+			RWDEBUG("Pool contains no free addresses");
+			RETURN_MODULE_NOTFOUND;
+
+		default:
+			RETURN_MODULE_FAIL;
+		}
+
+	case POOL_ACTION_UPDATE:
+		if (ippool_expand_time(&lease_time, request, inst->lease_time, "lease_time") < 0) RETURN_MODULE_FAIL;
+
+		switch (ippool_requested_address(&idx, &ip_str, ip_buff, inst, request, pool, owner_hash)) {
+		case 0:
+			break;
+
+		/*
+		 *	It's useful to be able to identify the 'not found' case
+		 *	as we can relay to a server where the IP address might
+		 *	be found.  This extremely useful for migrations.
+		 */
+		case -2:
+			REDEBUG("Requested IP address \"%s\" is not a member of the specified pool", ip_str);
+			RETURN_MODULE_NOTFOUND;
+
+		case -3:
+			REDEBUG("No address requested, and owner \"%s\" has no lease in pool \"%s\"", owner, pool->name);
+			RETURN_MODULE_NOTFOUND;
+
+		default:
+			RETURN_MODULE_FAIL;
+		}
+
+		RDEBUG2("Updating lease on %s in pool \"%s\" for owner \"%s\", %u seconds",
+			ip_str, pool->name, owner, lease_time);
+
+		switch (memory_ippool_update(inst, request, pool, idx, owner_hash, lease_time)) {
+		case IPPOOL_RCODE_SUCCESS:
+			RDEBUG2("Requested IP address' \"%s\" lease updated", ip_str);
+
+			/*
+			 *	Copy over the input IP address to the reply attribute
+			 */
+			if (inst->copy_on_update) {
+				tmpl_t ip_rhs = {
+					.name = "",
+					.type = TMPL_TYPE_DATA,
+					.quote = T_BARE_WORD,
+				};
+				map_t ip_map = {
+					.lhs = inst->allocated_address_attr,
+					.op = T_OP_SET,
+					.rhs = &ip_rhs
+				};
+
+				fr_value_box_strdup_shallow(&ip_rhs.data.literal, NULL, ip_str, false);
+
+				if (map_to_request(request, &ip_map, map_to_vp, NULL) < 0) RETURN_MODULE_FAIL;
+			}
+			RETURN_MODULE_UPDATED;
+
+		case IPPOOL_RCODE_EXPIRED:
+			REDEBUG("Requested IP address' \"%s\" lease already expired at time of renewal", ip_str);
+			RETURN_MODULE_INVALID;
+
+		case IPPOOL_RCODE_DEVICE_MISMATCH:
+			REDEBUG("Requested IP address' \"%s\" lease allocated to another device", ip_str);
+			RETURN_MODULE_INVALID;
+
+		default:
+			RETURN_MODULE_FAIL;
+		}
+
+	case POOL_ACTION_RELEASE:
+		switch (ippool_requested_address(&idx, &ip_str, ip_buff, inst, request, pool, owner_hash)) {
+		case 0:
+			break;
+
+		case -2:
+			REDEBUG("Requested IP address \"%s\" is not a member of the specified pool", ip_str);
+			RETURN_MODULE_NOTFOUND;
+
+		case -3:
+			REDEBUG("No address requested, and owner \"%s\" has no lease in pool \"%s\"", owner, pool->name);
+			RETURN_MODULE_NOTFOUND;
+
+		default:
+			RETURN_MODULE_FAIL;
+		}
+
+		RDEBUG2("Releasing %s in pool \"%s\" for owner \"%s\"", ip_str, pool->name, owner);
+
+		switch (memory_ippool_release(inst, request, pool, idx, owner_hash)) {
+		case IPPOOL_RCODE_SUCCESS:
+			RDEBUG2("IP address \"%s\" released", ip_str);
+			RETURN_MODULE_UPDATED;
+
+		case IPPOOL_RCODE_DEVICE_MISMATCH:
+			REDEBUG("Requested IP address' \"%s\" lease allocated to another device", ip_str);
+			RETURN_MODULE_INVALID;
+
+		default:
+			RETURN_MODULE_FAIL;
+		}
+
+	case POOL_ACTION_BULK_RELEASE:
+		RDEBUG2("Bulk release not yet implemented");
+		RETURN_MODULE_NOOP;
+
+	default:
+		fr_assert(0);
+		RETURN_MODULE_FAIL;
+	}
+}
+
+static unlang_action_t CC_HINT(nonnull) mod_accounting(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request)
+{
+	fr_pair_t			*vp;
+
+	/*
+	 *	IP-Pool.Action override
+	 */
+	vp = fr_pair_find_by_da(&request->control_pairs, NULL, attr_pool_action);
+	if (vp) return mod_action(p_result, mctx, request, vp->vp_uint32);
+
+	/*
+	 *	Otherwise, guess the action by Acct-Status-Type
+	 */
+	vp = fr_pair_find_by_da(&request->request_pairs, NULL, attr_acct_status_type);
+	if (!vp) {
+		RDEBUG2("Couldn't find &request.Acct-Status-Type or &control.IP-Pool.Action, doing nothing...");
+		RETURN_MODULE_NOOP;
+	}
+
+	if ((vp->vp_uint32 == enum_acct_status_type_start->vb_uint32) ||
+	    (vp->vp_uint32 == enum_acct_status_type_interim_update->vb_uint32)) {
+		return mod_action(p_result, mctx, request, POOL_ACTION_UPDATE);
+
+	} else if (vp->vp_uint32 == enum_acct_status_type_stop->vb_uint32) {
+		return mod_action(p_result, mctx, request, POOL_ACTION_RELEASE);
+
+	} else if ((vp->vp_uint32 == enum_acct_status_type_on->vb_uint32) ||
+		   (vp->vp_uint32 == enum_acct_status_type_off->vb_uint32)) {
+		return mod_action(p_result, mctx, request, POOL_ACTION_BULK_RELEASE);
+
+	}
+
+	RETURN_MODULE_NOOP;
+}
+
+static unlang_action_t CC_HINT(nonnull) mod_alloc(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request)
+{
+	fr_pair_t			*vp;
+
+	vp = fr_pair_find_by_da(&request->control_pairs, NULL, attr_pool_action);
+	return mod_action(p_result, mctx, request, vp ? vp->vp_uint32 : POOL_ACTION_ALLOCATE);
+}
+
+static unlang_action_t CC_HINT(nonnull) mod_post_auth(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request)
+{
+	fr_pair_t			*vp;
+	ippool_action_t			action = POOL_ACTION_ALLOCATE;
+
+	/*
+	 *	Unless it's overridden the default action is to allocate
+	 *	when called in Post-Auth.
+	 */
+	vp = fr_pair_find_by_da(&request->control_pairs, NULL, attr_pool_action);
+	if (vp) {
+		if ((vp->vp_uint32 > 0) && (vp->vp_uint32 <= POOL_ACTION_BULK_RELEASE)) {
+			action = vp->vp_uint32;
+
+		} else {
+			RWDEBUG("Ignoring invalid action %d", vp->vp_uint32);
+			RETURN_MODULE_NOOP;
+		}
+
+	} else if (request->dict == dict_dhcpv4) {
+		vp = fr_pair_find_by_da(&request->control_pairs, NULL, attr_message_type);
+		if (vp && (vp->vp_uint8 == FR_DHCP_REQUEST)) action = POOL_ACTION_UPDATE;
+	}
+
+	return mod_action(p_result, mctx, request, action);
+}
+
+static unlang_action_t CC_HINT(nonnull) mod_update(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request)
+{
+	fr_pair_t			*vp;
+
+	vp = fr_pair_find_by_da(&request->control_pairs, NULL, attr_pool_action);
+	return mod_action(p_result, mctx, request, vp ? vp->vp_uint32 : POOL_ACTION_UPDATE);
+}
+
+static unlang_action_t CC_HINT(nonnull) mod_release(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request)
+{
+	fr_pair_t			*vp;
+
+	vp = fr_pair_find_by_da(&request->control_pairs, NULL, attr_pool_action);
+	return mod_action(p_result, mctx, request, vp ? vp->vp_uint32 : POOL_ACTION_RELEASE);
+}
+
+/** Find the pool containing an address
+ *
+ * Only used when replaying the journal, so a linear search is fine.
+ */
+static memory_ippool_t *ippool_by_address(rlm_memory_ippool_t const *inst, uint32_t addr)
+{
+	memory_ippool_t		*pool;
+	fr_rb_iter_inorder_t	iter;
+
+	for (pool = fr_rb_iter_init_inorder(&iter, inst->pools);
+	     pool;
+	     pool = fr_rb_iter_next_inorder(&iter)) {
+		if ((addr >= pool->start) && ((addr - pool->start) < pool->num)) return pool;
+	}
+
+	return NULL;
+}
+
+/** Replay a journal file
+ *
+ * Replay doesn't depend on the order of the records.  A record with a
+ * higher generation replaces the lease.  Within a generation, a release
+ * ends the lease, and otherwise the latest expiry wins.
+ *
+ * @return
+ *	- 0 on success, or if the file doesn't exist.
+ *	- -1 on error.
+ */
+static int ippool_journal_replay(module_inst_ctx_t const *mctx, char const *file, uint32_t *num_records)
+{
+	rlm_memory_ippool_t		*inst = talloc_get_type_abort(mctx->inst->data, rlm_memory_ippool_t);
+	memory_ippool_journal_t		record;
+	memory_ippool_t			*pool;
+	ssize_t				slen;
+	int				fd;
+
+	fd = open(file, O_RDONLY);
+	if (fd < 0) {
+		if (errno == ENOENT) return 0;
+
+		ERROR("Failed opening journal \"%s\": %s", file, fr_syserror(errno));
+		return -1;
+	}
+
+	while ((slen = read(fd, &record, sizeof(record))) == sizeof(record)) {
+		uint64_t	state, old;
+		uint32_t	idx;
+
+		if (record.magic != MEMORY_IPPOOL_JOURNAL_MAGIC) {
+			ERROR("Journal \"%s\" is corrupt at record %u", file, *num_records);
+			close(fd);
+			return -1;
+		}
+		(*num_records)++;
+
+		/*
+		 *	The pool may have been removed, or shrunk.
+		 */
+		pool = ippool_by_address(inst, record.address);
+		if (!pool) continue;
+		idx = record.address - pool->start;
+
+		old = atomic_load_explicit(&pool->leases[idx].state, memory_order_relaxed);
+		if (record.gen < STATE_GEN(old)) continue;
+		if (record.gen == STATE_GEN(old)) {
+			if (STATE_EXPIRES(old) == 0) continue;
+			if ((record.expires != 0) && (record.expires < STATE_EXPIRES(old))) continue;
+		}
+
+		state = STATE(record.expires, record.gen);
+		atomic_store_explicit(&pool->leases[idx].state, state, memory_order_relaxed);
+		atomic_store_explicit(&pool->leases[idx].owner, record.owner, memory_order_relaxed);
+	}
+	if (slen < 0) {
+		ERROR("Failed reading journal \"%s\": %s", file, fr_syserror(errno));
+		close(fd);
+		return -1;
+	}
+	close(fd);
+
+	/*
+	 *	A partial record at the end was being written when
+	 *	we stopped.  The lease it records was never confirmed
+	 *	to the client, so it's safe to ignore.
+	 */
+	if (slen > 0) WARN("Ignoring partial record at the end of journal \"%s\"", file);
+
+	return 0;
+}
+
+/** Write a record for every address which has an owner
+ *
+ * Records are written in batches, each with a single write(), so they
+ * don't interleave with records appended by other threads.
+ */
+static int ippool_journal_snapshot(rlm_memory_ippool_t const *inst, int fd, uint32_t *num_records)
+{
+	memory_ippool_journal_t		records[MEMORY_IPPOOL_JOURNAL_BATCH];
+	memory_ippool_t			*pool;
+	fr_rb_iter_inorder_t		iter;
+	size_t				used = 0;
+
+	for (pool = fr_rb_iter_init_inorder(&iter, inst->pools);
+	     pool;
+	     pool = fr_rb_iter_next_inorder(&iter)) {
+		uint32_t idx;
+
+		for (idx = 0; idx < pool->num; idx++) {
+			uint64_t state, owner;
+
+			ippool_lease_read(&state, &owner, &pool->leases[idx]);
+			if (!owner) continue;
+
+			records[used++] = (memory_ippool_journal_t){
+				.magic = MEMORY_IPPOOL_JOURNAL_MAGIC,
+				.address = pool->start + idx,
+				.owner = owner,
+				.expires = STATE_EXPIRES(state),
+				.gen = STATE_GEN(state)
+			};
+			(*num_records)++;
+
+			if (used < NUM_ELEMENTS(records)) continue;
+
+			if (write(fd, records, sizeof(records)) != sizeof(records)) return -1;
+			used = 0;
+		}
+	}
+
+	if (used && (write(fd, records, used * sizeof(records[0])) != (ssize_t)(used * sizeof(records[0])))) return -1;
+
+	return 0;
+}
+
+/** Replay the journal, then replace it with one record per address
+ *
+ */
+static int ippool_journal_load(module_inst_ctx_t const *mctx)
+{
+	rlm_memory_ippool_t		*inst = talloc_get_type_abort(mctx->inst->data, rlm_memory_ippool_t);
+	memory_ippool_t			*pool;
+	fr_rb_iter_inorder_t		iter;
+	uint32_t			now = ippool_now(), num_records = 0, num_leases = 0;
+	char				*tmp;
+	int				fd;
+
+	tmp = talloc_asprintf(inst, "%s.tmp", inst->journal);
+
+	/*
+	 *	If we stopped while compacting the journal, the
+	 *	replacement holds the records appended since the
+	 *	compaction started, so it's replayed too.
+	 */
+	if ((ippool_journal_replay(mctx, inst->journal, &num_records) < 0) ||
+	    (ippool_journal_replay(mctx, tmp, &num_records) < 0)) {
+	error:
+		talloc_free(tmp);
+		return -1;
+	}
+
+	/*
+	 *	Nothing else is running yet, so the owner maps don't
+	 *	need locking.
+	 */
+	for (pool = fr_rb_iter_init_inorder(&iter, inst->pools);
+	     pool;
+	     pool = fr_rb_iter_next_inorder(&iter)) {
+		uint32_t idx;
+
+		for (idx = 0; idx < pool->num; idx++) {
+			memory_ippool_lease_t	*lease = &pool->leases[idx];
+			uint64_t		state = atomic_load_explicit(&lease->state, memory_order_relaxed);
+			uint64_t		owner = atomic_load_explicit(&lease->owner, memory_order_relaxed);
+
+			if (!owner) continue;
+
+			/*
+			 *	Leases which expired while we were stopped
+			 *	are ended.  The owner is kept, so the device
+			 *	can still get the same address back.
+			 */
+			if (STATE_EXPIRES(state) <= now) {
+				state = STATE(0, STATE_GEN(state));
+				atomic_store_explicit(&lease->state, state, memory_order_relaxed);
+			} else {
+				atomic_fetch_or_explicit(&pool->used[idx / 64], (uint64_t)1 << (idx % 64),
+							 memory_order_relaxed);
+				num_leases++;
+			}
+
+			/*
+			 *	An owner which was given a new address is
+			 *	recorded against both.  Prefer the one it
+			 *	holds a lease on.
+			 */
+			if ((STATE_EXPIRES(state) != 0) ||
+			    !fr_hash_table_find(pool->owner_map, &(memory_ippool_owner_t){ .owner = owner })) {
+				ippool_owner_set(pool, idx, owner);
+			}
+		}
+	}
+
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+	if (fd < 0) {
+		ERROR("Failed creating journal \"%s\": %s", tmp, fr_syserror(errno));
+		goto error;
+	}
+
+	if ((ippool_journal_snapshot(inst, fd, &(uint32_t){ 0 }) < 0) || (fsync(fd) < 0)) {
+		ERROR("Failed writing journal \"%s\": %s", tmp, fr_syserror(errno));
+		close(fd);
+		unlink(tmp);
+		goto error;
+	}
+
+	if (close(fd) < 0) {
+		ERROR("Failed writing journal \"%s\": %s", tmp, fr_syserror(errno));
+		unlink(tmp);
+		goto error;
+	}
+
+	if (rename(tmp, inst->journal) < 0) {
+		ERROR("Failed replacing journal \"%s\": %s", inst->journal, fr_syserror(errno));
+		unlink(tmp);
+		goto error;
+	}
+	talloc_free(tmp);
+
+	inst->journal_fd = open(inst->journal, O_WRONLY | O_APPEND);
+	if (inst->journal_fd < 0) {
+		ERROR("Failed opening journal \"%s\": %s", inst->journal, fr_syserror(errno));
+		return -1;
+	}
+
+	DEBUG("Replayed %u journal records, %u addresses are leased", num_records, num_leases);
+
+	return 0;
+}
+
+/** Replace the journal with one record per address, while the server is running
+ *
+ * The replacement is swapped in with dup2() before the snapshot is taken,
+ * so records appended while it's taken go to the replacement, and no change
+ * is lost.  If we stop before the replacement is renamed over the journal,
+ * both files are replayed at startup.
+ *
+ * @note Only called from the compaction thread.
+ */
+static void ippool_journal_compact(module_inst_ctx_t const *mctx, rlm_memory_ippool_t *inst)
+{
+	char		*tmp;
+	uint32_t	num_records = 0;
+	int		fd;
+
+	MEM(tmp = talloc_asprintf(NULL, "%s.tmp", inst->journal));
+
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, S_IRUSR | S_IWUSR);
+	if (fd < 0) {
+		ERROR("Failed creating journal \"%s\": %s", tmp, fr_syserror(errno));
+		goto done;
+	}
+
+	if (dup2(fd, inst->journal_fd) < 0) {
+		ERROR("Failed switching to journal \"%s\": %s", tmp, fr_syserror(errno));
+		close(fd);
+		unlink(tmp);
+		goto done;
+	}
+	close(fd);
+	atomic_store_explicit(&inst->journal_records, 0, memory_order_relaxed);
+
+	/*
+	 *	On failure the replacement is left where it is, as
+	 *	it's receiving records.  The next compaction starts
+	 *	it again.
+	 */
+	if ((ippool_journal_snapshot(inst, inst->journal_fd, &num_records) < 0) || (fsync(inst->journal_fd) < 0)) {
+		ERROR("Failed writing journal \"%s\": %s", tmp, fr_syserror(errno));
+		goto done;
+	}
+
+	if (rename(tmp, inst->journal) < 0) {
+		ERROR("Failed replacing journal \"%s\": %s", inst->journal, fr_syserror(errno));
+		goto done;
+	}
+
+	DEBUG2("Compacted journal \"%s\" to %u records", inst->journal, num_records);
+
+done:
+	talloc_free(tmp);
+}
+
+static void *ippool_journal_thread(void *arg)
+{
+	rlm_memory_ippool_t	*inst = talloc_get_type_abort(arg, rlm_memory_ippool_t);
+	module_inst_ctx_t const	*mctx = inst->mctx;
+
+	pthread_mutex_lock(&inst->journal_mutex);
+	for (;;) {
+		while (!inst->journal_compact && !inst->journal_stop) {
+			pthread_cond_wait(&inst->journal_cond, &inst->journal_mutex);
+		}
+		if (inst->journal_stop) break;
+		inst->journal_compact = false;
+		pthread_mutex_unlock(&inst->journal_mutex);
+
+		ippool_journal_compact(mctx, inst);
+
+		pthread_mutex_lock(&inst->journal_mutex);
+	}
+	pthread_mutex_unlock(&inst->journal_mutex);
+
+	return NULL;
+}
+
+/** Ask the compaction thread to compact the journal
+ *
+ */
+static void ippool_journal_compact_request(rlm_memory_ippool_t *inst)
+{
+	pthread_mutex_lock(&inst->journal_mutex);
+	if (inst->journal_thread_running && !inst->journal_compact) {
+		inst->journal_compact = true;
+		pthread_cond_signal(&inst->journal_cond);
+	}
+	pthread_mutex_unlock(&inst->journal_mutex);
+}
+
+static void ippool_sweep_timer(fr_event_list_t *el, UNUSED fr_time_t now, void *uctx)
+{
+	rlm_memory_ippool_thread_t	*t = talloc_get_type_abort(uctx, rlm_memory_ippool_thread_t);
+	module_thread_inst_ctx_t const	*mctx = t->mctx;
+	memory_ippool_t			*pool;
+	fr_rb_iter_inorder_t		iter;
+	uint32_t			unix_now = ippool_now();
+
+	/*
+	 *	Each thread sweeps part of every pool, so between them
+	 *	the threads cover all of the pools.
+	 */
+	for (pool = fr_rb_iter_init_inorder(&iter, t->inst->pools);
+	     pool;
+	     pool = fr_rb_iter_next_inorder(&iter)) {
+		uint32_t first = atomic_fetch_add_explicit(&pool->sweep, MEMORY_IPPOOL_SWEEP_WORDS,
+							  memory_order_relaxed) % pool->num_words;
+
+		(void) ippool_sweep(pool, first, MEMORY_IPPOOL_SWEEP_WORDS < pool->num_words ?
+				    MEMORY_IPPOOL_SWEEP_WORDS : pool->num_words, unix_now);
+	}
+
+	if ((t->inst->journal_fd >= 0) &&
+	    (atomic_load_explicit(&t->inst->journal_records, memory_order_relaxed) >= t->inst->journal_max_records)) {
+		ippool_journal_compact_request(t->inst);
+	}
+
+	if (fr_event_timer_in(t, el, &t->ev, t->inst->sweep_interval, ippool_sweep_timer, t) < 0) {
+		ERROR("Failed inserting sweep timer");
+	}
+}
+
+static int mod_instantiate(module_inst_ctx_t const *mctx)
+{
+	rlm_memory_ippool_t		*inst = talloc_get_type_abort(mctx->inst->data, rlm_memory_ippool_t);
+	CONF_SECTION			*conf = mctx->inst->conf;
+	CONF_SECTION			*cs = NULL;
+	memory_ippool_t			*pool;
+	fr_rb_iter_inorder_t		iter;
+	int				ret;
+
+	fr_assert(tmpl_is_attr(inst->allocated_address_attr));
+
+	FR_INTEGER_BOUND_CHECK("journal_max_records", inst->journal_max_records, >=, 1);
+
+	inst->journal_fd = -1;
+	atomic_init(&inst->journal_records, 0);
+	if ((ret = pthread_mutex_init(&inst->journal_mutex, NULL)) != 0) {
+		ERROR("Failed initializing mutex: %s", fr_syserror(ret));
+		return -1;
+	}
+	if ((ret = pthread_cond_init(&inst->journal_cond, NULL)) != 0) {
+		pthread_mutex_destroy(&inst->journal_mutex);
+		ERROR("Failed initializing condition variable: %s", fr_syserror(ret));
+		return -1;
+	}
+	MEM(inst->mctx = talloc_memdup(inst, mctx, sizeof(*mctx)));
+
+	/*
+	 *	If we don't have a separate time specifically for offers
+	 *	just use the lease time.
+	 */
+	if (!inst->offer_time) inst->offer_time = inst->lease_time;
+
+	MEM(inst->pools = fr_rb_inline_talloc_alloc(inst, memory_ippool_t, node, pool_cmp, NULL));
+
+	while ((cs = cf_section_find_next(conf, cs, "pool", CF_IDENT_ANY))) {
+		memory_ippool_conf_t	pool_conf;
+		memory_ippool_t		*other;
+		uint32_t		start, end, i;
+
+		if (!cf_section_name2(cs)) {
+			cf_log_err(cs, "Pool sections must have a name");
+			return -1;
+		}
+
+		if (cf_section_rules_push(cs, pool_config) < 0) return -1;
+		if (cf_section_parse(inst, &pool_conf, cs) < 0) return -1;
+
+		start = ntohl(pool_conf.start.addr.v4.s_addr);
+		end = ntohl(pool_conf.end.addr.v4.s_addr);
+		if (end < start) {
+			cf_log_err(cs, "Pool 'end' must not be before 'start'");
+			return -1;
+		}
+		if ((end - start) >= MEMORY_IPPOOL_MAX_SIZE) {
+			cf_log_err(cs, "Pool is too large, it can contain at most %u addresses", MEMORY_IPPOOL_MAX_SIZE);
+			return -1;
+		}
+
+		/*
+		 *	Journal records only contain the address, so
+		 *	each address must be in only one pool.
+		 */
+		other = ippool_by_address(inst, start);
+		if (!other) other = ippool_by_address(inst, end);
+		if (!other) {
+			for (other = fr_rb_iter_init_inorder(&iter, inst->pools);
+			     other;
+			     other = fr_rb_iter_next_inorder(&iter)) {
+				if ((other->start >= start) && (other->start <= end)) break;
+			}
+		}
+		if (other) {
+			cf_log_err(cs, "Pool overlaps pool \"%s\"", other->name);
+			return -1;
+		}
+
+		MEM(pool = talloc_zero(inst->pools, memory_ippool_t));
+		pool->name = cf_section_name2(cs);
+		pool->start = start;
+		pool->num = end - start + 1;
+		pool->num_words = (pool->num + 63) / 64;
+		MEM(pool->used = talloc_zero_array(pool, atomic_uint_fast64_t, pool->num_words));
+		MEM(pool->leases = talloc_zero_array(pool, memory_ippool_lease_t, pool->num));
+		MEM(pool->owners = talloc_zero_array(pool, memory_ippool_owner_t, pool->num));
+		MEM(pool->owner_map = fr_hash_table_alloc(pool, owner_hash, owner_cmp, NULL));
+
+		for (i = 0; i < pool->num_words; i++) atomic_init(&pool->used[i], 0);
+		for (i = 0; i < pool->num; i++) {
+			atomic_init(&pool->leases[i].state, 0);
+			atomic_init(&pool->leases[i].owner, 0);
+			pool->owners[i].idx = i;
+		}
+		atomic_init(&pool->sweep, 0);
+
+		/*
+		 *	Mark the bits past the end of the pool as used,
+		 *	so allocation never has to check for them.
+		 */
+		if (pool->num % 64) {
+			atomic_store_explicit(&pool->used[pool->num_words - 1],
+					      ~(uint64_t)0 << (pool->num % 64), memory_order_relaxed);
+		}
+
+		if (!fr_rb_insert(inst->pools, pool)) {
+			cf_log_err(cs, "Duplicate pool \"%s\"", pool->name);
+			return -1;
+		}
+
+		/*
+		 *	Only initialised once the pool is in the tree,
+		 *	so mod_detach destroys every mutex it finds.
+		 */
+		if ((ret = pthread_mutex_init(&pool->mutex, NULL)) != 0) {
+			fr_rb_delete(inst->pools, pool);
+			ERROR("Failed initializing mutex: %s", fr_syserror(ret));
+			return -1;
+		}
+
+		DEBUG2("Pool \"%s\" contains %u addresses", pool->name, pool->num);
+	}
+
+	if (fr_rb_num_elements(inst->pools) == 0) {
+		cf_log_err(conf, "At least one 'pool' section must be configured");
+		return -1;
+	}
+
+	if (inst->journal && (ippool_journal_load(mctx) < 0)) return -1;
+
+	return 0;
+}
+
+static int mod_detach(module_detach_ctx_t const *mctx)
+{
+	rlm_memory_ippool_t	*inst = talloc_get_type_abort(mctx->inst->data, rlm_memory_ippool_t);
+	memory_ippool_t		*pool;
+	fr_rb_iter_inorder_t	iter;
+
+	if (!inst->pools) {
+		if (inst->journal_fd >= 0) close(inst->journal_fd);
+		return 0;
+	}
+
+	pthread_mutex_lock(&inst->journal_mutex);
+	inst->journal_stop = true;
+	pthread_cond_signal(&inst->journal_cond);
+	pthread_mutex_unlock(&inst->journal_mutex);
+
+	if (inst->journal_thread_running) pthread_join(inst->journal_thread, NULL);
+
+	if (inst->journal_fd >= 0) close(inst->journal_fd);
+
+	pthread_cond_destroy(&inst->journal_cond);
+	pthread_mutex_destroy(&inst->journal_mutex);
+
+	for (pool = fr_rb_iter_init_inorder(&iter, inst->pools);
+	     pool;
+	     pool = fr_rb_iter_next_inorder(&iter)) {
+		pthread_mutex_destroy(&pool->mutex);
+	}
+
+	return 0;
+}
+
+static int mod_thread_instantiate(module_thread_inst_ctx_t const *mctx)
+{
+	rlm_memory_ippool_t		*inst = talloc_get_type_abort(mctx->inst->data, rlm_memory_ippool_t);
+	rlm_memory_ippool_thread_t	*t = talloc_get_type_abort(mctx->thread, rlm_memory_ippool_thread_t);
+
+	/*
+	 *	Create a copy of the mctx on the heap that we can
+	 *	use in the sweep timer.
+	 */
+	MEM(t->mctx = talloc_zero(t, module_thread_inst_ctx_t));
+	memcpy(t->mctx, mctx, sizeof(*t->mctx));
+	t->inst = inst;
+
+	/*
+	 *	The compaction thread is started by the first worker,
+	 *	as threads started when the module is instantiated
+	 *	wouldn't survive the server daemonizing.
+	 */
+	if (inst->journal_fd >= 0) {
+		int ret = 0;
+
+		pthread_mutex_lock(&inst->journal_mutex);
+		if (!inst->journal_thread_running) {
+			ret = pthread_create(&inst->journal_thread, NULL, ippool_journal_thread, inst);
+			if (ret == 0) inst->journal_thread_running = true;
+		}
+		pthread_mutex_unlock(&inst->journal_mutex);
+
+		if (ret != 0) {
+			ERROR("Failed starting journal compaction thread: %s", fr_syserror(ret));
+			return -1;
+		}
+	}
+
+	if (fr_event_timer_in(t, mctx->el, &t->ev, inst->sweep_interval, ippool_sweep_timer, t) < 0) {
+		ERROR("Failed inserting sweep timer");
+		return -1;
+	}
+
+	return 0;
+}
+
+extern module_rlm_t rlm_memory_ippool;
+module_rlm_t rlm_memory_ippool = {
+	.common = {
+		.magic			= MODULE_MAGIC_INIT,
+		.name			= "memory_ippool",
+		.type			= MODULE_TYPE_THREAD_SAFE,
+		.inst_size		= sizeof(rlm_memory_ippool_t),
+		.config			= module_config,
+		.instantiate		= mod_instantiate,
+		.detach			= mod_detach,
+		.thread_inst_size	= sizeof(rlm_memory_ippool_thread_t),
+		.thread_inst_type	= "rlm_memory_ippool_thread_t",
+		.thread_instantiate	= mod_thread_instantiate
+	},
+	.method_names = (module_method_name_t[]){
+		/*
+		 *	RADIUS specific
+		 */
+		{ .name1 = "recv",		.name2 = "access-request",	.method = mod_alloc },
+		{ .name1 = "accounting",	.name2 = "stop",		.method = mod_release },
+
+		/*
+		 *	DHCPv4
+		 */
+		{ .name1 = "recv",		.name2 = "discover",		.method = mod_alloc },
+		{ .name1 = "recv",		.name2 = "release",		.method = mod_release },
+
+		/*
+		 *	Generic
+		 */
+		{ .name1 = "recv",		.name2 = CF_IDENT_ANY,		.method = mod_update },
+		{ .name1 = "accounting",	.name2 = CF_IDENT_ANY,		.method = mod_accounting },
+		{ .name1 = "send",		.name2 = CF_IDENT_ANY,		.method = mod_post_auth },
+		MODULE_NAME_TERMINATOR
+	}
+};
@@ -0,0 +1,457 @@
+/*
+ *   This program is is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or (at
+ *   your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ * @file auth_ntlm_helper.c
+ * @brief NTLM authentication using a pool of long running ntlm_auth helpers
+ *
+ * Each connection in the pool is an ntlm_auth process started with
+ * --helper-protocol=ntlm-server-1.  Requests and responses are sets of
+ * "key: value" lines, terminated by a line containing only ".".
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+
+RCSID("$Id$")
+
+#define LOG_PREFIX mctx->inst->name
+
+#include <freeradius-devel/server/base.h>
+#include <freeradius-devel/server/exec_legacy.h>
+#include <freeradius-devel/server/module_rlm.h>
+#include <freeradius-devel/util/base16.h>
+#include <freeradius-devel/util/base64.h>
+#include <freeradius-devel/util/debug.h>
+
+#include <sys/wait.h>
+
+#include "rlm_mschap.h"
+#include "mschap.h"
+#include "auth_ntlm_helper.h"
+
+#define NT_LENGTH 24
+
+/** A running ntlm_auth helper
+ *
+ */
+typedef struct {
+	pid_t		pid;			//!< of ntlm_auth.
+	int		to_child;		//!< ntlm_auth's stdin.
+	int		from_child;		//!< ntlm_auth's stdout.
+	size_t		used;			//!< Bytes of the response read so far.
+	char		buffer[1024];		//!< The response.
+} ntlm_helper_conn_t;
+
+/** An authentication waiting for a response from a helper
+ *
+ */
+struct ntlm_helper_auth_s {
+	rlm_mschap_t const	*inst;
+	request_t		*request;		//!< being authenticated.
+	ntlm_helper_conn_t	*conn;			//!< we're waiting on.  NULL once it's been returned to the pool.
+	int			status;			//!< 1 response read, 0 waiting, -1 error or timeout.
+};
+
+static int _ntlm_helper_conn_free(ntlm_helper_conn_t *conn)
+{
+	int status;
+
+	if (conn->to_child >= 0) close(conn->to_child);
+	if (conn->from_child >= 0) close(conn->from_child);
+
+	/*
+	 *	ntlm_auth exits when its stdin is closed, but it may
+	 *	be stuck waiting for winbind, so don't rely on that.
+	 */
+	if (conn->pid > 0) {
+		kill(conn->pid, SIGKILL);
+		(void) waitpid(conn->pid, &status, 0);
+	}
+
+	return 0;
+}
+
+/** Start an ntlm_auth helper for the connection pool
+ *
+ */
+void *ntlm_helper_conn_create(TALLOC_CTX *ctx, void *instance, UNUSED fr_time_delta_t timeout)
+{
+	rlm_mschap_t const	*inst = talloc_get_type_abort_const(instance, rlm_mschap_t);
+	module_inst_ctx_t	*mctx = MODULE_INST_CTX(dl_module_instance_by_data(instance));
+	ntlm_helper_conn_t	*conn;
+
+	MEM(conn = talloc_zero(ctx, ntlm_helper_conn_t));
+	conn->to_child = -1;
+	conn->from_child = -1;
+
+	conn->pid = radius_start_program_legacy(&conn->to_child, &conn->from_child, NULL,
+						inst->ntlm_helper, NULL, true, NULL, false);
+	if (conn->pid < 0) {
+		ERROR("Failed starting ntlm_auth helper");
+		talloc_free(conn);
+		return NULL;
+	}
+	talloc_set_destructor(conn, _ntlm_helper_conn_free);
+
+	/*
+	 *	Responses are read from the event loop, so reading
+	 *	must never block the worker.
+	 */
+	if (fr_nonblock(conn->from_child) < 0) {
+		PERROR("Failed setting ntlm_auth helper's stdout non-blocking");
+		talloc_free(conn);
+		return NULL;
+	}
+
+	DEBUG2("Started ntlm_auth helper, PID %u", conn->pid);
+
+	return conn;
+}
+
+static int ntlm_helper_write(ntlm_helper_conn_t *conn, char const *buffer, size_t len)
+{
+	ssize_t slen;
+
+	while (len > 0) {
+		slen = write(conn->to_child, buffer, len);
+		if (slen < 0) {
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		buffer += slen;
+		len -= slen;
+	}
+
+	return 0;
+}
+
+/** Read whatever the helper has written
+ *
+ * @return
+ *	- 1 the response is complete.  It is NUL terminated, without
+ *	  the terminating ".".
+ *	- 0 more of the response is needed.
+ *	- -1 on error.  The helper is in an unknown state, and must be closed.
+ */
+static int ntlm_helper_read(request_t *request, ntlm_helper_conn_t *conn)
+{
+	ssize_t slen;
+
+	for (;;) {
+		if (conn->used >= (sizeof(conn->buffer) - 1)) {
+			REDEBUG("Response from ntlm_auth helper is too long");
+			return -1;
+		}
+
+		slen = read(conn->from_child, conn->buffer + conn->used, sizeof(conn->buffer) - 1 - conn->used);
+		if (slen < 0) {
+			if (errno == EINTR) continue;
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) return 0;
+
+			REDEBUG("Failed reading from ntlm_auth helper: %s", fr_syserror(errno));
+			return -1;
+		}
+		if (slen == 0) {
+			REDEBUG("ntlm_auth helper, PID %u, exited", conn->pid);
+			return -1;
+		}
+
+		conn->used += slen;
+
+		/*
+		 *	The response ends with a line containing only "."
+		 */
+		if ((conn->used >= 2) && (memcmp(conn->buffer + conn->used - 2, ".\n", 2) == 0) &&
+		    ((conn->used == 2) || (conn->buffer[conn->used - 3] == '\n'))) {
+			conn->used -= 2;
+			conn->buffer[conn->used] = '\0';
+			return 1;
+		}
+	}
+}
+
+/** Stop waiting for the helper, and let the request continue
+ *
+ * The timer is deleted first, deleting the fd event also
+ * removes the request data which refers to the timer.
+ */
+static void ntlm_helper_auth_done(ntlm_helper_auth_t *auth, request_t *request, int status)
+{
+	auth->status = status;
+
+	(void) unlang_module_timeout_delete(request, auth);
+	(void) unlang_module_fd_delete(request, auth, auth->conn->from_child);
+
+	unlang_interpret_mark_runnable(request);
+}
+
+static void _ntlm_helper_auth_read(module_ctx_t const *mctx, request_t *request, UNUSED int fd)
+{
+	ntlm_helper_auth_t	*auth = talloc_get_type_abort(mctx->rctx, ntlm_helper_auth_t);
+	int			ret;
+
+	ret = ntlm_helper_read(request, auth->conn);
+	if (ret == 0) return;
+
+	ntlm_helper_auth_done(auth, request, ret);
+}
+
+static void _ntlm_helper_auth_error(module_ctx_t const *mctx, request_t *request, UNUSED int fd)
+{
+	ntlm_helper_auth_t	*auth = talloc_get_type_abort(mctx->rctx, ntlm_helper_auth_t);
+
+	REDEBUG("Error waiting for ntlm_auth helper, PID %u", auth->conn->pid);
+	ntlm_helper_auth_done(auth, request, -1);
+}
+
+static void _ntlm_helper_auth_timeout(module_ctx_t const *mctx, request_t *request, UNUSED fr_time_t fired)
+{
+	ntlm_helper_auth_t	*auth = talloc_get_type_abort(mctx->rctx, ntlm_helper_auth_t);
+
+	REDEBUG("Timeout waiting for ntlm_auth helper, PID %u", auth->conn->pid);
+
+	/*
+	 *	The timer is freed when we return
+	 */
+	auth->status = -1;
+	(void) unlang_module_fd_delete(request, auth, auth->conn->from_child);
+
+	unlang_interpret_mark_runnable(request);
+}
+
+/** Give back a helper which hasn't finished with a request
+ *
+ * If the request is cancelled while we're waiting, the helper
+ * will still send its response, so it can't be reused.
+ */
+static int _ntlm_helper_auth_free(ntlm_helper_auth_t *auth)
+{
+	if (!auth->conn) return 0;
+
+	if (auth->status == 0) {
+		(void) unlang_module_timeout_delete(auth->request, auth);
+		(void) unlang_module_fd_delete(auth->request, auth, auth->conn->from_child);
+	}
+	fr_pool_connection_close(auth->inst->ntlm_helper_pool, auth->request, auth->conn);
+
+	return 0;
+}
+
+/** Add a "key:: <base64 value>" line to a request
+ *
+ * Base64 means we don't have to worry about what's in the value.
+ */
+static int ntlm_helper_add_b64(fr_sbuff_t *sbuff, char const *key, char const *value, size_t len)
+{
+	if ((fr_sbuff_in_sprintf(sbuff, "%s:: ", key) <= 0) ||
+	    (fr_base64_encode(sbuff, &FR_DBUFF_TMP((uint8_t const *)value, len), true) < 0) ||
+	    (fr_sbuff_in_char(sbuff, '\n') <= 0)) return -1;
+
+	return 0;
+}
+
+/** Send an authentication request to a long running ntlm_auth helper
+ *
+ * The helper's response is read from the event loop.  When it has
+ * been read, or on error or timeout, the request is marked runnable.
+ * The caller should yield, and call #ntlm_helper_auth_recv when it
+ * is resumed.
+ *
+ * @param[in] ctx		to allocate the authentication in.  Freeing it
+ *				before the response arrives closes the helper.
+ * @param[in] inst		of rlm_mschap.
+ * @param[in] request		being authenticated.
+ * @param[in] challenge		8 octets.
+ * @param[in] response		24 octets of NT-Response.
+ * @return
+ *	- The authentication to wait for.
+ *	- NULL on error.
+ */
+ntlm_helper_auth_t *ntlm_helper_auth_send(TALLOC_CTX *ctx, rlm_mschap_t const *inst, request_t *request,
+					  uint8_t const *challenge, uint8_t const *response)
+{
+	ntlm_helper_auth_t	*auth = NULL;
+	ntlm_helper_conn_t	*conn;
+	char			*username = NULL, *domain = NULL;
+	char			buffer[1024];
+	fr_sbuff_t		sbuff = FR_SBUFF_OUT(buffer, sizeof(buffer));
+
+	fr_assert(inst->ntlm_helper_username);
+
+	if (tmpl_aexpand(request, &username, request, inst->ntlm_helper_username, NULL, NULL) < 0) {
+		REDEBUG2("Unable to expand ntlm_auth_helper username");
+		return NULL;
+	}
+
+	if (inst->ntlm_helper_domain &&
+	    (tmpl_aexpand(request, &domain, request, inst->ntlm_helper_domain, NULL, NULL) < 0)) {
+		REDEBUG2("Unable to expand ntlm_auth_helper domain");
+		goto finish;
+	}
+
+	/*
+	 *	Build the whole request first, so it can be written
+	 *	in one go.
+	 */
+	if ((ntlm_helper_add_b64(&sbuff, "Username", username, talloc_array_length(username) - 1) < 0) ||
+	    (domain && (ntlm_helper_add_b64(&sbuff, "NT-Domain", domain, talloc_array_length(domain) - 1) < 0)) ||
+	    (fr_sbuff_in_strcpy_literal(&sbuff, "LANMAN-Challenge: ") <= 0) ||
+	    (fr_base16_encode(&sbuff, &FR_DBUFF_TMP(challenge, 8)) < 0) ||
+	    (fr_sbuff_in_strcpy_literal(&sbuff, "\nNT-Response: ") <= 0) ||
+	    (fr_base16_encode(&sbuff, &FR_DBUFF_TMP(response, NT_LENGTH)) < 0) ||
+	    (fr_sbuff_in_strcpy_literal(&sbuff, "\nRequest-User-Session-Key: Yes\n.\n") <= 0)) {
+		REDEBUG("Request to ntlm_auth helper is too long");
+		goto finish;
+	}
+
+	conn = fr_pool_connection_get(inst->ntlm_helper_pool, request);
+	if (!conn) {
+		RERROR("Unable to get ntlm_auth helper from pool");
+		goto finish;
+	}
+
+	RDEBUG2("Sending authentication request to ntlm_auth helper, PID %u, user \"%s\" domain \"%s\"",
+		conn->pid, username, domain ? domain : "");
+
+	/*
+	 *	A helper which exited while it was idle can't have
+	 *	seen the request, so it's safe to try again with a
+	 *	new one.
+	 */
+	if (ntlm_helper_write(conn, buffer, fr_sbuff_used(&sbuff)) < 0) {
+		RWDEBUG("Failed writing to ntlm_auth helper, PID %u: %s.  Restarting it",
+			conn->pid, fr_syserror(errno));
+
+		conn = fr_pool_connection_reconnect(inst->ntlm_helper_pool, request, conn);
+		if (!conn) {
+			RERROR("Unable to restart ntlm_auth helper");
+			goto finish;
+		}
+
+		if (ntlm_helper_write(conn, buffer, fr_sbuff_used(&sbuff)) < 0) {
+			REDEBUG("Failed writing to ntlm_auth helper, PID %u: %s", conn->pid, fr_syserror(errno));
+			fr_pool_connection_close(inst->ntlm_helper_pool, request, conn);
+			goto finish;
+		}
+	}
+	conn->used = 0;
+
+	MEM(auth = talloc_zero(ctx, ntlm_helper_auth_t));
+	auth->inst = inst;
+	auth->request = request;
+	auth->conn = conn;
+	talloc_set_destructor(auth, _ntlm_helper_auth_free);
+
+	if (unlang_module_fd_add(request, _ntlm_helper_auth_read, NULL, _ntlm_helper_auth_error,
+				 auth, conn->from_child) < 0) {
+		RPEDEBUG("Failed adding ntlm_auth helper to the event loop");
+	error:
+		auth->status = -1;	/* Nothing to delete, the destructor just closes the helper */
+		TALLOC_FREE(auth);
+		goto finish;
+	}
+
+	if (unlang_module_timeout_add(request, _ntlm_helper_auth_timeout, auth,
+				      fr_time_add(fr_time(), inst->ntlm_auth_timeout)) < 0) {
+		(void) unlang_module_fd_delete(request, auth, conn->from_child);
+		goto error;
+	}
+
+finish:
+	talloc_free(username);
+	talloc_free(domain);
+
+	return auth;
+}
+
+/** Process the response from an ntlm_auth helper
+ *
+ * The helper is returned to the pool, or closed if there was
+ * an error.
+ *
+ * @param[in] auth		returned by #ntlm_helper_auth_send.
+ * @param[in] request		being authenticated.
+ * @param[out] nthashhash	from the user session key.
+ * @param[out] error		why ntlm_auth rejected the user.
+ * @param[in] error_len		size of error.
+ * @return
+ *	- 0 success.
+ *	- 1 the user was rejected.  The reason is written to error.
+ *	- -1 error talking to the helper.
+ */
+int ntlm_helper_auth_recv(ntlm_helper_auth_t *auth, request_t *request,
+			  uint8_t nthashhash[NT_DIGEST_LENGTH], char *error, size_t error_len)
+{
+	ntlm_helper_conn_t	*conn = auth->conn;
+	bool			authenticated = false, have_key = false;
+	char			*line, *next;
+	int			ret = -1;
+
+	/*
+	 *	The destructor closes the helper
+	 */
+	if (auth->status != 1) return -1;
+
+	/*
+	 *	Authenticated: Yes
+	 *	User-Session-Key: <32 hex digits>
+	 *
+	 *	or
+	 *
+	 *	Authenticated: No
+	 *	Authentication-Error: <reason>
+	 */
+	for (line = conn->buffer; line && *line; line = next) {
+		next = strchr(line, '\n');
+		if (next) *next++ = '\0';
+
+		RDEBUG3("ntlm_auth helper said: %s", line);
+
+		if (strcmp(line, "Authenticated: Yes") == 0) {
+			authenticated = true;
+
+		} else if (strncmp(line, "User-Session-Key: ", 18) == 0) {
+			have_key = (fr_base16_decode(NULL, &FR_DBUFF_TMP(nthashhash, NT_DIGEST_LENGTH),
+						     &FR_SBUFF_IN(line + 18, strlen(line + 18)), false) == NT_DIGEST_LENGTH);
+
+		} else if ((strncmp(line, "Authentication-Error: ", 22) == 0) ||
+			   (strncmp(line, "Error: ", 7) == 0)) {
+			strlcpy(error, strchr(line, ' ') + 1, error_len);
+			ret = 1;
+		}
+	}
+
+	fr_pool_connection_release(auth->inst->ntlm_helper_pool, request, conn);
+	auth->conn = NULL;
+
+	if (authenticated) {
+		if (!have_key) {
+			REDEBUG("Invalid output from ntlm_auth helper: missing or invalid User-Session-Key");
+			return -1;
+		}
+
+		RDEBUG2("Authenticated successfully");
+		return 0;
+	}
+
+	if (ret < 0) {
+		strlcpy(error, "Authentication failed", error_len);
+		ret = 1;
+	}
+
+	return ret;
+}
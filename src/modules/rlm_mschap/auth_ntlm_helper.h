@@ -0,0 +1,13 @@
+#pragma once
+/* @copyright 2026 The FreeRADIUS server project */
+RCSIDH(auth_ntlm_helper_h, "$Id$")
+
+typedef struct ntlm_helper_auth_s ntlm_helper_auth_t;
+
+void *ntlm_helper_conn_create(TALLOC_CTX *ctx, void *instance, fr_time_delta_t timeout);
+
+ntlm_helper_auth_t *ntlm_helper_auth_send(TALLOC_CTX *ctx, rlm_mschap_t const *inst, request_t *request,
+					  uint8_t const *challenge, uint8_t const *response);
+
+int ntlm_helper_auth_recv(ntlm_helper_auth_t *auth, request_t *request,
+			  uint8_t nthashhash[NT_DIGEST_LENGTH], char *error, size_t error_len);
@@ -47,6 +47,7 @@ RCSID("$Id$")
 #include "rlm_mschap.h"
 #include "mschap.h"
 #include "smbdes.h"
+#include "auth_ntlm_helper.h"
 
 #ifdef WITH_AUTH_WINBIND
 #include "auth_wbclient.h"
@@ -84,6 +85,13 @@ static const CONF_PARSER passchange_config[] = {
 	CONF_PARSER_TERMINATOR
 };
 
+static const CONF_PARSER ntlm_auth_helper_config[] = {
+	{ FR_CONF_OFFSET("program", FR_TYPE_STRING, rlm_mschap_t, ntlm_helper) },
+	{ FR_CONF_OFFSET("username", FR_TYPE_TMPL, rlm_mschap_t, ntlm_helper_username) },
+	{ FR_CONF_OFFSET("domain", FR_TYPE_TMPL, rlm_mschap_t, ntlm_helper_domain) },
+	CONF_PARSER_TERMINATOR
+};
+
 static const CONF_PARSER winbind_config[] = {
 	{ FR_CONF_OFFSET("username", FR_TYPE_TMPL, rlm_mschap_t, wb_username) },
 	{ FR_CONF_OFFSET("domain", FR_TYPE_TMPL, rlm_mschap_t, wb_domain) },
@@ -105,6 +113,7 @@ static const CONF_PARSER module_config[] = {
 	{ FR_CONF_OFFSET("with_ntdomain_hack", FR_TYPE_BOOL, rlm_mschap_t, with_ntdomain_hack), .dflt = "yes" },
 	{ FR_CONF_OFFSET("ntlm_auth", FR_TYPE_STRING | FR_TYPE_XLAT, rlm_mschap_t, ntlm_auth) },
 	{ FR_CONF_OFFSET("ntlm_auth_timeout", FR_TYPE_TIME_DELTA, rlm_mschap_t, ntlm_auth_timeout) },
+	{ FR_CONF_POINTER("ntlm_auth_helper", FR_TYPE_SUBSECTION, NULL), .subcs = (void const *) ntlm_auth_helper_config },
 
 	{ FR_CONF_POINTER("passchange", FR_TYPE_SUBSECTION, NULL), .subcs = (void const *) passchange_config },
 	{ FR_CONF_OFFSET("allow_retry", FR_TYPE_BOOL, rlm_mschap_t, allow_retry), .dflt = "yes" },
@@ -1138,6 +1147,106 @@ ntlm_auth_err:
 	return -1;
 }
 
+/** Convert an error message from ntlm_auth into a do_mschap() result
+ *
+ * @param[in] request	being authenticated.
+ * @param[in] buffer	what ntlm_auth printed.
+ * @return
+ *	- -648 password expired.
+ *	- -647 account locked out.
+ *	- -691 account disabled.
+ *	- -2 no logon servers.
+ *	- -1 any other failure.
+ */
+static int ntlm_auth_error(request_t *request, char *buffer)
+{
+	int	result;
+	char	*p;
+
+	/*
+	 *	Do checks for numbers, which are
+	 *	language neutral.  They're also
+	 *	faster.
+	 */
+	p = strcasestr(buffer, "0xC0000");
+	if (p) {
+		result = 0;
+
+		p += 7;
+		if (strcmp(p, "224") == 0) {
+			result = -648;
+
+		} else if (strcmp(p, "234") == 0) {
+			result = -647;
+
+		} else if (strcmp(p, "072") == 0) {
+			result = -691;
+
+		} else if (strcasecmp(p, "05E") == 0) {
+			result = -2;
+		}
+
+		if (result != 0) {
+			REDEBUG2("%s", buffer);
+			return result;
+		}
+
+		/*
+		 *	Else fall through to more ridiculous checks.
+		 */
+	}
+
+	/*
+	 *	Look for variants of expire password.
+	 *
+	 *	The ntlm_auth helper protocol reports errors by
+	 *	NT_STATUS name.
+	 */
+	if (strcasestr(buffer, "0xC0000224") ||
+	    strcasestr(buffer, "NT_STATUS_PASSWORD_EXPIRED") ||
+	    strcasestr(buffer, "NT_STATUS_PASSWORD_MUST_CHANGE") ||
+	    strcasestr(buffer, "Password expired") ||
+	    strcasestr(buffer, "Password has expired") ||
+	    strcasestr(buffer, "Password must be changed") ||
+	    strcasestr(buffer, "Must change password")) {
+		return -648;
+	}
+
+	if (strcasestr(buffer, "0xC0000234") ||
+	    strcasestr(buffer, "NT_STATUS_ACCOUNT_LOCKED_OUT") ||
+	    strcasestr(buffer, "Account locked out")) {
+		REDEBUG2("%s", buffer);
+		return -647;
+	}
+
+	if (strcasestr(buffer, "0xC0000072") ||
+	    strcasestr(buffer, "NT_STATUS_ACCOUNT_DISABLED") ||
+	    strcasestr(buffer, "Account disabled")) {
+		REDEBUG2("%s", buffer);
+		return -691;
+	}
+
+	if (strcasestr(buffer, "0xC000005E") ||
+	    strcasestr(buffer, "NT_STATUS_NO_LOGON_SERVERS") ||
+	    strcasestr(buffer, "No logon servers")) {
+		REDEBUG2("%s", buffer);
+		return -2;
+	}
+
+	if (strcasestr(buffer, "could not obtain winbind separator") ||
+	    strcasestr(buffer, "Reading winbind reply failed")) {
+		REDEBUG2("%s", buffer);
+		return -2;
+	}
+
+	RDEBUG2("External script failed");
+	p = strchr(buffer, '\n');
+	if (p) *p = '\0';
+
+	REDEBUG("External script says: %s", buffer);
+	return -1;
+}
+
 /*
  *	Do the MS-CHAP stuff.
  *
@@ -1198,84 +1307,7 @@ static int CC_HINT(nonnull (1, 2, 4, 5, 6)) do_mschap(rlm_mschap_t const *inst,
 		 */
 		result = radius_exec_program_legacy(request, buffer, sizeof(buffer), NULL, request, inst->ntlm_auth, NULL,
 					     true, true, inst->ntlm_auth_timeout);
-		if (result != 0) {
-			char *p;
-
-			/*
-			 *	Do checks for numbers, which are
-			 *	language neutral.  They're also
-			 *	faster.
-			 */
-			p = strcasestr(buffer, "0xC0000");
-			if (p) {
-				result = 0;
-
-				p += 7;
-				if (strcmp(p, "224") == 0) {
-					result = -648;
-
-				} else if (strcmp(p, "234") == 0) {
-					result = -647;
-
-				} else if (strcmp(p, "072") == 0) {
-					result = -691;
-
-				} else if (strcasecmp(p, "05E") == 0) {
-					result = -2;
-				}
-
-				if (result != 0) {
-					REDEBUG2("%s", buffer);
-					return result;
-				}
-
-				/*
-				 *	Else fall through to more ridiculous checks.
-				 */
-			}
-
-			/*
-			 *	Look for variants of expire password.
-			 */
-			if (strcasestr(buffer, "0xC0000224") ||
-			    strcasestr(buffer, "Password expired") ||
-			    strcasestr(buffer, "Password has expired") ||
-			    strcasestr(buffer, "Password must be changed") ||
-			    strcasestr(buffer, "Must change password")) {
-				return -648;
-			}
-
-			if (strcasestr(buffer, "0xC0000234") ||
-			    strcasestr(buffer, "Account locked out")) {
-				REDEBUG2("%s", buffer);
-				return -647;
-			}
-
-			if (strcasestr(buffer, "0xC0000072") ||
-			    strcasestr(buffer, "Account disabled")) {
-				REDEBUG2("%s", buffer);
-				return -691;
-			}
-
-			if (strcasestr(buffer, "0xC000005E") ||
-			    strcasestr(buffer, "No logon servers")) {
-				REDEBUG2("%s", buffer);
-				return -2;
-			}
-
-			if (strcasestr(buffer, "could not obtain winbind separator") ||
-			    strcasestr(buffer, "Reading winbind reply failed")) {
-				REDEBUG2("%s", buffer);
-				return -2;
-			}
-
-			RDEBUG2("External script failed");
-			p = strchr(buffer, '\n');
-			if (p) *p = '\0';
-
-			REDEBUG("External script says: %s", buffer);
-			return -1;
-		}
+		if (result != 0) return ntlm_auth_error(request, buffer);
 
 		/*
 		 *	Parse the answer as an nthashhash.
@@ -1610,7 +1642,7 @@ static int CC_HINT(nonnull(1, 2, 3)) nt_password_find(bool *ephemeral, fr_pair_t
 		 *	..if we're not, then we can call out to external sources.
 		 */
 		} else {
-			return -1;
+			return 0;
 		}
 	}
 
@@ -1784,21 +1816,38 @@ static unlang_action_t CC_HINT(nonnull) mschap_process_cpw_request(rlm_rcode_t *
 	RETURN_MODULE_OK;
 }
 
-static CC_HINT(nonnull(1,2,3,4,5,8,9)) unlang_action_t mschap_process_response(rlm_rcode_t *p_result,
-									       int *mschap_version,
-									       uint8_t nthashhash[static NT_DIGEST_LENGTH],
-									       rlm_mschap_t const *inst,
-									       request_t *request,
-									       fr_pair_t *smb_ctrl,
-									       fr_pair_t *nt_password,
-									       fr_pair_t *challenge,
-									       fr_pair_t *response,
-									       MSCHAP_AUTH_METHOD method)
+/** State of an MS-CHAP authentication
+ *
+ * Kept across a yield, while we wait for an ntlm_auth helper.
+ */
+typedef struct {
+	rlm_mschap_t const	*inst;
+	fr_pair_t		*smb_ctrl;
+	fr_pair_t		*nt_password;
+	bool			ephemeral;		//!< Whether nt_password should be freed.
+	fr_pair_t		*challenge;
+	fr_pair_t		*response;
+
+	int			mschap_version;
+	uint8_t			mschap_challenge[MSCHAP_CHALLENGE_LENGTH];	//!< The MS-CHAPv1 challenge passed to do_mschap().
+	char const		*username;		//!< MS-CHAPv2 user name, without the domain.
+	size_t			username_len;
+	uint8_t const		*peer_challenge;	//!< MS-CHAPv2 peer challenge.
+
+	int			mschap_result;		//!< from do_mschap(), or the ntlm_auth helper.
+	uint8_t			nthashhash[NT_DIGEST_LENGTH];
+
+	ntlm_helper_auth_t	*helper;		//!< Authentication we're waiting on.
+} mschap_auth_ctx_t;
+
+static unlang_action_t CC_HINT(nonnull) mschap_process_response(rlm_rcode_t *p_result,
+								mschap_auth_ctx_t *auth_ctx,
+								request_t *request)
 {
-	int			offset;
-	rlm_rcode_t		mschap_result;
+	fr_pair_t	*challenge = auth_ctx->challenge;
+	fr_pair_t	*response = auth_ctx->response;
 
-	*mschap_version = 1;
+	auth_ctx->mschap_version = 1;
 
 	RDEBUG2("Processing MS-CHAPv1 response");
 
@@ -1827,41 +1876,27 @@ static CC_HINT(nonnull(1,2,3,4,5,8,9)) unlang_action_t mschap_process_response(r
 		RETURN_MODULE_FAIL;
 	}
 
-	offset = 26;
-
-	/*
-	 *	Do the MS-CHAP authentication.
-	 */
-	mschap_result = do_mschap(inst, request, nt_password, challenge->vp_octets,
-				  response->vp_octets + offset, nthashhash, method);
+	memcpy(auth_ctx->mschap_challenge, challenge->vp_octets, sizeof(auth_ctx->mschap_challenge));
 
-	/*
-	 *	Check for errors, and add MSCHAP-Error if necessary.
-	 */
-	return mschap_error(p_result, inst, request, *response->vp_octets, mschap_result, *mschap_version, smb_ctrl);
+	RETURN_MODULE_OK;
 }
 
-static unlang_action_t CC_HINT(nonnull(1,2,3,4,5,8,9)) mschap_process_v2_response(rlm_rcode_t *p_result,
-										  int *mschap_version,
-									    	  uint8_t nthashhash[static NT_DIGEST_LENGTH],
-									    	  rlm_mschap_t const *inst,
-									    	  request_t *request,
-									    	  fr_pair_t *smb_ctrl,
-									   	  fr_pair_t *nt_password,
-									    	  fr_pair_t *challenge,
-									    	  fr_pair_t *response,
-									    	  MSCHAP_AUTH_METHOD method)
+static unlang_action_t CC_HINT(nonnull) mschap_process_v2_response(rlm_rcode_t *p_result,
+								   mschap_auth_ctx_t *auth_ctx,
+								   request_t *request)
 {
-		uint8_t		mschap_challenge[16];
-		fr_pair_t	*user_name, *name_vp, *response_name, *peer_challenge_attr;
-		uint8_t const	*peer_challenge;
-		char const	*username_str;
-		size_t		username_len;
-		int		mschap_result;
-		rlm_rcode_t	rcode;
-		char		msch2resp[42];
+		rlm_mschap_t const	*inst = auth_ctx->inst;
+		fr_pair_t		*challenge = auth_ctx->challenge;
+		fr_pair_t		*response = auth_ctx->response;
+		fr_pair_t		*user_name, *name_vp, *response_name, *peer_challenge_attr;
+		uint8_t const		*peer_challenge;
+		char const		*username_str;
+		size_t			username_len;
+#ifdef __APPLE__
+		rlm_rcode_t		rcode;
+#endif
 
-		*mschap_version = 2;
+		auth_ctx->mschap_version = 2;
 
 		RDEBUG2("Processing MS-CHAPv2 response");
 
@@ -1928,7 +1963,7 @@ static unlang_action_t CC_HINT(nonnull(1,2,3,4,5,8,9)) mschap_process_v2_respons
 		 *  indicates the auth process should continue directly to AD.
 		 *  Otherwise OD will determine auth success/fail.
 		 */
-		if (!nt_password && inst->open_directory) {
+		if (!auth_ctx->nt_password && inst->open_directory) {
 			RDEBUG2("No NT-Password available. Trying OpenDirectory Authentication");
 			rcode = od_mschap_auth(request, challenge, user_name);
 			if (rcode != RLM_MODULE_NOOP) RETURN_MODULE_RCODE(rcode);
@@ -1951,23 +1986,45 @@ static unlang_action_t CC_HINT(nonnull(1,2,3,4,5,8,9)) mschap_process_v2_respons
 		 */
 		RDEBUG2("Creating challenge with username \"%pV\"",
 			fr_box_strvalue_len(username_str, username_len));
-		mschap_challenge_hash(mschap_challenge,		/* resulting challenge */
+		mschap_challenge_hash(auth_ctx->mschap_challenge,	/* resulting challenge */
 				      peer_challenge,			/* peer challenge */
 				      challenge->vp_octets,		/* our challenge */
 				      username_str, username_len);	/* user name */
 
-		mschap_result = do_mschap(inst, request, nt_password, mschap_challenge,
-					  response->vp_octets + 26, nthashhash, method);
+		auth_ctx->username = username_str;
+		auth_ctx->username_len = username_len;
+		auth_ctx->peer_challenge = peer_challenge;
 
-		/*
-		 *	Check for errors, and add MSCHAP-Error if necessary.
-		 */
-		mschap_error(&rcode, inst, request, *response->vp_octets,
-			     mschap_result, *mschap_version, smb_ctrl);
-		if (rcode != RLM_MODULE_OK) RETURN_MODULE_RCODE(rcode);
+		RETURN_MODULE_OK;
+}
+
+/** Check the result of the authentication, and build the reply
+ *
+ */
+static unlang_action_t CC_HINT(nonnull) mschap_auth_finish(rlm_rcode_t *p_result,
+							   mschap_auth_ctx_t *auth_ctx,
+							   request_t *request)
+{
+	rlm_mschap_t const	*inst = auth_ctx->inst;
+	fr_pair_t		*response = auth_ctx->response;
+	rlm_rcode_t		rcode;
+
+	/*
+	 *	Check for errors, and add MSCHAP-Error if necessary.
+	 */
+	mschap_error(&rcode, inst, request, *response->vp_octets,
+		     auth_ctx->mschap_result, auth_ctx->mschap_version, auth_ctx->smb_ctrl);
+	if (rcode != RLM_MODULE_OK) goto finish;
+
+	if (auth_ctx->mschap_version == 2) {
+		char const	*username_str = auth_ctx->username;
+		size_t		username_len = auth_ctx->username_len;
+		char		msch2resp[42];
 
 #ifdef WITH_AUTH_WINBIND
 		if (inst->wb_retry_with_normalised_username) {
+			fr_pair_t *response_name;
+
 			response_name = fr_pair_find_by_da(&request->request_pairs, NULL, attr_ms_chap_user_name);
 			if (response_name) {
 				if (strcmp(username_str, response_name->vp_strvalue)) {
@@ -1980,16 +2037,98 @@ static unlang_action_t CC_HINT(nonnull(1,2,3,4,5,8,9)) mschap_process_v2_respons
 		}
 #endif
 
-		mschap_auth_response(username_str,		/* without the domain */
-				     username_len,		/* Length of username str */
-				     nthashhash,		/* nt-hash-hash */
-				     response->vp_octets + 26,	/* peer response */
-				     peer_challenge,		/* peer challenge */
-				     challenge->vp_octets,	/* our challenge */
-				     msch2resp);		/* calculated MPPE key */
+		mschap_auth_response(username_str,			/* without the domain */
+				     username_len,			/* Length of username str */
+				     auth_ctx->nthashhash,		/* nt-hash-hash */
+				     response->vp_octets + 26,		/* peer response */
+				     auth_ctx->peer_challenge,		/* peer challenge */
+				     auth_ctx->challenge->vp_octets,	/* our challenge */
+				     msch2resp);			/* calculated MPPE key */
 		mschap_add_reply(request, *response->vp_octets, attr_ms_chap2_success, msch2resp, 42);
+	}
 
-		RETURN_MODULE_OK;
+	/* now create MPPE attributes */
+	if (inst->use_mppe) {
+		fr_pair_t	*vp;
+		uint8_t		mppe_sendkey[34];
+		uint8_t		mppe_recvkey[34];
+
+		switch (auth_ctx->mschap_version) {
+		case 1:
+			RDEBUG2("Generating MS-CHAPv1 MPPE keys");
+			memset(mppe_sendkey, 0, 32);
+
+			/*
+			 *	According to RFC 2548 we
+			 *	should send NT hash.  But in
+			 *	practice it doesn't work.
+			 *	Instead, we should send nthashhash
+			 *
+			 *	This is an error in RFC 2548.
+			 */
+			/*
+			 *	do_mschap cares to zero nthashhash if NT hash
+			 *	is not available.
+			 */
+			memcpy(mppe_sendkey + 8, auth_ctx->nthashhash, NT_DIGEST_LENGTH);
+			mppe_add_reply(inst, request, attr_ms_chap_mppe_keys, mppe_sendkey, 24);	//-V666
+			break;
+
+		case 2:
+			RDEBUG2("Generating MS-CHAPv2 MPPE keys");
+			mppe_chap2_gen_keys128(auth_ctx->nthashhash, response->vp_octets + 26, mppe_sendkey, mppe_recvkey);
+
+			mppe_add_reply(inst, request, attr_ms_mppe_recv_key, mppe_recvkey, 16);
+			mppe_add_reply(inst, request, attr_ms_mppe_send_key, mppe_sendkey, 16);
+			break;
+
+		default:
+			fr_assert(0);
+			break;
+		}
+
+		MEM(pair_update_reply(&vp, attr_ms_mppe_encryption_policy) >= 0);
+		vp->vp_uint32 = inst->require_encryption ? 2 : 1;
+
+		MEM(pair_update_reply(&vp, attr_ms_mppe_encryption_types) >= 0);
+		vp->vp_uint32 = inst->require_strong ? 4 : 6;
+	} /* else we weren't asked to use MPPE */
+
+finish:
+	if (auth_ctx->ephemeral) TALLOC_FREE(auth_ctx->nt_password);
+	talloc_free(auth_ctx);
+
+	RETURN_MODULE_RCODE(rcode);
+}
+
+/** Called when the ntlm_auth helper has responded, or given up
+ *
+ */
+static unlang_action_t CC_HINT(nonnull) mod_authenticate_resume(rlm_rcode_t *p_result, module_ctx_t const *mctx,
+								request_t *request)
+{
+	mschap_auth_ctx_t	*auth_ctx = talloc_get_type_abort(mctx->rctx, mschap_auth_ctx_t);
+	char			buffer[256];
+	int			ret;
+
+	ret = ntlm_helper_auth_recv(auth_ctx->helper, request, auth_ctx->nthashhash, buffer, sizeof(buffer));
+	TALLOC_FREE(auth_ctx->helper);
+
+	auth_ctx->mschap_result = (ret > 0) ? ntlm_auth_error(request, buffer) : ret;
+
+	return mschap_auth_finish(p_result, auth_ctx, request);
+}
+
+static void mod_authenticate_signal(module_ctx_t const *mctx, request_t *request, fr_state_signal_t action)
+{
+	mschap_auth_ctx_t	*auth_ctx = talloc_get_type_abort(mctx->rctx, mschap_auth_ctx_t);
+
+	if (action != FR_SIGNAL_CANCEL) return;
+
+	RDEBUG2("Cancelling ntlm_auth helper request");
+
+	if (auth_ctx->ephemeral) TALLOC_FREE(auth_ctx->nt_password);
+	talloc_free(auth_ctx);
 }
 
 /*
@@ -2015,8 +2154,7 @@ static unlang_action_t CC_HINT(nonnull) mod_authenticate(rlm_rcode_t *p_result,
 	fr_pair_t		*response = NULL;
 	fr_pair_t		*cpw = NULL;
 	fr_pair_t		*nt_password = NULL, *smb_ctrl;
-	uint8_t			nthashhash[NT_DIGEST_LENGTH];
-	int			mschap_version = 0;
+	mschap_auth_ctx_t	*auth_ctx;
 
 	MSCHAP_AUTH_METHOD	method;
 	bool			ephemeral = false;
@@ -2119,78 +2257,54 @@ static unlang_action_t CC_HINT(nonnull) mod_authenticate(rlm_rcode_t *p_result,
 		goto finish;
 	}
 
+	MEM(auth_ctx = talloc(unlang_interpret_frame_talloc_ctx(request), mschap_auth_ctx_t));
+	*auth_ctx = (mschap_auth_ctx_t){
+		.inst = inst,
+		.smb_ctrl = smb_ctrl,
+		.nt_password = nt_password,
+		.ephemeral = ephemeral,
+		.challenge = challenge
+	};
+
 	/*
 	 *	We also require an MS-CHAP-Response.
 	 */
-	if ((response = fr_pair_find_by_da(&request->request_pairs, NULL, attr_ms_chap_response))) {
-		mschap_process_response(&rcode,
-					&mschap_version, nthashhash,
-					inst, request,
-					smb_ctrl, nt_password,
-					challenge, response,
-					method);
-		if (rcode != RLM_MODULE_OK) goto finish;
-	} else if ((response = fr_pair_find_by_da(&request->request_pairs, NULL, attr_ms_chap2_response))) {
-		mschap_process_v2_response(&rcode,
-					   &mschap_version, nthashhash,
-					   inst, request,
-					   smb_ctrl, nt_password,
-					   challenge, response,
-					   method);
-		if (rcode != RLM_MODULE_OK) goto finish;
+	if ((auth_ctx->response = fr_pair_find_by_da(&request->request_pairs, NULL, attr_ms_chap_response))) {
+		mschap_process_response(&rcode, auth_ctx, request);
+	} else if ((auth_ctx->response = fr_pair_find_by_da(&request->request_pairs, NULL, attr_ms_chap2_response))) {
+		mschap_process_v2_response(&rcode, auth_ctx, request);
 	} else {		/* Neither CHAPv1 or CHAPv2 response: die */
 		REDEBUG("&control.Auth-Type = %s set for a request that does not contain &%s or &%s attributes",
 			mctx->inst->name, attr_ms_chap_response->name, attr_ms_chap2_response->name);
 		rcode = RLM_MODULE_INVALID;
+	}
+	if (rcode != RLM_MODULE_OK) {
+		talloc_free(auth_ctx);
 		goto finish;
 	}
 
-	/* now create MPPE attributes */
-	if (inst->use_mppe) {
-		fr_pair_t	*vp;
-		uint8_t		mppe_sendkey[34];
-		uint8_t		mppe_recvkey[34];
-
-		switch (mschap_version) {
-		case 1:
-			RDEBUG2("Generating MS-CHAPv1 MPPE keys");
-			memset(mppe_sendkey, 0, 32);
-
-			/*
-			 *	According to RFC 2548 we
-			 *	should send NT hash.  But in
-			 *	practice it doesn't work.
-			 *	Instead, we should send nthashhash
-			 *
-			 *	This is an error in RFC 2548.
-			 */
-			/*
-			 *	do_mschap cares to zero nthashhash if NT hash
-			 *	is not available.
-			 */
-			memcpy(mppe_sendkey + 8, nthashhash, NT_DIGEST_LENGTH);
-			mppe_add_reply(inst, request, attr_ms_chap_mppe_keys, mppe_sendkey, 24);	//-V666
-			break;
-
-		case 2:
-			RDEBUG2("Generating MS-CHAPv2 MPPE keys");
-			mppe_chap2_gen_keys128(nthashhash, response->vp_octets + 26, mppe_sendkey, mppe_recvkey);
-
-			mppe_add_reply(inst, request, attr_ms_mppe_recv_key, mppe_recvkey, 16);
-			mppe_add_reply(inst, request, attr_ms_mppe_send_key, mppe_sendkey, 16);
-			break;
-
-		default:
-			fr_assert(0);
-			break;
+	/*
+	 *	The ntlm_auth helpers answer from the event loop,
+	 *	so we don't block the worker while they talk to
+	 *	winbind.
+	 */
+	if (method == AUTH_NTLMAUTH_HELPER) {
+		auth_ctx->helper = ntlm_helper_auth_send(auth_ctx, inst, request, auth_ctx->mschap_challenge,
+							 auth_ctx->response->vp_octets + 26);
+		if (auth_ctx->helper) {
+			return unlang_module_yield(request, mod_authenticate_resume, mod_authenticate_signal, auth_ctx);
 		}
 
-		MEM(pair_update_reply(&vp, attr_ms_mppe_encryption_policy) >= 0);
-		vp->vp_uint32 = inst->require_encryption ? 2 : 1;
+		auth_ctx->mschap_result = -1;
+	} else {
+		/*
+		 *	Do the MS-CHAP authentication.
+		 */
+		auth_ctx->mschap_result = do_mschap(inst, request, nt_password, auth_ctx->mschap_challenge,
+						    auth_ctx->response->vp_octets + 26, auth_ctx->nthashhash, method);
+	}
 
-		MEM(pair_update_reply(&vp, attr_ms_mppe_encryption_types) >= 0);
-		vp->vp_uint32 = inst->require_strong ? 4 : 6;
-	} /* else we weren't asked to use MPPE */
+	return mschap_auth_finish(p_result, auth_ctx, request);
 
 finish:
 	if (ephemeral) TALLOC_FREE(nt_password);
@@ -2218,7 +2332,22 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 	 */
 	inst->method = AUTH_INTERNAL;
 
-	if (inst->wb_username) {
+	if (inst->ntlm_helper) {
+		if (!inst->ntlm_helper_username) {
+			cf_log_err(conf, "'ntlm_auth_helper.username' must be set when using 'ntlm_auth_helper.program'");
+			return -1;
+		}
+
+		inst->method = AUTH_NTLMAUTH_HELPER;
+
+		inst->ntlm_helper_pool = module_rlm_connection_pool_init(conf, inst, ntlm_helper_conn_create,
+									 NULL, NULL, NULL, NULL);
+		if (!inst->ntlm_helper_pool) {
+			cf_log_err(conf, "Unable to initialise ntlm_auth helper pool");
+			return -1;
+		}
+
+	} else if (inst->wb_username) {
 #ifdef WITH_AUTH_WINBIND
 		inst->method = AUTH_WBCLIENT;
 
@@ -2245,6 +2374,9 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 	case AUTH_NTLMAUTH_EXEC:
 		DEBUG("Authenticating by calling 'ntlm_auth'");
 		break;
+	case AUTH_NTLMAUTH_HELPER:
+		DEBUG("Authenticating with a pool of 'ntlm_auth' helpers");
+		break;
 #ifdef WITH_AUTH_WINBIND
 	case AUTH_WBCLIENT:
 		DEBUG("Authenticating directly to winbind");
@@ -2286,15 +2418,12 @@ static int mod_bootstrap(module_inst_ctx_t const *mctx)
 /*
  *	Tidy up instance
  */
-static int mod_detach(
-#ifndef WITH_AUTH_WINBIND
-		      UNUSED
-#endif
-		      module_detach_ctx_t const *mctx)
+static int mod_detach(module_detach_ctx_t const *mctx)
 {
-#ifdef WITH_AUTH_WINBIND
 	rlm_mschap_t *inst = talloc_get_type_abort(mctx->inst->data, rlm_mschap_t);
 
+	fr_pool_free(inst->ntlm_helper_pool);
+#ifdef WITH_AUTH_WINBIND
 	fr_pool_free(inst->wb_pool);
 #endif
 
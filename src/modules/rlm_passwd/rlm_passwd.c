@@ -26,6 +26,7 @@ RCSID("$Id$")
 #define LOG_PREFIX "passwd"
 
 #include <freeradius-devel/server/base.h>
+#include <freeradius-devel/server/file_reload.h>
 #include <freeradius-devel/server/module_rlm.h>
 #include <freeradius-devel/util/debug.h>
 
@@ -152,12 +153,13 @@ static void release_hash_table(struct hashtable * ht){
 	ht->tablesize = 0;
 }
 
-static void release_ht(struct hashtable * ht){
-	if (!ht) return;
+static int _release_hash_table(struct hashtable *ht)
+{
 	release_hash_table(ht);
-	talloc_free(ht);
+	return 0;
 }
 
+
 static struct hashtable * build_hash_table (char const * file, int num_fields,
 					    int key_field, int islist, int tablesize, int ignorenis, char delimiter)
 {
@@ -172,6 +174,7 @@ static struct hashtable * build_hash_table (char const * file, int num_fields,
 
 	MEM(ht = talloc_zero(NULL, struct hashtable));
 	MEM(ht->filename = talloc_typed_strdup(ht, file));
+	talloc_set_destructor(ht, _release_hash_table);
 
 	ht->tablesize = tablesize;
 	ht->num_fields = num_fields;
@@ -352,12 +355,12 @@ int main(void){
 		printpw(pw,4);
 		while ((pw = get_next(buffer, ht, &last_found))) printpw(pw,4);
 	}
-	release_ht(ht);
+	talloc_free(ht);
 }
 
 #else  /* TEST */
 typedef struct {
-	struct hashtable	*ht;
+	fr_file_reload_t	*reload;	//!< Holds the current struct hashtable.
 	struct mypasswd		*pwd_fmt;
 	char const		*filename;
 	char const		*format;
@@ -370,6 +373,7 @@ typedef struct {
 	uint32_t		listable;
 	fr_dict_attr_t const		*keyattr;
 	bool			ignore_empty;
+	bool			reload_on_change;
 } rlm_passwd_t;
 
 static const CONF_PARSER module_config[] = {
@@ -384,9 +388,29 @@ static const CONF_PARSER module_config[] = {
 	{ FR_CONF_OFFSET("allow_multiple_keys", FR_TYPE_BOOL, rlm_passwd_t, allow_multiple), .dflt = "no" },
 
 	{ FR_CONF_OFFSET("hash_size", FR_TYPE_UINT32, rlm_passwd_t, hash_size), .dflt = "100" },
+
+	{ FR_CONF_OFFSET("reload", FR_TYPE_BOOL, rlm_passwd_t, reload_on_change), .dflt = "no" },
 	CONF_PARSER_TERMINATOR
 };
 
+/*
+ *	(Re-)read the passwd file into a new hash table.
+ */
+static void *passwd_hash_table_build(void *uctx)
+{
+	rlm_passwd_t const	*inst = talloc_get_type_abort_const(uctx, rlm_passwd_t);
+	struct hashtable	*ht;
+
+	ht = build_hash_table(inst->filename, inst->num_fields, inst->key_field, inst->listable,
+			      inst->hash_size, inst->ignore_nislike, *inst->delimiter);
+	if (!ht) {
+		ERROR("Can't build hashtable from passwd file");
+		return NULL;
+	}
+
+	return ht;
+}
+
 static int mod_instantiate(module_inst_ctx_t const *mctx)
 {
 	int			num_fields = 0, key_field = -1, listable = 0;
@@ -395,6 +419,7 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 	size_t			len;
 	int			i;
 	fr_dict_attr_t const	*da;
+	struct hashtable	*ht;
 	rlm_passwd_t		*inst = talloc_get_type_abort(mctx->inst->data, rlm_passwd_t);
 	CONF_SECTION		*conf = mctx->inst->conf;
 
@@ -443,24 +468,13 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 		return -1;
 	}
 
-	inst->ht = build_hash_table(inst->filename, num_fields, key_field, listable,
-				    inst->hash_size, inst->ignore_nislike, *inst->delimiter);
-	if (!inst->ht){
-		ERROR("Can't build hashtable from passwd file");
-		return -1;
-	}
-
 	inst->pwd_fmt = mypasswd_alloc(inst->format, num_fields, &len);
 	if (!inst->pwd_fmt){
 		ERROR("Memory allocation failed");
-		release_ht(inst->ht);
-		inst->ht = NULL;
 		return -1;
 	}
 	if (!string_to_entry(inst->format, num_fields, ':', inst->pwd_fmt , len)) {
 		ERROR("Unable to convert format entry");
-		release_ht(inst->ht);
-		inst->ht = NULL;
 		return -1;
 	}
 
@@ -475,8 +489,6 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 	}
 	if (!*inst->pwd_fmt->field[key_field]) {
 		cf_log_err(conf, "key field is empty");
-		release_ht(inst->ht);
-		inst->ht = NULL;
 		return -1;
 	}
 
@@ -484,8 +496,6 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 						  inst->pwd_fmt->field[key_field], true, true);
 	if (!da) {
 		PERROR("Unable to resolve attribute");
-		release_ht(inst->ht);
-		inst->ht = NULL;
 		return -1;
 	}
 
@@ -497,6 +507,15 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 	DEBUG3("num_fields: %d key_field %d(%s) listable: %s", num_fields, key_field,
 	       inst->pwd_fmt->field[key_field], listable ? "yes" : "no");
 
+	ht = passwd_hash_table_build(inst);
+	if (!ht) return -1;
+
+	inst->reload = fr_file_reload_alloc(inst, mctx->inst->name, ht, passwd_hash_table_build, inst);
+	if (inst->reload_on_change && (fr_file_reload_watch(inst->reload, inst->filename) < 0)) {
+		cf_log_perr(conf, "Failed watching %s", inst->filename);
+		return -1;
+	}
+
 	return 0;
 
 #undef inst
@@ -505,10 +524,8 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 static int mod_detach(module_detach_ctx_t const *mctx)
 {
 	rlm_passwd_t *inst = talloc_get_type_abort(mctx->inst->data, rlm_passwd_t);
-	if (inst->ht) {
-		release_ht(inst->ht);
-		inst->ht = NULL;
-	}
+
+	TALLOC_FREE(inst->reload);
 	talloc_free(inst->pwd_fmt);
 	return 0;
 }
@@ -569,12 +586,15 @@ static unlang_action_t CC_HINT(nonnull) mod_passwd_map(rlm_rcode_t *p_result, mo
 	char			buffer[1024];
 	fr_pair_t		*key, *i;
 	struct mypasswd		*pw, *last_found;
+	struct hashtable	*ht;
 	fr_dcursor_t		cursor;
 	int			found = 0;
 
 	key = fr_pair_find_by_da(&request->request_pairs, NULL, inst->keyattr);
 	if (!key) RETURN_MODULE_NOTFOUND;
 
+	ht = fr_file_reload_acquire(inst->reload);
+
 	for (i = fr_pair_dcursor_by_da_init(&cursor, &request->request_pairs, inst->keyattr);
 	     i;
 	     i = fr_dcursor_next(&cursor)) {
@@ -589,20 +609,22 @@ static unlang_action_t CC_HINT(nonnull) mod_passwd_map(rlm_rcode_t *p_result, mo
 		buffer[0] = '\0';
 #endif
 		fr_pair_print_value_quoted(&FR_SBUFF_OUT(buffer, sizeof(buffer)), i, T_BARE_WORD);
-		pw = get_pw_nam(buffer, inst->ht, &last_found);
+		pw = get_pw_nam(buffer, ht, &last_found);
 		if (!pw) continue;
 
 		do {
 			result_add(request->control_ctx, inst, request, &request->control_pairs, pw, 0, "config");
 			result_add(request->reply_ctx, inst, request, &request->reply_pairs, pw, 1, "reply_items");
 			result_add(request->request_ctx, inst, request, &request->request_pairs, pw, 2, "request_items");
-		} while ((pw = get_next(buffer, inst->ht, &last_found)));
+		} while ((pw = get_next(buffer, ht, &last_found)));
 
 		found++;
 
 		if (!inst->allow_multiple) break;
 	}
 
+	fr_file_reload_release();
+
 	if (!found) RETURN_MODULE_NOTFOUND;
 
 	RETURN_MODULE_OK;
@@ -26,13 +26,16 @@
  */
 RCSID("$Id$")
 #include <freeradius-devel/server/cf_parse.h>
+#include <freeradius-devel/util/base16.h>
 #include <freeradius-devel/util/debug.h>
+#include <freeradius-devel/util/sha1.h>
 
 #include "base.h"
 #include "cluster.h"
 #include "redis_ippool.h"
 
 #define MAX_PIPELINED 100000
+#define MAX_PIPELINED_CALLS 100
 
 /** Pool management actions
  *
@@ -125,79 +128,119 @@ do { \
 #define EOL "\n"
 
 static char const *name;
-/** Lua script for releasing a lease
+
+static uint32_t batch_size = 1000;	//!< Addresses per script call.
+static bool show_progress = false;	//!< Print progress after each round trip.
+
+/** Lua script for adding leases
+ *
+ * - KEYS[1] The pool name.
+ * - ARGV[1] Whether to set the range ('1' or '0').
+ * - ARGV[2] Range identifier.
+ * - ARGV[3...] IP addresses to add.
+ *
+ * Adds each IP address to the ZSET with a score of 0, if it isn't already there,
+ * and sets its range.  Zero length ranges are allowed, and are preserved.
+ *
+ * Returns the number of IP addresses which weren't already in the pool.
+ */
+static char lua_add_cmd[] =
+	"local added = 0" EOL								/* 1 */
+	"local pool_key = '{' .. KEYS[1] .. '}:"IPPOOL_POOL_KEY"'" EOL			/* 2 */
+	"for i = 3, #ARGV do" EOL							/* 3 */
+	"  added = added + redis.call('ZADD', pool_key, 'NX', 0, ARGV[i])" EOL		/* 4 */
+	"  if ARGV[1] == '1' then" EOL							/* 5 */
+	"    redis.call('HSET', '{' .. KEYS[1] .. '}:"IPPOOL_ADDRESS_KEY":' .. ARGV[i],"
+		      " 'range', ARGV[2])" EOL						/* 6 */
+	"  end" EOL									/* 7 */
+	"end" EOL									/* 8 */
+	"return added" EOL;								/* 9 */
+
+/** Lua script for releasing leases
  *
  * - KEYS[1] The pool name.
- * - ARGV[1] IP address to release.
+ * - ARGV[1...] IP addresses to release.
  *
- * Removes the IP entry in the ZSET, then removes the address hash, and the device key
+ * Sets the score of each IP address in the ZSET to 0, then removes the device key
  * if one exists.
  *
- * Will do nothing if the lease is not found in the ZSET.
+ * IP addresses which aren't in the ZSET, or are already released, are skipped.
  *
- * Returns
- * - 0 if no ip addresses were removed.
- * - 1 if an ip address was removed.
+ * Returns the number of IP addresses released.
  */
 static char lua_release_cmd[] =
-	"local found" EOL								/* 1 */
-	"local ret" EOL									/* 2 */
+	"local released = 0" EOL							/* 1 */
+	"local pool_key = '{' .. KEYS[1] .. '}:"IPPOOL_POOL_KEY"'" EOL			/* 2 */
+	"for i = 1, #ARGV do" EOL							/* 3 */
 
 	/*
 	 *	Set expiry time to 0
 	 */
-	"ret = redis.call('ZADD', '{' .. KEYS[1] .. '}:"IPPOOL_POOL_KEY"', 'XX', 'CH', 0, ARGV[1])" EOL	/* 3 */
-	"if ret == 0 then" EOL								/* 4 */
-	"  return 0" EOL								/* 5 */
-	"end" EOL									/* 6 */
-	"found = redis.call('HGET', '{' .. KEYS[1] .. '}:"IPPOOL_ADDRESS_KEY":'"
-			    " .. ARGV[1], 'device')" EOL				/* 7 */
-	"if not found then" EOL								/* 8 */
-	"  return ret"	EOL								/* 9 */
-	"end" EOL									/* 10 */
+	"  if redis.call('ZADD', pool_key, 'XX', 'CH', 0, ARGV[i]) == 1 then" EOL	/* 4 */
+	"    released = released + 1" EOL						/* 5 */
+	"    local found = redis.call('HGET', '{' .. KEYS[1] .. '}:"IPPOOL_ADDRESS_KEY":'"
+			    " .. ARGV[i], 'device')" EOL				/* 6 */
 
 	/*
 	 *	Remove the association between the device and a lease
 	 */
-	"redis.call('DEL', '{' .. KEYS[1] .. '}:"IPPOOL_OWNER_KEY":' .. found)" EOL	/* 11 */
-	"return 1";									/* 12 */
-
-/** Lua script for removing a lease
+	"    if found then" EOL								/* 7 */
+	"      redis.call('DEL', '{' .. KEYS[1] .. '}:"IPPOOL_OWNER_KEY":' .. found)" EOL	/* 8 */
+	"    end" EOL									/* 9 */
+	"  end" EOL									/* 10 */
+	"end" EOL									/* 11 */
+	"return released" EOL;								/* 12 */
+
+/** Lua script for removing leases
  *
  * - KEYS[1] The pool name.
- * - ARGV[1] IP address to remove.
+ * - ARGV[1...] IP addresses to remove.
  *
- * Removes the IP entry in the ZSET, then removes the address hash, and the device key
+ * Removes each IP entry in the ZSET, then removes the address hash, and the device key
  * if one exists.
  *
  * Will work with partially removed IP addresses (where the ZSET entry is absent but other
  * elements weren't cleaned up).
  *
- * Returns
- * - 0 if no ip addresses were removed.
- * - 1 if an ip address was removed.
+ * Returns the number of IP addresses removed.
  */
 static char lua_remove_cmd[] =
-	"local found" EOL								/* 1 */
-	"local ret" EOL									/* 2 */
-	"local address_key" EOL								/* 3 */
-
-	"ret = redis.call('ZREM', '{' .. KEYS[1] .. '}:"IPPOOL_POOL_KEY"', ARGV[1])" EOL	/* 4 */
-	"address_key = '{' .. KEYS[1] .. '}:"IPPOOL_ADDRESS_KEY":' .. ARGV[1]" EOL	/* 5 */
-	"found = redis.call('HGET', address_key, 'device')" EOL				/* 6 */
-	"redis.call('DEL', address_key)" EOL						/* 7 */
-	"if not found then" EOL								/* 8 */
-	"  return ret"	EOL								/* 9 */
-	"end" EOL									/* 10 */
+	"local removed = 0" EOL								/* 1 */
+	"local pool_key = '{' .. KEYS[1] .. '}:"IPPOOL_POOL_KEY"'" EOL			/* 2 */
+	"for i = 1, #ARGV do" EOL							/* 3 */
+	"  local ret = redis.call('ZREM', pool_key, ARGV[i])" EOL			/* 4 */
+	"  local address_key = '{' .. KEYS[1] .. '}:"IPPOOL_ADDRESS_KEY":' .. ARGV[i]" EOL	/* 5 */
+	"  local found = redis.call('HGET', address_key, 'device')" EOL			/* 6 */
+	"  redis.call('DEL', address_key)" EOL						/* 7 */
 
 	/*
 	 *	Remove the association between the device and a lease
 	 */
-	"redis.call('DEL', '{' .. KEYS[1] .. '}:"IPPOOL_OWNER_KEY":' .. found)" EOL	/* 11 */
-	"return 1" EOL;									/* 12 */
+	"  if found then" EOL								/* 8 */
+	"    redis.call('DEL', '{' .. KEYS[1] .. '}:"IPPOOL_OWNER_KEY":' .. found)" EOL	/* 9 */
+	"    ret = 1" EOL								/* 10 */
+	"  end" EOL									/* 11 */
+	"  removed = removed + ret" EOL							/* 12 */
+	"end" EOL									/* 13 */
+	"return removed" EOL;								/* 14 */
+
+/** Lua script for modifying the range of leases
+ *
+ * - KEYS[1] The pool name.
+ * - ARGV[1] Range identifier.
+ * - ARGV[2...] IP addresses to modify.
+ *
+ * Returns the number of IP addresses modified.
+ */
+static char lua_modify_cmd[] =
+	"for i = 2, #ARGV do" EOL							/* 1 */
+	"  redis.call('HSET', '{' .. KEYS[1] .. '}:"IPPOOL_ADDRESS_KEY":' .. ARGV[i],"
+		    " 'range', ARGV[1])" EOL						/* 2 */
+	"end" EOL									/* 3 */
+	"return #ARGV - 1" EOL;								/* 4 */
 
 static NEVER_RETURNS void usage(int ret) {
-	INFO("Usage: %s -adrsm range... [-p prefix_len]... [-x]... [-oShf] server[:port] [pool] [range id]", name);
+	INFO("Usage: %s -adrsm range... [-p prefix_len]... [-x]... [-B num] [-oPShf] server[:port] [pool] [range id]", name);
 	INFO("Pool management:");
 	INFO("  -a range               Add address(es)/prefix(es) to the pool.");
 	INFO("  -d range               Delete address(es)/prefix(es) in this range.");
@@ -211,6 +254,10 @@ static NEVER_RETURNS void usage(int ret) {
 	INFO("                         instance of an -adrsm argument, only.");
 	INFO("  -m range               Change the range id to the one specified for addresses");
 	INFO("                         in this range.");
+	INFO("  -B num                 Number of addresses/prefixes each Lua script call operates on");
+	INFO("                         (defaults to 1000).  Larger batches are faster, but block the");
+	INFO("                         Redis server for longer.");
+	INFO("  -P                     Print progress while operating on a range.");
 	INFO("  -l                     List available pools.");
 //	INFO("  -L                     List available ranges in pool [NYI]");
 //	INFO("  -i file                Import entries from ISC lease file [NYI]");
@@ -465,226 +512,243 @@ static inline int driver_show_lease(void *out, void *instance, ippool_tool_opera
 	return driver_do_lease(out, instance, op, _driver_show_lease_enqueue, _driver_show_lease_process);
 }
 
-/** Count the number of leases we released
+/** Run a Lua script over a range of addresses or prefixes
+ *
+ * Each script call operates on up to batch_size addresses, and up to
+ * MAX_PIPELINED_CALLS calls are pipelined per round trip, so large
+ * ranges take a few round trips, instead of one per address.
  *
+ * The script is loaded with SCRIPT LOAD in the first round trip, and
+ * called with EVALSHA, so its text is only sent once.  If a node
+ * doesn't have the script cached, because we were redirected to it,
+ * or its script cache was flushed, the block is sent again with EVAL
+ * for its first call, which caches the script on that node.
+ *
+ * @param[out] modified		Sum of the values returned by the script.
+ * @param[in] instance		of the driver.
+ * @param[in] op		describing the range of addresses.
+ * @param[in] verb		for progress messages, e.g. "Added".
+ * @param[in] script		to run.
+ * @param[in] args		to pass to the script before the addresses.
+ * @param[in] args_len		lengths of args.
+ * @param[in] num_args		in args.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
  */
-static int _driver_release_lease_process(void *out, UNUSED fr_ipaddr_t const *ipaddr, redisReply const *reply)
+static int driver_do_lease_batch(uint64_t *modified, void *instance, ippool_tool_operation_t const *op,
+				 char const *verb, char const *script,
+				 char const **args, size_t const *args_len, int num_args)
 {
-	uint64_t *modified = out;
-	/*
-	 *	Record the actual number of addresses released.
-	 *	Leases with a score of zero shouldn't be included,
-	 *	in this count.
-	 */
-	if (reply->type != REDIS_REPLY_INTEGER) return -1;
+	redis_driver_conf_t		*inst = talloc_get_type_abort(instance, redis_driver_conf_t);
 
-	*modified += reply->integer;
+	size_t				i;
+	bool				more = true;
+	fr_redis_conn_t			*conn;
 
-	return 0;
-}
+	fr_redis_cluster_state_t	state;
+	fr_redis_rcode_t		status;
 
-/** Release a lease by setting its score back to zero
- *
- */
-static int _driver_release_lease_enqueue(UNUSED redis_driver_conf_t *inst, fr_redis_conn_t *conn,
-					 uint8_t const *key_prefix, size_t key_prefix_len,
-					 UNUSED uint8_t const *range, UNUSED size_t range_len,
-					 fr_ipaddr_t *ipaddr, uint8_t prefix)
-{
-	char		ip_buff[FR_IPADDR_PREFIX_STRLEN];
+	fr_ipaddr_t			ipaddr = op->start;
+	fr_redis_rcode_t		s_ret = REDIS_RCODE_SUCCESS;
+	redisReply			*replies[MAX_PIPELINED_CALLS + 1];	/* Calls, and SCRIPT LOAD */
 
-	IPPOOL_SPRINT_IP(ip_buff, ipaddr, prefix);
+	unsigned int			pipelined = 0;
+	uint64_t			done = 0;
 
-	DEBUG("Releasing %pV to pool \"%pV\"", ip_buff,
-	      fr_box_strvalue_len((char const *)key_prefix, key_prefix_len));
-	redisAppendCommand(conn->handle, "EVAL %s 1 %b %s", lua_release_cmd, key_prefix, key_prefix_len, ip_buff);
-	return 1;
-}
+	fr_sha1_ctx			sha1_ctx;
+	uint8_t				digest[SHA1_DIGEST_LENGTH];
+	char				digest_str[(SHA1_DIGEST_LENGTH * 2) + 1];
+	bool				load = true;
 
-/** Release a range of leases
- *
- */
-static inline int driver_release_lease(void *out, void *instance, ippool_tool_operation_t const *op)
-{
-	return driver_do_lease(out, instance, op,
-			       _driver_release_lease_enqueue, _driver_release_lease_process);
-}
+	size_t				argc_max = 4 + num_args + batch_size;
+	int				ret = 0;
+	char const			**argv;
+	size_t				*argv_len;
+	char				*ip_buffs;
+	char				last[FR_IPADDR_PREFIX_STRLEN] = "";
 
-/** Count the number of leases we removed
- *
- * Because the ZREM and DEL have to occur in a transaction, we need
- * some fancier processing to just count the number of ZREMs.
- */
-static int _driver_remove_lease_process(void *out, UNUSED fr_ipaddr_t const *ipaddr, redisReply const *reply)
-{
-	uint64_t *modified = out;
 	/*
-	 *	Record the actual number of addresses released.
-	 *	Leases with a score of zero shouldn't be included,
-	 *	in this count.
+	 *	hiredis copies the arguments when the command is
+	 *	appended, so these can be reused for every call.
 	 */
-	if (reply->type != REDIS_REPLY_INTEGER) return -1;
+	MEM(argv = talloc_array(inst, char const *, argc_max));
+	MEM(argv_len = talloc_array(inst, size_t, argc_max));
+	MEM(ip_buffs = talloc_array(inst, char, (size_t)batch_size * FR_IPADDR_PREFIX_STRLEN));
+
+	fr_sha1_init(&sha1_ctx);
+	fr_sha1_update(&sha1_ctx, (uint8_t const *)script, strlen(script));
+	fr_sha1_final(digest, &sha1_ctx);
+	fr_base16_encode(&FR_SBUFF_OUT(digest_str, sizeof(digest_str)), &FR_DBUFF_TMP(digest, sizeof(digest)));
+
+	argv[2] = "1";
+	argv_len[2] = 1;
+	argv[3] = (char const *)op->pool;
+	argv_len[3] = op->pool_len;
+	for (i = 0; i < (size_t)num_args; i++) {
+		argv[4 + i] = args[i];
+		argv_len[4 + i] = args_len[i];
+	}
 
-	*modified += reply->integer;
+	while (more) {
+		fr_ipaddr_t	acked = ipaddr; 	/* Record our progress */
+		size_t		reply_cnt = 0;
+		size_t		first = 0;
+		uint64_t	block_done = 0;
 
-	return 0;
-}
+		for (s_ret = fr_redis_cluster_state_init(&state, &conn, inst->cluster, NULL,
+							 op->pool, op->pool_len, false);
+		     s_ret == REDIS_RCODE_TRY_AGAIN;
+		     s_ret = fr_redis_cluster_state_next(&state, &conn, inst->cluster, NULL, status, &replies[0])) {
+			unsigned int	calls;
+			bool		eval = false;
 
-/** Enqueue lease removal commands
- *
- * This removes the lease from the expiry heap, and the data associated with
- * the lease.
- */
-static int _driver_remove_lease_enqueue(UNUSED redis_driver_conf_t *inst, fr_redis_conn_t *conn,
-					uint8_t const *key_prefix, size_t key_prefix_len,
-					UNUSED uint8_t const *range, UNUSED size_t range_len,
-					fr_ipaddr_t *ipaddr, uint8_t prefix)
-{
-	char		ip_buff[FR_IPADDR_PREFIX_STRLEN];
+		again:
+		     	more = true;	/* Reset to true, may have errored last loop */
+			status = REDIS_RCODE_SUCCESS;
+			block_done = 0;
 
-	IPPOOL_SPRINT_IP(ip_buff, ipaddr, prefix);
+			/*
+			 *	If we got a redirect, start back at the beginning of the block.
+			 */
+			ipaddr = acked;
 
-	DEBUG("Removing %s from pool \"%pV\"", ip_buff,
-	      fr_box_strvalue_len((char const *)key_prefix, key_prefix_len));
-	redisAppendCommand(conn->handle, "EVAL %s 1 %b %s", lua_remove_cmd, key_prefix, key_prefix_len, ip_buff);
-	return 1;
-}
+			if (load) {
+				DEBUG("Loading script 0x%s", digest_str);
+				redisAppendCommand(conn->handle, "SCRIPT LOAD %s", script);
+				pipelined++;
+			}
 
-/** Remove a range of leases
- *
- */
-static int driver_remove_lease(void *out, void *instance, ippool_tool_operation_t const *op)
-{
-	return driver_do_lease(out, instance, op,
-			       _driver_remove_lease_enqueue, _driver_remove_lease_process);
-}
+			for (calls = 0; (calls < MAX_PIPELINED_CALLS) && more; calls++) {
+				int argc = 4 + num_args;
+
+				if (eval && (calls == 0)) {
+					argv[0] = "EVAL";
+					argv_len[0] = sizeof("EVAL") - 1;
+					argv[1] = script;
+					argv_len[1] = strlen(script);
+				} else {
+					argv[0] = "EVALSHA";
+					argv_len[0] = sizeof("EVALSHA") - 1;
+					argv[1] = digest_str;
+					argv_len[1] = sizeof(digest_str) - 1;
+				}
 
-/** Count the number of leases we actually added
- *
- * This isn't necessarily the same as the number of ZADDs, as leases may
- * already exist.
- */
-static int _driver_add_lease_process(void *out, UNUSED fr_ipaddr_t const *ipaddr, redisReply const *reply)
-{
-	uint64_t *modified = out;
-	/*
-	 *	Record the actual number of addresses modified.
-	 *	Existing addresses won't be included in this
-	 *	count.
-	 */
-	if (reply->type != REDIS_REPLY_ARRAY) return -1;
+				for (i = 0; (i < batch_size) && more; i++, more = ipaddr_next(&ipaddr, &op->end,
+											      op->prefix)) {
+					char *ip_buff = ip_buffs + (i * FR_IPADDR_PREFIX_STRLEN);
 
-	if ((reply->elements > 0) && (reply->element[0]->type == REDIS_REPLY_INTEGER)) {
-		*modified += reply->element[0]->integer;
-	}
-	return 0;
-}
+					IPPOOL_SPRINT_IP(last, &ipaddr, op->prefix);
+					argv_len[argc] = strlcpy(ip_buff, last, FR_IPADDR_PREFIX_STRLEN);
+					argv[argc++] = ip_buff;
+				}
 
-/** Enqueue lease addition commands
- *
- */
-static int _driver_add_lease_enqueue(UNUSED redis_driver_conf_t *inst, fr_redis_conn_t *conn,
-				     uint8_t const *key_prefix, size_t key_prefix_len,
-				     uint8_t const *range, size_t range_len,
-				     fr_ipaddr_t *ipaddr, uint8_t prefix)
-{
-	uint8_t		key[IPPOOL_MAX_POOL_KEY_SIZE];
-	uint8_t		*key_p = key;
-	char		ip_buff[FR_IPADDR_PREFIX_STRLEN];
+				DEBUG("Queued %zu address(es)/prefix(es), up to %s, for pool \"%pV\"", i, last,
+				      fr_box_strvalue_len((char const *)op->pool, op->pool_len));
+				redisAppendCommandArgv(conn->handle, argc, argv, argv_len);
+				pipelined++;
+				block_done += i;
+			}
 
-	uint8_t		ip_key[IPPOOL_MAX_IP_KEY_SIZE];
-	uint8_t		*ip_key_p = ip_key;
+			reply_cnt = fr_redis_pipeline_result(&pipelined, &status, replies,
+							     NUM_ELEMENTS(replies), conn);
+			for (i = 0; i < reply_cnt; i++) fr_redis_reply_print(L_DBG_LVL_3, replies[i], NULL, i);
 
-	int		enqueued = 0;
+			/*
+			 *	The node doesn't have the script cached,
+			 *	send the block again, with the script.
+			 */
+			if ((status == REDIS_RCODE_NO_SCRIPT) && !eval) {
+				DEBUG("Script 0x%s not cached, sending it with the next call", digest_str);
+				fr_redis_pipeline_free(replies, reply_cnt);
+				eval = true;
+				goto again;
+			}
+		}
+		if (s_ret != REDIS_RCODE_SUCCESS) {
+			fr_redis_pipeline_free(replies, reply_cnt);
+			ret = -1;
+			goto finish;
+		}
 
-	IPPOOL_BUILD_KEY(key, key_p, key_prefix, key_prefix_len);
-	IPPOOL_SPRINT_IP(ip_buff, ipaddr, prefix);
-	IPPOOL_BUILD_IP_KEY_FROM_STR(ip_key, ip_key_p, key_prefix, key_prefix_len, ip_buff);
+		/*
+		 *	The first reply is the script's SHA1.
+		 */
+		if (load) {
+			if ((replies[0]->type != REDIS_REPLY_STRING) || (strcmp(replies[0]->str, digest_str) != 0)) {
+				ERROR("Bad response to SCRIPT LOAD, expected SHA1 %s", digest_str);
+				fr_redis_pipeline_free(replies, reply_cnt);
+				ret = -1;
+				goto finish;
+			}
+			load = false;
+			first = 1;
+		}
 
-	DEBUG("Adding %s to pool \"%pV\" (%zu)", ip_buff, fr_box_strvalue_len((char *)key, (key_p - key)), key_p - key);
-	redisAppendCommand(conn->handle, "MULTI");
-	enqueued++;
-	redisAppendCommand(conn->handle, "ZADD %b NX %u %s", key, key_p - key, 0, ip_buff);
-	enqueued++;
+		for (i = first; i < reply_cnt; i++) {
+			if (replies[i]->type != REDIS_REPLY_INTEGER) {
+				ERROR("Server returned unexpected type \"%s\" from script",
+				      fr_table_str_by_value(redis_reply_types, replies[i]->type, "<UNKNOWN>"));
+				fr_redis_pipeline_free(replies, reply_cnt);
+				ret = -1;
+				goto finish;
+			}
+			*modified += replies[i]->integer;
+		}
+		fr_redis_pipeline_free(replies, reply_cnt);
 
-	/*
-	 *	Only add range if it's not NULL.
-	 *
-	 *	Zero length ranges are allowed, and should be preserved.
-	 */
-	if (range) {
-		redisAppendCommand(conn->handle, "HSET %b range %b", ip_key, ip_key_p - ip_key, range, range_len);
-		enqueued++;
+		done += block_done;
+		if (show_progress) INFO("%s %" PRIu64 " address(es)/prefix(es), up to %s (%" PRIu64 " processed)",
+					verb, *modified, last, done);
 	}
-	redisAppendCommand(conn->handle, "EXEC");
-	enqueued++;
 
-	return enqueued;
+finish:
+	talloc_free(argv);
+	talloc_free(argv_len);
+	talloc_free(ip_buffs);
+
+	return ret;
 }
 
-/** Add a range of prefixes
+/** Release a range of leases
  *
  */
-static int driver_add_lease(void *out, void *instance, ippool_tool_operation_t const *op)
+static inline int driver_release_lease(uint64_t *modified, void *instance, ippool_tool_operation_t const *op)
 {
-	return driver_do_lease(out, instance, op, _driver_add_lease_enqueue, _driver_add_lease_process);
+	return driver_do_lease_batch(modified, instance, op, "Released", lua_release_cmd, NULL, NULL, 0);
 }
 
-/** Count the number of leases we modified
+/** Remove a range of leases
+ *
+ * This removes the leases from the expiry heap, and the data associated with
+ * the leases.
  */
-static int _driver_modify_lease_process(void *out, UNUSED fr_ipaddr_t const *ipaddr, redisReply const *reply)
+static int driver_remove_lease(uint64_t *modified, void *instance, ippool_tool_operation_t const *op)
 {
-	uint64_t *modified = out;
-	/*
-	 *	Record the actual number of addresses released.
-	 *	Leases with a score of zero shouldn't be included,
-	 *	in this count.
-	 */
-	if (reply->type != REDIS_REPLY_INTEGER) return -1;
-
-	/*
-	 *	return code is 0 or 1 depending on if its a new
-	 *	field, neither are useful
-	 */
-	*modified += 1;
-
-	return 0;
+	return driver_do_lease_batch(modified, instance, op, "Removed", lua_remove_cmd, NULL, NULL, 0);
 }
 
-/** Enqueue lease removal commands
+/** Add a range of prefixes
  *
- * This modifys the lease from the expiry heap, and the data associated with
- * the lease.
+ * Only set the range if it's not NULL.
  */
-static int _driver_modify_lease_enqueue(UNUSED redis_driver_conf_t *inst, fr_redis_conn_t *conn,
-					uint8_t const *key_prefix, size_t key_prefix_len,
-					uint8_t const *range, size_t range_len,
-					fr_ipaddr_t *ipaddr, uint8_t prefix)
+static int driver_add_lease(uint64_t *modified, void *instance, ippool_tool_operation_t const *op)
 {
-	uint8_t		key[IPPOOL_MAX_POOL_KEY_SIZE];
-	uint8_t		*key_p = key;
-	char		ip_buff[FR_IPADDR_PREFIX_STRLEN];
-
-	uint8_t		ip_key[IPPOOL_MAX_IP_KEY_SIZE];
-	uint8_t		*ip_key_p = ip_key;
+	char const	*args[] = { op->range ? "1" : "0", op->range ? (char const *)op->range : "" };
+	size_t		args_len[] = { 1, op->range_len };
 
-	IPPOOL_BUILD_KEY(key, key_p, key_prefix, key_prefix_len);
-	IPPOOL_SPRINT_IP(ip_buff, ipaddr, prefix);
-	IPPOOL_BUILD_IP_KEY_FROM_STR(ip_key, ip_key_p, key_prefix, key_prefix_len, ip_buff);
-
-	DEBUG("Modifying %s in pool \"%pV\"", ip_buff, fr_box_strvalue_len((char const *)key_prefix, key_prefix_len));
-	redisAppendCommand(conn->handle, "HSET %b range %b", ip_key, ip_key_p - ip_key, range, range_len);
-
-	return 1;
+	return driver_do_lease_batch(modified, instance, op, "Added", lua_add_cmd, args, args_len, 2);
 }
 
-/** Remove a range of leases
+/** Modify the range of a range of leases
  *
  */
-static int driver_modify_lease(void *out, void *instance, ippool_tool_operation_t const *op)
+static int driver_modify_lease(uint64_t *modified, void *instance, ippool_tool_operation_t const *op)
 {
-	return driver_do_lease(out, instance, op,
-			       _driver_modify_lease_enqueue, _driver_modify_lease_process);
+	char const	*args[] = { op->range ? (char const *)op->range : "" };
+	size_t		args_len[] = { op->range_len };
+
+	return driver_do_lease_batch(modified, instance, op, "Modified", lua_modify_cmd, args, args_len, 1);
 }
 
 /** Compare two pool names
@@ -1229,7 +1293,7 @@ do { \
 	need_pool = true; \
 } while (0);
 
-	while ((c = getopt(argc, argv, "a:d:r:s:Sm:p:ilLhxo:f:")) != -1) switch (c) {
+	while ((c = getopt(argc, argv, "a:d:r:s:Sm:p:B:PilLhxo:f:")) != -1) switch (c) {
 		case 'a':
 			ADD_ACTION(IPPOOL_TOOL_ADD);
 			break;
@@ -1270,6 +1334,24 @@ do { \
 		}
 			break;
 
+		case 'B':
+		{
+			unsigned long tmp;
+			char *q;
+
+			tmp = strtoul(optarg, &q, 10);
+			if ((q != (optarg + strlen(optarg))) || (tmp == 0) || (tmp > 100000)) {
+				ERROR("Batch size must be an integer value between 1 and 100000");
+				usage(64);
+			}
+			batch_size = (uint32_t)tmp;
+		}
+			break;
+
+		case 'P':
+			show_progress = true;
+			break;
+
 		case 'i':
 			do_import = optarg;
 			break;
@@ -29,6 +29,7 @@ RCSIDH(rest_h, "$Id$")
 #include <freeradius-devel/curl/config.h>
 #include <freeradius-devel/server/pairmove.h>
 #include <freeradius-devel/server/pool.h>
+#include <freeradius-devel/unlang/coalesce.h>
 
 /*
  *	The common JSON library (also tells us if we have json-c)
@@ -152,6 +153,9 @@ typedef struct {
 	int			http_negotiation; //!< What HTTP version to negotiate, and how to
 						///< negotiate it.  One or the CURL_HTTP_VERSION_ macros.
 
+	bool			coalesce;	//!< Whether identical concurrent GETs from the xlat
+						///< share a single HTTP request.
+
 	bool			multiplex;	//!< Whether to perform multiple requests using a single
 						///< connection.
 
@@ -177,6 +181,7 @@ typedef struct {
 	fr_pool_t		*pool;		//!< Thread specific connection pool.
 	fr_curl_handle_t	*mhandle;	//!< Thread specific multi handle.  Serves as the dispatch
 						//!< and coralling structure for REST requests.
+	unlang_coalesce_t	*coalesce;	//!< Outstanding xlat GETs, which identical GETs can wait on.
 } rlm_rest_thread_t;
 
 /*
@@ -258,6 +263,7 @@ typedef struct {
 typedef struct {
 	rlm_rest_section_t	section;	//!< Our mutated section config.
 	fr_curl_io_request_t	*handle;	//!< curl easy handle servicing our request.
+	unlang_coalesce_call_t	*call;		//!< Identical GETs waiting on this one.
 } rlm_rest_xlat_rctx_t;
 
 extern HIDDEN fr_dict_t const *dict_freeradius;
@@ -30,6 +30,7 @@ RCSID("$Id$")
 #include <freeradius-devel/server/module_rlm.h>
 #include <freeradius-devel/server/pairmove.h>
 #include <freeradius-devel/tls/base.h>
+#include <freeradius-devel/unlang/call.h>
 #include <freeradius-devel/util/debug.h>
 #include <freeradius-devel/util/table.h>
 #include <freeradius-devel/util/uri.h>
@@ -141,6 +142,8 @@ static const CONF_PARSER module_config[] = {
 	{ FR_CONF_OFFSET("http_negotiation", FR_TYPE_VOID, rlm_rest_t, http_negotiation),
 	  .func = cf_table_parse_int, .uctx = &(cf_table_parse_ctx_t){ .table = http_negotiation_table, .len = &http_negotiation_table_len }, .dflt = "default" },
 
+	{ FR_CONF_OFFSET("coalesce", FR_TYPE_BOOL, rlm_rest_t, coalesce), .dflt = "no" },
+
 #ifdef CURLPIPE_MULTIPLEX
 	{ FR_CONF_OFFSET("multiplex", FR_TYPE_BOOL, rlm_rest_t, multiplex), .dflt = "yes" },
 #endif
@@ -269,10 +272,14 @@ static xlat_action_t rest_xlat_resume(TALLOC_CTX *ctx, fr_dcursor_t *out,
 	ssize_t				len;
 	char const			*body;
 	xlat_action_t			xa = XLAT_ACTION_DONE;
+	fr_value_box_t			*vb;
+	FR_DLIST_HEAD(fr_value_box_list) result;
 
 	fr_curl_io_request_t		*handle = talloc_get_type_abort(rctx->handle, fr_curl_io_request_t);
 	rlm_rest_section_t		*section = &rctx->section;
 
+	fr_value_box_list_init(&result);
+
 	if (section->tls.extract_cert_attrs) fr_curl_response_certinfo(request, handle);
 
 	if (rlm_rest_status_update(request, handle) < 0) {
@@ -312,14 +319,15 @@ error:
 
 	len = rest_get_handle_data(&body, handle);
 	if (len > 0) {
-		fr_value_box_t *vb;
-
 		MEM(vb = fr_value_box_alloc_null(ctx));
 		fr_value_box_bstrndup(vb, vb, NULL, body, len, true);
-		fr_dcursor_insert(out, vb);
+		fr_value_box_list_insert_tail(&result, vb);
 	}
 
 finish:
+	if (rctx->call) unlang_coalesce_done(rctx->call, (xa == XLAT_ACTION_DONE), &result);
+	while ((vb = fr_value_box_list_pop_head(&result))) fr_dcursor_insert(out, vb);
+
 	rest_request_cleanup(inst, handle);
 
 	fr_pool_connection_release(t->pool, request, handle);
@@ -403,6 +411,8 @@ static xlat_action_t rest_xlat(UNUSED TALLOC_CTX *ctx, UNUSED fr_dcursor_t *out,
 	int				ret;
 	http_method_t			method;
 	fr_value_box_t			*in_vb = fr_value_box_list_pop_head(in), *uri_vb = NULL;
+	bool				coalesce = false;
+	char				*key = NULL;
 
 	/* There are no configurable parameters other than the URI */
 	rlm_rest_xlat_rctx_t		*rctx;
@@ -500,6 +510,34 @@ static xlat_action_t rest_xlat(UNUSED TALLOC_CTX *ctx, UNUSED fr_dcursor_t *out,
 		}
 		section->body = REST_HTTP_BODY_CUSTOM_LITERAL;
 		section->data = in_vb->vb_strvalue;
+
+	/*
+	 *	An identical GET is already in progress,
+	 *	wait for its result instead.
+	 *
+	 *	Requests which add their own headers, or which
+	 *	expand their own credentials, may get a different
+	 *	response, so they always make their own call.
+	 *	The virtual server name is sent as a header, so
+	 *	it's part of the key along with the method.
+	 */
+	} else if (t->coalesce && (section->method == REST_HTTP_METHOD_GET) &&
+		   (section->auth <= REST_HTTP_AUTH_NONE) &&
+		   !fr_pair_find_by_da(&request->control_pairs, NULL, attr_rest_http_header)) {
+		unlang_coalesce_call_t *call;
+
+		MEM(key = talloc_typed_asprintf(rctx, "GET %s %s", cf_section_name2(unlang_call_current(request)),
+						uri_vb->vb_strvalue));
+
+		call = unlang_coalesce_find(t->coalesce, key, talloc_array_length(key) - 1);
+		if (call) {
+			rest_request_cleanup(inst, randle);
+			fr_pool_connection_release(t->pool, request, randle);
+			talloc_free(rctx);
+
+			return unlang_coalesce_xlat_yield(request, call);
+		}
+		coalesce = true;
 	}
 
 	RDEBUG2("Sending HTTP %s to \"%pV\"",
@@ -527,6 +565,10 @@ static xlat_action_t rest_xlat(UNUSED TALLOC_CTX *ctx, UNUSED fr_dcursor_t *out,
 	ret = fr_curl_io_request_enqueue(t->mhandle, request, randle);
 	if (ret < 0) goto error;
 
+	if (coalesce) {
+		rctx->call = unlang_coalesce_start(rctx, t->coalesce, request, key, talloc_array_length(key) - 1);
+	}
+
 	return unlang_xlat_yield(request, rest_xlat_resume, rest_io_xlat_signal, rctx);
 }
 
@@ -1134,6 +1176,8 @@ static int mod_thread_instantiate(module_thread_inst_ctx_t const *mctx)
 
 	t->mhandle = mhandle;
 
+	if (inst->coalesce) MEM(t->coalesce = unlang_coalesce_alloc(t));
+
 	return 0;
 }
 
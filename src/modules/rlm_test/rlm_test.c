@@ -29,6 +29,7 @@ RCSID("$Id$")
 #include <freeradius-devel/server/base.h>
 #include <freeradius-devel/server/module_rlm.h>
 #include <freeradius-devel/server/tmpl.h>
+#include <freeradius-devel/unlang/coalesce.h>
 #include <freeradius-devel/util/debug.h>
 
 /*
@@ -111,8 +112,11 @@ typedef struct {
 } rlm_test_t;
 
 typedef struct {
-	rlm_test_t	*inst;
-	pthread_t	value;
+	rlm_test_t		*inst;
+	pthread_t		value;
+
+	unlang_coalesce_t	*coalesce;		//!< Outstanding calls to the test_coalesce xlat.
+	uint64_t		coalesce_calls;		//!< How many "backend" calls test_coalesce has made.
 } rlm_test_thread_t;
 
 /*
@@ -410,6 +414,72 @@ static xlat_action_t test_xlat(TALLOC_CTX *ctx, fr_dcursor_t *out,
 }
 
 
+typedef struct {
+	unlang_coalesce_call_t	*call;
+	uint64_t		calls;
+} rlm_test_coalesce_rctx_t;
+
+static void coalesce_test_xlat_done(UNUSED xlat_ctx_t const *xctx, request_t *request, UNUSED fr_time_t fired)
+{
+	unlang_interpret_mark_runnable(request);
+}
+
+static xlat_action_t coalesce_test_xlat_resume(TALLOC_CTX *ctx, fr_dcursor_t *out,
+					       xlat_ctx_t const *xctx, UNUSED request_t *request,
+					       UNUSED FR_DLIST_HEAD(fr_value_box_list) *in)
+{
+	rlm_test_coalesce_rctx_t	*rctx = talloc_get_type_abort(xctx->rctx, rlm_test_coalesce_rctx_t);
+	fr_value_box_t			*vb;
+	FR_DLIST_HEAD(fr_value_box_list) result;
+
+	fr_value_box_list_init(&result);
+
+	MEM(vb = fr_value_box_alloc(ctx, FR_TYPE_UINT64, NULL, false));
+	vb->vb_uint64 = rctx->calls;
+	fr_value_box_list_insert_tail(&result, vb);
+
+	unlang_coalesce_done(rctx->call, true, &result);
+
+	while ((vb = fr_value_box_list_pop_head(&result))) fr_dcursor_append(out, vb);
+	talloc_free(rctx);
+
+	return XLAT_ACTION_DONE;
+}
+
+static xlat_arg_parser_t const coalesce_test_xlat_args[] = {
+	{ .required = true, .concat = true, .type = FR_TYPE_STRING },
+	XLAT_ARG_PARSER_TERMINATOR
+};
+
+/** Make a slow "backend" call, which identical calls are coalesced with (useful for testing)
+ *
+ * Returns the number of backend calls this thread has made, including this one.
+ */
+static xlat_action_t coalesce_test_xlat(UNUSED TALLOC_CTX *ctx, UNUSED fr_dcursor_t *out,
+					xlat_ctx_t const *xctx, request_t *request,
+					FR_DLIST_HEAD(fr_value_box_list) *in)
+{
+	rlm_test_thread_t		*t = talloc_get_type_abort(xctx->mctx->thread, rlm_test_thread_t);
+	fr_value_box_t			*in_head = fr_value_box_list_head(in);
+	unlang_coalesce_call_t		*call;
+	rlm_test_coalesce_rctx_t	*rctx;
+
+	call = unlang_coalesce_find(t->coalesce, in_head->vb_strvalue, in_head->vb_length);
+	if (call) return unlang_coalesce_xlat_yield(request, call);
+
+	MEM(rctx = talloc_zero(unlang_interpret_frame_talloc_ctx(request), rlm_test_coalesce_rctx_t));
+	rctx->calls = ++t->coalesce_calls;
+	rctx->call = unlang_coalesce_start(rctx, t->coalesce, request, in_head->vb_strvalue, in_head->vb_length);
+
+	if (unlang_xlat_timeout_add(request, coalesce_test_xlat_done, rctx,
+				    fr_time_add(fr_time(), fr_time_delta_from_msec(10))) < 0) {
+		talloc_free(rctx);
+		return XLAT_ACTION_FAIL;
+	}
+
+	return unlang_xlat_yield(request, coalesce_test_xlat_resume, NULL, rctx);
+}
+
 static int mod_thread_instantiate(module_thread_inst_ctx_t const *mctx)
 {
 	rlm_test_t *inst = talloc_get_type_abort(mctx->inst->data, rlm_test_t);
@@ -417,6 +487,7 @@ static int mod_thread_instantiate(module_thread_inst_ctx_t const *mctx)
 
 	t->inst = inst;
 	t->value = pthread_self();
+	MEM(t->coalesce = unlang_coalesce_alloc(t));
 	INFO("Performing instantiation for thread %p (ctx %p)", (void *)t->value, t);
 
 	return 0;
@@ -489,6 +560,10 @@ static int mod_bootstrap(module_inst_ctx_t const *mctx)
 		if (!(xlat = xlat_register_module(inst, mctx, "test", test_xlat, FR_TYPE_STRING, NULL))) return -1;
 		xlat_func_args(xlat, test_xlat_args);
 
+		if (!(xlat = xlat_register_module(inst, mctx, "test_coalesce", coalesce_test_xlat, FR_TYPE_UINT64,
+						  XLAT_FLAG_NEEDS_ASYNC))) return -1;
+		xlat_func_args(xlat, coalesce_test_xlat_args);
+
 	} else {
 		if (!(xlat = xlat_register_module(inst, mctx, mctx->inst->name, test_xlat, FR_TYPE_VOID, NULL))) return -1;
 		xlat_func_args(xlat, test_xlat_args);
@@ -30,6 +30,7 @@
 #include <freeradius-devel/server/module.h>
 #include <freeradius-devel/server/pair.h>
 #include <freeradius-devel/server/protocol.h>
+#include <freeradius-devel/server/reload.h>
 #include <freeradius-devel/server/state.h>
 
 #include <freeradius-devel/unlang/module.h>
@@ -361,12 +362,29 @@ RECV(access_request)
 {
 	process_radius_t const		*inst = talloc_get_type_abort_const(mctx->inst->data, process_radius_t);
 
+	switch (fr_state_to_request(inst->auth.state_tree, request)) {
+	case 0:
+	case 1:
+		break;
+
+	/*
+	 *	The state may belong to the previous server
+	 *	process, which is still running after a reload.
+	 *	If so, it processes the request and replies.
+	 */
+	case 2:
+		if (fr_reload_forward(request)) {
+			request->reply->code = FR_RADIUS_CODE_DO_NOT_RESPOND;
+			RETURN_MODULE_HANDLED;
+		}
+		break;
+
 	/*
 	 *	Only reject if the state has already been thawed.
 	 *	It could be that the state value wasn't intended
 	 *	for us, and we're just proxying upstream.
 	 */
-	if (fr_state_to_request(inst->auth.state_tree, request) < 0) {
+	default:
 		return CALL_SEND_TYPE(FR_RADIUS_CODE_ACCESS_REJECT);
 	}
 
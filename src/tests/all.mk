@@ -55,10 +55,12 @@ test: \
 		test.modules	\
 		test.radiusd-c	\
 		test.radclient	\
+		test.radperf	\
 		test.radsniff	\
 		test.auth	\
 		test.digest	\
 		test.radmin	\
+		test.metrics	\
 		test.eap	\
 		test.tacacs	\
 		test.vmps	\
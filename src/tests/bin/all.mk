@@ -3,6 +3,7 @@ TEST	:= test.bin
 FILES	:= \
 	atomic_queue_test 	\
 	radclient		\
+	radperf			\
 	radict 			\
 	radmin			\
 	radsniff 		\
@@ -37,6 +38,7 @@ $(eval $(call TEST_BOOTSTRAP))
 #  Some tests take arguments, others do not.
 #
 radclient.ARGS = -h
+radperf.ARGS = -h
 radict.ARGS = -D $(top_srcdir)/share/dictionary User-Name
 radmin.ARGS = -h
 radsniff.ARGS =  -D $(top_srcdir)/share/dictionary -h
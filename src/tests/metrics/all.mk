@@ -0,0 +1,76 @@
+#
+#	Tests for the OpenMetrics exporter, scraped over HTTP.
+#
+#	Each "foo.txt" file contains an HTTP method and path, and
+#	optionally the size of a padding header to send.  Each line
+#	of "foo.out" is a regular expression which must match a line
+#	of the response, headers included.
+#
+
+#
+#	Test name
+#
+TEST := test.metrics
+FILES  := $(subst $(DIR)/,,$(wildcard $(DIR)/*.txt))
+
+#
+#  We need something to scrape the metrics with.
+#
+ifeq "$(shell which curl 2>/dev/null)" ""
+FILES :=
+endif
+
+$(eval $(call TEST_BOOTSTRAP))
+
+#
+#	Config settings
+#
+METRICS_RADIUS_LOG := $(OUTPUT)/radiusd.log
+
+#
+#  Generic rules to start / stop the radius service.
+#
+CLIENT := radmin
+include src/tests/radiusd.mk
+$(eval $(call RADIUSD_SERVICE,metrics,$(OUTPUT)))
+
+#
+#	Scrape the metrics from the radiusd.
+#
+#	Each thread publishes its counters once a second, so a new
+#	socket may not show up in the first scrape.  Try a few times.
+#
+$(OUTPUT)/%: $(DIR)/% | $(TEST).radiusd_kill $(TEST).radiusd_start
+	@echo "METRICS-TEST $(notdir $@)"
+	${Q} [ -f $(dir $@)/radiusd.pid ] || exit 1
+	$(eval EXPECTED := $(patsubst %.txt,%.out,$<))
+	$(eval FOUND    := $(patsubst %.txt,%.out,$@))
+	${Q}read method path pad < $<; \
+	if [ "$$method" = "HEAD" ]; then opt="--head"; else opt="--request $$method"; fi; \
+	if [ -n "$$pad" ]; then hdr="X-Padding: `printf '%*s' $$pad '' | tr ' ' x`"; else hdr="X-Padding: none"; fi; \
+	for try in 1 2 3; do \
+		curl --silent --show-error --include --max-time 5 $$opt --header "$$hdr" "http://127.0.0.1:$(metrics_port)$$path" > $(FOUND) 2>&1; \
+		missing=""; \
+		while read -r pattern; do \
+			grep -qE -- "$$pattern" $(FOUND) || { missing="$$pattern"; break; }; \
+		done < $(EXPECTED); \
+		[ -z "$$missing" ] && break; \
+		sleep 1; \
+	done; \
+	if [ -n "$$missing" ]; then \
+		echo "METRICS FAILED $@"; \
+		echo "RADIUSD: $(RADIUSD_RUN)"; \
+		echo "ERROR: Nothing in $(FOUND) matches '$$missing' from $(EXPECTED)"; \
+		echo "--------------------------------------------------"; \
+		echo "Last entries in server log ($(METRICS_RADIUS_LOG)):"; \
+		tail -n 20 "$(METRICS_RADIUS_LOG)"; \
+		rm -f $(BUILD_DIR)/tests/test.metrics; \
+		$(MAKE) --no-print-directory test.metrics.radiusd_kill; \
+		exit 1; \
+	fi; \
+	touch $@
+
+.NO_PARALLEL: $(TEST)
+$(TEST):
+	${Q}$(MAKE) --no-print-directory $@.radiusd_stop
+	@touch $(BUILD_DIR)/tests/$@
@@ -0,0 +1,4 @@
+#
+#  Test the "sharded" cache driver
+#
+cache_sharded.test:
@@ -0,0 +1,17 @@
+#
+#  Test the "memory_ippool" module
+#
+
+MEMORY_IPPOOL_JOURNAL := $(BUILD_DIR)/tests/modules/memory_ippool/test.journal
+export MEMORY_IPPOOL_JOURNAL
+
+#
+#  Every test loads, and rewrites, the journal.  So the tests are
+#  run one after another, ending with the ones which check what's
+#  left in the journal.
+#
+$(BUILD_DIR)/tests/modules/memory_ippool/update: $(BUILD_DIR)/tests/modules/memory_ippool/alloc
+$(BUILD_DIR)/tests/modules/memory_ippool/release: $(BUILD_DIR)/tests/modules/memory_ippool/update
+$(BUILD_DIR)/tests/modules/memory_ippool/full_word: $(BUILD_DIR)/tests/modules/memory_ippool/release
+$(BUILD_DIR)/tests/modules/memory_ippool/journal_write: $(BUILD_DIR)/tests/modules/memory_ippool/full_word
+$(BUILD_DIR)/tests/modules/memory_ippool/journal_replay: $(BUILD_DIR)/tests/modules/memory_ippool/journal_write
@@ -0,0 +1,43 @@
+#!/bin/sh
+#
+#  Pretends to be "ntlm_auth --helper-protocol=ntlm-server-1"
+#
+#  The first octet of the NT-Response says what to do.
+#
+#	01 - accept, and return a User-Session-Key.
+#	02 - reject, the account is locked out.
+#	03 - reject, with an error ntlm_auth_error() doesn't know.
+#	04 - exit without responding.
+#	05 - don't respond.
+#
+while read -r line; do
+	case "$line" in
+	NT-Response:*)
+		response="${line#NT-Response: }"
+		;;
+
+	.)
+		case "$response" in
+		01*)
+			printf 'Authenticated: Yes\nUser-Session-Key: 000102030405060708090A0B0C0D0E0F\n.\n'
+			;;
+
+		02*)
+			printf 'Authenticated: No\nAuthentication-Error: NT_STATUS_ACCOUNT_LOCKED_OUT\n.\n'
+			;;
+
+		03*)
+			printf 'Authenticated: No\nAuthentication-Error: NT_STATUS_WRONG_PASSWORD\n.\n'
+			;;
+
+		04*)
+			exit 1
+			;;
+
+		05*)
+			sleep 5
+			;;
+		esac
+		;;
+	esac
+done
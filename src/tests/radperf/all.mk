@@ -0,0 +1,69 @@
+#
+#	Tests for radperf against the radiusd.
+#
+
+#
+#	Test name
+#
+TEST  := test.radperf
+FILES := $(subst $(DIR)/,,$(wildcard $(DIR)/*.txt))
+
+$(eval $(call TEST_BOOTSTRAP))
+
+#
+#  Generic rules to start / stop the radius service.
+#
+CLIENT := radperf
+include src/tests/radiusd.mk
+$(eval $(call RADIUSD_SERVICE,radiusd,$(OUTPUT)))
+
+#
+#	Run radperf against the radiusd.  The rates and latencies
+#	change from run to run, so they're checked for order, and
+#	then replaced before the output is compared.
+#
+$(OUTPUT)/%: $(DIR)/% | $(TEST).radiusd_kill $(TEST).radiusd_start
+	$(eval TARGET   := $(notdir $<)$(E))
+	$(eval TYPE     := $(shell echo $(TARGET) | cut -f1 -d '_'))
+	$(eval EXPECTED := $(patsubst %.txt,%.out,$<))
+	$(eval FOUND    := $(patsubst %.txt,%.out,$@))
+	$(eval ARGV     := $(shell grep "#.*ARGV:" $< | cut -f2 -d ':'))
+	$(eval RADPERF  := $(TEST_BIN)/radperf -q $(ARGV) -f $< -d src/tests/radperf/config -D share/dictionary 127.0.0.1:$(radperf_port) $(TYPE) $(SECRET))
+
+	$(Q)echo "RADPERF-TEST INPUT=$(TARGET) ARGV=\"$(ARGV)\""
+	$(Q)[ -f $(dir $@)/radiusd.pid ] || exit 1
+	$(Q)if ! $(RADPERF) 1> $(FOUND).raw 2>&1; then \
+		echo "FAILED";                                              \
+		cat $(FOUND).raw;                                           \
+		rm -f $(BUILD_DIR)/tests/test.radperf;                      \
+		$(MAKE) --no-print-directory test.radperf.radiusd_kill;     \
+		echo "RADIUSD: $(RADIUSD_RUN)";                             \
+		echo "RADPERF: $(RADPERF)";                                 \
+		exit 1;                                                     \
+	fi
+	$(Q)if ! awk -f src/tests/radperf/latency.awk $(FOUND).raw; then    \
+		echo "RADPERF FAILED $@";                                   \
+		cat $(FOUND).raw;                                           \
+		rm -f $(BUILD_DIR)/tests/test.radperf;                      \
+		$(MAKE) --no-print-directory test.radperf.radiusd_kill;     \
+		exit 1;                                                     \
+	fi
+	$(Q)sed -e 's/ ([0-9]*\/s)$$//'                                 \
+		-e 's/^Sent for [0-9.]*s /Sent for <time> /'                \
+		-e 's/^\([[:space:]]*Latency [^:]*: \).*$$/\1<time>/'  \
+		-e '/^Executing: /d' $(FOUND).raw > $(FOUND)
+	$(Q)if ! diff $(EXPECTED) $(FOUND); then                            \
+		echo "RADPERF FAILED $@";                                   \
+		echo "RADIUSD: $(RADIUSD_RUN)";                             \
+		echo "RADPERF: $(RADPERF)";                                 \
+		echo "ERROR: File $(FOUND) is not the same as $(EXPECTED)"; \
+		rm -f $(BUILD_DIR)/tests/test.radperf;                      \
+		$(MAKE) --no-print-directory test.radperf.radiusd_kill;     \
+		exit 1;                                                     \
+	fi
+	$(Q)touch $@
+
+.NO_PARALLEL: $(TEST)
+$(TEST):
+	$(Q)$(MAKE) --no-print-directory $@.radiusd_stop
+	@touch $(BUILD_DIR)/tests/$@
@@ -0,0 +1,37 @@
+#
+#	Check that the latency histogram in the radperf summary is
+#	ordered: min <= p50 <= ... <= max.  The mean is skipped, as it
+#	may be larger than some of the percentiles.
+#
+#	Exits non-zero if a value is out of order, or missing.
+#
+function nsec(str) {
+	if (str ~ /ms$/) return substr(str, 1, length(str) - 2) * 1000000
+	if (str ~ /us$/) return substr(str, 1, length(str) - 2) * 1000
+	return substr(str, 1, length(str) - 2)
+}
+
+/^\tLatency mean/ { next }
+
+/^\tLatency / {
+	value = nsec($NF)
+	if (seen && (value < last)) {
+		print "radperf latency out of order: " $0
+		bad = 1
+	}
+	last = value
+	seen++
+	next
+}
+
+/^[A-Z]/ { last = 0; seen = 0 }
+
+/^\tSent / { sections++ }
+
+END {
+	if (!sections) {
+		print "radperf printed no statistics"
+		bad = 1
+	}
+	exit bad
+}